@@ -31,6 +31,7 @@
 
 #include "base/correspondence_graph.h"
 
+#include <limits>
 #include <unordered_set>
 
 #include "base/pose.h"
@@ -38,7 +39,12 @@
 
 namespace colmap {
 
-CorrespondenceGraph::CorrespondenceGraph() {}
+const size_t CorrespondenceGraph::kNoCorrsOffsets =
+    std::numeric_limits<size_t>::max();
+const size_t CorrespondenceGraph::kInvalidImageIdx =
+    std::numeric_limits<size_t>::max();
+
+CorrespondenceGraph::CorrespondenceGraph() : finalized_(false) {}
 
 std::unordered_map<image_pair_t, point2D_t>
 CorrespondenceGraph::NumCorrespondencesBetweenImages() const {
@@ -52,31 +58,135 @@ CorrespondenceGraph::NumCorrespondencesBetweenImages() const {
 }
 
 void CorrespondenceGraph::Finalize() {
-  for (auto it = images_.begin(); it != images_.end();) {
-    it->second.num_observations = 0;
-    for (auto& corr : it->second.corrs) {
-      corr.shrink_to_fit();
-      if (corr.size() > 0) {
-        it->second.num_observations += 1;
+  CHECK(!IsView()) << "Cannot modify a view of a correspondence graph";
+
+  // Count the observations and the total number of points and correspondences
+  // of the images that are kept.
+  size_t num_points2D = 0;
+  size_t num_corrs = 0;
+  for (auto& image : images_) {
+    image.num_observations = 0;
+    for (point2D_t point2D_idx = 0; point2D_idx < image.num_points2D;
+         ++point2D_idx) {
+      const size_t num_point_corrs =
+          FindCorrespondences(image, point2D_idx).size();
+      if (num_point_corrs > 0) {
+        image.num_observations += 1;
+        num_corrs += num_point_corrs;
       }
     }
-    if (it->second.num_observations == 0) {
-      images_.erase(it++);
-    } else {
-      ++it;
+    if (image.num_observations > 0) {
+      num_points2D += image.num_points2D;
+    }
+  }
+
+  // Compact the correspondences of all remaining images into a single array.
+  // Correspondences are symmetric, so images without observations are not
+  // referenced by any other image and can be deleted.
+
+  std::vector<Image> compact_images;
+  std::vector<size_t> compact_image_idxs(image_idxs_.size(), kInvalidImageIdx);
+  auto compact_corrs = std::make_shared<CompactCorrespondences>();
+  compact_corrs->offsets.reserve(num_points2D + 1);
+  compact_corrs->corrs.reserve(num_corrs);
+
+  for (auto& image : images_) {
+    if (image.num_observations == 0) {
+      continue;
+    }
+
+    Image compact_image;
+    compact_image.image_id = image.image_id;
+    compact_image.num_points2D = image.num_points2D;
+    compact_image.num_observations = image.num_observations;
+    compact_image.num_correspondences = image.num_correspondences;
+    compact_image.corrs_offsets_begin = compact_corrs->offsets.size();
+
+    for (point2D_t point2D_idx = 0; point2D_idx < image.num_points2D;
+         ++point2D_idx) {
+      compact_corrs->offsets.push_back(compact_corrs->corrs.size());
+      const CorrespondenceRange corrs = FindCorrespondences(image, point2D_idx);
+      compact_corrs->corrs.insert(compact_corrs->corrs.end(), corrs.begin(),
+                                  corrs.end());
+    }
+
+    // Release the memory of the per-point correspondences early to reduce the
+    // peak memory usage during compaction.
+    image.corrs.clear();
+    image.corrs.shrink_to_fit();
+
+    compact_image_idxs[compact_image.image_id] = compact_images.size();
+    compact_images.push_back(std::move(compact_image));
+  }
+
+  compact_corrs->offsets.push_back(compact_corrs->corrs.size());
+
+  images_ = std::move(compact_images);
+  image_idxs_ = std::move(compact_image_idxs);
+  compact_corrs_ = std::move(compact_corrs);
+  finalized_ = true;
+}
+
+size_t CorrespondenceGraph::NumBytes() const {
+  // Approximate size of a hash map node including its bucket.
+  const auto MapNumBytes = [](const size_t size, const size_t num_buckets,
+                              const size_t value_size) {
+    return num_buckets * sizeof(void*) + size * (value_size + sizeof(void*));
+  };
+
+  size_t num_bytes = sizeof(CorrespondenceGraph);
+  num_bytes += images_.capacity() * sizeof(Image);
+  num_bytes += image_idxs_.capacity() * sizeof(size_t);
+  num_bytes += MapNumBytes(image_pairs_.size(), image_pairs_.bucket_count(),
+                           sizeof(std::pair<image_pair_t, ImagePair>));
+  // The compact correspondences are only attributed to the graph that owns
+  // them and not to its views.
+  if (compact_corrs_ && !IsView()) {
+    num_bytes += sizeof(CompactCorrespondences);
+    num_bytes += compact_corrs_->offsets.capacity() * sizeof(size_t);
+    num_bytes += compact_corrs_->corrs.capacity() * sizeof(Correspondence);
+  }
+  num_bytes += image_mask_.capacity() * sizeof(char);
+  for (const auto& image : images_) {
+    num_bytes += image.corrs.capacity() * sizeof(std::vector<Correspondence>);
+    for (const auto& corrs : image.corrs) {
+      num_bytes += corrs.capacity() * sizeof(Correspondence);
     }
   }
+
+  return num_bytes;
 }
 
 void CorrespondenceGraph::AddImage(const image_t image_id,
                                    const size_t num_points) {
+  CHECK(!IsView()) << "Cannot modify a view of a correspondence graph";
   CHECK(!ExistsImage(image_id));
-  images_[image_id].corrs.resize(num_points);
+
+  Image image;
+  image.image_id = image_id;
+  image.num_points2D = static_cast<point2D_t>(num_points);
+
+  if (finalized_) {
+    // The new image has no correspondences, so the immutable compact
+    // correspondences do not need to be extended.
+    image.corrs_offsets_begin = kNoCorrsOffsets;
+  } else {
+    image.corrs.resize(num_points);
+  }
+
+  if (image_id >= image_idxs_.size()) {
+    image_idxs_.resize(static_cast<size_t>(image_id) + 1, kInvalidImageIdx);
+  }
+  image_idxs_[image_id] = images_.size();
+  images_.push_back(std::move(image));
 }
 
 void CorrespondenceGraph::AddCorrespondences(const image_t image_id1,
                                              const image_t image_id2,
                                              const FeatureMatches& matches) {
+  CHECK(!finalized_)
+      << "Cannot add correspondences to a finalized correspondence graph";
+
   // Avoid self-matches - should only happen, if user provides custom matches.
   if (image_id1 == image_id2) {
     std::cout << "WARNING: Cannot use self-matches for image_id=" << image_id1
@@ -85,8 +195,8 @@ void CorrespondenceGraph::AddCorrespondences(const image_t image_id1,
   }
 
   // Corresponding images.
-  struct Image& image1 = images_.at(image_id1);
-  struct Image& image2 = images_.at(image_id2);
+  struct Image& image1 = GetImage(image_id1);
+  struct Image& image2 = GetImage(image_id2);
 
   // Store number of correspondences for each image to find good initial pair.
   image1.num_correspondences += matches.size();
@@ -160,12 +270,79 @@ void CorrespondenceGraph::AddCorrespondences(const image_t image_id1,
   }
 }
 
+CorrespondenceGraph CorrespondenceGraph::CreateSubgraphView(
+    const std::unordered_set<image_t>& image_ids) const {
+  CHECK(finalized_) << "Only finalized correspondence graphs can be viewed";
+  CHECK(!IsView()) << "Cannot create a view of a view";
+
+  CorrespondenceGraph view;
+  view.finalized_ = true;
+  view.compact_corrs_ = compact_corrs_;
+
+  image_t max_image_id = 0;
+  for (const auto& image : images_) {
+    max_image_id = std::max(max_image_id, image.image_id);
+  }
+
+  view.image_mask_.resize(static_cast<size_t>(max_image_id) + 1, 0);
+  view.image_idxs_.resize(view.image_mask_.size(), kInvalidImageIdx);
+  for (const image_t image_id : image_ids) {
+    if (ExistsImage(image_id)) {
+      view.image_mask_[image_id] = 1;
+    }
+  }
+
+  for (const auto& image_pair : image_pairs_) {
+    image_t image_id1;
+    image_t image_id2;
+    Database::PairIdToImagePair(image_pair.first, &image_id1, &image_id2);
+    if (view.image_mask_[image_id1] && view.image_mask_[image_id2]) {
+      view.image_pairs_.emplace(image_pair.first, image_pair.second);
+    }
+  }
+
+  // Count the observations and correspondences in the subgraph. Images
+  // without any correspondences to other images of the subgraph are omitted.
+  // Correspondences are symmetric, so the omitted images are not referenced
+  // by any correspondence of the view.
+  for (const auto& image : images_) {
+    if (!view.image_mask_[image.image_id]) {
+      continue;
+    }
+
+    Image view_image;
+    view_image.image_id = image.image_id;
+    view_image.num_points2D = image.num_points2D;
+    view_image.corrs_offsets_begin = image.corrs_offsets_begin;
+    for (point2D_t point2D_idx = 0; point2D_idx < image.num_points2D;
+         ++point2D_idx) {
+      const size_t num_point_corrs =
+          view.FindCorrespondences(view_image, point2D_idx).size();
+      if (num_point_corrs > 0) {
+        view_image.num_observations += 1;
+        view_image.num_correspondences += num_point_corrs;
+      }
+    }
+
+    if (view_image.num_observations == 0) {
+      view.image_mask_[image.image_id] = 0;
+      continue;
+    }
+
+    view.image_idxs_[view_image.image_id] = view.images_.size();
+    view.images_.push_back(std::move(view_image));
+  }
+
+  return view;
+}
+
 std::vector<CorrespondenceGraph::Correspondence>
 CorrespondenceGraph::FindTransitiveCorrespondences(
     const image_t image_id, const point2D_t point2D_idx,
     const size_t transitivity) const {
   if (transitivity == 1) {
-    return FindCorrespondences(image_id, point2D_idx);
+    const CorrespondenceRange corrs = FindCorrespondences(image_id, point2D_idx);
+    return std::vector<Correspondence>(corrs.begin(), corrs.end());
   }
 
   std::vector<Correspondence> found_corrs;
@@ -175,8 +352,13 @@ CorrespondenceGraph::FindTransitiveCorrespondences(
 
   found_corrs.emplace_back(image_id, point2D_idx);
 
-  std::unordered_map<image_t, std::unordered_set<point2D_t>> image_corrs;
-  image_corrs[image_id].insert(point2D_idx);
+  // Observations are uniquely identified by their image and point index.
+  const auto ObservationKey = [](const Correspondence& corr) {
+    return (static_cast<uint64_t>(corr.image_id) << 32) | corr.point2D_idx;
+  };
+
+  std::unordered_set<uint64_t> found_observations;
+  found_observations.insert(ObservationKey(found_corrs.front()));
 
   size_t corr_queue_begin = 0;
   size_t corr_queue_end = found_corrs.size();
@@ -187,16 +369,13 @@ CorrespondenceGraph::FindTransitiveCorrespondences(
     for (size_t i = corr_queue_begin; i < corr_queue_end; ++i) {
       const Correspondence ref_corr = found_corrs[i];
 
-      const Image& image = images_.at(ref_corr.image_id);
-      const std::vector<Correspondence>& ref_corrs =
-          image.corrs[ref_corr.point2D_idx];
+      const CorrespondenceRange ref_corrs =
+          FindCorrespondences(GetImage(ref_corr.image_id), ref_corr.point2D_idx);
 
       for (const Correspondence corr : ref_corrs) {
         // Check if correspondence already collected, otherwise collect.
-        auto& corr_image_corrs = image_corrs[corr.image_id];
-        if (corr_image_corrs.count(corr.point2D_idx) == 0) {
-          corr_image_corrs.insert(corr.point2D_idx);
-          found_corrs.emplace_back(corr.image_id, corr.point2D_idx);
+        if (found_observations.insert(ObservationKey(corr)).second) {
+          found_corrs.push_back(corr);
         }
       }
     }
@@ -233,11 +412,12 @@ FeatureMatches CorrespondenceGraph::FindCorrespondencesBetweenImages(
   FeatureMatches found_corrs;
   found_corrs.reserve(num_correspondences);
 
-  const struct Image& image1 = images_.at(image_id1);
+  const struct Image& image1 = GetImage(image_id1);
 
-  for (point2D_t point2D_idx1 = 0; point2D_idx1 < image1.corrs.size();
+  for (point2D_t point2D_idx1 = 0; point2D_idx1 < image1.num_points2D;
        ++point2D_idx1) {
-    for (const Correspondence& corr1 : image1.corrs[point2D_idx1]) {
+    for (const Correspondence& corr1 :
+         FindCorrespondences(image1, point2D_idx1)) {
       if (corr1.image_id == image_id2) {
         found_corrs.emplace_back(point2D_idx1, corr1.point2D_idx);
       }
@@ -249,15 +429,12 @@ FeatureMatches CorrespondenceGraph::FindCorrespondencesBetweenImages(
 
 bool CorrespondenceGraph::IsTwoViewObservation(
     const image_t image_id, const point2D_t point2D_idx) const {
-  const struct Image& image = images_.at(image_id);
-  const std::vector<Correspondence>& corrs = image.corrs.at(point2D_idx);
+  const CorrespondenceRange corrs = FindCorrespondences(image_id, point2D_idx);
   if (corrs.size() != 1) {
     return false;
   }
-  const struct Image& other_image = images_.at(corrs[0].image_id);
-  const std::vector<Correspondence>& other_corrs =
-      other_image.corrs.at(corrs[0].point2D_idx);
-  return other_corrs.size() == 1;
+  const Correspondence& corr = *corrs.begin();
+  return FindCorrespondences(corr.image_id, corr.point2D_idx).size() == 1;
 }
 
 }  // namespace colmap
@@ -32,10 +32,14 @@
 #ifndef COLMAP_SRC_BASE_CORRESPONDENCE_GRAPH_H_
 #define COLMAP_SRC_BASE_CORRESPONDENCE_GRAPH_H_
 
+#include <iterator>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "base/database.h"
+#include "util/logging.h"
 #include "util/types.h"
 
 namespace colmap {
@@ -57,6 +61,83 @@ class CorrespondenceGraph {
     point2D_t point2D_idx;
   };
 
+  // Read-only range of the correspondences of an image point. The range is
+  // invalidated when the correspondence graph is modified. For views of a
+  // subgraph, the correspondences to images outside of the subgraph are
+  // skipped while iterating, which makes `size` linear in the number of
+  // correspondences of the point in the full graph. Hence, the range provides
+  // no random access and should be traversed with its iterators.
+  class CorrespondenceRange {
+   public:
+    class Iterator {
+     public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef Correspondence value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const Correspondence* pointer;
+      typedef const Correspondence& reference;
+
+      Iterator(const Correspondence* corr, const Correspondence* end,
+               const char* image_mask)
+          : corr_(corr), end_(end), image_mask_(image_mask) {
+        SkipMasked();
+      }
+
+      inline reference operator*() const { return *corr_; }
+      inline pointer operator->() const { return corr_; }
+      inline Iterator& operator++() {
+        ++corr_;
+        SkipMasked();
+        return *this;
+      }
+      inline Iterator operator++(int) {
+        Iterator it = *this;
+        ++(*this);
+        return it;
+      }
+      inline bool operator==(const Iterator& other) const {
+        return corr_ == other.corr_;
+      }
+      inline bool operator!=(const Iterator& other) const {
+        return corr_ != other.corr_;
+      }
+
+     private:
+      inline void SkipMasked() {
+        if (image_mask_ != nullptr) {
+          while (corr_ != end_ && !image_mask_[corr_->image_id]) {
+            ++corr_;
+          }
+        }
+      }
+
+      const Correspondence* corr_;
+      const Correspondence* end_;
+      const char* image_mask_;
+    };
+
+    CorrespondenceRange(const Correspondence* begin, const Correspondence* end,
+                        const char* image_mask = nullptr)
+        : begin_(begin), end_(end), image_mask_(image_mask) {}
+
+    inline Iterator begin() const {
+      return Iterator(begin_, end_, image_mask_);
+    }
+    inline Iterator end() const { return Iterator(end_, end_, image_mask_); }
+    inline size_t size() const {
+      if (image_mask_ == nullptr) {
+        return end_ - begin_;
+      }
+      return std::distance(begin(), end());
+    }
+    inline bool empty() const { return begin() == end(); }
+
+   private:
+    const Correspondence* begin_;
+    const Correspondence* end_;
+    const char* image_mask_;
+  };
+
   CorrespondenceGraph();
 
   // Number of added images.
@@ -88,21 +169,45 @@ class CorrespondenceGraph {
   // - Calculates the number of observations per image by counting the number
   //   of image points that have at least one correspondence.
   // - Deletes images without observations, as they are useless for SfM.
-  // - Shrinks the correspondence vectors to their size to save memory.
+  // - Compacts the correspondences of all image points into a single array in
+  //   compressed sparse row format to save memory and speed up queries.
+  //
+  // Images without correspondences can still be added after finalization,
+  // but no correspondences, since the compact correspondences are immutable.
   void Finalize();
 
+  // Whether the graph is in its compact, finalized representation.
+  inline bool IsFinalized() const;
+
+  // Create a read-only view of the subgraph of the given images, which only
+  // contains the correspondences between these images. The view only stores
+  // the statistics of its images and image pairs and shares ownership of the
+  // finalized correspondences with this graph. Hence, the view stays valid
+  // when this graph is modified, copied, or destroyed. This graph must be
+  // finalized. As in `Finalize`, images without correspondences in the
+  // subgraph are omitted.
+  CorrespondenceGraph CreateSubgraphView(
+      const std::unordered_set<image_t>& image_ids) const;
+
+  // Whether the graph is a view of the subgraph of another graph.
+  inline bool IsView() const;
+
+  // Approximate number of bytes used by the correspondence graph.
+  size_t NumBytes() const;
+
   // Add new image to the correspondence graph.
   void AddImage(const image_t image_id, const size_t num_points2D);
 
   // Add correspondences between images. This function ignores invalid
   // correspondences where the point indices are out of bounds or duplicate
   // correspondences between the same image points. Whenever either of the two
-  // cases occur this function prints a warning to the standard output.
+  // cases occur this function prints a warning to the standard output. The
+  // graph must not be finalized.
   void AddCorrespondences(const image_t image_id1, const image_t image_id2,
                           const FeatureMatches& matches);
 
   // Find the correspondence of an image observation to all other images.
-  inline const std::vector<Correspondence>& FindCorrespondences(
+  inline CorrespondenceRange FindCorrespondences(
       const image_t image_id, const point2D_t point2D_idx) const;
 
   // Find correspondences to the given observation.
@@ -133,6 +238,11 @@ class CorrespondenceGraph {
 
  private:
   struct Image {
+    image_t image_id = kInvalidImageId;
+
+    // Number of 2D points in the image.
+    point2D_t num_points2D = 0;
+
     // Number of 2D points with at least one correspondence to another image.
     point2D_t num_observations = 0;
 
@@ -140,7 +250,12 @@ class CorrespondenceGraph {
     // to find a good initial pair, that is connected to many images.
     point2D_t num_correspondences = 0;
 
-    // Correspondences to other images per image point.
+    // Index of the first image point in the offsets of the compact
+    // correspondences, if finalized. Images added after finalization have no
+    // correspondences and are marked with `kNoCorrsOffsets`.
+    size_t corrs_offsets_begin = 0;
+
+    // Correspondences to other images per image point, if not finalized.
     std::vector<std::vector<Correspondence>> corrs;
   };
 
@@ -149,8 +264,40 @@ class CorrespondenceGraph {
     point2D_t num_correspondences = 0;
   };
 
-  EIGEN_STL_UMAP(image_t, Image) images_;
+  inline const Image& GetImage(const image_t image_id) const;
+  inline Image& GetImage(const image_t image_id);
+
+  inline CorrespondenceRange FindCorrespondences(
+      const Image& image, const point2D_t point2D_idx) const;
+
+  // Images are densely stored and their indices are looked up by their
+  // identifier in `image_idxs_`, which is dense as well, since identifiers are
+  // assigned consecutively by the database. Missing images are marked with
+  // `kInvalidImageIdx`.
+  std::vector<Image> images_;
+  std::vector<size_t> image_idxs_;
+  static const size_t kInvalidImageIdx;
+
   std::unordered_map<image_pair_t, ImagePair> image_pairs_;
+
+  // The finalized correspondences of all image points. The correspondences of
+  // point `point2D_idx` in `image` are stored in `corrs` in the range from
+  // `offsets[image.corrs_offsets_begin + point2D_idx]` to
+  // `offsets[image.corrs_offsets_begin + point2D_idx + 1]`.
+  struct CompactCorrespondences {
+    std::vector<size_t> offsets;
+    std::vector<Correspondence> corrs;
+  };
+
+  static const size_t kNoCorrsOffsets;
+
+  // The finalized correspondences are immutable and shared with all views.
+  bool finalized_;
+  std::shared_ptr<const CompactCorrespondences> compact_corrs_;
+
+  // If this graph is a view, the mask of the images in the view indexed by
+  // their identifier.
+  std::vector<char> image_mask_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -164,17 +311,18 @@ size_t CorrespondenceGraph::NumImagePairs() const {
 }
 
 bool CorrespondenceGraph::ExistsImage(const image_t image_id) const {
-  return images_.find(image_id) != images_.end();
+  return image_id < image_idxs_.size() &&
+         image_idxs_[image_id] != kInvalidImageIdx;
 }
 
 point2D_t CorrespondenceGraph::NumObservationsForImage(
     const image_t image_id) const {
-  return images_.at(image_id).num_observations;
+  return GetImage(image_id).num_observations;
 }
 
 point2D_t CorrespondenceGraph::NumCorrespondencesForImage(
     const image_t image_id) const {
-  return images_.at(image_id).num_correspondences;
+  return GetImage(image_id).num_correspondences;
 }
 
 point2D_t CorrespondenceGraph::NumCorrespondencesBetweenImages(
@@ -189,15 +337,52 @@ point2D_t CorrespondenceGraph::NumCorrespondencesBetweenImages(
   }
 }
 
-const std::vector<CorrespondenceGraph::Correspondence>&
+bool CorrespondenceGraph::IsFinalized() const { return finalized_; }
+
+bool CorrespondenceGraph::IsView() const { return !image_mask_.empty(); }
+
+CorrespondenceGraph::CorrespondenceRange
 CorrespondenceGraph::FindCorrespondences(const image_t image_id,
                                          const point2D_t point2D_idx) const {
-  return images_.at(image_id).corrs.at(point2D_idx);
+  const Image& image = GetImage(image_id);
+  CHECK_LT(point2D_idx, image.num_points2D);
+  return FindCorrespondences(image, point2D_idx);
 }
 
 bool CorrespondenceGraph::HasCorrespondences(
     const image_t image_id, const point2D_t point2D_idx) const {
-  return !images_.at(image_id).corrs.at(point2D_idx).empty();
+  return !FindCorrespondences(image_id, point2D_idx).empty();
+}
+
+const CorrespondenceGraph::Image& CorrespondenceGraph::GetImage(
+    const image_t image_id) const {
+  CHECK(ExistsImage(image_id)) << "Image " << image_id << " does not exist";
+  return images_[image_idxs_[image_id]];
+}
+
+CorrespondenceGraph::Image& CorrespondenceGraph::GetImage(
+    const image_t image_id) {
+  CHECK(ExistsImage(image_id)) << "Image " << image_id << " does not exist";
+  return images_[image_idxs_[image_id]];
+}
+
+CorrespondenceGraph::CorrespondenceRange
+CorrespondenceGraph::FindCorrespondences(const Image& image,
+                                         const point2D_t point2D_idx) const {
+  if (finalized_) {
+    if (image.corrs_offsets_begin == kNoCorrsOffsets) {
+      return CorrespondenceRange(nullptr, nullptr);
+    }
+    const size_t offset_idx = image.corrs_offsets_begin + point2D_idx;
+    const Correspondence* corrs = compact_corrs_->corrs.data();
+    return CorrespondenceRange(
+        corrs + compact_corrs_->offsets[offset_idx],
+        corrs + compact_corrs_->offsets[offset_idx + 1],
+        image_mask_.empty() ? nullptr : image_mask_.data());
+  } else {
+    const std::vector<Correspondence>& corrs = image.corrs[point2D_idx];
+    return CorrespondenceRange(corrs.data(), corrs.data() + corrs.size());
+  }
 }
 
 }  // namespace colmap
@@ -88,55 +88,55 @@ BOOST_AUTO_TEST_CASE(TestTwoView) {
   BOOST_CHECK(correspondence_graph.HasCorrespondences(0, 0));
   BOOST_CHECK(correspondence_graph.IsTwoViewObservation(0, 0));
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 0).at(0).image_id, 1);
+      correspondence_graph.FindCorrespondences(0, 0).begin()->image_id, 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 0).at(0).point2D_idx, 0);
+      correspondence_graph.FindCorrespondences(0, 0).begin()->point2D_idx, 0);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 0).size(), 1);
   BOOST_CHECK(correspondence_graph.HasCorrespondences(1, 0));
   BOOST_CHECK(correspondence_graph.IsTwoViewObservation(1, 0));
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 0).at(0).image_id, 0);
+      correspondence_graph.FindCorrespondences(1, 0).begin()->image_id, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 0).at(0).point2D_idx, 0);
+      correspondence_graph.FindCorrespondences(1, 0).begin()->point2D_idx, 0);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(0, 1).size(), 1);
   BOOST_CHECK(correspondence_graph.HasCorrespondences(0, 1));
   BOOST_CHECK(correspondence_graph.IsTwoViewObservation(0, 1));
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 1).at(0).image_id, 1);
+      correspondence_graph.FindCorrespondences(0, 1).begin()->image_id, 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 1).at(0).point2D_idx, 2);
+      correspondence_graph.FindCorrespondences(0, 1).begin()->point2D_idx, 2);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 2).size(), 1);
   BOOST_CHECK(correspondence_graph.HasCorrespondences(1, 2));
   BOOST_CHECK(correspondence_graph.IsTwoViewObservation(1, 2));
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 2).at(0).image_id, 0);
+      correspondence_graph.FindCorrespondences(1, 2).begin()->image_id, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 2).at(0).point2D_idx, 1);
+      correspondence_graph.FindCorrespondences(1, 2).begin()->point2D_idx, 1);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(0, 4).size(), 1);
   BOOST_CHECK(correspondence_graph.HasCorrespondences(0, 3));
   BOOST_CHECK(correspondence_graph.IsTwoViewObservation(0, 4));
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 3).at(0).image_id, 1);
+      correspondence_graph.FindCorrespondences(0, 3).begin()->image_id, 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 3).at(0).point2D_idx, 7);
+      correspondence_graph.FindCorrespondences(0, 3).begin()->point2D_idx, 7);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 4).at(0).image_id, 1);
+      correspondence_graph.FindCorrespondences(0, 4).begin()->image_id, 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 4).at(0).point2D_idx, 8);
+      correspondence_graph.FindCorrespondences(0, 4).begin()->point2D_idx, 8);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 7).size(), 1);
   BOOST_CHECK(correspondence_graph.HasCorrespondences(1, 7));
   BOOST_CHECK(correspondence_graph.IsTwoViewObservation(1, 7));
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 7).at(0).image_id, 0);
+      correspondence_graph.FindCorrespondences(1, 7).begin()->image_id, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 7).at(0).point2D_idx, 3);
+      correspondence_graph.FindCorrespondences(1, 7).begin()->point2D_idx, 3);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 8).size(), 1);
   BOOST_CHECK(correspondence_graph.HasCorrespondences(1, 8));
   BOOST_CHECK(correspondence_graph.IsTwoViewObservation(1, 8));
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 8).at(0).image_id, 0);
+      correspondence_graph.FindCorrespondences(1, 8).begin()->image_id, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 8).at(0).point2D_idx, 4);
+      correspondence_graph.FindCorrespondences(1, 8).begin()->point2D_idx, 4);
   for (size_t i = 0; i < 10; ++i) {
     BOOST_CHECK_EQUAL(
         correspondence_graph.FindTransitiveCorrespondences(0, i, 0).size(), 0);
@@ -245,41 +245,53 @@ BOOST_AUTO_TEST_CASE(TestThreeView) {
       correspondence_graph.NumCorrespondencesBetweenImages().at(pair_id12), 2);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(0, 0).size(), 2);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 0).at(0).image_id, 1);
+      correspondence_graph.FindCorrespondences(0, 0).begin()->image_id, 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 0).at(0).point2D_idx, 0);
+      correspondence_graph.FindCorrespondences(0, 0).begin()->point2D_idx, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 0).at(1).image_id, 2);
+      std::next(correspondence_graph.FindCorrespondences(0, 0).begin())
+          ->image_id,
+      2);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(0, 0).at(1).point2D_idx, 0);
+      std::next(correspondence_graph.FindCorrespondences(0, 0).begin())
+          ->point2D_idx,
+      0);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 0).size(), 2);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 0).at(0).image_id, 0);
+      correspondence_graph.FindCorrespondences(1, 0).begin()->image_id, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 0).at(0).point2D_idx, 0);
+      correspondence_graph.FindCorrespondences(1, 0).begin()->point2D_idx, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 0).at(1).image_id, 2);
+      std::next(correspondence_graph.FindCorrespondences(1, 0).begin())
+          ->image_id,
+      2);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 0).at(1).point2D_idx, 0);
+      std::next(correspondence_graph.FindCorrespondences(1, 0).begin())
+          ->point2D_idx,
+      0);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(2, 0).size(), 2);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(2, 0).at(0).image_id, 0);
+      correspondence_graph.FindCorrespondences(2, 0).begin()->image_id, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(2, 0).at(0).point2D_idx, 0);
+      correspondence_graph.FindCorrespondences(2, 0).begin()->point2D_idx, 0);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(2, 0).at(1).image_id, 1);
+      std::next(correspondence_graph.FindCorrespondences(2, 0).begin())
+          ->image_id,
+      1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(2, 0).at(1).point2D_idx, 0);
+      std::next(correspondence_graph.FindCorrespondences(2, 0).begin())
+          ->point2D_idx,
+      0);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 5).size(), 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 5).at(0).image_id, 2);
+      correspondence_graph.FindCorrespondences(1, 5).begin()->image_id, 2);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(1, 5).at(0).point2D_idx, 5);
+      correspondence_graph.FindCorrespondences(1, 5).begin()->point2D_idx, 5);
   BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(2, 5).size(), 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(2, 5).at(0).image_id, 1);
+      correspondence_graph.FindCorrespondences(2, 5).begin()->image_id, 1);
   BOOST_CHECK_EQUAL(
-      correspondence_graph.FindCorrespondences(2, 5).at(0).point2D_idx, 5);
+      correspondence_graph.FindCorrespondences(2, 5).begin()->point2D_idx, 5);
   for (size_t i = 0; i < 10; ++i) {
     BOOST_CHECK_EQUAL(
         correspondence_graph.FindCorrespondences(0, i).size(),
@@ -371,3 +383,139 @@ BOOST_AUTO_TEST_CASE(TestDuplicate) {
   BOOST_CHECK_EQUAL(
       correspondence_graph.NumCorrespondencesBetweenImages().at(pair_id), 3);
 }
+
+BOOST_AUTO_TEST_CASE(TestFinalize) {
+  CorrespondenceGraph correspondence_graph;
+  correspondence_graph.AddImage(0, 10);
+  correspondence_graph.AddImage(1, 10);
+  correspondence_graph.AddImage(2, 10);
+  correspondence_graph.AddImage(3, 10);
+  FeatureMatches matches(2);
+  matches[0].point2D_idx1 = 0;
+  matches[0].point2D_idx2 = 1;
+  matches[1].point2D_idx1 = 9;
+  matches[1].point2D_idx2 = 9;
+  correspondence_graph.AddCorrespondences(0, 1, matches);
+  correspondence_graph.AddCorrespondences(1, 2, matches);
+  BOOST_CHECK(!correspondence_graph.IsFinalized());
+  const size_t num_bytes = correspondence_graph.NumBytes();
+  correspondence_graph.Finalize();
+  BOOST_CHECK(correspondence_graph.IsFinalized());
+  BOOST_CHECK_LT(correspondence_graph.NumBytes(), num_bytes);
+  BOOST_CHECK_EQUAL(correspondence_graph.NumImages(), 3);
+  BOOST_CHECK(!correspondence_graph.ExistsImage(3));
+  BOOST_CHECK_EQUAL(correspondence_graph.NumObservationsForImage(1), 3);
+  BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 9).size(), 2);
+  BOOST_CHECK_EQUAL(
+      correspondence_graph.FindCorrespondences(1, 9).begin()->image_id, 0);
+  BOOST_CHECK_EQUAL(
+      std::next(correspondence_graph.FindCorrespondences(1, 9).begin())
+          ->image_id,
+      2);
+  BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 1).size(), 1);
+  BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 0).size(), 1);
+  BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 5).size(), 0);
+  BOOST_CHECK(correspondence_graph.IsTwoViewObservation(0, 0));
+  BOOST_CHECK(!correspondence_graph.IsTwoViewObservation(0, 9));
+  BOOST_CHECK_EQUAL(
+      correspondence_graph.FindTransitiveCorrespondences(0, 9, 2).size(), 2);
+  BOOST_CHECK_EQUAL(
+      correspondence_graph.FindCorrespondencesBetweenImages(1, 2).size(), 2);
+
+  // Adding images without correspondences after finalization.
+  correspondence_graph.AddImage(3, 10);
+  correspondence_graph.AddImage(10, 10);
+  BOOST_CHECK(correspondence_graph.IsFinalized());
+  BOOST_CHECK_EQUAL(correspondence_graph.NumImages(), 5);
+  BOOST_CHECK(correspondence_graph.ExistsImage(10));
+  BOOST_CHECK(!correspondence_graph.ExistsImage(9));
+  BOOST_CHECK(!correspondence_graph.ExistsImage(11));
+  BOOST_CHECK(!correspondence_graph.HasCorrespondences(3, 9));
+  BOOST_CHECK_EQUAL(correspondence_graph.NumObservationsForImage(10), 0);
+  BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(2, 9).size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(TestSubgraphView) {
+  CorrespondenceGraph correspondence_graph;
+  correspondence_graph.AddImage(0, 10);
+  correspondence_graph.AddImage(1, 10);
+  correspondence_graph.AddImage(2, 10);
+  correspondence_graph.AddImage(3, 10);
+  FeatureMatches matches(2);
+  matches[0].point2D_idx1 = 0;
+  matches[0].point2D_idx2 = 1;
+  matches[1].point2D_idx1 = 9;
+  matches[1].point2D_idx2 = 9;
+  correspondence_graph.AddCorrespondences(0, 1, matches);
+  correspondence_graph.AddCorrespondences(1, 2, matches);
+  correspondence_graph.AddCorrespondences(0, 2, matches);
+  correspondence_graph.Finalize();
+  BOOST_CHECK(!correspondence_graph.IsView());
+
+  const CorrespondenceGraph view =
+      correspondence_graph.CreateSubgraphView({0, 1, 3});
+  BOOST_CHECK(view.IsView());
+  BOOST_CHECK(view.IsFinalized());
+  BOOST_CHECK_EQUAL(view.NumImages(), 2);
+  BOOST_CHECK(view.ExistsImage(0));
+  BOOST_CHECK(view.ExistsImage(1));
+  BOOST_CHECK(!view.ExistsImage(2));
+  BOOST_CHECK(!view.ExistsImage(3));
+  BOOST_CHECK_EQUAL(view.NumImagePairs(), 1);
+  BOOST_CHECK_EQUAL(view.NumCorrespondencesBetweenImages(0, 1), 2);
+  BOOST_CHECK_EQUAL(view.NumCorrespondencesBetweenImages(1, 2), 0);
+  BOOST_CHECK_EQUAL(view.NumObservationsForImage(1), 2);
+  BOOST_CHECK_EQUAL(view.NumCorrespondencesForImage(1), 2);
+  BOOST_CHECK_EQUAL(correspondence_graph.NumCorrespondencesForImage(1), 4);
+
+  // Correspondences to the image outside of the view are skipped.
+  BOOST_CHECK_EQUAL(correspondence_graph.FindCorrespondences(1, 9).size(), 2);
+  BOOST_CHECK_EQUAL(view.FindCorrespondences(1, 9).size(), 1);
+  BOOST_CHECK_EQUAL(view.FindCorrespondences(1, 9).begin()->image_id, 0);
+  BOOST_CHECK_EQUAL(view.FindCorrespondences(1, 9).begin()->point2D_idx, 9);
+  BOOST_CHECK_EQUAL(view.FindCorrespondences(0, 9).size(), 1);
+  BOOST_CHECK_EQUAL(view.FindCorrespondences(0, 9).begin()->image_id, 1);
+  BOOST_CHECK(!view.FindCorrespondences(0, 9).empty());
+  BOOST_CHECK(view.FindCorrespondences(1, 5).empty());
+  size_t num_corrs = 0;
+  for (const auto& corr : view.FindCorrespondences(0, 9)) {
+    BOOST_CHECK_EQUAL(corr.image_id, 1);
+    num_corrs += 1;
+  }
+  BOOST_CHECK_EQUAL(num_corrs, 1);
+
+  BOOST_CHECK(!correspondence_graph.IsTwoViewObservation(0, 9));
+  BOOST_CHECK(view.IsTwoViewObservation(0, 9));
+  BOOST_CHECK_EQUAL(
+      correspondence_graph.FindTransitiveCorrespondences(0, 9, 2).size(), 2);
+  BOOST_CHECK_EQUAL(view.FindTransitiveCorrespondences(0, 9, 2).size(), 1);
+  BOOST_CHECK_EQUAL(view.FindCorrespondencesBetweenImages(0, 1).size(), 2);
+  BOOST_CHECK_LT(view.NumBytes(), correspondence_graph.NumBytes());
+}
+
+BOOST_AUTO_TEST_CASE(TestSubgraphViewOutlivesGraph) {
+  std::unique_ptr<CorrespondenceGraph> correspondence_graph(
+      new CorrespondenceGraph());
+  correspondence_graph->AddImage(0, 10);
+  correspondence_graph->AddImage(1, 10);
+  correspondence_graph->AddImage(2, 10);
+  FeatureMatches matches(1);
+  matches[0].point2D_idx1 = 9;
+  matches[0].point2D_idx2 = 9;
+  correspondence_graph->AddCorrespondences(0, 1, matches);
+  correspondence_graph->AddCorrespondences(1, 2, matches);
+  correspondence_graph->Finalize();
+
+  const CorrespondenceGraph view =
+      correspondence_graph->CreateSubgraphView({0, 1});
+  const CorrespondenceGraph view_copy = view;
+  correspondence_graph.reset();
+
+  for (const CorrespondenceGraph* graph : {&view, &view_copy}) {
+    BOOST_CHECK(graph->IsView());
+    BOOST_CHECK_EQUAL(graph->NumImages(), 2);
+    BOOST_CHECK_EQUAL(graph->FindCorrespondences(1, 9).size(), 1);
+    BOOST_CHECK_EQUAL(graph->FindCorrespondences(1, 9).begin()->image_id, 0);
+    BOOST_CHECK(graph->IsTwoViewObservation(0, 9));
+  }
+}
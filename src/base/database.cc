@@ -31,8 +31,10 @@
 
 #include "base/database.h"
 
+#include <algorithm>
 #include <fstream>
 
+#include "util/logging.h"
 #include "util/sqlite3_utils.h"
 #include "util/string.h"
 #include "util/version.h"
@@ -263,6 +265,39 @@ void Database::Open(const std::string& path) {
       SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX,
       nullptr));
 
+  ConfigureConnection();
+
+  CreateTables();
+  UpdateSchema();
+  PrepareSQLStatements();
+
+  feature_store_path_ = FeatureStorePath(path);
+  if (FeatureStore::Exists(feature_store_path_)) {
+    feature_store_.reset(new FeatureStore(feature_store_path_));
+  }
+}
+
+void Database::OpenConnection(const Database& database) {
+  Close();
+
+  CHECK_NOTNULL(database.database_);
+  const char* path = sqlite3_db_filename(database.database_, "main");
+  CHECK(path != nullptr && path[0] != '\0')
+      << "A second connection requires a database file";
+
+  SQLITE3_CALL(sqlite3_open_v2(path, &database_,
+                               SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX,
+                               nullptr));
+
+  ConfigureConnection();
+
+  PrepareSQLStatements();
+
+  feature_store_path_ = database.feature_store_path_;
+  feature_store_ = database.feature_store_;
+}
+
+void Database::ConfigureConnection() const {
   // Don't wait for the operating system to write the changes to disk
   SQLITE3_EXEC(database_, "PRAGMA synchronous=OFF", nullptr);
 
@@ -275,12 +310,21 @@ void Database::Open(const std::string& path) {
   // Disabled by default
   SQLITE3_EXEC(database_, "PRAGMA foreign_keys=ON", nullptr);
 
-  CreateTables();
-  UpdateSchema();
-  PrepareSQLStatements();
+  // Use a larger page cache than the default of 2MB, since the indices of
+  // large databases are frequently accessed (negative values are in KB).
+  SQLITE3_EXEC(database_, "PRAGMA cache_size=-65536", nullptr);
+
+  // Read the database file through memory-mapped I/O instead of copying the
+  // pages with system calls. The size is capped by the SQLite build.
+  SQLITE3_EXEC(database_, "PRAGMA mmap_size=1073741824", nullptr);
+
+  // Wait for other connections, e.g., of a `DatabaseWriter`, to finish their
+  // transactions instead of failing immediately.
+  SQLITE3_CALL(sqlite3_busy_timeout(database_, 60000));
 }
 
 void Database::Close() {
+  feature_store_.reset();
   if (database_ != nullptr) {
     FinalizeSQLStatements();
     sqlite3_close_v2(database_);
@@ -301,15 +345,25 @@ bool Database::ExistsImageWithName(std::string name) const {
 }
 
 bool Database::ExistsKeypoints(const image_t image_id) const {
+  if (feature_store_) {
+    return feature_store_->ExistsKeypoints(image_id);
+  }
   return ExistsRowId(sql_stmt_exists_keypoints_, image_id);
 }
 
 bool Database::ExistsDescriptors(const image_t image_id) const {
+  if (feature_store_) {
+    return feature_store_->ExistsDescriptors(image_id);
+  }
   return ExistsRowId(sql_stmt_exists_descriptors_, image_id);
 }
 
 bool Database::ExistsMatches(const image_t image_id1,
                              const image_t image_id2) const {
+  if (feature_store_) {
+    return feature_store_->ExistsMatches(
+        ImagePairToPairId(image_id1, image_id2));
+  }
   return ExistsRowId(sql_stmt_exists_matches_,
                      ImagePairToPairId(image_id1, image_id2));
 }
@@ -324,35 +378,65 @@ size_t Database::NumCameras() const { return CountRows("cameras"); }
 
 size_t Database::NumImages() const { return CountRows("images"); }
 
-size_t Database::NumKeypoints() const { return SumColumn("rows", "keypoints"); }
+size_t Database::NumKeypoints() const {
+  if (feature_store_) {
+    return feature_store_->NumKeypoints();
+  }
+  return SumColumn("rows", "keypoints");
+}
 
 size_t Database::MaxNumKeypoints() const {
+  if (feature_store_) {
+    return feature_store_->MaxNumKeypoints();
+  }
   return MaxColumn("rows", "keypoints");
 }
 
 size_t Database::NumKeypointsForImage(const image_t image_id) const {
+  if (feature_store_) {
+    return feature_store_->NumKeypointsForImage(image_id);
+  }
   return CountRowsForEntry(sql_stmt_num_keypoints_, image_id);
 }
 
 size_t Database::NumDescriptors() const {
+  if (feature_store_) {
+    return feature_store_->NumDescriptors();
+  }
   return SumColumn("rows", "descriptors");
 }
 
 size_t Database::MaxNumDescriptors() const {
+  if (feature_store_) {
+    return feature_store_->MaxNumDescriptors();
+  }
   return MaxColumn("rows", "descriptors");
 }
 
 size_t Database::NumDescriptorsForImage(const image_t image_id) const {
+  if (feature_store_) {
+    return feature_store_->NumDescriptorsForImage(image_id);
+  }
   return CountRowsForEntry(sql_stmt_num_descriptors_, image_id);
 }
 
-size_t Database::NumMatches() const { return SumColumn("rows", "matches"); }
+size_t Database::NumMatches() const {
+  if (feature_store_) {
+    return feature_store_->NumMatches();
+  }
+  return SumColumn("rows", "matches");
+}
 
 size_t Database::NumInlierMatches() const {
   return SumColumn("rows", "two_view_geometries");
 }
 
-size_t Database::NumMatchedImagePairs() const { return CountRows("matches"); }
+size_t Database::NumMatchedImagePairs() const {
+  if (feature_store_) {
+    return feature_store_->NumMatchedImagePairs();
+  }
+  return CountRows("matches");
+}
 
 size_t Database::NumVerifiedImagePairs() const {
   return CountRows("two_view_geometries");
@@ -430,6 +514,10 @@ std::vector<Image> Database::ReadAllImages() const {
 }
 
 FeatureKeypoints Database::ReadKeypoints(const image_t image_id) const {
+  if (feature_store_) {
+    return feature_store_->ReadKeypoints(image_id).ToVector();
+  }
+
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_read_keypoints_, 1, image_id));
 
   const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_keypoints_));
@@ -442,6 +530,10 @@ FeatureKeypoints Database::ReadKeypoints(const image_t image_id) const {
 }
 
 FeatureDescriptors Database::ReadDescriptors(const image_t image_id) const {
+  if (feature_store_) {
+    return feature_store_->ReadDescriptors(image_id).Matrix();
+  }
+
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_read_descriptors_, 1, image_id));
 
   const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_descriptors_));
@@ -457,6 +549,17 @@ FeatureDescriptors Database::ReadDescriptors(const image_t image_id) const {
 FeatureMatches Database::ReadMatches(image_t image_id1,
                                      image_t image_id2) const {
   const image_pair_t pair_id = ImagePairToPairId(image_id1, image_id2);
+
+  if (feature_store_) {
+    FeatureMatches matches = feature_store_->ReadMatches(pair_id).ToVector();
+    if (SwapImagePair(image_id1, image_id2)) {
+      for (auto& match : matches) {
+        std::swap(match.point2D_idx1, match.point2D_idx2);
+      }
+    }
+    return matches;
+  }
+
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_read_matches_, 1, pair_id));
 
   const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_matches_));
@@ -476,6 +579,16 @@ std::vector<std::pair<image_pair_t, FeatureMatches>> Database::ReadAllMatches()
     const {
   std::vector<std::pair<image_pair_t, FeatureMatches>> all_matches;
 
+  if (feature_store_) {
+    const auto pair_ids = feature_store_->ImagePairIdsWithMatches();
+    all_matches.reserve(pair_ids.size());
+    for (const auto pair_id : pair_ids) {
+      all_matches.emplace_back(pair_id,
+                               feature_store_->ReadMatches(pair_id).ToVector());
+    }
+    return all_matches;
+  }
+
   int rc;
   while ((rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_matches_all_))) ==
          SQLITE_ROW) {
@@ -588,6 +701,22 @@ void Database::ReadTwoViewGeometryNumInliers(
   SQLITE3_CALL(sqlite3_reset(sql_stmt_read_two_view_geometry_num_inliers_));
 }
 
+void Database::ReadTwoViewGeometryConfigs(
+    std::vector<image_pair_t>* image_pair_ids, std::vector<int>* num_inliers,
+    std::vector<int>* configs) const {
+  while (SQLITE3_CALL(sqlite3_step(
+             sql_stmt_read_two_view_geometry_num_inliers_)) == SQLITE_ROW) {
+    image_pair_ids->push_back(static_cast<image_pair_t>(
+        sqlite3_column_int64(sql_stmt_read_two_view_geometry_num_inliers_, 0)));
+    num_inliers->push_back(static_cast<int>(
+        sqlite3_column_int64(sql_stmt_read_two_view_geometry_num_inliers_, 1)));
+    configs->push_back(static_cast<int>(
+        sqlite3_column_int64(sql_stmt_read_two_view_geometry_num_inliers_, 2)));
+  }
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_two_view_geometry_num_inliers_));
+}
+
 camera_t Database::WriteCamera(const Camera& camera,
                                const bool use_camera_id) const {
   if (use_camera_id) {
@@ -652,6 +781,11 @@ image_t Database::WriteImage(const Image& image,
 
 void Database::WriteKeypoints(const image_t image_id,
                               const FeatureKeypoints& keypoints) const {
+  if (feature_store_) {
+    feature_store_->WriteKeypoints(image_id, keypoints);
+    return;
+  }
+
   const FeatureKeypointsBlob blob = FeatureKeypointsToBlob(keypoints);
 
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_write_keypoints_, 1, image_id));
@@ -663,6 +797,11 @@ void Database::WriteKeypoints(const image_t image_id,
 
 void Database::WriteDescriptors(const image_t image_id,
                                 const FeatureDescriptors& descriptors) const {
+  if (feature_store_) {
+    feature_store_->WriteDescriptors(image_id, descriptors);
+    return;
+  }
+
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_write_descriptors_, 1, image_id));
   WriteDynamicMatrixBlob(sql_stmt_write_descriptors_, descriptors, 2);
 
@@ -673,6 +812,20 @@ void Database::WriteDescriptors(const image_t image_id,
 void Database::WriteMatches(const image_t image_id1, const image_t image_id2,
                             const FeatureMatches& matches) const {
   const image_pair_t pair_id = ImagePairToPairId(image_id1, image_id2);
+
+  if (feature_store_) {
+    if (SwapImagePair(image_id1, image_id2)) {
+      FeatureMatches swapped_matches = matches;
+      for (auto& match : swapped_matches) {
+        std::swap(match.point2D_idx1, match.point2D_idx2);
+      }
+      feature_store_->WriteMatches(pair_id, swapped_matches);
+    } else {
+      feature_store_->WriteMatches(pair_id, matches);
+    }
+    return;
+  }
+
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_write_matches_, 1, pair_id));
 
   // Important: the swapped data must live until the query is executed.
@@ -789,6 +942,10 @@ void Database::UpdateImage(const Image& image) const {
 void Database::DeleteMatches(const image_t image_id1,
                              const image_t image_id2) const {
   const image_pair_t pair_id = ImagePairToPairId(image_id1, image_id2);
+  if (feature_store_) {
+    feature_store_->DeleteMatches(pair_id);
+    return;
+  }
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_delete_matches_, 1,
                                   static_cast<sqlite3_int64>(pair_id)));
   SQLITE3_CALL(sqlite3_step(sql_stmt_delete_matches_));
@@ -805,6 +962,10 @@ void Database::DeleteInlierMatches(const image_t image_id1,
 }
 
 void Database::ClearMatches() const {
+  if (feature_store_) {
+    feature_store_->ClearMatches();
+    return;
+  }
   SQLITE3_CALL(sqlite3_step(sql_stmt_clear_matches_));
   SQLITE3_CALL(sqlite3_reset(sql_stmt_clear_matches_));
 }
@@ -814,6 +975,91 @@ void Database::ClearTwoViewGeometries() const {
   SQLITE3_CALL(sqlite3_reset(sql_stmt_clear_two_view_geometries_));
 }
 
+std::string Database::FeatureStorePath(const std::string& database_path) {
+  return database_path + ".features";
+}
+
+bool Database::HasFeatureStore() const { return feature_store_ != nullptr; }
+
+const FeatureStore* Database::GetFeatureStore() const {
+  return feature_store_.get();
+}
+
+void Database::MoveFeaturesToFeatureStore() {
+  CHECK_NOTNULL(database_);
+  CHECK(!feature_store_) << "Database already uses a feature store";
+
+  std::unique_ptr<FeatureStore> feature_store(
+      new FeatureStore(feature_store_path_));
+
+  for (const auto& image : ReadAllImages()) {
+    if (ExistsKeypoints(image.ImageId())) {
+      feature_store->WriteKeypoints(image.ImageId(),
+                                    ReadKeypoints(image.ImageId()));
+    }
+    if (ExistsDescriptors(image.ImageId())) {
+      feature_store->WriteDescriptors(image.ImageId(),
+                                      ReadDescriptors(image.ImageId()));
+    }
+  }
+
+  // Stream the matches instead of using `ReadAllMatches`, since they might
+  // not fit into memory at once.
+  int rc;
+  while ((rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_matches_all_))) ==
+         SQLITE_ROW) {
+    const image_pair_t pair_id = static_cast<image_pair_t>(
+        sqlite3_column_int64(sql_stmt_read_matches_all_, 0));
+    const FeatureMatchesBlob blob = ReadDynamicMatrixBlob<FeatureMatchesBlob>(
+        sql_stmt_read_matches_all_, rc, 1);
+    feature_store->WriteMatches(pair_id, FeatureMatchesFromBlob(blob));
+  }
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_matches_all_));
+
+  BeginTransaction();
+  SQLITE3_EXEC(database_, "DELETE FROM keypoints;", nullptr);
+  SQLITE3_EXEC(database_, "DELETE FROM descriptors;", nullptr);
+  SQLITE3_EXEC(database_, "DELETE FROM matches;", nullptr);
+  EndTransaction();
+
+  // Release the space of the deleted blobs.
+  SQLITE3_EXEC(database_, "VACUUM;", nullptr);
+
+  feature_store_ = std::move(feature_store);
+}
+
+void Database::MoveFeaturesToSQLite() {
+  CHECK_NOTNULL(database_);
+  CHECK(feature_store_) << "Database does not use a feature store";
+
+  // From here on, all reads and writes go to the SQLite tables.
+  std::shared_ptr<FeatureStore> feature_store = std::move(feature_store_);
+
+  BeginTransaction();
+
+  for (const auto image_id : feature_store->ImageIdsWithKeypoints()) {
+    WriteKeypoints(image_id, feature_store->ReadKeypoints(image_id).ToVector());
+  }
+
+  for (const auto image_id : feature_store->ImageIdsWithDescriptors()) {
+    WriteDescriptors(image_id,
+                     feature_store->ReadDescriptors(image_id).Matrix());
+  }
+
+  for (const auto pair_id : feature_store->ImagePairIdsWithMatches()) {
+    image_t image_id1, image_id2;
+    PairIdToImagePair(pair_id, &image_id1, &image_id2);
+    WriteMatches(image_id1, image_id2,
+                 feature_store->ReadMatches(pair_id).ToVector());
+  }
+
+  EndTransaction();
+
+  feature_store->Close();
+  FeatureStore::Remove(feature_store_path_);
+}
+
 void Database::Merge(const Database& database1, const Database& database2,
                      Database* merged_database) {
   // Merge the cameras.
@@ -1081,7 +1327,8 @@ void Database::PrepareSQLStatements() {
                                   &sql_stmt_read_two_view_geometries_, 0));
   sql_stmts_.push_back(sql_stmt_read_two_view_geometries_);
 
-  sql = "SELECT pair_id, rows FROM two_view_geometries WHERE rows > 0;";
+  sql =
+      "SELECT pair_id, rows, config FROM two_view_geometries WHERE rows > 0;";
   SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
                                   &sql_stmt_read_two_view_geometry_num_inliers_,
                                   0));
@@ -1412,4 +1659,173 @@ DatabaseTransaction::DatabaseTransaction(Database* database)
 
 DatabaseTransaction::~DatabaseTransaction() { database_->EndTransaction(); }
 
+bool DatabaseWriter::Options::Check() const {
+  CHECK_OPTION_GT(max_batch_size, 0);
+  CHECK_OPTION_GE(max_batch_seconds, 0);
+  CHECK_OPTION_GE(max_num_queued_writes, max_batch_size);
+  return true;
+}
+
+DatabaseWriter::DatabaseWriter(const Database* database,
+                               const Options& options)
+    : options_(options),
+      num_committing_writes_(0),
+      num_flushes_(0),
+      stop_(false) {
+  CHECK(options_.Check());
+  connection_.OpenConnection(*CHECK_NOTNULL(database));
+  thread_ = std::thread(&DatabaseWriter::Run, this);
+}
+
+DatabaseWriter::~DatabaseWriter() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  push_condition_.notify_all();
+  thread_.join();
+}
+
+void DatabaseWriter::WriteMatches(const image_t image_id1,
+                                  const image_t image_id2,
+                                  const FeatureMatches& matches) {
+  Push([image_id1, image_id2, matches](const Database& database) {
+    database.WriteMatches(image_id1, image_id2, matches);
+  });
+}
+
+void DatabaseWriter::WriteTwoViewGeometry(
+    const image_t image_id1, const image_t image_id2,
+    const TwoViewGeometry& two_view_geometry) {
+  Push([image_id1, image_id2, two_view_geometry](const Database& database) {
+    database.WriteTwoViewGeometry(image_id1, image_id2, two_view_geometry);
+  });
+}
+
+void DatabaseWriter::DeleteMatches(const image_t image_id1,
+                                   const image_t image_id2) {
+  Push([image_id1, image_id2](const Database& database) {
+    database.DeleteMatches(image_id1, image_id2);
+  });
+}
+
+void DatabaseWriter::DeleteInlierMatches(const image_t image_id1,
+                                         const image_t image_id2) {
+  Push([image_id1, image_id2](const Database& database) {
+    database.DeleteInlierMatches(image_id1, image_id2);
+  });
+}
+
+void DatabaseWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  num_flushes_ += 1;
+  push_condition_.notify_all();
+  while (!writes_.empty() || num_committing_writes_ > 0) {
+    commit_condition_.wait(lock);
+  }
+  num_flushes_ -= 1;
+}
+
+DatabaseWriter::Statistics DatabaseWriter::GetStatistics() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+void DatabaseWriter::Push(std::function<void(const Database&)> func) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  CHECK(!stop_);
+  while (writes_.size() >=
+         static_cast<size_t>(options_.max_num_queued_writes)) {
+    commit_condition_.wait(lock);
+  }
+  writes_.emplace_back();
+  writes_.back().func = std::move(func);
+  writes_.back().queue_time = Clock::now();
+  if (writes_.size() == 1 ||
+      writes_.size() == static_cast<size_t>(options_.max_batch_size)) {
+    push_condition_.notify_one();
+  }
+}
+
+void DatabaseWriter::Run() {
+  const auto max_batch_duration =
+      std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(options_.max_batch_seconds));
+  const size_t max_batch_size = static_cast<size_t>(options_.max_batch_size);
+
+  std::vector<Write> batch;
+  batch.reserve(max_batch_size);
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      while (writes_.empty() && !stop_) {
+        push_condition_.wait(lock);
+      }
+
+      if (writes_.empty()) {
+        break;
+      }
+
+      // Wait for more writes to fill the transaction, unless the writes are
+      // needed immediately or the oldest write waited long enough.
+      const Clock::time_point deadline =
+          writes_.front().queue_time + max_batch_duration;
+      while (writes_.size() < max_batch_size && num_flushes_ == 0 && !stop_ &&
+             Clock::now() < deadline) {
+        push_condition_.wait_until(lock, deadline);
+      }
+
+      const size_t batch_size = std::min(writes_.size(), max_batch_size);
+      for (size_t i = 0; i < batch_size; ++i) {
+        batch.push_back(std::move(writes_.front()));
+        writes_.pop_front();
+      }
+      num_committing_writes_ = batch_size;
+    }
+
+    // Writers blocked by the maximum number of queued writes can continue.
+    commit_condition_.notify_all();
+
+    const Clock::time_point begin_time = Clock::now();
+    connection_.BeginTransaction();
+    for (const auto& write : batch) {
+      write.func(connection_);
+    }
+    connection_.EndTransaction();
+    const Clock::time_point end_time = Clock::now();
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      const auto Seconds = [](const Clock::duration duration) {
+        return std::chrono::duration<double>(duration).count();
+      };
+
+      for (const auto& write : batch) {
+        const double latency = Seconds(end_time - write.queue_time);
+        statistics_.mean_write_latency +=
+            (latency - statistics_.mean_write_latency) /
+            (statistics_.num_writes + 1);
+        statistics_.max_write_latency =
+            std::max(statistics_.max_write_latency, latency);
+        statistics_.num_writes += 1;
+      }
+
+      statistics_.mean_transaction_time +=
+          (Seconds(end_time - begin_time) -
+           statistics_.mean_transaction_time) /
+          (statistics_.num_transactions + 1);
+      statistics_.num_transactions += 1;
+
+      num_committing_writes_ = 0;
+    }
+
+    commit_condition_.notify_all();
+
+    batch.clear();
+  }
+}
+
 }  // namespace colmap
@@ -32,7 +32,13 @@
 #ifndef COLMAP_SRC_BASE_DATABASE_H_
 #define COLMAP_SRC_BASE_DATABASE_H_
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -40,6 +46,7 @@
 
 #include "SQLite/sqlite3.h"
 #include "base/camera.h"
+#include "base/feature_store.h"
 #include "base/image.h"
 #include "estimators/two_view_geometry.h"
 #include "feature/types.h"
@@ -52,6 +59,14 @@ namespace colmap {
 // concurrently. The class is optimized for single-thread speed and for optimal
 // performance, wrap multiple method calls inside a leading `BeginTransaction`
 // and trailing `EndTransaction`.
+//
+// Keypoints, descriptors, and matches can alternatively be stored in a
+// memory-mapped `FeatureStore` next to the database file, which is used
+// automatically if it exists when opening the database. All other data,
+// including the two-view geometries, is always stored in SQLite.
+//
+// To write from a separate thread without blocking the readers of the
+// database, use the `DatabaseWriter` with its own connection.
 class Database {
  public:
   const static int kSchemaVersion = 1;
@@ -71,6 +86,12 @@ class Database {
   void Open(const std::string& path);
   void Close();
 
+  // Open a second connection to the database file of an already opened
+  // database, which shares its feature store. Use separate connections to
+  // access the same database from multiple threads. Note that this is not
+  // possible for in-memory databases.
+  void OpenConnection(const Database& database);
+
   // Check if entry already exists in database. For image pairs, the order of
   // `image_id1` and `image_id2` does not matter.
   bool ExistsCamera(const camera_t camera_id) const;
@@ -165,6 +186,13 @@ class Database {
       std::vector<std::pair<image_t, image_t>>* image_pairs,
       std::vector<int>* num_inliers) const;
 
+  // Read the number of inlier matches and the configuration of all image pairs
+  // that have an entry in the `two_view_geometries` table with at least one
+  // inlier match without reading the actual matches.
+  void ReadTwoViewGeometryConfigs(std::vector<image_pair_t>* image_pair_ids,
+                                  std::vector<int>* num_inliers,
+                                  std::vector<int>* configs) const;
+
   // Add new camera and return its database identifier. If `use_camera_id`
   // is false a new identifier is automatically generated.
   camera_t WriteCamera(const Camera& camera,
@@ -207,12 +235,34 @@ class Database {
   // Clear the entire inlier matches table.
   void ClearTwoViewGeometries() const;
 
+  // Path prefix of the feature store files for a given database path.
+  static std::string FeatureStorePath(const std::string& database_path);
+
+  // Whether keypoints, descriptors, and matches are stored in the feature
+  // store instead of the SQLite tables.
+  bool HasFeatureStore() const;
+
+  // Zero-copy access to the feature store or null if it is not used. Note that
+  // the feature store returns matches in the order of the image pair
+  // identifier, i.e. the matches for `image_id1 > image_id2` are swapped.
+  const FeatureStore* GetFeatureStore() const;
+
+  // Move all keypoints, descriptors, and matches from the SQLite tables into
+  // a new feature store or from the feature store back into the SQLite tables.
+  // The source data is deleted after the conversion.
+  void MoveFeaturesToFeatureStore();
+  void MoveFeaturesToSQLite();
+
   // Merge two databases into a single, new database.
   static void Merge(const Database& database1, const Database& database2,
                     Database* merged_database);
 
  private:
   friend class DatabaseTransaction;
+  friend class DatabaseWriter;
+
+  // Configure the journaling, caching, and memory-mapping of the connection.
+  void ConfigureConnection() const;
 
   // Combine multiple queries into one transaction by wrapping a code section
   // into a `BeginTransaction` and `EndTransaction`. You can create a scoped
@@ -254,6 +304,9 @@ class Database {
 
   sqlite3* database_ = nullptr;
 
+  std::string feature_store_path_;
+  std::shared_ptr<FeatureStore> feature_store_;
+
   // Ensure that only one database object at a time updates the schema of a
   // database. Since the schema is updated every time a database is opened, this
   // is to ensure that there are no race conditions ("database locked" error
@@ -332,6 +385,92 @@ class DatabaseTransaction {
   std::unique_lock<std::mutex> database_lock_;
 };
 
+// Asynchronously writes matches and two-view geometries to a database in a
+// background thread. The writes are executed in the order of the calls and
+// grouped into transactions, which are committed once they contain
+// `max_batch_size` writes or at the latest `max_batch_seconds` after their
+// first write. The writer uses its own connection to the database file, so
+// that readers of the database are not blocked by the writes. Since the writes
+// only become visible once committed, call `Flush` before reading data that
+// might still be pending. Note that the writer requires a database file and
+// does not work with in-memory databases.
+class DatabaseWriter {
+ public:
+  struct Options {
+    // Maximum number of writes committed in one transaction.
+    int max_batch_size = 1000;
+
+    // Maximum time in seconds between queuing a write and committing it.
+    double max_batch_seconds = 1.0;
+
+    // Maximum number of queued writes, after which writing blocks until the
+    // queued writes are committed.
+    int max_num_queued_writes = 10000;
+
+    bool Check() const;
+  };
+
+  struct Statistics {
+    // Number of committed writes and transactions.
+    size_t num_writes = 0;
+    size_t num_transactions = 0;
+
+    // Mean and maximum time in seconds between queuing and committing a write.
+    double mean_write_latency = 0.0;
+    double max_write_latency = 0.0;
+
+    // Mean time in seconds to execute and commit one transaction.
+    double mean_transaction_time = 0.0;
+  };
+
+  DatabaseWriter(const Database* database, const Options& options);
+
+  // Commits all queued writes before returning.
+  ~DatabaseWriter();
+
+  // Queue a write. For image pairs, the order of `image_id1` and `image_id2`
+  // does not matter. Blocks if the maximum number of writes is queued.
+  void WriteMatches(const image_t image_id1, const image_t image_id2,
+                    const FeatureMatches& matches);
+  void WriteTwoViewGeometry(const image_t image_id1, const image_t image_id2,
+                            const TwoViewGeometry& two_view_geometry);
+  void DeleteMatches(const image_t image_id1, const image_t image_id2);
+  void DeleteInlierMatches(const image_t image_id1, const image_t image_id2);
+
+  // Wait until all queued writes are committed.
+  void Flush();
+
+  Statistics GetStatistics();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Write {
+    std::function<void(const Database&)> func;
+    Clock::time_point queue_time;
+  };
+
+  NON_COPYABLE(DatabaseWriter)
+  NON_MOVABLE(DatabaseWriter)
+
+  void Push(std::function<void(const Database&)> func);
+  void Run();
+
+  const Options options_;
+  Database connection_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable push_condition_;
+  std::condition_variable commit_condition_;
+  std::deque<Write> writes_;
+  size_t num_committing_writes_;
+  size_t num_flushes_;
+  bool stop_;
+
+  Statistics statistics_;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -33,11 +33,28 @@
 
 #include <unordered_set>
 
-#include "feature/utils.h"
+#include "util/misc.h"
 #include "util/string.h"
+#include "util/threading.h"
 #include "util/timer.h"
+#include "util/trace.h"
 
 namespace colmap {
+namespace {
+
+// Number of image pairs whose inlier matches are read at once.
+const size_t kNumImagePairsPerBatch = 4096;
+
+template <typename KeypointsType>
+std::vector<Point2D> KeypointsToPoints2D(const KeypointsType& keypoints) {
+  std::vector<Point2D> points2D(keypoints.size());
+  for (size_t i = 0; i < keypoints.size(); ++i) {
+    points2D[i].SetXY(Eigen::Vector2d(keypoints[i].x, keypoints[i].y));
+  }
+  return points2D;
+}
+
+}  // namespace
 
 DatabaseCache::DatabaseCache() {}
 
@@ -48,13 +65,22 @@ void DatabaseCache::AddCamera(const class Camera& camera) {
 
 void DatabaseCache::AddImage(const class Image& image) {
   CHECK(!ExistsImage(image.ImageId()));
-  images_.emplace(image.ImageId(), image);
+  images_.emplace(image.ImageId(),
+                  std::shared_ptr<const class Image>(new class Image(image)));
   correspondence_graph_.AddImage(image.ImageId(), image.NumPoints2D());
 }
 
 void DatabaseCache::Load(const Database& database, const size_t min_num_matches,
                          const bool ignore_watermarks,
-                         const std::unordered_set<std::string>& image_names) {
+                         const std::unordered_set<std::string>& image_names,
+                         const int num_threads) {
+  COLMAP_TRACE_STAGE("LoadDatabaseCache");
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+
+  Timer total_timer;
+  total_timer.Start();
+
   //////////////////////////////////////////////////////////////////////////////
   // Load cameras
   //////////////////////////////////////////////////////////////////////////////
@@ -83,21 +109,33 @@ void DatabaseCache::Load(const Database& database, const size_t min_num_matches,
   timer.Restart();
   std::cout << "Loading matches..." << std::flush;
 
+  // Only read the number of inliers and the configuration here. The actual
+  // inlier matches are streamed when building the correspondence graph, so
+  // that all two-view geometries never have to be held in memory at once.
+  size_t num_ignored_image_pairs = 0;
   std::vector<image_pair_t> image_pair_ids;
-  std::vector<TwoViewGeometry> two_view_geometries;
-  database.ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
 
-  std::cout << StringPrintf(" %d in %.3fs", image_pair_ids.size(),
-                            timer.ElapsedSeconds())
-            << std::endl;
+  {
+    std::vector<image_pair_t> all_image_pair_ids;
+    std::vector<int> num_inliers;
+    std::vector<int> configs;
+    database.ReadTwoViewGeometryConfigs(&all_image_pair_ids, &num_inliers,
+                                        &configs);
+
+    image_pair_ids.reserve(all_image_pair_ids.size());
+    for (size_t i = 0; i < all_image_pair_ids.size(); ++i) {
+      if (static_cast<size_t>(num_inliers[i]) >= min_num_matches &&
+          (!ignore_watermarks || configs[i] != TwoViewGeometry::WATERMARK)) {
+        image_pair_ids.push_back(all_image_pair_ids[i]);
+      } else {
+        num_ignored_image_pairs += 1;
+      }
+    }
 
-  auto UseInlierMatchesCheck = [min_num_matches, ignore_watermarks](
-                                   const TwoViewGeometry& two_view_geometry) {
-    return static_cast<size_t>(two_view_geometry.inlier_matches.size()) >=
-               min_num_matches &&
-           (!ignore_watermarks ||
-            two_view_geometry.config != TwoViewGeometry::WATERMARK);
-  };
+    std::cout << StringPrintf(" %d in %.3fs", all_image_pair_ids.size(),
+                              timer.ElapsedSeconds())
+              << std::endl;
+  }
 
   //////////////////////////////////////////////////////////////////////////////
   // Load images
@@ -106,12 +144,15 @@ void DatabaseCache::Load(const Database& database, const size_t min_num_matches,
   timer.Restart();
   std::cout << "Loading images..." << std::flush;
 
-  std::unordered_set<image_t> image_ids;
+  // The images are only modified while loading the cache, afterwards they are
+  // immutable and can be shared with other caches.
+  std::vector<std::shared_ptr<class Image>> connected_images;
 
   {
     const std::vector<class Image> images = database.ReadAllImages();
 
     // Determines for which images data should be loaded.
+    std::unordered_set<image_t> image_ids;
     if (image_names.empty()) {
       for (const auto& image : images) {
         image_ids.insert(image.ImageId());
@@ -124,36 +165,79 @@ void DatabaseCache::Load(const Database& database, const size_t min_num_matches,
       }
     }
 
-    // Collect all images that are connected in the correspondence graph.
+    // Collect all images that are connected in the correspondence graph and
+    // discard all image pairs between images that are not loaded.
     std::unordered_set<image_t> connected_image_ids;
     connected_image_ids.reserve(image_ids.size());
-    for (size_t i = 0; i < image_pair_ids.size(); ++i) {
-      if (UseInlierMatchesCheck(two_view_geometries[i])) {
-        image_t image_id1;
-        image_t image_id2;
-        Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
-        if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
-          connected_image_ids.insert(image_id1);
-          connected_image_ids.insert(image_id2);
-        }
+    size_t num_used_image_pairs = 0;
+    for (const auto image_pair_id : image_pair_ids) {
+      image_t image_id1;
+      image_t image_id2;
+      Database::PairIdToImagePair(image_pair_id, &image_id1, &image_id2);
+      if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
+        connected_image_ids.insert(image_id1);
+        connected_image_ids.insert(image_id2);
+        image_pair_ids[num_used_image_pairs] = image_pair_id;
+        num_used_image_pairs += 1;
+      } else {
+        num_ignored_image_pairs += 1;
       }
     }
+    image_pair_ids.resize(num_used_image_pairs);
+    image_pair_ids.shrink_to_fit();
 
     // Load images with correspondences and discard images without
     // correspondences, as those images are useless for SfM.
-    images_.reserve(connected_image_ids.size());
+    connected_images.reserve(connected_image_ids.size());
     for (const auto& image : images) {
       if (image_ids.count(image.ImageId()) > 0 &&
           connected_image_ids.count(image.ImageId()) > 0) {
-        images_.emplace(image.ImageId(), image);
-        const FeatureKeypoints keypoints =
-            database.ReadKeypoints(image.ImageId());
-        const std::vector<Eigen::Vector2d> points =
-            FeatureKeypointsToPointsVector(keypoints);
-        images_[image.ImageId()].SetPoints2D(points);
+        connected_images.emplace_back(new class Image(image));
+      }
+    }
+
+    // Limit the number of images whose keypoints were read but not yet decoded
+    // to bound the memory usage if reading is faster than decoding.
+    const size_t kMaxNumQueuedImages = 4 * thread_pool.NumThreads();
+
+    const FeatureStore* feature_store = database.GetFeatureStore();
+
+    std::vector<std::future<void>> futures;
+    futures.reserve(connected_images.size());
+    for (const auto& image : connected_images) {
+      if (futures.size() >= kMaxNumQueuedImages) {
+        futures[futures.size() - kMaxNumQueuedImages].wait();
+      }
+
+      class Image* image_ptr = image.get();
+      if (feature_store != nullptr) {
+        // The feature store can be read concurrently and without copying the
+        // keypoints, so both reading and decoding happen in the workers.
+        futures.push_back(
+            thread_pool.AddTask([feature_store, image_ptr]() {
+              image_ptr->SetPoints2D(KeypointsToPoints2D(
+                  feature_store->ReadKeypoints(image_ptr->ImageId())));
+            }));
+      } else {
+        // The SQLite connection must not be shared between threads, so the
+        // blobs are read sequentially and only decoded in the workers.
+        futures.push_back(thread_pool.AddTask(
+            [image_ptr](const FeatureKeypoints& keypoints) {
+              image_ptr->SetPoints2D(KeypointsToPoints2D(keypoints));
+            },
+            database.ReadKeypoints(image_ptr->ImageId())));
       }
     }
 
+    for (auto& future : futures) {
+      future.get();
+    }
+
+    images_.reserve(connected_images.size());
+    for (const auto& image : connected_images) {
+      images_.emplace(image->ImageId(), image);
+    }
+
     std::cout << StringPrintf(" %d in %.3fs (connected %d)", images.size(),
                               timer.ElapsedSeconds(),
                               connected_image_ids.size())
@@ -168,46 +252,106 @@ void DatabaseCache::Load(const Database& database, const size_t min_num_matches,
   std::cout << "Building correspondence graph..." << std::flush;
 
   for (const auto& image : images_) {
-    correspondence_graph_.AddImage(image.first, image.second.NumPoints2D());
+    correspondence_graph_.AddImage(image.first, image.second->NumPoints2D());
   }
 
-  size_t num_ignored_image_pairs = 0;
-  for (size_t i = 0; i < image_pair_ids.size(); ++i) {
-    if (UseInlierMatchesCheck(two_view_geometries[i])) {
+  // The inlier matches are read in batches by a worker, while the previous
+  // batch is added to the correspondence graph in this thread. The database is
+  // only accessed by one batch at a time.
+  auto ReadInlierMatchesBatch = [&database, &image_pair_ids](
+                                    const size_t begin) {
+    const size_t end =
+        std::min(begin + kNumImagePairsPerBatch, image_pair_ids.size());
+    std::vector<FeatureMatches> batch(end - begin);
+    for (size_t i = begin; i < end; ++i) {
       image_t image_id1;
       image_t image_id2;
       Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
-      if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
-        correspondence_graph_.AddCorrespondences(
-            image_id1, image_id2, two_view_geometries[i].inlier_matches);
-      } else {
-        num_ignored_image_pairs += 1;
-      }
-    } else {
-      num_ignored_image_pairs += 1;
+      batch[i - begin] =
+          std::move(database.ReadTwoViewGeometry(image_id1, image_id2)
+                        .inlier_matches);
+    }
+    return batch;
+  };
+
+  std::future<std::vector<FeatureMatches>> next_batch;
+  if (!image_pair_ids.empty()) {
+    next_batch = thread_pool.AddTask(ReadInlierMatchesBatch, 0);
+  }
+
+  for (size_t begin = 0; begin < image_pair_ids.size();
+       begin += kNumImagePairsPerBatch) {
+    const std::vector<FeatureMatches> batch = next_batch.get();
+    if (begin + kNumImagePairsPerBatch < image_pair_ids.size()) {
+      next_batch = thread_pool.AddTask(ReadInlierMatchesBatch,
+                                       begin + kNumImagePairsPerBatch);
+    }
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      image_t image_id1;
+      image_t image_id2;
+      Database::PairIdToImagePair(image_pair_ids[begin + i], &image_id1,
+                                  &image_id2);
+      correspondence_graph_.AddCorrespondences(image_id1, image_id2, batch[i]);
     }
   }
 
+  const size_t num_graph_bytes = correspondence_graph_.NumBytes();
   correspondence_graph_.Finalize();
+  const size_t num_finalized_graph_bytes = correspondence_graph_.NumBytes();
 
   // Set number of observations and correspondences per image.
-  for (auto& image : images_) {
-    image.second.SetNumObservations(
-        correspondence_graph_.NumObservationsForImage(image.first));
-    image.second.SetNumCorrespondences(
-        correspondence_graph_.NumCorrespondencesForImage(image.first));
+  for (const auto& image : connected_images) {
+    image->SetNumObservations(
+        correspondence_graph_.NumObservationsForImage(image->ImageId()));
+    image->SetNumCorrespondences(
+        correspondence_graph_.NumCorrespondencesForImage(image->ImageId()));
   }
 
-  std::cout << StringPrintf(" in %.3fs (ignored %d)", timer.ElapsedSeconds(),
-                            num_ignored_image_pairs)
+  std::cout << StringPrintf(" in %.3fs (ignored %d, memory %.3fMB -> %.3fMB)",
+                            timer.ElapsedSeconds(), num_ignored_image_pairs,
+                            num_graph_bytes / (1024.0 * 1024.0),
+                            num_finalized_graph_bytes / (1024.0 * 1024.0))
             << std::endl;
+
+  std::cout << StringPrintf("Loaded database in %.3fs (peak memory %.3fGB)",
+                            total_timer.ElapsedSeconds(),
+                            GetPeakMemoryUsage() / (1024.0 * 1024.0 * 1024.0))
+            << std::endl;
+}
+
+void DatabaseCache::Load(const DatabaseCache& database_cache,
+                         const std::unordered_set<std::string>& image_names) {
+  COLMAP_TRACE_SCOPE("LoadDatabaseCacheSubset");
+
+  CHECK_NE(&database_cache, this);
+
+  std::unordered_set<image_t> image_ids;
+  for (const auto& image : database_cache.images_) {
+    if (image_names.empty() || image_names.count(image.second->Name()) > 0) {
+      image_ids.insert(image.first);
+    }
+  }
+
+  correspondence_graph_ =
+      database_cache.correspondence_graph_.CreateSubgraphView(image_ids);
+
+  cameras_ = database_cache.cameras_;
+
+  images_.clear();
+  images_.reserve(correspondence_graph_.NumImages());
+  for (const auto& image : database_cache.images_) {
+    if (correspondence_graph_.ExistsImage(image.first)) {
+      images_.emplace(image.first, image.second);
+    }
+  }
 }
 
 const class Image* DatabaseCache::FindImageWithName(
     const std::string& name) const {
   for (const auto& image : images_) {
-    if (image.second.Name() == name) {
-      return &image.second;
+    if (image.second->Name() == name) {
+      return image.second.get();
     }
   }
   return nullptr;
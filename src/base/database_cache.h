@@ -32,6 +32,7 @@
 #ifndef COLMAP_SRC_BASE_DATABASE_CACHE_H_
 #define COLMAP_SRC_BASE_DATABASE_CACHE_H_
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -62,12 +63,13 @@ class DatabaseCache {
   // Get specific objects.
   inline class Camera& Camera(const camera_t camera_id);
   inline const class Camera& Camera(const camera_t camera_id) const;
-  inline class Image& Image(const image_t image_id);
   inline const class Image& Image(const image_t image_id) const;
 
-  // Get all objects.
+  // Get all objects. The images are immutable and shared with all caches that
+  // are loaded from this cache.
   inline const EIGEN_STL_UMAP(camera_t, class Camera) & Cameras() const;
-  inline const EIGEN_STL_UMAP(image_t, class Image) & Images() const;
+  inline const std::unordered_map<image_t, std::shared_ptr<const class Image>>&
+  Images() const;
 
   // Check whether specific object exists.
   inline bool ExistsCamera(const camera_t camera_id) const;
@@ -88,8 +90,26 @@ class DatabaseCache {
   // @param ignore_watermarks     Whether to ignore watermark image pairs.
   // @param image_names           Whether to use only load the data for a subset
   //                              of the images. All images are used if empty.
+  // @param num_threads           The number of threads used to read and
+  //                              decode the data, -1 to use all threads.
   void Load(const Database& database, const size_t min_num_matches,
             const bool ignore_watermarks,
+            const std::unordered_set<std::string>& image_names,
+            const int num_threads = -1);
+
+  // Load a subset of the images from another cache instead of the database.
+  // The result is the same as loading the subset from the database with the
+  // options of the other cache, but no data is read or decoded, the images are
+  // shared, and the correspondence graph is a view of the graph of the other
+  // cache. This allows to cheaply reconstruct multiple subsets of a scene in
+  // parallel, e.g., the clusters in hierarchical mapping. Since the images are
+  // shared, their number of observations and correspondences refer to the
+  // other cache and must be queried from the correspondence graph instead.
+  //
+  // @param database_cache        Source cache from which to load data.
+  // @param image_names           Whether to use only load the data for a subset
+  //                              of the images. All images are used if empty.
+  void Load(const DatabaseCache& database_cache,
             const std::unordered_set<std::string>& image_names);
 
   // Find specific image by name. Note that this uses linear search.
@@ -99,7 +119,7 @@ class DatabaseCache {
   class CorrespondenceGraph correspondence_graph_;
 
   EIGEN_STL_UMAP(camera_t, class Camera) cameras_;
-  EIGEN_STL_UMAP(image_t, class Image) images_;
+  std::unordered_map<image_t, std::shared_ptr<const class Image>> images_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -117,19 +137,16 @@ const class Camera& DatabaseCache::Camera(const camera_t camera_id) const {
   return cameras_.at(camera_id);
 }
 
-class Image& DatabaseCache::Image(const image_t image_id) {
-  return images_.at(image_id);
-}
-
 const class Image& DatabaseCache::Image(const image_t image_id) const {
-  return images_.at(image_id);
+  return *images_.at(image_id);
 }
 
 const EIGEN_STL_UMAP(camera_t, class Camera) & DatabaseCache::Cameras() const {
   return cameras_;
 }
 
-const EIGEN_STL_UMAP(image_t, class Image) & DatabaseCache::Images() const {
+const std::unordered_map<image_t, std::shared_ptr<const class Image>>&
+DatabaseCache::Images() const {
   return images_;
 }
 
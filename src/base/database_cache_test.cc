@@ -84,3 +84,124 @@ BOOST_AUTO_TEST_CASE(TestAddImage) {
   BOOST_CHECK_EQUAL(
       cache.CorrespondenceGraph().NumObservationsForImage(image.ImageId()), 0);
 }
+
+BOOST_AUTO_TEST_CASE(TestLoad) {
+  Database database(":memory:");
+
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_PINHOLE", 1.0, 1, 1);
+  const camera_t camera_id = database.WriteCamera(camera);
+
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 4; ++i) {
+    Image image;
+    image.SetName(std::to_string(i));
+    image.SetCameraId(camera_id);
+    image_ids.push_back(database.WriteImage(image));
+    database.WriteKeypoints(image_ids.back(), FeatureKeypoints(10));
+  }
+
+  // The last image is only connected through a watermark image pair.
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+  two_view_geometry.inlier_matches.resize(5);
+  for (point2D_t i = 0; i < 5; ++i) {
+    two_view_geometry.inlier_matches[i].point2D_idx1 = i;
+    two_view_geometry.inlier_matches[i].point2D_idx2 = i;
+  }
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+  database.WriteTwoViewGeometry(image_ids[1], image_ids[2], two_view_geometry);
+  two_view_geometry.config = TwoViewGeometry::WATERMARK;
+  database.WriteTwoViewGeometry(image_ids[2], image_ids[3], two_view_geometry);
+
+  DatabaseCache cache;
+  cache.Load(database, 5, true, {}, 2);
+  BOOST_CHECK_EQUAL(cache.NumCameras(), 1);
+  BOOST_CHECK_EQUAL(cache.NumImages(), 3);
+  BOOST_CHECK(!cache.ExistsImage(image_ids[3]));
+  BOOST_CHECK_EQUAL(cache.Image(image_ids[1]).NumPoints2D(), 10);
+  BOOST_CHECK_EQUAL(cache.Image(image_ids[1]).NumCorrespondences(), 10);
+  BOOST_CHECK_EQUAL(cache.CorrespondenceGraph().NumImagePairs(), 2);
+  BOOST_CHECK_EQUAL(cache.CorrespondenceGraph().NumCorrespondencesBetweenImages(
+                        image_ids[0], image_ids[1]),
+                    5);
+
+  DatabaseCache cache_watermarks;
+  cache_watermarks.Load(database, 5, false, {}, 2);
+  BOOST_CHECK_EQUAL(cache_watermarks.NumImages(), 4);
+
+  DatabaseCache cache_min_num_matches;
+  cache_min_num_matches.Load(database, 6, false, {}, 2);
+  BOOST_CHECK_EQUAL(cache_min_num_matches.NumImages(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestLoadSubset) {
+  Database database(":memory:");
+
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_PINHOLE", 1.0, 1, 1);
+  const camera_t camera_id = database.WriteCamera(camera);
+
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 4; ++i) {
+    Image image;
+    image.SetName(std::to_string(i));
+    image.SetCameraId(camera_id);
+    image_ids.push_back(database.WriteImage(image));
+    database.WriteKeypoints(image_ids.back(), FeatureKeypoints(10));
+  }
+
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+  two_view_geometry.inlier_matches.resize(5);
+  for (point2D_t i = 0; i < 5; ++i) {
+    two_view_geometry.inlier_matches[i].point2D_idx1 = i;
+    two_view_geometry.inlier_matches[i].point2D_idx2 = i;
+  }
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+  database.WriteTwoViewGeometry(image_ids[1], image_ids[2], two_view_geometry);
+  database.WriteTwoViewGeometry(image_ids[2], image_ids[3], two_view_geometry);
+
+  DatabaseCache shared_cache;
+  shared_cache.Load(database, 5, true, {}, 2);
+  BOOST_CHECK_EQUAL(shared_cache.NumImages(), 4);
+
+  // The subset must be the same as if loaded from the database.
+  const std::unordered_set<std::string> image_names = {"0", "1", "3"};
+  DatabaseCache database_subset_cache;
+  database_subset_cache.Load(database, 5, true, image_names, 2);
+  DatabaseCache subset_cache;
+  subset_cache.Load(shared_cache, image_names);
+  BOOST_CHECK(subset_cache.CorrespondenceGraph().IsView());
+  BOOST_CHECK_EQUAL(&subset_cache.Image(image_ids[1]),
+                    &shared_cache.Image(image_ids[1]));
+
+  for (const DatabaseCache* cache : {&database_subset_cache, &subset_cache}) {
+    BOOST_CHECK_EQUAL(cache->NumCameras(), 1);
+    BOOST_CHECK_EQUAL(cache->NumImages(), 2);
+    BOOST_CHECK(cache->ExistsImage(image_ids[0]));
+    BOOST_CHECK(cache->ExistsImage(image_ids[1]));
+    BOOST_CHECK(!cache->ExistsImage(image_ids[2]));
+    BOOST_CHECK(!cache->ExistsImage(image_ids[3]));
+    BOOST_CHECK_EQUAL(cache->Image(image_ids[1]).NumPoints2D(), 10);
+    const auto& graph = cache->CorrespondenceGraph();
+    BOOST_CHECK_EQUAL(graph.NumImagePairs(), 1);
+    BOOST_CHECK_EQUAL(graph.NumObservationsForImage(image_ids[1]), 5);
+    BOOST_CHECK_EQUAL(graph.NumCorrespondencesForImage(image_ids[1]), 5);
+    BOOST_CHECK_EQUAL(graph.FindCorrespondences(image_ids[1], 0).size(), 1);
+    BOOST_CHECK_EQUAL(
+        graph.FindCorrespondences(image_ids[1], 0).begin()->image_id,
+        image_ids[0]);
+    BOOST_CHECK(graph.IsTwoViewObservation(image_ids[1], 0));
+    BOOST_CHECK_EQUAL(
+        graph.FindTransitiveCorrespondences(image_ids[0], 0, 5).size(), 1);
+  }
+
+  DatabaseCache all_cache;
+  all_cache.Load(shared_cache, {});
+  BOOST_CHECK_EQUAL(all_cache.NumImages(), 4);
+  BOOST_CHECK_EQUAL(all_cache.CorrespondenceGraph().NumImagePairs(), 3);
+  BOOST_CHECK_EQUAL(
+      all_cache.CorrespondenceGraph().FindCorrespondences(image_ids[1], 0).size(),
+      2);
+}
@@ -34,12 +34,31 @@
 
 #include <thread>
 
+#include <boost/filesystem.hpp>
+
 #include "base/database.h"
 
 using namespace colmap;
 
 const static std::string kMemoryDatabasePath = ":memory:";
 
+namespace {
+
+std::string GetTemporaryPath() {
+  return (boost::filesystem::temp_directory_path() /
+          boost::filesystem::unique_path())
+      .string();
+}
+
+void RemoveDatabase(const std::string& path) {
+  boost::filesystem::remove(path);
+  boost::filesystem::remove(path + "-wal");
+  boost::filesystem::remove(path + "-shm");
+  FeatureStore::Remove(Database::FeatureStorePath(path));
+}
+
+}  // namespace
+
 BOOST_AUTO_TEST_CASE(TestOpenCloseConstructorDestructor) {
   Database database(kMemoryDatabasePath);
 }
@@ -465,3 +484,97 @@ BOOST_AUTO_TEST_CASE(TestMerge) {
   BOOST_CHECK(!merged_database.ExistsMatches(2, 4));
   BOOST_CHECK(merged_database.ExistsMatches(3, 4));
 }
+
+BOOST_AUTO_TEST_CASE(TestWriter) {
+  const std::string path = GetTemporaryPath();
+  {
+    Database database(path);
+    DatabaseWriter::Options options;
+    options.max_batch_size = 10;
+    options.max_batch_seconds = 100.0;
+    DatabaseWriter writer(&database, options);
+    for (image_t image_id = 1; image_id <= 25; ++image_id) {
+      writer.WriteMatches(image_id, image_id + 1, FeatureMatches(image_id));
+    }
+    writer.Flush();
+    BOOST_CHECK_EQUAL(database.NumMatchedImagePairs(), 25);
+    BOOST_CHECK_EQUAL(database.NumMatches(), 25 * 26 / 2);
+    BOOST_CHECK_EQUAL(database.ReadMatches(3, 4).size(), 3);
+
+    // The writes are executed in order, so that results can be replaced.
+    writer.DeleteMatches(4, 3);
+    writer.WriteMatches(4, 3, FeatureMatches(100));
+    TwoViewGeometry two_view_geometry;
+    two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+    two_view_geometry.inlier_matches = FeatureMatches(10);
+    writer.WriteTwoViewGeometry(3, 4, two_view_geometry);
+    writer.Flush();
+    BOOST_CHECK_EQUAL(database.ReadMatches(3, 4).size(), 100);
+    BOOST_CHECK_EQUAL(database.ReadTwoViewGeometry(3, 4).config,
+                      TwoViewGeometry::CALIBRATED);
+    BOOST_CHECK_EQUAL(database.NumInlierMatches(), 10);
+    writer.DeleteInlierMatches(3, 4);
+    writer.Flush();
+    BOOST_CHECK(!database.ExistsInlierMatches(3, 4));
+
+    const DatabaseWriter::Statistics statistics = writer.GetStatistics();
+    BOOST_CHECK_EQUAL(statistics.num_writes, 29);
+    BOOST_CHECK_EQUAL(statistics.num_transactions, 5);
+    BOOST_CHECK_GE(statistics.mean_write_latency, 0);
+    BOOST_CHECK_GE(statistics.max_write_latency,
+                   statistics.mean_write_latency);
+  }
+  RemoveDatabase(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestWriterCommitOnDestruction) {
+  const std::string path = GetTemporaryPath();
+  {
+    Database database(path);
+    {
+      DatabaseWriter::Options options;
+      options.max_batch_seconds = 100.0;
+      DatabaseWriter writer(&database, options);
+      writer.WriteMatches(1, 2, FeatureMatches(10));
+      writer.WriteMatches(2, 3, FeatureMatches(20));
+    }
+    BOOST_CHECK_EQUAL(database.NumMatches(), 30);
+  }
+  RemoveDatabase(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestWriterConcurrentReads) {
+  const std::string path = GetTemporaryPath();
+  {
+    Database database(path);
+    DatabaseWriter::Options options;
+    options.max_batch_size = 1;
+    options.max_batch_seconds = 0.0;
+    DatabaseWriter writer(&database, options);
+    for (image_t image_id = 1; image_id <= 100; ++image_id) {
+      writer.WriteMatches(image_id, image_id + 1, FeatureMatches(1));
+      // Reading on the main connection never blocks on the writer.
+      BOOST_CHECK_LE(database.NumMatchedImagePairs(), image_id);
+    }
+    writer.Flush();
+    BOOST_CHECK_EQUAL(database.NumMatchedImagePairs(), 100);
+    BOOST_CHECK_EQUAL(writer.GetStatistics().num_transactions, 100);
+  }
+  RemoveDatabase(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestWriterFeatureStore) {
+  const std::string path = GetTemporaryPath();
+  {
+    Database database(path);
+    database.MoveFeaturesToFeatureStore();
+    DatabaseWriter writer(&database, DatabaseWriter::Options());
+    writer.WriteMatches(2, 1, {{0, 1}});
+    writer.Flush();
+    const FeatureMatches matches = database.ReadMatches(1, 2);
+    BOOST_CHECK_EQUAL(matches.size(), 1);
+    BOOST_CHECK_EQUAL(matches[0].point2D_idx1, 1);
+    BOOST_CHECK_EQUAL(matches[0].point2D_idx2, 0);
+  }
+  RemoveDatabase(path);
+}
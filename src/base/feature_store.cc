@@ -0,0 +1,566 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "base/feature_store.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "util/logging.h"
+#include "util/misc.h"
+
+namespace colmap {
+namespace {
+
+static_assert(sizeof(FeatureKeypoint) == 6 * sizeof(float),
+              "Keypoints must be tightly packed to be stored without copy");
+static_assert(sizeof(FeatureMatch) == 2 * sizeof(point2D_t),
+              "Matches must be tightly packed to be stored without copy");
+
+const char kIndexMagic[8] = {'C', 'O', 'L', 'M', 'A', 'P', 'F', 'S'};
+const uint32_t kIndexVersion = 1;
+
+// Records are aligned in the data file, so that the mapped payload can be
+// accessed directly as arrays of their element type.
+const uint64_t kDataAlignment = 16;
+
+// Marks index entries that delete a record or, together with `kAllKeys`,
+// all records of a type.
+const uint64_t kDeletedOffset = std::numeric_limits<uint64_t>::max();
+const uint64_t kAllKeys = std::numeric_limits<uint64_t>::max();
+
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct IndexEntry {
+  uint32_t type;
+  uint32_t cols;
+  uint64_t key;
+  uint64_t offset;
+  uint64_t rows;
+};
+
+static_assert(sizeof(IndexEntry) == 32, "Index entries must be packed");
+
+std::string DataPath(const std::string& path) { return path + ".data"; }
+
+std::string IndexPath(const std::string& path) { return path + ".index"; }
+
+std::string LockPath(const std::string& path) { return path + ".lock"; }
+
+}  // namespace
+
+FeatureStore::FeatureStore() : data_size_(0), index_size_(0) {}
+
+FeatureStore::FeatureStore(const std::string& path) : FeatureStore() {
+  Open(path);
+}
+
+FeatureStore::~FeatureStore() { Close(); }
+
+void FeatureStore::Open(const std::string& path) {
+  Close();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  path_ = path;
+
+  file_lock_.reset(new FileLock(LockPath(path_)));
+  FileLockGuard file_lock(file_lock_.get());
+
+  const bool index_exists = ExistsFile(IndexPath(path_));
+  if (index_exists) {
+    ReadIndex();
+    RepairIndex();
+  }
+
+  data_file_.open(DataPath(path_), std::ios::binary | std::ios::app);
+  CHECK(data_file_.is_open()) << DataPath(path_);
+
+  index_file_.open(IndexPath(path_), std::ios::binary | std::ios::app);
+  CHECK(index_file_.is_open()) << IndexPath(path_);
+
+  if (!index_exists) {
+    // Discard any data without index, e.g., from an interrupted creation.
+    data_file_.close();
+    data_file_.open(DataPath(path_), std::ios::binary | std::ios::trunc);
+    data_size_ = 0;
+
+    IndexHeader header;
+    memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kIndexVersion;
+    header.reserved = 0;
+    index_file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    index_file_.flush();
+    CHECK(index_file_.good()) << "Failed to write to " << IndexPath(path_);
+    index_size_ = sizeof(header);
+  }
+}
+
+void FeatureStore::Close() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (data_file_.is_open()) {
+    data_file_.close();
+  }
+  if (index_file_.is_open()) {
+    index_file_.close();
+  }
+  file_lock_.reset();
+  path_.clear();
+  data_size_ = 0;
+  index_size_ = 0;
+  mapping_.reset();
+  keypoints_.clear();
+  descriptors_.clear();
+  matches_.clear();
+}
+
+bool FeatureStore::IsOpen() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !path_.empty();
+}
+
+bool FeatureStore::Exists(const std::string& path) {
+  return ExistsFile(IndexPath(path));
+}
+
+void FeatureStore::Remove(const std::string& path) {
+  boost::filesystem::remove(DataPath(path));
+  boost::filesystem::remove(IndexPath(path));
+  boost::filesystem::remove(LockPath(path));
+}
+
+bool FeatureStore::ExistsKeypoints(const image_t image_id) const {
+  return ExistsRecord(RecordType::KEYPOINTS, image_id);
+}
+
+bool FeatureStore::ExistsDescriptors(const image_t image_id) const {
+  return ExistsRecord(RecordType::DESCRIPTORS, image_id);
+}
+
+bool FeatureStore::ExistsMatches(const image_pair_t pair_id) const {
+  return ExistsRecord(RecordType::MATCHES, pair_id);
+}
+
+size_t FeatureStore::NumKeypoints() const {
+  return SumRecordRows(RecordType::KEYPOINTS);
+}
+
+size_t FeatureStore::MaxNumKeypoints() const {
+  return MaxRecordRows(RecordType::KEYPOINTS);
+}
+
+size_t FeatureStore::NumKeypointsForImage(const image_t image_id) const {
+  return RecordRows(RecordType::KEYPOINTS, image_id);
+}
+
+size_t FeatureStore::NumDescriptors() const {
+  return SumRecordRows(RecordType::DESCRIPTORS);
+}
+
+size_t FeatureStore::MaxNumDescriptors() const {
+  return MaxRecordRows(RecordType::DESCRIPTORS);
+}
+
+size_t FeatureStore::NumDescriptorsForImage(const image_t image_id) const {
+  return RecordRows(RecordType::DESCRIPTORS, image_id);
+}
+
+size_t FeatureStore::NumMatches() const {
+  return SumRecordRows(RecordType::MATCHES);
+}
+
+size_t FeatureStore::NumMatchedImagePairs() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  return matches_.size();
+}
+
+std::vector<image_t> FeatureStore::ImageIdsWithKeypoints() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  std::vector<image_t> image_ids;
+  image_ids.reserve(keypoints_.size());
+  for (const auto& record : keypoints_) {
+    image_ids.push_back(static_cast<image_t>(record.first));
+  }
+  return image_ids;
+}
+
+std::vector<image_t> FeatureStore::ImageIdsWithDescriptors() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  std::vector<image_t> image_ids;
+  image_ids.reserve(descriptors_.size());
+  for (const auto& record : descriptors_) {
+    image_ids.push_back(static_cast<image_t>(record.first));
+  }
+  return image_ids;
+}
+
+std::vector<image_pair_t> FeatureStore::ImagePairIdsWithMatches() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  std::vector<image_pair_t> pair_ids;
+  pair_ids.reserve(matches_.size());
+  for (const auto& record : matches_) {
+    pair_ids.push_back(record.first);
+  }
+  return pair_ids;
+}
+
+FeatureStore::KeypointsView FeatureStore::ReadKeypoints(
+    const image_t image_id) const {
+  KeypointsView view;
+  Record record;
+  std::shared_ptr<const Mapping> mapping;
+  if (FindRecord(RecordType::KEYPOINTS, image_id, &record, &mapping) &&
+      record.rows > 0) {
+    CHECK_EQ(record.cols, 6);
+    view.mapping_ = mapping;
+    view.data_ = reinterpret_cast<const FeatureKeypoint*>(mapping->Data() +
+                                                          record.offset);
+    view.size_ = static_cast<size_t>(record.rows);
+  }
+  return view;
+}
+
+FeatureStore::DescriptorsView FeatureStore::ReadDescriptors(
+    const image_t image_id) const {
+  DescriptorsView view;
+  Record record;
+  std::shared_ptr<const Mapping> mapping;
+  if (FindRecord(RecordType::DESCRIPTORS, image_id, &record, &mapping)) {
+    view.rows_ = static_cast<Eigen::Index>(record.rows);
+    view.cols_ = static_cast<Eigen::Index>(record.cols);
+    if (view.rows_ > 0 && view.cols_ > 0) {
+      view.mapping_ = mapping;
+      view.data_ =
+          reinterpret_cast<const uint8_t*>(mapping->Data() + record.offset);
+    }
+  }
+  return view;
+}
+
+FeatureStore::MatchesView FeatureStore::ReadMatches(
+    const image_pair_t pair_id) const {
+  MatchesView view;
+  Record record;
+  std::shared_ptr<const Mapping> mapping;
+  if (FindRecord(RecordType::MATCHES, pair_id, &record, &mapping) &&
+      record.rows > 0) {
+    CHECK_EQ(record.cols, 2);
+    view.mapping_ = mapping;
+    view.data_ =
+        reinterpret_cast<const FeatureMatch*>(mapping->Data() + record.offset);
+    view.size_ = static_cast<size_t>(record.rows);
+  }
+  return view;
+}
+
+void FeatureStore::WriteKeypoints(const image_t image_id,
+                                  const FeatureKeypoints& keypoints) {
+  AppendRecord(RecordType::KEYPOINTS, image_id, keypoints.size(), 6,
+               keypoints.data(), keypoints.size() * sizeof(FeatureKeypoint));
+}
+
+void FeatureStore::WriteDescriptors(const image_t image_id,
+                                    const FeatureDescriptors& descriptors) {
+  AppendRecord(RecordType::DESCRIPTORS, image_id, descriptors.rows(),
+               static_cast<uint32_t>(descriptors.cols()), descriptors.data(),
+               descriptors.size() * sizeof(uint8_t));
+}
+
+void FeatureStore::WriteMatches(const image_pair_t pair_id,
+                                const FeatureMatches& matches) {
+  AppendRecord(RecordType::MATCHES, pair_id, matches.size(), 2, matches.data(),
+               matches.size() * sizeof(FeatureMatch));
+}
+
+void FeatureStore::DeleteMatches(const image_pair_t pair_id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  FileLockGuard file_lock(file_lock_.get());
+  ReadIndex();
+  RepairIndex();
+  if (matches_.erase(pair_id) > 0) {
+    Record record;
+    record.offset = kDeletedOffset;
+    record.rows = 0;
+    record.cols = 0;
+    AppendIndexEntry(RecordType::MATCHES, pair_id, record);
+  }
+}
+
+void FeatureStore::ClearMatches() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  FileLockGuard file_lock(file_lock_.get());
+  ReadIndex();
+  RepairIndex();
+  matches_.clear();
+  Record record;
+  record.offset = kDeletedOffset;
+  record.rows = 0;
+  record.cols = 0;
+  AppendIndexEntry(RecordType::MATCHES, kAllKeys, record);
+}
+
+size_t FeatureStore::NumDataBytes() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  return static_cast<size_t>(data_size_);
+}
+
+uint64_t FeatureStore::RecordNumBytes(const RecordType type,
+                                      const Record& record) {
+  // Keypoints are stored as float, descriptors as uint8_t, and matches as
+  // point2D_t elements.
+  const uint64_t element_size =
+      type == RecordType::DESCRIPTORS ? sizeof(uint8_t) : sizeof(float);
+  return record.rows * record.cols * element_size;
+}
+
+FeatureStore::RecordMap& FeatureStore::GetRecords(
+    const RecordType type) const {
+  switch (type) {
+    case RecordType::KEYPOINTS:
+      return keypoints_;
+    case RecordType::DESCRIPTORS:
+      return descriptors_;
+    case RecordType::MATCHES:
+      return matches_;
+  }
+  LOG(FATAL) << "Invalid record type";
+  return keypoints_;
+}
+
+bool FeatureStore::ExistsRecord(const RecordType type,
+                                const uint64_t key) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  return GetRecords(type).count(key) > 0;
+}
+
+size_t FeatureStore::SumRecordRows(const RecordType type) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  size_t num_rows = 0;
+  for (const auto& record : GetRecords(type)) {
+    num_rows += static_cast<size_t>(record.second.rows);
+  }
+  return num_rows;
+}
+
+size_t FeatureStore::MaxRecordRows(const RecordType type) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  size_t max_num_rows = 0;
+  for (const auto& record : GetRecords(type)) {
+    max_num_rows =
+        std::max(max_num_rows, static_cast<size_t>(record.second.rows));
+  }
+  return max_num_rows;
+}
+
+size_t FeatureStore::RecordRows(const RecordType type,
+                                const uint64_t key) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+  const auto& records = GetRecords(type);
+  const auto record = records.find(key);
+  if (record == records.end()) {
+    return 0;
+  }
+  return static_cast<size_t>(record->second.rows);
+}
+
+bool FeatureStore::FindRecord(const RecordType type, const uint64_t key,
+                              Record* record,
+                              std::shared_ptr<const Mapping>* mapping) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReadIndex();
+
+  const auto& records = GetRecords(type);
+  const auto record_it = records.find(key);
+  if (record_it == records.end()) {
+    return false;
+  }
+
+  *record = record_it->second;
+
+  // Only remap the data file when the record lies past the current mapping,
+  // so that reading previously mapped records never remaps the file, even if
+  // other records were appended in the meantime. Previous mappings stay alive
+  // as long as they are referenced by any view.
+  if (!mapping_ ||
+      mapping_->Size() < record->offset + RecordNumBytes(type, *record)) {
+    mapping_ = std::make_shared<const Mapping>(DataPath(path_),
+                                               static_cast<size_t>(data_size_));
+  }
+
+  *mapping = mapping_;
+
+  return true;
+}
+
+void FeatureStore::AppendRecord(const RecordType type, const uint64_t key,
+                                const uint64_t rows, const uint32_t cols,
+                                const void* data, const size_t num_bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  CHECK(data_file_.is_open());
+
+  FileLockGuard file_lock(file_lock_.get());
+  ReadIndex();
+  RepairIndex();
+
+  // Other instances of the store may have appended to the data file, so the
+  // record is placed after its actual end instead of after the known records.
+  data_file_.seekp(0, std::ios::end);
+  const uint64_t data_end = static_cast<uint64_t>(data_file_.tellp());
+  CHECK_GE(data_end, data_size_);
+
+  const uint64_t padding =
+      (kDataAlignment - data_end % kDataAlignment) % kDataAlignment;
+  const char kZeros[kDataAlignment] = {0};
+  data_file_.write(kZeros, padding);
+
+  Record record;
+  record.offset = data_end + padding;
+  record.rows = rows;
+  record.cols = cols;
+
+  data_file_.write(static_cast<const char*>(data), num_bytes);
+  data_file_.flush();
+  CHECK(data_file_.good()) << "Failed to write to " << DataPath(path_);
+
+  data_size_ = record.offset + num_bytes;
+
+  // The index entry is only written after the data, so that an interrupted
+  // write never leaves an index entry pointing to incomplete data.
+  AppendIndexEntry(type, key, record);
+
+  GetRecords(type)[key] = record;
+}
+
+void FeatureStore::AppendIndexEntry(const RecordType type, const uint64_t key,
+                                    const Record& record) {
+  IndexEntry entry;
+  entry.type = static_cast<uint32_t>(type);
+  entry.cols = record.cols;
+  entry.key = key;
+  entry.offset = record.offset;
+  entry.rows = record.rows;
+  index_file_.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+  index_file_.flush();
+  CHECK(index_file_.good()) << "Failed to write to " << IndexPath(path_);
+  index_size_ += sizeof(entry);
+}
+
+void FeatureStore::ReadIndex() const {
+  if (path_.empty()) {
+    return;
+  }
+
+  // The data of a record is always written before its index entry, so the
+  // data file must be measured after the index file to cover all entries.
+  const uint64_t index_size = boost::filesystem::file_size(IndexPath(path_));
+  if (index_size_ > 0 && index_size < index_size_ + sizeof(IndexEntry)) {
+    return;
+  }
+
+  data_size_ = ExistsFile(DataPath(path_)) ? GetFileSize(DataPath(path_)) : 0;
+
+  std::ifstream file(IndexPath(path_), std::ios::binary);
+  CHECK(file.is_open()) << IndexPath(path_);
+
+  if (index_size_ == 0) {
+    IndexHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    CHECK(file.good() &&
+          memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) == 0)
+        << "Invalid feature store index " << IndexPath(path_);
+    CHECK_EQ(header.version, kIndexVersion);
+    index_size_ = sizeof(header);
+  } else {
+    file.seekg(index_size_);
+  }
+
+  // Only read the complete entries within the measured size, since other
+  // instances may concurrently append entries for data beyond `data_size_`.
+  // Read the index in large chunks, since it can have millions of entries.
+  const size_t kNumEntriesPerChunk = 1 << 16;
+  std::vector<IndexEntry> entries(kNumEntriesPerChunk);
+  size_t num_remaining_entries =
+      static_cast<size_t>((index_size - index_size_) / sizeof(IndexEntry));
+  while (num_remaining_entries > 0 && file) {
+    file.read(reinterpret_cast<char*>(entries.data()),
+              std::min(num_remaining_entries, kNumEntriesPerChunk) *
+                  sizeof(IndexEntry));
+    const size_t num_entries =
+        static_cast<size_t>(file.gcount()) / sizeof(IndexEntry);
+    index_size_ += num_entries * sizeof(IndexEntry);
+    num_remaining_entries -= num_entries;
+    for (size_t i = 0; i < num_entries; ++i) {
+      const IndexEntry& entry = entries[i];
+      CHECK_LE(entry.type, static_cast<uint32_t>(RecordType::MATCHES));
+      const RecordType type = static_cast<RecordType>(entry.type);
+      auto& records = GetRecords(type);
+      if (entry.offset == kDeletedOffset) {
+        if (entry.key == kAllKeys) {
+          records.clear();
+        } else {
+          records.erase(entry.key);
+        }
+      } else {
+        Record record;
+        record.offset = entry.offset;
+        record.rows = entry.rows;
+        record.cols = entry.cols;
+        CHECK_LE(record.offset + RecordNumBytes(type, record), data_size_)
+            << "Feature store data is inconsistent with its index";
+        records[entry.key] = record;
+      }
+    }
+  }
+}
+
+void FeatureStore::RepairIndex() {
+  // A trailing partial entry stems from an interrupted write and is removed,
+  // so that subsequently appended entries are correctly aligned.
+  if (GetFileSize(IndexPath(path_)) != index_size_) {
+    boost::filesystem::resize_file(IndexPath(path_), index_size_);
+  }
+}
+
+}  // namespace colmap
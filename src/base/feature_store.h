@@ -0,0 +1,244 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_BASE_FEATURE_STORE_H_
+#define COLMAP_SRC_BASE_FEATURE_STORE_H_
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "feature/types.h"
+#include "util/file_lock.h"
+#include "util/mapped_file.h"
+#include "util/types.h"
+
+namespace colmap {
+
+// Append-only, memory-mapped storage of keypoints, descriptors, and matches.
+//
+// The store consists of three files: `<path>.data` contains the raw, contiguous
+// payload of all records, `<path>.index` contains one fixed-size entry per
+// written record with its offset and dimensions in the data file, and
+// `<path>.lock` serializes the writes of all store instances. Records are
+// never modified in place. Overwriting or deleting a record appends a new
+// index entry that supersedes all previous entries for the same key, so the
+// data file only grows until it is rewritten, e.g., by converting it back and
+// forth with `Database::MoveFeaturesToSQLite/MoveFeaturesToFeatureStore`.
+//
+// Reads return views directly into the memory-mapped data file without any
+// copy or decoding. The views keep the underlying mapping alive, so they stay
+// valid after subsequent writes or after the store is closed. All methods are
+// thread-safe, i.e. concurrent reads and writes are allowed. Multiple instances
+// may also be opened on the same path, e.g., by separate `Database` objects or
+// processes. Each instance picks up the records written by the others, since
+// records are always appended at the actual end of the files and new index
+// entries are read before accessing the records.
+//
+// Keypoints are always stored with all 6 affine shape parameters. Matches are
+// stored for the ordered image pair as defined by `Database::SwapImagePair`.
+class FeatureStore {
+ public:
+  // Read-only view of a contiguous array in the data file.
+  template <typename T>
+  class ArrayView {
+   public:
+    ArrayView() : data_(nullptr), size_(0) {}
+
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+    inline const T* data() const { return data_; }
+    inline const T* begin() const { return data_; }
+    inline const T* end() const { return data_ + size_; }
+    inline const T& operator[](const size_t idx) const { return data_[idx]; }
+
+    // Copy the viewed data into a new vector.
+    std::vector<T> ToVector() const { return std::vector<T>(begin(), end()); }
+
+   private:
+    friend class FeatureStore;
+    std::shared_ptr<const void> mapping_;
+    const T* data_;
+    size_t size_;
+  };
+
+  typedef ArrayView<FeatureKeypoint> KeypointsView;
+  typedef ArrayView<FeatureMatch> MatchesView;
+
+  // Read-only view of a row-major descriptor matrix in the data file.
+  class DescriptorsView {
+   public:
+    typedef Eigen::Map<const FeatureDescriptors> MapType;
+
+    DescriptorsView() : data_(nullptr), rows_(0), cols_(0) {}
+
+    inline MapType Matrix() const { return MapType(data_, rows_, cols_); }
+    inline Eigen::Index rows() const { return rows_; }
+    inline Eigen::Index cols() const { return cols_; }
+    inline const uint8_t* data() const { return data_; }
+
+   private:
+    friend class FeatureStore;
+    std::shared_ptr<const void> mapping_;
+    const uint8_t* data_;
+    Eigen::Index rows_;
+    Eigen::Index cols_;
+  };
+
+  FeatureStore();
+  explicit FeatureStore(const std::string& path);
+  ~FeatureStore();
+
+  // Open or create the store files `<path>.data` and `<path>.index`.
+  void Open(const std::string& path);
+  void Close();
+  bool IsOpen() const;
+
+  // Check whether a store exists at the given path or delete its files.
+  static bool Exists(const std::string& path);
+  static void Remove(const std::string& path);
+
+  bool ExistsKeypoints(const image_t image_id) const;
+  bool ExistsDescriptors(const image_t image_id) const;
+  bool ExistsMatches(const image_pair_t pair_id) const;
+
+  // Aggregate statistics over all records, equivalent to the corresponding
+  // methods in `Database`.
+  size_t NumKeypoints() const;
+  size_t MaxNumKeypoints() const;
+  size_t NumKeypointsForImage(const image_t image_id) const;
+  size_t NumDescriptors() const;
+  size_t MaxNumDescriptors() const;
+  size_t NumDescriptorsForImage(const image_t image_id) const;
+  size_t NumMatches() const;
+  size_t NumMatchedImagePairs() const;
+
+  // Identifiers of all records of the given type in unspecified order.
+  std::vector<image_t> ImageIdsWithKeypoints() const;
+  std::vector<image_t> ImageIdsWithDescriptors() const;
+  std::vector<image_pair_t> ImagePairIdsWithMatches() const;
+
+  // Read a record without copying. Returns an empty view if the record
+  // does not exist.
+  KeypointsView ReadKeypoints(const image_t image_id) const;
+  DescriptorsView ReadDescriptors(const image_t image_id) const;
+  MatchesView ReadMatches(const image_pair_t pair_id) const;
+
+  // Write a new record or overwrite an existing record.
+  void WriteKeypoints(const image_t image_id,
+                      const FeatureKeypoints& keypoints);
+  void WriteDescriptors(const image_t image_id,
+                        const FeatureDescriptors& descriptors);
+  void WriteMatches(const image_pair_t pair_id, const FeatureMatches& matches);
+
+  void DeleteMatches(const image_pair_t pair_id);
+  void ClearMatches();
+
+  // Number of bytes in the data file.
+  size_t NumDataBytes() const;
+
+ private:
+  enum class RecordType : uint32_t {
+    KEYPOINTS = 0,
+    DESCRIPTORS = 1,
+    MATCHES = 2,
+  };
+
+  struct Record {
+    uint64_t offset;
+    uint64_t rows;
+    uint32_t cols;
+  };
+
+  typedef std::unordered_map<uint64_t, Record> RecordMap;
+
+  typedef MappedFile Mapping;
+
+  static uint64_t RecordNumBytes(const RecordType type, const Record& record);
+
+  RecordMap& GetRecords(const RecordType type) const;
+  bool ExistsRecord(const RecordType type, const uint64_t key) const;
+  size_t SumRecordRows(const RecordType type) const;
+  size_t MaxRecordRows(const RecordType type) const;
+  size_t RecordRows(const RecordType type, const uint64_t key) const;
+
+  // Return the record and a mapping that covers it. Returns false if the
+  // record does not exist.
+  bool FindRecord(const RecordType type, const uint64_t key, Record* record,
+                  std::shared_ptr<const Mapping>* mapping) const;
+
+  void AppendRecord(const RecordType type, const uint64_t key,
+                    const uint64_t rows, const uint32_t cols, const void* data,
+                    const size_t num_bytes);
+  void AppendIndexEntry(const RecordType type, const uint64_t key,
+                        const Record& record);
+
+  // Read all index entries that were appended since the last call, including
+  // the entries of other instances of the store.
+  void ReadIndex() const;
+
+  // Remove a trailing partial entry of an interrupted write from the index.
+  // Must only be called while holding the file lock after reading the index.
+  void RepairIndex();
+
+  std::string path_;
+
+  mutable std::mutex mutex_;
+
+  // Serializes the writes of all instances of the store, as the appended
+  // records and their index entries must not interleave.
+  std::unique_ptr<FileLock> file_lock_;
+
+  std::ofstream data_file_;
+  std::ofstream index_file_;
+
+  // The number of bytes in the data file and of the already read entries in
+  // the index file.
+  mutable uint64_t data_size_;
+  mutable uint64_t index_size_;
+
+  // The current mapping of the data file, which is lazily replaced once a
+  // record beyond its end is read.
+  mutable std::shared_ptr<const Mapping> mapping_;
+
+  mutable RecordMap keypoints_;
+  mutable RecordMap descriptors_;
+  mutable RecordMap matches_;
+};
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_BASE_FEATURE_STORE_H_
@@ -0,0 +1,293 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "base/feature_store"
+#include "util/testing.h"
+
+#include "base/database.h"
+#include "base/feature_store.h"
+#include "util/misc.h"
+
+using namespace colmap;
+
+namespace {
+
+std::string GetTemporaryPath() {
+  return (boost::filesystem::temp_directory_path() /
+          boost::filesystem::unique_path())
+      .string();
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestEmpty) {
+  const std::string path = GetTemporaryPath();
+  BOOST_CHECK(!FeatureStore::Exists(path));
+  {
+    FeatureStore feature_store(path);
+    BOOST_CHECK(feature_store.IsOpen());
+    BOOST_CHECK(FeatureStore::Exists(path));
+    BOOST_CHECK_EQUAL(feature_store.NumKeypoints(), 0);
+    BOOST_CHECK_EQUAL(feature_store.MaxNumKeypoints(), 0);
+    BOOST_CHECK_EQUAL(feature_store.NumDescriptors(), 0);
+    BOOST_CHECK_EQUAL(feature_store.MaxNumDescriptors(), 0);
+    BOOST_CHECK_EQUAL(feature_store.NumMatches(), 0);
+    BOOST_CHECK_EQUAL(feature_store.NumMatchedImagePairs(), 0);
+    BOOST_CHECK(!feature_store.ExistsKeypoints(1));
+    BOOST_CHECK(feature_store.ReadKeypoints(1).empty());
+    BOOST_CHECK_EQUAL(feature_store.ReadDescriptors(1).rows(), 0);
+    BOOST_CHECK(feature_store.ReadMatches(1).empty());
+    feature_store.Close();
+    BOOST_CHECK(!feature_store.IsOpen());
+  }
+  FeatureStore::Remove(path);
+  BOOST_CHECK(!FeatureStore::Exists(path));
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWrite) {
+  const std::string path = GetTemporaryPath();
+
+  FeatureKeypoints keypoints1(10);
+  keypoints1[0].x = 1;
+  keypoints1[9].a22 = 2;
+  FeatureKeypoints keypoints2(3);
+  keypoints2[2].y = 3;
+  FeatureDescriptors descriptors(10, 128);
+  descriptors.setRandom();
+  FeatureMatches matches(100);
+  matches[99].point2D_idx1 = 4;
+  matches[99].point2D_idx2 = 5;
+
+  {
+    FeatureStore feature_store(path);
+    feature_store.WriteKeypoints(1, keypoints1);
+    const auto keypoints_view = feature_store.ReadKeypoints(1);
+    BOOST_CHECK_EQUAL(keypoints_view.size(), 10);
+    BOOST_CHECK_EQUAL(keypoints_view[0].x, 1);
+    BOOST_CHECK_EQUAL(keypoints_view[9].a22, 2);
+
+    // Views stay valid after the data file grows and is remapped.
+    feature_store.WriteKeypoints(2, keypoints2);
+    feature_store.WriteDescriptors(1, descriptors);
+    feature_store.WriteMatches(3, matches);
+    BOOST_CHECK_EQUAL(feature_store.ReadKeypoints(2)[2].y, 3);
+    BOOST_CHECK_EQUAL(keypoints_view[9].a22, 2);
+
+    BOOST_CHECK_EQUAL(feature_store.NumKeypoints(), 13);
+    BOOST_CHECK_EQUAL(feature_store.MaxNumKeypoints(), 10);
+    BOOST_CHECK_EQUAL(feature_store.NumKeypointsForImage(2), 3);
+    BOOST_CHECK_EQUAL(feature_store.NumDescriptors(), 10);
+    BOOST_CHECK_EQUAL(feature_store.NumMatches(), 100);
+    BOOST_CHECK_EQUAL(feature_store.NumMatchedImagePairs(), 1);
+
+    // Overwrite existing record.
+    feature_store.WriteKeypoints(1, keypoints2);
+    BOOST_CHECK_EQUAL(feature_store.NumKeypoints(), 6);
+    BOOST_CHECK_EQUAL(feature_store.ReadKeypoints(1).size(), 3);
+    BOOST_CHECK_EQUAL(keypoints_view.size(), 10);
+  }
+
+  {
+    FeatureStore feature_store(path);
+    BOOST_CHECK_EQUAL(feature_store.NumKeypoints(), 6);
+    BOOST_CHECK_EQUAL(feature_store.ReadKeypoints(1)[2].y, 3);
+    const auto descriptors_view = feature_store.ReadDescriptors(1);
+    BOOST_CHECK_EQUAL(descriptors_view.rows(), 10);
+    BOOST_CHECK_EQUAL(descriptors_view.cols(), 128);
+    BOOST_CHECK(descriptors_view.Matrix() == descriptors);
+    const auto matches_view = feature_store.ReadMatches(3);
+    BOOST_CHECK_EQUAL(matches_view.size(), 100);
+    BOOST_CHECK_EQUAL(matches_view[99].point2D_idx1, 4);
+    BOOST_CHECK_EQUAL(matches_view[99].point2D_idx2, 5);
+
+    feature_store.WriteMatches(4, matches);
+    feature_store.DeleteMatches(3);
+    BOOST_CHECK(!feature_store.ExistsMatches(3));
+    BOOST_CHECK(feature_store.ExistsMatches(4));
+  }
+
+  {
+    FeatureStore feature_store(path);
+    BOOST_CHECK(!feature_store.ExistsMatches(3));
+    BOOST_CHECK(feature_store.ExistsMatches(4));
+    feature_store.ClearMatches();
+    BOOST_CHECK_EQUAL(feature_store.NumMatchedImagePairs(), 0);
+  }
+
+  {
+    FeatureStore feature_store(path);
+    BOOST_CHECK_EQUAL(feature_store.NumMatchedImagePairs(), 0);
+    BOOST_CHECK_EQUAL(feature_store.NumKeypoints(), 6);
+  }
+
+  FeatureStore::Remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestInterleavedReadWrite) {
+  const std::string path = GetTemporaryPath();
+
+  FeatureStore feature_store(path);
+  feature_store.WriteKeypoints(1, FeatureKeypoints(10));
+  const auto keypoints_view = feature_store.ReadKeypoints(1);
+
+  // Records within the current mapping are read without remapping the data
+  // file, even if other records were appended in the meantime.
+  for (image_t image_id = 2; image_id < 10; ++image_id) {
+    feature_store.WriteKeypoints(image_id, FeatureKeypoints(image_id));
+    BOOST_CHECK_EQUAL(feature_store.ReadKeypoints(1).data(),
+                      keypoints_view.data());
+  }
+
+  // Records past the current mapping are read from a new mapping.
+  const auto new_keypoints_view = feature_store.ReadKeypoints(9);
+  BOOST_CHECK_EQUAL(new_keypoints_view.size(), 9);
+  BOOST_CHECK_NE(feature_store.ReadKeypoints(1).data(), keypoints_view.data());
+  BOOST_CHECK_EQUAL(keypoints_view.size(), 10);
+
+  feature_store.Close();
+  FeatureStore::Remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestMultipleInstances) {
+  const std::string path = GetTemporaryPath();
+
+  // Independently opened instances append their records after each other and
+  // see the records of the other instance.
+  FeatureStore feature_store1(path);
+  FeatureStore feature_store2(path);
+  for (image_t image_id = 1; image_id <= 10; ++image_id) {
+    FeatureKeypoints keypoints(image_id);
+    keypoints[0].x = image_id;
+    FeatureStore& feature_store =
+        image_id % 2 == 0 ? feature_store1 : feature_store2;
+    feature_store.WriteKeypoints(image_id, keypoints);
+  }
+
+  FeatureMatches matches(3);
+  matches[2].point2D_idx1 = 4;
+  feature_store1.WriteMatches(1, matches);
+  feature_store2.WriteMatches(2, matches);
+  feature_store2.DeleteMatches(1);
+
+  for (const FeatureStore* feature_store : {&feature_store1, &feature_store2}) {
+    BOOST_CHECK_EQUAL(feature_store->NumKeypoints(), 55);
+    BOOST_CHECK_EQUAL(feature_store->ImageIdsWithKeypoints().size(), 10);
+    BOOST_CHECK_EQUAL(feature_store->NumDataBytes(),
+                      GetFileSize(path + ".data"));
+    for (image_t image_id = 1; image_id <= 10; ++image_id) {
+      const auto keypoints = feature_store->ReadKeypoints(image_id);
+      BOOST_CHECK_EQUAL(keypoints.size(), image_id);
+      BOOST_CHECK_EQUAL(keypoints[0].x, image_id);
+    }
+    BOOST_CHECK(!feature_store->ExistsMatches(1));
+    BOOST_CHECK_EQUAL(feature_store->NumMatchedImagePairs(), 1);
+    BOOST_CHECK_EQUAL(feature_store->ReadMatches(2)[2].point2D_idx1, 4);
+  }
+
+  feature_store1.Close();
+  feature_store2.Close();
+
+  FeatureStore feature_store(path);
+  BOOST_CHECK_EQUAL(feature_store.NumKeypoints(), 55);
+  BOOST_CHECK_EQUAL(feature_store.ReadKeypoints(7)[0].x, 7);
+  BOOST_CHECK_EQUAL(feature_store.NumMatchedImagePairs(), 1);
+  feature_store.Close();
+
+  FeatureStore::Remove(path);
+  BOOST_CHECK(!ExistsFile(path + ".lock"));
+}
+
+BOOST_AUTO_TEST_CASE(TestDatabaseConversion) {
+  const std::string path = GetTemporaryPath();
+
+  Database database(path);
+  BOOST_CHECK(!database.HasFeatureStore());
+  BOOST_CHECK(database.GetFeatureStore() == nullptr);
+
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_PINHOLE", 1.0, 1, 1);
+  camera.SetCameraId(database.WriteCamera(camera));
+  Image image1;
+  image1.SetName("test1");
+  image1.SetCameraId(camera.CameraId());
+  image1.SetImageId(database.WriteImage(image1));
+  Image image2;
+  image2.SetName("test2");
+  image2.SetCameraId(camera.CameraId());
+  image2.SetImageId(database.WriteImage(image2));
+
+  FeatureKeypoints keypoints(10);
+  keypoints[3].x = 1;
+  FeatureDescriptors descriptors(10, 128);
+  descriptors.setRandom();
+  FeatureMatches matches(20);
+  matches[0].point2D_idx1 = 1;
+  matches[0].point2D_idx2 = 2;
+
+  database.WriteKeypoints(image1.ImageId(), keypoints);
+  database.WriteDescriptors(image1.ImageId(), descriptors);
+  database.WriteMatches(image2.ImageId(), image1.ImageId(), matches);
+
+  database.MoveFeaturesToFeatureStore();
+  BOOST_CHECK(database.HasFeatureStore());
+  BOOST_CHECK(database.GetFeatureStore() != nullptr);
+  BOOST_CHECK_EQUAL(database.NumKeypoints(), 10);
+  BOOST_CHECK_EQUAL(database.NumDescriptors(), 10);
+  BOOST_CHECK_EQUAL(database.NumMatches(), 20);
+  BOOST_CHECK_EQUAL(database.ReadKeypoints(image1.ImageId())[3].x, 1);
+  BOOST_CHECK(database.ReadDescriptors(image1.ImageId()) == descriptors);
+  BOOST_CHECK_EQUAL(
+      database.ReadMatches(image2.ImageId(), image1.ImageId())[0].point2D_idx1,
+      1);
+  BOOST_CHECK_EQUAL(
+      database.ReadMatches(image1.ImageId(), image2.ImageId())[0].point2D_idx1,
+      2);
+
+  // The feature store is automatically used when reopening the database.
+  database.Close();
+  database.Open(path);
+  BOOST_CHECK(database.HasFeatureStore());
+  database.WriteKeypoints(image2.ImageId(), keypoints);
+  BOOST_CHECK_EQUAL(database.NumKeypoints(), 20);
+
+  database.MoveFeaturesToSQLite();
+  BOOST_CHECK(!database.HasFeatureStore());
+  BOOST_CHECK(!FeatureStore::Exists(Database::FeatureStorePath(path)));
+  BOOST_CHECK_EQUAL(database.NumKeypoints(), 20);
+  BOOST_CHECK_EQUAL(database.ReadKeypoints(image2.ImageId())[3].x, 1);
+  BOOST_CHECK(database.ReadDescriptors(image1.ImageId()) == descriptors);
+  BOOST_CHECK_EQUAL(
+      database.ReadMatches(image2.ImageId(), image1.ImageId())[0].point2D_idx1,
+      1);
+
+  database.Close();
+  boost::filesystem::remove(path);
+}
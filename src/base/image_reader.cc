@@ -81,6 +81,72 @@ ImageReader::ImageReader(const ImageReaderOptions& options, Database* database)
 
 ImageReader::Status ImageReader::Next(Camera* camera, Image* image,
                                       Bitmap* bitmap, Bitmap* mask) {
+  return Next(nullptr, camera, image, bitmap, mask);
+}
+
+size_t ImageReader::NextIndex() const { return image_index_; }
+
+size_t ImageReader::NumImages() const { return options_.image_list.size(); }
+
+bool ImageReader::ExistsFeatures(const size_t index) const {
+  const std::string image_name = ImageName(index);
+  if (!database_->ExistsImageWithName(image_name)) {
+    return false;
+  }
+
+  const image_t image_id = database_->ReadImageWithName(image_name).ImageId();
+  return database_->ExistsKeypoints(image_id) &&
+         database_->ExistsDescriptors(image_id);
+}
+
+ImageReader::Status ImageReader::Decode(const size_t index, Bitmap* bitmap,
+                                        Bitmap* mask) const {
+  CHECK_NOTNULL(bitmap);
+  CHECK_LT(index, options_.image_list.size());
+
+  const std::string& image_path = options_.image_list[index];
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Read image.
+  //////////////////////////////////////////////////////////////////////////////
+
+  if (!bitmap->Read(image_path, false)) {
+    return Status::BITMAP_ERROR;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Read mask.
+  //////////////////////////////////////////////////////////////////////////////
+
+  if (mask && !options_.mask_path.empty()) {
+    const std::string mask_path =
+        JoinPaths(options_.mask_path,
+                  GetRelativePath(options_.image_path, image_path) + ".png");
+    if (ExistsFile(mask_path) && !mask->Read(mask_path, false)) {
+      // NOTE: Maybe introduce a separate error type MASK_ERROR?
+      return Status::BITMAP_ERROR;
+    }
+  }
+
+  return Status::SUCCESS;
+}
+
+ImageReader::Status ImageReader::NextDecoded(const Status decode_status,
+                                             Camera* camera, Image* image,
+                                             Bitmap* bitmap, Bitmap* mask) {
+  return Next(&decode_status, camera, image, bitmap, mask);
+}
+
+std::string ImageReader::ImageName(const size_t index) const {
+  const std::string image_path =
+      StringReplace(options_.image_list.at(index), "\\", "/");
+  return image_path.substr(options_.image_path.size(),
+                           image_path.size() - options_.image_path.size());
+}
+
+ImageReader::Status ImageReader::Next(const Status* decode_status,
+                                      Camera* camera, Image* image,
+                                      Bitmap* bitmap, Bitmap* mask) {
   CHECK_NOTNULL(camera);
   CHECK_NOTNULL(image);
   CHECK_NOTNULL(bitmap);
@@ -88,19 +154,13 @@ ImageReader::Status ImageReader::Next(Camera* camera, Image* image,
   image_index_ += 1;
   CHECK_LE(image_index_, options_.image_list.size());
 
-  const std::string image_path = options_.image_list.at(image_index_ - 1);
-
   DatabaseTransaction database_transaction(database_);
 
   //////////////////////////////////////////////////////////////////////////////
   // Set the image name.
   //////////////////////////////////////////////////////////////////////////////
 
-  image->SetName(image_path);
-  image->SetName(StringReplace(image->Name(), "\\", "/"));
-  image->SetName(
-      image->Name().substr(options_.image_path.size(),
-                           image->Name().size() - options_.image_path.size()));
+  image->SetName(ImageName(image_index_ - 1));
 
   const std::string image_folder = GetParentDir(image->Name());
 
@@ -122,25 +182,14 @@ ImageReader::Status ImageReader::Next(Camera* camera, Image* image,
   }
 
   //////////////////////////////////////////////////////////////////////////////
-  // Read image.
-  //////////////////////////////////////////////////////////////////////////////
-
-  if (!bitmap->Read(image_path, false)) {
-    return Status::BITMAP_ERROR;
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-  // Read mask.
+  // Read image and mask.
   //////////////////////////////////////////////////////////////////////////////
 
-  if (mask && !options_.mask_path.empty()) {
-    const std::string mask_path =
-        JoinPaths(options_.mask_path,
-                  GetRelativePath(options_.image_path, image_path) + ".png");
-    if (ExistsFile(mask_path) && !mask->Read(mask_path, false)) {
-      // NOTE: Maybe introduce a separate error type MASK_ERROR?
-      return Status::BITMAP_ERROR;
-    }
+  const Status read_status = decode_status == nullptr
+                                 ? Decode(image_index_ - 1, bitmap, mask)
+                                 : *decode_status;
+  if (read_status != Status::SUCCESS) {
+    return read_status;
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -230,8 +279,4 @@ ImageReader::Status ImageReader::Next(Camera* camera, Image* image,
   return Status::SUCCESS;
 }
 
-size_t ImageReader::NextIndex() const { return image_index_; }
-
-size_t ImageReader::NumImages() const { return options_.image_list.size(); }
-
 }  // namespace colmap
@@ -111,7 +111,30 @@ class ImageReader {
   size_t NextIndex() const;
   size_t NumImages() const;
 
+  // Decoding the images is usually the most expensive part of reading them.
+  // Since it does not depend on the database or the previously read images,
+  // the bitmaps can be decoded concurrently with `Decode` ahead of time, as
+  // long as `NextDecoded` is then called in the order of the image indices.
+
+  // Check whether the features of the image at the given index were already
+  // extracted, in which case the image does not need to be decoded.
+  bool ExistsFeatures(const size_t index) const;
+
+  // Decode the bitmap and the optional mask of the image at the given index.
+  // This method is thread-safe and can be called concurrently.
+  Status Decode(const size_t index, Bitmap* bitmap, Bitmap* mask) const;
+
+  // Same as `Next` but with the bitmap and mask of the next image already
+  // decoded by `Decode`, which returned the given status.
+  Status NextDecoded(const Status decode_status, Camera* camera, Image* image,
+                     Bitmap* bitmap, Bitmap* mask);
+
  private:
+  std::string ImageName(const size_t index) const;
+
+  Status Next(const Status* decode_status, Camera* camera, Image* image,
+              Bitmap* bitmap, Bitmap* mask);
+
   // Image reader options.
   ImageReaderOptions options_;
   Database* database_;
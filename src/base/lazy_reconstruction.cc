@@ -0,0 +1,583 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "base/lazy_reconstruction.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+
+#include "base/reconstruction.h"
+#include "util/endian.h"
+#include "util/logging.h"
+#include "util/misc.h"
+#include "util/ply.h"
+
+namespace colmap {
+namespace {
+
+const char kIndexMagic[8] = {'C', 'O', 'L', 'M', 'A', 'P', 'R', 'I'};
+const uint32_t kIndexVersion = 2;
+
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t images_file_size;
+  uint64_t points3D_file_size;
+  int64_t images_file_mtime;
+  int64_t points3D_file_mtime;
+  uint64_t num_images;
+  uint64_t num_points3D;
+};
+
+static_assert(sizeof(IndexHeader) == 64, "Index header must be packed");
+
+// Number of 3D points, whose identifiers are verified when opening the model.
+const size_t kNumVerifiedPoints3D = 32;
+
+int64_t GetFileModificationTime(const std::string& path) {
+  return static_cast<int64_t>(boost::filesystem::last_write_time(path));
+}
+
+const uint64_t kPoint2DNumBytes = 2 * sizeof(double) + sizeof(point3D_t);
+const uint64_t kTrackElementNumBytes = sizeof(image_t) + sizeof(point2D_t);
+
+// Read an image record of `images.bin`. The 2D points are only read if the
+// output vectors are given and skipped otherwise.
+void ReadImageRecord(MappedFileReader* reader, class Image* image,
+                     std::vector<Eigen::Vector2d>* points2D,
+                     std::vector<point3D_t>* point3D_ids) {
+  image->SetImageId(reader->Read<image_t>());
+
+  image->Qvec(0) = reader->Read<double>();
+  image->Qvec(1) = reader->Read<double>();
+  image->Qvec(2) = reader->Read<double>();
+  image->Qvec(3) = reader->Read<double>();
+  image->NormalizeQvec();
+
+  image->Tvec(0) = reader->Read<double>();
+  image->Tvec(1) = reader->Read<double>();
+  image->Tvec(2) = reader->Read<double>();
+
+  image->SetCameraId(reader->Read<camera_t>());
+  image->SetName(reader->ReadString());
+
+  const size_t num_points2D = reader->Read<uint64_t>();
+  if (points2D == nullptr || point3D_ids == nullptr) {
+    reader->Skip(num_points2D * kPoint2DNumBytes);
+    return;
+  }
+
+  points2D->reserve(num_points2D);
+  point3D_ids->reserve(num_points2D);
+  for (size_t i = 0; i < num_points2D; ++i) {
+    const double x = reader->Read<double>();
+    const double y = reader->Read<double>();
+    points2D->emplace_back(x, y);
+    point3D_ids->push_back(reader->Read<point3D_t>());
+  }
+}
+
+// Read a 3D point record of `points3D.bin`.
+class Point3D ReadPoint3DRecord(MappedFileReader* reader,
+                                point3D_t* point3D_id) {
+  class Point3D point3D;
+
+  *point3D_id = reader->Read<point3D_t>();
+
+  point3D.XYZ()(0) = reader->Read<double>();
+  point3D.XYZ()(1) = reader->Read<double>();
+  point3D.XYZ()(2) = reader->Read<double>();
+  point3D.Color(0) = reader->Read<uint8_t>();
+  point3D.Color(1) = reader->Read<uint8_t>();
+  point3D.Color(2) = reader->Read<uint8_t>();
+  point3D.SetError(reader->Read<double>());
+
+  const size_t track_length = reader->Read<uint64_t>();
+  point3D.Track().Reserve(track_length);
+  for (size_t i = 0; i < track_length; ++i) {
+    const image_t image_id = reader->Read<image_t>();
+    const point2D_t point2D_idx = reader->Read<point2D_t>();
+    point3D.Track().AddElement(image_id, point2D_idx);
+  }
+
+  return point3D;
+}
+
+}  // namespace
+
+LazyReconstruction::LazyReconstruction(const std::string& path) {
+  CHECK(Exists(path)) << "Binary model does not exist at " << path;
+  ReadCameras(JoinPaths(path, "cameras.bin"));
+  ReadIndex(path);
+}
+
+bool LazyReconstruction::Exists(const std::string& path) {
+  return ExistsFile(JoinPaths(path, "cameras.bin")) &&
+         ExistsFile(JoinPaths(path, "images.bin")) &&
+         ExistsFile(JoinPaths(path, "points3D.bin"));
+}
+
+void LazyReconstruction::WriteIndex(const std::string& path) {
+  const std::string images_path = JoinPaths(path, "images.bin");
+  const std::string points3D_path = JoinPaths(path, "points3D.bin");
+
+  std::vector<IndexEntry> image_entries;
+  std::vector<IndexEntry> point3D_entries;
+
+  IndexHeader header;
+  memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.version = kIndexVersion;
+  header.reserved = 0;
+
+  {
+    MappedFile images_file(images_path);
+    header.images_file_size = images_file.Size();
+    header.images_file_mtime = GetFileModificationTime(images_path);
+    BuildImageIndex(images_file, &image_entries);
+  }
+
+  {
+    MappedFile points3D_file(points3D_path);
+    header.points3D_file_size = points3D_file.Size();
+    header.points3D_file_mtime = GetFileModificationTime(points3D_path);
+    BuildPoint3DIndex(points3D_file, &point3D_entries);
+  }
+
+  header.num_images = image_entries.size();
+  header.num_points3D = point3D_entries.size();
+
+  // Write to a temporary file first, such that an interrupted write never
+  // leaves a truncated index behind.
+  const std::string index_path = JoinPaths(path, "index.bin");
+  const std::string temp_index_path = index_path + ".tmp";
+  std::ofstream file(temp_index_path, std::ios::trunc | std::ios::binary);
+  CHECK(file.is_open()) << temp_index_path;
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(image_entries.data()),
+             image_entries.size() * sizeof(IndexEntry));
+  file.write(reinterpret_cast<const char*>(point3D_entries.data()),
+             point3D_entries.size() * sizeof(IndexEntry));
+
+  file.close();
+  CHECK(file.good()) << "Failed to write " << temp_index_path;
+  boost::filesystem::rename(temp_index_path, index_path);
+}
+
+size_t LazyReconstruction::NumPoints3D() const {
+  return GetPoint3DIndex()->entries.size();
+}
+
+bool LazyReconstruction::ExistsPoint3D(const point3D_t point3D_id) const {
+  const Span<const IndexEntry> entries = GetPoint3DIndex()->entries;
+  const auto entry = std::lower_bound(
+      entries.begin(), entries.end(), point3D_id,
+      [](const IndexEntry& entry, const uint64_t id) { return entry.id < id; });
+  return entry != entries.end() && entry->id == point3D_id;
+}
+
+std::vector<point3D_t> LazyReconstruction::Point3DIds() const {
+  const std::shared_ptr<const Point3DIndex> point3D_index = GetPoint3DIndex();
+  std::vector<point3D_t> point3D_ids;
+  point3D_ids.reserve(point3D_index->entries.size());
+  for (const auto& entry : point3D_index->entries) {
+    point3D_ids.push_back(static_cast<point3D_t>(entry.id));
+  }
+  return point3D_ids;
+}
+
+class Image LazyReconstruction::Image(const image_t image_id) const {
+  const bool kReadPoints2D = true;
+  return ReadImage(image_id, kReadPoints2D);
+}
+
+class Image LazyReconstruction::ImageHeader(const image_t image_id) const {
+  const bool kReadPoints2D = false;
+  return ReadImage(image_id, kReadPoints2D);
+}
+
+class Point3D LazyReconstruction::Point3D(const point3D_t point3D_id) const {
+  std::shared_ptr<const Point3DIndex> point3D_index = GetPoint3DIndex();
+  while (true) {
+    const Span<const IndexEntry> entries = point3D_index->entries;
+    const auto entry = std::lower_bound(
+        entries.begin(), entries.end(), point3D_id,
+        [](const IndexEntry& entry, const uint64_t id) {
+          return entry.id < id;
+        });
+    CHECK(entry != entries.end() && entry->id == point3D_id)
+        << "3D point " << point3D_id << " does not exist";
+
+    // The rebuilt index is always consistent with the model.
+    if (point3D_index->rebuilt_entries.empty() &&
+        !VerifyEntry<point3D_t>(*points3D_file_, *entry)) {
+      point3D_index = RebuildPoint3DIndex(point3D_index);
+      continue;
+    }
+
+    MappedFileReader reader(*points3D_file_, entry->offset);
+    point3D_t read_point3D_id;
+    return ReadPoint3DRecord(&reader, &read_point3D_id);
+  }
+}
+
+void LazyReconstruction::ReadPoints3D(
+    const std::function<void(const point3D_t, const class Point3D&)>& func)
+    const {
+  MappedFileReader reader(*points3D_file_, 0);
+  const size_t num_points3D = reader.Read<uint64_t>();
+  for (size_t i = 0; i < num_points3D; ++i) {
+    point3D_t point3D_id;
+    const class Point3D point3D = ReadPoint3DRecord(&reader, &point3D_id);
+    func(point3D_id, point3D);
+  }
+}
+
+size_t LazyReconstruction::ComputeNumObservations() const {
+  size_t num_obs = 0;
+  ReadPoints3D([&num_obs](const point3D_t, const class Point3D& point3D) {
+    num_obs += point3D.Track().Length();
+  });
+  return num_obs;
+}
+
+double LazyReconstruction::ComputeMeanTrackLength() const {
+  if (NumPoints3D() == 0) {
+    return 0.0;
+  } else {
+    return ComputeNumObservations() / static_cast<double>(NumPoints3D());
+  }
+}
+
+double LazyReconstruction::ComputeMeanObservationsPerRegImage() const {
+  if (reg_image_ids_.empty()) {
+    return 0.0;
+  } else {
+    return ComputeNumObservations() /
+           static_cast<double>(reg_image_ids_.size());
+  }
+}
+
+double LazyReconstruction::ComputeMeanReprojectionError() const {
+  double error_sum = 0.0;
+  size_t num_valid_errors = 0;
+  ReadPoints3D([&](const point3D_t, const class Point3D& point3D) {
+    if (point3D.HasError()) {
+      error_sum += point3D.Error();
+      num_valid_errors += 1;
+    }
+  });
+
+  if (num_valid_errors == 0) {
+    return 0.0;
+  } else {
+    return error_sum / num_valid_errors;
+  }
+}
+
+std::vector<PlyPoint> LazyReconstruction::ConvertToPLY() const {
+  std::vector<PlyPoint> ply_points;
+  ply_points.reserve(NumPoints3D());
+
+  ReadPoints3D([&ply_points](const point3D_t, const class Point3D& point3D) {
+    PlyPoint ply_point;
+    ply_point.x = point3D.X();
+    ply_point.y = point3D.Y();
+    ply_point.z = point3D.Z();
+    ply_point.r = point3D.Color(0);
+    ply_point.g = point3D.Color(1);
+    ply_point.b = point3D.Color(2);
+    ply_points.push_back(ply_point);
+  });
+
+  return ply_points;
+}
+
+void LazyReconstruction::ReadSubset(const std::vector<image_t>& image_ids,
+                                    Reconstruction* reconstruction) const {
+  CHECK_EQ(reconstruction->NumImages(), 0);
+  CHECK_EQ(reconstruction->NumPoints3D(), 0);
+
+  const std::unordered_set<image_t> image_id_set(image_ids.begin(),
+                                                 image_ids.end());
+
+  // The 3D points are added after all images and link the observations again,
+  // so that the tracks only refer to images in the subset.
+  std::vector<point3D_t> point3D_ids;
+  for (const image_t image_id : image_ids) {
+    class Image image = Image(image_id);
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      const class Point2D& point2D = image.Point2D(point2D_idx);
+      if (point2D.HasPoint3D()) {
+        point3D_ids.push_back(point2D.Point3DId());
+        image.ResetPoint3DForPoint2D(point2D_idx);
+      }
+    }
+
+    if (!reconstruction->ExistsCamera(image.CameraId())) {
+      reconstruction->AddCamera(Camera(image.CameraId()));
+    }
+
+    image.SetRegistered(false);
+    reconstruction->AddImage(image);
+    reconstruction->RegisterImage(image_id);
+  }
+
+  // Sorting the identifiers also reads the 3D points in index order.
+  std::sort(point3D_ids.begin(), point3D_ids.end());
+  point3D_ids.erase(std::unique(point3D_ids.begin(), point3D_ids.end()),
+                    point3D_ids.end());
+
+  for (const point3D_t point3D_id : point3D_ids) {
+    const class Point3D point3D = Point3D(point3D_id);
+    Track track;
+    for (const auto& track_el : point3D.Track().Elements()) {
+      if (image_id_set.count(track_el.image_id) > 0) {
+        track.AddElement(track_el);
+      }
+    }
+    const point3D_t new_point3D_id =
+        reconstruction->AddPoint3D(point3D.XYZ(), track, point3D.Color());
+    reconstruction->Point3D(new_point3D_id).SetError(point3D.Error());
+  }
+}
+
+void LazyReconstruction::ReadCameras(const std::string& path) {
+  const MappedFile file(path);
+  MappedFileReader reader(file, 0);
+
+  const size_t num_cameras = reader.Read<uint64_t>();
+  cameras_.reserve(num_cameras);
+  for (size_t i = 0; i < num_cameras; ++i) {
+    class Camera camera;
+    camera.SetCameraId(reader.Read<camera_t>());
+    camera.SetModelId(reader.Read<int>());
+    camera.SetWidth(reader.Read<uint64_t>());
+    camera.SetHeight(reader.Read<uint64_t>());
+    for (double& param : camera.Params()) {
+      param = reader.Read<double>();
+    }
+    CHECK(camera.VerifyParams());
+    cameras_.emplace(camera.CameraId(), camera);
+  }
+}
+
+void LazyReconstruction::ReadIndex(const std::string& path) {
+  const std::string images_path = JoinPaths(path, "images.bin");
+  const std::string points3D_path = JoinPaths(path, "points3D.bin");
+  images_file_.reset(new MappedFile(images_path));
+  points3D_file_.reset(new MappedFile(points3D_path));
+
+  // Use the index file only if it was written for the current model files.
+  const std::string index_path = JoinPaths(path, "index.bin");
+  if (ExistsFile(index_path)) {
+    index_file_.reset(new MappedFile(index_path));
+    IndexHeader header;
+    if (index_file_->Size() >= sizeof(header)) {
+      memcpy(&header, index_file_->Data(), sizeof(header));
+    }
+    if (index_file_->Size() < sizeof(header) ||
+        memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+        header.version != kIndexVersion ||
+        header.images_file_size != images_file_->Size() ||
+        header.points3D_file_size != points3D_file_->Size() ||
+        header.images_file_mtime != GetFileModificationTime(images_path) ||
+        header.points3D_file_mtime != GetFileModificationTime(points3D_path) ||
+        index_file_->Size() !=
+            sizeof(header) + (header.num_images + header.num_points3D) *
+                                 sizeof(IndexEntry)) {
+      index_file_.reset();
+    }
+  }
+
+  Span<const IndexEntry> image_entries;
+  std::vector<IndexEntry> rebuilt_image_entries;
+  std::shared_ptr<Point3DIndex> point3D_index(new Point3DIndex());
+  if (index_file_) {
+    IndexHeader header;
+    memcpy(&header, index_file_->Data(), sizeof(header));
+    const IndexEntry* entries =
+        reinterpret_cast<const IndexEntry*>(index_file_->Data() + sizeof(header));
+    image_entries = Span<const IndexEntry>(entries, header.num_images);
+    point3D_index->entries = Span<const IndexEntry>(
+        entries + header.num_images, header.num_points3D);
+
+    // Verify all images, which are few compared to their 2D points, and a
+    // sample of the 3D points evenly spread over the index.
+    bool valid = true;
+    for (const auto& entry : image_entries) {
+      valid = valid && VerifyEntry<image_t>(*images_file_, entry);
+    }
+    const size_t num_points3D = point3D_index->entries.size();
+    const size_t num_verified_points3D =
+        std::min(num_points3D, kNumVerifiedPoints3D);
+    for (size_t i = 0; valid && i < num_verified_points3D; ++i) {
+      const size_t idx =
+          num_verified_points3D > 1
+              ? i * (num_points3D - 1) / (num_verified_points3D - 1)
+              : 0;
+      valid = VerifyEntry<point3D_t>(*points3D_file_,
+                                     point3D_index->entries[idx]);
+    }
+    if (!valid) {
+      std::cout << "WARNING: Index does not match the model, rebuilding it: "
+                << index_path << std::endl;
+      index_file_.reset();
+    }
+  }
+
+  if (!index_file_) {
+    BuildImageIndex(*images_file_, &rebuilt_image_entries);
+    image_entries = rebuilt_image_entries;
+    BuildPoint3DIndex(*points3D_file_, &point3D_index->rebuilt_entries);
+    point3D_index->entries = point3D_index->rebuilt_entries;
+  }
+
+  reg_image_ids_.reserve(image_entries.size());
+  image_offsets_.reserve(image_entries.size());
+  for (const auto& entry : image_entries) {
+    reg_image_ids_.push_back(static_cast<image_t>(entry.id));
+    image_offsets_.emplace(static_cast<image_t>(entry.id), entry.offset);
+  }
+
+  point3D_index_ = point3D_index;
+}
+
+void LazyReconstruction::BuildImageIndex(const MappedFile& file,
+                                         std::vector<IndexEntry>* entries) {
+  MappedFileReader reader(file, 0);
+  const size_t num_images = reader.Read<uint64_t>();
+  entries->reserve(num_images);
+  for (size_t i = 0; i < num_images; ++i) {
+    IndexEntry entry;
+    entry.offset = reader.Offset();
+    class Image image;
+    ReadImageRecord(&reader, &image, nullptr, nullptr);
+    entry.id = image.ImageId();
+    entries->push_back(entry);
+  }
+}
+
+void LazyReconstruction::BuildPoint3DIndex(const MappedFile& file,
+                                           std::vector<IndexEntry>* entries) {
+  MappedFileReader reader(file, 0);
+  const size_t num_points3D = reader.Read<uint64_t>();
+  entries->reserve(num_points3D);
+  for (size_t i = 0; i < num_points3D; ++i) {
+    IndexEntry entry;
+    entry.offset = reader.Offset();
+    entry.id = reader.Read<point3D_t>();
+    // Skip the position, color, and error to the track length.
+    reader.Skip(3 * sizeof(double) + 3 * sizeof(uint8_t) + sizeof(double));
+    reader.Skip(reader.Read<uint64_t>() * kTrackElementNumBytes);
+    entries->push_back(entry);
+  }
+
+  std::sort(entries->begin(), entries->end(),
+            [](const IndexEntry& entry1, const IndexEntry& entry2) {
+              return entry1.id < entry2.id;
+            });
+}
+
+template <typename T>
+bool LazyReconstruction::VerifyEntry(const MappedFile& file,
+                                     const IndexEntry& entry) {
+  if (entry.offset > file.Size() || file.Size() - entry.offset < sizeof(T)) {
+    return false;
+  }
+  MappedFileReader reader(file, entry.offset);
+  return reader.Read<T>() == entry.id;
+}
+
+std::shared_ptr<const LazyReconstruction::Point3DIndex>
+LazyReconstruction::GetPoint3DIndex() const {
+  return std::atomic_load(&point3D_index_);
+}
+
+std::shared_ptr<const LazyReconstruction::Point3DIndex>
+LazyReconstruction::RebuildPoint3DIndex(
+    const std::shared_ptr<const Point3DIndex>& outdated_index) const {
+  std::unique_lock<std::mutex> lock(point3D_index_mutex_);
+  // Another thread may have rebuilt the index in the meantime.
+  std::shared_ptr<const Point3DIndex> point3D_index = GetPoint3DIndex();
+  if (point3D_index != outdated_index) {
+    return point3D_index;
+  }
+
+  std::cout << "WARNING: Index of 3D points does not match the model, "
+               "rebuilding it"
+            << std::endl;
+
+  std::shared_ptr<Point3DIndex> rebuilt_index(new Point3DIndex());
+  BuildPoint3DIndex(*points3D_file_, &rebuilt_index->rebuilt_entries);
+  rebuilt_index->entries = rebuilt_index->rebuilt_entries;
+  std::atomic_store(&point3D_index_,
+                    std::shared_ptr<const Point3DIndex>(rebuilt_index));
+  return rebuilt_index;
+}
+
+class Image LazyReconstruction::ReadImage(const image_t image_id,
+                                          const bool read_points2D) const {
+  const auto offset = image_offsets_.find(image_id);
+  CHECK(offset != image_offsets_.end())
+      << "Image " << image_id << " does not exist";
+
+  class Image image;
+  std::vector<Eigen::Vector2d> points2D;
+  std::vector<point3D_t> point3D_ids;
+
+  MappedFileReader reader(*images_file_, offset->second);
+  if (read_points2D) {
+    ReadImageRecord(&reader, &image, &points2D, &point3D_ids);
+  } else {
+    ReadImageRecord(&reader, &image, nullptr, nullptr);
+  }
+  CHECK_EQ(image.ImageId(), image_id);
+
+  image.SetUp(Camera(image.CameraId()));
+  image.SetPoints2D(points2D);
+  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+       ++point2D_idx) {
+    if (point3D_ids[point2D_idx] != kInvalidPoint3DId) {
+      image.SetPoint3DForPoint2D(point2D_idx, point3D_ids[point2D_idx]);
+    }
+  }
+  image.SetRegistered(true);
+
+  return image;
+}
+
+}  // namespace colmap
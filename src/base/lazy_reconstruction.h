@@ -0,0 +1,224 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_BASE_LAZY_RECONSTRUCTION_H_
+#define COLMAP_SRC_BASE_LAZY_RECONSTRUCTION_H_
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/camera.h"
+#include "base/image.h"
+#include "base/point3d.h"
+#include "util/mapped_file.h"
+#include "util/span.h"
+#include "util/types.h"
+
+namespace colmap {
+
+struct PlyPoint;
+class Reconstruction;
+
+// Read-only view of a binary reconstruction, as written by
+// `Reconstruction::WriteBinary`, that reads images and 3D points on demand.
+//
+// The files `images.bin` and `points3D.bin` are memory-mapped and only the
+// cameras are parsed upfront. Random access to individual records goes through
+// the file `index.bin`, which stores the byte offsets of all images in file
+// order and of all 3D points sorted by their identifier:
+//
+//    IndexHeader:     magic "COLMAPRI", version, reserved,
+//                     size of images.bin, size of points3D.bin,
+//                     mtime of images.bin, mtime of points3D.bin,
+//                     number of images, number of 3D points
+//    IndexEntry[]:    image_id, offset in images.bin
+//    IndexEntry[]:    point3D_id, offset in points3D.bin
+//
+// All fields are 64-bit except for the 32-bit version and reserved fields, so
+// that the entries can be used directly from the mapped index file. The index
+// is written together with the binary model. If it is missing or does not
+// match the sizes and modification times of the model files, e.g., for models
+// written by an earlier version, it is rebuilt in memory by skipping over the
+// records, which is much faster than parsing the entire model. Since the
+// modification times have a coarse resolution, the identifiers of all images
+// and of a sample of the 3D points are also verified against the model when it
+// is opened, and the index of the 3D points is rebuilt, if any later lookup
+// finds a different identifier in the model.
+//
+// Opening the view is thus independent of the number of 2D and 3D points and
+// all read methods are thread-safe.
+class LazyReconstruction {
+ public:
+  explicit LazyReconstruction(const std::string& path);
+
+  // Check whether a binary model exists at the given path.
+  static bool Exists(const std::string& path);
+
+  // Write the index for the binary model at the given path.
+  static void WriteIndex(const std::string& path);
+
+  // Get number of objects.
+  inline size_t NumCameras() const;
+  inline size_t NumImages() const;
+  inline size_t NumRegImages() const;
+  size_t NumPoints3D() const;
+
+  // Check whether specific object exists.
+  inline bool ExistsCamera(const camera_t camera_id) const;
+  inline bool ExistsImage(const image_t image_id) const;
+  bool ExistsPoint3D(const point3D_t point3D_id) const;
+
+  // Get reference to the cameras and registered images in file order.
+  inline const std::unordered_map<camera_t, class Camera>& Cameras() const;
+  inline const std::vector<image_t>& RegImageIds() const;
+
+  // Identifiers of all 3D points in ascending order.
+  std::vector<point3D_t> Point3DIds() const;
+
+  // Get objects. Images and 3D points are read from disk on every call.
+  inline const class Camera& Camera(const camera_t camera_id) const;
+  class Image Image(const image_t image_id) const;
+  class Point3D Point3D(const point3D_t point3D_id) const;
+
+  // Read only the name, camera and pose of an image without its 2D points,
+  // which typically make up most of the model.
+  class Image ImageHeader(const image_t image_id) const;
+
+  // Read all 3D points in file order, which is faster than reading them one
+  // by one through their identifiers.
+  void ReadPoints3D(
+      const std::function<void(const point3D_t, const class Point3D&)>& func)
+      const;
+
+  // Compute statistics for scene, see the equivalent methods in
+  // `Reconstruction`. These only read the 3D points.
+  size_t ComputeNumObservations() const;
+  double ComputeMeanTrackLength() const;
+  double ComputeMeanObservationsPerRegImage() const;
+  double ComputeMeanReprojectionError() const;
+
+  // Convert 3D points to PLY points, see `Reconstruction::ExportPLY`.
+  std::vector<PlyPoint> ConvertToPLY() const;
+
+  // Read the given registered images with their cameras and all 3D points
+  // observed by them into an empty reconstruction. Tracks are restricted to
+  // the given images and the 3D points are assigned new identifiers.
+  void ReadSubset(const std::vector<image_t>& image_ids,
+                  Reconstruction* reconstruction) const;
+
+ private:
+  struct IndexEntry {
+    uint64_t id;
+    uint64_t offset;
+  };
+
+  void ReadCameras(const std::string& path);
+  void ReadIndex(const std::string& path);
+
+  struct Point3DIndex {
+    // Entries of all 3D points sorted by their identifier, either pointing
+    // into the mapped index file or into `rebuilt_entries`.
+    Span<const IndexEntry> entries;
+    std::vector<IndexEntry> rebuilt_entries;
+  };
+
+  static void BuildImageIndex(const MappedFile& file,
+                              std::vector<IndexEntry>* entries);
+  static void BuildPoint3DIndex(const MappedFile& file,
+                                std::vector<IndexEntry>* entries);
+
+  // Check whether the record at the offset of the entry has its identifier.
+  template <typename T>
+  static bool VerifyEntry(const MappedFile& file, const IndexEntry& entry);
+
+  // Get the current index of the 3D points or replace the given outdated
+  // index by an index rebuilt from the model.
+  std::shared_ptr<const Point3DIndex> GetPoint3DIndex() const;
+  std::shared_ptr<const Point3DIndex> RebuildPoint3DIndex(
+      const std::shared_ptr<const Point3DIndex>& outdated_index) const;
+
+  class Image ReadImage(const image_t image_id,
+                        const bool read_points2D) const;
+
+  std::unique_ptr<MappedFile> images_file_;
+  std::unique_ptr<MappedFile> points3D_file_;
+  std::unique_ptr<MappedFile> index_file_;
+
+  std::unordered_map<camera_t, class Camera> cameras_;
+  std::vector<image_t> reg_image_ids_;
+  std::unordered_map<image_t, uint64_t> image_offsets_;
+
+  // Only accessed atomically, since lookups replace it, if it is outdated.
+  mutable std::shared_ptr<const Point3DIndex> point3D_index_;
+  mutable std::mutex point3D_index_mutex_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+size_t LazyReconstruction::NumCameras() const { return cameras_.size(); }
+
+size_t LazyReconstruction::NumImages() const { return reg_image_ids_.size(); }
+
+size_t LazyReconstruction::NumRegImages() const {
+  return reg_image_ids_.size();
+}
+
+bool LazyReconstruction::ExistsCamera(const camera_t camera_id) const {
+  return cameras_.find(camera_id) != cameras_.end();
+}
+
+bool LazyReconstruction::ExistsImage(const image_t image_id) const {
+  return image_offsets_.find(image_id) != image_offsets_.end();
+}
+
+const std::unordered_map<camera_t, class Camera>& LazyReconstruction::Cameras()
+    const {
+  return cameras_;
+}
+
+const std::vector<image_t>& LazyReconstruction::RegImageIds() const {
+  return reg_image_ids_;
+}
+
+const class Camera& LazyReconstruction::Camera(
+    const camera_t camera_id) const {
+  return cameras_.at(camera_id);
+}
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_BASE_LAZY_RECONSTRUCTION_H_
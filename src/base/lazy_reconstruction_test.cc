@@ -0,0 +1,306 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "base/lazy_reconstruction"
+#include "util/testing.h"
+
+#include "base/lazy_reconstruction.h"
+#include "base/reconstruction.h"
+#include "util/misc.h"
+#include "util/ply.h"
+
+using namespace colmap;
+
+namespace {
+
+std::string CreateTemporaryDir() {
+  const std::string path = (boost::filesystem::temp_directory_path() /
+                            boost::filesystem::unique_path())
+                               .string();
+  CreateDirIfNotExists(path);
+  return path;
+}
+
+// Generate a reconstruction, in which every 3D point is observed by all images
+// at the 2D point with the index of the 3D point. Skipping identifiers yields
+// models of the same size with different 3D point identifiers.
+void GenerateReconstruction(const image_t num_images,
+                            const size_t num_points3D,
+                            Reconstruction* reconstruction,
+                            const size_t num_skipped_point3D_ids = 0) {
+  Camera camera;
+  camera.SetCameraId(1);
+  camera.InitializeWithName("PINHOLE", 1, 1, 1);
+  reconstruction->AddCamera(camera);
+
+  for (image_t image_id = 1; image_id <= num_images; ++image_id) {
+    Image image;
+    image.SetImageId(image_id);
+    image.SetCameraId(1);
+    image.SetName("image" + std::to_string(image_id));
+    image.Tvec() = Eigen::Vector3d::Random();
+    std::vector<Eigen::Vector2d> points2D;
+    for (size_t i = 0; i < num_points3D + 1; ++i) {
+      points2D.emplace_back(image_id, i);
+    }
+    image.SetPoints2D(points2D);
+    reconstruction->AddImage(image);
+    reconstruction->RegisterImage(image_id);
+  }
+
+  for (size_t i = 0; i < num_skipped_point3D_ids; ++i) {
+    reconstruction->DeletePoint3D(
+        reconstruction->AddPoint3D(Eigen::Vector3d::Zero(), Track()));
+  }
+
+  for (size_t i = 0; i < num_points3D; ++i) {
+    Track track;
+    for (image_t image_id = 1; image_id <= num_images; ++image_id) {
+      track.AddElement(image_id, i);
+    }
+    const point3D_t point3D_id = reconstruction->AddPoint3D(
+        Eigen::Vector3d::Random(), track, Eigen::Vector3ub(i, 0, 255));
+    reconstruction->Point3D(point3D_id).SetError(i);
+  }
+}
+
+void CheckEqualImages(const Image& image1, const Image& image2) {
+  BOOST_CHECK_EQUAL(image1.ImageId(), image2.ImageId());
+  BOOST_CHECK_EQUAL(image1.CameraId(), image2.CameraId());
+  BOOST_CHECK_EQUAL(image1.Name(), image2.Name());
+  BOOST_CHECK_EQUAL(image1.Qvec(), image2.Qvec());
+  BOOST_CHECK_EQUAL(image1.Tvec(), image2.Tvec());
+}
+
+void CheckEqualModels(const Reconstruction& reconstruction,
+                      const LazyReconstruction& lazy_reconstruction) {
+  BOOST_CHECK_EQUAL(lazy_reconstruction.NumCameras(),
+                    reconstruction.NumCameras());
+  BOOST_CHECK_EQUAL(lazy_reconstruction.NumRegImages(),
+                    reconstruction.NumRegImages());
+  BOOST_CHECK_EQUAL(lazy_reconstruction.NumPoints3D(),
+                    reconstruction.NumPoints3D());
+  BOOST_CHECK(lazy_reconstruction.RegImageIds() ==
+              reconstruction.RegImageIds());
+
+  for (const auto image_id : reconstruction.RegImageIds()) {
+    const auto& image = reconstruction.Image(image_id);
+    const auto lazy_image = lazy_reconstruction.Image(image_id);
+    CheckEqualImages(image, lazy_image);
+    BOOST_CHECK(lazy_image.IsRegistered());
+    BOOST_CHECK_EQUAL(lazy_image.NumPoints2D(), image.NumPoints2D());
+    BOOST_CHECK_EQUAL(lazy_image.NumPoints3D(), image.NumPoints3D());
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      BOOST_CHECK_EQUAL(lazy_image.Point2D(point2D_idx).XY(),
+                        image.Point2D(point2D_idx).XY());
+      BOOST_CHECK_EQUAL(lazy_image.Point2D(point2D_idx).Point3DId(),
+                        image.Point2D(point2D_idx).Point3DId());
+    }
+
+    const auto lazy_image_header = lazy_reconstruction.ImageHeader(image_id);
+    CheckEqualImages(image, lazy_image_header);
+    BOOST_CHECK_EQUAL(lazy_image_header.NumPoints2D(), 0);
+  }
+
+  size_t num_points3D = 0;
+  lazy_reconstruction.ReadPoints3D(
+      [&](const point3D_t point3D_id, const Point3D& lazy_point3D) {
+        const auto& point3D = reconstruction.Point3D(point3D_id);
+        BOOST_CHECK_EQUAL(lazy_point3D.XYZ(), point3D.XYZ());
+        BOOST_CHECK_EQUAL(lazy_point3D.Color(), point3D.Color());
+        BOOST_CHECK_EQUAL(lazy_point3D.Error(), point3D.Error());
+        BOOST_CHECK_EQUAL(lazy_point3D.Track().Length(),
+                          point3D.Track().Length());
+        BOOST_CHECK_EQUAL(lazy_reconstruction.Point3D(point3D_id).XYZ(),
+                          point3D.XYZ());
+        num_points3D += 1;
+      });
+  BOOST_CHECK_EQUAL(num_points3D, reconstruction.NumPoints3D());
+
+  const auto point3D_ids = lazy_reconstruction.Point3DIds();
+  BOOST_CHECK(std::is_sorted(point3D_ids.begin(), point3D_ids.end()));
+  BOOST_CHECK_EQUAL(point3D_ids.size(), reconstruction.NumPoints3D());
+  for (const auto point3D_id : point3D_ids) {
+    BOOST_CHECK(lazy_reconstruction.ExistsPoint3D(point3D_id));
+  }
+  BOOST_CHECK(!lazy_reconstruction.ExistsPoint3D(0));
+  BOOST_CHECK(!lazy_reconstruction.ExistsImage(0));
+
+  BOOST_CHECK_EQUAL(lazy_reconstruction.ComputeNumObservations(),
+                    reconstruction.ComputeNumObservations());
+  BOOST_CHECK_EQUAL(lazy_reconstruction.ComputeMeanTrackLength(),
+                    reconstruction.ComputeMeanTrackLength());
+  BOOST_CHECK_EQUAL(lazy_reconstruction.ComputeMeanObservationsPerRegImage(),
+                    reconstruction.ComputeMeanObservationsPerRegImage());
+  BOOST_CHECK_CLOSE(lazy_reconstruction.ComputeMeanReprojectionError(),
+                    reconstruction.ComputeMeanReprojectionError(), 1e-6);
+  BOOST_CHECK_EQUAL(lazy_reconstruction.ConvertToPLY().size(),
+                    reconstruction.NumPoints3D());
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestEmpty) {
+  const std::string path = CreateTemporaryDir();
+  BOOST_CHECK(!LazyReconstruction::Exists(path));
+  Reconstruction reconstruction;
+  reconstruction.WriteBinary(path);
+  BOOST_CHECK(LazyReconstruction::Exists(path));
+  BOOST_CHECK(ExistsFile(JoinPaths(path, "index.bin")));
+  LazyReconstruction lazy_reconstruction(path);
+  BOOST_CHECK_EQUAL(lazy_reconstruction.NumCameras(), 0);
+  BOOST_CHECK_EQUAL(lazy_reconstruction.NumImages(), 0);
+  BOOST_CHECK_EQUAL(lazy_reconstruction.NumRegImages(), 0);
+  BOOST_CHECK_EQUAL(lazy_reconstruction.NumPoints3D(), 0);
+  BOOST_CHECK_EQUAL(lazy_reconstruction.ComputeMeanTrackLength(), 0);
+  BOOST_CHECK_EQUAL(lazy_reconstruction.ComputeMeanReprojectionError(), 0);
+  boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestRead) {
+  const std::string path = CreateTemporaryDir();
+  Reconstruction reconstruction;
+  GenerateReconstruction(5, 100, &reconstruction);
+  reconstruction.WriteBinary(path);
+  CheckEqualModels(reconstruction, LazyReconstruction(path));
+  boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWithoutIndex) {
+  const std::string path = CreateTemporaryDir();
+  Reconstruction reconstruction;
+  GenerateReconstruction(5, 100, &reconstruction);
+  reconstruction.WriteBinary(path);
+  boost::filesystem::remove(JoinPaths(path, "index.bin"));
+  CheckEqualModels(reconstruction, LazyReconstruction(path));
+  boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWithOutdatedIndex) {
+  const std::string path = CreateTemporaryDir();
+  const std::string other_path = CreateTemporaryDir();
+  Reconstruction reconstruction;
+  GenerateReconstruction(5, 100, &reconstruction);
+  reconstruction.WriteBinary(path);
+  Reconstruction other_reconstruction;
+  GenerateReconstruction(2, 10, &other_reconstruction);
+  other_reconstruction.WriteBinary(other_path);
+  boost::filesystem::copy_file(
+      JoinPaths(other_path, "index.bin"), JoinPaths(path, "index.bin"),
+      boost::filesystem::copy_option::overwrite_if_exists);
+  CheckEqualModels(reconstruction, LazyReconstruction(path));
+  boost::filesystem::remove_all(path);
+  boost::filesystem::remove_all(other_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWithOutdatedIndexOfSameSize) {
+  const std::string path = CreateTemporaryDir();
+  const std::string other_path = CreateTemporaryDir();
+  Reconstruction reconstruction;
+  GenerateReconstruction(5, 100, &reconstruction);
+  reconstruction.WriteBinary(path);
+  Reconstruction other_reconstruction;
+  GenerateReconstruction(5, 100, &other_reconstruction, 10);
+  other_reconstruction.WriteBinary(other_path);
+  // Replace the model files by files of the same size and modification time,
+  // such that only the identifiers reveal the outdated index.
+  for (const std::string name : {"images.bin", "points3D.bin"}) {
+    const std::time_t mtime =
+        boost::filesystem::last_write_time(JoinPaths(path, name));
+    boost::filesystem::copy_file(
+        JoinPaths(other_path, name), JoinPaths(path, name),
+        boost::filesystem::copy_option::overwrite_if_exists);
+    boost::filesystem::last_write_time(JoinPaths(path, name), mtime);
+  }
+  CheckEqualModels(other_reconstruction, LazyReconstruction(path));
+  boost::filesystem::remove_all(path);
+  boost::filesystem::remove_all(other_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWithInconsistentIndex) {
+  const std::string path = CreateTemporaryDir();
+  Reconstruction reconstruction;
+  GenerateReconstruction(5, 100, &reconstruction);
+  reconstruction.WriteBinary(path);
+
+  // Swap the offsets of two 3D points, which are not among the 3D points
+  // verified when opening the model, such that the index is only found to be
+  // inconsistent when reading the 3D points.
+  const std::string index_path = JoinPaths(path, "index.bin");
+  std::vector<uint64_t> index;
+  ReadBinaryBlob(index_path, &index);
+  const size_t kHeaderNumWords = 8;
+  const size_t point3D_entries_begin = kHeaderNumWords + 2 * 5;
+  std::swap(index[point3D_entries_begin + 2 * 49 + 1],
+            index[point3D_entries_begin + 2 * 50 + 1]);
+  WriteBinaryBlob(index_path, index);
+
+  LazyReconstruction lazy_reconstruction(path);
+  const point3D_t point3D_id = lazy_reconstruction.Point3DIds()[49];
+  BOOST_CHECK_EQUAL(lazy_reconstruction.Point3D(point3D_id).XYZ(),
+                    reconstruction.Point3D(point3D_id).XYZ());
+  CheckEqualModels(reconstruction, lazy_reconstruction);
+  boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestReadSubset) {
+  const std::string path = CreateTemporaryDir();
+  Reconstruction reconstruction;
+  GenerateReconstruction(5, 100, &reconstruction);
+  reconstruction.WriteBinary(path);
+
+  LazyReconstruction lazy_reconstruction(path);
+  Reconstruction subset;
+  lazy_reconstruction.ReadSubset({2, 4}, &subset);
+  BOOST_CHECK_EQUAL(subset.NumCameras(), 1);
+  BOOST_CHECK_EQUAL(subset.NumImages(), 2);
+  BOOST_CHECK_EQUAL(subset.NumRegImages(), 2);
+  BOOST_CHECK_EQUAL(subset.NumPoints3D(), 100);
+  BOOST_CHECK(subset.IsImageRegistered(2));
+  BOOST_CHECK(subset.IsImageRegistered(4));
+  CheckEqualImages(subset.Image(2), reconstruction.Image(2));
+  BOOST_CHECK_EQUAL(subset.Image(2).NumPoints2D(), 101);
+  BOOST_CHECK_EQUAL(subset.Image(2).NumPoints3D(), 100);
+  for (const auto& point3D : subset.Points3D()) {
+    BOOST_CHECK_EQUAL(point3D.second.Track().Length(), 2);
+    for (const auto& track_el : point3D.second.Track().Elements()) {
+      BOOST_CHECK_EQUAL(
+          subset.Image(track_el.image_id).Point2D(track_el.point2D_idx)
+              .Point3DId(),
+          point3D.first);
+    }
+  }
+  BOOST_CHECK_CLOSE(subset.ComputeMeanReprojectionError(),
+                    reconstruction.ComputeMeanReprojectionError(), 1e-6);
+
+  boost::filesystem::remove_all(path);
+}
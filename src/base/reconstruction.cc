@@ -31,9 +31,14 @@
 
 #include "base/reconstruction.h"
 
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <limits>
 
 #include "base/database_cache.h"
+#include "base/lazy_reconstruction.h"
 #include "base/pose.h"
 #include "base/projection.h"
 #include "base/similarity_transform.h"
@@ -41,10 +46,191 @@
 #include "estimators/similarity_transform.h"
 #include "optim/loransac.h"
 #include "util/bitmap.h"
+#include "util/mapped_file.h"
 #include "util/misc.h"
 #include "util/ply.h"
+#include "util/string.h"
+#include "util/threading.h"
 
 namespace colmap {
+namespace {
+
+// Approximate number of bytes of text that is parsed by one task.
+const size_t kTextChunkNumBytes = 4 * 1024 * 1024;
+
+// Number of images and 3D points that are formatted as text by one task.
+const size_t kTextChunkNumImages = 64;
+const size_t kTextChunkNumPoints3D = 16384;
+
+inline bool IsTextWhitespace(const char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+         c == '\f';
+}
+
+// Get the next line in [*pos, end) with leading and trailing whitespace
+// removed and advance `pos` to the beginning of the following line. Returns
+// false if there are no more lines.
+bool NextTextLine(const char** pos, const char* end, const char** line_begin,
+                  const char** line_end) {
+  if (*pos >= end) {
+    return false;
+  }
+
+  const char* newline =
+      static_cast<const char*>(memchr(*pos, '\n', end - *pos));
+  if (newline == nullptr) {
+    newline = end;
+  }
+
+  *line_begin = *pos;
+  *line_end = newline;
+  *pos = newline == end ? end : newline + 1;
+
+  while (*line_begin < *line_end && IsTextWhitespace(**line_begin)) {
+    *line_begin += 1;
+  }
+  while (*line_end > *line_begin && IsTextWhitespace(*(*line_end - 1))) {
+    *line_end -= 1;
+  }
+
+  return true;
+}
+
+// Split the text into at most `num_chunks` ranges of whole lines.
+std::vector<std::pair<const char*, const char*>> SplitTextIntoChunks(
+    const char* begin, const char* end, const size_t num_chunks) {
+  std::vector<std::pair<const char*, const char*>> chunks;
+  const size_t num_bytes = end - begin;
+  const char* chunk_begin = begin;
+  for (size_t i = 1; i <= num_chunks && chunk_begin < end; ++i) {
+    const char* chunk_end = begin + num_bytes * i / num_chunks;
+    if (chunk_end < chunk_begin) {
+      chunk_end = chunk_begin;
+    }
+    if (chunk_end < end) {
+      chunk_end = static_cast<const char*>(
+          memchr(chunk_end, '\n', end - chunk_end));
+      chunk_end = chunk_end == nullptr ? end : chunk_end + 1;
+    }
+    chunks.emplace_back(chunk_begin, chunk_end);
+    chunk_begin = chunk_end;
+  }
+  return chunks;
+}
+
+// Parse a decimal integer without any dependence on the current locale.
+int64_t ParseInteger(const char* begin, const char* end) {
+  const char* ptr = begin;
+  const bool negative = ptr != end && *ptr == '-';
+  if (ptr != end && (*ptr == '-' || *ptr == '+')) {
+    ++ptr;
+  }
+  CHECK(ptr != end) << "Invalid integer: " << std::string(begin, end);
+  uint64_t value = 0;
+  for (; ptr != end; ++ptr) {
+    CHECK(*ptr >= '0' && *ptr <= '9')
+        << "Invalid integer: " << std::string(begin, end);
+    value = 10 * value + (*ptr - '0');
+  }
+  return negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+}
+
+// Parser of the whitespace-separated values in a line of text.
+class TextLineParser {
+ public:
+  TextLineParser(const char* begin, const char* end)
+      : pos_(begin), end_(end) {}
+
+  // Check whether all values in the line were parsed.
+  bool AtEnd() {
+    SkipWhitespace();
+    return pos_ == end_;
+  }
+
+  std::string NextString() {
+    const char* token_begin;
+    const char* token_end;
+    NextToken(&token_begin, &token_end);
+    return std::string(token_begin, token_end);
+  }
+
+  int64_t NextInteger() {
+    const char* token_begin;
+    const char* token_end;
+    NextToken(&token_begin, &token_end);
+    return ParseInteger(token_begin, token_end);
+  }
+
+  double NextDouble() {
+    const char* token_begin;
+    const char* token_end;
+    NextToken(&token_begin, &token_end);
+    double value;
+    CHECK(ParseDouble(token_begin, token_end, &value))
+        << "Invalid number: " << std::string(token_begin, token_end);
+    return value;
+  }
+
+ private:
+  void SkipWhitespace() {
+    while (pos_ != end_ && IsTextWhitespace(*pos_)) {
+      ++pos_;
+    }
+  }
+
+  void NextToken(const char** token_begin, const char** token_end) {
+    SkipWhitespace();
+    CHECK(pos_ != end_) << "Unexpected end of line";
+    *token_begin = pos_;
+    while (pos_ != end_ && !IsTextWhitespace(*pos_)) {
+      ++pos_;
+    }
+    *token_end = pos_;
+  }
+
+  const char* pos_;
+  const char* end_;
+};
+
+// Format the elements as text with the given floating point precision in
+// parallel and write them to the file in order. The text of one chunk of
+// elements is generated by one task, and only a few chunks are kept in memory
+// at the same time.
+void WriteTextChunks(
+    const size_t num_elements, const size_t chunk_size, const int precision,
+    const std::function<void(const size_t, std::ostream*)>& format_element,
+    std::ostream* file) {
+  ThreadPool thread_pool;
+  const size_t num_chunks = (num_elements + chunk_size - 1) / chunk_size;
+  const size_t batch_size = 4 * thread_pool.NumThreads();
+  std::vector<std::string> texts(batch_size);
+  for (size_t batch_begin = 0; batch_begin < num_chunks;
+       batch_begin += batch_size) {
+    const size_t batch_end = std::min(num_chunks, batch_begin + batch_size);
+    thread_pool.ParallelFor(
+        batch_begin, batch_end,
+        [&](const int64_t chunk_idx) {
+          std::ostringstream stream;
+          stream.imbue(std::locale::classic());
+          stream.precision(precision);
+          const size_t begin = chunk_idx * chunk_size;
+          const size_t end = std::min(num_elements, begin + chunk_size);
+          for (size_t i = begin; i < end; ++i) {
+            format_element(i, &stream);
+          }
+          texts[chunk_idx - batch_begin] = stream.str();
+        },
+        1);
+    for (size_t chunk_idx = batch_begin; chunk_idx < batch_end; ++chunk_idx) {
+      std::string& text = texts[chunk_idx - batch_begin];
+      file->write(text.data(), text.size());
+      text.clear();
+      text.shrink_to_fit();
+    }
+  }
+}
+
+}  // namespace
 
 Reconstruction::Reconstruction()
     : correspondence_graph_(nullptr), num_added_points3D_(0) {}
@@ -75,20 +261,28 @@ void Reconstruction::Load(const DatabaseCache& database_cache) {
   // Add images.
   images_.reserve(database_cache.NumImages());
 
+  // The number of observations and correspondences are taken from the
+  // correspondence graph, since the images may be shared with other caches.
+  const class CorrespondenceGraph& correspondence_graph =
+      database_cache.CorrespondenceGraph();
   for (const auto& image : database_cache.Images()) {
-    if (ExistsImage(image.second.ImageId())) {
-      class Image& existing_image = Image(image.second.ImageId());
-      CHECK_EQ(existing_image.Name(), image.second.Name());
+    const class Image& cached_image = *image.second;
+    if (ExistsImage(cached_image.ImageId())) {
+      class Image& existing_image = Image(cached_image.ImageId());
+      CHECK_EQ(existing_image.Name(), cached_image.Name());
       if (existing_image.NumPoints2D() == 0) {
-        existing_image.SetPoints2D(image.second.Points2D());
+        existing_image.SetPoints2D(cached_image.Points2D());
       } else {
-        CHECK_EQ(image.second.NumPoints2D(), existing_image.NumPoints2D());
+        CHECK_EQ(cached_image.NumPoints2D(), existing_image.NumPoints2D());
       }
-      existing_image.SetNumObservations(image.second.NumObservations());
-      existing_image.SetNumCorrespondences(image.second.NumCorrespondences());
     } else {
-      AddImage(image.second);
+      AddImage(cached_image);
     }
+    class Image& new_image = Image(cached_image.ImageId());
+    new_image.SetNumObservations(
+        correspondence_graph.NumObservationsForImage(image.first));
+    new_image.SetNumCorrespondences(
+        correspondence_graph.NumCorrespondencesForImage(image.first));
   }
 
   // Add image pairs.
@@ -512,7 +706,8 @@ bool Reconstruction::Merge(const Reconstruction& reconstruction,
     }
   }
 
-  FilterPoints3DWithLargeReprojectionError(max_reproj_error, Point3DIds());
+  FilterPoints3DWithLargeReprojectionError(max_reproj_error,
+                                           StorageOrderedPoint3DIds());
 
   return true;
 }
@@ -638,7 +833,7 @@ void Reconstruction::TranscribeImageIdsToDatabase(const Database& database) {
   std::unordered_map<image_t, image_t> old_to_new_image_ids;
   old_to_new_image_ids.reserve(NumImages());
 
-  EIGEN_STL_UMAP(image_t, class Image) new_images;
+  SlotMap<image_t, class Image> new_images;
   new_images.reserve(NumImages());
 
   for (auto& image : images_) {
@@ -670,11 +865,13 @@ void Reconstruction::TranscribeImageIdsToDatabase(const Database& database) {
 size_t Reconstruction::FilterPoints3D(
     const double max_reproj_error, const double min_tri_angle,
     const std::unordered_set<point3D_t>& point3D_ids) {
+  const std::vector<point3D_t> point3D_ids_vector(point3D_ids.begin(),
+                                                  point3D_ids.end());
   size_t num_filtered = 0;
-  num_filtered +=
-      FilterPoints3DWithLargeReprojectionError(max_reproj_error, point3D_ids);
-  num_filtered +=
-      FilterPoints3DWithSmallTriangulationAngle(min_tri_angle, point3D_ids);
+  num_filtered += FilterPoints3DWithLargeReprojectionError(max_reproj_error,
+                                                           point3D_ids_vector);
+  num_filtered += FilterPoints3DWithSmallTriangulationAngle(
+      min_tri_angle, point3D_ids_vector);
   return num_filtered;
 }
 
@@ -698,7 +895,7 @@ size_t Reconstruction::FilterAllPoints3D(const double max_reproj_error,
   // Important: First filter observations and points with large reprojection
   // error, so that observations with large reprojection error do not make
   // a point stable through a large triangulation angle.
-  const std::unordered_set<point3D_t>& point3D_ids = Point3DIds();
+  const std::vector<point3D_t> point3D_ids = StorageOrderedPoint3DIds();
   size_t num_filtered = 0;
   num_filtered +=
       FilterPoints3DWithLargeReprojectionError(max_reproj_error, point3D_ids);
@@ -831,6 +1028,7 @@ void Reconstruction::WriteBinary(const std::string& path) const {
   WriteCamerasBinary(JoinPaths(path, "cameras.bin"));
   WriteImagesBinary(JoinPaths(path, "images.bin"));
   WritePoints3DBinary(JoinPaths(path, "points3D.bin"));
+  LazyReconstruction::WriteIndex(path);
 }
 
 std::vector<PlyPoint> Reconstruction::ConvertToPLY() const {
@@ -1267,9 +1465,17 @@ void Reconstruction::CreateImageDirs(const std::string& path) const {
   }
 }
 
+std::vector<point3D_t> Reconstruction::StorageOrderedPoint3DIds() const {
+  std::vector<point3D_t> point3D_ids;
+  point3D_ids.reserve(points3D_.size());
+  for (const auto& point3D : points3D_) {
+    point3D_ids.push_back(point3D.first);
+  }
+  return point3D_ids;
+}
+
 size_t Reconstruction::FilterPoints3DWithSmallTriangulationAngle(
-    const double min_tri_angle,
-    const std::unordered_set<point3D_t>& point3D_ids) {
+    const double min_tri_angle, const std::vector<point3D_t>& point3D_ids) {
   // Number of filtered points.
   size_t num_filtered = 0;
 
@@ -1277,7 +1483,7 @@ size_t Reconstruction::FilterPoints3DWithSmallTriangulationAngle(
   const double min_tri_angle_rad = DegToRad(min_tri_angle);
 
   // Cache for image projection centers.
-  EIGEN_STL_UMAP(image_t, Eigen::Vector3d) proj_centers;
+  SlotMap<image_t, Eigen::Vector3d> proj_centers;
 
   for (const auto point3D_id : point3D_ids) {
     if (!ExistsPoint3D(point3D_id)) {
@@ -1331,7 +1537,7 @@ size_t Reconstruction::FilterPoints3DWithSmallTriangulationAngle(
 
 size_t Reconstruction::FilterPoints3DWithLargeReprojectionError(
     const double max_reproj_error,
-    const std::unordered_set<point3D_t>& point3D_ids) {
+    const std::vector<point3D_t>& point3D_ids) {
   const double max_squared_reproj_error = max_reproj_error * max_reproj_error;
 
   // Number of filtered points.
@@ -1385,44 +1591,38 @@ size_t Reconstruction::FilterPoints3DWithLargeReprojectionError(
 void Reconstruction::ReadCamerasText(const std::string& path) {
   cameras_.clear();
 
-  std::ifstream file(path);
-  CHECK(file.is_open()) << path;
+  CHECK(ExistsFile(path)) << path;
+  const MappedFile file(path);
 
-  std::string line;
-  std::string item;
-
-  while (std::getline(file, line)) {
-    StringTrim(&line);
-
-    if (line.empty() || line[0] == '#') {
+  const char* pos = file.Data();
+  const char* end = file.Data() + file.Size();
+  const char* line_begin;
+  const char* line_end;
+  while (NextTextLine(&pos, end, &line_begin, &line_end)) {
+    if (line_begin == line_end || *line_begin == '#') {
       continue;
     }
 
-    std::stringstream line_stream(line);
+    TextLineParser parser(line_begin, line_end);
 
     class Camera camera;
 
     // ID
-    std::getline(line_stream, item, ' ');
-    camera.SetCameraId(std::stoul(item));
+    camera.SetCameraId(static_cast<camera_t>(parser.NextInteger()));
 
     // MODEL
-    std::getline(line_stream, item, ' ');
-    camera.SetModelIdFromName(item);
+    camera.SetModelIdFromName(parser.NextString());
 
     // WIDTH
-    std::getline(line_stream, item, ' ');
-    camera.SetWidth(std::stoll(item));
+    camera.SetWidth(static_cast<size_t>(parser.NextInteger()));
 
     // HEIGHT
-    std::getline(line_stream, item, ' ');
-    camera.SetHeight(std::stoll(item));
+    camera.SetHeight(static_cast<size_t>(parser.NextInteger()));
 
     // PARAMS
     camera.Params().clear();
-    while (!line_stream.eof()) {
-      std::getline(line_stream, item, ' ');
-      camera.Params().push_back(std::stold(item));
+    while (!parser.AtEnd()) {
+      camera.Params().push_back(parser.NextDouble());
     }
 
     CHECK(camera.VerifyParams());
@@ -1434,93 +1634,82 @@ void Reconstruction::ReadCamerasText(const std::string& path) {
 void Reconstruction::ReadImagesText(const std::string& path) {
   images_.clear();
 
-  std::ifstream file(path);
-  CHECK(file.is_open()) << path;
-
-  std::string line;
-  std::string item;
+  CHECK(ExistsFile(path)) << path;
+  const MappedFile file(path);
+
+  // Find the two lines of every image, which is cheap compared to parsing
+  // them. Note that the second line is empty for images without 2D points.
+  std::vector<std::pair<const char*, const char*>> header_lines;
+  std::vector<std::pair<const char*, const char*>> points2D_lines;
+  {
+    const char* pos = file.Data();
+    const char* end = file.Data() + file.Size();
+    const char* line_begin;
+    const char* line_end;
+    while (NextTextLine(&pos, end, &line_begin, &line_end)) {
+      if (line_begin == line_end || *line_begin == '#') {
+        continue;
+      }
+      const auto header_line = std::make_pair(line_begin, line_end);
+      if (!NextTextLine(&pos, end, &line_begin, &line_end)) {
+        break;
+      }
+      header_lines.push_back(header_line);
+      points2D_lines.emplace_back(line_begin, line_end);
+    }
+  }
 
-  while (std::getline(file, line)) {
-    StringTrim(&line);
+  std::vector<class Image> images(header_lines.size());
 
-    if (line.empty() || line[0] == '#') {
-      continue;
-    }
+  ThreadPool thread_pool;
+  thread_pool.ParallelFor(0, images.size(), [&](const int64_t image_idx) {
+    class Image& image = images[image_idx];
 
-    std::stringstream line_stream1(line);
+    TextLineParser parser1(header_lines[image_idx].first,
+                           header_lines[image_idx].second);
 
     // ID
-    std::getline(line_stream1, item, ' ');
-    const image_t image_id = std::stoul(item);
-
-    class Image image;
-    image.SetImageId(image_id);
+    image.SetImageId(static_cast<image_t>(parser1.NextInteger()));
 
     image.SetRegistered(true);
-    reg_image_ids_.push_back(image_id);
 
     // QVEC (qw, qx, qy, qz)
-    std::getline(line_stream1, item, ' ');
-    image.Qvec(0) = std::stold(item);
-
-    std::getline(line_stream1, item, ' ');
-    image.Qvec(1) = std::stold(item);
-
-    std::getline(line_stream1, item, ' ');
-    image.Qvec(2) = std::stold(item);
-
-    std::getline(line_stream1, item, ' ');
-    image.Qvec(3) = std::stold(item);
+    image.Qvec(0) = parser1.NextDouble();
+    image.Qvec(1) = parser1.NextDouble();
+    image.Qvec(2) = parser1.NextDouble();
+    image.Qvec(3) = parser1.NextDouble();
 
     image.NormalizeQvec();
 
     // TVEC
-    std::getline(line_stream1, item, ' ');
-    image.Tvec(0) = std::stold(item);
-
-    std::getline(line_stream1, item, ' ');
-    image.Tvec(1) = std::stold(item);
-
-    std::getline(line_stream1, item, ' ');
-    image.Tvec(2) = std::stold(item);
+    image.Tvec(0) = parser1.NextDouble();
+    image.Tvec(1) = parser1.NextDouble();
+    image.Tvec(2) = parser1.NextDouble();
 
     // CAMERA_ID
-    std::getline(line_stream1, item, ' ');
-    image.SetCameraId(std::stoul(item));
+    image.SetCameraId(static_cast<camera_t>(parser1.NextInteger()));
 
     // NAME
-    std::getline(line_stream1, item, ' ');
-    image.SetName(item);
+    image.SetName(parser1.NextString());
 
     // POINTS2D
-    if (!std::getline(file, line)) {
-      break;
-    }
-
-    StringTrim(&line);
-    std::stringstream line_stream2(line);
+    TextLineParser parser2(points2D_lines[image_idx].first,
+                           points2D_lines[image_idx].second);
 
     std::vector<Eigen::Vector2d> points2D;
     std::vector<point3D_t> point3D_ids;
 
-    if (!line.empty()) {
-      while (!line_stream2.eof()) {
-        Eigen::Vector2d point;
-
-        std::getline(line_stream2, item, ' ');
-        point.x() = std::stold(item);
-
-        std::getline(line_stream2, item, ' ');
-        point.y() = std::stold(item);
-
-        points2D.push_back(point);
+    while (!parser2.AtEnd()) {
+      Eigen::Vector2d point;
+      point.x() = parser2.NextDouble();
+      point.y() = parser2.NextDouble();
+      points2D.push_back(point);
 
-        std::getline(line_stream2, item, ' ');
-        if (item == "-1") {
-          point3D_ids.push_back(kInvalidPoint3DId);
-        } else {
-          point3D_ids.push_back(std::stoll(item));
-        }
+      const int64_t point3D_id = parser2.NextInteger();
+      if (point3D_id == -1) {
+        point3D_ids.push_back(kInvalidPoint3DId);
+      } else {
+        point3D_ids.push_back(static_cast<point3D_t>(point3D_id));
       }
     }
 
@@ -1533,83 +1722,96 @@ void Reconstruction::ReadImagesText(const std::string& path) {
         image.SetPoint3DForPoint2D(point2D_idx, point3D_ids[point2D_idx]);
       }
     }
+  });
 
-    images_.emplace(image.ImageId(), image);
+  images_.reserve(images.size());
+  for (auto& image : images) {
+    const image_t image_id = image.ImageId();
+    reg_image_ids_.push_back(image_id);
+    images_.emplace(image_id, std::move(image));
   }
 }
 
 void Reconstruction::ReadPoints3DText(const std::string& path) {
   points3D_.clear();
 
-  std::ifstream file(path);
-  CHECK(file.is_open()) << path;
-
-  std::string line;
-  std::string item;
-
-  while (std::getline(file, line)) {
-    StringTrim(&line);
-
-    if (line.empty() || line[0] == '#') {
-      continue;
-    }
-
-    std::stringstream line_stream(line);
-
-    // ID
-    std::getline(line_stream, item, ' ');
-    const point3D_t point3D_id = std::stoll(item);
-
-    // Make sure, that we can add new 3D points after reading 3D points
-    // without overwriting existing 3D points.
-    num_added_points3D_ = std::max(num_added_points3D_, point3D_id);
-
-    class Point3D point3D;
+  CHECK(ExistsFile(path)) << path;
+  const MappedFile file(path);
+
+  ThreadPool thread_pool;
+
+  const size_t num_chunks =
+      std::max<size_t>(1, file.Size() / kTextChunkNumBytes);
+  const auto chunks = SplitTextIntoChunks(
+      file.Data(), file.Data() + file.Size(),
+      std::min(num_chunks, 4 * thread_pool.NumThreads()));
+
+  std::vector<std::vector<std::pair<point3D_t, class Point3D>>> points3D(
+      chunks.size());
+
+  thread_pool.ParallelFor(
+      0, chunks.size(),
+      [&](const int64_t chunk_idx) {
+        const char* pos = chunks[chunk_idx].first;
+        const char* end = chunks[chunk_idx].second;
+        const char* line_begin;
+        const char* line_end;
+        while (NextTextLine(&pos, end, &line_begin, &line_end)) {
+          if (line_begin == line_end || *line_begin == '#') {
+            continue;
+          }
 
-    // XYZ
-    std::getline(line_stream, item, ' ');
-    point3D.XYZ(0) = std::stold(item);
+          TextLineParser parser(line_begin, line_end);
 
-    std::getline(line_stream, item, ' ');
-    point3D.XYZ(1) = std::stold(item);
+          // ID
+          const point3D_t point3D_id =
+              static_cast<point3D_t>(parser.NextInteger());
 
-    std::getline(line_stream, item, ' ');
-    point3D.XYZ(2) = std::stold(item);
+          class Point3D point3D;
 
-    // Color
-    std::getline(line_stream, item, ' ');
-    point3D.Color(0) = static_cast<uint8_t>(std::stoi(item));
+          // XYZ
+          point3D.XYZ(0) = parser.NextDouble();
+          point3D.XYZ(1) = parser.NextDouble();
+          point3D.XYZ(2) = parser.NextDouble();
 
-    std::getline(line_stream, item, ' ');
-    point3D.Color(1) = static_cast<uint8_t>(std::stoi(item));
+          // Color
+          point3D.Color(0) = static_cast<uint8_t>(parser.NextInteger());
+          point3D.Color(1) = static_cast<uint8_t>(parser.NextInteger());
+          point3D.Color(2) = static_cast<uint8_t>(parser.NextInteger());
 
-    std::getline(line_stream, item, ' ');
-    point3D.Color(2) = static_cast<uint8_t>(std::stoi(item));
+          // ERROR
+          point3D.SetError(parser.NextDouble());
 
-    // ERROR
-    std::getline(line_stream, item, ' ');
-    point3D.SetError(std::stold(item));
+          // TRACK
+          while (!parser.AtEnd()) {
+            TrackElement track_el;
+            track_el.image_id = static_cast<image_t>(parser.NextInteger());
+            track_el.point2D_idx = static_cast<point2D_t>(parser.NextInteger());
+            point3D.Track().AddElement(track_el);
+          }
 
-    // TRACK
-    while (!line_stream.eof()) {
-      TrackElement track_el;
+          point3D.Track().Compress();
 
-      std::getline(line_stream, item, ' ');
-      StringTrim(&item);
-      if (item.empty()) {
-        break;
-      }
-      track_el.image_id = std::stoul(item);
+          points3D[chunk_idx].emplace_back(point3D_id, std::move(point3D));
+        }
+      },
+      1);
 
-      std::getline(line_stream, item, ' ');
-      track_el.point2D_idx = std::stoul(item);
+  size_t num_points3D = 0;
+  for (const auto& chunk_points3D : points3D) {
+    num_points3D += chunk_points3D.size();
+  }
+  points3D_.reserve(num_points3D);
 
-      point3D.Track().AddElement(track_el);
+  for (auto& chunk_points3D : points3D) {
+    for (auto& point3D : chunk_points3D) {
+      // Make sure, that we can add new 3D points after reading 3D points
+      // without overwriting existing 3D points.
+      num_added_points3D_ = std::max(num_added_points3D_, point3D.first);
+      points3D_.emplace(point3D.first, std::move(point3D.second));
     }
-
-    point3D.Track().Compress();
-
-    points3D_.emplace(point3D_id, point3D);
+    chunk_points3D.clear();
+    chunk_points3D.shrink_to_fit();
   }
 }
 
@@ -1767,51 +1969,58 @@ void Reconstruction::WriteImagesText(const std::string& path) const {
        << ", mean observations per image: "
        << ComputeMeanObservationsPerRegImage() << std::endl;
 
+  std::vector<const class Image*> images;
+  images.reserve(reg_image_ids_.size());
   for (const auto& image : images_) {
-    if (!image.second.IsRegistered()) {
-      continue;
+    if (image.second.IsRegistered()) {
+      images.push_back(&image.second);
     }
+  }
 
-    std::ostringstream line;
-    std::string line_string;
-
-    line << image.first << " ";
-
-    // QVEC (qw, qx, qy, qz)
-    const Eigen::Vector4d normalized_qvec =
-        NormalizeQuaternion(image.second.Qvec());
-    line << normalized_qvec(0) << " ";
-    line << normalized_qvec(1) << " ";
-    line << normalized_qvec(2) << " ";
-    line << normalized_qvec(3) << " ";
+  // Note that the image lines are written with the default precision of
+  // output streams, which the text format always used for images.
+  const int kImagePrecision = 6;
+  WriteTextChunks(
+      images.size(), kTextChunkNumImages, kImagePrecision,
+      [&images](const size_t image_idx, std::ostream* line) {
+        const class Image& image = *images[image_idx];
 
-    // TVEC
-    line << image.second.Tvec(0) << " ";
-    line << image.second.Tvec(1) << " ";
-    line << image.second.Tvec(2) << " ";
+        *line << image.ImageId() << " ";
 
-    line << image.second.CameraId() << " ";
+        // QVEC (qw, qx, qy, qz)
+        const Eigen::Vector4d normalized_qvec =
+            NormalizeQuaternion(image.Qvec());
+        *line << normalized_qvec(0) << " ";
+        *line << normalized_qvec(1) << " ";
+        *line << normalized_qvec(2) << " ";
+        *line << normalized_qvec(3) << " ";
 
-    line << image.second.Name();
+        // TVEC
+        *line << image.Tvec(0) << " ";
+        *line << image.Tvec(1) << " ";
+        *line << image.Tvec(2) << " ";
 
-    file << line.str() << std::endl;
+        *line << image.CameraId() << " ";
 
-    line.str("");
-    line.clear();
+        *line << image.Name() << "\n";
 
-    for (const Point2D& point2D : image.second.Points2D()) {
-      line << point2D.X() << " ";
-      line << point2D.Y() << " ";
-      if (point2D.HasPoint3D()) {
-        line << point2D.Point3DId() << " ";
-      } else {
-        line << -1 << " ";
-      }
-    }
-    line_string = line.str();
-    line_string = line_string.substr(0, line_string.size() - 1);
-    file << line_string << std::endl;
-  }
+        bool first = true;
+        for (const Point2D& point2D : image.Points2D()) {
+          if (!first) {
+            *line << " ";
+          }
+          first = false;
+          *line << point2D.X() << " ";
+          *line << point2D.Y() << " ";
+          if (point2D.HasPoint3D()) {
+            *line << point2D.Point3DId();
+          } else {
+            *line << -1;
+          }
+        }
+        *line << "\n";
+      },
+      &file);
 }
 
 void Reconstruction::WritePoints3DText(const std::string& path) const {
@@ -1828,28 +2037,40 @@ void Reconstruction::WritePoints3DText(const std::string& path) const {
   file << "# Number of points: " << points3D_.size()
        << ", mean track length: " << ComputeMeanTrackLength() << std::endl;
 
+  std::vector<std::pair<point3D_t, const class Point3D*>> points3D;
+  points3D.reserve(points3D_.size());
   for (const auto& point3D : points3D_) {
-    file << point3D.first << " ";
-    file << point3D.second.XYZ()(0) << " ";
-    file << point3D.second.XYZ()(1) << " ";
-    file << point3D.second.XYZ()(2) << " ";
-    file << static_cast<int>(point3D.second.Color(0)) << " ";
-    file << static_cast<int>(point3D.second.Color(1)) << " ";
-    file << static_cast<int>(point3D.second.Color(2)) << " ";
-    file << point3D.second.Error() << " ";
-
-    std::ostringstream line;
-
-    for (const auto& track_el : point3D.second.Track().Elements()) {
-      line << track_el.image_id << " ";
-      line << track_el.point2D_idx << " ";
-    }
-
-    std::string line_string = line.str();
-    line_string = line_string.substr(0, line_string.size() - 1);
-
-    file << line_string << std::endl;
+    points3D.emplace_back(point3D.first, &point3D.second);
   }
+
+  // Ensure that we don't loose any precision by storing in text.
+  const int kPoint3DPrecision = 17;
+  WriteTextChunks(
+      points3D.size(), kTextChunkNumPoints3D, kPoint3DPrecision,
+      [&points3D](const size_t point3D_idx, std::ostream* line) {
+        const class Point3D& point3D = *points3D[point3D_idx].second;
+
+        *line << points3D[point3D_idx].first << " ";
+        *line << point3D.XYZ()(0) << " ";
+        *line << point3D.XYZ()(1) << " ";
+        *line << point3D.XYZ()(2) << " ";
+        *line << static_cast<int>(point3D.Color(0)) << " ";
+        *line << static_cast<int>(point3D.Color(1)) << " ";
+        *line << static_cast<int>(point3D.Color(2)) << " ";
+        *line << point3D.Error() << " ";
+
+        bool first = true;
+        for (const auto& track_el : point3D.Track().Elements()) {
+          if (!first) {
+            *line << " ";
+          }
+          first = false;
+          *line << track_el.image_id << " ";
+          *line << track_el.point2D_idx;
+        }
+        *line << "\n";
+      },
+      &file);
 }
 
 void Reconstruction::WriteCamerasBinary(const std::string& path) const {
@@ -1940,7 +2161,7 @@ void Reconstruction::SetObservationAsTriangulated(
 
   const class Image& image = Image(image_id);
   const Point2D& point2D = image.Point2D(point2D_idx);
-  const std::vector<CorrespondenceGraph::Correspondence>& corrs =
+  const CorrespondenceGraph::CorrespondenceRange corrs =
       correspondence_graph_->FindCorrespondences(image_id, point2D_idx);
 
   CHECK(image.IsRegistered());
@@ -1974,7 +2195,7 @@ void Reconstruction::ResetTriObservations(const image_t image_id,
 
   const class Image& image = Image(image_id);
   const Point2D& point2D = image.Point2D(point2D_idx);
-  const std::vector<CorrespondenceGraph::Correspondence>& corrs =
+  const CorrespondenceGraph::CorrespondenceRange corrs =
       correspondence_graph_->FindCorrespondences(image_id, point2D_idx);
 
   CHECK(image.IsRegistered());
@@ -45,6 +45,7 @@
 #include "base/point3d.h"
 #include "base/track.h"
 #include "util/alignment.h"
+#include "util/slot_map.h"
 #include "util/types.h"
 
 namespace colmap {
@@ -93,10 +94,10 @@ class Reconstruction {
                                         const image_t image_id2) const;
 
   // Get reference to all objects.
-  inline const EIGEN_STL_UMAP(camera_t, class Camera) & Cameras() const;
-  inline const EIGEN_STL_UMAP(image_t, class Image) & Images() const;
+  inline const SlotMap<camera_t, class Camera>& Cameras() const;
+  inline const SlotMap<image_t, class Image>& Images() const;
   inline const std::vector<image_t>& RegImageIds() const;
-  inline const EIGEN_STL_UMAP(point3D_t, class Point3D) & Points3D() const;
+  inline const SlotMap<point3D_t, class Point3D>& Points3D() const;
   inline const std::unordered_map<image_pair_t, ImagePairStat>& ImagePairs()
       const;
 
@@ -298,12 +299,15 @@ class Reconstruction {
   void CreateImageDirs(const std::string& path) const;
 
  private:
+  // Identifiers of all 3D points in the order of their storage, which makes
+  // subsequent sequential accesses to the 3D points cache-friendly.
+  std::vector<point3D_t> StorageOrderedPoint3DIds() const;
+
   size_t FilterPoints3DWithSmallTriangulationAngle(
-      const double min_tri_angle,
-      const std::unordered_set<point3D_t>& point3D_ids);
+      const double min_tri_angle, const std::vector<point3D_t>& point3D_ids);
   size_t FilterPoints3DWithLargeReprojectionError(
       const double max_reproj_error,
-      const std::unordered_set<point3D_t>& point3D_ids);
+      const std::vector<point3D_t>& point3D_ids);
 
   void ReadCamerasText(const std::string& path);
   void ReadImagesText(const std::string& path);
@@ -327,9 +331,9 @@ class Reconstruction {
 
   const CorrespondenceGraph* correspondence_graph_;
 
-  EIGEN_STL_UMAP(camera_t, class Camera) cameras_;
-  EIGEN_STL_UMAP(image_t, class Image) images_;
-  EIGEN_STL_UMAP(point3D_t, class Point3D) points3D_;
+  SlotMap<camera_t, class Camera> cameras_;
+  SlotMap<image_t, class Image> images_;
+  SlotMap<point3D_t, class Point3D> points3D_;
 
   std::unordered_map<image_pair_t, ImagePairStat> image_pair_stats_;
 
@@ -402,11 +406,11 @@ Reconstruction::ImagePairStat& Reconstruction::ImagePair(
   return image_pair_stats_.at(pair_id);
 }
 
-const EIGEN_STL_UMAP(camera_t, Camera) & Reconstruction::Cameras() const {
+const SlotMap<camera_t, Camera>& Reconstruction::Cameras() const {
   return cameras_;
 }
 
-const EIGEN_STL_UMAP(image_t, class Image) & Reconstruction::Images() const {
+const SlotMap<image_t, class Image>& Reconstruction::Images() const {
   return images_;
 }
 
@@ -414,7 +418,7 @@ const std::vector<image_t>& Reconstruction::RegImageIds() const {
   return reg_image_ids_;
 }
 
-const EIGEN_STL_UMAP(point3D_t, Point3D) & Reconstruction::Points3D() const {
+const SlotMap<point3D_t, Point3D>& Reconstruction::Points3D() const {
   return points3D_;
 }
 
@@ -32,11 +32,14 @@
 #define TEST_NAME "base/reconstruction"
 #include "util/testing.h"
 
+#include <fstream>
+
 #include "base/camera_models.h"
 #include "base/correspondence_graph.h"
 #include "base/pose.h"
 #include "base/reconstruction.h"
 #include "base/similarity_transform.h"
+#include "util/misc.h"
 
 using namespace colmap;
 
@@ -532,3 +535,86 @@ BOOST_AUTO_TEST_CASE(TestComputeMeanReprojectionError) {
   reconstruction.Point3D(point3D_id1).SetError(2.0);
   BOOST_CHECK_EQUAL(reconstruction.ComputeMeanReprojectionError(), 2.0);
 }
+
+BOOST_AUTO_TEST_CASE(TestReadWriteText) {
+  Reconstruction reconstruction;
+  CorrespondenceGraph correspondence_graph;
+  GenerateReconstruction(3, &reconstruction, &correspondence_graph);
+  reconstruction.Camera(1).Params() = {0.5, -0.25, 1e-30};
+  reconstruction.Image(1).Qvec() = Eigen::Vector4d(0.5, -0.5, 0.5, 0.5);
+  reconstruction.Image(1).Tvec() = Eigen::Vector3d(1e22, -0.125, 0.25);
+  for (point2D_t point2D_idx = 0;
+       point2D_idx < reconstruction.Image(2).NumPoints2D(); ++point2D_idx) {
+    reconstruction.Image(2).Point2D(point2D_idx).SetXY(
+        Eigen::Vector2d(10.5 * point2D_idx, -0.25 * point2D_idx));
+  }
+  reconstruction.Image(3).SetPoints2D(std::vector<Eigen::Vector2d>());
+  for (point2D_t point2D_idx = 0; point2D_idx < 10; ++point2D_idx) {
+    Track track;
+    track.AddElement(1, point2D_idx);
+    track.AddElement(2, point2D_idx);
+    const point3D_t point3D_id = reconstruction.AddPoint3D(
+        Eigen::Vector3d::Random(), track, Eigen::Vector3ub(point2D_idx, 0, 255));
+    reconstruction.Point3D(point3D_id).SetError(point2D_idx / 10.0);
+  }
+  reconstruction.AddPoint3D(Eigen::Vector3d(-1e-300, 123456789.5, 0), Track());
+
+  const std::string path = (boost::filesystem::temp_directory_path() /
+                            boost::filesystem::unique_path())
+                               .string();
+  const std::string path2 = path + "_2";
+  boost::filesystem::create_directory(path);
+  boost::filesystem::create_directory(path2);
+
+  reconstruction.WriteText(path);
+  Reconstruction read_reconstruction;
+  read_reconstruction.ReadText(path);
+
+  BOOST_CHECK_EQUAL(read_reconstruction.NumCameras(), 1);
+  BOOST_CHECK(read_reconstruction.Camera(1).Params() ==
+              reconstruction.Camera(1).Params());
+  BOOST_CHECK(read_reconstruction.RegImageIds() ==
+              reconstruction.RegImageIds());
+  for (const auto image_id : reconstruction.RegImageIds()) {
+    const auto& image = reconstruction.Image(image_id);
+    const auto& read_image = read_reconstruction.Image(image_id);
+    BOOST_CHECK_EQUAL(read_image.Name(), image.Name());
+    BOOST_CHECK_EQUAL(read_image.CameraId(), image.CameraId());
+    BOOST_CHECK_EQUAL(read_image.Qvec(), NormalizeQuaternion(image.Qvec()));
+    BOOST_CHECK_EQUAL(read_image.Tvec(), image.Tvec());
+    BOOST_CHECK_EQUAL(read_image.NumPoints2D(), image.NumPoints2D());
+    BOOST_CHECK_EQUAL(read_image.NumPoints3D(), image.NumPoints3D());
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      BOOST_CHECK_EQUAL(read_image.Point2D(point2D_idx).XY(),
+                        image.Point2D(point2D_idx).XY());
+      BOOST_CHECK_EQUAL(read_image.Point2D(point2D_idx).Point3DId(),
+                        image.Point2D(point2D_idx).Point3DId());
+    }
+  }
+  BOOST_CHECK_EQUAL(read_reconstruction.NumPoints3D(),
+                    reconstruction.NumPoints3D());
+  for (const auto& point3D : reconstruction.Points3D()) {
+    const auto& read_point3D = read_reconstruction.Point3D(point3D.first);
+    BOOST_CHECK_EQUAL(read_point3D.XYZ(), point3D.second.XYZ());
+    BOOST_CHECK_EQUAL(read_point3D.Color(), point3D.second.Color());
+    BOOST_CHECK_EQUAL(read_point3D.Error(), point3D.second.Error());
+    BOOST_CHECK_EQUAL(read_point3D.Track().Length(),
+                      point3D.second.Track().Length());
+  }
+
+  // Writing the model again must reproduce the same files.
+  read_reconstruction.WriteText(path2);
+  for (const std::string name : {"cameras.txt", "images.txt", "points3D.txt"}) {
+    std::ifstream file1(JoinPaths(path, name));
+    std::ifstream file2(JoinPaths(path2, name));
+    const std::string text1((std::istreambuf_iterator<char>(file1)),
+                            std::istreambuf_iterator<char>());
+    const std::string text2((std::istreambuf_iterator<char>(file2)),
+                            std::istreambuf_iterator<char>());
+    BOOST_CHECK_EQUAL(text1, text2);
+  }
+
+  boost::filesystem::remove_all(path);
+  boost::filesystem::remove_all(path2);
+}
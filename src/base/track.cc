@@ -31,9 +31,13 @@
 
 #include "base/track.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 namespace colmap {
 
-Track::Track() {}
+const uint32_t Track::kNumInlineElements;
 
 TrackElement::TrackElement()
     : image_id(kInvalidImageId), point2D_idx(kInvalidPoint2DIdx) {}
@@ -41,14 +45,140 @@ TrackElement::TrackElement()
 TrackElement::TrackElement(const image_t image_id, const point2D_t point2D_idx)
     : image_id(image_id), point2D_idx(point2D_idx) {}
 
+Track::Track() : length_(0), capacity_(kNumInlineElements) {}
+
+Track::Track(const Track& other) : Track() { *this = other; }
+
+Track::Track(Track&& other) : Track() { *this = std::move(other); }
+
+Track::~Track() {
+  if (!IsInline()) {
+    ::operator delete(heap_elements_);
+  }
+}
+
+Track& Track::operator=(const Track& other) {
+  if (this != &other) {
+    SetElements(other.Elements());
+  }
+  return *this;
+}
+
+Track& Track::operator=(Track&& other) {
+  if (this != &other) {
+    if (other.IsInline()) {
+      SetElements(other.Elements());
+    } else {
+      if (!IsInline()) {
+        ::operator delete(heap_elements_);
+      }
+      heap_elements_ = other.heap_elements_;
+      capacity_ = other.capacity_;
+      length_ = other.length_;
+      other.capacity_ = kNumInlineElements;
+    }
+    other.length_ = 0;
+  }
+  return *this;
+}
+
+void Track::SetElements(const Span<const TrackElement>& elements) {
+  if (elements.data() == Data()) {
+    length_ = static_cast<uint32_t>(elements.size());
+    return;
+  }
+  // The elements may be a part of this track, so they can overlap the
+  // destination or be freed by the reallocation.
+  length_ = 0;
+  if (elements.size() > capacity_ ||
+      (!IsInline() && elements.size() <= kNumInlineElements)) {
+    Reallocate(elements.size(), elements.data(), elements.size());
+  } else {
+    std::memmove(Data(), elements.data(),
+                 elements.size() * sizeof(TrackElement));
+    length_ = static_cast<uint32_t>(elements.size());
+  }
+}
+
+void Track::AddElements(const Span<const TrackElement>& elements) {
+  if (length_ + elements.size() > capacity_) {
+    Reallocate(std::max(length_ + elements.size(), 2 * size_t(capacity_)),
+               elements.data(), elements.size());
+  } else {
+    std::memcpy(Data() + length_, elements.data(),
+                elements.size() * sizeof(TrackElement));
+    length_ += static_cast<uint32_t>(elements.size());
+  }
+}
+
+void Track::DeleteElement(const size_t idx) {
+  CHECK_LT(idx, length_);
+  TrackElement* data = Data();
+  std::copy(data + idx + 1, data + length_, data + idx);
+  length_ -= 1;
+}
+
 void Track::DeleteElement(const image_t image_id, const point2D_t point2D_idx) {
-  elements_.erase(
-      std::remove_if(elements_.begin(), elements_.end(),
+  TrackElement* data = Data();
+  TrackElement* end =
+      std::remove_if(data, data + length_,
                      [image_id, point2D_idx](const TrackElement& element) {
                        return element.image_id == image_id &&
                               element.point2D_idx == point2D_idx;
-                     }),
-      elements_.end());
+                     });
+  length_ = static_cast<uint32_t>(end - data);
+}
+
+void Track::Reserve(const size_t num_elements) {
+  if (num_elements > capacity_) {
+    Reallocate(num_elements);
+  }
+}
+
+void Track::Compress() {
+  if (length_ < capacity_ && !IsInline()) {
+    Reallocate(length_);
+  }
+}
+
+void Track::Reallocate(const size_t capacity,
+                       const TrackElement* new_elements,
+                       const size_t num_new_elements) {
+  CHECK_GE(capacity, length_ + num_new_elements);
+  CHECK_LE(capacity, std::numeric_limits<uint32_t>::max());
+
+  const bool was_inline = IsInline();
+  TrackElement* old_data = Data();
+  const size_t num_new_bytes = num_new_elements * sizeof(TrackElement);
+
+  if (capacity <= kNumInlineElements) {
+    if (!was_inline) {
+      // Move the elements into the inline storage, which overlaps the heap
+      // pointer, so the pointer is saved above before.
+      std::memcpy(&inline_elements_, old_data, length_ * sizeof(TrackElement));
+      capacity_ = kNumInlineElements;
+    }
+    if (num_new_bytes > 0) {
+      std::memmove(Data() + length_, new_elements, num_new_bytes);
+    }
+  } else {
+    TrackElement* new_data = static_cast<TrackElement*>(
+        ::operator new(capacity * sizeof(TrackElement)));
+    std::memcpy(new_data, old_data, length_ * sizeof(TrackElement));
+    // The new elements may be stored inline, which is overwritten by the heap
+    // pointer, so they are copied before.
+    if (num_new_bytes > 0) {
+      std::memcpy(new_data + length_, new_elements, num_new_bytes);
+    }
+    heap_elements_ = new_data;
+    capacity_ = static_cast<uint32_t>(capacity);
+  }
+
+  length_ += static_cast<uint32_t>(num_new_elements);
+
+  if (!was_inline) {
+    ::operator delete(old_data);
+  }
 }
 
 }  // namespace colmap
@@ -32,9 +32,12 @@
 #ifndef COLMAP_SRC_BASE_TRACK_H_
 #define COLMAP_SRC_BASE_TRACK_H_
 
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 
 #include "util/logging.h"
+#include "util/span.h"
 #include "util/types.h"
 
 namespace colmap {
@@ -49,91 +52,129 @@ struct TrackElement {
   point2D_t point2D_idx;
 };
 
+// The elements of short tracks are stored inline in the track object and only
+// longer tracks allocate memory on the heap. Most 3D points of a
+// reconstruction have short tracks, so this avoids one small heap allocation
+// per 3D point and keeps the observations next to the other data of the point.
 class Track {
  public:
   Track();
+  Track(const Track& other);
+  Track(Track&& other);
+  ~Track();
+
+  Track& operator=(const Track& other);
+  Track& operator=(Track&& other);
 
   // The number of track elements.
   inline size_t Length() const;
 
-  // Access all elements.
-  inline const std::vector<TrackElement>& Elements() const;
-  inline std::vector<TrackElement>& Elements();
-  inline void SetElements(const std::vector<TrackElement>& elements);
+  // The number of elements that fit into the track without reallocation.
+  inline size_t Capacity() const;
+
+  // Access all elements. The returned views are invalidated when elements
+  // are added or the capacity of the track changes.
+  inline Span<const TrackElement> Elements() const;
+  inline Span<TrackElement> Elements();
+  void SetElements(const Span<const TrackElement>& elements);
 
   // Access specific elements.
   inline const TrackElement& Element(const size_t idx) const;
   inline TrackElement& Element(const size_t idx);
   inline void SetElement(const size_t idx, const TrackElement& element);
 
-  // Append new elements.
+  // Append new elements. The elements may be elements of this track.
   inline void AddElement(const TrackElement& element);
   inline void AddElement(const image_t image_id, const point2D_t point2D_idx);
-  inline void AddElements(const std::vector<TrackElement>& elements);
+  void AddElements(const Span<const TrackElement>& elements);
 
   // Delete existing element.
-  inline void DeleteElement(const size_t idx);
+  void DeleteElement(const size_t idx);
   void DeleteElement(const image_t image_id, const point2D_t point2D_idx);
 
   // Requests that the track capacity be at least enough to contain the
   // specified number of elements.
-  inline void Reserve(const size_t num_elements);
+  void Reserve(const size_t num_elements);
 
-  // Shrink the capacity of track vector to fit its size to save memory.
-  inline void Compress();
+  // Shrink the capacity of the track to fit its size to save memory.
+  void Compress();
 
  private:
-  std::vector<TrackElement> elements_;
+  // Tracks with up to this number of elements are stored inline.
+  static const uint32_t kNumInlineElements = 4;
+
+  inline bool IsInline() const;
+  inline TrackElement* Data();
+  inline const TrackElement* Data() const;
+
+  // Change the capacity, which must be at least the length of the track after
+  // appending the given new elements. The new elements may be elements of this
+  // track, since they are appended before the old storage is freed.
+  void Reallocate(const size_t capacity,
+                  const TrackElement* new_elements = nullptr,
+                  const size_t num_new_elements = 0);
+
+  uint32_t length_;
+  uint32_t capacity_;
+  union {
+    std::aligned_storage<sizeof(TrackElement) * kNumInlineElements,
+                         alignof(TrackElement)>::type inline_elements_;
+    TrackElement* heap_elements_;
+  };
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
-size_t Track::Length() const { return elements_.size(); }
+size_t Track::Length() const { return length_; }
 
-const std::vector<TrackElement>& Track::Elements() const { return elements_; }
+size_t Track::Capacity() const { return capacity_; }
 
-std::vector<TrackElement>& Track::Elements() { return elements_; }
+Span<const TrackElement> Track::Elements() const {
+  return Span<const TrackElement>(Data(), length_);
+}
 
-void Track::SetElements(const std::vector<TrackElement>& elements) {
-  elements_ = elements;
+Span<TrackElement> Track::Elements() {
+  return Span<TrackElement>(Data(), length_);
 }
 
 // Access specific elements.
 const TrackElement& Track::Element(const size_t idx) const {
-  return elements_.at(idx);
+  return Elements().at(idx);
 }
 
-TrackElement& Track::Element(const size_t idx) { return elements_.at(idx); }
+TrackElement& Track::Element(const size_t idx) { return Elements().at(idx); }
 
 void Track::SetElement(const size_t idx, const TrackElement& element) {
-  elements_.at(idx) = element;
+  Elements().at(idx) = element;
 }
 
 void Track::AddElement(const TrackElement& element) {
-  elements_.push_back(element);
+  if (length_ == capacity_) {
+    Reallocate(2 * capacity_, &element, 1);
+  } else {
+    new (Data() + length_) TrackElement(element);
+    length_ += 1;
+  }
 }
 
 void Track::AddElement(const image_t image_id, const point2D_t point2D_idx) {
-  elements_.emplace_back(image_id, point2D_idx);
+  AddElement(TrackElement(image_id, point2D_idx));
 }
 
-void Track::AddElements(const std::vector<TrackElement>& elements) {
-  elements_.insert(elements_.end(), elements.begin(), elements.end());
-}
+bool Track::IsInline() const { return capacity_ == kNumInlineElements; }
 
-void Track::DeleteElement(const size_t idx) {
-  CHECK_LT(idx, elements_.size());
-  elements_.erase(elements_.begin() + idx);
+TrackElement* Track::Data() {
+  return IsInline() ? reinterpret_cast<TrackElement*>(&inline_elements_)
+                    : heap_elements_;
 }
 
-void Track::Reserve(const size_t num_elements) {
-  elements_.reserve(num_elements);
+const TrackElement* Track::Data() const {
+  return IsInline() ? reinterpret_cast<const TrackElement*>(&inline_elements_)
+                    : heap_elements_;
 }
 
-void Track::Compress() { elements_.shrink_to_fit(); }
-
 }  // namespace colmap
 
 #endif  // COLMAP_SRC_BASE_TRACK_H_
@@ -119,19 +119,97 @@ BOOST_AUTO_TEST_CASE(TestDeleteElement) {
 BOOST_AUTO_TEST_CASE(TestReserve) {
   Track track;
   track.Reserve(2);
-  BOOST_CHECK_EQUAL(track.Elements().capacity(), 2);
+  BOOST_CHECK_EQUAL(track.Capacity(), 4);
+  track.Reserve(10);
+  BOOST_CHECK_EQUAL(track.Capacity(), 10);
+  BOOST_CHECK_EQUAL(track.Length(), 0);
 }
 
 BOOST_AUTO_TEST_CASE(TestCompress) {
   Track track;
-  track.AddElement(0, 1);
-  track.AddElement(0, 2);
-  track.AddElement(0, 3);
-  track.AddElement(0, 3);
-  BOOST_CHECK_EQUAL(track.Elements().capacity(), 4);
+  for (point2D_t i = 0; i < 6; ++i) {
+    track.AddElement(0, i);
+  }
+  BOOST_CHECK_EQUAL(track.Capacity(), 8);
+  track.DeleteElement(0);
+  BOOST_CHECK_EQUAL(track.Capacity(), 8);
+  track.Compress();
+  BOOST_CHECK_EQUAL(track.Capacity(), 5);
   track.DeleteElement(0);
   track.DeleteElement(0);
-  BOOST_CHECK_EQUAL(track.Elements().capacity(), 4);
   track.Compress();
-  BOOST_CHECK_EQUAL(track.Elements().capacity(), 2);
+  BOOST_CHECK_EQUAL(track.Capacity(), 4);
+  BOOST_CHECK_EQUAL(track.Length(), 3);
+  for (point2D_t i = 0; i < 3; ++i) {
+    BOOST_CHECK_EQUAL(track.Element(i).image_id, 0);
+    BOOST_CHECK_EQUAL(track.Element(i).point2D_idx, i + 3);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestCopyMove) {
+  for (const point2D_t length : {2, 10}) {
+    Track track;
+    for (point2D_t i = 0; i < length; ++i) {
+      track.AddElement(1, i);
+    }
+
+    Track track_copy(track);
+    BOOST_CHECK_EQUAL(track_copy.Length(), length);
+    BOOST_CHECK_EQUAL(track.Length(), length);
+    BOOST_CHECK(track_copy.Elements().data() != track.Elements().data());
+
+    Track track_move(std::move(track_copy));
+    BOOST_CHECK_EQUAL(track_move.Length(), length);
+    BOOST_CHECK_EQUAL(track_copy.Length(), 0);
+
+    track_copy = track_move;
+    track = std::move(track_move);
+    for (point2D_t i = 0; i < length; ++i) {
+      BOOST_CHECK_EQUAL(track.Element(i).point2D_idx, i);
+      BOOST_CHECK_EQUAL(track_copy.Element(i).point2D_idx, i);
+    }
+
+    track.SetElements(Track().Elements());
+    BOOST_CHECK_EQUAL(track.Length(), 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestElementOutOfRange) {
+  Track track;
+  track.AddElement(0, 0);
+  BOOST_CHECK_THROW(track.Element(1), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(TestAliasedElements) {
+  for (const size_t length : {4, 8}) {
+    Track track;
+    for (point2D_t i = 0; i < length; ++i) {
+      track.AddElement(1, i);
+    }
+    track.AddElement(track.Element(length - 1));
+    BOOST_CHECK_EQUAL(track.Length(), length + 1);
+    BOOST_CHECK_EQUAL(track.Element(length).image_id, 1);
+    BOOST_CHECK_EQUAL(track.Element(length).point2D_idx, length - 1);
+
+    track.AddElements(track.Elements());
+    BOOST_CHECK_EQUAL(track.Length(), 2 * (length + 1));
+    for (size_t i = 0; i < length + 1; ++i) {
+      BOOST_CHECK_EQUAL(track.Element(i).image_id,
+                        track.Element(i + length + 1).image_id);
+      BOOST_CHECK_EQUAL(track.Element(i).point2D_idx,
+                        track.Element(i + length + 1).point2D_idx);
+    }
+
+    track.SetElements(Span<const TrackElement>(track.Elements().data() + 1, 3));
+    BOOST_CHECK_EQUAL(track.Length(), 3);
+    for (point2D_t i = 0; i < 3; ++i) {
+      BOOST_CHECK_EQUAL(track.Element(i).image_id, 1);
+      BOOST_CHECK_EQUAL(track.Element(i).point2D_idx, i + 1);
+    }
+
+    track.SetElements(Span<const TrackElement>(track.Elements().data() + 1, 2));
+    BOOST_CHECK_EQUAL(track.Length(), 2);
+    BOOST_CHECK_EQUAL(track.Element(0).point2D_idx, 2);
+    BOOST_CHECK_EQUAL(track.Element(1).point2D_idx, 3);
+  }
 }
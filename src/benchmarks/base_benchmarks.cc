@@ -0,0 +1,316 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include <boost/filesystem.hpp>
+
+#include "base/database_cache.h"
+#include "base/lazy_reconstruction.h"
+#include "benchmarks/benchmark.h"
+#include "benchmarks/synthetic.h"
+#include "util/misc.h"
+
+namespace colmap {
+namespace {
+
+// Synthesize a database with the given number of images, where every image
+// observes 50 3D points per image in expectation that are each observed in
+// about 20 images.
+void SynthesizeDatabase(const int num_images, Database* database) {
+  SyntheticDatasetOptions options;
+  options.num_images = num_images;
+  options.num_points3D = 50 * num_images;
+  options.point3D_visibility = std::min(1.0, 20.0 / num_images);
+  options.point2D_stddev = 0.5;
+
+  Reconstruction reconstruction;
+  SynthesizeDataset(options, &reconstruction);
+
+  database->Open(":memory:");
+  WriteSyntheticDatabase(reconstruction, database);
+}
+
+// The argument is the number of images.
+void BM_DatabaseCacheLoad(BenchmarkState* state) {
+  Database database;
+  SynthesizeDatabase(static_cast<int>(state->Arg()), &database);
+
+  size_t num_image_pairs = 0;
+  while (state->KeepRunning()) {
+    DatabaseCache database_cache;
+    database_cache.Load(database, /*min_num_matches=*/15,
+                        /*ignore_watermarks=*/false,
+                        /*image_names=*/{});
+    num_image_pairs = database_cache.CorrespondenceGraph().NumImagePairs();
+  }
+
+  state->SetCounter("num_images", database.NumImages());
+  state->SetCounter("num_inlier_matches", database.NumInlierMatches());
+  state->SetCounter("num_image_pairs", num_image_pairs);
+}
+
+// The argument is the number of images.
+void BM_CorrespondenceGraphFindCorrespondences(BenchmarkState* state) {
+  Database database;
+  SynthesizeDatabase(static_cast<int>(state->Arg()), &database);
+  DatabaseCache database_cache;
+  database_cache.Load(database, /*min_num_matches=*/15,
+                      /*ignore_watermarks=*/false,
+                      /*image_names=*/{});
+
+  const auto& correspondence_graph = database_cache.CorrespondenceGraph();
+
+  size_t num_correspondences = 0;
+  while (state->KeepRunning()) {
+    num_correspondences = 0;
+    for (const auto& image : database_cache.Images()) {
+      const point2D_t num_points2D = image.second->NumPoints2D();
+      for (point2D_t point2D_idx = 0; point2D_idx < num_points2D;
+           ++point2D_idx) {
+        num_correspondences +=
+            correspondence_graph.FindCorrespondences(image.first, point2D_idx)
+                .size();
+      }
+    }
+  }
+
+  state->SetCounter("num_correspondences", num_correspondences);
+}
+
+// The argument is the number of images.
+void BM_CorrespondenceGraphFindTransitiveCorrespondences(
+    BenchmarkState* state) {
+  Database database;
+  SynthesizeDatabase(static_cast<int>(state->Arg()), &database);
+  DatabaseCache database_cache;
+  database_cache.Load(database, /*min_num_matches=*/15,
+                      /*ignore_watermarks=*/false,
+                      /*image_names=*/{});
+
+  const auto& correspondence_graph = database_cache.CorrespondenceGraph();
+
+  const size_t kTransitivity = 3;
+  size_t num_correspondences = 0;
+  while (state->KeepRunning()) {
+    num_correspondences = 0;
+    for (const auto& image : database_cache.Images()) {
+      const point2D_t num_points2D = image.second->NumPoints2D();
+      for (point2D_t point2D_idx = 0; point2D_idx < num_points2D;
+           ++point2D_idx) {
+        num_correspondences +=
+            correspondence_graph
+                .FindTransitiveCorrespondences(image.first, point2D_idx,
+                                               kTransitivity)
+                .size();
+      }
+    }
+  }
+
+  state->SetCounter("num_correspondences", num_correspondences);
+}
+
+// Synthesize a reconstruction with the given number of images, where every
+// image observes 500 3D points in expectation with tracks of about 20 images.
+void SynthesizeReconstruction(const int num_images,
+                              Reconstruction* reconstruction) {
+  SyntheticDatasetOptions options;
+  options.num_images = num_images;
+  options.num_points3D = 500 * num_images / 20;
+  options.point3D_visibility = std::min(1.0, 20.0 / num_images);
+  options.point2D_stddev = 0.5;
+  SynthesizeDataset(options, reconstruction);
+}
+
+// The argument is the number of images. The thresholds are chosen such that
+// no points are filtered and every iteration performs the same work.
+void BM_ReconstructionFilterAllPoints3D(BenchmarkState* state) {
+  Reconstruction reconstruction;
+  SynthesizeReconstruction(static_cast<int>(state->Arg()), &reconstruction);
+
+  const double kMaxReprojError = 100.0;
+  const double kMinTriAngle = 0.0;
+  size_t num_filtered = 0;
+  while (state->KeepRunning()) {
+    num_filtered +=
+        reconstruction.FilterAllPoints3D(kMaxReprojError, kMinTriAngle);
+  }
+
+  state->SetCounter("num_points3D", reconstruction.NumPoints3D());
+  state->SetCounter("num_observations",
+                    reconstruction.ComputeNumObservations());
+  state->SetCounter("num_filtered", num_filtered);
+}
+
+// The argument is the number of images.
+void BM_ReconstructionComputeMeanReprojectionError(BenchmarkState* state) {
+  Reconstruction reconstruction;
+  SynthesizeReconstruction(static_cast<int>(state->Arg()), &reconstruction);
+
+  // Compute the reprojection errors of all points.
+  reconstruction.FilterAllPoints3D(/*max_reproj_error=*/100.0,
+                                   /*min_tri_angle=*/0.0);
+
+  double mean_reproj_error = 0;
+  while (state->KeepRunning()) {
+    mean_reproj_error = reconstruction.ComputeMeanReprojectionError();
+  }
+
+  state->SetCounter("num_points3D", reconstruction.NumPoints3D());
+  state->SetCounter("mean_reproj_error", mean_reproj_error);
+}
+
+// The argument is the number of images. Copying the reconstruction copies
+// the tracks of all 3D points, which stresses the track storage.
+void BM_ReconstructionCopy(BenchmarkState* state) {
+  Reconstruction reconstruction;
+  SynthesizeReconstruction(static_cast<int>(state->Arg()), &reconstruction);
+
+  size_t num_points3D = 0;
+  while (state->KeepRunning()) {
+    const Reconstruction reconstruction_copy = reconstruction;
+    num_points3D = reconstruction_copy.NumPoints3D();
+  }
+
+  state->SetCounter("num_points3D", num_points3D);
+}
+
+// The argument is the number of images. Reads a binary model to compute its
+// mean reprojection error, as done by the model analyzer.
+void BM_ReconstructionReadBinary(BenchmarkState* state) {
+  const std::string path =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("colmap_benchmark_%%%%-%%%%-%%%%"))
+          .string();
+  boost::filesystem::create_directory(path);
+  {
+    Reconstruction reconstruction;
+    SynthesizeReconstruction(static_cast<int>(state->Arg()), &reconstruction);
+    reconstruction.WriteBinary(path);
+  }
+
+  double mean_reproj_error = 0;
+  while (state->KeepRunning()) {
+    Reconstruction reconstruction;
+    reconstruction.ReadBinary(path);
+    mean_reproj_error = reconstruction.ComputeMeanReprojectionError();
+  }
+
+  state->SetCounter("mean_reproj_error", mean_reproj_error);
+
+  boost::filesystem::remove_all(path);
+}
+
+// Same as `BM_ReconstructionReadBinary` but through the lazy view.
+void BM_LazyReconstructionRead(BenchmarkState* state) {
+  const std::string path =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("colmap_benchmark_%%%%-%%%%-%%%%"))
+          .string();
+  boost::filesystem::create_directory(path);
+  {
+    Reconstruction reconstruction;
+    SynthesizeReconstruction(static_cast<int>(state->Arg()), &reconstruction);
+    reconstruction.WriteBinary(path);
+  }
+
+  double mean_reproj_error = 0;
+  while (state->KeepRunning()) {
+    const LazyReconstruction reconstruction(path);
+    mean_reproj_error = reconstruction.ComputeMeanReprojectionError();
+  }
+
+  state->SetCounter("mean_reproj_error", mean_reproj_error);
+
+  boost::filesystem::remove_all(path);
+}
+
+// The argument is the number of images.
+void BM_ReconstructionWriteText(BenchmarkState* state) {
+  const std::string path =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("colmap_benchmark_%%%%-%%%%-%%%%"))
+          .string();
+  boost::filesystem::create_directory(path);
+
+  Reconstruction reconstruction;
+  SynthesizeReconstruction(static_cast<int>(state->Arg()), &reconstruction);
+
+  while (state->KeepRunning()) {
+    reconstruction.WriteText(path);
+  }
+
+  state->SetCounter("num_bytes",
+                    GetFileSize(JoinPaths(path, "images.txt")) +
+                        GetFileSize(JoinPaths(path, "points3D.txt")));
+
+  boost::filesystem::remove_all(path);
+}
+
+// The argument is the number of images.
+void BM_ReconstructionReadText(BenchmarkState* state) {
+  const std::string path =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("colmap_benchmark_%%%%-%%%%-%%%%"))
+          .string();
+  boost::filesystem::create_directory(path);
+  {
+    Reconstruction reconstruction;
+    SynthesizeReconstruction(static_cast<int>(state->Arg()), &reconstruction);
+    reconstruction.WriteText(path);
+  }
+
+  size_t num_points3D = 0;
+  while (state->KeepRunning()) {
+    Reconstruction reconstruction;
+    reconstruction.ReadText(path);
+    num_points3D = reconstruction.NumPoints3D();
+  }
+
+  state->SetCounter("num_points3D", num_points3D);
+
+  boost::filesystem::remove_all(path);
+}
+
+}  // namespace
+
+COLMAP_BENCHMARK_ARGS(BM_DatabaseCacheLoad, 20, 100);
+COLMAP_BENCHMARK_ARGS(BM_CorrespondenceGraphFindCorrespondences, 20, 100);
+COLMAP_BENCHMARK_ARGS(BM_CorrespondenceGraphFindTransitiveCorrespondences, 20,
+                      100);
+COLMAP_BENCHMARK_ARGS(BM_ReconstructionFilterAllPoints3D, 100, 1000);
+COLMAP_BENCHMARK_ARGS(BM_ReconstructionComputeMeanReprojectionError, 100,
+                      1000);
+COLMAP_BENCHMARK_ARGS(BM_ReconstructionCopy, 100, 1000);
+COLMAP_BENCHMARK_ARGS(BM_ReconstructionReadBinary, 100, 1000);
+COLMAP_BENCHMARK_ARGS(BM_LazyReconstructionRead, 100, 1000);
+COLMAP_BENCHMARK_ARGS(BM_ReconstructionWriteText, 100, 1000);
+COLMAP_BENCHMARK_ARGS(BM_ReconstructionReadText, 100, 1000);
+
+}  // namespace colmap
@@ -0,0 +1,279 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "benchmarks/benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <regex>
+
+#include "util/logging.h"
+#include "util/math.h"
+#include "util/misc.h"
+#include "util/random.h"
+#include "util/string.h"
+#include "util/threading.h"
+#include "util/version.h"
+
+namespace colmap {
+namespace {
+
+// JSON has no representation for non-finite numbers.
+std::string FormatJSONNumber(const double value) {
+  if (!std::isfinite(value)) {
+    return "null";
+  }
+  return StringPrintf("%.9g", value);
+}
+
+BenchmarkResult ComputeBenchmarkResult(const std::string& name,
+                                       const BenchmarkState& state) {
+  BenchmarkResult result;
+  result.name = name;
+  result.counters = state.Counters();
+
+  const auto& times = state.IterationTimes();
+  result.num_iterations = times.size();
+  if (times.empty()) {
+    return result;
+  }
+
+  for (const double time : times) {
+    result.total_time += time;
+  }
+  result.mean_time = Mean(times);
+  result.median_time = Median(times);
+  result.min_time = *std::min_element(times.begin(), times.end());
+  result.max_time = *std::max_element(times.begin(), times.end());
+  if (times.size() > 1) {
+    result.stddev_time = StdDev(times);
+  }
+
+  return result;
+}
+
+}  // namespace
+
+bool BenchmarkOptions::Check() const {
+  CHECK_OPTION_GE(min_time, 0);
+  CHECK_OPTION_GT(min_num_iterations, 0);
+  CHECK_OPTION_GE(max_num_iterations, min_num_iterations);
+  CHECK_OPTION_GE(num_warmup_iterations, 0);
+  CHECK_OPTION_GE(random_seed, 0);
+  return true;
+}
+
+BenchmarkState::BenchmarkState(const BenchmarkOptions& options,
+                               const bool has_arg, const int64_t arg)
+    : options_(options),
+      has_arg_(has_arg),
+      arg_(arg),
+      num_started_iterations_(0),
+      total_time_(0) {}
+
+int64_t BenchmarkState::Arg() const {
+  CHECK(has_arg_) << "Benchmark was not registered with arguments";
+  return arg_;
+}
+
+bool BenchmarkState::KeepRunning() {
+  // Record the time of the previous iteration, unless it was a warmup.
+  if (num_started_iterations_ > options_.num_warmup_iterations) {
+    const double elapsed_time = timer_.ElapsedSeconds();
+    iteration_times_.push_back(elapsed_time);
+    total_time_ += elapsed_time;
+  }
+
+  const int num_measured_iterations = static_cast<int>(iteration_times_.size());
+  if (num_measured_iterations >= options_.max_num_iterations ||
+      (num_measured_iterations >= options_.min_num_iterations &&
+       total_time_ >= options_.min_time)) {
+    timer_.Reset();
+    return false;
+  }
+
+  num_started_iterations_ += 1;
+  timer_.Restart();
+
+  return true;
+}
+
+void BenchmarkState::PauseTiming() { timer_.Pause(); }
+
+void BenchmarkState::ResumeTiming() { timer_.Resume(); }
+
+void BenchmarkState::SetCounter(const std::string& name, const double value) {
+  counters_[name] = value;
+}
+
+const std::vector<double>& BenchmarkState::IterationTimes() const {
+  return iteration_times_;
+}
+
+const std::map<std::string, double>& BenchmarkState::Counters() const {
+  return counters_;
+}
+
+BenchmarkRegistry& BenchmarkRegistry::Instance() {
+  static BenchmarkRegistry registry;
+  return registry;
+}
+
+void BenchmarkRegistry::Register(const std::string& name,
+                                 const BenchmarkFunc& func,
+                                 const std::vector<int64_t>& args) {
+  if (args.empty()) {
+    benchmarks_.push_back({name, func, false, 0});
+  } else {
+    for (const int64_t arg : args) {
+      benchmarks_.push_back(
+          {StringPrintf("%s/%lld", name.c_str(), static_cast<long long>(arg)),
+           func, true, arg});
+    }
+  }
+}
+
+std::vector<std::string> BenchmarkRegistry::Names(
+    const std::string& filter) const {
+  const std::regex filter_regex(filter);
+  std::vector<std::string> names;
+  for (const auto& benchmark : benchmarks_) {
+    if (std::regex_search(benchmark.name, filter_regex)) {
+      names.push_back(benchmark.name);
+    }
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+std::vector<BenchmarkResult> BenchmarkRegistry::Run(
+    const BenchmarkOptions& options) const {
+  CHECK(options.Check());
+
+  // Registration order depends on the static initialization order of the
+  // translation units, so run the benchmarks in a stable order.
+  std::vector<const Benchmark*> benchmarks;
+  const std::regex filter_regex(options.filter);
+  for (const auto& benchmark : benchmarks_) {
+    if (std::regex_search(benchmark.name, filter_regex)) {
+      benchmarks.push_back(&benchmark);
+    }
+  }
+  std::sort(benchmarks.begin(), benchmarks.end(),
+            [](const Benchmark* benchmark1, const Benchmark* benchmark2) {
+              return benchmark1->name < benchmark2->name;
+            });
+
+  std::vector<BenchmarkResult> results;
+  results.reserve(benchmarks.size());
+  for (const auto benchmark : benchmarks) {
+    PrintHeading2(benchmark->name);
+    SetPRNGSeed(static_cast<unsigned>(options.random_seed));
+    BenchmarkState state(options, benchmark->has_arg, benchmark->arg);
+    benchmark->func(&state);
+    results.push_back(ComputeBenchmarkResult(benchmark->name, state));
+  }
+
+  return results;
+}
+
+BenchmarkRegistrar::BenchmarkRegistrar(const std::string& name,
+                                       const BenchmarkFunc& func,
+                                       const std::vector<int64_t>& args) {
+  BenchmarkRegistry::Instance().Register(name, func, args);
+}
+
+void WriteBenchmarkResultsJSON(const std::vector<BenchmarkResult>& results,
+                               std::ostream* stream) {
+  CHECK_NOTNULL(stream);
+
+  *stream << "{\n";
+  *stream << "  \"context\": {\n";
+  *stream << "    \"version\": " << EscapeJSONString(GetVersionInfo())
+          << ",\n";
+  *stream << "    \"build\": " << EscapeJSONString(GetBuildInfo()) << ",\n";
+  *stream << "    \"num_threads\": " << GetEffectiveNumThreads(-1) << "\n";
+  *stream << "  },\n";
+  *stream << "  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    *stream << (i == 0 ? "\n" : ",\n");
+    *stream << "    {\n";
+    *stream << "      \"name\": " << EscapeJSONString(result.name) << ",\n";
+    *stream << "      \"num_iterations\": " << result.num_iterations << ",\n";
+    *stream << "      \"total_time\": " << FormatJSONNumber(result.total_time)
+            << ",\n";
+    *stream << "      \"mean_time\": " << FormatJSONNumber(result.mean_time)
+            << ",\n";
+    *stream << "      \"median_time\": "
+            << FormatJSONNumber(result.median_time) << ",\n";
+    *stream << "      \"min_time\": " << FormatJSONNumber(result.min_time)
+            << ",\n";
+    *stream << "      \"max_time\": " << FormatJSONNumber(result.max_time)
+            << ",\n";
+    *stream << "      \"stddev_time\": "
+            << FormatJSONNumber(result.stddev_time) << ",\n";
+    *stream << "      \"counters\": {";
+    bool first_counter = true;
+    for (const auto& counter : result.counters) {
+      *stream << (first_counter ? "" : ", ") << EscapeJSONString(counter.first)
+              << ": " << FormatJSONNumber(counter.second);
+      first_counter = false;
+    }
+    *stream << "}\n";
+    *stream << "    }";
+  }
+  *stream << (results.empty() ? "]\n" : "\n  ]\n");
+  *stream << "}\n";
+}
+
+void PrintBenchmarkResults(const std::vector<BenchmarkResult>& results) {
+  size_t max_name_length = 9;
+  for (const auto& result : results) {
+    max_name_length = std::max(max_name_length, result.name.size());
+  }
+
+  const int name_width = static_cast<int>(max_name_length);
+  std::cout << StringPrintf("%-*s %12s %12s %12s %10s", name_width,
+                            "Benchmark", "Median [ms]", "Min [ms]",
+                            "StdDev [ms]", "Iterations")
+            << std::endl;
+  std::cout << std::string(max_name_length + 50, '-') << std::endl;
+  for (const auto& result : results) {
+    std::cout << StringPrintf("%-*s %12.3f %12.3f %12.3f %10d", name_width,
+                              result.name.c_str(), 1e3 * result.median_time,
+                              1e3 * result.min_time, 1e3 * result.stddev_time,
+                              static_cast<int>(result.num_iterations))
+              << std::endl;
+  }
+}
+
+}  // namespace colmap
@@ -0,0 +1,181 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_BENCHMARKS_BENCHMARK_H_
+#define COLMAP_SRC_BENCHMARKS_BENCHMARK_H_
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "util/timer.h"
+
+namespace colmap {
+
+struct BenchmarkOptions {
+  // Minimum accumulated time in seconds of the measured iterations.
+  double min_time = 0.5;
+
+  // Minimum and maximum number of measured iterations.
+  int min_num_iterations = 3;
+  int max_num_iterations = 1000;
+
+  // Number of iterations that are run but not measured before the
+  // measured iterations.
+  int num_warmup_iterations = 1;
+
+  // Seed for the random number generator that is reset before every
+  // benchmark to make the synthetic data deterministic.
+  int random_seed = 0;
+
+  // Regular expression that selects the benchmarks to run.
+  std::string filter = ".*";
+
+  bool Check() const;
+};
+
+// State of a running benchmark. The benchmark function sets up its data and
+// then repeatedly executes the measured code in a loop of the form:
+//
+//    while (state->KeepRunning()) {
+//      ...
+//    }
+//
+// Per-iteration setup that should not be measured can be wrapped in
+// `PauseTiming` and `ResumeTiming`.
+class BenchmarkState {
+ public:
+  BenchmarkState(const BenchmarkOptions& options, const bool has_arg,
+                 const int64_t arg);
+
+  // The argument of parameterized benchmarks, e.g. the problem size.
+  int64_t Arg() const;
+
+  // Returns true as long as another iteration should be executed.
+  bool KeepRunning();
+
+  void PauseTiming();
+  void ResumeTiming();
+
+  // Record a named value in the results, e.g. the number of processed
+  // elements or the result of the benchmarked computation.
+  void SetCounter(const std::string& name, const double value);
+
+  const std::vector<double>& IterationTimes() const;
+  const std::map<std::string, double>& Counters() const;
+
+ private:
+  const BenchmarkOptions options_;
+  const bool has_arg_;
+  const int64_t arg_;
+  int num_started_iterations_;
+  double total_time_;
+  Timer timer_;
+  std::vector<double> iteration_times_;
+  std::map<std::string, double> counters_;
+};
+
+typedef std::function<void(BenchmarkState*)> BenchmarkFunc;
+
+struct BenchmarkResult {
+  std::string name;
+  size_t num_iterations = 0;
+  double total_time = 0;
+  double mean_time = 0;
+  double median_time = 0;
+  double min_time = 0;
+  double max_time = 0;
+  double stddev_time = 0;
+  std::map<std::string, double> counters;
+};
+
+class BenchmarkRegistry {
+ public:
+  static BenchmarkRegistry& Instance();
+
+  // Register a benchmark. If arguments are given, the benchmark is run once
+  // per argument and named `name/arg`.
+  void Register(const std::string& name, const BenchmarkFunc& func,
+                const std::vector<int64_t>& args);
+
+  // Names of all registered benchmarks that match the filter.
+  std::vector<std::string> Names(const std::string& filter) const;
+
+  // Run all registered benchmarks that match the filter in the options.
+  std::vector<BenchmarkResult> Run(const BenchmarkOptions& options) const;
+
+ private:
+  struct Benchmark {
+    std::string name;
+    BenchmarkFunc func;
+    bool has_arg;
+    int64_t arg;
+  };
+
+  std::vector<Benchmark> benchmarks_;
+};
+
+struct BenchmarkRegistrar {
+  BenchmarkRegistrar(const std::string& name, const BenchmarkFunc& func,
+                     const std::vector<int64_t>& args = {});
+};
+
+// Write the results as a JSON document of the form:
+//
+//    {
+//      "context": {"version": ..., "build": ..., "num_threads": ...},
+//      "benchmarks": [
+//        {"name": ..., "num_iterations": ..., "mean_time": ..., ...,
+//         "counters": {...}},
+//        ...
+//      ]
+//    }
+//
+// All times are in seconds.
+void WriteBenchmarkResultsJSON(const std::vector<BenchmarkResult>& results,
+                               std::ostream* stream);
+
+// Print the results as a human readable table.
+void PrintBenchmarkResults(const std::vector<BenchmarkResult>& results);
+
+#define COLMAP_BENCHMARK(func)                                         \
+  static const ::colmap::BenchmarkRegistrar benchmark_registrar_##func( \
+      #func, &func)
+
+#define COLMAP_BENCHMARK_ARGS(func, ...)                               \
+  static const ::colmap::BenchmarkRegistrar benchmark_registrar_##func( \
+      #func, &func, {__VA_ARGS__})
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_BENCHMARKS_BENCHMARK_H_
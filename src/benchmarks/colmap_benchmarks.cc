@@ -0,0 +1,93 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include <fstream>
+
+#include "benchmarks/benchmark.h"
+#include "util/logging.h"
+#include "util/misc.h"
+#include "util/option_manager.h"
+
+using namespace colmap;
+
+// Runs the registered benchmarks on synthetic data and optionally writes the
+// results in JSON format, e.g.:
+//
+//    colmap_benchmarks --filter "BundleAdjuster|Triangulator"
+//                      --output_path results.json
+//
+int main(int argc, char** argv) {
+  InitializeGlog(argv);
+
+  BenchmarkOptions benchmark_options;
+  std::string output_path;
+  bool list_benchmarks = false;
+
+  OptionManager options(/*add_project_options=*/false);
+  options.AddDefaultOption("filter", &benchmark_options.filter);
+  options.AddDefaultOption("min_time", &benchmark_options.min_time);
+  options.AddDefaultOption("min_num_iterations",
+                           &benchmark_options.min_num_iterations);
+  options.AddDefaultOption("max_num_iterations",
+                           &benchmark_options.max_num_iterations);
+  options.AddDefaultOption("num_warmup_iterations",
+                           &benchmark_options.num_warmup_iterations);
+  options.AddDefaultOption("random_seed", &benchmark_options.random_seed);
+  options.AddDefaultOption("output_path", &output_path);
+  options.AddDefaultOption("list_benchmarks", &list_benchmarks);
+  options.Parse(argc, argv);
+
+  if (!benchmark_options.Check()) {
+    std::cerr << "ERROR: Invalid benchmark options" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (list_benchmarks) {
+    for (const auto& name :
+         BenchmarkRegistry::Instance().Names(benchmark_options.filter)) {
+      std::cout << name << std::endl;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  const auto results = BenchmarkRegistry::Instance().Run(benchmark_options);
+
+  PrintHeading1("Benchmark results");
+  PrintBenchmarkResults(results);
+
+  if (!output_path.empty()) {
+    std::ofstream file(output_path, std::ios::trunc);
+    CHECK(file.is_open()) << output_path;
+    WriteBenchmarkResultsJSON(results, &file);
+  }
+
+  return EXIT_SUCCESS;
+}
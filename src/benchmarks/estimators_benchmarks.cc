@@ -0,0 +1,193 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "benchmarks/benchmark.h"
+#include "benchmarks/synthetic.h"
+#include "estimators/pose.h"
+#include "estimators/two_view_geometry.h"
+#include "util/random.h"
+
+namespace colmap {
+namespace {
+
+// Synthesize two views of the given number of 3D points with a known focal
+// length. A quarter of the number of points is added as unrelated 2D points
+// in both images.
+void SynthesizeTwoViews(const size_t num_points3D,
+                        Reconstruction* reconstruction) {
+  SyntheticDatasetOptions options;
+  options.num_images = 2;
+  options.num_points3D = static_cast<int>(num_points3D);
+  options.num_points2D_without_point3D = static_cast<int>(num_points3D / 4);
+  options.point2D_stddev = 0.5;
+  SynthesizeDataset(options, reconstruction);
+  reconstruction->Camera(1).SetPriorFocalLength(true);
+}
+
+// The argument is the number of inlier matches. The unrelated points of both
+// images are matched as outliers.
+void BenchmarkTwoViewGeometryEstimate(BenchmarkState* state,
+                                      const bool use_sprt) {
+  Reconstruction reconstruction;
+  SynthesizeTwoViews(state->Arg(), &reconstruction);
+
+  const auto& image1 = reconstruction.Image(1);
+  const auto& image2 = reconstruction.Image(2);
+  const auto& camera = reconstruction.Camera(image1.CameraId());
+
+  std::vector<Eigen::Vector2d> points1;
+  std::vector<point2D_t> outlier_idxs1;
+  for (point2D_t point2D_idx = 0; point2D_idx < image1.NumPoints2D();
+       ++point2D_idx) {
+    points1.push_back(image1.Point2D(point2D_idx).XY());
+    if (!image1.Point2D(point2D_idx).HasPoint3D()) {
+      outlier_idxs1.push_back(point2D_idx);
+    }
+  }
+
+  std::vector<Eigen::Vector2d> points2;
+  std::vector<point2D_t> outlier_idxs2;
+  std::unordered_map<point3D_t, point2D_t> point3D_to_point2D2;
+  for (point2D_t point2D_idx = 0; point2D_idx < image2.NumPoints2D();
+       ++point2D_idx) {
+    const auto& point2D = image2.Point2D(point2D_idx);
+    points2.push_back(point2D.XY());
+    if (point2D.HasPoint3D()) {
+      point3D_to_point2D2.emplace(point2D.Point3DId(), point2D_idx);
+    } else {
+      outlier_idxs2.push_back(point2D_idx);
+    }
+  }
+
+  FeatureMatches matches;
+  for (point2D_t point2D_idx = 0; point2D_idx < image1.NumPoints2D();
+       ++point2D_idx) {
+    const auto& point2D = image1.Point2D(point2D_idx);
+    if (point2D.HasPoint3D()) {
+      matches.emplace_back(point2D_idx,
+                           point3D_to_point2D2.at(point2D.Point3DId()));
+    }
+  }
+  const size_t num_inlier_matches = matches.size();
+  for (size_t i = 0; i < outlier_idxs1.size() && i < outlier_idxs2.size();
+       ++i) {
+    matches.emplace_back(outlier_idxs1[i], outlier_idxs2[i]);
+  }
+  Shuffle(static_cast<uint32_t>(matches.size()), &matches);
+
+  // Same RANSAC options as the default feature matching options.
+  TwoViewGeometry::Options options;
+  options.ransac_options.max_error = 4.0;
+  options.ransac_options.confidence = 0.999;
+  options.ransac_options.max_num_trials = 10000;
+  options.ransac_options.min_inlier_ratio = 0.25;
+  options.ransac_options.use_sprt = use_sprt;
+
+  TwoViewGeometry two_view_geometry;
+  while (state->KeepRunning()) {
+    two_view_geometry = TwoViewGeometry();
+    two_view_geometry.Estimate(camera, points1, camera, points2, matches,
+                               options);
+  }
+
+  state->SetCounter("num_matches", matches.size());
+  state->SetCounter("num_true_inliers", num_inlier_matches);
+  state->SetCounter("num_inliers", two_view_geometry.inlier_matches.size());
+  state->SetCounter("config", two_view_geometry.config);
+}
+
+void BM_TwoViewGeometryEstimate(BenchmarkState* state) {
+  BenchmarkTwoViewGeometryEstimate(state, /*use_sprt=*/false);
+}
+
+void BM_TwoViewGeometryEstimateSPRT(BenchmarkState* state) {
+  BenchmarkTwoViewGeometryEstimate(state, /*use_sprt=*/true);
+}
+
+// The argument is the number of inlier 2D-3D correspondences. The unrelated
+// points of the image are paired with random 3D points as outliers.
+void BenchmarkEstimateAbsolutePose(BenchmarkState* state,
+                                   const bool use_sprt) {
+  Reconstruction reconstruction;
+  SynthesizeTwoViews(state->Arg(), &reconstruction);
+
+  const auto& image = reconstruction.Image(1);
+
+  std::vector<Eigen::Vector2d> points2D;
+  std::vector<Eigen::Vector3d> points3D;
+  size_t num_inlier_correspondences = 0;
+  for (const auto& point2D : image.Points2D()) {
+    points2D.push_back(point2D.XY());
+    if (point2D.HasPoint3D()) {
+      points3D.push_back(reconstruction.Point3D(point2D.Point3DId()).XYZ());
+      num_inlier_correspondences += 1;
+    } else {
+      points3D.emplace_back(RandomReal(-1.0, 1.0), RandomReal(-1.0, 1.0),
+                            RandomReal(-1.0, 1.0));
+    }
+  }
+
+  AbsolutePoseEstimationOptions options;
+  options.ransac_options.max_error = 4.0;
+  options.ransac_options.use_sprt = use_sprt;
+
+  Eigen::Vector4d qvec;
+  Eigen::Vector3d tvec;
+  size_t num_inliers = 0;
+  std::vector<char> inlier_mask;
+  while (state->KeepRunning()) {
+    Camera camera = reconstruction.Camera(image.CameraId());
+    EstimateAbsolutePose(options, points2D, points3D, &qvec, &tvec, &camera,
+                         &num_inliers, &inlier_mask);
+  }
+
+  state->SetCounter("num_correspondences", points2D.size());
+  state->SetCounter("num_true_inliers", num_inlier_correspondences);
+  state->SetCounter("num_inliers", num_inliers);
+  state->SetCounter("translation_error", (tvec - image.Tvec()).norm());
+}
+
+void BM_EstimateAbsolutePose(BenchmarkState* state) {
+  BenchmarkEstimateAbsolutePose(state, /*use_sprt=*/false);
+}
+
+void BM_EstimateAbsolutePoseSPRT(BenchmarkState* state) {
+  BenchmarkEstimateAbsolutePose(state, /*use_sprt=*/true);
+}
+
+}  // namespace
+
+COLMAP_BENCHMARK_ARGS(BM_TwoViewGeometryEstimate, 200, 2000);
+COLMAP_BENCHMARK_ARGS(BM_TwoViewGeometryEstimateSPRT, 200, 2000);
+COLMAP_BENCHMARK_ARGS(BM_EstimateAbsolutePose, 100, 1000);
+COLMAP_BENCHMARK_ARGS(BM_EstimateAbsolutePoseSPRT, 100, 1000);
+
+}  // namespace colmap
@@ -0,0 +1,113 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "benchmarks/benchmark.h"
+#include "benchmarks/synthetic.h"
+#include "feature/sift.h"
+#include "util/random.h"
+
+namespace colmap {
+namespace {
+
+// The argument is the image width with a 4:3 aspect ratio.
+void BM_ExtractSiftFeaturesCPU(BenchmarkState* state) {
+  const int width = static_cast<int>(state->Arg());
+  const Bitmap bitmap = SynthesizeBitmap(width, width * 3 / 4, width / 2);
+
+  SiftExtractionOptions options;
+  options.use_gpu = false;
+
+  FeatureKeypoints keypoints;
+  FeatureDescriptors descriptors;
+  while (state->KeepRunning()) {
+    CHECK(ExtractSiftFeaturesCPU(options, bitmap, &keypoints, &descriptors));
+  }
+
+  state->SetCounter("num_features", keypoints.size());
+}
+
+// Half of the second descriptors are perturbed copies of the first
+// descriptors and the other half are unrelated.
+void SynthesizeDescriptorPair(const size_t num_descriptors,
+                              FeatureDescriptors* descriptors1,
+                              FeatureDescriptors* descriptors2) {
+  *descriptors1 = SynthesizeDescriptors(num_descriptors);
+  *descriptors2 = SynthesizeDescriptors(num_descriptors);
+  for (size_t i = 0; i < num_descriptors / 2; ++i) {
+    const size_t idx1 = RandomInteger<size_t>(0, num_descriptors - 1);
+    for (int j = 0; j < descriptors1->cols(); ++j) {
+      const int value = (*descriptors1)(idx1, j) + RandomInteger(-5, 5);
+      (*descriptors2)(i, j) =
+          static_cast<uint8_t>(std::min(255, std::max(0, value)));
+    }
+  }
+}
+
+void BM_MatchSiftFeaturesCPUBruteForce(BenchmarkState* state) {
+  FeatureDescriptors descriptors1;
+  FeatureDescriptors descriptors2;
+  SynthesizeDescriptorPair(state->Arg(), &descriptors1, &descriptors2);
+
+  SiftMatchingOptions options;
+  options.use_gpu = false;
+
+  FeatureMatches matches;
+  while (state->KeepRunning()) {
+    MatchSiftFeaturesCPUBruteForce(options, descriptors1, descriptors2,
+                                   &matches);
+  }
+
+  state->SetCounter("num_matches", matches.size());
+}
+
+void BM_MatchSiftFeaturesCPUFLANN(BenchmarkState* state) {
+  FeatureDescriptors descriptors1;
+  FeatureDescriptors descriptors2;
+  SynthesizeDescriptorPair(state->Arg(), &descriptors1, &descriptors2);
+
+  SiftMatchingOptions options;
+  options.use_gpu = false;
+
+  FeatureMatches matches;
+  while (state->KeepRunning()) {
+    MatchSiftFeaturesCPUFLANN(options, descriptors1, descriptors2, &matches);
+  }
+
+  state->SetCounter("num_matches", matches.size());
+}
+
+}  // namespace
+
+COLMAP_BENCHMARK_ARGS(BM_ExtractSiftFeaturesCPU, 640, 1600);
+COLMAP_BENCHMARK_ARGS(BM_MatchSiftFeaturesCPUBruteForce, 1000, 8000);
+COLMAP_BENCHMARK_ARGS(BM_MatchSiftFeaturesCPUFLANN, 1000, 8000);
+
+}  // namespace colmap
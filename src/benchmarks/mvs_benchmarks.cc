@@ -0,0 +1,72 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include <boost/filesystem.hpp>
+
+#include "benchmarks/benchmark.h"
+#include "benchmarks/synthetic.h"
+#include "mvs/fusion.h"
+
+namespace colmap {
+namespace {
+
+// The argument is the number of threads, where -1 uses all cores. The
+// workspace consists of 10 images of 320x240 pixels.
+void BM_StereoFusion(BenchmarkState* state) {
+  const std::string workspace_path =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("colmap_benchmark_%%%%-%%%%-%%%%"))
+          .string();
+  SynthesizeDenseWorkspace(workspace_path, /*num_images=*/10, /*width=*/320,
+                           /*height=*/240);
+
+  mvs::StereoFusionOptions options;
+  options.num_threads = static_cast<int>(state->Arg());
+
+  size_t num_fused_points = 0;
+  while (state->KeepRunning()) {
+    mvs::StereoFusion fusion(options, workspace_path, "COLMAP", "",
+                             "geometric");
+    fusion.Start();
+    fusion.Wait();
+    num_fused_points = fusion.GetFusedPoints().size();
+  }
+
+  boost::filesystem::remove_all(workspace_path);
+
+  state->SetCounter("num_fused_points", num_fused_points);
+}
+
+}  // namespace
+
+COLMAP_BENCHMARK_ARGS(BM_StereoFusion, 1, -1);
+
+}  // namespace colmap
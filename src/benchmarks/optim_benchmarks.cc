@@ -0,0 +1,106 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "benchmarks/benchmark.h"
+#include "benchmarks/synthetic.h"
+#include "optim/bundle_adjustment.h"
+#include "util/random.h"
+
+namespace colmap {
+namespace {
+
+// The argument is the number of images with 100 3D points per image that are
+// observed in most images. Every iteration solves the same perturbed problem.
+void BM_BundleAdjusterSolve(BenchmarkState* state) {
+  SyntheticDatasetOptions synthetic_options;
+  synthetic_options.num_images = static_cast<int>(state->Arg());
+  synthetic_options.num_points3D = 100 * synthetic_options.num_images;
+  synthetic_options.num_points2D_without_point3D = 0;
+  synthetic_options.point2D_stddev = 0.5;
+
+  Reconstruction perturbed_reconstruction;
+  SynthesizeDataset(synthetic_options, &perturbed_reconstruction);
+
+  for (const auto& point3D_id : perturbed_reconstruction.Point3DIds()) {
+    auto& point3D = perturbed_reconstruction.Point3D(point3D_id);
+    point3D.XYZ() += Eigen::Vector3d(RandomGaussian(0.0, 0.01),
+                                     RandomGaussian(0.0, 0.01),
+                                     RandomGaussian(0.0, 0.01));
+  }
+
+  // Fix the first pose and the scale with the x-coordinate of the second
+  // pose to remove the gauge freedom.
+  BundleAdjustmentConfig config;
+  for (const image_t image_id : perturbed_reconstruction.RegImageIds()) {
+    config.AddImage(image_id);
+    if (image_id == 1) {
+      config.SetConstantPose(image_id);
+    } else {
+      if (image_id == 2) {
+        config.SetConstantTvec(image_id, {0});
+      }
+      auto& image = perturbed_reconstruction.Image(image_id);
+      image.Tvec() += Eigen::Vector3d(RandomGaussian(0.0, 0.01),
+                                      RandomGaussian(0.0, 0.01),
+                                      RandomGaussian(0.0, 0.01));
+    }
+  }
+
+  BundleAdjustmentOptions options;
+  options.print_summary = false;
+  options.solver_options.max_num_iterations = 25;
+
+  Reconstruction reconstruction;
+  size_t num_residuals = 0;
+  double final_cost = 0;
+  while (state->KeepRunning()) {
+    state->PauseTiming();
+    reconstruction = perturbed_reconstruction;
+    state->ResumeTiming();
+
+    BundleAdjuster bundle_adjuster(options, config);
+    CHECK(bundle_adjuster.Solve(&reconstruction));
+
+    num_residuals = bundle_adjuster.Summary().num_residuals;
+    final_cost = bundle_adjuster.Summary().final_cost;
+  }
+
+  state->SetCounter("num_images", reconstruction.NumRegImages());
+  state->SetCounter("num_points3D", reconstruction.NumPoints3D());
+  state->SetCounter("num_residuals", num_residuals);
+  state->SetCounter("final_cost", final_cost);
+}
+
+}  // namespace
+
+COLMAP_BENCHMARK_ARGS(BM_BundleAdjusterSolve, 5, 20, 50);
+
+}  // namespace colmap
@@ -0,0 +1,87 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "benchmarks/benchmark.h"
+#include "retrieval/inverted_file.h"
+#include "util/random.h"
+
+namespace colmap {
+namespace {
+
+typedef retrieval::InvertedFile<64> InvertedFileType;
+
+// The argument is the number of images with two entries each in the inverted
+// file, whose signatures are thresholded from uniformly random descriptors.
+void BM_InvertedFileScoreFeature(BenchmarkState* state) {
+  const int num_images = static_cast<int>(state->Arg());
+
+  Eigen::Matrix<float, Eigen::Dynamic, 64> descriptors(1000, 64);
+  for (int i = 0; i < descriptors.rows(); ++i) {
+    for (int j = 0; j < descriptors.cols(); ++j) {
+      descriptors(i, j) = RandomReal(-1.0f, 1.0f);
+    }
+  }
+
+  InvertedFileType inverted_file;
+  inverted_file.ComputeHammingEmbedding(descriptors);
+
+  InvertedFileType::EntryType entry;
+  for (int image_id = 0; image_id < num_images; ++image_id) {
+    entry.image_id = image_id;
+    for (int feature_idx = 0; feature_idx < 2; ++feature_idx) {
+      entry.feature_idx = feature_idx;
+      for (int i = 0; i < 64; ++i) {
+        entry.descriptor[i] = RandomInteger(0, 1) == 1;
+      }
+      inverted_file.AddEntry(entry);
+    }
+  }
+
+  inverted_file.ComputeIDFWeight(2 * num_images);
+  inverted_file.SortEntries();
+
+  std::vector<retrieval::ImageScore> image_scores;
+  int query_idx = 0;
+  while (state->KeepRunning()) {
+    const Eigen::VectorXf query = descriptors.row(query_idx).transpose();
+    inverted_file.ScoreFeature(query, &image_scores);
+    query_idx = (query_idx + 1) % descriptors.rows();
+  }
+
+  state->SetCounter("num_entries", inverted_file.NumEntries());
+  state->SetCounter("num_image_scores", image_scores.size());
+}
+
+}  // namespace
+
+COLMAP_BENCHMARK_ARGS(BM_InvertedFileScoreFeature, 10000, 1000000);
+
+}  // namespace colmap
@@ -0,0 +1,103 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "base/database_cache.h"
+#include "benchmarks/benchmark.h"
+#include "benchmarks/synthetic.h"
+#include "sfm/incremental_triangulator.h"
+
+namespace colmap {
+namespace {
+
+// The argument is the number of registered images, which observe 50 3D points
+// per image that are each observed in about 20 images. Every iteration
+// triangulates all images from scratch with the ground-truth poses.
+void BM_IncrementalTriangulatorTriangulateImage(BenchmarkState* state) {
+  SyntheticDatasetOptions synthetic_options;
+  synthetic_options.num_images = static_cast<int>(state->Arg());
+  synthetic_options.num_points3D = 50 * synthetic_options.num_images;
+  synthetic_options.point3D_visibility =
+      std::min(1.0, 20.0 / synthetic_options.num_images);
+  synthetic_options.point2D_stddev = 0.5;
+
+  Reconstruction synthetic_reconstruction;
+  SynthesizeDataset(synthetic_options, &synthetic_reconstruction);
+
+  Database database(":memory:");
+  WriteSyntheticDatabase(synthetic_reconstruction, &database);
+
+  DatabaseCache database_cache;
+  database_cache.Load(database, /*min_num_matches=*/15,
+                      /*ignore_watermarks=*/false,
+                      /*image_names=*/{});
+
+  Reconstruction reconstruction;
+  reconstruction.Load(database_cache);
+  reconstruction.SetUp(&database_cache.CorrespondenceGraph());
+  for (const image_t image_id : synthetic_reconstruction.RegImageIds()) {
+    const auto& synthetic_image = synthetic_reconstruction.Image(image_id);
+    auto& image = reconstruction.Image(image_id);
+    image.SetQvec(synthetic_image.Qvec());
+    image.SetTvec(synthetic_image.Tvec());
+    reconstruction.RegisterImage(image_id);
+  }
+
+  const std::vector<image_t> image_ids = reconstruction.RegImageIds();
+
+  IncrementalTriangulator triangulator(&database_cache.CorrespondenceGraph(),
+                                       &reconstruction);
+  IncrementalTriangulator::Options options;
+
+  size_t num_observations = 0;
+  while (state->KeepRunning()) {
+    state->PauseTiming();
+    for (const point3D_t point3D_id : reconstruction.Point3DIds()) {
+      reconstruction.DeletePoint3D(point3D_id);
+    }
+    triangulator.ClearModifiedPoints3D();
+    state->ResumeTiming();
+
+    num_observations = 0;
+    for (const image_t image_id : image_ids) {
+      num_observations += triangulator.TriangulateImage(options, image_id);
+    }
+  }
+
+  state->SetCounter("num_images", image_ids.size());
+  state->SetCounter("num_points3D", reconstruction.NumPoints3D());
+  state->SetCounter("num_observations", num_observations);
+}
+
+}  // namespace
+
+COLMAP_BENCHMARK_ARGS(BM_IncrementalTriangulatorTriangulateImage, 20, 100);
+
+}  // namespace colmap
@@ -0,0 +1,406 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "benchmarks/synthetic.h"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+
+#include "base/pose.h"
+#include "base/projection.h"
+#include "estimators/two_view_geometry.h"
+#include "feature/utils.h"
+#include "mvs/depth_map.h"
+#include "mvs/normal_map.h"
+#include "util/misc.h"
+#include "util/random.h"
+
+namespace colmap {
+namespace {
+
+// Rotation of a camera at the given center that looks at the origin.
+Eigen::Matrix3d LookAtOrigin(const Eigen::Vector3d& proj_center) {
+  const Eigen::Vector3d z_axis = -proj_center.normalized();
+  const Eigen::Vector3d x_axis =
+      Eigen::Vector3d::UnitY().cross(z_axis).normalized();
+  const Eigen::Vector3d y_axis = z_axis.cross(x_axis);
+  Eigen::Matrix3d R;
+  R.row(0) = x_axis;
+  R.row(1) = y_axis;
+  R.row(2) = z_axis;
+  return R;
+}
+
+bool IsInsideCamera(const Camera& camera, const Eigen::Vector2d& point2D) {
+  return point2D.x() >= 0 && point2D.y() >= 0 &&
+         point2D.x() < camera.Width() && point2D.y() < camera.Height();
+}
+
+}  // namespace
+
+void SynthesizeDataset(const SyntheticDatasetOptions& options,
+                       Reconstruction* reconstruction) {
+  CHECK_GT(options.num_images, 0);
+  CHECK_GE(options.num_points3D, 0);
+  CHECK_GE(options.num_points2D_without_point3D, 0);
+  CHECK_GE(options.point2D_stddev, 0);
+  CHECK_GE(options.point3D_visibility, 0);
+  CHECK_LE(options.point3D_visibility, 1);
+  CHECK_EQ(reconstruction->NumCameras(), 0);
+  CHECK_EQ(reconstruction->NumImages(), 0);
+
+  Camera camera;
+  camera.SetCameraId(1);
+  camera.InitializeWithName(options.camera_model_name,
+                            options.camera_focal_length, options.camera_width,
+                            options.camera_height);
+  reconstruction->AddCamera(camera);
+
+  // The points fill the unit cube and the cameras are far enough away for the
+  // cube to project into the image for the default focal length.
+  std::vector<Eigen::Vector3d> points3D(options.num_points3D);
+  for (auto& xyz : points3D) {
+    xyz = Eigen::Vector3d(RandomReal(-1.0, 1.0), RandomReal(-1.0, 1.0),
+                          RandomReal(-1.0, 1.0));
+  }
+
+  const double kCameraDistance = 8.0;
+  const double kArcAngle = DegToRad(90.0);
+
+  std::vector<std::vector<TrackElement>> track_elements(points3D.size());
+
+  for (int i = 0; i < options.num_images; ++i) {
+    const image_t image_id = static_cast<image_t>(i + 1);
+
+    const double angle =
+        options.num_images == 1
+            ? 0.0
+            : kArcAngle * (static_cast<double>(i) / (options.num_images - 1) -
+                           0.5);
+    const Eigen::Vector3d proj_center(
+        kCameraDistance * std::sin(angle), RandomReal(-0.5, 0.5),
+        -kCameraDistance * std::cos(angle));
+    const Eigen::Matrix3d R = LookAtOrigin(proj_center);
+
+    Image image;
+    image.SetImageId(image_id);
+    image.SetCameraId(camera.CameraId());
+    image.SetName(StringPrintf("image%06d.png", i + 1));
+    image.SetQvec(RotationMatrixToQuaternion(R));
+    image.SetTvec(-R * proj_center);
+
+    const Eigen::Matrix3x4d proj_matrix = image.ProjectionMatrix();
+
+    // Generate the observations in a random order, such that the indices of
+    // the same 3D point differ between images.
+    std::vector<Eigen::Vector2d> points2D;
+    std::vector<int> point3D_idxs;
+    for (size_t j = 0; j < points3D.size(); ++j) {
+      if (!HasPointPositiveDepth(proj_matrix, points3D[j]) ||
+          (options.point3D_visibility < 1 &&
+           RandomReal(0.0, 1.0) > options.point3D_visibility)) {
+        continue;
+      }
+      Eigen::Vector2d point2D =
+          ProjectPointToImage(points3D[j], proj_matrix, camera);
+      if (options.point2D_stddev > 0) {
+        point2D += Eigen::Vector2d(
+            RandomGaussian(0.0, options.point2D_stddev),
+            RandomGaussian(0.0, options.point2D_stddev));
+      }
+      if (IsInsideCamera(camera, point2D)) {
+        points2D.push_back(point2D);
+        point3D_idxs.push_back(static_cast<int>(j));
+      }
+    }
+
+    for (int j = 0; j < options.num_points2D_without_point3D; ++j) {
+      points2D.emplace_back(RandomReal(0.0, camera.Width() - 1.0),
+                            RandomReal(0.0, camera.Height() - 1.0));
+      point3D_idxs.push_back(-1);
+    }
+
+    std::vector<size_t> order(points2D.size());
+    std::iota(order.begin(), order.end(), 0);
+    Shuffle(static_cast<uint32_t>(order.size()), &order);
+
+    std::vector<Eigen::Vector2d> shuffled_points2D(points2D.size());
+    for (size_t j = 0; j < order.size(); ++j) {
+      shuffled_points2D[j] = points2D[order[j]];
+      const int point3D_idx = point3D_idxs[order[j]];
+      if (point3D_idx >= 0) {
+        track_elements[point3D_idx].emplace_back(image_id,
+                                                 static_cast<point2D_t>(j));
+      }
+    }
+
+    image.SetPoints2D(shuffled_points2D);
+
+    reconstruction->AddImage(image);
+    reconstruction->RegisterImage(image_id);
+  }
+
+  for (size_t j = 0; j < points3D.size(); ++j) {
+    if (track_elements[j].size() < 2) {
+      continue;
+    }
+    Track track;
+    track.AddElements(track_elements[j]);
+    reconstruction->AddPoint3D(points3D[j], track);
+  }
+}
+
+void WriteSyntheticDatabase(const Reconstruction& reconstruction,
+                            Database* database) {
+  DatabaseTransaction database_transaction(database);
+
+  for (const auto& camera : reconstruction.Cameras()) {
+    database->WriteCamera(camera.second, /*use_camera_id=*/true);
+  }
+
+  std::vector<image_t> image_ids;
+  image_ids.reserve(reconstruction.NumImages());
+  for (const auto& image : reconstruction.Images()) {
+    image_ids.push_back(image.first);
+  }
+  std::sort(image_ids.begin(), image_ids.end());
+
+  // Maps the 3D points of every image to the index of their observation.
+  std::vector<std::unordered_map<point3D_t, point2D_t>> point3D_to_point2D(
+      image_ids.size());
+
+  for (size_t i = 0; i < image_ids.size(); ++i) {
+    const auto& image = reconstruction.Image(image_ids[i]);
+    database->WriteImage(image, /*use_image_id=*/true);
+
+    FeatureKeypoints keypoints;
+    keypoints.reserve(image.NumPoints2D());
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      const auto& point2D = image.Point2D(point2D_idx);
+      keypoints.emplace_back(static_cast<float>(point2D.X()),
+                             static_cast<float>(point2D.Y()));
+      if (point2D.HasPoint3D()) {
+        point3D_to_point2D[i].emplace(point2D.Point3DId(), point2D_idx);
+      }
+    }
+    database->WriteKeypoints(image.ImageId(), keypoints);
+  }
+
+  for (size_t i1 = 0; i1 < image_ids.size(); ++i1) {
+    for (size_t i2 = i1 + 1; i2 < image_ids.size(); ++i2) {
+      TwoViewGeometry two_view_geometry;
+      two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+      for (const auto& point3D_and_idx : point3D_to_point2D[i1]) {
+        const auto match = point3D_to_point2D[i2].find(point3D_and_idx.first);
+        if (match != point3D_to_point2D[i2].end()) {
+          two_view_geometry.inlier_matches.emplace_back(
+              point3D_and_idx.second, match->second);
+        }
+      }
+      if (two_view_geometry.inlier_matches.empty()) {
+        continue;
+      }
+      database->WriteMatches(image_ids[i1], image_ids[i2],
+                             two_view_geometry.inlier_matches);
+      database->WriteTwoViewGeometry(image_ids[i1], image_ids[i2],
+                                     two_view_geometry);
+    }
+  }
+}
+
+FeatureDescriptors SynthesizeDescriptors(const size_t num_descriptors) {
+  Eigen::MatrixXf descriptors(num_descriptors, 128);
+  for (Eigen::MatrixXf::Index i = 0; i < descriptors.size(); ++i) {
+    descriptors.data()[i] = RandomReal(0.0f, 1.0f);
+  }
+  return FeatureDescriptorsToUnsignedByte(
+      L2NormalizeFeatureDescriptors(descriptors));
+}
+
+Bitmap SynthesizeBitmap(const int width, const int height,
+                        const int num_shapes) {
+  Bitmap bitmap;
+  CHECK(bitmap.Allocate(width, height, /*as_rgb=*/false));
+  bitmap.Fill(BitmapColor<uint8_t>(128));
+
+  for (int i = 0; i < num_shapes; ++i) {
+    const BitmapColor<uint8_t> color(
+        static_cast<uint8_t>(RandomInteger(0, 255)));
+    const int center_x = RandomInteger(0, width - 1);
+    const int center_y = RandomInteger(0, height - 1);
+    const int radius =
+        RandomInteger(2, std::max(2, std::min(width, height) / 8));
+    const bool is_disk = RandomInteger(0, 1) == 1;
+    for (int y = std::max(0, center_y - radius);
+         y <= std::min(height - 1, center_y + radius); ++y) {
+      for (int x = std::max(0, center_x - radius);
+           x <= std::min(width - 1, center_x + radius); ++x) {
+        const int dx = x - center_x;
+        const int dy = y - center_y;
+        if (!is_disk || dx * dx + dy * dy <= radius * radius) {
+          bitmap.SetPixel(x, y, color);
+        }
+      }
+    }
+  }
+
+  // Soften the edges to obtain features at multiple scales.
+  bitmap.Smooth(1.0f, 1.0f);
+
+  return bitmap;
+}
+
+void SynthesizeDenseWorkspace(const std::string& workspace_path,
+                              const int num_images, const int width,
+                              const int height) {
+  CHECK_GT(num_images, 1);
+
+  const std::string images_path = JoinPaths(workspace_path, "images");
+  const std::string sparse_path = JoinPaths(workspace_path, "sparse");
+  const std::string stereo_path = JoinPaths(workspace_path, "stereo");
+  CreateDirIfNotExists(workspace_path);
+  CreateDirIfNotExists(images_path);
+  CreateDirIfNotExists(sparse_path);
+  CreateDirIfNotExists(stereo_path);
+  CreateDirIfNotExists(JoinPaths(stereo_path, "depth_maps"));
+  CreateDirIfNotExists(JoinPaths(stereo_path, "normal_maps"));
+
+  Camera camera;
+  camera.SetCameraId(1);
+  camera.InitializeWithName("PINHOLE", width, width, height);
+
+  // The cameras are translated along the x-axis with identity rotation and
+  // observe a plane that is slanted around the x-axis.
+  const double kBaseline = 0.1;
+  const Eigen::Vector3d plane_normal =
+      Eigen::Vector3d(0, -0.2, -1).normalized();
+  const double plane_dist = plane_normal.dot(Eigen::Vector3d(0, 0, 5));
+
+  std::vector<Eigen::Vector3d> proj_centers(num_images);
+  for (int i = 0; i < num_images; ++i) {
+    proj_centers[i] = Eigen::Vector3d(kBaseline * (i - 0.5 * num_images), 0, 0);
+  }
+
+  // Depth of the plane along the ray through the given pixel.
+  auto PlaneDepth = [&](const Eigen::Vector3d& proj_center, const double x,
+                        const double y) {
+    const Eigen::Vector3d ray =
+        camera.ImageToWorld(Eigen::Vector2d(x, y)).homogeneous();
+    return (plane_dist - plane_normal.dot(proj_center)) /
+           plane_normal.dot(ray);
+  };
+
+  // Sparse points on the plane determine the overlapping images in fusion.
+  const int kNumPoints3D = 200;
+  std::vector<Eigen::Vector3d> points3D(kNumPoints3D);
+  for (auto& xyz : points3D) {
+    const Eigen::Vector3d& proj_center = proj_centers[num_images / 2];
+    const Eigen::Vector2d point2D(RandomReal(0.0, width - 1.0),
+                                  RandomReal(0.0, height - 1.0));
+    xyz = proj_center +
+          PlaneDepth(proj_center, point2D.x(), point2D.y()) *
+              camera.ImageToWorld(point2D).homogeneous();
+  }
+
+  Reconstruction reconstruction;
+  reconstruction.AddCamera(camera);
+
+  std::vector<Track> tracks(points3D.size());
+
+  std::ofstream fusion_config_file(JoinPaths(stereo_path, "fusion.cfg"));
+  CHECK(fusion_config_file.is_open());
+
+  for (int i = 0; i < num_images; ++i) {
+    Image image;
+    image.SetImageId(static_cast<image_t>(i + 1));
+    image.SetCameraId(camera.CameraId());
+    image.SetName(StringPrintf("image%06d.png", i + 1));
+    image.SetQvec(ComposeIdentityQuaternion());
+    image.SetTvec(-proj_centers[i]);
+
+    std::vector<Eigen::Vector2d> points2D;
+    for (size_t j = 0; j < points3D.size(); ++j) {
+      const Eigen::Vector2d point2D =
+          ProjectPointToImage(points3D[j], image.ProjectionMatrix(), camera);
+      if (IsInsideCamera(camera, point2D)) {
+        tracks[j].AddElement(image.ImageId(),
+                             static_cast<point2D_t>(points2D.size()));
+        points2D.push_back(point2D);
+      }
+    }
+    image.SetPoints2D(points2D);
+
+    reconstruction.AddImage(image);
+    reconstruction.RegisterImage(image.ImageId());
+
+    fusion_config_file << image.Name() << std::endl;
+
+    CHECK(SynthesizeBitmap(width, height, 100)
+              .Write(JoinPaths(images_path, image.Name())));
+
+    std::vector<float> depths(width * height);
+    for (int row = 0; row < height; ++row) {
+      for (int col = 0; col < width; ++col) {
+        depths[row * width + col] = static_cast<float>(
+            PlaneDepth(proj_centers[i], col + 0.5, row + 0.5));
+      }
+    }
+
+    const auto depth_minmax = std::minmax_element(depths.begin(), depths.end());
+    mvs::DepthMap depth_map(width, height, *depth_minmax.first,
+                            *depth_minmax.second);
+    mvs::NormalMap normal_map(width, height);
+    for (int row = 0; row < height; ++row) {
+      for (int col = 0; col < width; ++col) {
+        depth_map.Set(row, col, depths[row * width + col]);
+        for (int d = 0; d < 3; ++d) {
+          normal_map.Set(row, col, d, static_cast<float>(plane_normal(d)));
+        }
+      }
+    }
+
+    const std::string file_name = image.Name() + ".geometric.bin";
+    depth_map.Write(JoinPaths(stereo_path, "depth_maps", file_name));
+    normal_map.Write(JoinPaths(stereo_path, "normal_maps", file_name));
+  }
+
+  for (size_t j = 0; j < points3D.size(); ++j) {
+    if (tracks[j].Length() >= 2) {
+      reconstruction.AddPoint3D(points3D[j], tracks[j]);
+    }
+  }
+
+  reconstruction.Write(sparse_path);
+}
+
+}  // namespace colmap
@@ -0,0 +1,93 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_BENCHMARKS_SYNTHETIC_H_
+#define COLMAP_SRC_BENCHMARKS_SYNTHETIC_H_
+
+#include <string>
+
+#include "base/database.h"
+#include "base/reconstruction.h"
+#include "feature/types.h"
+#include "util/bitmap.h"
+
+namespace colmap {
+
+struct SyntheticDatasetOptions {
+  int num_images = 10;
+  int num_points3D = 1000;
+
+  // Number of additional 2D points per image without a 3D point.
+  int num_points2D_without_point3D = 100;
+
+  std::string camera_model_name = "SIMPLE_RADIAL";
+  int camera_width = 1024;
+  int camera_height = 768;
+  double camera_focal_length = 1280;
+
+  // Standard deviation of the Gaussian noise added to the 2D points.
+  double point2D_stddev = 0.0;
+
+  // Probability with which a 3D point is observed in an image that it
+  // projects into. Lower values lead to shorter tracks and sparser matches.
+  double point3D_visibility = 1.0;
+};
+
+// Synthesize a registered reconstruction with a single shared camera. The
+// cameras lie on an arc around a cloud of 3D points and look at its center.
+// The 3D points are randomly observed in the images they project into, and
+// the 2D points of every image are randomly permuted. The data is a
+// deterministic function of the options and the current seed of the PRNG.
+void SynthesizeDataset(const SyntheticDatasetOptions& options,
+                       Reconstruction* reconstruction);
+
+// Write the cameras, images, keypoints, and the matches between all
+// observations of the same 3D point as calibrated two-view geometries.
+void WriteSyntheticDatabase(const Reconstruction& reconstruction,
+                            Database* database);
+
+// Synthesize L2-normalized, non-negative descriptors in the SIFT format.
+FeatureDescriptors SynthesizeDescriptors(const size_t num_descriptors);
+
+// Synthesize a grayscale image composed of random rectangles and disks.
+Bitmap SynthesizeBitmap(const int width, const int height,
+                        const int num_shapes);
+
+// Synthesize a dense workspace in COLMAP format with undistorted images,
+// geometric depth and normal maps of a slanted plane, a sparse model, and a
+// fusion configuration that includes all images.
+void SynthesizeDenseWorkspace(const std::string& workspace_path,
+                              const int num_images, const int width,
+                              const int height);
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_BENCHMARKS_SYNTHETIC_H_
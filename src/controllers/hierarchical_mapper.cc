@@ -31,24 +31,103 @@
 
 #include "controllers/hierarchical_mapper.h"
 
+#include <fstream>
+
 #include "base/scene_clustering.h"
 #include "util/misc.h"
+#include "util/trace.h"
 
 namespace colmap {
 namespace {
 
+// Approximate number of bytes used by a reconstruction in memory.
+size_t EstimateNumBytes(const Reconstruction& reconstruction) {
+  size_t num_bytes = sizeof(Reconstruction);
+  for (const auto& camera : reconstruction.Cameras()) {
+    num_bytes += sizeof(Camera) + camera.second.NumParams() * sizeof(double);
+  }
+  for (const auto& image : reconstruction.Images()) {
+    num_bytes += sizeof(Image) + image.second.NumPoints2D() * sizeof(Point2D);
+  }
+  for (const auto& point3D : reconstruction.Points3D()) {
+    num_bytes += sizeof(Point3D) +
+                 point3D.second.Track().Length() * sizeof(TrackElement);
+  }
+  return num_bytes;
+}
+
+const std::string kClusterDirPrefix = "cluster";
+
+// The image identifiers of the cluster, which are used to verify that a
+// cluster of a previous run is the same as the current cluster.
+std::vector<std::string> ClusterFileLines(
+    const SceneClustering::Cluster& cluster) {
+  std::vector<image_t> image_ids = cluster.image_ids;
+  std::sort(image_ids.begin(), image_ids.end());
+  return {std::to_string(image_ids.size()), VectorToCSV(image_ids)};
+}
+
+// Assign each cluster a key by its path in the cluster tree, e.g. "_0_1" for
+// the second child of the first child of the root cluster.
+void ComputeClusterKeys(
+    const SceneClustering::Cluster& cluster, const std::string& key,
+    std::unordered_map<const SceneClustering::Cluster*, std::string>*
+        cluster_keys) {
+  cluster_keys->emplace(&cluster, key);
+  for (size_t i = 0; i < cluster.child_clusters.size(); ++i) {
+    ComputeClusterKeys(cluster.child_clusters[i],
+                       key + "_" + std::to_string(i), cluster_keys);
+  }
+}
+
+// Collect the leaf clusters that are not finished and are not part of a
+// finished parent cluster.
+void CollectUnfinishedLeafClusters(
+    const SceneClustering::Cluster& cluster,
+    const std::unordered_map<const SceneClustering::Cluster*, std::string>&
+        cluster_keys,
+    ClusterReconstructionStore* store,
+    std::vector<const SceneClustering::Cluster*>* leaf_clusters) {
+  if (store->IsFinished(cluster_keys.at(&cluster), cluster)) {
+    return;
+  }
+
+  if (cluster.child_clusters.empty()) {
+    leaf_clusters->push_back(&cluster);
+  } else {
+    for (const auto& child_cluster : cluster.child_clusters) {
+      CollectUnfinishedLeafClusters(child_cluster, cluster_keys, store,
+                                    leaf_clusters);
+    }
+  }
+}
+
 void MergeClusters(
     const SceneClustering::Cluster& cluster,
-    std::unordered_map<const SceneClustering::Cluster*, ReconstructionManager>*
-        reconstruction_managers) {
+    const std::unordered_map<const SceneClustering::Cluster*, std::string>&
+        cluster_keys,
+    ClusterReconstructionStore* store) {
+  const std::string& key = cluster_keys.at(&cluster);
+  if (store->IsFinished(key, cluster)) {
+    return;
+  }
+
+  // Merge the child clusters bottom-up, such that only the reconstructions of
+  // the direct child clusters are needed to merge this cluster.
+  for (const auto& child_cluster : cluster.child_clusters) {
+    MergeClusters(child_cluster, cluster_keys, store);
+  }
+
   // Extract all reconstructions from all child clusters.
-  std::vector<Reconstruction*> reconstructions;
+  std::vector<ReconstructionManager> child_reconstruction_managers;
+  child_reconstruction_managers.reserve(cluster.child_clusters.size());
   for (const auto& child_cluster : cluster.child_clusters) {
-    if (!child_cluster.child_clusters.empty()) {
-      MergeClusters(child_cluster, reconstruction_managers);
-    }
+    child_reconstruction_managers.push_back(
+        store->Take(cluster_keys.at(&child_cluster)));
+  }
 
-    auto& reconstruction_manager = reconstruction_managers->at(&child_cluster);
+  std::vector<Reconstruction*> reconstructions;
+  for (auto& reconstruction_manager : child_reconstruction_managers) {
     for (size_t i = 0; i < reconstruction_manager.Size(); ++i) {
       reconstructions.push_back(&reconstruction_manager.Get(i));
     }
@@ -78,24 +157,184 @@ void MergeClusters(
   }
 
   // Insert a new reconstruction manager for merged cluster.
-  auto& reconstruction_manager = (*reconstruction_managers)[&cluster];
+  ReconstructionManager reconstruction_manager;
   for (const auto& reconstruction : reconstructions) {
     reconstruction_manager.Add();
     reconstruction_manager.Get(reconstruction_manager.Size() - 1) =
-        *reconstruction;
+        std::move(*reconstruction);
   }
 
-  // Delete all merged child cluster reconstruction managers.
+  // Delete all merged child cluster reconstructions.
+  child_reconstruction_managers.clear();
+
+  store->Put(key, cluster, std::move(reconstruction_manager));
+
   for (const auto& child_cluster : cluster.child_clusters) {
-    reconstruction_managers->erase(&child_cluster);
+    store->Discard(cluster_keys.at(&child_cluster));
   }
 }
 
 }  // namespace
 
+ClusterReconstructionStore::ClusterReconstructionStore(
+    const std::string& scratch_path, const size_t max_num_bytes)
+    : scratch_path_(scratch_path),
+      max_num_bytes_(max_num_bytes),
+      num_resident_bytes_(0),
+      num_resumed_clusters_(0) {
+  if (IsOutOfCore()) {
+    CreateDirIfNotExists(scratch_path_);
+  }
+}
+
+bool ClusterReconstructionStore::IsOutOfCore() const {
+  return !scratch_path_.empty();
+}
+
+bool ClusterReconstructionStore::IsFinished(
+    const std::string& key, const SceneClustering::Cluster& cluster) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (entries_.count(key) > 0) {
+    return true;
+  }
+
+  if (!IsOutOfCore()) {
+    return false;
+  }
+
+  const std::string cluster_file_path =
+      JoinPaths(ClusterPath(key), "cluster.txt");
+  if (!ExistsFile(cluster_file_path) ||
+      ReadTextFileLines(cluster_file_path) != ClusterFileLines(cluster)) {
+    return false;
+  }
+
+  entries_[key].resident = false;
+  num_resumed_clusters_ += 1;
+
+  return true;
+}
+
+size_t ClusterReconstructionStore::NumResumedClusters() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return num_resumed_clusters_;
+}
+
+size_t ClusterReconstructionStore::RemoveOrphanedClusters() {
+  if (!IsOutOfCore()) {
+    return 0;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  std::vector<boost::filesystem::path> orphaned_paths;
+  for (const auto& entry :
+       boost::filesystem::directory_iterator(scratch_path_)) {
+    const std::string name = entry.path().filename().string();
+    if (boost::filesystem::is_directory(entry.path()) &&
+        StringStartsWith(name, kClusterDirPrefix) &&
+        entries_.count(name.substr(kClusterDirPrefix.size())) == 0) {
+      orphaned_paths.push_back(entry.path());
+    }
+  }
+
+  for (const auto& path : orphaned_paths) {
+    boost::filesystem::remove_all(path);
+  }
+
+  return orphaned_paths.size();
+}
+
+void ClusterReconstructionStore::Put(
+    const std::string& key, const SceneClustering::Cluster& cluster,
+    ReconstructionManager reconstruction_manager) {
+  size_t num_bytes = 0;
+  for (size_t i = 0; i < reconstruction_manager.Size(); ++i) {
+    num_bytes += EstimateNumBytes(reconstruction_manager.Get(i));
+  }
+
+  if (IsOutOfCore()) {
+    const std::string path = ClusterPath(key);
+    if (ExistsDir(path)) {
+      boost::filesystem::remove_all(path);
+    }
+    CreateDirIfNotExists(path);
+    reconstruction_manager.Write(path, nullptr);
+
+    // The cluster file is written last, since it marks the cluster as
+    // finished when resuming.
+    std::ofstream file(JoinPaths(path, "cluster.txt"), std::ios::trunc);
+    CHECK(file.is_open()) << path;
+    for (const auto& line : ClusterFileLines(cluster)) {
+      file << line << std::endl;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  Entry& entry = entries_[key];
+  entry.reconstruction_manager = std::move(reconstruction_manager);
+  entry.num_bytes = num_bytes;
+  entry.resident = true;
+  resident_keys_.push_back(key);
+  num_resident_bytes_ += num_bytes;
+
+  if (IsOutOfCore()) {
+    // Evict the least recently finished reconstructions, since the most
+    // recent ones are most likely to be merged next.
+    while (num_resident_bytes_ > max_num_bytes_ && !resident_keys_.empty()) {
+      Entry& evicted_entry = entries_.at(resident_keys_.front());
+      evicted_entry.reconstruction_manager.Clear();
+      evicted_entry.resident = false;
+      num_resident_bytes_ -= evicted_entry.num_bytes;
+      resident_keys_.pop_front();
+    }
+  }
+}
+
+ReconstructionManager ClusterReconstructionStore::Take(const std::string& key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto entry = entries_.find(key);
+  CHECK(entry != entries_.end()) << "Cluster " << key << " not finished";
+
+  ReconstructionManager reconstruction_manager;
+  if (entry->second.resident) {
+    reconstruction_manager = std::move(entry->second.reconstruction_manager);
+    num_resident_bytes_ -= entry->second.num_bytes;
+    resident_keys_.remove(key);
+  } else {
+    const std::string path = ClusterPath(key);
+    for (size_t i = 0; ExistsDir(JoinPaths(path, std::to_string(i))); ++i) {
+      reconstruction_manager.Read(JoinPaths(path, std::to_string(i)));
+    }
+  }
+
+  entries_.erase(entry);
+
+  return reconstruction_manager;
+}
+
+void ClusterReconstructionStore::Discard(const std::string& key) {
+  if (IsOutOfCore()) {
+    boost::filesystem::remove_all(ClusterPath(key));
+  }
+}
+
+size_t ClusterReconstructionStore::NumResidentBytes() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return num_resident_bytes_;
+}
+
+std::string ClusterReconstructionStore::ClusterPath(
+    const std::string& key) const {
+  return JoinPaths(scratch_path_, kClusterDirPrefix + key);
+}
+
 bool HierarchicalMapperController::Options::Check() const {
   CHECK_OPTION_GT(init_num_trials, -1);
   CHECK_OPTION_GE(num_workers, -1);
+  CHECK_OPTION_GE(cache_size, 0.0);
   return true;
 }
 
@@ -114,6 +353,9 @@ HierarchicalMapperController::HierarchicalMapperController(
 }
 
 void HierarchicalMapperController::Run() {
+  COLMAP_TRACE_STAGE("HierarchicalMapping");
+  Tracer::Instance().SetThreadName("Hierarchical mapper");
+
   PrintHeading1("Partitioning the scene");
 
   //////////////////////////////////////////////////////////////////////////////
@@ -125,6 +367,8 @@ void HierarchicalMapperController::Run() {
   std::unordered_map<image_t, std::string> image_id_to_name;
 
   {
+    COLMAP_TRACE_STAGE("PartitionScene");
+
     Database database(options_.database_path);
 
     std::cout << "Reading images..." << std::endl;
@@ -142,7 +386,33 @@ void HierarchicalMapperController::Run() {
     scene_clustering.Partition(image_pairs, num_inliers);
   }
 
-  auto leaf_clusters = scene_clustering.GetLeafClusters();
+  const auto& root_cluster = *scene_clustering.GetRootCluster();
+
+  std::unordered_map<const SceneClustering::Cluster*, std::string>
+      cluster_keys;
+  ComputeClusterKeys(root_cluster, "", &cluster_keys);
+
+  const size_t max_num_bytes =
+      static_cast<size_t>(options_.cache_size * 1024.0 * 1024.0 * 1024.0);
+  ClusterReconstructionStore store(options_.scratch_path, max_num_bytes);
+
+  std::vector<const SceneClustering::Cluster*> leaf_clusters;
+  CollectUnfinishedLeafClusters(root_cluster, cluster_keys, &store,
+                                &leaf_clusters);
+
+  if (store.NumResumedClusters() > 0) {
+    const size_t num_leaf_clusters = scene_clustering.GetLeafClusters().size();
+    std::cout << StringPrintf("Resuming with %d of %d leaf clusters unfinished",
+                              leaf_clusters.size(), num_leaf_clusters)
+              << std::endl;
+  }
+
+  const size_t num_orphaned_clusters = store.RemoveOrphanedClusters();
+  if (num_orphaned_clusters > 0) {
+    std::cout << StringPrintf("Removed %d orphaned clusters from scratch",
+                              num_orphaned_clusters)
+              << std::endl;
+  }
 
   size_t total_num_images = 0;
   for (size_t i = 0; i < leaf_clusters.size(); ++i) {
@@ -155,6 +425,27 @@ void HierarchicalMapperController::Run() {
   std::cout << StringPrintf("Clusters have %d images", total_num_images)
             << std::endl;
 
+  //////////////////////////////////////////////////////////////////////////////
+  // Load database
+  //////////////////////////////////////////////////////////////////////////////
+
+  PrintHeading1("Loading database");
+
+  const int kMaxNumThreads = -1;
+  const int num_eff_threads = GetEffectiveNumThreads(kMaxNumThreads);
+
+  // The database is only loaded once and the workers reconstruct their
+  // clusters from views of the shared cache, which avoids reading the
+  // database and holding the correspondences multiple times.
+  DatabaseCache database_cache;
+  if (!leaf_clusters.empty()) {
+    Database database(options_.database_path);
+    database_cache.Load(database,
+                        static_cast<size_t>(mapper_options_.min_num_matches),
+                        mapper_options_.ignore_watermarks,
+                        std::unordered_set<std::string>(), num_eff_threads);
+  }
+
   //////////////////////////////////////////////////////////////////////////////
   // Reconstruct clusters
   //////////////////////////////////////////////////////////////////////////////
@@ -162,25 +453,27 @@ void HierarchicalMapperController::Run() {
   PrintHeading1("Reconstructing clusters");
 
   // Determine the number of workers and threads per worker.
-  const int kMaxNumThreads = -1;
-  const int num_eff_threads = GetEffectiveNumThreads(kMaxNumThreads);
   const int kDefaultNumWorkers = 8;
   const int num_eff_workers =
       options_.num_workers < 1
-          ? std::min(static_cast<int>(leaf_clusters.size()),
-                     std::min(kDefaultNumWorkers, num_eff_threads))
+          ? std::max(1, std::min(static_cast<int>(leaf_clusters.size()),
+                                 std::min(kDefaultNumWorkers, num_eff_threads)))
           : options_.num_workers;
   const int num_threads_per_worker =
       std::max(1, num_eff_threads / num_eff_workers);
 
   // Function to reconstruct one cluster using incremental mapping.
-  auto ReconstructCluster = [&, this](
-                                const SceneClustering::Cluster& cluster,
-                                ReconstructionManager* reconstruction_manager) {
+  auto ReconstructCluster = [&, this](const SceneClustering::Cluster& cluster) {
+    ReconstructionManager reconstruction_manager;
     if (cluster.image_ids.empty()) {
+      store.Put(cluster_keys.at(&cluster), cluster,
+                std::move(reconstruction_manager));
       return;
     }
 
+    ScopedTraceStage trace_stage("ReconstructCluster");
+    trace_stage.SetArg("num_images", cluster.image_ids.size());
+
     IncrementalMapperOptions custom_options = mapper_options_;
     custom_options.max_model_overlap = 3;
     custom_options.init_num_trials = options_.init_num_trials;
@@ -191,10 +484,13 @@ void HierarchicalMapperController::Run() {
     }
 
     IncrementalMapperController mapper(&custom_options, options_.image_path,
-                                       options_.database_path,
-                                       reconstruction_manager);
+                                       &database_cache,
+                                       &reconstruction_manager);
     mapper.Start();
     mapper.Wait();
+
+    store.Put(cluster_keys.at(&cluster), cluster,
+              std::move(reconstruction_manager));
   };
 
   // Start reconstructing the bigger clusters first for resource usage.
@@ -205,15 +501,9 @@ void HierarchicalMapperController::Run() {
             });
 
   // Start the reconstruction workers.
-
-  std::unordered_map<const SceneClustering::Cluster*, ReconstructionManager>
-      reconstruction_managers;
-  reconstruction_managers.reserve(leaf_clusters.size());
-
   ThreadPool thread_pool(num_eff_workers);
   for (const auto& cluster : leaf_clusters) {
-    thread_pool.AddTask(ReconstructCluster, *cluster,
-                        &reconstruction_managers[cluster]);
+    thread_pool.AddTask(ReconstructCluster, std::cref(*cluster));
   }
   thread_pool.Wait();
 
@@ -223,10 +513,12 @@ void HierarchicalMapperController::Run() {
 
   PrintHeading1("Merging clusters");
 
-  MergeClusters(*scene_clustering.GetRootCluster(), &reconstruction_managers);
+  {
+    COLMAP_TRACE_STAGE("MergeClusters");
+    MergeClusters(root_cluster, cluster_keys, &store);
+  }
 
-  CHECK_EQ(reconstruction_managers.size(), 1);
-  *reconstruction_manager_ = std::move(reconstruction_managers.begin()->second);
+  *reconstruction_manager_ = store.Take(cluster_keys.at(&root_cluster));
 
   std::cout << std::endl;
   GetTimer().PrintMinutes();
@@ -32,6 +32,11 @@
 #ifndef COLMAP_SRC_CONTROLLERS_HIERARCHICAL_MAPPER_H_
 #define COLMAP_SRC_CONTROLLERS_HIERARCHICAL_MAPPER_H_
 
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #include "base/reconstruction_manager.h"
 #include "base/scene_clustering.h"
 #include "controllers/incremental_mapper.h"
@@ -39,6 +44,71 @@
 
 namespace colmap {
 
+// Stores the reconstructions of finished clusters until they are merged into
+// their parent cluster. In the out-of-core mode, the reconstructions are
+// written to a scratch directory in the binary format as soon as a cluster is
+// finished and only the most recently finished ones are kept in memory within
+// the memory budget, while the others are read back when they are merged.
+// The scratch directory also records which clusters were finished, so that an
+// interrupted run can be resumed with the same scratch directory.
+//
+// Clusters are identified by their key, which must be unique among all
+// clusters of the cluster tree, e.g., their path in the tree.
+class ClusterReconstructionStore {
+ public:
+  // The reconstructions are only kept in memory if the scratch path is empty.
+  ClusterReconstructionStore(const std::string& scratch_path,
+                             const size_t max_num_bytes);
+
+  bool IsOutOfCore() const;
+
+  // Check whether the cluster was finished, possibly in a previous run.
+  bool IsFinished(const std::string& key,
+                  const SceneClustering::Cluster& cluster);
+
+  // The number of clusters that were found to be finished in a previous run.
+  size_t NumResumedClusters() const;
+
+  // Delete the scratch data of all clusters, which are not finished or not
+  // needed anymore, since they are not known to be finished by `IsFinished`.
+  // This removes the data of clusters, whose parent cluster finished before
+  // they could be discarded, and of partially written clusters of an
+  // interrupted run. Returns the number of removed clusters.
+  size_t RemoveOrphanedClusters();
+
+  // Store the reconstructions of a finished cluster.
+  void Put(const std::string& key, const SceneClustering::Cluster& cluster,
+           ReconstructionManager reconstruction_manager);
+
+  // Remove and return the reconstructions of a finished cluster.
+  ReconstructionManager Take(const std::string& key);
+
+  // Delete the scratch data of a cluster, whose reconstructions were merged
+  // and whose parent cluster is finished.
+  void Discard(const std::string& key);
+
+  // The number of bytes of the reconstructions currently kept in memory.
+  size_t NumResidentBytes() const;
+
+ private:
+  struct Entry {
+    ReconstructionManager reconstruction_manager;
+    size_t num_bytes = 0;
+    bool resident = false;
+  };
+
+  std::string ClusterPath(const std::string& key) const;
+
+  const std::string scratch_path_;
+  const size_t max_num_bytes_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+  std::list<std::string> resident_keys_;
+  size_t num_resident_bytes_;
+  size_t num_resumed_clusters_;
+};
+
 // Hierarchical mapping first hierarchically partitions the scene into multiple
 // overlapping clusters, then reconstructs them separately using incremental
 // mapping, and finally merges them all into a globally consistent
@@ -59,6 +129,16 @@ class HierarchicalMapperController : public Thread {
     // The number of workers used to reconstruct clusters in parallel.
     int num_workers = -1;
 
+    // Optional scratch directory to which finished cluster reconstructions
+    // are written. If set, only the reconstructions within the cache size
+    // are kept in memory and an interrupted run can be resumed by running it
+    // again with the same scratch directory.
+    std::string scratch_path = "";
+
+    // The maximum memory in gigabytes used by the cluster reconstructions kept
+    // in memory, if a scratch directory is set.
+    double cache_size = 32.0;
+
     bool Check() const;
   };
 
@@ -0,0 +1,230 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "controllers/hierarchical_mapper"
+#include "util/testing.h"
+
+#include "controllers/hierarchical_mapper.h"
+#include "util/misc.h"
+
+using namespace colmap;
+
+namespace {
+
+std::string CreateTemporaryDir() {
+  const std::string path = (boost::filesystem::temp_directory_path() /
+                            boost::filesystem::unique_path())
+                               .string();
+  CreateDirIfNotExists(path);
+  return path;
+}
+
+SceneClustering::Cluster GenerateCluster(const image_t first_image_id,
+                                         const image_t num_images) {
+  SceneClustering::Cluster cluster;
+  for (image_t image_id = first_image_id;
+       image_id < first_image_id + num_images; ++image_id) {
+    cluster.image_ids.push_back(image_id);
+  }
+  return cluster;
+}
+
+// Generate one reconstruction per image of the cluster, each with the image
+// and one point observed by it.
+ReconstructionManager GenerateReconstructions(
+    const SceneClustering::Cluster& cluster) {
+  ReconstructionManager reconstruction_manager;
+  for (const auto image_id : cluster.image_ids) {
+    Reconstruction& reconstruction =
+        reconstruction_manager.Get(reconstruction_manager.Add());
+
+    Camera camera;
+    camera.SetCameraId(1);
+    camera.InitializeWithName("PINHOLE", 1, 1, 1);
+    reconstruction.AddCamera(camera);
+
+    Image image;
+    image.SetImageId(image_id);
+    image.SetCameraId(1);
+    image.SetName("image" + std::to_string(image_id));
+    image.SetPoints2D(std::vector<Eigen::Vector2d>(1, Eigen::Vector2d::Zero()));
+    reconstruction.AddImage(image);
+    reconstruction.RegisterImage(image_id);
+
+    Track track;
+    track.AddElement(image_id, 0);
+    reconstruction.AddPoint3D(Eigen::Vector3d(image_id, 0, 0), track);
+  }
+  return reconstruction_manager;
+}
+
+void CheckReconstructions(const SceneClustering::Cluster& cluster,
+                          const ReconstructionManager& reconstruction_manager) {
+  BOOST_REQUIRE_EQUAL(reconstruction_manager.Size(), cluster.image_ids.size());
+  for (size_t i = 0; i < reconstruction_manager.Size(); ++i) {
+    const Reconstruction& reconstruction = reconstruction_manager.Get(i);
+    BOOST_CHECK_EQUAL(reconstruction.NumImages(), 1);
+    BOOST_CHECK_EQUAL(reconstruction.NumRegImages(), 1);
+    BOOST_CHECK_EQUAL(reconstruction.NumPoints3D(), 1);
+    BOOST_CHECK(reconstruction.ExistsImage(cluster.image_ids[i]));
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestInMemory) {
+  ClusterReconstructionStore store("", 0);
+  BOOST_CHECK(!store.IsOutOfCore());
+
+  const SceneClustering::Cluster cluster1 = GenerateCluster(1, 3);
+  const SceneClustering::Cluster cluster2 = GenerateCluster(4, 2);
+  BOOST_CHECK(!store.IsFinished("_0", cluster1));
+  BOOST_CHECK(!store.IsFinished("_1", cluster2));
+
+  store.Put("_0", cluster1, GenerateReconstructions(cluster1));
+  store.Put("_1", cluster2, GenerateReconstructions(cluster2));
+  BOOST_CHECK(store.IsFinished("_0", cluster1));
+  BOOST_CHECK(store.IsFinished("_1", cluster2));
+  BOOST_CHECK_EQUAL(store.NumResumedClusters(), 0);
+  BOOST_CHECK_GT(store.NumResidentBytes(), 0);
+  BOOST_CHECK_EQUAL(store.RemoveOrphanedClusters(), 0);
+
+  CheckReconstructions(cluster1, store.Take("_0"));
+  BOOST_CHECK(!store.IsFinished("_0", cluster1));
+  BOOST_CHECK_GT(store.NumResidentBytes(), 0);
+  CheckReconstructions(cluster2, store.Take("_1"));
+  BOOST_CHECK(!store.IsFinished("_1", cluster2));
+  BOOST_CHECK_EQUAL(store.NumResidentBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestOutOfCore) {
+  const std::string scratch_path = CreateTemporaryDir();
+
+  const SceneClustering::Cluster cluster1 = GenerateCluster(1, 3);
+  const SceneClustering::Cluster cluster2 = GenerateCluster(4, 2);
+
+  // Keep no reconstructions in memory, such that they are read back from the
+  // scratch directory.
+  ClusterReconstructionStore store(scratch_path, 0);
+  BOOST_CHECK(store.IsOutOfCore());
+  store.Put("_0", cluster1, GenerateReconstructions(cluster1));
+  BOOST_CHECK_EQUAL(store.NumResidentBytes(), 0);
+  BOOST_CHECK(ExistsFile(JoinPaths(scratch_path, "cluster_0", "cluster.txt")));
+  CheckReconstructions(cluster1, store.Take("_0"));
+  store.Discard("_0");
+  BOOST_CHECK(!ExistsDir(JoinPaths(scratch_path, "cluster_0")));
+
+  // Keep the most recently finished reconstructions in memory.
+  const size_t kMaxNumBytes = 1024 * 1024;
+  ClusterReconstructionStore cached_store(scratch_path, kMaxNumBytes);
+  cached_store.Put("_0", cluster1, GenerateReconstructions(cluster1));
+  cached_store.Put("_1", cluster2, GenerateReconstructions(cluster2));
+  const size_t num_resident_bytes = cached_store.NumResidentBytes();
+  BOOST_CHECK_GT(num_resident_bytes, 0);
+  BOOST_CHECK_LE(num_resident_bytes, kMaxNumBytes);
+  CheckReconstructions(cluster2, cached_store.Take("_1"));
+  CheckReconstructions(cluster1, cached_store.Take("_0"));
+  BOOST_CHECK_EQUAL(cached_store.NumResidentBytes(), 0);
+
+  boost::filesystem::remove_all(scratch_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestResume) {
+  const std::string scratch_path = CreateTemporaryDir();
+
+  const SceneClustering::Cluster cluster1 = GenerateCluster(1, 3);
+  const SceneClustering::Cluster cluster2 = GenerateCluster(4, 2);
+
+  {
+    ClusterReconstructionStore store(scratch_path, 0);
+    store.Put("_0", cluster1, GenerateReconstructions(cluster1));
+    store.Put("_1", cluster2, GenerateReconstructions(cluster2));
+  }
+
+  ClusterReconstructionStore store(scratch_path, 0);
+  BOOST_CHECK_EQUAL(store.NumResumedClusters(), 0);
+  BOOST_CHECK(store.IsFinished("_0", cluster1));
+  BOOST_CHECK_EQUAL(store.NumResumedClusters(), 1);
+  BOOST_CHECK(store.IsFinished("_0", cluster1));
+  BOOST_CHECK_EQUAL(store.NumResumedClusters(), 1);
+
+  // A cluster with different images than in the previous run is unfinished.
+  BOOST_CHECK(!store.IsFinished("_1", GenerateCluster(4, 3)));
+  BOOST_CHECK(!store.IsFinished("_2", cluster2));
+  BOOST_CHECK_EQUAL(store.NumResumedClusters(), 1);
+
+  CheckReconstructions(cluster1, store.Take("_0"));
+
+  boost::filesystem::remove_all(scratch_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestRemoveOrphanedClusters) {
+  const std::string scratch_path = CreateTemporaryDir();
+
+  SceneClustering::Cluster cluster = GenerateCluster(1, 4);
+  cluster.child_clusters.push_back(GenerateCluster(1, 2));
+  cluster.child_clusters.push_back(GenerateCluster(3, 2));
+
+  // Simulate a run, which was interrupted after finishing the parent cluster
+  // and before discarding its child clusters.
+  {
+    ClusterReconstructionStore store(scratch_path, 0);
+    store.Put("_0_0", cluster.child_clusters[0],
+              GenerateReconstructions(cluster.child_clusters[0]));
+    store.Put("_0_1", cluster.child_clusters[1],
+              GenerateReconstructions(cluster.child_clusters[1]));
+    store.Put("_0", cluster, GenerateReconstructions(cluster));
+  }
+
+  // Partially written cluster without cluster file.
+  CreateDirIfNotExists(JoinPaths(scratch_path, "cluster_1"));
+  CreateDirIfNotExists(JoinPaths(scratch_path, "cluster_1", "0"));
+
+  // Unrelated files are kept.
+  CreateDirIfNotExists(JoinPaths(scratch_path, "other"));
+  std::ofstream(JoinPaths(scratch_path, "cluster.txt")) << "other";
+
+  ClusterReconstructionStore store(scratch_path, 0);
+  BOOST_CHECK(store.IsFinished("_0", cluster));
+  BOOST_CHECK(!store.IsFinished("_1", GenerateCluster(5, 2)));
+  BOOST_CHECK_EQUAL(store.RemoveOrphanedClusters(), 3);
+  BOOST_CHECK(ExistsDir(JoinPaths(scratch_path, "cluster_0")));
+  BOOST_CHECK(!ExistsDir(JoinPaths(scratch_path, "cluster_0_0")));
+  BOOST_CHECK(!ExistsDir(JoinPaths(scratch_path, "cluster_0_1")));
+  BOOST_CHECK(!ExistsDir(JoinPaths(scratch_path, "cluster_1")));
+  BOOST_CHECK(ExistsDir(JoinPaths(scratch_path, "other")));
+  BOOST_CHECK(ExistsFile(JoinPaths(scratch_path, "cluster.txt")));
+  BOOST_CHECK_EQUAL(store.RemoveOrphanedClusters(), 0);
+
+  CheckReconstructions(cluster, store.Take("_0"));
+
+  boost::filesystem::remove_all(scratch_path);
+}
@@ -32,6 +32,7 @@
 #include "controllers/incremental_mapper.h"
 
 #include "util/misc.h"
+#include "util/trace.h"
 
 namespace colmap {
 namespace {
@@ -75,12 +76,13 @@ void AdjustGlobalBundle(const IncrementalMapperOptions& options,
 }
 
 void IterativeLocalRefinement(const IncrementalMapperOptions& options,
-                              const image_t image_id,
+                              const std::vector<image_t>& image_ids,
                               IncrementalMapper* mapper) {
+  COLMAP_TRACE_SCOPE("IterativeLocalRefinement");
   auto ba_options = options.LocalBundleAdjustment();
   for (int i = 0; i < options.ba_local_max_refinements; ++i) {
     const auto report = mapper->AdjustLocalBundle(
-        options.Mapper(), ba_options, options.Triangulation(), image_id,
+        options.Mapper(), ba_options, options.Triangulation(), image_ids,
         mapper->GetModifiedPoints3D());
     std::cout << "  => Merged observations: " << report.num_merged_observations
               << std::endl;
@@ -106,6 +108,7 @@ void IterativeLocalRefinement(const IncrementalMapperOptions& options,
 
 void IterativeGlobalRefinement(const IncrementalMapperOptions& options,
                                IncrementalMapper* mapper) {
+  COLMAP_TRACE_STAGE("IterativeGlobalRefinement");
   PrintHeading1("Retriangulation");
   CompleteAndMergeTracks(options, mapper);
   std::cout << "  => Retriangulated observations: "
@@ -132,6 +135,7 @@ void IterativeGlobalRefinement(const IncrementalMapperOptions& options,
 
 void ExtractColors(const std::string& image_path, const image_t image_id,
                    Reconstruction* reconstruction) {
+  COLMAP_TRACE_SCOPE("ExtractColors");
   if (!reconstruction->ExtractColorsForImage(image_id, image_path)) {
     std::cout << StringPrintf("WARNING: Could not read image %s at path %s.",
                               reconstruction->Image(image_id).Name().c_str(),
@@ -143,6 +147,7 @@ void ExtractColors(const std::string& image_path, const image_t image_id,
 void WriteSnapshot(const Reconstruction& reconstruction,
                    const std::string& snapshot_path) {
   PrintHeading1("Creating snapshot");
+  COLMAP_TRACE_STAGE("WriteSnapshot");
   // Get the current timestamp in milliseconds.
   const size_t timestamp =
       std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -276,6 +281,7 @@ bool IncrementalMapperOptions::Check() const {
   CHECK_OPTION_GT(max_model_overlap, 0);
   CHECK_OPTION_GE(min_model_size, 0);
   CHECK_OPTION_GT(init_num_trials, 0);
+  CHECK_OPTION_GT(reg_batch_size, 0);
   CHECK_OPTION_GT(min_focal_length_ratio, 0);
   CHECK_OPTION_GT(max_focal_length_ratio, 0);
   CHECK_OPTION_GE(max_extra_param, 0);
@@ -303,6 +309,21 @@ IncrementalMapperController::IncrementalMapperController(
     : options_(options),
       image_path_(image_path),
       database_path_(database_path),
+      shared_database_cache_(nullptr),
+      reconstruction_manager_(reconstruction_manager) {
+  CHECK(options_->Check());
+  RegisterCallback(INITIAL_IMAGE_PAIR_REG_CALLBACK);
+  RegisterCallback(NEXT_IMAGE_REG_CALLBACK);
+  RegisterCallback(LAST_IMAGE_REG_CALLBACK);
+}
+
+IncrementalMapperController::IncrementalMapperController(
+    const IncrementalMapperOptions* options, const std::string& image_path,
+    const DatabaseCache* shared_database_cache,
+    ReconstructionManager* reconstruction_manager)
+    : options_(options),
+      image_path_(image_path),
+      shared_database_cache_(CHECK_NOTNULL(shared_database_cache)),
       reconstruction_manager_(reconstruction_manager) {
   CHECK(options_->Check());
   RegisterCallback(INITIAL_IMAGE_PAIR_REG_CALLBACK);
@@ -311,6 +332,9 @@ IncrementalMapperController::IncrementalMapperController(
 }
 
 void IncrementalMapperController::Run() {
+  COLMAP_TRACE_STAGE("IncrementalMapping");
+  Tracer::Instance().SetThreadName("Incremental mapper");
+
   if (!LoadDatabase()) {
     return;
   }
@@ -344,6 +368,8 @@ void IncrementalMapperController::Run() {
 bool IncrementalMapperController::LoadDatabase() {
   PrintHeading1("Loading database");
 
+  COLMAP_TRACE_STAGE("LoadDatabase");
+
   // Make sure images of the given reconstruction are also included when
   // manually specifying images for the reconstrunstruction procedure.
   std::unordered_set<std::string> image_names = options_->image_names;
@@ -355,12 +381,21 @@ bool IncrementalMapperController::LoadDatabase() {
     }
   }
 
-  Database database(database_path_);
   Timer timer;
   timer.Start();
-  const size_t min_num_matches = static_cast<size_t>(options_->min_num_matches);
-  database_cache_.Load(database, min_num_matches, options_->ignore_watermarks,
-                       image_names);
+  if (shared_database_cache_ != nullptr) {
+    database_cache_.Load(*shared_database_cache_, image_names);
+    std::cout << StringPrintf("Loaded %d images from shared cache",
+                              database_cache_.NumImages())
+              << std::endl;
+  } else {
+    Database database(database_path_);
+    const size_t min_num_matches =
+        static_cast<size_t>(options_->min_num_matches);
+    database_cache_.Load(database, min_num_matches,
+                         options_->ignore_watermarks, image_names,
+                         options_->num_threads);
+  }
   std::cout << std::endl;
   timer.PrintMinutes();
 
@@ -509,24 +544,54 @@ void IncrementalMapperController::Reconstruct(
         break;
       }
 
-      for (size_t reg_trial = 0; reg_trial < next_images.size(); ++reg_trial) {
-        const image_t next_image_id = next_images[reg_trial];
-        const Image& next_image = reconstruction.Image(next_image_id);
+      const size_t reg_batch_size =
+          static_cast<size_t>(options_->reg_batch_size);
+      for (size_t reg_trial = 0; reg_trial < next_images.size();
+           reg_trial += reg_batch_size) {
+        const size_t batch_end =
+            std::min(reg_trial + reg_batch_size, next_images.size());
+        const std::vector<image_t> batch_image_ids(
+            next_images.begin() + reg_trial, next_images.begin() + batch_end);
+
+        std::vector<image_t> reg_image_ids;
+        if (batch_image_ids.size() == 1) {
+          const image_t next_image_id = batch_image_ids[0];
+          const Image& next_image = reconstruction.Image(next_image_id);
+
+          PrintHeading1(StringPrintf("Registering image #%d (%d)",
+                                     next_image_id,
+                                     reconstruction.NumRegImages() + 1));
+
+          std::cout << StringPrintf("  => Image sees %d / %d points",
+                                    next_image.NumVisiblePoints3D(),
+                                    next_image.NumObservations())
+                    << std::endl;
+
+          if (mapper.RegisterNextImage(options_->Mapper(), next_image_id)) {
+            reg_image_ids.push_back(next_image_id);
+          }
+        } else {
+          PrintHeading1(StringPrintf("Registering %d images (%d)",
+                                     batch_image_ids.size(),
+                                     reconstruction.NumRegImages() + 1));
 
-        PrintHeading1(StringPrintf("Registering image #%d (%d)", next_image_id,
-                                   reconstruction.NumRegImages() + 1));
+          reg_image_ids =
+              mapper.RegisterNextImages(options_->Mapper(), batch_image_ids);
 
-        std::cout << StringPrintf("  => Image sees %d / %d points",
-                                  next_image.NumVisiblePoints3D(),
-                                  next_image.NumObservations())
-                  << std::endl;
+          std::cout << StringPrintf("  => Registered %d / %d images",
+                                    reg_image_ids.size(),
+                                    batch_image_ids.size())
+                    << std::endl;
+        }
 
-        reg_next_success =
-            mapper.RegisterNextImage(options_->Mapper(), next_image_id);
+        reg_next_success = !reg_image_ids.empty();
 
         if (reg_next_success) {
-          TriangulateImage(*options_, next_image, &mapper);
-          IterativeLocalRefinement(*options_, next_image_id, &mapper);
+          for (const image_t image_id : reg_image_ids) {
+            TriangulateImage(*options_, reconstruction.Image(image_id),
+                             &mapper);
+          }
+          IterativeLocalRefinement(*options_, reg_image_ids, &mapper);
 
           if (reconstruction.NumRegImages() >=
                   options_->ba_global_images_ratio * ba_prev_num_reg_images ||
@@ -542,7 +607,9 @@ void IncrementalMapperController::Reconstruct(
           }
 
           if (options_->extract_colors) {
-            ExtractColors(image_path_, next_image_id, &reconstruction);
+            for (const image_t image_id : reg_image_ids) {
+              ExtractColors(image_path_, image_id, &reconstruction);
+            }
           }
 
           if (options_->snapshot_images_freq > 0 &&
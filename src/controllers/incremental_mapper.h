@@ -70,6 +70,12 @@ struct IncrementalMapperOptions {
   // The number of trials to initialize the reconstruction.
   int init_num_trials = 200;
 
+  // The maximum number of next images to register as a batch. The poses of
+  // a batch are estimated in parallel and the registered images are refined
+  // in a single local bundle adjustment. Larger batches speed up large and
+  // well connected scenes at the cost of less frequent refinement.
+  int reg_batch_size = 1;
+
   // Whether to extract colors for reconstructed points.
   bool extract_colors = true;
 
@@ -166,6 +172,14 @@ class IncrementalMapperController : public Thread {
                               const std::string& database_path,
                               ReconstructionManager* reconstruction_manager);
 
+  // Reconstruct the images in `options->image_names` from an already loaded
+  // database cache instead of loading them from the database. The cache is
+  // only read and can be shared by multiple controllers running in parallel.
+  IncrementalMapperController(const IncrementalMapperOptions* options,
+                              const std::string& image_path,
+                              const DatabaseCache* shared_database_cache,
+                              ReconstructionManager* reconstruction_manager);
+
  private:
   void Run();
   bool LoadDatabase();
@@ -174,6 +188,7 @@ class IncrementalMapperController : public Thread {
   const IncrementalMapperOptions* options_;
   const std::string image_path_;
   const std::string database_path_;
+  const DatabaseCache* shared_database_cache_;
   ReconstructionManager* reconstruction_manager_;
   DatabaseCache database_cache_;
 };
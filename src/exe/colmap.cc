@@ -36,6 +36,7 @@
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include "base/lazy_reconstruction.h"
 #include "base/similarity_transform.h"
 #include "controllers/automatic_reconstruction.h"
 #include "controllers/bundle_adjustment.h"
@@ -49,6 +50,7 @@
 #include "retrieval/visual_index.h"
 #include "ui/main_window.h"
 #include "util/opengl_utils.h"
+#include "util/trace.h"
 #include "util/version.h"
 
 using namespace colmap;
@@ -260,6 +262,37 @@ int RunDatabaseMerger(int argc, char** argv) {
   return EXIT_SUCCESS;
 }
 
+int RunFeatureStoreConverter(int argc, char** argv) {
+  std::string output_type;
+
+  OptionManager options;
+  options.AddDatabaseOptions();
+  options.AddRequiredOption("output_type", &output_type, "{STORE, SQLITE}");
+  options.Parse(argc, argv);
+
+  Database database(*options.database_path);
+
+  StringToLower(&output_type);
+  if (output_type == "store") {
+    if (database.HasFeatureStore()) {
+      std::cout << "Database already uses a feature store." << std::endl;
+      return EXIT_SUCCESS;
+    }
+    database.MoveFeaturesToFeatureStore();
+  } else if (output_type == "sqlite") {
+    if (!database.HasFeatureStore()) {
+      std::cout << "Database does not use a feature store." << std::endl;
+      return EXIT_SUCCESS;
+    }
+    database.MoveFeaturesToSQLite();
+  } else {
+    std::cerr << "ERROR: Invalid `output_type`" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
 int RunStereoFuser(int argc, char** argv) {
   std::string workspace_path;
   std::string input_type = "geometric";
@@ -392,12 +425,6 @@ int RunDelaunayMesher(int argc, char** argv) {
 }
 
 int RunPatchMatchStereo(int argc, char** argv) {
-#ifndef CUDA_ENABLED
-  std::cerr << "ERROR: Dense stereo reconstruction requires CUDA, which is not "
-               "available on your system."
-            << std::endl;
-  return EXIT_FAILURE;
-#else   // CUDA_ENABLED
   std::string workspace_path;
   std::string workspace_format = "COLMAP";
   std::string pmvs_option_name = "option-all";
@@ -428,7 +455,6 @@ int RunPatchMatchStereo(int argc, char** argv) {
   controller.Wait();
 
   return EXIT_SUCCESS;
-#endif  // CUDA_ENABLED
 }
 
 int RunExhaustiveMatcher(int argc, char** argv) {
@@ -783,7 +809,8 @@ int RunImageRegistrator(int argc, char** argv) {
         static_cast<size_t>(options.mapper->min_num_matches);
     database_cache.Load(database, min_num_matches,
                         options.mapper->ignore_watermarks,
-                        options.mapper->image_names);
+                        options.mapper->image_names,
+                        options.mapper->num_threads);
     std::cout << std::endl;
     timer.PrintMinutes();
   }
@@ -825,6 +852,7 @@ int RunImageUndistorter(int argc, char** argv) {
   std::string input_path;
   std::string output_path;
   std::string output_type = "COLMAP";
+  std::string image_list_path;
 
   UndistortCameraOptions undistort_camera_options;
 
@@ -834,6 +862,7 @@ int RunImageUndistorter(int argc, char** argv) {
   options.AddRequiredOption("output_path", &output_path);
   options.AddDefaultOption("output_type", &output_type,
                            "{COLMAP, PMVS, CMP-MVS}");
+  options.AddDefaultOption("image_list_path", &image_list_path);
   options.AddDefaultOption("blank_pixels",
                            &undistort_camera_options.blank_pixels);
   options.AddDefaultOption("min_scale", &undistort_camera_options.min_scale);
@@ -849,7 +878,30 @@ int RunImageUndistorter(int argc, char** argv) {
   CreateDirIfNotExists(output_path);
 
   Reconstruction reconstruction;
-  reconstruction.Read(input_path);
+  if (image_list_path.empty()) {
+    reconstruction.Read(input_path);
+  } else {
+    if (!LazyReconstruction::Exists(input_path)) {
+      std::cerr << "ERROR: `image_list_path` requires a binary model"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Only read the listed images and the 3D points observed by them.
+    const LazyReconstruction lazy_reconstruction(input_path);
+    const auto image_names = ReadTextFileLines(image_list_path);
+    const std::unordered_set<std::string> image_name_set(image_names.begin(),
+                                                         image_names.end());
+    std::vector<image_t> image_ids;
+    for (const auto image_id : lazy_reconstruction.RegImageIds()) {
+      const auto image = lazy_reconstruction.ImageHeader(image_id);
+      if (image_name_set.count(image.Name()) > 0) {
+        image_ids.push_back(image_id);
+      }
+    }
+
+    lazy_reconstruction.ReadSubset(image_ids, &reconstruction);
+  }
 
   std::unique_ptr<Thread> undistorter;
   if (output_type == "COLMAP") {
@@ -1049,6 +1101,9 @@ int RunHierarchicalMapper(int argc, char** argv) {
   options.AddRequiredOption("image_path", &hierarchical_options.image_path);
   options.AddRequiredOption("output_path", &output_path);
   options.AddDefaultOption("num_workers", &hierarchical_options.num_workers);
+  options.AddDefaultOption("scratch_path",
+                           &hierarchical_options.scratch_path);
+  options.AddDefaultOption("cache_size", &hierarchical_options.cache_size);
   options.AddDefaultOption("image_overlap", &clustering_options.image_overlap);
   options.AddDefaultOption("leaf_max_num_images",
                            &clustering_options.leaf_max_num_images);
@@ -1196,16 +1251,8 @@ int RunModelAligner(int argc, char** argv) {
   return EXIT_SUCCESS;
 }
 
-int RunModelAnalyzer(int argc, char** argv) {
-  std::string path;
-
-  OptionManager options;
-  options.AddRequiredOption("path", &path);
-  options.Parse(argc, argv);
-
-  Reconstruction reconstruction;
-  reconstruction.Read(path);
-
+template <typename ReconstructionType>
+void PrintModelStatistics(const ReconstructionType& reconstruction) {
   std::cout << StringPrintf("Cameras: %d", reconstruction.NumCameras())
             << std::endl;
   std::cout << StringPrintf("Images: %d", reconstruction.NumImages())
@@ -1227,6 +1274,23 @@ int RunModelAnalyzer(int argc, char** argv) {
   std::cout << StringPrintf("Mean reprojection error: %fpx",
                             reconstruction.ComputeMeanReprojectionError())
             << std::endl;
+}
+
+int RunModelAnalyzer(int argc, char** argv) {
+  std::string path;
+
+  OptionManager options;
+  options.AddRequiredOption("path", &path);
+  options.Parse(argc, argv);
+
+  // Binary models are analyzed without reading the images.
+  if (LazyReconstruction::Exists(path)) {
+    PrintModelStatistics(LazyReconstruction(path));
+  } else {
+    Reconstruction reconstruction;
+    reconstruction.Read(path);
+    PrintModelStatistics(reconstruction);
+  }
 
   return EXIT_SUCCESS;
 }
@@ -1243,10 +1307,21 @@ int RunModelConverter(int argc, char** argv) {
                             "{BIN, TXT, NVM, Bundler, VRML, PLY}");
   options.Parse(argc, argv);
 
+  StringToLower(&output_type);
+
+  // Binary models are exported to PLY without reading the images.
+  if (output_type == "ply" && LazyReconstruction::Exists(input_path)) {
+    const bool kWriteNormal = false;
+    const bool kWriteRGB = true;
+    WriteBinaryPlyPoints(output_path,
+                         LazyReconstruction(input_path).ConvertToPLY(),
+                         kWriteNormal, kWriteRGB);
+    return EXIT_SUCCESS;
+  }
+
   Reconstruction reconstruction;
   reconstruction.Read(input_path);
 
-  StringToLower(&output_type);
   if (output_type == "bin") {
     reconstruction.WriteBinary(output_path);
   } else if (output_type == "txt") {
@@ -1492,7 +1567,8 @@ int RunPointTriangulator(int argc, char** argv) {
         static_cast<size_t>(mapper_options.min_num_matches);
     database_cache.Load(database, min_num_matches,
                         mapper_options.ignore_watermarks,
-                        mapper_options.image_names);
+                        mapper_options.image_names,
+                        mapper_options.num_threads);
 
     if (clear_points) {
       reconstruction.DeleteAllPoints2DAndPoints3D();
@@ -2121,6 +2197,7 @@ int main(int argc, char** argv) {
   commands.emplace_back("exhaustive_matcher", &RunExhaustiveMatcher);
   commands.emplace_back("feature_extractor", &RunFeatureExtractor);
   commands.emplace_back("feature_importer", &RunFeatureImporter);
+  commands.emplace_back("feature_store_converter", &RunFeatureStoreConverter);
   commands.emplace_back("hierarchical_mapper", &RunHierarchicalMapper);
   commands.emplace_back("image_deleter", &RunImageDeleter);
   commands.emplace_back("image_filterer", &RunImageFilterer);
@@ -2177,7 +2254,10 @@ int main(int argc, char** argv) {
       int command_argc = argc - 1;
       char** command_argv = &argv[1];
       command_argv[0] = argv[0];
-      return matched_command_func(command_argc, command_argv);
+      const int return_code = matched_command_func(command_argc, command_argv);
+      // Write the trace, if enabled through the `trace_path` option.
+      Tracer::Instance().Stop();
+      return return_code;
     }
   }
 
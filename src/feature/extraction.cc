@@ -32,11 +32,13 @@
 #include "feature/extraction.h"
 
 #include <numeric>
+#include <queue>
 
 #include "SiftGPU/SiftGPU.h"
 #include "feature/sift.h"
 #include "util/cuda.h"
 #include "util/misc.h"
+#include "util/trace.h"
 
 namespace colmap {
 namespace {
@@ -87,7 +89,11 @@ SiftFeatureExtractor::SiftFeatureExtractor(
     : reader_options_(reader_options),
       sift_options_(sift_options),
       database_(reader_options_.database_path),
-      image_reader_(reader_options_, &database_) {
+      image_reader_(reader_options_, &database_),
+      prev_num_read_images_(0),
+      prev_num_resized_images_(0),
+      prev_num_extracted_images_(0),
+      prev_num_written_images_(0) {
   CHECK(reader_options_.Check());
   CHECK(sift_options_.Check());
 
@@ -106,18 +112,21 @@ SiftFeatureExtractor::SiftFeatureExtractor(
   const int num_threads = GetEffectiveNumThreads(sift_options_.num_threads);
   CHECK_GT(num_threads, 0);
 
-  // Make sure that we only have limited number of objects in the queue to avoid
-  // excess in memory usage since images and features take lots of memory.
-  const int kQueueSize = 1;
-  resizer_queue_.reset(new JobQueue<internal::ImageData>(kQueueSize));
-  extractor_queue_.reset(new JobQueue<internal::ImageData>(kQueueSize));
-  writer_queue_.reset(new JobQueue<internal::ImageData>(kQueueSize));
+  // The decoded images take lots of memory, so that their total size in the
+  // resizer and extractor queues is limited by the memory budget instead of
+  // limiting the number of queued images. The extracted features are much
+  // smaller and the writer is fast, so that a few queued images suffice.
+  memory_budget_.reset(new internal::MemoryBudget(
+      static_cast<size_t>(sift_options_.max_image_buffer_mb) * 1024 * 1024));
+  resizer_queue_.reset(new JobQueue<internal::ImageData>());
+  extractor_queue_.reset(new JobQueue<internal::ImageData>());
+  writer_queue_.reset(new JobQueue<internal::ImageData>(num_threads));
 
   if (sift_options_.max_image_size > 0) {
     for (int i = 0; i < num_threads; ++i) {
       resizers_.emplace_back(new internal::ImageResizerThread(
-          sift_options_.max_image_size, resizer_queue_.get(),
-          extractor_queue_.get()));
+          sift_options_.max_image_size, memory_budget_.get(),
+          resizer_queue_.get(), extractor_queue_.get()));
     }
   }
 
@@ -139,16 +148,16 @@ SiftFeatureExtractor::SiftFeatureExtractor(
     for (const auto& gpu_index : gpu_indices) {
       sift_gpu_options.gpu_index = std::to_string(gpu_index);
       extractors_.emplace_back(new internal::SiftFeatureExtractorThread(
-          sift_gpu_options, camera_mask, extractor_queue_.get(),
-          writer_queue_.get()));
+          sift_gpu_options, camera_mask, memory_budget_.get(),
+          extractor_queue_.get(), writer_queue_.get()));
     }
   } else {
     auto custom_sift_options = sift_options_;
     custom_sift_options.use_gpu = false;
     for (int i = 0; i < num_threads; ++i) {
       extractors_.emplace_back(new internal::SiftFeatureExtractorThread(
-          custom_sift_options, camera_mask, extractor_queue_.get(),
-          writer_queue_.get()));
+          custom_sift_options, camera_mask, memory_budget_.get(),
+          extractor_queue_.get(), writer_queue_.get()));
     }
   }
 
@@ -159,6 +168,9 @@ SiftFeatureExtractor::SiftFeatureExtractor(
 void SiftFeatureExtractor::Run() {
   PrintHeading1("Feature extraction");
 
+  COLMAP_TRACE_STAGE("FeatureExtraction");
+  Tracer::Instance().SetThreadName("Feature extraction");
+
   for (auto& resizer : resizers_) {
     resizer->Start();
   }
@@ -175,6 +187,22 @@ void SiftFeatureExtractor::Run() {
     }
   }
 
+  // Decode the images ahead of time in parallel, while the camera assignment
+  // by the image reader must run sequentially in the order of the images. The
+  // number of images decoded ahead is limited, since their memory is only
+  // accounted in the memory budget once they are read in order.
+  const int num_decoder_threads =
+      GetEffectiveNumThreads(sift_options_.num_threads);
+  ThreadPool decoder_pool(num_decoder_threads);
+  const size_t max_num_decoding_images = 2 * decoder_pool.NumThreads();
+  std::queue<std::future<internal::ImageData>> decoding_images;
+  size_t next_decode_index = 0;
+
+  // Report the pipeline status at regular intervals in addition to the
+  // per-image output of the writer.
+  const double kStatusIntervalSeconds = 10.0;
+  status_timer_.Start();
+
   while (image_reader_.NextIndex() < image_reader_.NumImages()) {
     if (IsStopped()) {
       resizer_queue_->Stop();
@@ -184,13 +212,46 @@ void SiftFeatureExtractor::Run() {
       break;
     }
 
-    internal::ImageData image_data;
-    image_data.status =
-        image_reader_.Next(&image_data.camera, &image_data.image,
-                           &image_data.bitmap, &image_data.mask);
+    while (next_decode_index < image_reader_.NumImages() &&
+           decoding_images.size() < max_num_decoding_images) {
+      const size_t image_index = next_decode_index;
+      const bool exists_features = image_reader_.ExistsFeatures(image_index);
+      decoding_images.push(decoder_pool.AddTask(
+          [this, image_index, exists_features]() {
+            internal::ImageData image_data;
+            if (exists_features) {
+              // The image reader skips the image without decoding it.
+              image_data.status = ImageReader::Status::IMAGE_EXISTS;
+            } else {
+              COLMAP_TRACE_SCOPE("DecodeImage");
+              image_data.status = image_reader_.Decode(
+                  image_index, &image_data.bitmap, &image_data.mask);
+            }
+            return image_data;
+          }));
+      next_decode_index += 1;
+    }
+
+    internal::ImageData image_data = decoding_images.front().get();
+    decoding_images.pop();
+
+    {
+      COLMAP_TRACE_SCOPE("ReadImage");
+      image_data.status = image_reader_.NextDecoded(
+          image_data.status, &image_data.camera, &image_data.image,
+          &image_data.bitmap, &image_data.mask);
+    }
 
     if (image_data.status != ImageReader::Status::SUCCESS) {
       image_data.bitmap.Deallocate();
+      image_data.mask.Deallocate();
+    }
+
+    {
+      COLMAP_TRACE_SCOPE("WaitForMemory");
+      image_data.num_bytes =
+          image_data.bitmap.NumBytes() + image_data.mask.NumBytes();
+      memory_budget_->Acquire(image_data.num_bytes);
     }
 
     if (sift_options_.max_image_size > 0) {
@@ -198,8 +259,14 @@ void SiftFeatureExtractor::Run() {
     } else {
       CHECK(extractor_queue_->Push(image_data));
     }
+
+    if (status_timer_.ElapsedSeconds() >= kStatusIntervalSeconds) {
+      PrintPipelineStatus(image_reader_.NextIndex());
+    }
   }
 
+  decoder_pool.Stop();
+
   resizer_queue_->Wait();
   resizer_queue_->Stop();
   for (auto& resizer : resizers_) {
@@ -219,6 +286,48 @@ void SiftFeatureExtractor::Run() {
   GetTimer().PrintMinutes();
 }
 
+void SiftFeatureExtractor::PrintPipelineStatus(const size_t num_read_images) {
+  size_t num_resized_images = 0;
+  for (const auto& resizer : resizers_) {
+    num_resized_images += resizer->NumProcessedImages();
+  }
+
+  size_t num_extracted_images = 0;
+  for (const auto& extractor : extractors_) {
+    num_extracted_images += extractor->NumProcessedImages();
+  }
+
+  const size_t num_written_images = writer_->NumProcessedImages();
+
+  const double elapsed_seconds = status_timer_.ElapsedSeconds();
+  const auto Throughput = [elapsed_seconds](const size_t num_images,
+                                            const size_t prev_num_images) {
+    return (num_images - prev_num_images) / elapsed_seconds;
+  };
+
+  // Print everything at once to not interleave with the writer output.
+  std::string status = StringPrintf(
+      "Pipeline throughput [images/s]: read %.1f, resize %.1f, extract %.1f, "
+      "write %.1f\n",
+      Throughput(num_read_images, prev_num_read_images_),
+      Throughput(num_resized_images, prev_num_resized_images_),
+      Throughput(num_extracted_images, prev_num_extracted_images_),
+      Throughput(num_written_images, prev_num_written_images_));
+  status += StringPrintf(
+      "Pipeline queues [images]: resize %d, extract %d, write %d "
+      "(decoded images: %d / %d MB)\n",
+      resizer_queue_->Size(), extractor_queue_->Size(), writer_queue_->Size(),
+      memory_budget_->NumBytes() / (1024 * 1024),
+      memory_budget_->MaxNumBytes() / (1024 * 1024));
+  std::cout << status << std::flush;
+
+  prev_num_read_images_ = num_read_images;
+  prev_num_resized_images_ = num_resized_images;
+  prev_num_extracted_images_ = num_extracted_images;
+  prev_num_written_images_ = num_written_images;
+  status_timer_.Restart();
+}
+
 FeatureImporter::FeatureImporter(const ImageReaderOptions& reader_options,
                                  const std::string& import_path)
     : reader_options_(reader_options), import_path_(import_path) {}
@@ -285,14 +394,50 @@ void FeatureImporter::Run() {
 
 namespace internal {
 
+MemoryBudget::MemoryBudget(const size_t max_num_bytes)
+    : max_num_bytes_(max_num_bytes), num_bytes_(0) {}
+
+void MemoryBudget::Acquire(const size_t num_bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (num_bytes_ > 0 && num_bytes_ + num_bytes > max_num_bytes_) {
+    release_condition_.wait(lock);
+  }
+  num_bytes_ += num_bytes;
+}
+
+void MemoryBudget::Release(const size_t num_bytes) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    CHECK_LE(num_bytes, num_bytes_);
+    num_bytes_ -= num_bytes;
+  }
+  release_condition_.notify_all();
+}
+
+size_t MemoryBudget::NumBytes() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return num_bytes_;
+}
+
+size_t MemoryBudget::MaxNumBytes() const { return max_num_bytes_; }
+
 ImageResizerThread::ImageResizerThread(const int max_image_size,
+                                       MemoryBudget* memory_budget,
                                        JobQueue<ImageData>* input_queue,
                                        JobQueue<ImageData>* output_queue)
     : max_image_size_(max_image_size),
+      memory_budget_(memory_budget),
       input_queue_(input_queue),
-      output_queue_(output_queue) {}
+      output_queue_(output_queue),
+      num_processed_images_(0) {}
+
+size_t ImageResizerThread::NumProcessedImages() const {
+  return num_processed_images_;
+}
 
 void ImageResizerThread::Run() {
+  Tracer::Instance().SetThreadName("Image resizer");
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -303,6 +448,7 @@ void ImageResizerThread::Run() {
       auto image_data = input_job.Data();
 
       if (image_data.status == ImageReader::Status::SUCCESS) {
+        COLMAP_TRACE_SCOPE("ResizeImage");
         if (static_cast<int>(image_data.bitmap.Width()) > max_image_size_ ||
             static_cast<int>(image_data.bitmap.Height()) > max_image_size_) {
           // Fit the down-sampled version exactly into the max dimensions.
@@ -315,9 +461,19 @@ void ImageResizerThread::Run() {
               static_cast<int>(image_data.bitmap.Height() * scale);
 
           image_data.bitmap.Rescale(new_width, new_height);
+
+          // Return the memory of the down-sampled pixels to the budget.
+          const size_t num_bytes =
+              image_data.bitmap.NumBytes() + image_data.mask.NumBytes();
+          if (num_bytes < image_data.num_bytes) {
+            memory_budget_->Release(image_data.num_bytes - num_bytes);
+            image_data.num_bytes = num_bytes;
+          }
         }
       }
 
+      num_processed_images_ += 1;
+
       output_queue_->Push(image_data);
     } else {
       break;
@@ -327,12 +483,14 @@ void ImageResizerThread::Run() {
 
 SiftFeatureExtractorThread::SiftFeatureExtractorThread(
     const SiftExtractionOptions& sift_options,
-    const std::shared_ptr<Bitmap>& camera_mask,
+    const std::shared_ptr<Bitmap>& camera_mask, MemoryBudget* memory_budget,
     JobQueue<ImageData>* input_queue, JobQueue<ImageData>* output_queue)
     : sift_options_(sift_options),
       camera_mask_(camera_mask),
+      memory_budget_(memory_budget),
       input_queue_(input_queue),
-      output_queue_(output_queue) {
+      output_queue_(output_queue),
+      num_processed_images_(0) {
   CHECK(sift_options_.Check());
 
 #ifndef CUDA_ENABLED
@@ -342,6 +500,10 @@ SiftFeatureExtractorThread::SiftFeatureExtractorThread(
 #endif
 }
 
+size_t SiftFeatureExtractorThread::NumProcessedImages() const {
+  return num_processed_images_;
+}
+
 void SiftFeatureExtractorThread::Run() {
   std::unique_ptr<SiftGPU> sift_gpu;
   if (sift_options_.use_gpu) {
@@ -360,6 +522,8 @@ void SiftFeatureExtractorThread::Run() {
 
   SignalValidSetup();
 
+  Tracer::Instance().SetThreadName("Feature extractor");
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -370,6 +534,7 @@ void SiftFeatureExtractorThread::Run() {
       auto image_data = input_job.Data();
 
       if (image_data.status == ImageReader::Status::SUCCESS) {
+        COLMAP_TRACE_SCOPE("ExtractFeatures");
         bool success = false;
         if (sift_options_.estimate_affine_shape ||
             sift_options_.domain_size_pooling) {
@@ -401,7 +566,14 @@ void SiftFeatureExtractorThread::Run() {
         }
       }
 
+      // The writer only needs the features, so that the memory of the bitmap
+      // and mask can be released here.
       image_data.bitmap.Deallocate();
+      image_data.mask.Deallocate();
+      memory_budget_->Release(image_data.num_bytes);
+      image_data.num_bytes = 0;
+
+      num_processed_images_ += 1;
 
       output_queue_->Push(image_data);
     } else {
@@ -412,17 +584,44 @@ void SiftFeatureExtractorThread::Run() {
 
 FeatureWriterThread::FeatureWriterThread(const size_t num_images,
                                          Database* database,
-                                         JobQueue<ImageData>* input_queue)
-    : num_images_(num_images), database_(database), input_queue_(input_queue) {}
+                                         JobQueue<ImageData>* input_queue,
+                                         const size_t max_batch_size,
+                                         const double max_batch_seconds)
+    : num_images_(num_images),
+      database_(database),
+      input_queue_(input_queue),
+      max_batch_size_(max_batch_size),
+      max_batch_seconds_(max_batch_seconds),
+      num_processed_images_(0) {
+  CHECK_GT(max_batch_size_, 0);
+  CHECK_GE(max_batch_seconds_, 0);
+}
+
+size_t FeatureWriterThread::NumProcessedImages() const {
+  return num_processed_images_;
+}
 
 void FeatureWriterThread::Run() {
+  Tracer::Instance().SetThreadName("Feature writer");
+
+  // Commit the features after the maximum number of images or, if the images
+  // arrive slowly, after the maximum time to limit the work lost on
+  // interruption.
+  std::vector<ImageData> batch;
+  Timer batch_timer;
+
   size_t image_index = 0;
   while (true) {
     if (IsStopped()) {
       break;
     }
 
-    auto input_job = input_queue_->Pop();
+    // Wait for the next image at most until the pending batch is due.
+    auto input_job =
+        batch.empty()
+            ? input_queue_->Pop()
+            : input_queue_->Pop(std::max(
+                  0.0, max_batch_seconds_ - batch_timer.ElapsedSeconds()));
     if (input_job.IsValid()) {
       auto& image_data = input_job.Data();
 
@@ -458,6 +657,7 @@ void FeatureWriterThread::Run() {
       }
 
       if (image_data.status != ImageReader::Status::SUCCESS) {
+        num_processed_images_ += 1;
         continue;
       }
 
@@ -488,8 +688,37 @@ void FeatureWriterThread::Run() {
                                 image_data.keypoints.size())
                 << std::endl;
 
-      DatabaseTransaction database_transaction(database_);
+      if (batch.empty()) {
+        batch_timer.Restart();
+      }
+
+      batch.push_back(std::move(image_data));
+
+      if (batch.size() >= max_batch_size_ ||
+          batch_timer.ElapsedSeconds() >= max_batch_seconds_) {
+        WriteBatch(&batch);
+      }
+    } else if (input_queue_->IsStopped()) {
+      break;
+    } else {
+      WriteBatch(&batch);
+    }
+  }
+
+  WriteBatch(&batch);
+}
 
+void FeatureWriterThread::WriteBatch(std::vector<ImageData>* batch) {
+  if (batch->empty()) {
+    return;
+  }
+
+  COLMAP_TRACE_SCOPE("WriteFeatures");
+
+  {
+    DatabaseTransaction database_transaction(database_);
+
+    for (auto& image_data : *batch) {
       if (image_data.image.ImageId() == kInvalidImageId) {
         image_data.image.SetImageId(database_->WriteImage(image_data.image));
       }
@@ -503,10 +732,11 @@ void FeatureWriterThread::Run() {
         database_->WriteDescriptors(image_data.image.ImageId(),
                                     image_data.descriptors);
       }
-    } else {
-      break;
     }
   }
+
+  num_processed_images_ += batch->size();
+  batch->clear();
 }
 
 }  // namespace internal
@@ -37,16 +37,28 @@
 #include "feature/sift.h"
 #include "util/opengl_utils.h"
 #include "util/threading.h"
+#include "util/timer.h"
 
 namespace colmap {
 
 namespace internal {
 
 struct ImageData;
+class MemoryBudget;
+class ImageResizerThread;
+class SiftFeatureExtractorThread;
+class FeatureWriterThread;
 
 }  // namespace internal
 
 // Feature extraction class to extract features for all images in a directory.
+//
+// The images are decoded in parallel by a pool of decoder threads, while the
+// camera assignment and database lookups of the image reader run sequentially
+// in the order of the images. The decoded images are then resized, their
+// features extracted, and finally written to the database in batches. The
+// memory of the decoded images buffered between the stages is bounded by
+// `SiftExtractionOptions::max_image_buffer_mb`.
 class SiftFeatureExtractor : public Thread {
  public:
   SiftFeatureExtractor(const ImageReaderOptions& reader_options,
@@ -55,19 +67,33 @@ class SiftFeatureExtractor : public Thread {
  private:
   void Run();
 
+  // Print the throughput of all pipeline stages since the last report and the
+  // number of images waiting in front of every stage.
+  void PrintPipelineStatus(const size_t num_read_images);
+
   const ImageReaderOptions reader_options_;
   const SiftExtractionOptions sift_options_;
 
   Database database_;
   ImageReader image_reader_;
 
-  std::vector<std::unique_ptr<Thread>> resizers_;
-  std::vector<std::unique_ptr<Thread>> extractors_;
-  std::unique_ptr<Thread> writer_;
+  std::unique_ptr<internal::MemoryBudget> memory_budget_;
+
+  std::vector<std::unique_ptr<internal::ImageResizerThread>> resizers_;
+  std::vector<std::unique_ptr<internal::SiftFeatureExtractorThread>>
+      extractors_;
+  std::unique_ptr<internal::FeatureWriterThread> writer_;
 
   std::unique_ptr<JobQueue<internal::ImageData>> resizer_queue_;
   std::unique_ptr<JobQueue<internal::ImageData>> extractor_queue_;
   std::unique_ptr<JobQueue<internal::ImageData>> writer_queue_;
+
+  // Number of processed images per stage and time of the last status report.
+  Timer status_timer_;
+  size_t prev_num_read_images_;
+  size_t prev_num_resized_images_;
+  size_t prev_num_extracted_images_;
+  size_t prev_num_written_images_;
 };
 
 // Import features from text files. Each image must have a corresponding text
@@ -100,29 +126,68 @@ struct ImageData {
 
   FeatureKeypoints keypoints;
   FeatureDescriptors descriptors;
+
+  // Number of bytes of the bitmap and mask reserved in the memory budget.
+  size_t num_bytes = 0;
+};
+
+// Bounds the memory of the decoded images in the pipeline. In contrast to a
+// bound on the number of queued images, this adapts to the image resolution,
+// so that many small images can be buffered while few large images do not
+// exhaust the available memory.
+class MemoryBudget {
+ public:
+  explicit MemoryBudget(const size_t max_num_bytes);
+
+  // Reserve the given number of bytes and wait until they are available. An
+  // image larger than the budget passes once all other memory is released.
+  void Acquire(const size_t num_bytes);
+
+  // Release previously reserved bytes.
+  void Release(const size_t num_bytes);
+
+  // The number of currently reserved bytes.
+  size_t NumBytes();
+
+  size_t MaxNumBytes() const;
+
+ private:
+  const size_t max_num_bytes_;
+  size_t num_bytes_;
+  std::mutex mutex_;
+  std::condition_variable release_condition_;
 };
 
 class ImageResizerThread : public Thread {
  public:
-  ImageResizerThread(const int max_image_size, JobQueue<ImageData>* input_queue,
+  ImageResizerThread(const int max_image_size, MemoryBudget* memory_budget,
+                     JobQueue<ImageData>* input_queue,
                      JobQueue<ImageData>* output_queue);
 
+  size_t NumProcessedImages() const;
+
  private:
   void Run();
 
   const int max_image_size_;
 
+  MemoryBudget* memory_budget_;
   JobQueue<ImageData>* input_queue_;
   JobQueue<ImageData>* output_queue_;
+
+  std::atomic<size_t> num_processed_images_;
 };
 
 class SiftFeatureExtractorThread : public Thread {
  public:
   SiftFeatureExtractorThread(const SiftExtractionOptions& sift_options,
                              const std::shared_ptr<Bitmap>& camera_mask,
+                             MemoryBudget* memory_budget,
                              JobQueue<ImageData>* input_queue,
                              JobQueue<ImageData>* output_queue);
 
+  size_t NumProcessedImages() const;
+
  private:
   void Run();
 
@@ -131,21 +196,37 @@ class SiftFeatureExtractorThread : public Thread {
 
   std::unique_ptr<OpenGLContextManager> opengl_context_;
 
+  MemoryBudget* memory_budget_;
   JobQueue<ImageData>* input_queue_;
   JobQueue<ImageData>* output_queue_;
+
+  std::atomic<size_t> num_processed_images_;
 };
 
+// Writes the extracted features to the database. Committing a transaction is
+// expensive, so that the features are written in batches of several images,
+// which are committed at the latest after a few seconds.
 class FeatureWriterThread : public Thread {
  public:
   FeatureWriterThread(const size_t num_images, Database* database,
-                      JobQueue<ImageData>* input_queue);
+                      JobQueue<ImageData>* input_queue,
+                      const size_t max_batch_size = 100,
+                      const double max_batch_seconds = 5.0);
+
+  size_t NumProcessedImages() const;
 
  private:
   void Run();
 
+  void WriteBatch(std::vector<ImageData>* batch);
+
   const size_t num_images_;
   Database* database_;
   JobQueue<ImageData>* input_queue_;
+  const size_t max_batch_size_;
+  const double max_batch_seconds_;
+
+  std::atomic<size_t> num_processed_images_;
 };
 
 }  // namespace internal
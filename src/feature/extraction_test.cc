@@ -0,0 +1,254 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "feature/extraction"
+#include "util/testing.h"
+
+#include <thread>
+
+#include "feature/extraction.h"
+#include "util/misc.h"
+
+using namespace colmap;
+using namespace colmap::internal;
+
+namespace {
+
+// Wait until the condition is true or the timeout expires.
+template <typename Condition>
+bool WaitFor(const Condition& condition, const double timeout_seconds = 10) {
+  Timer timer;
+  timer.Start();
+  while (!condition()) {
+    if (timer.ElapsedSeconds() > timeout_seconds) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+std::string GetTemporaryPath() {
+  return (boost::filesystem::temp_directory_path() /
+          boost::filesystem::unique_path())
+      .string();
+}
+
+ImageData CreateImageData(const camera_t camera_id, const int index) {
+  ImageData image_data;
+  image_data.status = ImageReader::Status::SUCCESS;
+  image_data.camera.InitializeWithName("SIMPLE_PINHOLE", 1.0, 1, 1);
+  image_data.camera.SetCameraId(camera_id);
+  image_data.image.SetCameraId(camera_id);
+  image_data.image.SetName("image" + std::to_string(index));
+  image_data.keypoints.resize(index + 1);
+  image_data.descriptors.resize(index + 1, 128);
+  return image_data;
+}
+
+// Write images to a new database with a feature writer, which commits batches
+// of the given size and age. The given function pushes the first images and
+// returns their number, and the features of all images must be written after
+// the shutdown of the writer.
+void CheckFeatureWriter(
+    const size_t max_batch_size, const double max_batch_seconds,
+    const std::function<size_t(JobQueue<ImageData>*, FeatureWriterThread*)>&
+        fn) {
+  const std::string database_path = GetTemporaryPath();
+  Database database(database_path);
+
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_PINHOLE", 1.0, 1, 1);
+  const camera_t camera_id = database.WriteCamera(camera);
+
+  const int kNumImages = 5;
+  JobQueue<ImageData> queue;
+  FeatureWriterThread writer(kNumImages, &database, &queue, max_batch_size,
+                             max_batch_seconds);
+  writer.Start();
+
+  const size_t num_images = kNumImages + fn(&queue, &writer);
+  for (int i = 0; i < kNumImages; ++i) {
+    BOOST_CHECK(queue.Push(CreateImageData(camera_id, i)));
+  }
+  queue.Wait();
+  queue.Stop();
+  writer.Wait();
+
+  BOOST_CHECK_EQUAL(writer.NumProcessedImages(), num_images);
+  const std::vector<Image> images = database.ReadAllImages();
+  BOOST_CHECK_EQUAL(images.size(), num_images);
+  for (const auto& image : images) {
+    BOOST_CHECK_EQUAL(database.ReadKeypoints(image.ImageId()).size(),
+                      database.ReadDescriptors(image.ImageId()).rows());
+  }
+
+  database.Close();
+  boost::filesystem::remove(database_path);
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestMemoryBudgetOversizedRequest) {
+  MemoryBudget memory_budget(10);
+  BOOST_CHECK_EQUAL(memory_budget.MaxNumBytes(), 10);
+  BOOST_CHECK_EQUAL(memory_budget.NumBytes(), 0);
+
+  // A request larger than the budget proceeds, if no other memory is reserved.
+  memory_budget.Acquire(100);
+  BOOST_CHECK_EQUAL(memory_budget.NumBytes(), 100);
+
+  // Any other request waits until the oversized request is released.
+  std::atomic<bool> acquired(false);
+  std::thread thread([&]() {
+    memory_budget.Acquire(1);
+    acquired = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  BOOST_CHECK(!acquired);
+  BOOST_CHECK_EQUAL(memory_budget.NumBytes(), 100);
+
+  memory_budget.Release(100);
+  thread.join();
+  BOOST_CHECK(acquired);
+  BOOST_CHECK_EQUAL(memory_budget.NumBytes(), 1);
+
+  memory_budget.Release(1);
+  BOOST_CHECK_EQUAL(memory_budget.NumBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestMemoryBudgetReleaseWakesAll) {
+  MemoryBudget memory_budget(10);
+  memory_budget.Acquire(10);
+
+  const int kNumThreads = 3;
+  std::atomic<int> num_acquired(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&]() {
+      memory_budget.Acquire(3);
+      num_acquired += 1;
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  BOOST_CHECK_EQUAL(num_acquired, 0);
+
+  // All waiting requests fit into the budget after a single release.
+  memory_budget.Release(10);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_CHECK_EQUAL(num_acquired, kNumThreads);
+  BOOST_CHECK_EQUAL(memory_budget.NumBytes(), 3 * kNumThreads);
+}
+
+BOOST_AUTO_TEST_CASE(TestMemoryBudgetConcurrent) {
+  const size_t kMaxNumBytes = 100;
+  MemoryBudget memory_budget(kMaxNumBytes);
+
+  // The reserved bytes are unsigned, so that releasing more than reserved
+  // would wrap around and exceed the budget.
+  const int kNumThreads = 8;
+  const int kNumIterations = 1000;
+  std::atomic<size_t> max_num_bytes(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < kNumIterations; ++j) {
+        const size_t num_bytes = 1 + (i * kNumIterations + j) % kMaxNumBytes;
+        memory_budget.Acquire(num_bytes);
+        size_t num_reserved_bytes = memory_budget.NumBytes();
+        size_t prev_max_num_bytes = max_num_bytes;
+        while (num_reserved_bytes > prev_max_num_bytes &&
+               !max_num_bytes.compare_exchange_weak(prev_max_num_bytes,
+                                                    num_reserved_bytes)) {
+        }
+        memory_budget.Release(num_bytes);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  BOOST_CHECK_GT(max_num_bytes, 0);
+  BOOST_CHECK_LE(max_num_bytes, kMaxNumBytes);
+  BOOST_CHECK_EQUAL(memory_budget.NumBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestFeatureWriterBatchSize) {
+  CheckFeatureWriter(
+      2, 1000,
+      [](JobQueue<ImageData>* queue, FeatureWriterThread* writer) {
+        BOOST_CHECK(queue->Push(CreateImageData(1, 100)));
+        queue->Wait();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        BOOST_CHECK_EQUAL(writer->NumProcessedImages(), 0);
+        BOOST_CHECK(queue->Push(CreateImageData(1, 101)));
+        BOOST_CHECK(WaitFor([writer]() {
+          return writer->NumProcessedImages() == 2;
+        }));
+        return 2;
+      });
+}
+
+BOOST_AUTO_TEST_CASE(TestFeatureWriterTimeout) {
+  // The partial batch is written after the timeout without further images.
+  CheckFeatureWriter(
+      1000, 0.1,
+      [](JobQueue<ImageData>* queue, FeatureWriterThread* writer) {
+        Timer timer;
+        timer.Start();
+        BOOST_CHECK(queue->Push(CreateImageData(1, 100)));
+        BOOST_CHECK(WaitFor([writer]() {
+          return writer->NumProcessedImages() == 1;
+        }));
+        BOOST_CHECK_GE(timer.ElapsedSeconds(), 0.1);
+        return 1;
+      });
+}
+
+BOOST_AUTO_TEST_CASE(TestFeatureWriterShutdown) {
+  // The partial batch is only written on shutdown.
+  CheckFeatureWriter(
+      1000, 1000,
+      [](JobQueue<ImageData>* queue, FeatureWriterThread* writer) {
+        BOOST_CHECK(queue->Push(CreateImageData(1, 100)));
+        queue->Wait();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        BOOST_CHECK_EQUAL(writer->NumProcessedImages(), 0);
+        return 1;
+      });
+}
@@ -31,7 +31,9 @@
 
 #include "feature/matching.h"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
 #include <numeric>
 
 #include "SiftGPU/SiftGPU.h"
@@ -40,6 +42,7 @@
 #include "retrieval/visual_index.h"
 #include "util/cuda.h"
 #include "util/misc.h"
+#include "util/trace.h"
 
 namespace colmap {
 namespace {
@@ -48,16 +51,103 @@ void PrintElapsedTime(const Timer& timer) {
   std::cout << StringPrintf(" in %.3fs", timer.ElapsedSeconds()) << std::endl;
 }
 
+// Read the images of the persistent image index and remove the images, which
+// were removed from the database or whose features changed since. Changes are
+// detected by the number of features, which is cheap to read from the
+// database. Only if the features of an image were truncated to the top scale
+// features, the count cannot tell and the checksum of the indexed descriptors
+// is compared instead.
+void ReadImagesInVisualIndex(
+    const std::string& image_index_path,
+    const retrieval::VisualIndex<>::IndexOptions& index_options,
+    const int max_num_features, FeatureMatcherCache* cache,
+    retrieval::VisualIndex<>* visual_index) {
+  if (image_index_path.empty() || !ExistsFile(image_index_path)) {
+    return;
+  }
+
+  Timer timer;
+  timer.Start();
+
+  std::cout << "Reading image index..." << std::flush;
+
+  if (!visual_index->ReadImages(image_index_path, index_options)) {
+    std::cout << " => Incompatible image index, re-indexing all images"
+              << std::endl;
+    return;
+  }
+
+  const std::vector<image_t> image_ids = cache->GetImageIds();
+  const std::unordered_set<image_t> image_ids_set(image_ids.begin(),
+                                                  image_ids.end());
+  std::unordered_set<int> outdated_image_ids;
+  for (const int image_id : visual_index->ImageIds()) {
+    if (image_ids_set.count(image_id) == 0) {
+      outdated_image_ids.insert(image_id);
+      continue;
+    }
+
+    const size_t num_features = cache->GetNumDescriptors(image_id);
+    const bool truncated =
+        max_num_features > 0 &&
+        num_features > static_cast<size_t>(max_num_features);
+    const size_t num_indexed_features =
+        truncated ? static_cast<size_t>(max_num_features) : num_features;
+    if (num_indexed_features !=
+        static_cast<size_t>(visual_index->NumImageFeatures(image_id))) {
+      outdated_image_ids.insert(image_id);
+    } else if (truncated) {
+      auto keypoints = *cache->GetKeypoints(image_id);
+      auto descriptors = *cache->GetDescriptors(image_id);
+      ExtractTopScaleFeatures(&keypoints, &descriptors, max_num_features);
+      if (retrieval::VisualIndex<>::DescriptorsChecksum(descriptors) !=
+          visual_index->ImageDescriptorsChecksum(image_id)) {
+        outdated_image_ids.insert(image_id);
+      }
+    }
+  }
+
+  visual_index->RemoveImages(outdated_image_ids);
+
+  std::cout << StringPrintf(" %d images", visual_index->ImageIds().size());
+  if (!outdated_image_ids.empty()) {
+    std::cout << StringPrintf(", %d outdated", outdated_image_ids.size());
+  }
+  PrintElapsedTime(timer);
+}
+
 void IndexImagesInVisualIndex(const int num_threads, const int num_checks,
                               const int max_num_features,
-                              const std::vector<image_t>& image_ids,
+                              const std::string& image_index_path,
+                              const std::vector<image_t>& all_image_ids,
                               Thread* thread, FeatureMatcherCache* cache,
                               retrieval::VisualIndex<>* visual_index) {
   retrieval::VisualIndex<>::IndexOptions index_options;
   index_options.num_threads = num_threads;
   index_options.num_checks = num_checks;
 
-  for (size_t i = 0; i < image_ids.size(); ++i) {
+  ReadImagesInVisualIndex(image_index_path, index_options, max_num_features,
+                          cache, visual_index);
+
+  std::vector<image_t> image_ids;
+  image_ids.reserve(all_image_ids.size());
+  for (const image_t image_id : all_image_ids) {
+    if (!visual_index->ImageIndexed(image_id)) {
+      image_ids.push_back(image_id);
+    }
+  }
+
+  // The features of a batch of images are read sequentially and then indexed
+  // in parallel, one image per thread. The same threads are used for all
+  // batches.
+  ThreadPool index_thread_pool(num_threads);
+  const size_t batch_size = 4 * index_thread_pool.NumThreads();
+
+  std::vector<int> batch_image_ids;
+  std::vector<retrieval::VisualIndex<>::GeomType> batch_keypoints;
+  std::vector<retrieval::VisualIndex<>::DescType> batch_descriptors;
+
+  for (size_t begin = 0; begin < image_ids.size(); begin += batch_size) {
     if (thread->IsStopped()) {
       return;
     }
@@ -65,20 +155,40 @@ void IndexImagesInVisualIndex(const int num_threads, const int num_checks,
     Timer timer;
     timer.Start();
 
-    std::cout << StringPrintf("Indexing image [%d/%d]", i + 1, image_ids.size())
+    const size_t end = std::min(image_ids.size(), begin + batch_size);
+
+    std::cout << StringPrintf("Indexing images [%d-%d/%d]", begin + 1, end,
+                              image_ids.size())
               << std::flush;
 
-    auto keypoints = cache->GetKeypoints(image_ids[i]);
-    auto descriptors = cache->GetDescriptors(image_ids[i]);
-    if (max_num_features > 0 && descriptors.rows() > max_num_features) {
-      ExtractTopScaleFeatures(&keypoints, &descriptors, max_num_features);
+    batch_image_ids.clear();
+    batch_keypoints.clear();
+    batch_descriptors.clear();
+    for (size_t i = begin; i < end; ++i) {
+      auto keypoints = *cache->GetKeypoints(image_ids[i]);
+      auto descriptors = *cache->GetDescriptors(image_ids[i]);
+      if (max_num_features > 0 && descriptors.rows() > max_num_features) {
+        ExtractTopScaleFeatures(&keypoints, &descriptors, max_num_features);
+      }
+      batch_image_ids.push_back(image_ids[i]);
+      batch_keypoints.push_back(std::move(keypoints));
+      batch_descriptors.push_back(std::move(descriptors));
     }
 
-    visual_index->Add(index_options, image_ids[i], keypoints, descriptors);
+    visual_index->Add(index_options, batch_image_ids, batch_keypoints,
+                      batch_descriptors, &index_thread_pool);
 
     PrintElapsedTime(timer);
   }
 
+  if (!image_index_path.empty() && !image_ids.empty()) {
+    Timer timer;
+    timer.Start();
+    std::cout << "Writing image index..." << std::flush;
+    visual_index->WriteImages(image_index_path, index_options);
+    PrintElapsedTime(timer);
+  }
+
   // Compute the TF-IDF weights, etc.
   visual_index->Prepare();
 }
@@ -96,7 +206,6 @@ void MatchNearestNeighborsInVisualIndex(
 
   // Create a thread pool to retrieve the nearest neighbors.
   ThreadPool retrieval_thread_pool(num_threads);
-  JobQueue<Retrieval> retrieval_queue(num_threads);
 
   // The retrieval thread kernel function. Note that the descriptors should be
   // extracted outside of this function sequentially to avoid any concurrent
@@ -107,8 +216,8 @@ void MatchNearestNeighborsInVisualIndex(
   query_options.num_checks = num_checks;
   query_options.num_images_after_verification = num_images_after_verification;
   auto QueryFunc = [&](const image_t image_id) {
-    auto keypoints = cache->GetKeypoints(image_id);
-    auto descriptors = cache->GetDescriptors(image_id);
+    auto keypoints = *cache->GetKeypoints(image_id);
+    auto descriptors = *cache->GetDescriptors(image_id);
     if (max_num_features > 0 && descriptors.rows() > max_num_features) {
       ExtractTopScaleFeatures(&keypoints, &descriptors, max_num_features);
     }
@@ -118,15 +227,19 @@ void MatchNearestNeighborsInVisualIndex(
     visual_index->Query(query_options, keypoints, descriptors,
                         &retrieval.image_scores);
 
-    CHECK(retrieval_queue.Push(retrieval));
+    return retrieval;
   };
 
   // Initially, make all retrieval threads busy and continue with the matching.
+  // The results are consumed in submission order, so that the images are
+  // matched in the same order independent of the number of threads.
+  std::queue<std::future<Retrieval>> retrievals;
   size_t image_idx = 0;
   const size_t init_num_tasks =
       std::min(image_ids.size(), 2 * retrieval_thread_pool.NumThreads());
   for (; image_idx < init_num_tasks; ++image_idx) {
-    retrieval_thread_pool.AddTask(QueryFunc, image_ids[image_idx]);
+    retrievals.push(
+        retrieval_thread_pool.AddTask(QueryFunc, image_ids[image_idx]));
   }
 
   std::vector<std::pair<image_t, image_t>> image_pairs;
@@ -134,7 +247,8 @@ void MatchNearestNeighborsInVisualIndex(
   // Pop the finished retrieval results and enqueue them for feature matching.
   for (size_t i = 0; i < image_ids.size(); ++i) {
     if (thread->IsStopped()) {
-      retrieval_queue.Stop();
+      // Wait for running queries, which reference the local query state.
+      retrieval_thread_pool.Stop();
       return;
     }
 
@@ -146,16 +260,17 @@ void MatchNearestNeighborsInVisualIndex(
 
     // Push the next image to the retrieval queue.
     if (image_idx < image_ids.size()) {
-      retrieval_thread_pool.AddTask(QueryFunc, image_ids[image_idx]);
+      retrievals.push(
+          retrieval_thread_pool.AddTask(QueryFunc, image_ids[image_idx]));
       image_idx += 1;
     }
 
     // Pop the next results from the retrieval queue.
-    const auto retrieval = retrieval_queue.Pop();
-    CHECK(retrieval.IsValid());
+    const Retrieval retrieval = retrievals.front().get();
+    retrievals.pop();
 
-    const auto& image_id = retrieval.Data().image_id;
-    const auto& image_scores = retrieval.Data().image_scores;
+    const auto& image_id = retrieval.image_id;
+    const auto& image_scores = retrieval.image_scores;
 
     // Compose the image pairs from the scores.
     image_pairs.clear();
@@ -172,6 +287,73 @@ void MatchNearestNeighborsInVisualIndex(
 
 }  // namespace
 
+namespace internal {
+
+std::vector<std::pair<size_t, size_t>> OrderExhaustiveBlocks(
+    const size_t num_blocks, const size_t band_size) {
+  CHECK_GT(band_size, 0);
+
+  std::vector<std::pair<size_t, size_t>> blocks;
+  blocks.reserve(num_blocks * (num_blocks + 1) / 2);
+
+  const auto AddBandBlocks = [&](const size_t band_begin,
+                                 const size_t band_end) {
+    for (size_t row = band_begin; row < band_end; ++row) {
+      for (size_t col = row; col < band_end; ++col) {
+        blocks.emplace_back(row, col);
+      }
+    }
+  };
+
+  const auto AddColumnBlocks = [&](const size_t band_begin,
+                                   const size_t band_end, const size_t col) {
+    for (size_t row = band_begin; row < band_end; ++row) {
+      blocks.emplace_back(row, col);
+    }
+  };
+
+  for (size_t band_begin = 0; band_begin < num_blocks;
+       band_begin += band_size) {
+    const size_t band_end = std::min(num_blocks, band_begin + band_size);
+    if ((band_begin / band_size) % 2 == 0) {
+      AddBandBlocks(band_begin, band_end);
+      for (size_t col = band_end; col < num_blocks; ++col) {
+        AddColumnBlocks(band_begin, band_end, col);
+      }
+    } else {
+      for (size_t col = num_blocks; col > band_end; --col) {
+        AddColumnBlocks(band_begin, band_end, col - 1);
+      }
+      AddBandBlocks(band_begin, band_end);
+    }
+  }
+
+  return blocks;
+}
+
+std::vector<std::pair<image_t, image_t>> GetBlockImagePairs(
+    const std::vector<image_t>& image_ids, const size_t block_size,
+    const std::pair<size_t, size_t>& block) {
+  const size_t start_idx1 = block.first * block_size;
+  const size_t end_idx1 = std::min(image_ids.size(), start_idx1 + block_size);
+  const size_t start_idx2 = block.second * block_size;
+  const size_t end_idx2 = std::min(image_ids.size(), start_idx2 + block_size);
+
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  image_pairs.reserve(block_size * block_size);
+  for (size_t idx1 = start_idx1; idx1 < end_idx1; ++idx1) {
+    // Avoid duplicate pairs in the blocks on the diagonal.
+    for (size_t idx2 = std::max(start_idx2, idx1 + 1); idx2 < end_idx2;
+         ++idx2) {
+      image_pairs.emplace_back(image_ids[idx1], image_ids[idx2]);
+    }
+  }
+
+  return image_pairs;
+}
+
+}  // namespace internal
+
 bool ExhaustiveMatchingOptions::Check() const {
   CHECK_OPTION_GT(block_size, 1);
   return true;
@@ -212,10 +394,35 @@ bool ImagePairsMatchingOptions::Check() const {
 
 bool FeaturePairsMatchingOptions::Check() const { return true; }
 
+double FeatureMatcherCache::Statistics::HitRate() const {
+  const size_t num_requests = num_hits + num_prefetch_waits + num_misses;
+  if (num_requests == 0) {
+    return 0.0;
+  }
+  return (num_hits + num_prefetch_waits) / static_cast<double>(num_requests);
+}
+
 FeatureMatcherCache::FeatureMatcherCache(const size_t cache_size,
                                          const Database* database)
-    : cache_size_(cache_size), database_(database) {
+    : cache_size_(cache_size),
+      database_(database),
+      num_accesses_(0),
+      schedule_begin_(0),
+      prefetch_pos_(0),
+      num_pending_prefetches_(0) {
   CHECK_NOTNULL(database_);
+  CHECK_GT(cache_size_, 0);
+}
+
+FeatureMatcherCache::~FeatureMatcherCache() {
+  {
+    std::unique_lock<std::mutex> lock(features_mutex_);
+    schedule_.clear();
+    prefetch_pos_ = 0;
+  }
+  if (prefetch_thread_pool_) {
+    prefetch_thread_pool_->Wait();
+  }
 }
 
 void FeatureMatcherCache::Setup() {
@@ -231,17 +438,19 @@ void FeatureMatcherCache::Setup() {
     images_cache_.emplace(image.ImageId(), image);
   }
 
-  keypoints_cache_.reset(new LRUCache<image_t, FeatureKeypoints>(
-      cache_size_, [this](const image_t image_id) {
-        return database_->ReadKeypoints(image_id);
-      }));
+  features_cache_.reserve(cache_size_ + 1);
 
-  descriptors_cache_.reset(new LRUCache<image_t, FeatureDescriptors>(
-      cache_size_, [this](const image_t image_id) {
-        return database_->ReadDescriptors(image_id);
-      }));
+  const int kNumPrefetchThreads = 2;
+  prefetch_connections_.resize(kNumPrefetchThreads);
+  for (auto& connection : prefetch_connections_) {
+    connection.reset(new Database());
+    connection->OpenConnection(*database_);
+  }
+  prefetch_thread_pool_.reset(new ThreadPool(kNumPrefetchThreads));
 }
 
+size_t FeatureMatcherCache::Capacity() const { return cache_size_; }
+
 const Camera& FeatureMatcherCache::GetCamera(const camera_t camera_id) const {
   return cameras_cache_.at(camera_id);
 }
@@ -250,16 +459,19 @@ const Image& FeatureMatcherCache::GetImage(const image_t image_id) const {
   return images_cache_.at(image_id);
 }
 
-const FeatureKeypoints& FeatureMatcherCache::GetKeypoints(
+std::shared_ptr<const FeatureKeypoints> FeatureMatcherCache::GetKeypoints(
     const image_t image_id) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
-  return keypoints_cache_->Get(image_id);
+  return GetFeatures(image_id).keypoints;
 }
 
-const FeatureDescriptors& FeatureMatcherCache::GetDescriptors(
+std::shared_ptr<const FeatureDescriptors> FeatureMatcherCache::GetDescriptors(
     const image_t image_id) {
+  return GetFeatures(image_id).descriptors;
+}
+
+size_t FeatureMatcherCache::GetNumDescriptors(const image_t image_id) {
   std::unique_lock<std::mutex> lock(database_mutex_);
-  return descriptors_cache_->Get(image_id);
+  return database_->NumDescriptorsForImage(image_id);
 }
 
 FeatureMatches FeatureMatcherCache::GetMatches(const image_t image_id1,
@@ -289,30 +501,246 @@ bool FeatureMatcherCache::ExistsInlierMatches(const image_t image_id1,
   return database_->ExistsInlierMatches(image_id1, image_id2);
 }
 
-void FeatureMatcherCache::WriteMatches(const image_t image_id1,
-                                       const image_t image_id2,
-                                       const FeatureMatches& matches) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
-  database_->WriteMatches(image_id1, image_id2, matches);
+void FeatureMatcherCache::SetSchedule(
+    const std::vector<std::pair<image_t, image_t>>& image_pairs) {
+  std::unique_lock<std::mutex> lock(features_mutex_);
+
+  schedule_ = image_pairs;
+  schedule_uses_.clear();
+  schedule_pair_idxs_.clear();
+  schedule_pair_idxs_.reserve(schedule_.size());
+  for (size_t i = 0; i < schedule_.size(); ++i) {
+    schedule_uses_[schedule_[i].first].push_back(i);
+    schedule_uses_[schedule_[i].second].push_back(i);
+    schedule_pair_idxs_.emplace(
+        Database::ImagePairToPairId(schedule_[i].first, schedule_[i].second),
+        i);
+  }
+  schedule_finished_.assign(schedule_.size(), false);
+  schedule_begin_ = 0;
+  prefetch_pos_ = 0;
+
+  Prefetch();
 }
 
-void FeatureMatcherCache::WriteTwoViewGeometry(
-    const image_t image_id1, const image_t image_id2,
-    const TwoViewGeometry& two_view_geometry) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
-  database_->WriteTwoViewGeometry(image_id1, image_id2, two_view_geometry);
+void FeatureMatcherCache::FinishScheduledPair(const image_t image_id1,
+                                              const image_t image_id2) {
+  std::unique_lock<std::mutex> lock(features_mutex_);
+
+  const auto pair_idx = schedule_pair_idxs_.find(
+      Database::ImagePairToPairId(image_id1, image_id2));
+  if (pair_idx == schedule_pair_idxs_.end()) {
+    return;
+  }
+
+  schedule_finished_[pair_idx->second] = true;
+  while (schedule_begin_ < schedule_.size() &&
+         schedule_finished_[schedule_begin_]) {
+    schedule_begin_ += 1;
+  }
+
+  Prefetch();
 }
 
-void FeatureMatcherCache::DeleteMatches(const image_t image_id1,
-                                        const image_t image_id2) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
-  database_->DeleteMatches(image_id1, image_id2);
+void FeatureMatcherCache::WaitForPrefetches() {
+  std::unique_lock<std::mutex> lock(features_mutex_);
+  features_condition_.wait(lock,
+                           [this]() { return num_pending_prefetches_ == 0; });
 }
 
-void FeatureMatcherCache::DeleteInlierMatches(const image_t image_id1,
-                                              const image_t image_id2) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
-  database_->DeleteInlierMatches(image_id1, image_id2);
+std::vector<image_t> FeatureMatcherCache::GetCachedImageIds() {
+  std::unique_lock<std::mutex> lock(features_mutex_);
+  std::vector<image_t> image_ids;
+  image_ids.reserve(features_cache_.size());
+  for (const auto& features : features_cache_) {
+    if (!features.second.pending) {
+      image_ids.push_back(features.first);
+    }
+  }
+  return image_ids;
+}
+
+FeatureMatcherCache::Statistics FeatureMatcherCache::GetStatistics() {
+  std::unique_lock<std::mutex> lock(features_mutex_);
+  return statistics_;
+}
+
+FeatureMatcherCache::Features FeatureMatcherCache::GetFeatures(
+    const image_t image_id) {
+  std::unique_lock<std::mutex> lock(features_mutex_);
+
+  num_accesses_ += 1;
+
+  auto features = features_cache_.find(image_id);
+  if (features != features_cache_.end()) {
+    if (features->second.pending) {
+      statistics_.num_prefetch_waits += 1;
+      // The entry can be evicted between the end of the read and the wake up,
+      // in which case the features are read again below.
+      features_condition_.wait(lock, [this, image_id]() {
+        const auto features = features_cache_.find(image_id);
+        return features == features_cache_.end() || !features->second.pending;
+      });
+      features = features_cache_.find(image_id);
+    } else {
+      statistics_.num_hits += 1;
+    }
+    if (features != features_cache_.end()) {
+      features->second.last_access = num_accesses_;
+      return features->second;
+    }
+  } else {
+    statistics_.num_misses += 1;
+  }
+
+  // Read the features synchronously. The entry is marked as pending, so that
+  // concurrent requests for the same image wait instead of reading it again.
+  MakeRoom(0, true);
+  features_cache_[image_id].pending = true;
+  lock.unlock();
+
+  std::unique_lock<std::mutex> database_lock(database_mutex_);
+  return ReadFeatures(image_id, *database_, false);
+}
+
+void FeatureMatcherCache::ReadImageFeatures(const Database& database,
+                                            const image_t image_id,
+                                            FeatureKeypoints* keypoints,
+                                            FeatureDescriptors* descriptors) {
+  *keypoints = database.ReadKeypoints(image_id);
+  *descriptors = database.ReadDescriptors(image_id);
+}
+
+FeatureMatcherCache::Features FeatureMatcherCache::ReadFeatures(
+    const image_t image_id, const Database& database, const bool prefetch) {
+  FeatureKeypoints keypoints;
+  FeatureDescriptors descriptors;
+  ReadImageFeatures(database, image_id, &keypoints, &descriptors);
+
+  Features features;
+  features.keypoints =
+      std::make_shared<const FeatureKeypoints>(std::move(keypoints));
+  features.descriptors =
+      std::make_shared<const FeatureDescriptors>(std::move(descriptors));
+
+  {
+    std::unique_lock<std::mutex> lock(features_mutex_);
+    features.last_access = num_accesses_;
+    const auto cached_features = features_cache_.find(image_id);
+    if (cached_features != features_cache_.end()) {
+      // A request adds its entry beyond the capacity, if all other entries
+      // are being read, so that the capacity is only restored now.
+      size_t num_cached_features = 0;
+      for (const auto& other_features : features_cache_) {
+        num_cached_features += !other_features.second.pending;
+      }
+      for (; num_cached_features >= cache_size_; --num_cached_features) {
+        size_t victim_next_use = 0;
+        features_cache_.erase(FindEvictionCandidate(&victim_next_use));
+      }
+      cached_features->second = features;
+    }
+    if (prefetch) {
+      num_pending_prefetches_ -= 1;
+      Prefetch();
+    }
+  }
+
+  features_condition_.notify_all();
+
+  return features;
+}
+
+size_t FeatureMatcherCache::NextScheduledUse(const image_t image_id) const {
+  const auto uses = schedule_uses_.find(image_id);
+  if (uses == schedule_uses_.end()) {
+    return std::numeric_limits<size_t>::max();
+  }
+
+  // The finished uses after `schedule_begin_` are not skipped, since the pairs
+  // are mostly finished in order.
+  const auto next_use = std::lower_bound(uses->second.begin(),
+                                         uses->second.end(), schedule_begin_);
+  if (next_use == uses->second.end()) {
+    return std::numeric_limits<size_t>::max();
+  }
+
+  return *next_use;
+}
+
+std::unordered_map<image_t, FeatureMatcherCache::Features>::iterator
+FeatureMatcherCache::FindEvictionCandidate(size_t* next_use) {
+  auto victim = features_cache_.end();
+  for (auto features = features_cache_.begin();
+       features != features_cache_.end(); ++features) {
+    if (features->second.pending) {
+      continue;
+    }
+    const size_t features_next_use = NextScheduledUse(features->first);
+    if (victim == features_cache_.end() || features_next_use > *next_use ||
+        (features_next_use == *next_use &&
+         features->second.last_access < victim->second.last_access)) {
+      victim = features;
+      *next_use = features_next_use;
+    }
+  }
+  return victim;
+}
+
+bool FeatureMatcherCache::MakeRoom(const size_t next_use, const bool force) {
+  if (features_cache_.size() < cache_size_) {
+    return true;
+  }
+
+  size_t victim_next_use = 0;
+  const auto victim = FindEvictionCandidate(&victim_next_use);
+  if (victim == features_cache_.end() ||
+      (!force && victim_next_use <= next_use)) {
+    return false;
+  }
+
+  features_cache_.erase(victim);
+
+  return true;
+}
+
+void FeatureMatcherCache::Prefetch() {
+  if (!prefetch_thread_pool_) {
+    return;
+  }
+
+  // Limit the number of concurrent reads, so that the prefetched images do
+  // not occupy the whole cache before they are needed.
+  const size_t max_num_pending_prefetches =
+      std::min<size_t>(2 * prefetch_thread_pool_->NumThreads(), cache_size_);
+
+  prefetch_pos_ = std::max(prefetch_pos_, 2 * schedule_begin_);
+  while (num_pending_prefetches_ < max_num_pending_prefetches &&
+         prefetch_pos_ < 2 * schedule_.size()) {
+    const size_t pair_idx = prefetch_pos_ / 2;
+    const image_t image_id = prefetch_pos_ % 2 == 0
+                                 ? schedule_[pair_idx].first
+                                 : schedule_[pair_idx].second;
+
+    if (features_cache_.count(image_id) == 0) {
+      // Stop prefetching, if the cache is full of images that are needed
+      // before this image.
+      if (!MakeRoom(pair_idx, false)) {
+        break;
+      }
+
+      features_cache_[image_id].pending = true;
+      num_pending_prefetches_ += 1;
+      statistics_.num_prefetches += 1;
+
+      prefetch_thread_pool_->AddTask([this, image_id]() {
+        const int thread_idx = prefetch_thread_pool_->GetThreadIndex();
+        ReadFeatures(image_id, *prefetch_connections_.at(thread_idx), true);
+      });
+    }
+
+    prefetch_pos_ += 1;
+  }
 }
 
 FeatureMatcherThread::FeatureMatcherThread(const SiftMatchingOptions& options,
@@ -336,6 +764,8 @@ SiftCPUFeatureMatcher::SiftCPUFeatureMatcher(const SiftMatchingOptions& options,
 void SiftCPUFeatureMatcher::Run() {
   SignalValidSetup();
 
+  Tracer::Instance().SetThreadName("Feature matcher");
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -345,11 +775,13 @@ void SiftCPUFeatureMatcher::Run() {
     if (input_job.IsValid()) {
       auto data = input_job.Data();
 
-      const FeatureDescriptors descriptors1 =
-          cache_->GetDescriptors(data.image_id1);
-      const FeatureDescriptors descriptors2 =
-          cache_->GetDescriptors(data.image_id2);
-      MatchSiftFeaturesCPU(options_, descriptors1, descriptors2, &data.matches);
+      {
+        COLMAP_TRACE_SCOPE("MatchFeatures");
+        const auto descriptors1 = cache_->GetDescriptors(data.image_id1);
+        const auto descriptors2 = cache_->GetDescriptors(data.image_id2);
+        MatchSiftFeaturesCPU(options_, *descriptors1, *descriptors2,
+                             &data.matches);
+      }
 
       CHECK(output_queue_->Push(data));
     }
@@ -388,6 +820,8 @@ void SiftGPUFeatureMatcher::Run() {
 
   SignalValidSetup();
 
+  Tracer::Instance().SetThreadName("Feature matcher");
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -397,12 +831,15 @@ void SiftGPUFeatureMatcher::Run() {
     if (input_job.IsValid()) {
       auto data = input_job.Data();
 
-      const FeatureDescriptors* descriptors1_ptr;
-      GetDescriptorData(0, data.image_id1, &descriptors1_ptr);
-      const FeatureDescriptors* descriptors2_ptr;
-      GetDescriptorData(1, data.image_id2, &descriptors2_ptr);
-      MatchSiftFeaturesGPU(options_, descriptors1_ptr, descriptors2_ptr,
-                           &sift_match_gpu, &data.matches);
+      {
+        COLMAP_TRACE_SCOPE("MatchFeatures");
+        const FeatureDescriptors* descriptors1_ptr;
+        GetDescriptorData(0, data.image_id1, &descriptors1_ptr);
+        const FeatureDescriptors* descriptors2_ptr;
+        GetDescriptorData(1, data.image_id2, &descriptors2_ptr);
+        MatchSiftFeaturesGPU(options_, descriptors1_ptr, descriptors2_ptr,
+                             &sift_match_gpu, &data.matches);
+      }
 
       CHECK(output_queue_->Push(data));
     }
@@ -418,7 +855,7 @@ void SiftGPUFeatureMatcher::GetDescriptorData(
     *descriptors_ptr = nullptr;
   } else {
     prev_uploaded_descriptors_[index] = cache_->GetDescriptors(image_id);
-    *descriptors_ptr = &prev_uploaded_descriptors_[index];
+    *descriptors_ptr = prev_uploaded_descriptors_[index].get();
     prev_uploaded_image_ids_[index] = image_id;
   }
 }
@@ -435,6 +872,8 @@ GuidedSiftCPUFeatureMatcher::GuidedSiftCPUFeatureMatcher(
 void GuidedSiftCPUFeatureMatcher::Run() {
   SignalValidSetup();
 
+  Tracer::Instance().SetThreadName("Guided feature matcher");
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -450,14 +889,15 @@ void GuidedSiftCPUFeatureMatcher::Run() {
         continue;
       }
 
-      const FeatureKeypoints keypoints1 = cache_->GetKeypoints(data.image_id1);
-      const FeatureKeypoints keypoints2 = cache_->GetKeypoints(data.image_id2);
-      const FeatureDescriptors descriptors1 =
-          cache_->GetDescriptors(data.image_id1);
-      const FeatureDescriptors descriptors2 =
-          cache_->GetDescriptors(data.image_id2);
-      MatchGuidedSiftFeaturesCPU(options_, keypoints1, keypoints2, descriptors1,
-                                 descriptors2, &data.two_view_geometry);
+      COLMAP_TRACE_SCOPE("MatchGuidedFeatures");
+
+      const auto keypoints1 = cache_->GetKeypoints(data.image_id1);
+      const auto keypoints2 = cache_->GetKeypoints(data.image_id2);
+      const auto descriptors1 = cache_->GetDescriptors(data.image_id1);
+      const auto descriptors2 = cache_->GetDescriptors(data.image_id2);
+      MatchGuidedSiftFeaturesCPU(options_, *keypoints1, *keypoints2,
+                                 *descriptors1, *descriptors2,
+                                 &data.two_view_geometry);
 
       CHECK(output_queue_->Push(data));
     }
@@ -495,6 +935,8 @@ void GuidedSiftGPUFeatureMatcher::Run() {
 
   SignalValidSetup();
 
+  Tracer::Instance().SetThreadName("Guided feature matcher");
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -510,6 +952,8 @@ void GuidedSiftGPUFeatureMatcher::Run() {
         continue;
       }
 
+      COLMAP_TRACE_SCOPE("MatchGuidedFeatures");
+
       const FeatureDescriptors* descriptors1_ptr;
       const FeatureKeypoints* keypoints1_ptr;
       GetFeatureData(0, data.image_id1, &keypoints1_ptr, &descriptors1_ptr);
@@ -538,8 +982,8 @@ void GuidedSiftGPUFeatureMatcher::GetFeatureData(
   } else {
     prev_uploaded_keypoints_[index] = cache_->GetKeypoints(image_id);
     prev_uploaded_descriptors_[index] = cache_->GetDescriptors(image_id);
-    *keypoints_ptr = &prev_uploaded_keypoints_[index];
-    *descriptors_ptr = &prev_uploaded_descriptors_[index];
+    *keypoints_ptr = prev_uploaded_keypoints_[index].get();
+    *descriptors_ptr = prev_uploaded_descriptors_[index].get();
     prev_uploaded_image_ids_[index] = image_id;
   }
 }
@@ -563,9 +1007,12 @@ TwoViewGeometryVerifier::TwoViewGeometryVerifier(
       static_cast<size_t>(options_.max_num_trials);
   two_view_geometry_options_.ransac_options.min_inlier_ratio =
       options_.min_inlier_ratio;
+  two_view_geometry_options_.ransac_options.use_sprt = options_.use_sprt;
 }
 
 void TwoViewGeometryVerifier::Run() {
+  Tracer::Instance().SetThreadName("Geometric verifier");
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -580,14 +1027,16 @@ void TwoViewGeometryVerifier::Run() {
         continue;
       }
 
+      COLMAP_TRACE_SCOPE("VerifyTwoViewGeometry");
+
       const auto& camera1 =
           cache_->GetCamera(cache_->GetImage(data.image_id1).CameraId());
       const auto& camera2 =
           cache_->GetCamera(cache_->GetImage(data.image_id2).CameraId());
       const auto keypoints1 = cache_->GetKeypoints(data.image_id1);
       const auto keypoints2 = cache_->GetKeypoints(data.image_id2);
-      const auto points1 = FeatureKeypointsToPointsVector(keypoints1);
-      const auto points2 = FeatureKeypointsToPointsVector(keypoints2);
+      const auto points1 = FeatureKeypointsToPointsVector(*keypoints1);
+      const auto points2 = FeatureKeypointsToPointsVector(*keypoints2);
 
       if (options_.multiple_models) {
         data.two_view_geometry.EstimateMultiple(camera1, points1, camera2,
@@ -705,6 +1154,32 @@ SiftFeatureMatcher::~SiftFeatureMatcher() {
   for (auto& guided_matcher : guided_matchers_) {
     guided_matcher->Wait();
   }
+
+  if (database_writer_) {
+    database_writer_->Flush();
+    const DatabaseWriter::Statistics statistics =
+        database_writer_->GetStatistics();
+    if (statistics.num_transactions > 0) {
+      std::cout << StringPrintf(
+                       "Database writes: %d in %d transactions, latency "
+                       "%.3fs (mean), %.3fs (max)",
+                       statistics.num_writes, statistics.num_transactions,
+                       statistics.mean_write_latency,
+                       statistics.max_write_latency)
+                << std::endl;
+    }
+  }
+
+  if (is_setup_) {
+    const FeatureMatcherCache::Statistics statistics = cache_->GetStatistics();
+    std::cout << StringPrintf(
+                     "Feature cache: %.1f%% hit rate, %d hits, %d prefetch "
+                     "waits, %d misses, %d prefetches",
+                     100.0 * statistics.HitRate(), statistics.num_hits,
+                     statistics.num_prefetch_waits, statistics.num_misses,
+                     statistics.num_prefetches)
+              << std::endl;
+  }
 }
 
 bool SiftFeatureMatcher::Setup() {
@@ -738,13 +1213,23 @@ bool SiftFeatureMatcher::Setup() {
     }
   }
 
+  DatabaseWriter::Options database_writer_options;
+  database_writer_options.max_batch_size = options_.write_batch_size;
+  database_writer_options.max_batch_seconds = options_.write_batch_seconds;
+  database_writer_options.max_num_queued_writes =
+      std::max(database_writer_options.max_num_queued_writes,
+               options_.write_batch_size);
+  database_writer_.reset(
+      new DatabaseWriter(database_, database_writer_options));
+
   is_setup_ = true;
 
   return true;
 }
 
 void SiftFeatureMatcher::Match(
-    const std::vector<std::pair<image_t, image_t>>& image_pairs) {
+    const std::vector<std::pair<image_t, image_t>>& image_pairs,
+    const std::vector<std::pair<image_t, image_t>>& next_image_pairs) {
   CHECK_NOTNULL(database_);
   CHECK_NOTNULL(cache_);
   CHECK(is_setup_);
@@ -753,6 +1238,15 @@ void SiftFeatureMatcher::Match(
     return;
   }
 
+  ScopedTraceSpan trace_span("MatchImagePairs");
+  trace_span.SetArg("num_image_pairs", image_pairs.size());
+
+  // Make the results of previous batches visible to the existence checks.
+  {
+    COLMAP_TRACE_SCOPE("FlushWrites");
+    database_writer_->Flush();
+  }
+
   //////////////////////////////////////////////////////////////////////////////
   // Match the image pairs
   //////////////////////////////////////////////////////////////////////////////
@@ -760,7 +1254,12 @@ void SiftFeatureMatcher::Match(
   std::unordered_set<image_pair_t> image_pair_ids;
   image_pair_ids.reserve(image_pairs.size());
 
-  size_t num_outputs = 0;
+  // The jobs are collected before pushing them to the queues, so that the
+  // cache can read the features of the scheduled image pairs ahead of time.
+  std::vector<internal::FeatureMatcherData> jobs;
+  std::vector<bool> jobs_exist_matches;
+  std::vector<std::pair<image_t, image_t>> scheduled_image_pairs;
+
   for (const auto image_pair : image_pairs) {
     // Avoid self-matches.
     if (image_pair.first == image_pair.second) {
@@ -785,15 +1284,14 @@ void SiftFeatureMatcher::Match(
       continue;
     }
 
-    num_outputs += 1;
-
     // If only one of the matches or inlier matches exist, we recompute them
     // from scratch and delete the existing results. This must be done before
     // pushing the jobs to the queue, otherwise database constraints might fail
     // when writing an existing result into the database.
 
     if (exists_inlier_matches) {
-      cache_->DeleteInlierMatches(image_pair.first, image_pair.second);
+      database_writer_->DeleteInlierMatches(image_pair.first,
+                                            image_pair.second);
     }
 
     internal::FeatureMatcherData data;
@@ -802,10 +1300,26 @@ void SiftFeatureMatcher::Match(
 
     if (exists_matches) {
       data.matches = cache_->GetMatches(image_pair.first, image_pair.second);
-      cache_->DeleteMatches(image_pair.first, image_pair.second);
-      CHECK(verifier_queue_.Push(data));
+      database_writer_->DeleteMatches(image_pair.first, image_pair.second);
+    }
+
+    jobs.push_back(std::move(data));
+    jobs_exist_matches.push_back(exists_matches);
+    scheduled_image_pairs.emplace_back(image_pair.first, image_pair.second);
+  }
+
+  // The next image pairs are scheduled after the current ones, so that their
+  // features are only read once all features of the current batch are read.
+  scheduled_image_pairs.insert(scheduled_image_pairs.end(),
+                               next_image_pairs.begin(),
+                               next_image_pairs.end());
+  cache_->SetSchedule(scheduled_image_pairs);
+
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (jobs_exist_matches[i]) {
+      CHECK(verifier_queue_.Push(jobs[i]));
     } else {
-      CHECK(matcher_queue_.Push(data));
+      CHECK(matcher_queue_.Push(jobs[i]));
     }
   }
 
@@ -813,11 +1327,13 @@ void SiftFeatureMatcher::Match(
   // Write results to database
   //////////////////////////////////////////////////////////////////////////////
 
-  for (size_t i = 0; i < num_outputs; ++i) {
+  for (size_t i = 0; i < jobs.size(); ++i) {
     const auto output_job = output_queue_.Pop();
     CHECK(output_job.IsValid());
     auto output = output_job.Data();
 
+    cache_->FinishScheduledPair(output.image_id1, output.image_id2);
+
     if (output.matches.size() < static_cast<size_t>(options_.min_num_inliers)) {
       output.matches = {};
     }
@@ -827,9 +1343,11 @@ void SiftFeatureMatcher::Match(
       output.two_view_geometry = TwoViewGeometry();
     }
 
-    cache_->WriteMatches(output.image_id1, output.image_id2, output.matches);
-    cache_->WriteTwoViewGeometry(output.image_id1, output.image_id2,
-                                 output.two_view_geometry);
+    COLMAP_TRACE_SCOPE("WriteMatches");
+    database_writer_->WriteMatches(output.image_id1, output.image_id2,
+                                   output.matches);
+    database_writer_->WriteTwoViewGeometry(output.image_id1, output.image_id2,
+                                           output.two_view_geometry);
   }
 
   CHECK_EQ(output_queue_.Size(), 0);
@@ -850,6 +1368,9 @@ ExhaustiveFeatureMatcher::ExhaustiveFeatureMatcher(
 void ExhaustiveFeatureMatcher::Run() {
   PrintHeading1("Exhaustive feature matching");
 
+  COLMAP_TRACE_STAGE("ExhaustiveMatching");
+  Tracer::Instance().SetThreadName("Feature matching");
+
   if (!matcher_.Setup()) {
     return;
   }
@@ -861,51 +1382,46 @@ void ExhaustiveFeatureMatcher::Run() {
   const size_t block_size = static_cast<size_t>(options_.block_size);
   const size_t num_blocks = static_cast<size_t>(
       std::ceil(static_cast<double>(image_ids.size()) / block_size));
-  const size_t num_pairs_per_block = block_size * (block_size - 1) / 2;
 
-  std::vector<std::pair<image_t, image_t>> image_pairs;
-  image_pairs.reserve(num_pairs_per_block);
-
-  for (size_t start_idx1 = 0; start_idx1 < image_ids.size();
-       start_idx1 += block_size) {
-    const size_t end_idx1 =
-        std::min(image_ids.size(), start_idx1 + block_size) - 1;
-    for (size_t start_idx2 = 0; start_idx2 < image_ids.size();
-         start_idx2 += block_size) {
-      const size_t end_idx2 =
-          std::min(image_ids.size(), start_idx2 + block_size) - 1;
-
-      if (IsStopped()) {
-        GetTimer().PrintMinutes();
-        return;
-      }
+  // Keep a band of rows, the current column, and the next column in the cache.
+  const size_t num_cached_blocks = cache_.Capacity() / block_size;
+  const size_t band_size = num_cached_blocks > 3 ? num_cached_blocks - 2 : 1;
 
-      Timer timer;
-      timer.Start();
-
-      std::cout << StringPrintf("Matching block [%d/%d, %d/%d]",
-                                start_idx1 / block_size + 1, num_blocks,
-                                start_idx2 / block_size + 1, num_blocks)
-                << std::flush;
-
-      image_pairs.clear();
-      for (size_t idx1 = start_idx1; idx1 <= end_idx1; ++idx1) {
-        for (size_t idx2 = start_idx2; idx2 <= end_idx2; ++idx2) {
-          const size_t block_id1 = idx1 % block_size;
-          const size_t block_id2 = idx2 % block_size;
-          if ((idx1 > idx2 && block_id1 <= block_id2) ||
-              (idx1 < idx2 &&
-               block_id1 < block_id2)) {  // Avoid duplicate pairs
-            image_pairs.emplace_back(image_ids[idx1], image_ids[idx2]);
-          }
-        }
-      }
+  const std::vector<std::pair<size_t, size_t>> blocks =
+      internal::OrderExhaustiveBlocks(num_blocks, band_size);
+
+  std::vector<std::pair<image_t, image_t>> next_image_pairs;
+  if (!blocks.empty()) {
+    next_image_pairs =
+        internal::GetBlockImagePairs(image_ids, block_size, blocks[0]);
+  }
+
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (IsStopped()) {
+      GetTimer().PrintMinutes();
+      return;
+    }
 
-      DatabaseTransaction database_transaction(&database_);
-      matcher_.Match(image_pairs);
+    Timer timer;
+    timer.Start();
+
+    std::cout << StringPrintf("Matching block [%d/%d, %d/%d]",
+                              blocks[i].first + 1, num_blocks,
+                              blocks[i].second + 1, num_blocks)
+              << std::flush;
 
-      PrintElapsedTime(timer);
+    const std::vector<std::pair<image_t, image_t>> image_pairs =
+        std::move(next_image_pairs);
+    if (i + 1 < blocks.size()) {
+      next_image_pairs =
+          internal::GetBlockImagePairs(image_ids, block_size, blocks[i + 1]);
+    } else {
+      next_image_pairs.clear();
     }
+
+    matcher_.Match(image_pairs, next_image_pairs);
+
+    PrintElapsedTime(timer);
   }
 
   GetTimer().PrintMinutes();
@@ -928,6 +1444,9 @@ SequentialFeatureMatcher::SequentialFeatureMatcher(
 void SequentialFeatureMatcher::Run() {
   PrintHeading1("Sequential feature matching");
 
+  COLMAP_TRACE_STAGE("SequentialMatching");
+  Tracer::Instance().SetThreadName("Feature matching");
+
   if (!matcher_.Setup()) {
     return;
   }
@@ -1003,7 +1522,6 @@ void SequentialFeatureMatcher::RunSequentialMatching(
       }
     }
 
-    DatabaseTransaction database_transaction(&database_);
     matcher_.Match(image_pairs);
 
     PrintElapsedTime(timer);
@@ -1019,8 +1537,9 @@ void SequentialFeatureMatcher::RunLoopDetection(
   // Index all images in the visual index.
   IndexImagesInVisualIndex(match_options_.num_threads,
                            options_.loop_detection_num_checks,
-                           options_.loop_detection_max_num_features, image_ids,
-                           this, &cache_, &visual_index);
+                           options_.loop_detection_max_num_features,
+                           options_.image_index_path, image_ids, this, &cache_,
+                           &visual_index);
 
   if (IsStopped()) {
     return;
@@ -1057,6 +1576,9 @@ VocabTreeFeatureMatcher::VocabTreeFeatureMatcher(
 void VocabTreeFeatureMatcher::Run() {
   PrintHeading1("Vocabulary tree feature matching");
 
+  COLMAP_TRACE_STAGE("VocabTreeMatching");
+  Tracer::Instance().SetThreadName("Feature matching");
+
   if (!matcher_.Setup()) {
     return;
   }
@@ -1101,8 +1623,8 @@ void VocabTreeFeatureMatcher::Run() {
 
   // Index all images in the visual index.
   IndexImagesInVisualIndex(match_options_.num_threads, options_.num_checks,
-                           options_.max_num_features, all_image_ids, this,
-                           &cache_, &visual_index);
+                           options_.max_num_features, options_.image_index_path,
+                           all_image_ids, this, &cache_, &visual_index);
 
   if (IsStopped()) {
     GetTimer().PrintMinutes();
@@ -1134,6 +1656,9 @@ SpatialFeatureMatcher::SpatialFeatureMatcher(
 void SpatialFeatureMatcher::Run() {
   PrintHeading1("Spatial feature matching");
 
+  COLMAP_TRACE_STAGE("SpatialMatching");
+  Tracer::Instance().SetThreadName("Feature matching");
+
   if (!matcher_.Setup()) {
     return;
   }
@@ -1213,11 +1738,17 @@ void SpatialFeatureMatcher::Run() {
 
   std::cout << "Building search index..." << std::flush;
 
+  // Without the z-coordinate, only the x- and y-coordinates of the local
+  // locations are indexed. In contrast, GPS locations are indexed in the
+  // Earth-centered frame, in which all coordinates vary.
+  const size_t num_dims = (options_.ignore_z && !options_.is_gps) ? 2 : 3;
   flann::Matrix<float> locations(location_matrix.data(), num_locations,
-                                 location_matrix.cols());
+                                 num_dims, location_matrix.cols() * sizeof(float));
 
-  flann::LinearIndexParams index_params;
-  flann::LinearIndex<flann::L2<float>> search_index(index_params);
+  // The exact k-d tree answers the nearest neighbor and radius queries in
+  // logarithmic instead of linear time in the number of locations.
+  flann::KDTreeSingleIndexParams index_params;
+  flann::KDTreeSingleIndex<flann::L2<float>> search_index(index_params);
   search_index.buildIndex(locations);
 
   PrintElapsedTime(timer);
@@ -1240,7 +1771,12 @@ void SpatialFeatureMatcher::Run() {
       distance_matrix(num_locations, knn);
   flann::Matrix<float> distances(distance_matrix.data(), num_locations, knn);
 
-  flann::SearchParams search_params(flann::FLANN_CHECKS_AUTOTUNED);
+  // Search the nearest neighbors within the maximum distance, so that the
+  // search does not descend into far away parts of the tree. Note that the
+  // squared distance is used for the L2 norm.
+  flann::SearchParams search_params(flann::FLANN_CHECKS_UNLIMITED);
+  search_params.max_neighbors = knn;
+  search_params.sorted = true;
   if (match_options_.num_threads == ThreadPool::kMaxNumThreads) {
     search_params.cores = std::thread::hardware_concurrency();
   } else {
@@ -1250,7 +1786,11 @@ void SpatialFeatureMatcher::Run() {
     search_params.cores = 1;
   }
 
-  search_index.knnSearch(locations, indices, distances, knn, search_params);
+  const float max_distance =
+      static_cast<float>(options_.max_distance * options_.max_distance);
+
+  search_index.radiusSearch(locations, indices, distances, max_distance,
+                            search_params);
 
   PrintElapsedTime(timer);
 
@@ -1258,11 +1798,32 @@ void SpatialFeatureMatcher::Run() {
   // Matching
   //////////////////////////////////////////////////////////////////////////////
 
-  const float max_distance =
-      static_cast<float>(options_.max_distance * options_.max_distance);
+  const auto GetImagePairs = [&](const size_t i) {
+    std::vector<std::pair<image_t, image_t>> image_pairs;
+    image_pairs.reserve(knn);
 
-  std::vector<std::pair<image_t, image_t>> image_pairs;
-  image_pairs.reserve(knn);
+    for (int j = 0; j < knn; ++j) {
+      // Fewer neighbors than requested are within the maximum distance.
+      if (index_matrix(i, j) == std::numeric_limits<size_t>::max()) {
+        break;
+      }
+
+      // Check if query equals result.
+      if (index_matrix(i, j) == i) {
+        continue;
+      }
+
+      const size_t idx = location_idxs[i];
+      const image_t image_id = image_ids.at(idx);
+      const size_t nn_idx = location_idxs.at(index_matrix(i, j));
+      const image_t nn_image_id = image_ids.at(nn_idx);
+      image_pairs.emplace_back(image_id, nn_image_id);
+    }
+
+    return image_pairs;
+  };
+
+  std::vector<std::pair<image_t, image_t>> next_image_pairs = GetImagePairs(0);
 
   for (size_t i = 0; i < num_locations; ++i) {
     if (IsStopped()) {
@@ -1275,28 +1836,15 @@ void SpatialFeatureMatcher::Run() {
     std::cout << StringPrintf("Matching image [%d/%d]", i + 1, num_locations)
               << std::flush;
 
-    image_pairs.clear();
-
-    for (int j = 0; j < knn; ++j) {
-      // Check if query equals result.
-      if (index_matrix(i, j) == i) {
-        continue;
-      }
-
-      // Since the nearest neighbors are sorted by distance, we can break.
-      if (distance_matrix(i, j) > max_distance) {
-        break;
-      }
-
-      const size_t idx = location_idxs[i];
-      const image_t image_id = image_ids.at(idx);
-      const size_t nn_idx = location_idxs.at(index_matrix(i, j));
-      const image_t nn_image_id = image_ids.at(nn_idx);
-      image_pairs.emplace_back(image_id, nn_image_id);
+    const std::vector<std::pair<image_t, image_t>> image_pairs =
+        std::move(next_image_pairs);
+    if (i + 1 < num_locations) {
+      next_image_pairs = GetImagePairs(i + 1);
+    } else {
+      next_image_pairs.clear();
     }
 
-    DatabaseTransaction database_transaction(&database_);
-    matcher_.Match(image_pairs);
+    matcher_.Match(image_pairs, next_image_pairs);
 
     PrintElapsedTime(timer);
   }
@@ -1319,6 +1867,9 @@ TransitiveFeatureMatcher::TransitiveFeatureMatcher(
 void TransitiveFeatureMatcher::Run() {
   PrintHeading1("Transitive feature matching");
 
+  COLMAP_TRACE_STAGE("TransitiveMatching");
+  Tracer::Instance().SetThreadName("Feature matching");
+
   if (!matcher_.Setup()) {
     return;
   }
@@ -1375,7 +1926,6 @@ void TransitiveFeatureMatcher::Run() {
                 num_batches += 1;
                 std::cout << StringPrintf("  Batch %d", num_batches)
                           << std::flush;
-                DatabaseTransaction database_transaction(&database_);
                 matcher_.Match(image_pairs);
                 image_pairs.clear();
                 PrintElapsedTime(timer);
@@ -1394,7 +1944,6 @@ void TransitiveFeatureMatcher::Run() {
 
     num_batches += 1;
     std::cout << StringPrintf("  Batch %d", num_batches) << std::flush;
-    DatabaseTransaction database_transaction(&database_);
     matcher_.Match(image_pairs);
     PrintElapsedTime(timer);
   }
@@ -1417,6 +1966,9 @@ ImagePairsFeatureMatcher::ImagePairsFeatureMatcher(
 void ImagePairsFeatureMatcher::Run() {
   PrintHeading1("Custom feature matching");
 
+  COLMAP_TRACE_STAGE("ImagePairsMatching");
+  Tracer::Instance().SetThreadName("Feature matching");
+
   if (!matcher_.Setup()) {
     return;
   }
@@ -1501,7 +2053,6 @@ void ImagePairsFeatureMatcher::Run() {
       block_image_pairs.push_back(image_pairs[j]);
     }
 
-    DatabaseTransaction database_transaction(&database_);
     matcher_.Match(block_image_pairs);
 
     PrintElapsedTime(timer);
@@ -1524,6 +2075,9 @@ FeaturePairsFeatureMatcher::FeaturePairsFeatureMatcher(
 void FeaturePairsFeatureMatcher::Run() {
   PrintHeading1("Importing matches");
 
+  COLMAP_TRACE_STAGE("FeaturePairsMatching");
+  Tracer::Instance().SetThreadName("Feature matching");
+
   cache_.Setup();
 
   std::unordered_map<std::string, const Image*> image_name_to_image;
@@ -1633,10 +2187,12 @@ void FeaturePairsFeatureMatcher::Run() {
           static_cast<size_t>(match_options_.max_num_trials);
       two_view_geometry_options.ransac_options.min_inlier_ratio =
           match_options_.min_inlier_ratio;
+      two_view_geometry_options.ransac_options.use_sprt =
+          match_options_.use_sprt;
 
       two_view_geometry.Estimate(
-          camera1, FeatureKeypointsToPointsVector(keypoints1), camera2,
-          FeatureKeypointsToPointsVector(keypoints2), matches,
+          camera1, FeatureKeypointsToPointsVector(*keypoints1), camera2,
+          FeatureKeypointsToPointsVector(*keypoints2), matches,
           two_view_geometry_options);
 
       database_.WriteTwoViewGeometry(image1.ImageId(), image2.ImageId(),
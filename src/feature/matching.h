@@ -33,13 +33,15 @@
 #define COLMAP_SRC_FEATURE_MATCHING_H_
 
 #include <array>
+#include <condition_variable>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "base/database.h"
 #include "feature/sift.h"
 #include "util/alignment.h"
-#include "util/cache.h"
 #include "util/opengl_utils.h"
 #include "util/threading.h"
 #include "util/timer.h"
@@ -87,6 +89,10 @@ struct SequentialMatchingOptions {
   // Path to the vocabulary tree.
   std::string vocab_tree_path = "";
 
+  // Optional path to the persistent index of the images in the database. If
+  // the index exists, only images that are not yet indexed are added to it.
+  std::string image_index_path = "";
+
   bool Check() const;
 };
 
@@ -111,6 +117,10 @@ struct VocabTreeMatchingOptions {
   // Path to the vocabulary tree.
   std::string vocab_tree_path = "";
 
+  // Optional path to the persistent index of the images in the database. If
+  // the index exists, only images that are not yet indexed are added to it.
+  std::string image_index_path = "";
+
   // Optional path to file with specific image names to match.
   std::string match_list_path = "";
 
@@ -174,41 +184,156 @@ struct FeatureMatcherData {
   TwoViewGeometry two_view_geometry;
 };
 
+// Order the blocks in the upper triangle of the exhaustive match matrix, where
+// every block is given by its row and column index. The rows are grouped into
+// bands of `band_size` rows, and the columns of a band are visited in
+// alternating direction, such that consecutive bands start with the column,
+// at which the previous band finished.
+std::vector<std::pair<size_t, size_t>> OrderExhaustiveBlocks(
+    const size_t num_blocks, const size_t band_size);
+
+// Get the image pairs of a block of the exhaustive match matrix, where the
+// images are split into blocks of `block_size` consecutive images. The blocks
+// in the upper triangle together contain every image pair exactly once.
+std::vector<std::pair<image_t, image_t>> GetBlockImagePairs(
+    const std::vector<image_t>& image_ids, const size_t block_size,
+    const std::pair<size_t, size_t>& block);
+
 }  // namespace internal
 
 // Cache for feature matching to minimize database access during matching.
+//
+// The cache holds the keypoints and descriptors of at most `cache_size`
+// images. If the upcoming image pairs are known, they should be announced
+// with `SetSchedule`, e.g., by `SiftFeatureMatcher::Match` for every batch of
+// image pairs. Background threads then read the features of the upcoming
+// images ahead of time and, when the cache is full, the images needed
+// farthest in the future are evicted first (Belady's policy). Images without
+// any scheduled use are evicted in least recently used order.
 class FeatureMatcherCache {
  public:
+  struct Statistics {
+    // Number of feature requests that were served from memory, that waited
+    // for a pending prefetch, and that had to read from the database.
+    size_t num_hits = 0;
+    size_t num_prefetch_waits = 0;
+    size_t num_misses = 0;
+
+    // Number of images read ahead of time.
+    size_t num_prefetches = 0;
+
+    // Fraction of requests that did not have to read from the database.
+    double HitRate() const;
+  };
+
   FeatureMatcherCache(const size_t cache_size, const Database* database);
+  virtual ~FeatureMatcherCache();
 
   void Setup();
 
+  // Maximum number of images, whose features are cached.
+  size_t Capacity() const;
+
   const Camera& GetCamera(const camera_t camera_id) const;
   const Image& GetImage(const image_t image_id) const;
-  const FeatureKeypoints& GetKeypoints(const image_t image_id);
-  const FeatureDescriptors& GetDescriptors(const image_t image_id);
+  std::shared_ptr<const FeatureKeypoints> GetKeypoints(const image_t image_id);
+  std::shared_ptr<const FeatureDescriptors> GetDescriptors(
+      const image_t image_id);
+  size_t GetNumDescriptors(const image_t image_id);
   FeatureMatches GetMatches(const image_t image_id1, const image_t image_id2);
   std::vector<image_t> GetImageIds() const;
 
   bool ExistsMatches(const image_t image_id1, const image_t image_id2);
   bool ExistsInlierMatches(const image_t image_id1, const image_t image_id2);
 
-  void WriteMatches(const image_t image_id1, const image_t image_id2,
-                    const FeatureMatches& matches);
-  void WriteTwoViewGeometry(const image_t image_id1, const image_t image_id2,
-                            const TwoViewGeometry& two_view_geometry);
+  // Replace the schedule by the given image pairs, which are matched next in
+  // the given order, and start reading their features ahead of time.
+  void SetSchedule(const std::vector<std::pair<image_t, image_t>>& image_pairs);
 
-  void DeleteMatches(const image_t image_id1, const image_t image_id2);
-  void DeleteInlierMatches(const image_t image_id1, const image_t image_id2);
+  // Mark a scheduled image pair as finished, so that the features of images
+  // without further scheduled use can be evicted.
+  void FinishScheduledPair(const image_t image_id1, const image_t image_id2);
+
+  // Block until all started prefetches are finished.
+  void WaitForPrefetches();
+
+  // Identifiers of the images whose features are cached and not being read.
+  std::vector<image_t> GetCachedImageIds();
+
+  Statistics GetStatistics();
+
+ protected:
+  // Read the features of the image on the given connection. This is called
+  // concurrently by the prefetch threads and the requesting threads.
+  virtual void ReadImageFeatures(const Database& database,
+                                 const image_t image_id,
+                                 FeatureKeypoints* keypoints,
+                                 FeatureDescriptors* descriptors);
 
  private:
+  struct Features {
+    std::shared_ptr<const FeatureKeypoints> keypoints;
+    std::shared_ptr<const FeatureDescriptors> descriptors;
+    // Whether the features are currently being read.
+    bool pending = false;
+    // Time of the last request for least recently used eviction.
+    size_t last_access = 0;
+  };
+
+  Features GetFeatures(const image_t image_id);
+
+  // Read the features on the given connection and store them in the cache.
+  // The read features are returned, since the cache entry may be evicted as
+  // soon as the lock is released. A finished prefetch continues prefetching
+  // before any waiting request is woken up.
+  Features ReadFeatures(const image_t image_id, const Database& database,
+                        const bool prefetch);
+
+  // Index of the next scheduled image pair that uses the image.
+  size_t NextScheduledUse(const image_t image_id) const;
+
+  // Find the image to evict first, i.e. the image that is used farthest in the
+  // future and, among images that are used at the same time, the least
+  // recently used one. Images whose features are being read are never evicted.
+  std::unordered_map<image_t, Features>::iterator FindEvictionCandidate(
+      size_t* next_use);
+
+  // Evict an image to make room for an image that is next used at the given
+  // pair index. Only images that are used later are evicted, unless forced.
+  // Returns false if there is no room.
+  bool MakeRoom(const size_t next_use, const bool force);
+
+  // Start reading the features of the upcoming scheduled images.
+  void Prefetch();
+
   const size_t cache_size_;
   const Database* database_;
   std::mutex database_mutex_;
   EIGEN_STL_UMAP(camera_t, Camera) cameras_cache_;
   EIGEN_STL_UMAP(image_t, Image) images_cache_;
-  std::unique_ptr<LRUCache<image_t, FeatureKeypoints>> keypoints_cache_;
-  std::unique_ptr<LRUCache<image_t, FeatureDescriptors>> descriptors_cache_;
+
+  // The cached features and the state of the schedule, guarded by the mutex.
+  std::mutex features_mutex_;
+  std::condition_variable features_condition_;
+  std::unordered_map<image_t, Features> features_cache_;
+  size_t num_accesses_;
+  Statistics statistics_;
+
+  // The scheduled image pairs, the indices of the pairs that use each image,
+  // and which pairs are finished. All pairs before `schedule_begin_` are
+  // finished and the next image to prefetch is at `prefetch_pos_`, where
+  // every pair consists of two positions.
+  std::vector<std::pair<image_t, image_t>> schedule_;
+  std::unordered_map<image_t, std::vector<size_t>> schedule_uses_;
+  std::unordered_map<image_pair_t, size_t> schedule_pair_idxs_;
+  std::vector<bool> schedule_finished_;
+  size_t schedule_begin_;
+  size_t prefetch_pos_;
+  size_t num_pending_prefetches_;
+
+  // Every prefetch thread reads through its own database connection.
+  std::vector<std::unique_ptr<Database>> prefetch_connections_;
+  std::unique_ptr<ThreadPool> prefetch_thread_pool_;
 };
 
 class FeatureMatcherThread : public Thread {
@@ -263,7 +388,8 @@ class SiftGPUFeatureMatcher : public FeatureMatcherThread {
 
   // The previously uploaded images to the GPU.
   std::array<image_t, 2> prev_uploaded_image_ids_;
-  std::array<FeatureDescriptors, 2> prev_uploaded_descriptors_;
+  std::array<std::shared_ptr<const FeatureDescriptors>, 2>
+      prev_uploaded_descriptors_;
 };
 
 class GuidedSiftCPUFeatureMatcher : public FeatureMatcherThread {
@@ -307,8 +433,10 @@ class GuidedSiftGPUFeatureMatcher : public FeatureMatcherThread {
 
   // The previously uploaded images to the GPU.
   std::array<image_t, 2> prev_uploaded_image_ids_;
-  std::array<FeatureKeypoints, 2> prev_uploaded_keypoints_;
-  std::array<FeatureDescriptors, 2> prev_uploaded_descriptors_;
+  std::array<std::shared_ptr<const FeatureKeypoints>, 2>
+      prev_uploaded_keypoints_;
+  std::array<std::shared_ptr<const FeatureDescriptors>, 2>
+      prev_uploaded_descriptors_;
 };
 
 class TwoViewGeometryVerifier : public Thread {
@@ -333,9 +461,11 @@ class TwoViewGeometryVerifier : public Thread {
 
 // Multi-threaded and multi-GPU SIFT feature matcher, which writes the computed
 // results to the database and skips already matched image pairs. To improve
-// performance of the matching by taking advantage of caching and database
-// transactions, pass multiple images to the `Match` function. Note that the
-// database should be in an active transaction while calling `Match`.
+// performance of the matching by taking advantage of caching, pass multiple
+// images to the `Match` function. The results are written asynchronously by a
+// `DatabaseWriter` in batched transactions, so that the writes do not block
+// the matchers from reading features. All writes of a batch are committed at
+// the latest when matching the next batch or destructing the matcher.
 class SiftFeatureMatcher {
  public:
   SiftFeatureMatcher(const SiftMatchingOptions& options, Database* database,
@@ -346,13 +476,17 @@ class SiftFeatureMatcher {
   // Setup the matchers and return if successful.
   bool Setup();
 
-  // Match one batch of multiple image pairs.
-  void Match(const std::vector<std::pair<image_t, image_t>>& image_pairs);
+  // Match one batch of multiple image pairs. The features of the optional
+  // next image pairs are read ahead of time, if there is room in the cache.
+  void Match(const std::vector<std::pair<image_t, image_t>>& image_pairs,
+             const std::vector<std::pair<image_t, image_t>>& next_image_pairs =
+                 std::vector<std::pair<image_t, image_t>>());
 
  private:
   SiftMatchingOptions options_;
   Database* database_;
   FeatureMatcherCache* cache_;
+  std::unique_ptr<DatabaseWriter> database_writer_;
 
   bool is_setup_;
 
@@ -367,29 +501,31 @@ class SiftFeatureMatcher {
   JobQueue<internal::FeatureMatcherData> output_queue_;
 };
 
-// Exhaustively match images by processing each block in the exhaustive match
-// matrix in one batch:
+// Exhaustively match images by processing each block in the upper triangle of
+// the exhaustive match matrix in one batch:
 //
-// +----+----+-----------------> images[i]
-// |#000|0000|
-// |1#00|1000| <- Above the main diagonal, the block diagonal is not matched
-// |11#0|1100|                                                             ^
-// |111#|1110|                                                             |
-// +----+----+                                                             |
-// |1000|#000|\                                                            |
-// |1100|1#00| \ One block                                                 |
-// |1110|11#0| / of image pairs                                            |
-// |1111|111#|/                                                            |
-// +----+----+                                                             |
-// |  ^                                                                    |
-// |  |                                                                    |
-// | Below the main diagonal, the block diagonal is matched <--------------+
+// +---+---+---+-----------> images[i]
+// |#11|111|111|
+// |0#1|111|111| <- One block of image pairs
+// |00#|111|111|
+// +---+---+---+
+// |000|#11|111|
+// |000|0#1|111|
+// |000|00#|111|
+// +---+---+---+
 // |
 // v
 // images[i]
 //
 // Pairs will only be matched if 1, to avoid duplicate pairs. Pairs with #
 // are on the main diagonal and denote pairs of the same image.
+//
+// The rows of blocks are processed in bands, whose images remain in the
+// cache, while the columns of a band are visited in alternating direction.
+// The band size is chosen such that the band, the current column, and the
+// next column fit into the cache, so that the features of an image are read
+// from the database about `num_blocks / band_size` instead of `num_blocks`
+// times. The features of the next block are read while matching the current.
 class ExhaustiveFeatureMatcher : public Thread {
  public:
   ExhaustiveFeatureMatcher(const ExhaustiveMatchingOptions& options,
@@ -0,0 +1,348 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "feature/matching"
+#include "util/testing.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include "base/database.h"
+#include "feature/matching.h"
+#include "util/misc.h"
+
+using namespace colmap;
+
+namespace {
+
+std::string CreateTestDatabase(const image_t num_images) {
+  const std::string database_path =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path())
+          .string();
+  Database database(database_path);
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_PINHOLE", 1.0, 1, 1);
+  camera.SetCameraId(database.WriteCamera(camera));
+  for (image_t i = 1; i <= num_images; ++i) {
+    Image image;
+    image.SetName("image" + std::to_string(i));
+    image.SetCameraId(camera.CameraId());
+    const image_t image_id = database.WriteImage(image);
+    BOOST_CHECK_EQUAL(image_id, i);
+    // The number of features identifies the image.
+    database.WriteKeypoints(image_id, FeatureKeypoints(image_id));
+    database.WriteDescriptors(image_id, FeatureDescriptors(image_id, 128));
+  }
+  return database_path;
+}
+
+// Cache that counts the reads of every image and can block them.
+class TestFeatureMatcherCache : public FeatureMatcherCache {
+ public:
+  TestFeatureMatcherCache(const size_t cache_size, const Database* database)
+      : FeatureMatcherCache(cache_size, database) {}
+
+  ~TestFeatureMatcherCache() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      blocked_image_ids_.clear();
+    }
+    condition_.notify_all();
+    WaitForPrefetches();
+  }
+
+  void Block(const image_t image_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    blocked_image_ids_.insert(image_id);
+  }
+
+  void Unblock(const image_t image_id) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      blocked_image_ids_.erase(image_id);
+    }
+    condition_.notify_all();
+  }
+
+  size_t NumReads(const image_t image_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return num_reads_[image_id];
+  }
+
+  std::set<image_t> CachedImageIds() {
+    const std::vector<image_t> image_ids = GetCachedImageIds();
+    BOOST_CHECK_LE(image_ids.size(), Capacity());
+    return std::set<image_t>(image_ids.begin(), image_ids.end());
+  }
+
+ protected:
+  void ReadImageFeatures(const Database& database, const image_t image_id,
+                         FeatureKeypoints* keypoints,
+                         FeatureDescriptors* descriptors) override {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      num_reads_[image_id] += 1;
+      condition_.wait(lock, [this, image_id]() {
+        return blocked_image_ids_.count(image_id) == 0;
+      });
+    }
+    FeatureMatcherCache::ReadImageFeatures(database, image_id, keypoints,
+                                           descriptors);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::set<image_t> blocked_image_ids_;
+  std::unordered_map<image_t, size_t> num_reads_;
+};
+
+// Wait until the given number of requests waits for a pending prefetch.
+void WaitForPrefetchWaits(FeatureMatcherCache* cache,
+                          const size_t num_prefetch_waits) {
+  while (cache->GetStatistics().num_prefetch_waits < num_prefetch_waits) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestFeatureMatcherCacheEviction) {
+  const std::string database_path = CreateTestDatabase(5);
+  Database database(database_path);
+  TestFeatureMatcherCache cache(3, &database);
+  cache.Setup();
+
+  // The first three images are prefetched. The fourth image is only needed
+  // after the others and does not fit into the cache.
+  cache.SetSchedule({{1, 2}, {3, 1}, {4, 2}});
+  cache.WaitForPrefetches();
+  BOOST_CHECK(cache.CachedImageIds() == std::set<image_t>({1, 2, 3}));
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(1)->size(), 1);
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(2)->size(), 2);
+  cache.FinishScheduledPair(1, 2);
+  cache.WaitForPrefetches();
+  BOOST_CHECK(cache.CachedImageIds() == std::set<image_t>({1, 2, 3}));
+
+  // An unscheduled request evicts the image whose next use is farthest away.
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(5)->size(), 5);
+  BOOST_CHECK(cache.CachedImageIds() == std::set<image_t>({1, 3, 5}));
+
+  // Once no image is used anymore, the least recently used images are evicted
+  // to prefetch the remaining images.
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(3)->size(), 3);
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(1)->size(), 1);
+  cache.FinishScheduledPair(3, 1);
+  cache.WaitForPrefetches();
+  BOOST_CHECK(cache.CachedImageIds() == std::set<image_t>({1, 2, 4}));
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(4)->size(), 4);
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(2)->size(), 2);
+  cache.FinishScheduledPair(4, 2);
+
+  const auto statistics = cache.GetStatistics();
+  BOOST_CHECK_EQUAL(statistics.num_hits, 6);
+  BOOST_CHECK_EQUAL(statistics.num_prefetch_waits, 0);
+  BOOST_CHECK_EQUAL(statistics.num_misses, 1);
+  BOOST_CHECK_EQUAL(statistics.num_prefetches, 5);
+  BOOST_CHECK_EQUAL(statistics.HitRate(), 6.0 / 7.0);
+  BOOST_CHECK_EQUAL(cache.NumReads(1), 1);
+  BOOST_CHECK_EQUAL(cache.NumReads(2), 2);
+  BOOST_CHECK_EQUAL(cache.NumReads(3), 1);
+  BOOST_CHECK_EQUAL(cache.NumReads(4), 1);
+  BOOST_CHECK_EQUAL(cache.NumReads(5), 1);
+
+  database.Close();
+  boost::filesystem::remove(database_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestFeatureMatcherCachePrefetchWait) {
+  const std::string database_path = CreateTestDatabase(2);
+  Database database(database_path);
+  TestFeatureMatcherCache cache(2, &database);
+  cache.Setup();
+
+  cache.Block(1);
+  cache.SetSchedule({{1, 2}});
+
+  size_t num_keypoints = 0;
+  std::thread thread([&cache, &num_keypoints]() {
+    num_keypoints = cache.GetKeypoints(1)->size();
+  });
+  WaitForPrefetchWaits(&cache, 1);
+  cache.Unblock(1);
+  thread.join();
+
+  BOOST_CHECK_EQUAL(num_keypoints, 1);
+  cache.WaitForPrefetches();
+  BOOST_CHECK(cache.CachedImageIds() == std::set<image_t>({1, 2}));
+  BOOST_CHECK_EQUAL(cache.GetKeypoints(2)->size(), 2);
+
+  const auto statistics = cache.GetStatistics();
+  BOOST_CHECK_EQUAL(statistics.num_hits, 1);
+  BOOST_CHECK_EQUAL(statistics.num_prefetch_waits, 1);
+  BOOST_CHECK_EQUAL(statistics.num_misses, 0);
+  BOOST_CHECK_EQUAL(statistics.num_prefetches, 2);
+  BOOST_CHECK_EQUAL(cache.NumReads(1), 1);
+  BOOST_CHECK_EQUAL(cache.NumReads(2), 1);
+
+  database.Close();
+  boost::filesystem::remove(database_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestFeatureMatcherCacheEvictedPrefetchWait) {
+  const std::string database_path = CreateTestDatabase(5);
+  Database database(database_path);
+  TestFeatureMatcherCache cache(1, &database);
+  cache.Setup();
+
+  // The first image is prefetched and, since its first pair is finished
+  // before the read, it is evicted right after the read to prefetch the third
+  // image, which is used before the first image is used again.
+  cache.Block(1);
+  cache.Block(3);
+  cache.SetSchedule({{1, 2}, {3, 4}, {1, 5}});
+  cache.FinishScheduledPair(1, 2);
+
+  size_t num_keypoints = 0;
+  std::thread thread([&cache, &num_keypoints]() {
+    num_keypoints = cache.GetKeypoints(1)->size();
+  });
+  WaitForPrefetchWaits(&cache, 1);
+  cache.Unblock(1);
+  thread.join();
+
+  // The waiting request reads the evicted image again, which exceeds the
+  // capacity while the third image is still being read.
+  BOOST_CHECK_EQUAL(num_keypoints, 1);
+  BOOST_CHECK_EQUAL(cache.NumReads(1), 2);
+  BOOST_CHECK(cache.CachedImageIds() == std::set<image_t>({1}));
+
+  // The capacity is restored once the third image is read.
+  cache.Unblock(3);
+  cache.WaitForPrefetches();
+  BOOST_CHECK_EQUAL(cache.NumReads(3), 1);
+  BOOST_CHECK(cache.CachedImageIds() == std::set<image_t>({3}));
+
+  const auto statistics = cache.GetStatistics();
+  BOOST_CHECK_EQUAL(statistics.num_hits, 0);
+  BOOST_CHECK_EQUAL(statistics.num_prefetch_waits, 1);
+  BOOST_CHECK_EQUAL(statistics.num_misses, 0);
+
+  database.Close();
+  boost::filesystem::remove(database_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestOrderExhaustiveBlocks) {
+  for (size_t num_blocks = 0; num_blocks <= 10; ++num_blocks) {
+    for (size_t band_size = 1; band_size <= num_blocks + 1; ++band_size) {
+      const std::vector<std::pair<size_t, size_t>> blocks =
+          internal::OrderExhaustiveBlocks(num_blocks, band_size);
+
+      // Every block of the upper triangle appears exactly once.
+      BOOST_CHECK_EQUAL(blocks.size(), num_blocks * (num_blocks + 1) / 2);
+      std::set<std::pair<size_t, size_t>> unique_blocks;
+      for (const auto& block : blocks) {
+        BOOST_CHECK_LE(block.first, block.second);
+        BOOST_CHECK_LT(block.second, num_blocks);
+        unique_blocks.insert(block);
+      }
+      BOOST_CHECK_EQUAL(unique_blocks.size(), blocks.size());
+
+      // The blocks of a band are contiguous and the columns outside of the
+      // band are visited in opposite directions by consecutive bands.
+      size_t block_idx = 0;
+      int prev_direction = 0;
+      for (size_t band_begin = 0; band_begin < num_blocks;
+           band_begin += band_size) {
+        const size_t band_end = std::min(num_blocks, band_begin + band_size);
+        const size_t num_band_blocks =
+            (band_end - band_begin) * (2 * num_blocks - band_begin -
+                                       band_end + 1) / 2;
+        std::vector<size_t> cols;
+        for (size_t i = 0; i < num_band_blocks; ++i, ++block_idx) {
+          BOOST_REQUIRE_LT(block_idx, blocks.size());
+          BOOST_CHECK_GE(blocks[block_idx].first, band_begin);
+          BOOST_CHECK_LT(blocks[block_idx].first, band_end);
+          if (blocks[block_idx].second >= band_end &&
+              (cols.empty() || cols.back() != blocks[block_idx].second)) {
+            cols.push_back(blocks[block_idx].second);
+          }
+        }
+
+        if (cols.size() < 2) {
+          continue;
+        }
+
+        const int direction = cols.front() < cols.back() ? 1 : -1;
+        for (size_t i = 1; i < cols.size(); ++i) {
+          BOOST_CHECK_EQUAL(cols[i] > cols[i - 1] ? 1 : -1, direction);
+        }
+        BOOST_CHECK_NE(direction, prev_direction);
+        prev_direction = direction;
+      }
+      BOOST_CHECK_EQUAL(block_idx, blocks.size());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestGetBlockImagePairs) {
+  for (size_t num_images = 0; num_images <= 20; ++num_images) {
+    std::vector<image_t> image_ids(num_images);
+    for (size_t i = 0; i < num_images; ++i) {
+      image_ids[i] = static_cast<image_t>(2 * i + 1);
+    }
+
+    for (size_t block_size = 1; block_size <= num_images + 1; ++block_size) {
+      const size_t num_blocks = (num_images + block_size - 1) / block_size;
+
+      std::set<std::pair<image_t, image_t>> image_pairs;
+      size_t num_image_pairs = 0;
+      for (const auto& block : internal::OrderExhaustiveBlocks(num_blocks, 2)) {
+        for (const auto& image_pair :
+             internal::GetBlockImagePairs(image_ids, block_size, block)) {
+          BOOST_CHECK_LT(image_pair.first, image_pair.second);
+          image_pairs.emplace(std::min(image_pair.first, image_pair.second),
+                              std::max(image_pair.first, image_pair.second));
+          num_image_pairs += 1;
+        }
+      }
+
+      // Every unordered image pair appears exactly once.
+      BOOST_CHECK_EQUAL(num_image_pairs, num_images * (num_images - 1) / 2);
+      BOOST_CHECK_EQUAL(image_pairs.size(), num_image_pairs);
+    }
+  }
+}
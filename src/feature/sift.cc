@@ -35,6 +35,10 @@
 #include <fstream>
 #include <memory>
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
 #include "FLANN/flann.hpp"
 #include "SiftGPU/SiftGPU.h"
 #include "VLFeat/covdet.h"
@@ -45,38 +49,127 @@
 #include "util/math.h"
 #include "util/misc.h"
 #include "util/opengl_utils.h"
+#include "util/simd.h"
 
 namespace colmap {
-namespace {
+namespace internal {
+
+// The products are computed in 16-bit and accumulated in 32-bit integers,
+// which cannot overflow since 2 * 255 * 255 < 2^31.
+void ComputeSiftDescriptorDotProductsBaseline(const uint8_t* descriptor1,
+                                              const uint8_t* descriptors2,
+                                              const int num_descriptors2,
+                                              int* dots) {
+  for (int i2 = 0; i2 < num_descriptors2; ++i2) {
+    const uint8_t* descriptor2 = descriptors2 + i2 * 128;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < 128; i += 16) {
+      const __m128i values1 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor1 + i));
+      const __m128i values2 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor2 + i));
+      sum = _mm_add_epi32(sum,
+                          _mm_madd_epi16(_mm_unpacklo_epi8(values1, zero),
+                                         _mm_unpacklo_epi8(values2, zero)));
+      sum = _mm_add_epi32(sum,
+                          _mm_madd_epi16(_mm_unpackhi_epi8(values1, zero),
+                                         _mm_unpackhi_epi8(values2, zero)));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    dots[i2] = _mm_cvtsi128_si32(sum);
+#else
+    int dot = 0;
+    for (int i = 0; i < 128; ++i) {
+      dot += static_cast<int>(descriptor1[i]) *
+             static_cast<int>(descriptor2[i]);
+    }
+    dots[i2] = dot;
+#endif
+  }
+}
 
-size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
-                                       const float max_ratio,
-                                       const float max_distance,
-                                       std::vector<int>* matches) {
-  // SIFT descriptor vectors are normalized to length 512.
-  const float kDistNorm = 1.0f / (512.0f * 512.0f);
+#if defined(COLMAP_HAS_TARGET_AVX2)
+
+// The first descriptor is widened to 16-bit once and kept in registers for the
+// whole block.
+COLMAP_TARGET_AVX2 void ComputeSiftDescriptorDotProductsAVX2(
+    const uint8_t* descriptor1, const uint8_t* descriptors2,
+    const int num_descriptors2, int* dots) {
+  __m256i values1[8];
+  for (int i = 0; i < 8; ++i) {
+    values1[i] = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(descriptor1 + 16 * i)));
+  }
 
-  size_t num_matches = 0;
-  matches->resize(dists.rows(), -1);
+  for (int i2 = 0; i2 < num_descriptors2; ++i2) {
+    const uint8_t* descriptor2 = descriptors2 + i2 * 128;
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < 8; ++i) {
+      const __m256i values2 = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(descriptor2 + 16 * i)));
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(values1[i], values2));
+    }
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                   _mm256_extracti128_si256(sum, 1));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0x4E));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0xB1));
+    dots[i2] = _mm_cvtsi128_si32(sum128);
+  }
+}
 
-  for (Eigen::Index i1 = 0; i1 < dists.rows(); ++i1) {
-    int best_i2 = -1;
-    int best_dist = 0;
-    int second_best_dist = 0;
-    for (Eigen::Index i2 = 0; i2 < dists.cols(); ++i2) {
-      const int dist = dists(i1, i2);
-      if (dist > best_dist) {
-        best_i2 = i2;
-        second_best_dist = best_dist;
-        best_dist = dist;
-      } else if (dist > second_best_dist) {
-        second_best_dist = dist;
-      }
+#endif
+
+}  // namespace internal
+
+namespace {
+
+// Number of descriptors per block in the tiled brute-force matching. Two
+// blocks of 128-byte descriptors fit comfortably into the L1 cache.
+const Eigen::Index kBruteForceBlockSize = 64;
+
+// Computes the dot products with the fastest instruction set of the CPU.
+void ComputeSiftDescriptorDotProducts(const uint8_t* descriptor1,
+                                      const uint8_t* descriptors2,
+                                      const int num_descriptors2, int* dots) {
+#if defined(COLMAP_HAS_TARGET_AVX2)
+  if (CPUHasAVX2()) {
+    internal::ComputeSiftDescriptorDotProductsAVX2(descriptor1, descriptors2,
+                                                   num_descriptors2, dots);
+    return;
+  }
+#endif
+  internal::ComputeSiftDescriptorDotProductsBaseline(descriptor1, descriptors2,
+                                                     num_descriptors2, dots);
+}
+
+// The best and second best match of a descriptor found so far.
+struct SiftBestMatch {
+  int best_idx = -1;
+  int best_dist = 0;
+  int second_best_dist = 0;
+
+  inline void Update(const int idx, const int dist) {
+    if (dist > best_dist) {
+      best_idx = idx;
+      second_best_dist = best_dist;
+      best_dist = dist;
+    } else if (dist > second_best_dist) {
+      second_best_dist = dist;
     }
+  }
+
+  // Returns the index of the best match or -1, if the match fails the
+  // distance threshold or the ratio test.
+  int GetMatchIdx(const float max_ratio, const float max_distance) const {
+    // SIFT descriptor vectors are normalized to length 512.
+    const float kDistNorm = 1.0f / (512.0f * 512.0f);
 
     // Check if any match found.
-    if (best_i2 == -1) {
-      continue;
+    if (best_idx == -1) {
+      return -1;
     }
 
     const float best_dist_normed =
@@ -84,7 +177,7 @@ size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
 
     // Check if match distance passes threshold.
     if (best_dist_normed > max_distance) {
-      continue;
+      return -1;
     }
 
     const float second_best_dist_normed =
@@ -93,50 +186,93 @@ size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
     // Check if match passes ratio test. Keep this comparison >= in order to
     // ensure that the case of best == second_best is detected.
     if (best_dist_normed >= max_ratio * second_best_dist_normed) {
-      continue;
+      return -1;
     }
 
-    num_matches += 1;
-    (*matches)[i1] = best_i2;
+    return best_idx;
   }
-
-  return num_matches;
-}
-
-void FindBestMatchesBruteForce(const Eigen::MatrixXi& dists,
-                               const float max_ratio, const float max_distance,
-                               const bool cross_check,
-                               FeatureMatches* matches) {
+};
+
+// Exhaustively match the descriptors in blocks of descriptors, such that the
+// full distance matrix is never materialized. The best matches in both
+// directions are tracked while iterating over the blocks, which visits every
+// row and column in increasing order and thus yields the same result as
+// scanning the full distance matrix. Pairs rejected by the optional guided
+// filter are skipped, which is equivalent to a distance of zero.
+void FindBestMatchesBruteForce(
+    const FeatureKeypoints* keypoints1, const FeatureKeypoints* keypoints2,
+    const FeatureDescriptors& descriptors1,
+    const FeatureDescriptors& descriptors2,
+    const std::function<bool(float, float, float, float)>& guided_filter,
+    const float max_ratio, const float max_distance, const bool cross_check,
+    FeatureMatches* matches) {
   matches->clear();
 
-  std::vector<int> matches12;
-  const size_t num_matches12 = FindBestMatchesOneWayBruteForce(
-      dists, max_ratio, max_distance, &matches12);
+  if (guided_filter != nullptr) {
+    CHECK_NOTNULL(keypoints1);
+    CHECK_NOTNULL(keypoints2);
+    CHECK_EQ(keypoints1->size(), descriptors1.rows());
+    CHECK_EQ(keypoints2->size(), descriptors2.rows());
+  }
 
-  if (cross_check) {
-    std::vector<int> matches21;
-    const size_t num_matches21 = FindBestMatchesOneWayBruteForce(
-        dists.transpose(), max_ratio, max_distance, &matches21);
-    matches->reserve(std::min(num_matches12, num_matches21));
-    for (size_t i1 = 0; i1 < matches12.size(); ++i1) {
-      if (matches12[i1] != -1 && matches21[matches12[i1]] != -1 &&
-          matches21[matches12[i1]] == static_cast<int>(i1)) {
-        FeatureMatch match;
-        match.point2D_idx1 = i1;
-        match.point2D_idx2 = matches12[i1];
-        matches->push_back(match);
+  const Eigen::Index num_descriptors1 = descriptors1.rows();
+  const Eigen::Index num_descriptors2 = descriptors2.rows();
+  if (num_descriptors1 == 0 || num_descriptors2 == 0) {
+    return;
+  }
+
+  CHECK_EQ(descriptors1.cols(), 128);
+  CHECK_EQ(descriptors2.cols(), 128);
+
+  std::vector<SiftBestMatch> best_matches12(num_descriptors1);
+  std::vector<SiftBestMatch> best_matches21(cross_check ? num_descriptors2
+                                                        : 0);
+
+  std::array<int, kBruteForceBlockSize> dists;
+
+  for (Eigen::Index block_start1 = 0; block_start1 < num_descriptors1;
+       block_start1 += kBruteForceBlockSize) {
+    const Eigen::Index block_end1 =
+        std::min(block_start1 + kBruteForceBlockSize, num_descriptors1);
+    for (Eigen::Index block_start2 = 0; block_start2 < num_descriptors2;
+         block_start2 += kBruteForceBlockSize) {
+      const Eigen::Index block_end2 =
+          std::min(block_start2 + kBruteForceBlockSize, num_descriptors2);
+      for (Eigen::Index i1 = block_start1; i1 < block_end1; ++i1) {
+        ComputeSiftDescriptorDotProducts(
+            descriptors1.data() + i1 * 128,
+            descriptors2.data() + block_start2 * 128,
+            static_cast<int>(block_end2 - block_start2), dists.data());
+        SiftBestMatch& best_match12 = best_matches12[i1];
+        for (Eigen::Index i2 = block_start2; i2 < block_end2; ++i2) {
+          if (guided_filter != nullptr &&
+              guided_filter((*keypoints1)[i1].x, (*keypoints1)[i1].y,
+                            (*keypoints2)[i2].x, (*keypoints2)[i2].y)) {
+            continue;
+          }
+          const int dist = dists[i2 - block_start2];
+          best_match12.Update(i2, dist);
+          if (cross_check) {
+            best_matches21[i2].Update(i1, dist);
+          }
+        }
       }
     }
-  } else {
-    matches->reserve(num_matches12);
-    for (size_t i1 = 0; i1 < matches12.size(); ++i1) {
-      if (matches12[i1] != -1) {
-        FeatureMatch match;
-        match.point2D_idx1 = i1;
-        match.point2D_idx2 = matches12[i1];
-        matches->push_back(match);
-      }
+  }
+
+  for (Eigen::Index i1 = 0; i1 < num_descriptors1; ++i1) {
+    const int i2 = best_matches12[i1].GetMatchIdx(max_ratio, max_distance);
+    if (i2 == -1) {
+      continue;
     }
+    if (cross_check &&
+        best_matches21[i2].GetMatchIdx(max_ratio, max_distance) != i1) {
+      continue;
+    }
+    FeatureMatch match;
+    match.point2D_idx1 = i1;
+    match.point2D_idx2 = i2;
+    matches->push_back(match);
   }
 }
 
@@ -165,41 +301,6 @@ FeatureDescriptors TransformVLFeatToUBCFeatureDescriptors(
   return ubc_descriptors;
 }
 
-Eigen::MatrixXi ComputeSiftDistanceMatrix(
-    const FeatureKeypoints* keypoints1, const FeatureKeypoints* keypoints2,
-    const FeatureDescriptors& descriptors1,
-    const FeatureDescriptors& descriptors2,
-    const std::function<bool(float, float, float, float)>& guided_filter) {
-  if (guided_filter != nullptr) {
-    CHECK_NOTNULL(keypoints1);
-    CHECK_NOTNULL(keypoints2);
-    CHECK_EQ(keypoints1->size(), descriptors1.rows());
-    CHECK_EQ(keypoints2->size(), descriptors2.rows());
-  }
-
-  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors1_int =
-      descriptors1.cast<int>();
-  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors2_int =
-      descriptors2.cast<int>();
-
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dists(
-      descriptors1.rows(), descriptors2.rows());
-
-  for (FeatureDescriptors::Index i1 = 0; i1 < descriptors1.rows(); ++i1) {
-    for (FeatureDescriptors::Index i2 = 0; i2 < descriptors2.rows(); ++i2) {
-      if (guided_filter != nullptr &&
-          guided_filter((*keypoints1)[i1].x, (*keypoints1)[i1].y,
-                        (*keypoints2)[i2].x, (*keypoints2)[i2].y)) {
-        dists(i1, i2) = 0;
-      } else {
-        dists(i1, i2) = descriptors1_int.row(i1).dot(descriptors2_int.row(i2));
-      }
-    }
-  }
-
-  return dists;
-}
-
 void FindBestMatchesOneWayFLANN(
     const FeatureDescriptors& query, const FeatureDescriptors& database,
     Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>*
@@ -371,6 +472,7 @@ bool SiftExtractionOptions::Check() const {
     CHECK_OPTION_GT(CSVToVector<int>(gpu_index).size(), 0);
   }
   CHECK_OPTION_GT(max_image_size, 0);
+  CHECK_OPTION_GT(max_image_buffer_mb, 0);
   CHECK_OPTION_GT(max_num_features, 0);
   CHECK_OPTION_GT(octave_resolution, 0);
   CHECK_OPTION_GT(peak_threshold, 0.0);
@@ -397,6 +499,8 @@ bool SiftMatchingOptions::Check() const {
   CHECK_OPTION_GE(min_inlier_ratio, 0);
   CHECK_OPTION_LE(min_inlier_ratio, 1);
   CHECK_OPTION_GE(min_num_inliers, 0);
+  CHECK_OPTION_GT(write_batch_size, 0);
+  CHECK_OPTION_GE(write_batch_seconds, 0);
   return true;
 }
 
@@ -965,10 +1069,8 @@ void MatchSiftFeaturesCPUBruteForce(const SiftMatchingOptions& match_options,
   CHECK(match_options.Check());
   CHECK_NOTNULL(matches);
 
-  const Eigen::MatrixXi distances = ComputeSiftDistanceMatrix(
-      nullptr, nullptr, descriptors1, descriptors2, nullptr);
-
-  FindBestMatchesBruteForce(distances, match_options.max_ratio,
+  FindBestMatchesBruteForce(nullptr, nullptr, descriptors1, descriptors2,
+                            nullptr, match_options.max_ratio,
                             match_options.max_distance,
                             match_options.cross_check, matches);
 }
@@ -1006,7 +1108,18 @@ void MatchSiftFeaturesCPU(const SiftMatchingOptions& match_options,
                           const FeatureDescriptors& descriptors1,
                           const FeatureDescriptors& descriptors2,
                           FeatureMatches* matches) {
-  MatchSiftFeaturesCPUFLANN(match_options, descriptors1, descriptors2, matches);
+  // The exhaustive search is exact and faster than the approximate search of
+  // FLANN up to about the default maximum number of extracted features.
+  const size_t kMaxNumBruteForcePairs = 8192 * 8192;
+  if (static_cast<size_t>(descriptors1.rows()) *
+          static_cast<size_t>(descriptors2.rows()) <=
+      kMaxNumBruteForcePairs) {
+    MatchSiftFeaturesCPUBruteForce(match_options, descriptors1, descriptors2,
+                                   matches);
+  } else {
+    MatchSiftFeaturesCPUFLANN(match_options, descriptors1, descriptors2,
+                              matches);
+  }
 }
 
 void MatchGuidedSiftFeaturesCPU(const SiftMatchingOptions& match_options,
@@ -1054,31 +1167,11 @@ void MatchGuidedSiftFeaturesCPU(const SiftMatchingOptions& match_options,
 
   CHECK(guided_filter);
 
-  const Eigen::MatrixXi dists = ComputeSiftDistanceMatrix(
-      &keypoints1, &keypoints2, descriptors1, descriptors2, guided_filter);
-
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      indices_1to2(dists.rows(), dists.cols());
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      indices_2to1(dists.cols(), dists.rows());
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      distances_1to2 = dists;
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      distances_2to1 = dists.transpose();
-
-  for (int i = 0; i < indices_1to2.rows(); ++i) {
-    indices_1to2.row(i) = Eigen::VectorXi::LinSpaced(indices_1to2.cols(), 0,
-                                                     indices_1to2.cols() - 1);
-  }
-  for (int i = 0; i < indices_2to1.rows(); ++i) {
-    indices_2to1.row(i) = Eigen::VectorXi::LinSpaced(indices_2to1.cols(), 0,
-                                                     indices_2to1.cols() - 1);
-  }
-
-  FindBestMatchesFLANN(indices_1to2, distances_1to2, indices_2to1,
-                       distances_2to1, match_options.max_ratio,
-                       match_options.max_distance, match_options.cross_check,
-                       &two_view_geometry->inlier_matches);
+  FindBestMatchesBruteForce(&keypoints1, &keypoints2, descriptors1,
+                            descriptors2, guided_filter,
+                            match_options.max_ratio, match_options.max_distance,
+                            match_options.cross_check,
+                            &two_view_geometry->inlier_matches);
 }
 
 bool CreateSiftGPUMatcher(const SiftMatchingOptions& match_options,
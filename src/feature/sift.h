@@ -35,6 +35,7 @@
 #include "estimators/two_view_geometry.h"
 #include "feature/types.h"
 #include "util/bitmap.h"
+#include "util/simd.h"
 
 class SiftGPU;
 class SiftMatchGPU;
@@ -55,6 +56,10 @@ struct SiftExtractionOptions {
   // Maximum image size, otherwise image will be down-scaled.
   int max_image_size = 3200;
 
+  // Maximum memory in megabytes of the decoded images that are buffered
+  // between reading the images and extracting their features.
+  int max_image_buffer_mb = 1024;
+
   // Maximum number of features to detect, keeping larger-scale features.
   int max_num_features = 8192;
 
@@ -151,6 +156,10 @@ struct SiftMatchingOptions {
   // number of iterations.
   double min_inlier_ratio = 0.25;
 
+  // Whether to reject bad hypotheses early during geometric verification
+  // using the sequential probability ratio test.
+  bool use_sprt = false;
+
   // Minimum number of inliers for an image pair to be considered as
   // geometrically verified.
   int min_num_inliers = 15;
@@ -161,6 +170,12 @@ struct SiftMatchingOptions {
   // Whether to perform guided matching, if geometric verification succeeds.
   bool guided_matching = false;
 
+  // Maximum number of database writes committed in one transaction and
+  // maximum time in seconds until a write is committed. The matches and the
+  // two-view geometry of each image pair are written separately.
+  int write_batch_size = 1000;
+  double write_batch_seconds = 1.0;
+
   bool Check() const;
 };
 
@@ -210,7 +225,9 @@ void LoadSiftFeaturesFromTextFile(const std::string& path,
                                   FeatureKeypoints* keypoints,
                                   FeatureDescriptors* descriptors);
 
-// Match the given SIFT features on the CPU.
+// Match the given SIFT features on the CPU. MatchSiftFeaturesCPU uses the
+// exact brute-force matching for up to 8192 x 8192 descriptor pairs and the
+// approximate FLANN matching for more pairs.
 void MatchSiftFeaturesCPUBruteForce(const SiftMatchingOptions& match_options,
                                     const FeatureDescriptors& descriptors1,
                                     const FeatureDescriptors& descriptors2,
@@ -253,6 +270,23 @@ void MatchGuidedSiftFeaturesGPU(const SiftMatchingOptions& match_options,
                                 SiftMatchGPU* sift_match_gpu,
                                 TwoViewGeometry* two_view_geometry);
 
+namespace internal {
+
+// Dot products of a SIFT descriptor with a block of contiguously stored SIFT
+// descriptors with 128 unsigned bytes each. The baseline version only uses the
+// baseline instruction set, while the AVX2 version requires `CPUHasAVX2()`.
+void ComputeSiftDescriptorDotProductsBaseline(const uint8_t* descriptor1,
+                                              const uint8_t* descriptors2,
+                                              const int num_descriptors2,
+                                              int* dots);
+#if defined(COLMAP_HAS_TARGET_AVX2)
+COLMAP_TARGET_AVX2 void ComputeSiftDescriptorDotProductsAVX2(
+    const uint8_t* descriptor1, const uint8_t* descriptors2,
+    const int num_descriptors2, int* dots);
+#endif
+
+}  // namespace internal
+
 }  // namespace colmap
 
 #endif  // COLMAP_SRC_FEATURE_SIFT_H_
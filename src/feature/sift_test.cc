@@ -430,6 +430,40 @@ BOOST_AUTO_TEST_CASE(TestMatchSiftFeaturesCPUFLANNvsBruteForce) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestComputeSiftDescriptorDotProducts) {
+  // Random descriptors with all byte values, including the saturated ones.
+  const int kNumDescriptors = 100;
+  SetPRNGSeed(0);
+  FeatureDescriptors descriptors(kNumDescriptors, 128);
+  for (int i = 0; i < kNumDescriptors; ++i) {
+    for (int j = 0; j < 128; ++j) {
+      descriptors(i, j) = i == 0 ? 255 : RandomInteger(0, 255);
+    }
+  }
+
+  for (int i = 0; i < kNumDescriptors; ++i) {
+    std::vector<int> dots(kNumDescriptors);
+    internal::ComputeSiftDescriptorDotProductsBaseline(
+        descriptors.row(i).data(), descriptors.data(), kNumDescriptors,
+        dots.data());
+    for (int j = 0; j < kNumDescriptors; ++j) {
+      const int dot = descriptors.row(i).cast<int>().dot(
+          descriptors.row(j).cast<int>());
+      BOOST_CHECK_EQUAL(dots[j], dot);
+    }
+
+#if defined(COLMAP_HAS_TARGET_AVX2)
+    if (CPUHasAVX2()) {
+      std::vector<int> dots_avx2(kNumDescriptors);
+      internal::ComputeSiftDescriptorDotProductsAVX2(
+          descriptors.row(i).data(), descriptors.data(), kNumDescriptors,
+          dots_avx2.data());
+      BOOST_CHECK(dots_avx2 == dots);
+    }
+#endif
+  }
+}
+
 BOOST_AUTO_TEST_CASE(TestMatchGuidedSiftFeaturesCPU) {
   FeatureKeypoints empty_keypoints(0);
   FeatureKeypoints keypoints1(2);
@@ -32,6 +32,7 @@
 #include "mvs/fusion.h"
 
 #include "util/misc.h"
+#include "util/trace.h"
 
 namespace colmap {
 namespace mvs {
@@ -92,6 +93,7 @@ void StereoFusionOptions::Print() const {
   PrintOption(max_normal_error);
   PrintOption(check_num_images);
   PrintOption(cache_size);
+  PrintOption(num_threads);
 #undef PrintOption
 }
 
@@ -133,6 +135,8 @@ const std::vector<std::vector<int>>& StereoFusion::GetFusedPointsVisibility()
 }
 
 void StereoFusion::Run() {
+  COLMAP_TRACE_STAGE("StereoFusion");
+
   fused_points_.clear();
   fused_points_visibility_.clear();
 
@@ -202,20 +206,20 @@ void StereoFusion::Run() {
     }
 
     const auto& image = model.images.at(image_idx);
-    const auto& depth_map = workspace_->GetDepthMap(image_idx);
+    const auto depth_map = workspace_->GetDepthMap(image_idx);
 
     used_images_.at(image_idx) = true;
 
     fused_pixel_masks_.at(image_idx) =
-        Mat<bool>(depth_map.GetWidth(), depth_map.GetHeight(), 1);
+        Mat<bool>(depth_map->GetWidth(), depth_map->GetHeight(), 1);
     fused_pixel_masks_.at(image_idx).Fill(false);
 
     depth_map_sizes_.at(image_idx) =
-        std::make_pair(depth_map.GetWidth(), depth_map.GetHeight());
+        std::make_pair(depth_map->GetWidth(), depth_map->GetHeight());
 
     bitmap_scales_.at(image_idx) = std::make_pair(
-        static_cast<float>(depth_map.GetWidth()) / image.GetWidth(),
-        static_cast<float>(depth_map.GetHeight()) / image.GetHeight());
+        static_cast<float>(depth_map->GetWidth()) / image.GetWidth(),
+        static_cast<float>(depth_map->GetHeight()) / image.GetHeight());
 
     Eigen::Matrix<float, 3, 3, Eigen::RowMajor> K =
         Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>>(
@@ -235,6 +239,18 @@ void StereoFusion::Run() {
             .transpose();
   }
 
+  const int num_threads = GetEffectiveNumThreads(options_.num_threads);
+  ThreadPool thread_pool(num_threads);
+  fusion_states_.clear();
+  fusion_states_.resize(thread_pool.NumThreads());
+  num_refused_pixels_ = 0;
+
+  // The state used for committing the speculative fusions.
+  FusionState commit_state;
+
+  const int kNumRowsPerBlock = 8;
+  std::vector<FusionBlock> blocks(4 * thread_pool.NumThreads());
+
   size_t num_fused_images = 0;
   for (int image_idx = 0; image_idx >= 0;
        image_idx = internal::FindNextImage(overlapping_images_, used_images_,
@@ -243,6 +259,9 @@ void StereoFusion::Run() {
       break;
     }
 
+    ScopedTraceSpan trace_span("FuseImage");
+    trace_span.SetArg("image_idx", image_idx);
+
     Timer timer;
     timer.Start();
 
@@ -250,24 +269,49 @@ void StereoFusion::Run() {
                               model.images.size())
               << std::flush;
 
-    const int width = depth_map_sizes_.at(image_idx).first;
     const int height = depth_map_sizes_.at(image_idx).second;
-    const auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
-
-    FusionData data;
-    data.image_idx = image_idx;
-    data.traversal_depth = 0;
-
-    for (data.row = 0; data.row < height; ++data.row) {
-      for (data.col = 0; data.col < width; ++data.col) {
-        if (fused_pixel_mask.Get(data.row, data.col)) {
-          continue;
+    if (thread_pool.NumThreads() == 1) {
+      FusionState* state = &fusion_states_[0];
+      Timer thread_timer;
+      thread_timer.Start();
+      const int width = depth_map_sizes_.at(image_idx).first;
+      for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+          if (!IsFusedPixel(image_idx, row, col)) {
+            FuseSerially(image_idx, row, col, state);
+          }
         }
+      }
+      state->image_data.clear();
+      state->elapsed_seconds += thread_timer.ElapsedSeconds();
+    } else {
+      // Fuse the blocks of rows of a wave concurrently and then commit them in
+      // row-major order, which produces the same points as the serial fusion.
+      // Note that the fused images are only updated in between reference
+      // images, so the threads never observe a partially fused reference
+      // image.
+      for (int wave_start = 0; wave_start < height;
+           wave_start += blocks.size() * kNumRowsPerBlock) {
+        size_t num_blocks = 0;
+        for (int row_start = wave_start;
+             row_start < height && num_blocks < blocks.size();
+             row_start += kNumRowsPerBlock) {
+          FusionBlock* block = &blocks[num_blocks];
+          block->row_start = row_start;
+          block->row_end = std::min(height, row_start + kNumRowsPerBlock);
+          thread_pool.AddTask([this, &thread_pool, image_idx, block]() {
+            FuseRows(image_idx, block,
+                     &fusion_states_.at(thread_pool.GetThreadIndex()));
+          });
+          num_blocks += 1;
+        }
+        thread_pool.Wait();
 
-        fusion_queue_.push_back(data);
-
-        Fuse();
+        for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+          CommitRows(image_idx, &blocks[block_idx], &commit_state);
+        }
       }
+      commit_state.image_data.clear();
     }
 
     num_fused_images += 1;
@@ -278,6 +322,31 @@ void StereoFusion::Run() {
               << std::endl;
   }
 
+  for (size_t thread_idx = 0; thread_idx < fusion_states_.size();
+       ++thread_idx) {
+    const auto& state = fusion_states_[thread_idx];
+    const double pixels_per_second =
+        state.elapsed_seconds > 0
+            ? state.num_fused_pixels / state.elapsed_seconds
+            : 0.0;
+    std::cout << StringPrintf(
+                     "Thread %d: %d points from %d pixels in %.3fs "
+                     "(%.0f pixels/s)",
+                     thread_idx, state.num_fused_points,
+                     state.num_fused_pixels, state.elapsed_seconds,
+                     pixels_per_second)
+              << std::endl;
+  }
+
+  if (fusion_states_.size() > 1) {
+    std::cout << StringPrintf(
+                     "Serially re-fused %d conflicting pixels in %.3fs",
+                     num_refused_pixels_, commit_state.elapsed_seconds)
+              << std::endl;
+  }
+
+  fusion_states_.clear();
+
   fused_points_.shrink_to_fit();
   fused_points_visibility_.shrink_to_fit();
 
@@ -292,40 +361,155 @@ void StereoFusion::Run() {
   GetTimer().PrintMinutes();
 }
 
-void StereoFusion::Fuse() {
-  CHECK_EQ(fusion_queue_.size(), 1);
+void StereoFusion::FuseRows(const int image_idx, FusionBlock* block,
+                            FusionState* state) {
+  Timer timer;
+  timer.Start();
+
+  block->fusions.clear();
+  block->claimed_pixels.clear();
+  block->points.clear();
+  block->points_visibility.clear();
+
+  PlyPoint fused_point;
+  std::vector<int> fused_point_visibility;
+
+  const int width = depth_map_sizes_.at(image_idx).first;
+  for (int row = block->row_start; row < block->row_end; ++row) {
+    for (int col = 0; col < width; ++col) {
+      if (IsFusedPixel(image_idx, row, col)) {
+        continue;
+      }
+
+      const size_t num_claimed_pixels = block->claimed_pixels.size();
+      const bool has_fused_point =
+          Fuse(image_idx, row, col, state, &block->claimed_pixels, &fused_point,
+               &fused_point_visibility);
+
+      // Fusions without any claimed pixels have no effect.
+      if (block->claimed_pixels.size() == num_claimed_pixels) {
+        continue;
+      }
+
+      FusionBlock::Fusion fusion;
+      fusion.row = row;
+      fusion.col = col;
+      fusion.claimed_pixels_end = block->claimed_pixels.size();
+      if (has_fused_point) {
+        fusion.point_idx = static_cast<int>(block->points.size());
+        block->points.push_back(fused_point);
+        block->points_visibility.push_back(std::move(fused_point_visibility));
+      }
+      block->fusions.push_back(fusion);
+    }
+  }
+
+  // Release the references to the workspace data, such that evicted images
+  // are not kept alive by idle threads.
+  state->image_data.clear();
+
+  state->elapsed_seconds += timer.ElapsedSeconds();
+}
+
+void StereoFusion::CommitRows(const int image_idx, FusionBlock* block,
+                              FusionState* state) {
+  Timer timer;
+  timer.Start();
+
+  // A speculative fusion produces the same result as the serial fusion, if
+  // none of its claimed pixels was claimed by a preceding fusion, since the
+  // fusion only depends on the fused pixel masks through these pixels.
+  // Otherwise, the pixel is fused again with the current masks.
+  size_t claimed_pixels_begin = 0;
+  for (const auto& fusion : block->fusions) {
+    bool is_valid = true;
+    for (size_t i = claimed_pixels_begin; i < fusion.claimed_pixels_end; ++i) {
+      if (IsFusedPixel(block->claimed_pixels[i])) {
+        is_valid = false;
+        break;
+      }
+    }
+
+    if (is_valid) {
+      for (size_t i = claimed_pixels_begin; i < fusion.claimed_pixels_end;
+           ++i) {
+        SetFusedPixel(block->claimed_pixels[i]);
+      }
+      if (fusion.point_idx >= 0) {
+        fused_points_.push_back(block->points[fusion.point_idx]);
+        fused_points_visibility_.push_back(
+            std::move(block->points_visibility[fusion.point_idx]));
+      }
+    } else {
+      FuseSerially(image_idx, fusion.row, fusion.col, state);
+      num_refused_pixels_ += 1;
+    }
+
+    claimed_pixels_begin = fusion.claimed_pixels_end;
+  }
+
+  state->elapsed_seconds += timer.ElapsedSeconds();
+}
+
+void StereoFusion::FuseSerially(const int image_idx, const int row,
+                                const int col, FusionState* state) {
+  PlyPoint fused_point;
+  std::vector<int> fused_point_visibility;
+  if (Fuse(image_idx, row, col, state, nullptr, &fused_point,
+           &fused_point_visibility)) {
+    fused_points_.push_back(fused_point);
+    fused_points_visibility_.push_back(std::move(fused_point_visibility));
+  }
+}
 
+bool StereoFusion::Fuse(const int image_idx, const int row, const int col,
+                        FusionState* state,
+                        std::vector<uint64_t>* claimed_pixels,
+                        PlyPoint* fused_point,
+                        std::vector<int>* fused_point_visibility) {
   Eigen::Vector4f fused_ref_point = Eigen::Vector4f::Zero();
   Eigen::Vector3f fused_ref_normal = Eigen::Vector3f::Zero();
 
-  fused_point_x_.clear();
-  fused_point_y_.clear();
-  fused_point_z_.clear();
-  fused_point_nx_.clear();
-  fused_point_ny_.clear();
-  fused_point_nz_.clear();
-  fused_point_r_.clear();
-  fused_point_g_.clear();
-  fused_point_b_.clear();
-  fused_point_visibility_.clear();
-
-  while (!fusion_queue_.empty()) {
-    const auto data = fusion_queue_.back();
+  state->fused_point_x.clear();
+  state->fused_point_y.clear();
+  state->fused_point_z.clear();
+  state->fused_point_nx.clear();
+  state->fused_point_ny.clear();
+  state->fused_point_nz.clear();
+  state->fused_point_r.clear();
+  state->fused_point_g.clear();
+  state->fused_point_b.clear();
+  state->fused_point_visibility.clear();
+  state->claimed_pixels.clear();
+
+  FusionData ref_data;
+  ref_data.image_idx = image_idx;
+  ref_data.row = row;
+  ref_data.col = col;
+  ref_data.traversal_depth = 0;
+  state->fusion_queue.push_back(ref_data);
+
+  while (!state->fusion_queue.empty()) {
+    const auto data = state->fusion_queue.back();
     const int image_idx = data.image_idx;
     const int row = data.row;
     const int col = data.col;
     const int traversal_depth = data.traversal_depth;
 
-    fusion_queue_.pop_back();
+    state->fusion_queue.pop_back();
 
     // Check if pixel already fused.
-    auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
-    if (fused_pixel_mask.Get(row, col)) {
+    if (IsFusedPixel(image_idx, row, col)) {
       continue;
     }
+    const uint64_t pixel_key = GetPixelKey(image_idx, row, col);
+    if (claimed_pixels != nullptr && state->claimed_pixels.count(pixel_key)) {
+      continue;
+    }
+
+    const auto& image_data = GetImageData(image_idx, state);
 
-    const auto& depth_map = workspace_->GetDepthMap(image_idx);
-    const float depth = depth_map.Get(row, col);
+    const float depth = image_data.depth_map->Get(row, col);
 
     // Pixels with negative depth are filtered.
     if (depth <= 0.0f) {
@@ -355,7 +539,7 @@ void StereoFusion::Fuse() {
     }
 
     // Determine normal direction in global reference frame.
-    const auto& normal_map = workspace_->GetNormalMap(image_idx);
+    const auto& normal_map = *image_data.normal_map;
     const Eigen::Vector3f normal =
         inv_R_.at(image_idx) * Eigen::Vector3f(normal_map.Get(row, col, 0),
                                                normal_map.Get(row, col, 1),
@@ -369,6 +553,14 @@ void StereoFusion::Fuse() {
       }
     }
 
+    // Set the current pixel as visited.
+    if (claimed_pixels == nullptr) {
+      SetFusedPixel(pixel_key);
+    } else {
+      state->claimed_pixels.insert(pixel_key);
+      claimed_pixels->push_back(pixel_key);
+    }
+
     // Determine 3D location of current depth value.
     const Eigen::Vector3f xyz =
         inv_P_.at(image_idx) *
@@ -377,23 +569,20 @@ void StereoFusion::Fuse() {
     // Read the color of the pixel.
     BitmapColor<uint8_t> color;
     const auto& bitmap_scale = bitmap_scales_.at(image_idx);
-    workspace_->GetBitmap(image_idx).InterpolateNearestNeighbor(
+    image_data.bitmap->InterpolateNearestNeighbor(
         col / bitmap_scale.first, row / bitmap_scale.second, &color);
 
-    // Set the current pixel as visited.
-    fused_pixel_mask.Set(row, col, true);
-
     // Accumulate statistics for fused point.
-    fused_point_x_.push_back(xyz(0));
-    fused_point_y_.push_back(xyz(1));
-    fused_point_z_.push_back(xyz(2));
-    fused_point_nx_.push_back(normal(0));
-    fused_point_ny_.push_back(normal(1));
-    fused_point_nz_.push_back(normal(2));
-    fused_point_r_.push_back(color.r);
-    fused_point_g_.push_back(color.g);
-    fused_point_b_.push_back(color.b);
-    fused_point_visibility_.insert(image_idx);
+    state->fused_point_x.push_back(xyz(0));
+    state->fused_point_y.push_back(xyz(1));
+    state->fused_point_z.push_back(xyz(2));
+    state->fused_point_nx.push_back(normal(0));
+    state->fused_point_ny.push_back(normal(1));
+    state->fused_point_nz.push_back(normal(2));
+    state->fused_point_r.push_back(color.r);
+    state->fused_point_g.push_back(color.g);
+    state->fused_point_b.push_back(color.b);
+    state->fused_point_visibility.insert(image_idx);
 
     // Remember the first pixel as the reference.
     if (traversal_depth == 0) {
@@ -401,7 +590,8 @@ void StereoFusion::Fuse() {
       fused_ref_normal = normal;
     }
 
-    if (fused_point_x_.size() >= static_cast<size_t>(options_.max_num_pixels)) {
+    if (state->fused_point_x.size() >=
+        static_cast<size_t>(options_.max_num_pixels)) {
       break;
     }
 
@@ -432,44 +622,87 @@ void StereoFusion::Fuse() {
         continue;
       }
 
-      fusion_queue_.push_back(next_data);
+      state->fusion_queue.push_back(next_data);
     }
   }
 
-  fusion_queue_.clear();
+  state->fusion_queue.clear();
 
-  const size_t num_pixels = fused_point_x_.size();
-  if (num_pixels >= static_cast<size_t>(options_.min_num_pixels)) {
-    PlyPoint fused_point;
+  const size_t num_pixels = state->fused_point_x.size();
+  state->num_fused_pixels += num_pixels;
 
-    Eigen::Vector3f fused_normal;
-    fused_normal.x() = internal::Median(&fused_point_nx_);
-    fused_normal.y() = internal::Median(&fused_point_ny_);
-    fused_normal.z() = internal::Median(&fused_point_nz_);
-    const float fused_normal_norm = fused_normal.norm();
-    if (fused_normal_norm < std::numeric_limits<float>::epsilon()) {
-      return;
-    }
+  if (num_pixels < static_cast<size_t>(options_.min_num_pixels)) {
+    return false;
+  }
 
-    fused_point.x = internal::Median(&fused_point_x_);
-    fused_point.y = internal::Median(&fused_point_y_);
-    fused_point.z = internal::Median(&fused_point_z_);
+  Eigen::Vector3f fused_normal;
+  fused_normal.x() = internal::Median(&state->fused_point_nx);
+  fused_normal.y() = internal::Median(&state->fused_point_ny);
+  fused_normal.z() = internal::Median(&state->fused_point_nz);
+  const float fused_normal_norm = fused_normal.norm();
+  if (fused_normal_norm < std::numeric_limits<float>::epsilon()) {
+    return false;
+  }
 
-    fused_point.nx = fused_normal.x() / fused_normal_norm;
-    fused_point.ny = fused_normal.y() / fused_normal_norm;
-    fused_point.nz = fused_normal.z() / fused_normal_norm;
+  fused_point->x = internal::Median(&state->fused_point_x);
+  fused_point->y = internal::Median(&state->fused_point_y);
+  fused_point->z = internal::Median(&state->fused_point_z);
 
-    fused_point.r = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_r_)));
-    fused_point.g = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_g_)));
-    fused_point.b = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_b_)));
+  fused_point->nx = fused_normal.x() / fused_normal_norm;
+  fused_point->ny = fused_normal.y() / fused_normal_norm;
+  fused_point->nz = fused_normal.z() / fused_normal_norm;
 
-    fused_points_.push_back(fused_point);
-    fused_points_visibility_.emplace_back(fused_point_visibility_.begin(),
-                                          fused_point_visibility_.end());
+  fused_point->r = TruncateCast<float, uint8_t>(
+      std::round(internal::Median(&state->fused_point_r)));
+  fused_point->g = TruncateCast<float, uint8_t>(
+      std::round(internal::Median(&state->fused_point_g)));
+  fused_point->b = TruncateCast<float, uint8_t>(
+      std::round(internal::Median(&state->fused_point_b)));
+
+  fused_point_visibility->assign(state->fused_point_visibility.begin(),
+                                 state->fused_point_visibility.end());
+  state->num_fused_points += 1;
+
+  return true;
+}
+
+const StereoFusion::ImageData& StereoFusion::GetImageData(
+    const int image_idx, FusionState* state) {
+  auto& image_data = state->image_data[image_idx];
+  if (!image_data.depth_map) {
+    image_data.bitmap = workspace_->GetBitmap(image_idx);
+    image_data.depth_map = workspace_->GetDepthMap(image_idx);
+    image_data.normal_map = workspace_->GetNormalMap(image_idx);
   }
+  return image_data;
+}
+
+uint64_t StereoFusion::GetPixelKey(const int image_idx, const int row,
+                                   const int col) const {
+  const int width = depth_map_sizes_[image_idx].first;
+  return (static_cast<uint64_t>(image_idx) << 32) |
+         static_cast<uint64_t>(row * width + col);
+}
+
+bool StereoFusion::IsFusedPixel(const int image_idx, const int row,
+                                const int col) const {
+  return fused_pixel_masks_[image_idx].Get(row, col);
+}
+
+bool StereoFusion::IsFusedPixel(const uint64_t pixel_key) const {
+  const int image_idx = static_cast<int>(pixel_key >> 32);
+  const int pixel_idx = static_cast<int>(pixel_key & 0xffffffff);
+  const int width = depth_map_sizes_[image_idx].first;
+  return fused_pixel_masks_[image_idx].Get(pixel_idx / width,
+                                           pixel_idx % width);
+}
+
+void StereoFusion::SetFusedPixel(const uint64_t pixel_key) {
+  const int image_idx = static_cast<int>(pixel_key >> 32);
+  const int pixel_idx = static_cast<int>(pixel_key & 0xffffffff);
+  const int width = depth_map_sizes_[image_idx].first;
+  fused_pixel_masks_[image_idx].Set(pixel_idx / width, pixel_idx % width,
+                                    true);
 }
 
 void WritePointsVisibility(
@@ -32,6 +32,8 @@
 #ifndef COLMAP_SRC_MVS_FUSION_H_
 #define COLMAP_SRC_MVS_FUSION_H_
 
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -84,6 +86,12 @@ struct StereoFusionOptions {
   // consume a lot of memory, if the consistency graph is dense.
   double cache_size = 32.0;
 
+  // The number of threads to use for fusion. The pixels of each reference
+  // image are partitioned into blocks of rows that are fused concurrently.
+  // The result is independent of the number of threads and identical to the
+  // serial fusion.
+  int num_threads = -1;
+
   // Check the options for validity.
   bool Check() const;
 
@@ -106,7 +114,6 @@ class StereoFusion : public Thread {
 
  private:
   void Run();
-  void Fuse();
 
   const StereoFusionOptions options_;
   const std::string workspace_path_;
@@ -120,6 +127,8 @@ class StereoFusion : public Thread {
   std::vector<char> used_images_;
   std::vector<char> fused_images_;
   std::vector<std::vector<int>> overlapping_images_;
+  // Flags of already fused pixels. The masks are only read by the fusion
+  // threads and updated in between, when their results are committed.
   std::vector<Mat<bool>> fused_pixel_masks_;
   std::vector<std::pair<int, int>> depth_map_sizes_;
   std::vector<std::pair<float, float>> bitmap_scales_;
@@ -137,24 +146,93 @@ class StereoFusion : public Thread {
     }
   };
 
-  // Next points to fuse.
-  std::vector<FusionData> fusion_queue_;
+  // Workspace data referenced by a fusion thread during the current task.
+  struct ImageData {
+    std::shared_ptr<const Bitmap> bitmap;
+    std::shared_ptr<const DepthMap> depth_map;
+    std::shared_ptr<const NormalMap> normal_map;
+  };
+
+  // The state of a single fusion thread.
+  struct FusionState {
+    // Next points to fuse.
+    std::vector<FusionData> fusion_queue;
+
+    // Pixels claimed by the current speculative fusion.
+    std::unordered_set<uint64_t> claimed_pixels;
+
+    // Points of different pixels of the currently point to be fused.
+    std::vector<float> fused_point_x;
+    std::vector<float> fused_point_y;
+    std::vector<float> fused_point_z;
+    std::vector<float> fused_point_nx;
+    std::vector<float> fused_point_ny;
+    std::vector<float> fused_point_nz;
+    std::vector<uint8_t> fused_point_r;
+    std::vector<uint8_t> fused_point_g;
+    std::vector<uint8_t> fused_point_b;
+    std::unordered_set<int> fused_point_visibility;
+
+    std::unordered_map<int, ImageData> image_data;
+
+    // Throughput statistics of the thread.
+    size_t num_fused_pixels = 0;
+    size_t num_fused_points = 0;
+    double elapsed_seconds = 0;
+  };
+
+  // The speculatively fused points of a block of rows of the reference image.
+  // The threads fuse the pixels of their block without updating the fused
+  // pixel masks. Instead, the pixels claimed by each fusion are recorded, and
+  // a fusion is only valid if none of them has been claimed by the fusion of a
+  // preceding pixel in the serial order.
+  struct FusionBlock {
+    struct Fusion {
+      int row = 0;
+      int col = 0;
+      // End of the claimed pixels of this fusion in `claimed_pixels`.
+      size_t claimed_pixels_end = 0;
+      // Index of the fused point in `points` or -1, if no point was fused.
+      int point_idx = -1;
+    };
+
+    int row_start = 0;
+    int row_end = 0;
+    std::vector<Fusion> fusions;
+    std::vector<uint64_t> claimed_pixels;
+    std::vector<PlyPoint> points;
+    std::vector<std::vector<int>> points_visibility;
+  };
+
+  // Speculatively fuse the rows of a block concurrently to other blocks.
+  void FuseRows(const int image_idx, FusionBlock* block, FusionState* state);
+
+  // Commit the speculative fusions of a block in serial order.
+  void CommitRows(const int image_idx, FusionBlock* block, FusionState* state);
+
+  // Fuse a pixel, update the fused pixel masks, and add the fused point.
+  void FuseSerially(const int image_idx, const int row, const int col,
+                    FusionState* state);
+
+  // Fuse a pixel and return whether a point was fused. If claimed pixels are
+  // given, the fusion is speculative and records the claimed pixels instead
+  // of updating the fused pixel masks.
+  bool Fuse(const int image_idx, const int row, const int col,
+            FusionState* state, std::vector<uint64_t>* claimed_pixels,
+            PlyPoint* fused_point, std::vector<int>* fused_point_visibility);
+
+  const ImageData& GetImageData(const int image_idx, FusionState* state);
+  uint64_t GetPixelKey(const int image_idx, const int row, const int col) const;
+  bool IsFusedPixel(const int image_idx, const int row, const int col) const;
+  bool IsFusedPixel(const uint64_t pixel_key) const;
+  void SetFusedPixel(const uint64_t pixel_key);
+
+  std::vector<FusionState> fusion_states_;
+  size_t num_refused_pixels_;
 
   // Already fused points.
   std::vector<PlyPoint> fused_points_;
   std::vector<std::vector<int>> fused_points_visibility_;
-
-  // Points of different pixels of the currently point to be fused.
-  std::vector<float> fused_point_x_;
-  std::vector<float> fused_point_y_;
-  std::vector<float> fused_point_z_;
-  std::vector<float> fused_point_nx_;
-  std::vector<float> fused_point_ny_;
-  std::vector<float> fused_point_nz_;
-  std::vector<uint8_t> fused_point_r_;
-  std::vector<uint8_t> fused_point_g_;
-  std::vector<uint8_t> fused_point_b_;
-  std::unordered_set<int> fused_point_visibility_;
 };
 
 // Write the visiblity information into a binary file of the following format:
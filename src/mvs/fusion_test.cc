@@ -0,0 +1,206 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "mvs/fusion_test"
+#include "util/testing.h"
+
+#include "base/reconstruction.h"
+#include "mvs/depth_map.h"
+#include "mvs/fusion.h"
+#include "mvs/normal_map.h"
+#include "util/bitmap.h"
+#include "util/misc.h"
+
+using namespace colmap;
+using namespace colmap::mvs;
+
+namespace {
+
+const int kWidth = 64;
+const int kHeight = 48;
+const int kNumImages = 4;
+
+std::string CreateTemporaryDir() {
+  const std::string path = (boost::filesystem::temp_directory_path() /
+                            boost::filesystem::unique_path())
+                               .string();
+  CreateDirIfNotExists(path);
+  return path;
+}
+
+// Generate a workspace of images observing the plane z = 5 from a row of
+// cameras. The depth maps are perturbed and contain outliers, such that the
+// fused points depend on the order in which the pixels are fused.
+std::string GenerateWorkspace() {
+  const std::string workspace_path = CreateTemporaryDir();
+  CreateDirIfNotExists(JoinPaths(workspace_path, "images"));
+  CreateDirIfNotExists(JoinPaths(workspace_path, "sparse"));
+  CreateDirIfNotExists(JoinPaths(workspace_path, "stereo"));
+  CreateDirIfNotExists(JoinPaths(workspace_path, "stereo", "depth_maps"));
+  CreateDirIfNotExists(JoinPaths(workspace_path, "stereo", "normal_maps"));
+
+  Reconstruction reconstruction;
+
+  // The images of the second camera have half the resolution, such that the
+  // fusions of neighboring pixels in the first camera compete for the same
+  // pixels in the second camera.
+  Camera camera1;
+  camera1.SetCameraId(1);
+  camera1.InitializeWithName("PINHOLE", 50, kWidth, kHeight);
+  reconstruction.AddCamera(camera1);
+  Camera camera2;
+  camera2.SetCameraId(2);
+  camera2.InitializeWithName("PINHOLE", 25, kWidth / 2, kHeight / 2);
+  reconstruction.AddCamera(camera2);
+
+  const double kPlaneDepth = 5;
+
+  std::vector<Eigen::Vector3d> points3D;
+  for (int i = 0; i < 10; ++i) {
+    points3D.emplace_back(0.1 * i - 0.5, 0.05 * i - 0.25, kPlaneDepth);
+  }
+
+  std::string fusion_config;
+  for (image_t image_id = 1; image_id <= kNumImages; ++image_id) {
+    const std::string image_name = "image" + std::to_string(image_id) + ".png";
+
+    const Camera& camera = reconstruction.Camera((image_id + 1) % 2 + 1);
+    const int width = camera.Width();
+    const int height = camera.Height();
+
+    colmap::Image image;
+    image.SetImageId(image_id);
+    image.SetCameraId(camera.CameraId());
+    image.SetName(image_name);
+    image.Tvec() = Eigen::Vector3d(-0.1 * image_id, 0, 0);
+    std::vector<Eigen::Vector2d> points2D;
+    for (const auto& point3D : points3D) {
+      points2D.push_back(
+          camera.WorldToImage((point3D + image.Tvec()).hnormalized()));
+    }
+    image.SetPoints2D(points2D);
+    reconstruction.AddImage(image);
+    reconstruction.RegisterImage(image_id);
+
+    Bitmap bitmap;
+    bitmap.Allocate(width, height, true);
+    DepthMap depth_map(width, height, 0, 2 * kPlaneDepth);
+    NormalMap normal_map(width, height);
+    for (int row = 0; row < height; ++row) {
+      for (int col = 0; col < width; ++col) {
+        bitmap.SetPixel(col, row,
+                        BitmapColor<uint8_t>(4 * col, 5 * row, 60 * image_id));
+        float depth = kPlaneDepth * (1 + 0.004f * std::sin(0.7f * row + 1.3f *
+                                                           col + image_id));
+        if ((row * width + col + image_id) % 11 == 0) {
+          depth *= 1.05f;
+        } else if ((row * width + col + image_id) % 13 == 0) {
+          depth = 0;
+        }
+        depth_map.Set(row, col, depth);
+        normal_map.Set(row, col, 0, 0);
+        normal_map.Set(row, col, 1, 0);
+        normal_map.Set(row, col, 2, -1);
+      }
+    }
+
+    bitmap.Write(JoinPaths(workspace_path, "images", image_name));
+    depth_map.Write(JoinPaths(workspace_path, "stereo", "depth_maps",
+                              image_name + ".geometric.bin"));
+    normal_map.Write(JoinPaths(workspace_path, "stereo", "normal_maps",
+                               image_name + ".geometric.bin"));
+
+    fusion_config += image_name + "\n";
+  }
+
+  for (const auto& point3D : points3D) {
+    Track track;
+    for (image_t image_id = 1; image_id <= kNumImages; ++image_id) {
+      track.AddElement(image_id, &point3D - points3D.data());
+    }
+    reconstruction.AddPoint3D(point3D, track);
+  }
+
+  reconstruction.Write(JoinPaths(workspace_path, "sparse"));
+
+  std::ofstream file(JoinPaths(workspace_path, "stereo", "fusion.cfg"));
+  file << fusion_config;
+
+  return workspace_path;
+}
+
+void RunFusion(const std::string& workspace_path, const int num_threads,
+               std::vector<PlyPoint>* points,
+               std::vector<std::vector<int>>* points_visibility) {
+  StereoFusionOptions options;
+  options.min_num_pixels = 2;
+  options.num_threads = num_threads;
+  StereoFusion fusion(options, workspace_path, "COLMAP", "", "geometric");
+  fusion.Start();
+  fusion.Wait();
+  *points = fusion.GetFusedPoints();
+  *points_visibility = fusion.GetFusedPointsVisibility();
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestSerialEqualsParallel) {
+  const std::string workspace_path = GenerateWorkspace();
+
+  std::vector<PlyPoint> serial_points;
+  std::vector<std::vector<int>> serial_points_visibility;
+  RunFusion(workspace_path, 1, &serial_points, &serial_points_visibility);
+  BOOST_CHECK_GT(serial_points.size(), 0);
+  BOOST_CHECK_EQUAL(serial_points.size(), serial_points_visibility.size());
+
+  for (const int num_threads : {2, 3, 8}) {
+    std::vector<PlyPoint> parallel_points;
+    std::vector<std::vector<int>> parallel_points_visibility;
+    RunFusion(workspace_path, num_threads, &parallel_points,
+              &parallel_points_visibility);
+    BOOST_REQUIRE_EQUAL(parallel_points.size(), serial_points.size());
+    BOOST_REQUIRE_EQUAL(parallel_points_visibility.size(),
+                        serial_points_visibility.size());
+    for (size_t i = 0; i < serial_points.size(); ++i) {
+      BOOST_CHECK_EQUAL(parallel_points[i].x, serial_points[i].x);
+      BOOST_CHECK_EQUAL(parallel_points[i].y, serial_points[i].y);
+      BOOST_CHECK_EQUAL(parallel_points[i].z, serial_points[i].z);
+      BOOST_CHECK_EQUAL(parallel_points[i].nx, serial_points[i].nx);
+      BOOST_CHECK_EQUAL(parallel_points[i].ny, serial_points[i].ny);
+      BOOST_CHECK_EQUAL(parallel_points[i].nz, serial_points[i].nz);
+      BOOST_CHECK_EQUAL(parallel_points[i].r, serial_points[i].r);
+      BOOST_CHECK_EQUAL(parallel_points[i].g, serial_points[i].g);
+      BOOST_CHECK_EQUAL(parallel_points[i].b, serial_points[i].b);
+      BOOST_CHECK(parallel_points_visibility[i] ==
+                  serial_points_visibility[i]);
+    }
+  }
+}
@@ -219,7 +219,7 @@ class DelaunayMeshingInput {
     uint32_t num_visible_images = 0;
   };
 
-  EIGEN_STL_UMAP(camera_t, Camera) cameras;
+  SlotMap<camera_t, Camera> cameras;
   std::vector<Image> images;
   std::vector<Point> points;
 
@@ -728,7 +728,6 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
   // Spawn threads for parallelized integration of images.
   const int num_threads = GetEffectiveNumThreads(options.num_threads);
   ThreadPool thread_pool(num_threads);
-  JobQueue<CellGraphData> result_queue(num_threads);
 
   // Function that accumulates edge weights in the s-t graph for a single image.
   auto IntegreateImage = [&](const size_t image_idx) {
@@ -821,15 +820,18 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
       }
     }
 
-    CHECK(result_queue.Push(image_cell_graph_data));
+    return image_cell_graph_data;
   };
 
-  // Add first batch of images to the thread job queue.
+  // Add first batch of images to the thread pool. The results are accumulated
+  // in the order of the images, so that the floating point sums, and hence
+  // the final mesh, do not depend on the scheduling of the threads.
+  std::queue<std::future<CellGraphData>> results;
   size_t image_idx = 0;
   const size_t init_num_tasks =
       std::min(input_data.images.size(), 2 * thread_pool.NumThreads());
   for (; image_idx < init_num_tasks; ++image_idx) {
-    thread_pool.AddTask(IntegreateImage, image_idx);
+    results.push(thread_pool.AddTask(IntegreateImage, image_idx));
   }
 
   // Pop the integrated images from the thread job queue and integrate their
@@ -844,16 +846,15 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
 
     // Push the next image to the queue.
     if (image_idx < input_data.images.size()) {
-      thread_pool.AddTask(IntegreateImage, image_idx);
+      results.push(thread_pool.AddTask(IntegreateImage, image_idx));
       image_idx += 1;
     }
 
     // Pop the next results from the queue.
-    const auto result = result_queue.Pop();
-    CHECK(result.IsValid());
+    const CellGraphData image_cell_graph_data = results.front().get();
+    results.pop();
 
     // Accumulate the weights of the image into the global graph.
-    const auto& image_cell_graph_data = result.Data();
     for (const auto& image_cell_data : image_cell_graph_data) {
       auto& cell_data = cell_graph_data.at(image_cell_data.first);
       cell_data.sink_weight += image_cell_data.second.sink_weight;
@@ -32,6 +32,7 @@
 #include "mvs/model.h"
 
 #include "base/camera_models.h"
+#include "base/lazy_reconstruction.h"
 #include "base/pose.h"
 #include "base/projection.h"
 #include "base/reconstruction.h"
@@ -54,16 +55,12 @@ void Model::Read(const std::string& path, const std::string& format) {
 }
 
 void Model::ReadFromCOLMAP(const std::string& path) {
-  Reconstruction reconstruction;
-  reconstruction.Read(JoinPaths(path, "sparse"));
+  const std::string sparse_path = JoinPaths(path, "sparse");
 
-  images.reserve(reconstruction.NumRegImages());
   std::unordered_map<image_t, size_t> image_id_to_idx;
-  for (size_t i = 0; i < reconstruction.NumRegImages(); ++i) {
-    const auto image_id = reconstruction.RegImageIds()[i];
-    const auto& image = reconstruction.Image(image_id);
-    const auto& camera = reconstruction.Camera(image.CameraId());
 
+  const auto AddImage = [&](const colmap::Image& image,
+                            const colmap::Camera& camera) {
     CHECK_EQ(camera.ModelId(), PinholeCameraModel::model_id);
 
     const std::string image_path = JoinPaths(path, "images", image.Name());
@@ -73,24 +70,54 @@ void Model::ReadFromCOLMAP(const std::string& path) {
         QuaternionToRotationMatrix(image.Qvec()).cast<float>();
     const Eigen::Vector3f T = image.Tvec().cast<float>();
 
+    image_id_to_idx.emplace(image.ImageId(), images.size());
+    image_name_to_idx_.emplace(image.Name(), images.size());
+    image_names_.push_back(image.Name());
     images.emplace_back(image_path, camera.Width(), camera.Height(), K.data(),
                         R.data(), T.data());
-    image_id_to_idx.emplace(image_id, i);
-    image_names_.push_back(image.Name());
-    image_name_to_idx_.emplace(image.Name(), i);
-  }
+  };
 
-  points.reserve(reconstruction.NumPoints3D());
-  for (const auto& point3D : reconstruction.Points3D()) {
+  const auto AddPoint = [&](const colmap::Point3D& point3D) {
     Point point;
-    point.x = point3D.second.X();
-    point.y = point3D.second.Y();
-    point.z = point3D.second.Z();
-    point.track.reserve(point3D.second.Track().Length());
-    for (const auto& track_el : point3D.second.Track().Elements()) {
+    point.x = point3D.X();
+    point.y = point3D.Y();
+    point.z = point3D.Z();
+    point.track.reserve(point3D.Track().Length());
+    for (const auto& track_el : point3D.Track().Elements()) {
       point.track.push_back(image_id_to_idx.at(track_el.image_id));
     }
     points.push_back(point);
+  };
+
+  if (LazyReconstruction::Exists(sparse_path)) {
+    // Binary models are read lazily, which skips the 2D points of all images.
+    const LazyReconstruction reconstruction(sparse_path);
+
+    images.reserve(reconstruction.NumRegImages());
+    for (const auto image_id : reconstruction.RegImageIds()) {
+      const auto image = reconstruction.ImageHeader(image_id);
+      AddImage(image, reconstruction.Camera(image.CameraId()));
+    }
+
+    points.reserve(reconstruction.NumPoints3D());
+    reconstruction.ReadPoints3D(
+        [&](const point3D_t, const colmap::Point3D& point3D) {
+          AddPoint(point3D);
+        });
+  } else {
+    Reconstruction reconstruction;
+    reconstruction.Read(sparse_path);
+
+    images.reserve(reconstruction.NumRegImages());
+    for (const auto image_id : reconstruction.RegImageIds()) {
+      const auto& image = reconstruction.Image(image_id);
+      AddImage(image, reconstruction.Camera(image.CameraId()));
+    }
+
+    points.reserve(reconstruction.NumPoints3D());
+    for (const auto& point3D : reconstruction.Points3D()) {
+      AddPoint(point3D.second);
+    }
   }
 }
 
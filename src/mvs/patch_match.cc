@@ -35,10 +35,16 @@
 #include <unordered_set>
 
 #include "mvs/consistency_graph.h"
-#include "mvs/patch_match_cuda.h"
+#include "mvs/patch_match_cpu.h"
 #include "mvs/workspace.h"
 #include "util/math.h"
 #include "util/misc.h"
+#include "util/trace.h"
+
+#ifdef CUDA_ENABLED
+#include "mvs/patch_match_cuda.h"
+#include "util/cuda.h"
+#endif
 
 #define PrintOption(option) std::cout << #option ": " << option << std::endl
 
@@ -53,7 +59,9 @@ PatchMatch::~PatchMatch() {}
 void PatchMatchOptions::Print() const {
   PrintHeading2("PatchMatchOptions");
   PrintOption(max_image_size);
+  PrintOption(use_gpu);
   PrintOption(gpu_index);
+  PrintOption(num_threads);
   PrintOption(depth_min);
   PrintOption(depth_max);
   PrintOption(window_radius);
@@ -95,10 +103,12 @@ void PatchMatch::Problem::Print() const {
 void PatchMatch::Check() const {
   CHECK(options_.Check());
 
-  CHECK(!options_.gpu_index.empty());
-  const std::vector<int> gpu_indices = CSVToVector<int>(options_.gpu_index);
-  CHECK_EQ(gpu_indices.size(), 1);
-  CHECK_GE(gpu_indices[0], -1);
+  if (options_.use_gpu) {
+    CHECK(!options_.gpu_index.empty());
+    const std::vector<int> gpu_indices = CSVToVector<int>(options_.gpu_index);
+    CHECK_EQ(gpu_indices.size(), 1);
+    CHECK_GE(gpu_indices[0], -1);
+  }
 
   CHECK_NOTNULL(problem_.images);
   if (options_.geom_consistency) {
@@ -158,26 +168,55 @@ void PatchMatch::Run() {
 
   Check();
 
-  patch_match_cuda_.reset(new PatchMatchCuda(options_, problem_));
-  patch_match_cuda_->Run();
+#ifdef CUDA_ENABLED
+  if (options_.use_gpu) {
+    patch_match_cuda_.reset(new PatchMatchCuda(options_, problem_));
+    patch_match_cuda_->Run();
+    return;
+  }
+#endif
+
+  patch_match_cpu_.reset(new PatchMatchCpu(options_, problem_));
+  patch_match_cpu_->Run();
 }
 
 DepthMap PatchMatch::GetDepthMap() const {
-  return patch_match_cuda_->GetDepthMap();
+#ifdef CUDA_ENABLED
+  if (patch_match_cuda_) {
+    return patch_match_cuda_->GetDepthMap();
+  }
+#endif
+  return patch_match_cpu_->GetDepthMap();
 }
 
 NormalMap PatchMatch::GetNormalMap() const {
-  return patch_match_cuda_->GetNormalMap();
+#ifdef CUDA_ENABLED
+  if (patch_match_cuda_) {
+    return patch_match_cuda_->GetNormalMap();
+  }
+#endif
+  return patch_match_cpu_->GetNormalMap();
 }
 
 Mat<float> PatchMatch::GetSelProbMap() const {
-  return patch_match_cuda_->GetSelProbMap();
+#ifdef CUDA_ENABLED
+  if (patch_match_cuda_) {
+    return patch_match_cuda_->GetSelProbMap();
+  }
+#endif
+  return patch_match_cpu_->GetSelProbMap();
 }
 
 ConsistencyGraph PatchMatch::GetConsistencyGraph() const {
   const auto& ref_image = problem_.images->at(problem_.ref_image_idx);
+#ifdef CUDA_ENABLED
+  if (patch_match_cuda_) {
+    return ConsistencyGraph(ref_image.GetWidth(), ref_image.GetHeight(),
+                            patch_match_cuda_->GetConsistentImageIdxs());
+  }
+#endif
   return ConsistencyGraph(ref_image.GetWidth(), ref_image.GetHeight(),
-                          patch_match_cuda_->GetConsistentImageIdxs());
+                          patch_match_cpu_->GetConsistentImageIdxs());
 }
 
 PatchMatchController::PatchMatchController(const PatchMatchOptions& options,
@@ -192,11 +231,15 @@ PatchMatchController::PatchMatchController(const PatchMatchOptions& options,
 }
 
 void PatchMatchController::Run() {
+  COLMAP_TRACE_STAGE("PatchMatchStereo");
+
   ReadWorkspace();
   ReadProblems();
   ReadGpuIndices();
 
-  thread_pool_.reset(new ThreadPool(gpu_indices_.size()));
+  // The CPU implementation is multi-threaded itself, so process one problem
+  // at a time in that case.
+  thread_pool_.reset(new ThreadPool(use_gpu_ ? gpu_indices_.size() : 1));
 
   // If geometric consistency is enabled, then photometric output must be
   // computed first for all images without filtering.
@@ -393,13 +436,29 @@ void PatchMatchController::ReadProblems() {
 }
 
 void PatchMatchController::ReadGpuIndices() {
-  gpu_indices_ = CSVToVector<int>(options_.gpu_index);
-  if (gpu_indices_.size() == 1 && gpu_indices_[0] == -1) {
-    const int num_cuda_devices = GetNumCudaDevices();
-    CHECK_GT(num_cuda_devices, 0);
-    gpu_indices_.resize(num_cuda_devices);
-    std::iota(gpu_indices_.begin(), gpu_indices_.end(), 0);
+  use_gpu_ = false;
+  gpu_indices_ = {-1};
+
+  if (!options_.use_gpu) {
+    return;
+  }
+
+#ifdef CUDA_ENABLED
+  const int num_cuda_devices = GetNumCudaDevices();
+  if (num_cuda_devices > 0) {
+    use_gpu_ = true;
+    gpu_indices_ = CSVToVector<int>(options_.gpu_index);
+    if (gpu_indices_.size() == 1 && gpu_indices_[0] == -1) {
+      gpu_indices_.resize(num_cuda_devices);
+      std::iota(gpu_indices_.begin(), gpu_indices_.end(), 0);
+    }
+    return;
   }
+#endif
+
+  std::cout << "WARNING: No CUDA device available, falling back to the CPU "
+               "implementation of patch match stereo."
+            << std::endl;
 }
 
 void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
@@ -408,6 +467,9 @@ void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
     return;
   }
 
+  ScopedTraceSpan trace_span("ProcessProblem");
+  trace_span.SetArg("problem_idx", problem_idx);
+
   const auto& model = workspace_->GetModel();
 
   auto& problem = problems_.at(problem_idx);
@@ -449,6 +511,7 @@ void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
            "sparse model is provided in the workspace.";
   }
 
+  patch_match_options.use_gpu = use_gpu_;
   patch_match_options.gpu_index = std::to_string(gpu_index);
 
   if (patch_match_options.sigma_spatial <= 0.0f) {
@@ -483,10 +546,10 @@ void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
 
     std::cout << "Reading inputs..." << std::endl;
     for (const auto image_idx : used_image_idxs) {
-      images.at(image_idx).SetBitmap(workspace_->GetBitmap(image_idx));
+      images.at(image_idx).SetBitmap(*workspace_->GetBitmap(image_idx));
       if (options.geom_consistency) {
-        depth_maps.at(image_idx) = workspace_->GetDepthMap(image_idx);
-        normal_maps.at(image_idx) = workspace_->GetNormalMap(image_idx);
+        depth_maps.at(image_idx) = *workspace_->GetDepthMap(image_idx);
+        normal_maps.at(image_idx) = *workspace_->GetNormalMap(image_idx);
       }
     }
   }
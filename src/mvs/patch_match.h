@@ -53,6 +53,7 @@ namespace mvs {
 const static size_t kMaxPatchMatchWindowRadius = 32;
 
 class ConsistencyGraph;
+class PatchMatchCpu;
 class PatchMatchCuda;
 class Workspace;
 
@@ -60,10 +61,17 @@ struct PatchMatchOptions {
   // Maximum image size in either dimension.
   int max_image_size = -1;
 
+  // Whether to use the GPU for patch match. If CUDA is not available or no
+  // CUDA device is found, the CPU implementation is used instead.
+  bool use_gpu = true;
+
   // Index of the GPU used for patch match. For multi-GPU usage,
   // you should separate multiple GPU indices by comma, e.g., "0,1,2,3".
   std::string gpu_index = "-1";
 
+  // Number of threads used by the CPU implementation.
+  int num_threads = -1;
+
   // Depth range in which to randomly sample depth hypotheses.
   double depth_min = -1.0f;
   double depth_max = -1.0f;
@@ -155,6 +163,7 @@ struct PatchMatchOptions {
     CHECK_OPTION_LT(min_triangulation_angle, 180.0f);
     CHECK_OPTION_GT(incident_angle_sigma, 0.0f);
     CHECK_OPTION_GT(num_iterations, 0);
+    CHECK_OPTION_GE(num_threads, -1);
     CHECK_OPTION_GE(geom_consistency_regularizer, 0.0f);
     CHECK_OPTION_GE(geom_consistency_max_cost, 0.0f);
     CHECK_OPTION_GE(filter_min_ncc, -1.0f);
@@ -168,9 +177,9 @@ struct PatchMatchOptions {
   }
 };
 
-// This is a wrapper class around the actual PatchMatchCuda implementation. This
-// class is necessary to hide Cuda code from any boost or Eigen code, since
-// NVCC/MSVC cannot compile complex C++ code.
+// This is a wrapper class around the actual PatchMatchCuda and PatchMatchCpu
+// implementations. This class is necessary to hide Cuda code from any boost or
+// Eigen code, since NVCC/MSVC cannot compile complex C++ code.
 class PatchMatch {
  public:
   struct Problem {
@@ -211,7 +220,10 @@ class PatchMatch {
  private:
   const PatchMatchOptions options_;
   const Problem problem_;
+  std::unique_ptr<PatchMatchCpu> patch_match_cpu_;
+#ifdef CUDA_ENABLED
   std::unique_ptr<PatchMatchCuda> patch_match_cuda_;
+#endif
 };
 
 // This thread processes all problems in a workspace. A workspace has the
@@ -269,6 +281,7 @@ class PatchMatchController : public Thread {
   std::mutex workspace_mutex_;
   std::unique_ptr<Workspace> workspace_;
   std::vector<PatchMatch::Problem> problems_;
+  bool use_gpu_ = false;
   std::vector<int> gpu_indices_;
   std::vector<std::pair<float, float>> depth_ranges_;
 };
@@ -0,0 +1,1416 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define _USE_MATH_DEFINES
+
+#include "mvs/patch_match_cpu.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "util/logging.h"
+#include "util/math.h"
+#include "util/misc.h"
+#include "util/timer.h"
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+// The number of parameters per source image in the poses array, i.e.
+// K(4), R(9), T(3), C(3), P(12), inv(P)(12).
+const size_t kNumTformParams = 4 + 9 + 3 + 3 + 12 + 12;
+
+// The number of columns processed by a single thread pool task.
+const int kNumColsPerTask = 8;
+
+inline void Mat33DotVec3(const float mat[9], const float vec[3],
+                         float result[3]) {
+  result[0] = mat[0] * vec[0] + mat[1] * vec[1] + mat[2] * vec[2];
+  result[1] = mat[3] * vec[0] + mat[4] * vec[1] + mat[5] * vec[2];
+  result[2] = mat[6] * vec[0] + mat[7] * vec[1] + mat[8] * vec[2];
+}
+
+inline void Mat33DotVec3Homogeneous(const float mat[9], const float vec[2],
+                                    float result[2]) {
+  const float inv_z = 1.0f / (mat[6] * vec[0] + mat[7] * vec[1] + mat[8]);
+  result[0] = inv_z * (mat[0] * vec[0] + mat[1] * vec[1] + mat[2]);
+  result[1] = inv_z * (mat[3] * vec[0] + mat[4] * vec[1] + mat[5]);
+}
+
+inline float DotProduct3(const float vec1[3], const float vec2[3]) {
+  return vec1[0] * vec2[0] + vec1[1] * vec2[1] + vec1[2] * vec2[2];
+}
+
+// Uniformly distributed random number in the range (0, 1], equivalent to
+// `curand_uniform` in the CUDA implementation.
+inline float GenerateRandomUniform(std::mt19937* rand_state) {
+  std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+  return 1.0f - distribution(*rand_state);
+}
+
+inline float GenerateRandomDepth(const float depth_min, const float depth_max,
+                                 std::mt19937* rand_state) {
+  return GenerateRandomUniform(rand_state) * (depth_max - depth_min) +
+         depth_min;
+}
+
+inline void GenerateRandomNormal(const int row, const int col,
+                                 const float ref_inv_K[4],
+                                 std::mt19937* rand_state, float normal[3]) {
+  // Unbiased sampling of normal, according to George Marsaglia, "Choosing a
+  // Point from the Surface of a Sphere", 1972.
+  float v1 = 0.0f;
+  float v2 = 0.0f;
+  float s = 2.0f;
+  while (s >= 1.0f) {
+    v1 = 2.0f * GenerateRandomUniform(rand_state) - 1.0f;
+    v2 = 2.0f * GenerateRandomUniform(rand_state) - 1.0f;
+    s = v1 * v1 + v2 * v2;
+  }
+
+  const float s_norm = std::sqrt(1.0f - s);
+  normal[0] = 2.0f * v1 * s_norm;
+  normal[1] = 2.0f * v2 * s_norm;
+  normal[2] = 1.0f - 2.0f * s;
+
+  // Make sure normal is looking away from camera.
+  const float view_ray[3] = {ref_inv_K[0] * col + ref_inv_K[1],
+                             ref_inv_K[2] * row + ref_inv_K[3], 1.0f};
+  if (DotProduct3(normal, view_ray) > 0) {
+    normal[0] = -normal[0];
+    normal[1] = -normal[1];
+    normal[2] = -normal[2];
+  }
+}
+
+inline float PerturbDepth(const float perturbation, const float depth,
+                          std::mt19937* rand_state) {
+  const float depth_min = (1.0f - perturbation) * depth;
+  const float depth_max = (1.0f + perturbation) * depth;
+  return GenerateRandomDepth(depth_min, depth_max, rand_state);
+}
+
+void PerturbNormal(const int row, const int col, const float perturbation,
+                   const float normal[3], const float ref_inv_K[4],
+                   std::mt19937* rand_state, float perturbed_normal[3],
+                   const int num_trials = 0) {
+  // Perturbation rotation angles.
+  const float a1 = (GenerateRandomUniform(rand_state) - 0.5f) * perturbation;
+  const float a2 = (GenerateRandomUniform(rand_state) - 0.5f) * perturbation;
+  const float a3 = (GenerateRandomUniform(rand_state) - 0.5f) * perturbation;
+
+  const float sin_a1 = std::sin(a1);
+  const float sin_a2 = std::sin(a2);
+  const float sin_a3 = std::sin(a3);
+  const float cos_a1 = std::cos(a1);
+  const float cos_a2 = std::cos(a2);
+  const float cos_a3 = std::cos(a3);
+
+  // R = Rx * Ry * Rz
+  float R[9];
+  R[0] = cos_a2 * cos_a3;
+  R[1] = -cos_a2 * sin_a3;
+  R[2] = sin_a2;
+  R[3] = cos_a1 * sin_a3 + cos_a3 * sin_a1 * sin_a2;
+  R[4] = cos_a1 * cos_a3 - sin_a1 * sin_a2 * sin_a3;
+  R[5] = -cos_a2 * sin_a1;
+  R[6] = sin_a1 * sin_a3 - cos_a1 * cos_a3 * sin_a2;
+  R[7] = cos_a3 * sin_a1 + cos_a1 * sin_a2 * sin_a3;
+  R[8] = cos_a1 * cos_a2;
+
+  // Perturb the normal vector.
+  Mat33DotVec3(R, normal, perturbed_normal);
+
+  // Make sure the perturbed normal is still looking in the same direction as
+  // the viewing direction, otherwise try again but with smaller perturbation.
+  const float view_ray[3] = {ref_inv_K[0] * col + ref_inv_K[1],
+                             ref_inv_K[2] * row + ref_inv_K[3], 1.0f};
+  if (DotProduct3(perturbed_normal, view_ray) >= 0.0f) {
+    const int kMaxNumTrials = 3;
+    if (num_trials < kMaxNumTrials) {
+      PerturbNormal(row, col, 0.5f * perturbation, normal, ref_inv_K,
+                    rand_state, perturbed_normal, num_trials + 1);
+      return;
+    } else {
+      perturbed_normal[0] = normal[0];
+      perturbed_normal[1] = normal[1];
+      perturbed_normal[2] = normal[2];
+      return;
+    }
+  }
+
+  // Make sure normal has unit norm.
+  const float inv_norm =
+      1.0f / std::sqrt(DotProduct3(perturbed_normal, perturbed_normal));
+  perturbed_normal[0] *= inv_norm;
+  perturbed_normal[1] *= inv_norm;
+  perturbed_normal[2] *= inv_norm;
+}
+
+// Bilinear interpolation of the image at the given position with a zero
+// border, equivalent to a CUDA texture with linear filtering.
+inline float SampleBilinear(const Mat<uint8_t>& image, const float col,
+                            const float row) {
+  const int width = static_cast<int>(image.GetWidth());
+  const int height = static_cast<int>(image.GetHeight());
+
+  // Note that this also catches non-finite coordinates.
+  if (!(col > -1.0f && row > -1.0f && col < width && row < height)) {
+    return 0.0f;
+  }
+
+  const float col_floor = std::floor(col);
+  const float row_floor = std::floor(row);
+  const int col0 = static_cast<int>(col_floor);
+  const int row0 = static_cast<int>(row_floor);
+  const int col1 = col0 + 1;
+  const int row1 = row0 + 1;
+  const float dcol = col - col_floor;
+  const float drow = row - row_floor;
+
+  const uint8_t* data = image.GetPtr();
+  const bool valid_col0 = col0 >= 0;
+  const bool valid_col1 = col1 < width;
+  const bool valid_row0 = row0 >= 0;
+  const bool valid_row1 = row1 < height;
+
+  const float color00 =
+      valid_row0 && valid_col0 ? data[row0 * width + col0] : 0.0f;
+  const float color01 =
+      valid_row0 && valid_col1 ? data[row0 * width + col1] : 0.0f;
+  const float color10 =
+      valid_row1 && valid_col0 ? data[row1 * width + col0] : 0.0f;
+  const float color11 =
+      valid_row1 && valid_col1 ? data[row1 * width + col1] : 0.0f;
+
+  const float kNormalization = 1.0f / 255.0f;
+  return kNormalization *
+         ((1.0f - drow) * ((1.0f - dcol) * color00 + dcol * color01) +
+          drow * ((1.0f - dcol) * color10 + dcol * color11));
+}
+
+// Rotate the matrix by 90 degrees in counter-clockwise direction.
+template <typename T>
+Mat<T> RotateMat(const Mat<T>& input) {
+  const size_t width = input.GetWidth();
+  const size_t height = input.GetHeight();
+  const size_t depth = input.GetDepth();
+  Mat<T> output(height, width, depth);
+  const T* input_data = input.GetPtr();
+  T* output_data = output.GetPtr();
+  for (size_t slice = 0; slice < depth; ++slice) {
+    const size_t slice_offset = slice * width * height;
+    for (size_t row = 0; row < height; ++row) {
+      for (size_t col = 0; col < width; ++col) {
+        output_data[slice_offset + (width - 1 - col) * height + row] =
+            input_data[slice_offset + row * width + col];
+      }
+    }
+  }
+  return output;
+}
+
+inline void TransformPDFToCDF(float* probs, const int num_probs) {
+  float prob_sum = 0.0f;
+  for (int i = 0; i < num_probs; ++i) {
+    prob_sum += probs[i];
+  }
+  const float inv_prob_sum = 1.0f / prob_sum;
+
+  float cum_prob = 0.0f;
+  for (int i = 0; i < num_probs; ++i) {
+    const float prob = probs[i] * inv_prob_sum;
+    cum_prob += prob;
+    probs[i] = cum_prob;
+  }
+}
+
+// Find index of minimum in given values.
+template <int kNumCosts>
+inline int FindMinCost(const float costs[kNumCosts]) {
+  float min_cost = costs[0];
+  int min_cost_idx = 0;
+  for (int idx = 1; idx < kNumCosts; ++idx) {
+    if (costs[idx] <= min_cost) {
+      min_cost = costs[idx];
+      min_cost_idx = idx;
+    }
+  }
+  return min_cost_idx;
+}
+
+class LikelihoodComputer {
+ public:
+  LikelihoodComputer(const float ncc_sigma, const float min_triangulation_angle,
+                     const float incident_angle_sigma)
+      : cos_min_triangulation_angle_(std::cos(min_triangulation_angle)),
+        inv_incident_angle_sigma_square_(
+            -0.5f / (incident_angle_sigma * incident_angle_sigma)),
+        inv_ncc_sigma_square_(-0.5f / (ncc_sigma * ncc_sigma)),
+        ncc_norm_factor_(ComputeNCCCostNormFactor(ncc_sigma)) {}
+
+  // Compute forward message from current cost and forward message of
+  // previous / neighboring pixel.
+  float ComputeForwardMessage(const float cost, const float prev) const {
+    return ComputeMessage<true>(cost, prev);
+  }
+
+  // Compute backward message from current cost and backward message of
+  // previous / neighboring pixel.
+  float ComputeBackwardMessage(const float cost, const float prev) const {
+    return ComputeMessage<false>(cost, prev);
+  }
+
+  // Compute the selection probability from the forward and backward message.
+  inline float ComputeSelProb(const float alpha, const float beta,
+                              const float prev, const float prev_weight) const {
+    const float zn0 = (1.0f - alpha) * (1.0f - beta);
+    const float zn1 = alpha * beta;
+    const float curr = zn1 / (zn0 + zn1);
+    return prev_weight * prev + (1.0f - prev_weight) * curr;
+  }
+
+  // Compute NCC probability. Note that cost = 1 - NCC.
+  inline float ComputeNCCProb(const float cost) const {
+    return std::exp(cost * cost * inv_ncc_sigma_square_) * ncc_norm_factor_;
+  }
+
+  // Compute the triangulation angle probability.
+  inline float ComputeTriProb(const float cos_triangulation_angle) const {
+    const float abs_cos_triangulation_angle =
+        std::abs(cos_triangulation_angle);
+    if (abs_cos_triangulation_angle > cos_min_triangulation_angle_) {
+      const float scaled = 1.0f - (1.0f - abs_cos_triangulation_angle) /
+                                      (1.0f - cos_min_triangulation_angle_);
+      const float likelihood = 1.0f - scaled * scaled;
+      return std::min(1.0f, std::max(0.0f, likelihood));
+    } else {
+      return 1.0f;
+    }
+  }
+
+  // Compute the incident angle probability.
+  inline float ComputeIncProb(const float cos_incident_angle) const {
+    const float x = 1.0f - std::max(0.0f, cos_incident_angle);
+    return std::exp(x * x * inv_incident_angle_sigma_square_);
+  }
+
+  // Compute the warping/resolution prior probability.
+  inline float ComputeResolutionProb(const float H[9], const float row,
+                                     const float col,
+                                     const int window_radius) const {
+    const int window_size = 2 * window_radius + 1;
+
+    // Warp corners of patch in reference image to source image.
+    float src1[2];
+    const float ref1[2] = {col - window_radius, row - window_radius};
+    Mat33DotVec3Homogeneous(H, ref1, src1);
+    float src2[2];
+    const float ref2[2] = {col - window_radius, row + window_radius};
+    Mat33DotVec3Homogeneous(H, ref2, src2);
+    float src3[2];
+    const float ref3[2] = {col + window_radius, row + window_radius};
+    Mat33DotVec3Homogeneous(H, ref3, src3);
+    float src4[2];
+    const float ref4[2] = {col + window_radius, row - window_radius};
+    Mat33DotVec3Homogeneous(H, ref4, src4);
+
+    // Compute area of patches in reference and source image.
+    const float ref_area = window_size * window_size;
+    const float src_area = std::abs(
+        0.5f * (src1[0] * src2[1] - src2[0] * src1[1] - src1[0] * src4[1] +
+                src2[0] * src3[1] - src3[0] * src2[1] + src4[0] * src1[1] +
+                src3[0] * src4[1] - src4[0] * src3[1]));
+
+    if (ref_area > src_area) {
+      return src_area / ref_area;
+    } else {
+      return ref_area / src_area;
+    }
+  }
+
+ private:
+  // The normalization for the likelihood function, i.e. the normalization for
+  // the prior on the matching cost.
+  static inline float ComputeNCCCostNormFactor(const float ncc_sigma) {
+    // A = sqrt(2pi)*sigma/2*erf(sqrt(2)/sigma)
+    // erf(x) = 2/sqrt(pi) * integral from 0 to x of exp(-t^2) dt
+    return 2.0f / (std::sqrt(2.0f * static_cast<float>(M_PI)) * ncc_sigma *
+                   std::erf(2.0f / (ncc_sigma * 1.414213562f)));
+  }
+
+  // Compute the forward or backward message.
+  template <bool kForward>
+  inline float ComputeMessage(const float cost, const float prev) const {
+    const float kUniformProb = 0.5f;
+    const float kNoChangeProb = 0.99999f;
+    const float kChangeProb = 1.0f - kNoChangeProb;
+    const float emission = ComputeNCCProb(cost);
+
+    float zn0;  // Message for selection probability = 0.
+    float zn1;  // Message for selection probability = 1.
+    if (kForward) {
+      zn0 = (prev * kChangeProb + (1.0f - prev) * kNoChangeProb) * kUniformProb;
+      zn1 = (prev * kNoChangeProb + (1.0f - prev) * kChangeProb) * emission;
+    } else {
+      zn0 = prev * emission * kChangeProb +
+            (1.0f - prev) * kUniformProb * kNoChangeProb;
+      zn1 = prev * emission * kNoChangeProb +
+            (1.0f - prev) * kUniformProb * kChangeProb;
+    }
+
+    return zn1 / (zn0 + zn1);
+  }
+
+  float cos_min_triangulation_angle_;
+  float inv_incident_angle_sigma_square_;
+  float inv_ncc_sigma_square_;
+  float ncc_norm_factor_;
+};
+
+void PrintElapsedSeconds(const Timer& timer, const std::string& message) {
+  std::cout << StringPrintf("%s: %.4fs", message.c_str(),
+                            timer.ElapsedSeconds())
+            << std::endl;
+}
+
+}  // namespace
+
+struct PatchMatchCpu::SweepOptions {
+  float perturbation = 1.0f;
+  float depth_min = 0.0f;
+  float depth_max = 1.0f;
+  int num_samples = 15;
+  float sigma_spatial = 3.0f;
+  float sigma_color = 0.3f;
+  float ncc_sigma = 0.6f;
+  float min_triangulation_angle = 0.5f;
+  float incident_angle_sigma = 0.9f;
+  float prev_sel_prob_weight = 0.0f;
+  bool geom_consistency = false;
+  float geom_consistency_regularizer = 0.1f;
+  float geom_consistency_max_cost = 5.0f;
+  bool filter_photo_consistency = false;
+  bool filter_geom_consistency = false;
+  float filter_min_ncc = 0.1f;
+  float filter_min_triangulation_angle = 3.0f;
+  int filter_min_num_consistent = 2;
+  float filter_geom_consistency_max_cost = 1.0f;
+  // Seed of the random number generators of the current sweep.
+  unsigned int seed = 0;
+};
+
+// Workspace memory of a single thread processing one column at a time.
+struct PatchMatchCpu::ColumnWorkspace {
+  explicit ColumnWorkspace(const int num_patch_pixels,
+                           const int num_src_images)
+      : ref_colors(num_patch_pixels),
+        ref_weights(num_patch_pixels),
+        ref_weighted_colors(num_patch_pixels),
+        src_cols(num_patch_pixels),
+        src_rows(num_patch_pixels),
+        src_inv_zs(num_patch_pixels),
+        src_colors(num_patch_pixels),
+        forward_message(num_src_images),
+        sampling_probs(num_src_images) {}
+
+  // Colors, normalized bilateral weights, and weighted colors of the current
+  // reference patch, and the resulting weighted color statistics.
+  Eigen::ArrayXf ref_colors;
+  Eigen::ArrayXf ref_weights;
+  Eigen::ArrayXf ref_weighted_colors;
+  float ref_color_sum = 0.0f;
+  float ref_color_squared_sum = 0.0f;
+
+  // Warped patch coordinates and colors in the source image.
+  Eigen::ArrayXf src_cols;
+  Eigen::ArrayXf src_rows;
+  Eigen::ArrayXf src_inv_zs;
+  Eigen::ArrayXf src_colors;
+
+  std::vector<float> forward_message;
+  std::vector<float> sampling_probs;
+
+  std::mt19937 rand_state;
+};
+
+PatchMatchCpu::PatchMatchCpu(const PatchMatchOptions& options,
+                             const PatchMatch::Problem& problem)
+    : options_(options),
+      problem_(problem),
+      ref_width_(0),
+      ref_height_(0),
+      rotation_in_half_pi_(0) {
+  InitPatchOffsets();
+  InitRefImage();
+  InitSourceImages();
+  InitTransforms();
+  InitWorkspaceMemory();
+}
+
+void PatchMatchCpu::Run() {
+  Timer total_timer;
+  total_timer.Start();
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(options_.num_threads));
+
+  Timer init_timer;
+  init_timer.Start();
+
+  ComputeInitialCost(&thread_pool);
+
+  PrintElapsedSeconds(init_timer, "Initialization");
+
+  const float total_num_steps = options_.num_iterations * 4;
+
+  SweepOptions sweep_options;
+  sweep_options.depth_min = options_.depth_min;
+  sweep_options.depth_max = options_.depth_max;
+  sweep_options.sigma_spatial = options_.sigma_spatial;
+  sweep_options.sigma_color = options_.sigma_color;
+  sweep_options.num_samples = options_.num_samples;
+  sweep_options.ncc_sigma = options_.ncc_sigma;
+  sweep_options.min_triangulation_angle =
+      DegToRad(options_.min_triangulation_angle);
+  sweep_options.incident_angle_sigma = options_.incident_angle_sigma;
+  sweep_options.geom_consistency = options_.geom_consistency;
+  sweep_options.geom_consistency_regularizer =
+      options_.geom_consistency_regularizer;
+  sweep_options.geom_consistency_max_cost = options_.geom_consistency_max_cost;
+  sweep_options.filter_min_ncc = options_.filter_min_ncc;
+  sweep_options.filter_min_triangulation_angle =
+      DegToRad(options_.filter_min_triangulation_angle);
+  sweep_options.filter_min_num_consistent = options_.filter_min_num_consistent;
+  sweep_options.filter_geom_consistency_max_cost =
+      options_.filter_geom_consistency_max_cost;
+
+  for (int iter = 0; iter < options_.num_iterations; ++iter) {
+    Timer iter_timer;
+    iter_timer.Start();
+
+    for (int sweep = 0; sweep < 4; ++sweep) {
+      Timer sweep_timer;
+      sweep_timer.Start();
+
+      // Expenentially reduce amount of perturbation during the optimization.
+      sweep_options.perturbation = 1.0f / std::pow(2.0f, iter + sweep / 4.0f);
+
+      // Linearly increase the influence of previous selection probabilities.
+      sweep_options.prev_sel_prob_weight =
+          static_cast<float>(iter * 4 + sweep) / total_num_steps;
+
+      sweep_options.seed = static_cast<unsigned int>(iter * 4 + sweep + 1);
+
+      const bool last_sweep = iter == options_.num_iterations - 1 && sweep == 3;
+
+      if (last_sweep && options_.filter) {
+        consistency_mask_ =
+            Mat<uint8_t>(cost_map_.GetWidth(), cost_map_.GetHeight(),
+                         cost_map_.GetDepth());
+        sweep_options.filter_photo_consistency = true;
+        sweep_options.filter_geom_consistency = options_.geom_consistency;
+      }
+
+      Sweep(sweep_options, &thread_pool);
+
+      Rotate();
+
+      // Rotate selected image map.
+      if (last_sweep && options_.filter) {
+        consistency_mask_ = RotateMat(consistency_mask_);
+      }
+
+      PrintElapsedSeconds(sweep_timer, " Sweep " + std::to_string(sweep + 1));
+    }
+
+    PrintElapsedSeconds(iter_timer, "Iteration " + std::to_string(iter + 1));
+  }
+
+  PrintElapsedSeconds(total_timer, "Total");
+}
+
+DepthMap PatchMatchCpu::GetDepthMap() const {
+  return DepthMap(depth_map_, options_.depth_min, options_.depth_max);
+}
+
+NormalMap PatchMatchCpu::GetNormalMap() const { return NormalMap(normal_map_); }
+
+Mat<float> PatchMatchCpu::GetSelProbMap() const { return prev_sel_prob_map_; }
+
+std::vector<int> PatchMatchCpu::GetConsistentImageIdxs() const {
+  const Mat<uint8_t>& mask = consistency_mask_;
+  std::vector<int> consistent_image_idxs;
+  std::vector<int> pixel_consistent_image_idxs;
+  pixel_consistent_image_idxs.reserve(mask.GetDepth());
+  for (size_t r = 0; r < mask.GetHeight(); ++r) {
+    for (size_t c = 0; c < mask.GetWidth(); ++c) {
+      pixel_consistent_image_idxs.clear();
+      for (size_t d = 0; d < mask.GetDepth(); ++d) {
+        if (mask.Get(r, c, d)) {
+          pixel_consistent_image_idxs.push_back(problem_.src_image_idxs[d]);
+        }
+      }
+      if (pixel_consistent_image_idxs.size() > 0) {
+        consistent_image_idxs.push_back(c);
+        consistent_image_idxs.push_back(r);
+        consistent_image_idxs.push_back(pixel_consistent_image_idxs.size());
+        consistent_image_idxs.insert(consistent_image_idxs.end(),
+                                     pixel_consistent_image_idxs.begin(),
+                                     pixel_consistent_image_idxs.end());
+      }
+    }
+  }
+  return consistent_image_idxs;
+}
+
+void PatchMatchCpu::InitPatchOffsets() {
+  const int window_radius = options_.window_radius;
+  const int window_step = options_.window_step;
+
+  int num_patch_pixels = 0;
+  for (int row = -window_radius; row <= window_radius; row += window_step) {
+    for (int col = -window_radius; col <= window_radius; col += window_step) {
+      num_patch_pixels += 1;
+    }
+  }
+
+  patch_row_offsets_.resize(num_patch_pixels);
+  patch_col_offsets_.resize(num_patch_pixels);
+
+  int idx = 0;
+  for (int row = -window_radius; row <= window_radius; row += window_step) {
+    for (int col = -window_radius; col <= window_radius; col += window_step) {
+      patch_row_offsets_(idx) = row;
+      patch_col_offsets_(idx) = col;
+      idx += 1;
+    }
+  }
+
+  const float spatial_normalization =
+      1.0f / (2.0f * options_.sigma_spatial * options_.sigma_spatial);
+  patch_spatial_weights_ =
+      (-(patch_row_offsets_.square() + patch_col_offsets_.square()) *
+       spatial_normalization)
+          .exp();
+}
+
+void PatchMatchCpu::InitRefImage() {
+  const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+
+  ref_width_ = ref_image.GetWidth();
+  ref_height_ = ref_image.GetHeight();
+
+  const std::vector<uint8_t> ref_image_array =
+      ref_image.GetBitmap().ConvertToRowMajorArray();
+  ref_image_ = Mat<float>(ref_width_, ref_height_, 1);
+  float* ref_image_data = ref_image_.GetPtr();
+  for (size_t i = 0; i < ref_image_array.size(); ++i) {
+    ref_image_data[i] = ref_image_array[i] / 255.0f;
+  }
+}
+
+void PatchMatchCpu::InitSourceImages() {
+  src_images_.resize(problem_.src_image_idxs.size());
+  for (size_t i = 0; i < problem_.src_image_idxs.size(); ++i) {
+    const Image& image = problem_.images->at(problem_.src_image_idxs[i]);
+    const std::vector<uint8_t> image_array =
+        image.GetBitmap().ConvertToRowMajorArray();
+    src_images_[i] = Mat<uint8_t>(image.GetWidth(), image.GetHeight(), 1);
+    memcpy(src_images_[i].GetPtr(), image_array.data(),
+           image_array.size() * sizeof(uint8_t));
+  }
+
+  if (options_.geom_consistency) {
+    src_depth_maps_.resize(problem_.src_image_idxs.size());
+    for (size_t i = 0; i < problem_.src_image_idxs.size(); ++i) {
+      src_depth_maps_[i] = &problem_.depth_maps->at(problem_.src_image_idxs[i]);
+    }
+  }
+}
+
+void PatchMatchCpu::InitTransforms() {
+  const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Generate rotated versions (counter-clockwise) of calibration matrix.
+  //////////////////////////////////////////////////////////////////////////////
+
+  for (size_t i = 0; i < 4; ++i) {
+    ref_K_[i][0] = ref_image.GetK()[0];
+    ref_K_[i][1] = ref_image.GetK()[2];
+    ref_K_[i][2] = ref_image.GetK()[4];
+    ref_K_[i][3] = ref_image.GetK()[5];
+  }
+
+  // Rotated by 90 degrees.
+  std::swap(ref_K_[1][0], ref_K_[1][2]);
+  std::swap(ref_K_[1][1], ref_K_[1][3]);
+  ref_K_[1][3] = ref_width_ - 1 - ref_K_[1][3];
+
+  // Rotated by 180 degrees.
+  ref_K_[2][1] = ref_width_ - 1 - ref_K_[2][1];
+  ref_K_[2][3] = ref_height_ - 1 - ref_K_[2][3];
+
+  // Rotated by 270 degrees.
+  std::swap(ref_K_[3][0], ref_K_[3][2]);
+  std::swap(ref_K_[3][1], ref_K_[3][3]);
+  ref_K_[3][1] = ref_height_ - 1 - ref_K_[3][1];
+
+  // Extract 1/fx, -cx/fx, fy, -cy/fy.
+  for (size_t i = 0; i < 4; ++i) {
+    ref_inv_K_[i][0] = 1.0f / ref_K_[i][0];
+    ref_inv_K_[i][1] = -ref_K_[i][1] / ref_K_[i][0];
+    ref_inv_K_[i][2] = 1.0f / ref_K_[i][2];
+    ref_inv_K_[i][3] = -ref_K_[i][3] / ref_K_[i][2];
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Generate rotated versions of camera poses.
+  //////////////////////////////////////////////////////////////////////////////
+
+  float rotated_R[9];
+  memcpy(rotated_R, ref_image.GetR(), 9 * sizeof(float));
+
+  float rotated_T[3];
+  memcpy(rotated_T, ref_image.GetT(), 3 * sizeof(float));
+
+  // Matrix for 90deg rotation around Z-axis in counter-clockwise direction.
+  const float R_z90[9] = {0, 1, 0, -1, 0, 0, 0, 0, 1};
+
+  for (size_t i = 0; i < 4; ++i) {
+    poses_[i].resize(kNumTformParams * problem_.src_image_idxs.size());
+    float* pose = poses_[i].data();
+    for (const auto image_idx : problem_.src_image_idxs) {
+      const Image& image = problem_.images->at(image_idx);
+
+      const float K[4] = {image.GetK()[0], image.GetK()[2], image.GetK()[4],
+                          image.GetK()[5]};
+      memcpy(pose, K, 4 * sizeof(float));
+
+      float* rel_R = pose + 4;
+      float* rel_T = pose + 13;
+      ComputeRelativePose(rotated_R, rotated_T, image.GetR(), image.GetT(),
+                          rel_R, rel_T);
+      ComputeProjectionCenter(rel_R, rel_T, pose + 16);
+      ComposeProjectionMatrix(image.GetK(), rel_R, rel_T, pose + 19);
+      ComposeInverseProjectionMatrix(image.GetK(), rel_R, rel_T, pose + 31);
+
+      pose += kNumTformParams;
+    }
+
+    RotatePose(R_z90, rotated_R, rotated_T);
+  }
+}
+
+void PatchMatchCpu::InitWorkspaceMemory() {
+  const size_t num_src_images = problem_.src_image_idxs.size();
+
+  depth_map_ = Mat<float>(ref_width_, ref_height_, 1);
+  normal_map_ = Mat<float>(ref_width_, ref_height_, 3);
+
+  if (options_.geom_consistency) {
+    depth_map_ = problem_.depth_maps->at(problem_.ref_image_idx);
+    normal_map_ = problem_.normal_maps->at(problem_.ref_image_idx);
+  } else {
+    for (size_t row = 0; row < ref_height_; ++row) {
+      std::mt19937 rand_state(static_cast<unsigned int>(row));
+      for (size_t col = 0; col < ref_width_; ++col) {
+        depth_map_.Set(row, col,
+                       GenerateRandomDepth(options_.depth_min,
+                                           options_.depth_max, &rand_state));
+        float normal[3];
+        GenerateRandomNormal(row, col, ref_inv_K_[0], &rand_state, normal);
+        for (int d = 0; d < 3; ++d) {
+          normal_map_.Set(row, col, d, normal[d]);
+        }
+      }
+    }
+  }
+
+  sel_prob_map_ = Mat<float>(ref_width_, ref_height_, num_src_images);
+  prev_sel_prob_map_ = Mat<float>(ref_width_, ref_height_, num_src_images);
+  prev_sel_prob_map_.Fill(0.5f);
+
+  cost_map_ = Mat<float>(ref_width_, ref_height_, num_src_images);
+}
+
+void PatchMatchCpu::ComputeInitialCost(ThreadPool* thread_pool) {
+  const int width = static_cast<int>(cost_map_.GetWidth());
+  const int height = static_cast<int>(cost_map_.GetHeight());
+  const int num_src_images = static_cast<int>(cost_map_.GetDepth());
+  const size_t num_pixels = cost_map_.GetWidth() * cost_map_.GetHeight();
+
+  for (int col_start = 0; col_start < width; col_start += kNumColsPerTask) {
+    const int col_end = std::min(width, col_start + kNumColsPerTask);
+    thread_pool->AddTask([this, col_start, col_end, height, width,
+                          num_src_images, num_pixels]() {
+      ColumnWorkspace workspace(patch_row_offsets_.size(), num_src_images);
+      const float* depth_data = depth_map_.GetPtr();
+      const float* normal_data = normal_map_.GetPtr();
+      float* cost_data = cost_map_.GetPtr();
+      for (int col = col_start; col < col_end; ++col) {
+        for (int row = 0; row < height; ++row) {
+          const size_t pixel_idx = row * width + col;
+          const float depth = depth_data[pixel_idx];
+          const float normal[3] = {normal_data[pixel_idx],
+                                   normal_data[num_pixels + pixel_idx],
+                                   normal_data[2 * num_pixels + pixel_idx]};
+          SetRefPatch(row, col, &workspace);
+          for (int image_idx = 0; image_idx < num_src_images; ++image_idx) {
+            cost_data[image_idx * num_pixels + pixel_idx] =
+                ComputePhotoConsistencyCost(image_idx, row, col, depth, normal,
+                                            &workspace);
+          }
+        }
+      }
+    });
+  }
+
+  thread_pool->Wait();
+}
+
+void PatchMatchCpu::Sweep(const SweepOptions& sweep_options,
+                          ThreadPool* thread_pool) {
+  const int width = static_cast<int>(cost_map_.GetWidth());
+  const int num_src_images = static_cast<int>(cost_map_.GetDepth());
+
+  for (int col_start = 0; col_start < width; col_start += kNumColsPerTask) {
+    const int col_end = std::min(width, col_start + kNumColsPerTask);
+    thread_pool->AddTask(
+        [this, &sweep_options, col_start, col_end, num_src_images]() {
+          ColumnWorkspace workspace(patch_row_offsets_.size(), num_src_images);
+          for (int col = col_start; col < col_end; ++col) {
+            SweepColumn(sweep_options, col, &workspace);
+          }
+        });
+  }
+
+  thread_pool->Wait();
+}
+
+void PatchMatchCpu::SweepColumn(const SweepOptions& options, const int col,
+                                ColumnWorkspace* workspace) {
+  const int width = static_cast<int>(cost_map_.GetWidth());
+  const int height = static_cast<int>(cost_map_.GetHeight());
+  const int num_src_images = static_cast<int>(cost_map_.GetDepth());
+  const size_t num_pixels = cost_map_.GetWidth() * cost_map_.GetHeight();
+
+  float* depth_data = depth_map_.GetPtr();
+  float* normal_data = normal_map_.GetPtr();
+  float* cost_data = cost_map_.GetPtr();
+  float* sel_prob_data = sel_prob_map_.GetPtr();
+  const float* prev_sel_prob_data = prev_sel_prob_map_.GetPtr();
+  uint8_t* consistency_mask_data = consistency_mask_.GetPtr();
+
+  const float* ref_inv_K = ref_inv_K_[rotation_in_half_pi_];
+
+  // Seed the random number generator independently of the thread that
+  // processes the column, such that the results are deterministic.
+  std::seed_seq seed_seq{options.seed, static_cast<unsigned int>(col)};
+  workspace->rand_state.seed(seed_seq);
+
+  // Probability for boundary pixels.
+  const float kUniformProb = 0.5f;
+
+  LikelihoodComputer likelihood_computer(options.ncc_sigma,
+                                         options.min_triangulation_angle,
+                                         options.incident_angle_sigma);
+
+  float* forward_message = workspace->forward_message.data();
+  float* sampling_probs = workspace->sampling_probs.data();
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Compute backward message for all rows. Note that the backward messages are
+  // temporarily stored in the sel_prob_map and replaced row by row as the
+  // updated forward messages are computed further below.
+  //////////////////////////////////////////////////////////////////////////////
+
+  for (int image_idx = 0; image_idx < num_src_images; ++image_idx) {
+    // Compute backward message.
+    float beta = kUniformProb;
+    for (int row = height - 1; row >= 0; --row) {
+      const size_t idx = image_idx * num_pixels + row * width + col;
+      beta = likelihood_computer.ComputeBackwardMessage(cost_data[idx], beta);
+      sel_prob_data[idx] = beta;
+    }
+
+    // Initialize forward message.
+    forward_message[image_idx] = kUniformProb;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Estimate parameters for remaining rows and compute selection probabilities.
+  //////////////////////////////////////////////////////////////////////////////
+
+  struct ParamState {
+    float depth = 0.0f;
+    float normal[3];
+  };
+
+  // Parameters of previous pixel in column.
+  ParamState prev_param_state;
+  // Parameters of current pixel in column.
+  ParamState curr_param_state;
+  // Randomly sampled parameters.
+  ParamState rand_param_state;
+
+  // Parameters for first row in column.
+  prev_param_state.depth = depth_data[col];
+  for (int d = 0; d < 3; ++d) {
+    prev_param_state.normal[d] = normal_data[d * num_pixels + col];
+  }
+
+  for (int row = 0; row < height; ++row) {
+    const size_t pixel_idx = row * width + col;
+
+    SetRefPatch(row, col, workspace);
+
+    // Propagate the depth at which the current ray intersects with the plane
+    // of the normal of the previous ray. This helps to better estimate
+    // the depth of very oblique structures, i.e. pixels whose normal direction
+    // is significantly different from their viewing direction.
+    prev_param_state.depth = PropagateDepth(
+        prev_param_state.depth, prev_param_state.normal, row - 1, row);
+
+    // Read parameters for current pixel from previous sweep.
+    curr_param_state.depth = depth_data[pixel_idx];
+    for (int d = 0; d < 3; ++d) {
+      curr_param_state.normal[d] = normal_data[d * num_pixels + pixel_idx];
+    }
+
+    // Generate random parameters.
+    rand_param_state.depth = PerturbDepth(
+        options.perturbation, curr_param_state.depth, &workspace->rand_state);
+    PerturbNormal(row, col, options.perturbation * M_PI,
+                  curr_param_state.normal, ref_inv_K, &workspace->rand_state,
+                  rand_param_state.normal);
+
+    // Read in the backward message, compute selection probabilities and
+    // modulate selection probabilities with priors.
+
+    float point[3];
+    ComputePointAtDepth(row, col, curr_param_state.depth, point);
+
+    for (int image_idx = 0; image_idx < num_src_images; ++image_idx) {
+      const size_t idx = image_idx * num_pixels + pixel_idx;
+      const float cost = cost_data[idx];
+      const float alpha = likelihood_computer.ComputeForwardMessage(
+          cost, forward_message[image_idx]);
+      const float beta = sel_prob_data[idx];
+      const float prev_prob = prev_sel_prob_data[idx];
+      const float sel_prob = likelihood_computer.ComputeSelProb(
+          alpha, beta, prev_prob, options.prev_sel_prob_weight);
+
+      float cos_triangulation_angle;
+      float cos_incident_angle;
+      ComputeViewingAngles(point, curr_param_state.normal, image_idx,
+                           &cos_triangulation_angle, &cos_incident_angle);
+      const float tri_prob =
+          likelihood_computer.ComputeTriProb(cos_triangulation_angle);
+      const float inc_prob =
+          likelihood_computer.ComputeIncProb(cos_incident_angle);
+
+      float H[9];
+      ComposeHomography(image_idx, row, col, curr_param_state.depth,
+                        curr_param_state.normal, H);
+      const float res_prob = likelihood_computer.ComputeResolutionProb(
+          H, row, col, options_.window_radius);
+
+      sampling_probs[image_idx] = sel_prob * tri_prob * inc_prob * res_prob;
+    }
+
+    TransformPDFToCDF(sampling_probs, num_src_images);
+
+    // Compute matching cost using Monte Carlo sampling of source images. Images
+    // with higher selection probability are more likely to be sampled. Hence,
+    // if only very few source images see the reference image pixel, the same
+    // source image is likely to be sampled many times. Instead of taking
+    // the best K probabilities, this sampling scheme has the advantage of
+    // being adaptive to any distribution of selection probabilities.
+
+    const int kNumCosts = 5;
+    float costs[kNumCosts];
+    const float depths[kNumCosts] = {
+        curr_param_state.depth, prev_param_state.depth, rand_param_state.depth,
+        curr_param_state.depth, rand_param_state.depth};
+    const float* normals[kNumCosts] = {
+        curr_param_state.normal, prev_param_state.normal,
+        rand_param_state.normal, rand_param_state.normal,
+        curr_param_state.normal};
+
+    for (int i = 0; i < kNumCosts; ++i) {
+      costs[i] = 0.0f;
+    }
+
+    for (int sample = 0; sample < options.num_samples; ++sample) {
+      const float rand_prob =
+          GenerateRandomUniform(&workspace->rand_state) - FLT_EPSILON;
+
+      int src_image_idx = -1;
+      for (int image_idx = 0; image_idx < num_src_images; ++image_idx) {
+        const float prob = sampling_probs[image_idx];
+        if (prob > rand_prob) {
+          src_image_idx = image_idx;
+          break;
+        }
+      }
+
+      if (src_image_idx == -1) {
+        continue;
+      }
+
+      costs[0] += cost_data[src_image_idx * num_pixels + pixel_idx];
+      if (options.geom_consistency) {
+        costs[0] += options.geom_consistency_regularizer *
+                    ComputeGeomConsistencyCost(
+                        src_image_idx, row, col, depths[0],
+                        options.geom_consistency_max_cost);
+      }
+
+      for (int i = 1; i < kNumCosts; ++i) {
+        costs[i] += ComputePhotoConsistencyCost(
+            src_image_idx, row, col, depths[i], normals[i], workspace);
+        if (options.geom_consistency) {
+          costs[i] += options.geom_consistency_regularizer *
+                      ComputeGeomConsistencyCost(
+                          src_image_idx, row, col, depths[i],
+                          options.geom_consistency_max_cost);
+        }
+      }
+    }
+
+    // Find the parameters of the minimum cost.
+    const int min_cost_idx = FindMinCost<kNumCosts>(costs);
+    const float best_depth = depths[min_cost_idx];
+    const float* best_normal = normals[min_cost_idx];
+
+    // Save best new parameters.
+    depth_data[pixel_idx] = best_depth;
+    for (int d = 0; d < 3; ++d) {
+      normal_data[d * num_pixels + pixel_idx] = best_normal[d];
+    }
+
+    // Use the new cost to recompute the updated forward message and
+    // the selection probability.
+    for (int image_idx = 0; image_idx < num_src_images; ++image_idx) {
+      const size_t idx = image_idx * num_pixels + pixel_idx;
+
+      // Determine the cost for best depth.
+      float cost;
+      if (min_cost_idx == 0) {
+        cost = cost_data[idx];
+      } else {
+        cost = ComputePhotoConsistencyCost(image_idx, row, col, best_depth,
+                                           best_normal, workspace);
+        cost_data[idx] = cost;
+      }
+
+      const float alpha = likelihood_computer.ComputeForwardMessage(
+          cost, forward_message[image_idx]);
+      const float beta = sel_prob_data[idx];
+      const float prev_prob = prev_sel_prob_data[idx];
+      const float prob = likelihood_computer.ComputeSelProb(
+          alpha, beta, prev_prob, options.prev_sel_prob_weight);
+      forward_message[image_idx] = alpha;
+      sel_prob_data[idx] = prob;
+    }
+
+    if (options.filter_photo_consistency || options.filter_geom_consistency) {
+      int num_consistent = 0;
+
+      float best_point[3];
+      ComputePointAtDepth(row, col, best_depth, best_point);
+
+      const float min_ncc_prob =
+          likelihood_computer.ComputeNCCProb(1.0f - options.filter_min_ncc);
+      const float cos_min_triangulation_angle =
+          std::cos(options.filter_min_triangulation_angle);
+
+      for (int image_idx = 0; image_idx < num_src_images; ++image_idx) {
+        const size_t idx = image_idx * num_pixels + pixel_idx;
+
+        float cos_triangulation_angle;
+        float cos_incident_angle;
+        ComputeViewingAngles(best_point, best_normal, image_idx,
+                             &cos_triangulation_angle, &cos_incident_angle);
+        if (cos_triangulation_angle > cos_min_triangulation_angle ||
+            cos_incident_angle <= 0.0f) {
+          continue;
+        }
+
+        bool consistent = true;
+        if (options.filter_photo_consistency) {
+          consistent = sel_prob_data[idx] >= min_ncc_prob;
+        }
+        if (consistent && options.filter_geom_consistency) {
+          consistent = ComputeGeomConsistencyCost(
+                           image_idx, row, col, best_depth,
+                           options.geom_consistency_max_cost) <=
+                       options.filter_geom_consistency_max_cost;
+        }
+
+        if (consistent) {
+          consistency_mask_data[idx] = 1;
+          num_consistent += 1;
+        }
+      }
+
+      if (num_consistent < options.filter_min_num_consistent) {
+        const float kFilterValue = 0.0f;
+        depth_data[pixel_idx] = kFilterValue;
+        for (int d = 0; d < 3; ++d) {
+          normal_data[d * num_pixels + pixel_idx] = kFilterValue;
+        }
+        for (int image_idx = 0; image_idx < num_src_images; ++image_idx) {
+          consistency_mask_data[image_idx * num_pixels + pixel_idx] = 0;
+        }
+      }
+    }
+
+    // Update previous depth for next row.
+    prev_param_state.depth = best_depth;
+    for (int i = 0; i < 3; ++i) {
+      prev_param_state.normal[i] = best_normal[i];
+    }
+  }
+}
+
+void PatchMatchCpu::SetRefPatch(const int row, const int col,
+                                ColumnWorkspace* workspace) const {
+  const int width = static_cast<int>(ref_image_.GetWidth());
+  const int height = static_cast<int>(ref_image_.GetHeight());
+  const float* ref_image_data = ref_image_.GetPtr();
+
+  // Read the patch with a zero border, equivalent to a CUDA texture.
+  for (int i = 0; i < workspace->ref_colors.size(); ++i) {
+    const int patch_row = row + static_cast<int>(patch_row_offsets_(i));
+    const int patch_col = col + static_cast<int>(patch_col_offsets_(i));
+    if (patch_row >= 0 && patch_col >= 0 && patch_row < height &&
+        patch_col < width) {
+      workspace->ref_colors(i) = ref_image_data[patch_row * width + patch_col];
+    } else {
+      workspace->ref_colors(i) = 0.0f;
+    }
+  }
+
+  const float center_color =
+      (row >= 0 && col >= 0 && row < height && col < width)
+          ? ref_image_data[row * width + col]
+          : 0.0f;
+
+  // Bilateral weights normalized to unit sum.
+  const float color_normalization =
+      1.0f / (2.0f * options_.sigma_color * options_.sigma_color);
+  workspace->ref_weights =
+      patch_spatial_weights_ *
+      (-(workspace->ref_colors - center_color).square() * color_normalization)
+          .exp();
+  workspace->ref_weights /= workspace->ref_weights.sum();
+
+  workspace->ref_weighted_colors =
+      workspace->ref_weights * workspace->ref_colors;
+  workspace->ref_color_sum = workspace->ref_weighted_colors.sum();
+  workspace->ref_color_squared_sum =
+      (workspace->ref_weighted_colors * workspace->ref_colors).sum();
+}
+
+float PatchMatchCpu::ComputePhotoConsistencyCost(
+    const int src_image_idx, const int row, const int col, const float depth,
+    const float normal[3], ColumnWorkspace* workspace) const {
+  // Maximum photo consistency cost as 1 - min(NCC).
+  const float kMaxCost = 2.0f;
+
+  float H[9];
+  ComposeHomography(src_image_idx, row, col, depth, normal, H);
+
+  // Warp the patch into the source image.
+  const float center_col = H[0] * col + H[1] * row + H[2];
+  const float center_row = H[3] * col + H[4] * row + H[5];
+  const float center_z = H[6] * col + H[7] * row + H[8];
+  workspace->src_inv_zs =
+      (H[6] * patch_col_offsets_ + H[7] * patch_row_offsets_ + center_z)
+          .inverse();
+  workspace->src_cols =
+      (H[0] * patch_col_offsets_ + H[1] * patch_row_offsets_ + center_col) *
+      workspace->src_inv_zs;
+  workspace->src_rows =
+      (H[3] * patch_col_offsets_ + H[4] * patch_row_offsets_ + center_row) *
+      workspace->src_inv_zs;
+
+  const Mat<uint8_t>& src_image = src_images_[src_image_idx];
+  for (int i = 0; i < workspace->src_colors.size(); ++i) {
+    workspace->src_colors(i) = SampleBilinear(
+        src_image, workspace->src_cols(i), workspace->src_rows(i));
+  }
+
+  const float src_color_sum =
+      (workspace->ref_weights * workspace->src_colors).sum();
+  const float src_color_squared_sum =
+      (workspace->ref_weights * workspace->src_colors.square()).sum();
+  const float src_ref_color_sum =
+      (workspace->ref_weighted_colors * workspace->src_colors).sum();
+
+  const float ref_color_var =
+      workspace->ref_color_squared_sum -
+      workspace->ref_color_sum * workspace->ref_color_sum;
+  const float src_color_var =
+      src_color_squared_sum - src_color_sum * src_color_sum;
+
+  // Based on Jensen's Inequality for convex functions, the variance
+  // should always be larger than 0. Do not make this threshold smaller.
+  const float kMinVar = 1e-5f;
+  if (ref_color_var < kMinVar || src_color_var < kMinVar) {
+    return kMaxCost;
+  } else {
+    const float src_ref_color_covar =
+        src_ref_color_sum - workspace->ref_color_sum * src_color_sum;
+    const float src_ref_color_var = std::sqrt(ref_color_var * src_color_var);
+    return std::max(
+        0.0f, std::min(kMaxCost, 1.0f - src_ref_color_covar / src_ref_color_var));
+  }
+}
+
+float PatchMatchCpu::ComputeGeomConsistencyCost(const int src_image_idx,
+                                                const float row,
+                                                const float col,
+                                                const float depth,
+                                                const float max_cost) const {
+  const float* pose =
+      poses_[rotation_in_half_pi_].data() + src_image_idx * kNumTformParams;
+  const float* P = pose + 19;
+  const float* inv_P = pose + 31;
+  const float* ref_K = ref_K_[rotation_in_half_pi_];
+
+  // Project point in reference image to world.
+  float forward_point[3];
+  ComputePointAtDepth(row, col, depth, forward_point);
+
+  // Project world point to source image.
+  const float inv_forward_z =
+      1.0f / (P[8] * forward_point[0] + P[9] * forward_point[1] +
+              P[10] * forward_point[2] + P[11]);
+  float src_col =
+      inv_forward_z * (P[0] * forward_point[0] + P[1] * forward_point[1] +
+                       P[2] * forward_point[2] + P[3]);
+  float src_row =
+      inv_forward_z * (P[4] * forward_point[0] + P[5] * forward_point[1] +
+                       P[6] * forward_point[2] + P[7]);
+
+  // Extract depth in source image with nearest neighbor interpolation.
+  const DepthMap& src_depth_map = *src_depth_maps_[src_image_idx];
+  const float src_col_nn = std::floor(src_col + 0.5f);
+  const float src_row_nn = std::floor(src_row + 0.5f);
+  if (!(src_col_nn >= 0 && src_row_nn >= 0 &&
+        src_col_nn < src_depth_map.GetWidth() &&
+        src_row_nn < src_depth_map.GetHeight())) {
+    return max_cost;
+  }
+  const float src_depth =
+      src_depth_map.GetPtr()[static_cast<size_t>(src_row_nn) *
+                                 src_depth_map.GetWidth() +
+                             static_cast<size_t>(src_col_nn)];
+
+  // Projection outside of source image.
+  if (src_depth == 0.0f) {
+    return max_cost;
+  }
+
+  // Project point in source image to world.
+  src_col *= src_depth;
+  src_row *= src_depth;
+  const float backward_point_x =
+      inv_P[0] * src_col + inv_P[1] * src_row + inv_P[2] * src_depth + inv_P[3];
+  const float backward_point_y =
+      inv_P[4] * src_col + inv_P[5] * src_row + inv_P[6] * src_depth + inv_P[7];
+  const float backward_point_z = inv_P[8] * src_col + inv_P[9] * src_row +
+                                 inv_P[10] * src_depth + inv_P[11];
+  const float inv_backward_point_z = 1.0f / backward_point_z;
+
+  // Project world point back to reference image.
+  const float backward_col =
+      inv_backward_point_z *
+      (ref_K[0] * backward_point_x + ref_K[1] * backward_point_z);
+  const float backward_row =
+      inv_backward_point_z *
+      (ref_K[2] * backward_point_y + ref_K[3] * backward_point_z);
+
+  // Return truncated reprojection error between original observation and
+  // the forward-backward projected observation.
+  const float diff_col = col - backward_col;
+  const float diff_row = row - backward_row;
+  return std::min(max_cost,
+                  std::sqrt(diff_col * diff_col + diff_row * diff_row));
+}
+
+void PatchMatchCpu::ComposeHomography(const int src_image_idx, const int row,
+                                      const int col, const float depth,
+                                      const float normal[3],
+                                      float H[9]) const {
+  const float* pose =
+      poses_[rotation_in_half_pi_].data() + src_image_idx * kNumTformParams;
+  const float* ref_inv_K = ref_inv_K_[rotation_in_half_pi_];
+
+  // Calibration of source image.
+  const float* K = pose;
+
+  // Relative rotation between reference and source image.
+  const float* R = pose + 4;
+
+  // Relative translation between reference and source image.
+  const float* T = pose + 13;
+
+  // Distance to the plane.
+  const float dist =
+      depth * (normal[0] * (ref_inv_K[0] * col + ref_inv_K[1]) +
+               normal[1] * (ref_inv_K[2] * row + ref_inv_K[3]) + normal[2]);
+  const float inv_dist = 1.0f / dist;
+
+  const float inv_dist_N0 = inv_dist * normal[0];
+  const float inv_dist_N1 = inv_dist * normal[1];
+  const float inv_dist_N2 = inv_dist * normal[2];
+
+  // Homography as H = K * (R - T * n' / d) * Kref^-1.
+  H[0] = ref_inv_K[0] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
+                         K[1] * (R[6] + inv_dist_N0 * T[2]));
+  H[1] = ref_inv_K[2] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
+                         K[1] * (R[7] + inv_dist_N1 * T[2]));
+  H[2] = K[0] * (R[2] + inv_dist_N2 * T[0]) +
+         K[1] * (R[8] + inv_dist_N2 * T[2]) +
+         ref_inv_K[1] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
+                         K[1] * (R[6] + inv_dist_N0 * T[2])) +
+         ref_inv_K[3] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
+                         K[1] * (R[7] + inv_dist_N1 * T[2]));
+  H[3] = ref_inv_K[0] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
+                         K[3] * (R[6] + inv_dist_N0 * T[2]));
+  H[4] = ref_inv_K[2] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
+                         K[3] * (R[7] + inv_dist_N1 * T[2]));
+  H[5] = K[2] * (R[5] + inv_dist_N2 * T[1]) +
+         K[3] * (R[8] + inv_dist_N2 * T[2]) +
+         ref_inv_K[1] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
+                         K[3] * (R[6] + inv_dist_N0 * T[2])) +
+         ref_inv_K[3] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
+                         K[3] * (R[7] + inv_dist_N1 * T[2]));
+  H[6] = ref_inv_K[0] * (R[6] + inv_dist_N0 * T[2]);
+  H[7] = ref_inv_K[2] * (R[7] + inv_dist_N1 * T[2]);
+  H[8] = R[8] + ref_inv_K[1] * (R[6] + inv_dist_N0 * T[2]) +
+         ref_inv_K[3] * (R[7] + inv_dist_N1 * T[2]) + inv_dist_N2 * T[2];
+}
+
+// First, compute triangulation angle between reference and source image for 3D
+// point. Second, compute incident angle between viewing direction of source
+// image and normal direction of 3D point. Both angles are cosine distances.
+void PatchMatchCpu::ComputeViewingAngles(const float point[3],
+                                         const float normal[3],
+                                         const int src_image_idx,
+                                         float* cos_triangulation_angle,
+                                         float* cos_incident_angle) const {
+  // Projection center of source image.
+  const float* C = poses_[rotation_in_half_pi_].data() +
+                   src_image_idx * kNumTformParams + 16;
+
+  // Ray from point to camera.
+  const float SX[3] = {C[0] - point[0], C[1] - point[1], C[2] - point[2]};
+
+  // Length of ray from reference image to point.
+  const float RX_inv_norm = 1.0f / std::sqrt(DotProduct3(point, point));
+
+  // Length of ray from source image to point.
+  const float SX_inv_norm = 1.0f / std::sqrt(DotProduct3(SX, SX));
+
+  *cos_incident_angle = DotProduct3(SX, normal) * SX_inv_norm;
+  *cos_triangulation_angle = DotProduct3(SX, point) * RX_inv_norm * SX_inv_norm;
+}
+
+void PatchMatchCpu::ComputePointAtDepth(const float row, const float col,
+                                        const float depth,
+                                        float point[3]) const {
+  const float* ref_inv_K = ref_inv_K_[rotation_in_half_pi_];
+  point[0] = depth * (ref_inv_K[0] * col + ref_inv_K[1]);
+  point[1] = depth * (ref_inv_K[2] * row + ref_inv_K[3]);
+  point[2] = depth;
+}
+
+// Transfer depth on plane from viewing ray at row1 to row2. The returned
+// depth is the intersection of the viewing ray through row2 with the plane
+// at row1 defined by the given depth and normal.
+float PatchMatchCpu::PropagateDepth(const float depth1, const float normal1[3],
+                                    const float row1, const float row2) const {
+  const float* ref_inv_K = ref_inv_K_[rotation_in_half_pi_];
+
+  // Point along first viewing ray.
+  const float x1 = depth1 * (ref_inv_K[2] * row1 + ref_inv_K[3]);
+  const float y1 = depth1;
+  // Point on plane defined by point along first viewing ray and plane normal1.
+  const float x2 = x1 + normal1[2];
+  const float y2 = y1 - normal1[1];
+
+  // Point on second viewing ray, which originates in (0, 0).
+  const float x4 = ref_inv_K[2] * row2 + ref_inv_K[3];
+
+  // Intersection of the lines ((x1, y1), (x2, y2)) and ((0, 0), (x4, 1)).
+  const float denom = x2 - x1 + x4 * (y1 - y2);
+  const float kEps = 1e-5f;
+  if (std::abs(denom) < kEps) {
+    return depth1;
+  }
+  const float nom = y1 * x2 - x1 * y2;
+  return nom / denom;
+}
+
+void PatchMatchCpu::Rotate() {
+  rotation_in_half_pi_ = (rotation_in_half_pi_ + 1) % 4;
+
+  // Rotate normals by 90deg around z-axis in counter-clockwise direction.
+  const size_t num_pixels = normal_map_.GetWidth() * normal_map_.GetHeight();
+  float* normal_data = normal_map_.GetPtr();
+  for (size_t i = 0; i < num_pixels; ++i) {
+    const float normal0 = normal_data[i];
+    normal_data[i] = normal_data[num_pixels + i];
+    normal_data[num_pixels + i] = -normal0;
+  }
+
+  depth_map_ = RotateMat(depth_map_);
+  normal_map_ = RotateMat(normal_map_);
+  ref_image_ = RotateMat(ref_image_);
+  cost_map_ = RotateMat(cost_map_);
+
+  // Rotate selection probability map.
+  prev_sel_prob_map_ = RotateMat(sel_prob_map_);
+  sel_prob_map_ = Mat<float>(prev_sel_prob_map_.GetWidth(),
+                             prev_sel_prob_map_.GetHeight(),
+                             prev_sel_prob_map_.GetDepth());
+}
+
+}  // namespace mvs
+}  // namespace colmap
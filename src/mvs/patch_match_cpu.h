@@ -0,0 +1,156 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_MVS_PATCH_MATCH_CPU_H_
+#define COLMAP_SRC_MVS_PATCH_MATCH_CPU_H_
+
+#include <memory>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "mvs/depth_map.h"
+#include "mvs/mat.h"
+#include "mvs/normal_map.h"
+#include "mvs/patch_match.h"
+#include "util/threading.h"
+
+namespace colmap {
+namespace mvs {
+
+// CPU implementation of the patch match stereo algorithm. The implementation
+// follows PatchMatchCuda step by step, i.e. the reference image is swept from
+// top to bottom in four rotated versions per iteration and all columns of a
+// sweep are processed independently in parallel. Within a column, the
+// bilateral weights of the reference patch are computed once per pixel and
+// shared by all cost evaluations, which reduces the photo-consistency cost to
+// a warp of the patch and three vectorized dot products.
+class PatchMatchCpu {
+ public:
+  PatchMatchCpu(const PatchMatchOptions& options,
+                const PatchMatch::Problem& problem);
+
+  void Run();
+
+  DepthMap GetDepthMap() const;
+  NormalMap GetNormalMap() const;
+  Mat<float> GetSelProbMap() const;
+  std::vector<int> GetConsistentImageIdxs() const;
+
+ private:
+  struct SweepOptions;
+  struct ColumnWorkspace;
+
+  void InitRefImage();
+  void InitSourceImages();
+  void InitTransforms();
+  void InitWorkspaceMemory();
+  void InitPatchOffsets();
+
+  void ComputeInitialCost(ThreadPool* thread_pool);
+  void Sweep(const SweepOptions& sweep_options, ThreadPool* thread_pool);
+  void SweepColumn(const SweepOptions& sweep_options, const int col,
+                   ColumnWorkspace* workspace);
+
+  // Set up the reference patch centered at the given pixel.
+  void SetRefPatch(const int row, const int col,
+                   ColumnWorkspace* workspace) const;
+
+  // Compute the photo-consistency cost as 1 - NCC in the range [0, 2] for the
+  // current reference patch warped into the given source image.
+  float ComputePhotoConsistencyCost(const int src_image_idx, const int row,
+                                    const int col, const float depth,
+                                    const float normal[3],
+                                    ColumnWorkspace* workspace) const;
+
+  // Compute the truncated forward-backward reprojection error.
+  float ComputeGeomConsistencyCost(const int src_image_idx, const float row,
+                                   const float col, const float depth,
+                                   const float max_cost) const;
+
+  void ComposeHomography(const int src_image_idx, const int row,
+                         const int col, const float depth,
+                         const float normal[3], float H[9]) const;
+  void ComputeViewingAngles(const float point[3], const float normal[3],
+                            const int src_image_idx,
+                            float* cos_triangulation_angle,
+                            float* cos_incident_angle) const;
+  void ComputePointAtDepth(const float row, const float col, const float depth,
+                           float point[3]) const;
+  float PropagateDepth(const float depth1, const float normal1[3],
+                       const float row1, const float row2) const;
+
+  // Rotate reference image by 90 degrees in counter-clockwise direction.
+  void Rotate();
+
+  const PatchMatchOptions options_;
+  const PatchMatch::Problem problem_;
+
+  // Original (not rotated) dimension of reference image.
+  size_t ref_width_;
+  size_t ref_height_;
+
+  // Rotation of reference image in pi/2. This is equivalent to the number of
+  // calls to `rotate` mod 4.
+  int rotation_in_half_pi_;
+
+  // Calibration matrix for rotated versions of reference image as
+  // {K[0, 0], K[0, 2], K[1, 1], K[1, 2]} corresponding to rotation_in_half_pi_.
+  float ref_K_[4][4];
+  float ref_inv_K_[4][4];
+
+  // Relative poses from rotated versions of reference image to source images
+  // in the same layout as in PatchMatchCuda.
+  std::vector<float> poses_[4];
+
+  // Source images and depth maps in the order of the source image indices.
+  std::vector<Mat<uint8_t>> src_images_;
+  std::vector<const DepthMap*> src_depth_maps_;
+
+  // Offsets and spatial bilateral weights of the pixels in the patch window.
+  Eigen::ArrayXf patch_row_offsets_;
+  Eigen::ArrayXf patch_col_offsets_;
+  Eigen::ArrayXf patch_spatial_weights_;
+
+  // Data for reference image.
+  Mat<float> ref_image_;
+  Mat<float> depth_map_;
+  Mat<float> normal_map_;
+  Mat<float> sel_prob_map_;
+  Mat<float> prev_sel_prob_map_;
+  Mat<float> cost_map_;
+  Mat<uint8_t> consistency_mask_;
+};
+
+}  // namespace mvs
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_MVS_PATCH_MATCH_CPU_H_
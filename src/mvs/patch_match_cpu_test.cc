@@ -0,0 +1,215 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "mvs/patch_match_cpu_test"
+#include "util/testing.h"
+
+#include <random>
+
+#include <Eigen/Core>
+
+#include "mvs/patch_match_cpu.h"
+
+using namespace colmap;
+using namespace colmap::mvs;
+
+namespace {
+
+const int kWidth = 64;
+const int kHeight = 48;
+const float kFocalLength = 60;
+const float kPlaneDepth = 5;
+
+const int kTextureGridSize = 101;
+const float kTextureGridMin = -5;
+const float kTexelSize = 0.1f;
+
+// Randomly textured plane z = kPlaneDepth, whose intensity is bilinearly
+// interpolated from a grid of random values.
+class PlaneTexture {
+ public:
+  PlaneTexture() : values_(kTextureGridSize, kTextureGridSize) {
+    std::mt19937 rand_state(0);
+    std::uniform_real_distribution<float> distribution(0.0f, 255.0f);
+    for (int i = 0; i < values_.size(); ++i) {
+      values_(i) = distribution(rand_state);
+    }
+  }
+
+  float Get(const float x, const float y) const {
+    const float grid_x = (x - kTextureGridMin) / kTexelSize;
+    const float grid_y = (y - kTextureGridMin) / kTexelSize;
+    const int x0 = static_cast<int>(std::floor(grid_x));
+    const int y0 = static_cast<int>(std::floor(grid_y));
+    CHECK_GE(x0, 0);
+    CHECK_GE(y0, 0);
+    CHECK_LT(x0 + 1, kTextureGridSize);
+    CHECK_LT(y0 + 1, kTextureGridSize);
+    const float dx = grid_x - x0;
+    const float dy = grid_y - y0;
+    return (1 - dy) * ((1 - dx) * values_(y0, x0) + dx * values_(y0, x0 + 1)) +
+           dy * ((1 - dx) * values_(y0 + 1, x0) + dx * values_(y0 + 1, x0 + 1));
+  }
+
+ private:
+  Eigen::MatrixXf values_;
+};
+
+// Render the textured plane from a camera with identity rotation at the given
+// projection center.
+Image RenderImage(const PlaneTexture& texture, const float center_x,
+                  const float center_y) {
+  const float K[9] = {kFocalLength, 0, kWidth / 2.0f, 0, kFocalLength,
+                      kHeight / 2.0f, 0, 0, 1};
+  const float R[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  const float T[3] = {-center_x, -center_y, 0};
+  Image image("", kWidth, kHeight, K, R, T);
+
+  Bitmap bitmap;
+  bitmap.Allocate(kWidth, kHeight, false);
+  for (int row = 0; row < kHeight; ++row) {
+    for (int col = 0; col < kWidth; ++col) {
+      const float x = center_x + kPlaneDepth * (col - K[2]) / K[0];
+      const float y = center_y + kPlaneDepth * (row - K[5]) / K[4];
+      const uint8_t intensity =
+          static_cast<uint8_t>(std::round(texture.Get(x, y)));
+      bitmap.SetPixel(col, row, BitmapColor<uint8_t>(intensity));
+    }
+  }
+  image.SetBitmap(bitmap);
+
+  return image;
+}
+
+std::vector<Image> GenerateImages() {
+  const PlaneTexture texture;
+  std::vector<Image> images;
+  images.push_back(RenderImage(texture, 0, 0));
+  images.push_back(RenderImage(texture, -0.5f, 0));
+  images.push_back(RenderImage(texture, 0.5f, 0));
+  images.push_back(RenderImage(texture, 0, 0.5f));
+  return images;
+}
+
+PatchMatchOptions GenerateOptions(const int num_threads,
+                                  const int num_iterations) {
+  PatchMatchOptions options;
+  options.use_gpu = false;
+  options.num_threads = num_threads;
+  options.num_iterations = num_iterations;
+  options.depth_min = 1;
+  options.depth_max = 10;
+  options.sigma_spatial = options.window_radius;
+  options.geom_consistency = false;
+  options.filter = false;
+  return options;
+}
+
+PatchMatch::Problem GenerateProblem(std::vector<Image>* images) {
+  PatchMatch::Problem problem;
+  problem.ref_image_idx = 0;
+  problem.src_image_idxs = {1, 2, 3};
+  problem.images = images;
+  return problem;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestPlane) {
+  std::vector<Image> images = GenerateImages();
+  PatchMatchCpu patch_match(GenerateOptions(-1, 5), GenerateProblem(&images));
+  patch_match.Run();
+
+  const DepthMap depth_map = patch_match.GetDepthMap();
+  const NormalMap normal_map = patch_match.GetNormalMap();
+  BOOST_REQUIRE_EQUAL(depth_map.GetWidth(), kWidth);
+  BOOST_REQUIRE_EQUAL(depth_map.GetHeight(), kHeight);
+  BOOST_REQUIRE_EQUAL(normal_map.GetWidth(), kWidth);
+  BOOST_REQUIRE_EQUAL(normal_map.GetHeight(), kHeight);
+
+  // Parts of the border are not visible in the source images.
+  const int kBorder = 12;
+  int num_pixels = 0;
+  int num_accurate_depths = 0;
+  int num_accurate_normals = 0;
+  for (int row = kBorder; row < kHeight - kBorder; ++row) {
+    for (int col = kBorder; col < kWidth - kBorder; ++col) {
+      num_pixels += 1;
+      if (std::abs(depth_map.Get(row, col) - kPlaneDepth) <
+          0.01f * kPlaneDepth) {
+        num_accurate_depths += 1;
+      }
+      // The normal of the plane is (0, 0, -1) and points towards the camera.
+      if (normal_map.Get(row, col, 2) < -0.98f) {
+        num_accurate_normals += 1;
+      }
+    }
+  }
+
+  BOOST_CHECK_GT(num_accurate_depths, 0.95 * num_pixels);
+  BOOST_CHECK_GT(num_accurate_normals, 0.9 * num_pixels);
+}
+
+BOOST_AUTO_TEST_CASE(TestSerialEqualsParallel) {
+  std::vector<Image> images = GenerateImages();
+
+  // The random numbers only depend on the sweep and the column, such that the
+  // result is independent of the number of threads.
+  const int kNumIterations = 2;
+  PatchMatchOptions serial_options = GenerateOptions(1, kNumIterations);
+  serial_options.filter = true;
+  PatchMatchCpu serial_patch_match(serial_options, GenerateProblem(&images));
+  serial_patch_match.Run();
+  const DepthMap serial_depth_map = serial_patch_match.GetDepthMap();
+  const NormalMap serial_normal_map = serial_patch_match.GetNormalMap();
+  const Mat<float> serial_sel_prob_map = serial_patch_match.GetSelProbMap();
+  const std::vector<int> serial_consistent_image_idxs =
+      serial_patch_match.GetConsistentImageIdxs();
+  BOOST_CHECK(!serial_consistent_image_idxs.empty());
+
+  for (const int num_threads : {2, 3, 8}) {
+    PatchMatchOptions parallel_options =
+        GenerateOptions(num_threads, kNumIterations);
+    parallel_options.filter = true;
+    PatchMatchCpu parallel_patch_match(parallel_options,
+                                       GenerateProblem(&images));
+    parallel_patch_match.Run();
+    const DepthMap depth_map = parallel_patch_match.GetDepthMap();
+    const NormalMap normal_map = parallel_patch_match.GetNormalMap();
+    const Mat<float> sel_prob_map = parallel_patch_match.GetSelProbMap();
+    const std::vector<int> consistent_image_idxs =
+        parallel_patch_match.GetConsistentImageIdxs();
+    BOOST_CHECK(depth_map.GetData() == serial_depth_map.GetData());
+    BOOST_CHECK(normal_map.GetData() == serial_normal_map.GetData());
+    BOOST_CHECK(sel_prob_map.GetData() == serial_sel_prob_map.GetData());
+    BOOST_CHECK(consistent_image_idxs == serial_consistent_image_idxs);
+  }
+}
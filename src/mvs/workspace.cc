@@ -77,16 +77,20 @@ Workspace::Workspace(const Options& options)
       options_.workspace_path, options_.stereo_folder, "normal_maps"));
 }
 
-void Workspace::ClearCache() { cache_.Clear(); }
+void Workspace::ClearCache() {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  cache_.Clear();
+}
 
 const Workspace::Options& Workspace::GetOptions() const { return options_; }
 
 const Model& Workspace::GetModel() const { return model_; }
 
-const Bitmap& Workspace::GetBitmap(const int image_idx) {
+std::shared_ptr<const Bitmap> Workspace::GetBitmap(const int image_idx) {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.bitmap) {
-    cached_image.bitmap.reset(new Bitmap());
+    cached_image.bitmap = std::make_shared<Bitmap>();
     cached_image.bitmap->Read(GetBitmapPath(image_idx), options_.image_as_rgb);
     if (options_.max_image_size > 0) {
       cached_image.bitmap->Rescale(model_.images.at(image_idx).GetWidth(),
@@ -95,13 +99,15 @@ const Bitmap& Workspace::GetBitmap(const int image_idx) {
     cached_image.num_bytes += cached_image.bitmap->NumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
-  return *cached_image.bitmap;
+  return cached_image.bitmap;
 }
 
-const DepthMap& Workspace::GetDepthMap(const int image_idx) {
+std::shared_ptr<const DepthMap> Workspace::GetDepthMap(
+    const int image_idx) {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.depth_map) {
-    cached_image.depth_map.reset(new DepthMap());
+    cached_image.depth_map = std::make_shared<DepthMap>();
     cached_image.depth_map->Read(GetDepthMapPath(image_idx));
     if (options_.max_image_size > 0) {
       cached_image.depth_map->Downsize(model_.images.at(image_idx).GetWidth(),
@@ -110,13 +116,15 @@ const DepthMap& Workspace::GetDepthMap(const int image_idx) {
     cached_image.num_bytes += cached_image.depth_map->GetNumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
-  return *cached_image.depth_map;
+  return cached_image.depth_map;
 }
 
-const NormalMap& Workspace::GetNormalMap(const int image_idx) {
+std::shared_ptr<const NormalMap> Workspace::GetNormalMap(
+    const int image_idx) {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.normal_map) {
-    cached_image.normal_map.reset(new NormalMap());
+    cached_image.normal_map = std::make_shared<NormalMap>();
     cached_image.normal_map->Read(GetNormalMapPath(image_idx));
     if (options_.max_image_size > 0) {
       cached_image.normal_map->Downsize(
@@ -126,7 +134,7 @@ const NormalMap& Workspace::GetNormalMap(const int image_idx) {
     cached_image.num_bytes += cached_image.normal_map->GetNumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
-  return *cached_image.normal_map;
+  return cached_image.normal_map;
 }
 
 std::string Workspace::GetBitmapPath(const int image_idx) const {
@@ -32,6 +32,9 @@
 #ifndef COLMAP_SRC_MVS_WORKSPACE_H_
 #define COLMAP_SRC_MVS_WORKSPACE_H_
 
+#include <memory>
+#include <mutex>
+
 #include "mvs/consistency_graph.h"
 #include "mvs/depth_map.h"
 #include "mvs/model.h"
@@ -68,9 +71,13 @@ class Workspace {
   const Options& GetOptions() const;
 
   const Model& GetModel() const;
-  const Bitmap& GetBitmap(const int image_idx);
-  const DepthMap& GetDepthMap(const int image_idx);
-  const NormalMap& GetNormalMap(const int image_idx);
+
+  // Get the bitmap, depth map, and normal map of an image. The accessors are
+  // thread-safe and the returned data shares ownership with the cache, so it
+  // remains valid even if another thread evicts the image from the cache.
+  std::shared_ptr<const Bitmap> GetBitmap(const int image_idx);
+  std::shared_ptr<const DepthMap> GetDepthMap(const int image_idx);
+  std::shared_ptr<const NormalMap> GetNormalMap(const int image_idx);
 
   // Get paths to bitmap, depth map, normal map and consistency graph.
   std::string GetBitmapPath(const int image_idx) const;
@@ -92,9 +99,9 @@ class Workspace {
     CachedImage& operator=(CachedImage&& other);
     size_t NumBytes() const;
     size_t num_bytes = 0;
-    std::unique_ptr<Bitmap> bitmap;
-    std::unique_ptr<DepthMap> depth_map;
-    std::unique_ptr<NormalMap> normal_map;
+    std::shared_ptr<Bitmap> bitmap;
+    std::shared_ptr<DepthMap> depth_map;
+    std::shared_ptr<NormalMap> normal_map;
 
    private:
     NON_COPYABLE(CachedImage)
@@ -103,6 +110,7 @@ class Workspace {
   Options options_;
   Model model_;
   MemoryConstrainedLRUCache<int, CachedImage> cache_;
+  std::mutex cache_mutex_;
   std::string depth_map_path_;
   std::string normal_map_path_;
 };
@@ -33,6 +33,7 @@
 #define COLMAP_SRC_OPTIM_LORANSAC_H_
 
 #include <cfloat>
+#include <memory>
 #include <random>
 #include <stdexcept>
 #include <vector>
@@ -122,6 +123,11 @@ LORANSAC<Estimator, LocalEstimator, SupportMeasurer, Sampler>::Estimate(
 
   sampler.Initialize(num_samples);
 
+  std::unique_ptr<SPRTVerifier<Estimator>> sprt_verifier;
+  if (options_.use_sprt) {
+    sprt_verifier.reset(new SPRTVerifier<Estimator>(options_, X, Y));
+  }
+
   size_t max_num_trials = options_.max_num_trials;
   max_num_trials = std::min<size_t>(max_num_trials, sampler.MaxNumSamples());
   size_t dyn_max_num_trials = max_num_trials;
@@ -141,54 +147,68 @@ LORANSAC<Estimator, LocalEstimator, SupportMeasurer, Sampler>::Estimate(
 
     // Iterate through all estimated models
     for (const auto& sample_model : sample_models) {
-      estimator.Residuals(X, Y, sample_model, &residuals);
-      CHECK_EQ(residuals.size(), X.size());
-
-      const auto support = support_measurer.Evaluate(residuals, max_residual);
-
-      // Do local optimization if better than all previous subsets.
-      if (support_measurer.Compare(support, best_support)) {
-        best_support = support;
-        best_model = sample_model;
-        best_model_is_local = false;
-
-        // Estimate locally optimized model from inliers.
-        if (support.num_inliers > Estimator::kMinNumSamples &&
-            support.num_inliers >= LocalEstimator::kMinNumSamples) {
-          X_inlier.clear();
-          Y_inlier.clear();
-          X_inlier.reserve(support.num_inliers);
-          Y_inlier.reserve(support.num_inliers);
-          for (size_t i = 0; i < residuals.size(); ++i) {
-            if (residuals[i] <= max_residual) {
-              X_inlier.push_back(X[i]);
-              Y_inlier.push_back(Y[i]);
+      bool verified = true;
+      if (sprt_verifier) {
+        verified = sprt_verifier->Verify(&estimator, sample_model, &residuals);
+      } else {
+        estimator.Residuals(X, Y, sample_model, &residuals);
+      }
+
+      if (verified) {
+        CHECK_EQ(residuals.size(), X.size());
+
+        const auto support =
+            support_measurer.Evaluate(residuals, max_residual);
+
+        // Do local optimization if better than all previous subsets.
+        if (support_measurer.Compare(support, best_support)) {
+          best_support = support;
+          best_model = sample_model;
+          best_model_is_local = false;
+
+          // Estimate locally optimized model from inliers.
+          if (support.num_inliers > Estimator::kMinNumSamples &&
+              support.num_inliers >= LocalEstimator::kMinNumSamples) {
+            X_inlier.clear();
+            Y_inlier.clear();
+            X_inlier.reserve(support.num_inliers);
+            Y_inlier.reserve(support.num_inliers);
+            for (size_t i = 0; i < residuals.size(); ++i) {
+              if (residuals[i] <= max_residual) {
+                X_inlier.push_back(X[i]);
+                Y_inlier.push_back(Y[i]);
+              }
             }
-          }
 
-          const std::vector<typename LocalEstimator::M_t> local_models =
-              local_estimator.Estimate(X_inlier, Y_inlier);
+            const std::vector<typename LocalEstimator::M_t> local_models =
+                local_estimator.Estimate(X_inlier, Y_inlier);
 
-          for (const auto& local_model : local_models) {
-            local_estimator.Residuals(X, Y, local_model, &residuals);
-            CHECK_EQ(residuals.size(), X.size());
+            for (const auto& local_model : local_models) {
+              local_estimator.Residuals(X, Y, local_model, &residuals);
+              CHECK_EQ(residuals.size(), X.size());
 
-            const auto local_support =
-                support_measurer.Evaluate(residuals, max_residual);
+              const auto local_support =
+                  support_measurer.Evaluate(residuals, max_residual);
 
-            // Check if non-locally optimized model is better.
-            if (support_measurer.Compare(local_support, best_support)) {
-              best_support = local_support;
-              best_model = local_model;
-              best_model_is_local = true;
+              // Check if non-locally optimized model is better.
+              if (support_measurer.Compare(local_support, best_support)) {
+                best_support = local_support;
+                best_model = local_model;
+                best_model_is_local = true;
+              }
             }
           }
-        }
 
-        dyn_max_num_trials =
-            RANSAC<Estimator, SupportMeasurer, Sampler>::ComputeNumTrials(
-                best_support.num_inliers, num_samples, options_.confidence,
-                options_.dyn_num_trials_multiplier);
+          dyn_max_num_trials =
+              RANSAC<Estimator, SupportMeasurer, Sampler>::ComputeNumTrials(
+                  best_support.num_inliers, num_samples, options_.confidence,
+                  options_.dyn_num_trials_multiplier);
+
+          if (sprt_verifier) {
+            sprt_verifier->UpdateInlierRatio(best_support.num_inliers,
+                                             num_samples);
+          }
+        }
       }
 
       if (report.num_trials >= dyn_max_num_trials &&
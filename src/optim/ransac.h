@@ -33,14 +33,18 @@
 #define COLMAP_SRC_OPTIM_RANSAC_H_
 
 #include <cfloat>
+#include <memory>
+#include <numeric>
 #include <random>
 #include <stdexcept>
 #include <vector>
 
 #include "optim/random_sampler.h"
+#include "optim/sprt.h"
 #include "optim/support_measurement.h"
 #include "util/alignment.h"
 #include "util/logging.h"
+#include "util/random.h"
 
 namespace colmap {
 
@@ -65,6 +69,12 @@ struct RANSACOptions {
   size_t min_num_trials = 0;
   size_t max_num_trials = std::numeric_limits<size_t>::max();
 
+  // Whether to verify hypotheses with the sequential probability ratio test,
+  // which rejects bad models after evaluating only a few samples. This makes
+  // estimation significantly faster for data with many outliers, at the risk
+  // of occasionally rejecting a good model.
+  bool use_sprt = false;
+
   void Check() const {
     CHECK_GT(max_error, 0);
     CHECK_GE(min_inlier_ratio, 0);
@@ -75,6 +85,43 @@ struct RANSACOptions {
   }
 };
 
+// Verification of models using the sequential probability ratio test (SPRT) as
+// proposed in "Randomized RANSAC with Sequential Probability Ratio Test",
+// Matas et al., 2005. The samples are evaluated in a random order and in
+// small batches, such that the residuals of bad models are computed only for
+// a fraction of the samples. The parameters of the test are adapted during the
+// estimation: epsilon from the inlier ratio of the best model and delta from
+// the inlier ratio of the rejected models.
+template <typename Estimator>
+class SPRTVerifier {
+ public:
+  SPRTVerifier(const RANSACOptions& options,
+               const std::vector<typename Estimator::X_t>& X,
+               const std::vector<typename Estimator::Y_t>& Y);
+
+  // Verify the model and return false, if the model was rejected. A verified
+  // model was evaluated on all samples and its residuals are returned in the
+  // original order of the samples, such that they need not be computed again.
+  bool Verify(Estimator* estimator, const typename Estimator::M_t& model,
+              std::vector<double>* residuals);
+
+  // Update the assumed inlier ratio of good models from the best model.
+  void UpdateInlierRatio(const size_t num_inliers, const size_t num_samples);
+
+ private:
+  // Number of samples per batch of residual computations.
+  static const size_t kBatchSize = 16;
+
+  const double max_residual_;
+  std::vector<size_t> sample_idxs_;
+  std::vector<std::vector<typename Estimator::X_t>> X_batches_;
+  std::vector<std::vector<typename Estimator::Y_t>> Y_batches_;
+  std::vector<double> residuals_;
+  SPRT sprt_;
+  size_t num_rejected_inliers_;
+  size_t num_rejected_eval_samples_;
+};
+
 template <typename Estimator, typename SupportMeasurer = InlierSupportMeasurer,
           typename Sampler = RandomSampler>
 class RANSAC {
@@ -140,6 +187,95 @@ class RANSAC {
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+template <typename Estimator>
+SPRTVerifier<Estimator>::SPRTVerifier(
+    const RANSACOptions& options,
+    const std::vector<typename Estimator::X_t>& X,
+    const std::vector<typename Estimator::Y_t>& Y)
+    : max_residual_(options.max_error * options.max_error),
+      sprt_(SPRT::Options()),
+      num_rejected_inliers_(0),
+      num_rejected_eval_samples_(0) {
+  CHECK_EQ(X.size(), Y.size());
+
+  SPRT::Options sprt_options;
+  sprt_options.epsilon =
+      std::max(options.min_inlier_ratio, 2 * sprt_options.delta);
+  sprt_.Update(sprt_options);
+
+  sample_idxs_.resize(X.size());
+  std::iota(sample_idxs_.begin(), sample_idxs_.end(), 0);
+  Shuffle(static_cast<uint32_t>(sample_idxs_.size()), &sample_idxs_);
+
+  const size_t num_batches = (X.size() + kBatchSize - 1) / kBatchSize;
+  X_batches_.resize(num_batches);
+  Y_batches_.resize(num_batches);
+  for (size_t i = 0; i < sample_idxs_.size(); ++i) {
+    X_batches_[i / kBatchSize].push_back(X[sample_idxs_[i]]);
+    Y_batches_[i / kBatchSize].push_back(Y[sample_idxs_[i]]);
+  }
+}
+
+template <typename Estimator>
+bool SPRTVerifier<Estimator>::Verify(Estimator* estimator,
+                                     const typename Estimator::M_t& model,
+                                     std::vector<double>* residuals) {
+  residuals->resize(sample_idxs_.size());
+
+  double likelihood_ratio = 1;
+  size_t num_inliers = 0;
+  size_t num_eval_samples = 0;
+  for (size_t i = 0; i < X_batches_.size(); ++i) {
+    estimator->Residuals(X_batches_[i], Y_batches_[i], model, &residuals_);
+    CHECK_EQ(residuals_.size(), X_batches_[i].size());
+
+    for (size_t j = 0; j < residuals_.size(); ++j) {
+      (*residuals)[sample_idxs_[i * kBatchSize + j]] = residuals_[j];
+    }
+
+    size_t num_batch_inliers;
+    size_t num_batch_eval_samples;
+    const bool accepted =
+        sprt_.Evaluate(residuals_, max_residual_, &likelihood_ratio,
+                       &num_batch_inliers, &num_batch_eval_samples);
+    num_inliers += num_batch_inliers;
+    num_eval_samples += num_batch_eval_samples;
+
+    if (!accepted) {
+      // Estimate the probability of a sample being consistent with a bad model
+      // from all rejected models.
+      num_rejected_inliers_ += num_inliers;
+      num_rejected_eval_samples_ += num_eval_samples;
+      const double kMinDelta = 1e-4;
+      const double delta =
+          std::max(kMinDelta, num_rejected_inliers_ /
+                                  static_cast<double>(num_rejected_eval_samples_));
+      SPRT::Options sprt_options = sprt_.GetOptions();
+      if (delta < sprt_options.epsilon &&
+          std::abs(delta - sprt_options.delta) > 0.1 * sprt_options.delta) {
+        sprt_options.delta = delta;
+        sprt_.Update(sprt_options);
+      }
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename Estimator>
+void SPRTVerifier<Estimator>::UpdateInlierRatio(const size_t num_inliers,
+                                                const size_t num_samples) {
+  const double kMaxEpsilon = 0.999;
+  const double epsilon = std::min(
+      kMaxEpsilon, num_inliers / static_cast<double>(num_samples));
+  SPRT::Options sprt_options = sprt_.GetOptions();
+  if (epsilon > sprt_options.epsilon) {
+    sprt_options.epsilon = epsilon;
+    sprt_.Update(sprt_options);
+  }
+}
+
 template <typename Estimator, typename SupportMeasurer, typename Sampler>
 RANSAC<Estimator, SupportMeasurer, Sampler>::RANSAC(
     const RANSACOptions& options)
@@ -206,6 +342,11 @@ RANSAC<Estimator, SupportMeasurer, Sampler>::Estimate(
 
   sampler.Initialize(num_samples);
 
+  std::unique_ptr<SPRTVerifier<Estimator>> sprt_verifier;
+  if (options_.use_sprt) {
+    sprt_verifier.reset(new SPRTVerifier<Estimator>(options_, X, Y));
+  }
+
   size_t max_num_trials = options_.max_num_trials;
   max_num_trials = std::min<size_t>(max_num_trials, sampler.MaxNumSamples());
   size_t dyn_max_num_trials = max_num_trials;
@@ -225,19 +366,33 @@ RANSAC<Estimator, SupportMeasurer, Sampler>::Estimate(
 
     // Iterate through all estimated models.
     for (const auto& sample_model : sample_models) {
-      estimator.Residuals(X, Y, sample_model, &residuals);
-      CHECK_EQ(residuals.size(), X.size());
+      bool verified = true;
+      if (sprt_verifier) {
+        verified = sprt_verifier->Verify(&estimator, sample_model, &residuals);
+      } else {
+        estimator.Residuals(X, Y, sample_model, &residuals);
+      }
+
+      if (verified) {
+        CHECK_EQ(residuals.size(), X.size());
+
+        const auto support =
+            support_measurer.Evaluate(residuals, max_residual);
 
-      const auto support = support_measurer.Evaluate(residuals, max_residual);
+        // Save as best subset if better than all previous subsets.
+        if (support_measurer.Compare(support, best_support)) {
+          best_support = support;
+          best_model = sample_model;
 
-      // Save as best subset if better than all previous subsets.
-      if (support_measurer.Compare(support, best_support)) {
-        best_support = support;
-        best_model = sample_model;
+          dyn_max_num_trials = ComputeNumTrials(
+              best_support.num_inliers, num_samples, options_.confidence,
+              options_.dyn_num_trials_multiplier);
 
-        dyn_max_num_trials = ComputeNumTrials(
-            best_support.num_inliers, num_samples, options_.confidence,
-            options_.dyn_num_trials_multiplier);
+          if (sprt_verifier) {
+            sprt_verifier->UpdateInlierRatio(best_support.num_inliers,
+                                             num_samples);
+          }
+        }
       }
 
       if (report.num_trials >= dyn_max_num_trials &&
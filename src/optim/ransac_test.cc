@@ -50,6 +50,7 @@ BOOST_AUTO_TEST_CASE(TestOptions) {
   BOOST_CHECK_EQUAL(options.confidence, 0.99);
   BOOST_CHECK_EQUAL(options.min_num_trials, 0);
   BOOST_CHECK_EQUAL(options.max_num_trials, std::numeric_limits<size_t>::max());
+  BOOST_CHECK_EQUAL(options.use_sprt, false);
 }
 
 BOOST_AUTO_TEST_CASE(TestReport) {
@@ -136,3 +137,92 @@ BOOST_AUTO_TEST_CASE(TestSimilarityTransform) {
       (orig_tform.Matrix().topLeftCorner<3, 4>() - report.model).norm();
   BOOST_CHECK(std::abs(matrix_diff) < 1e-6);
 }
+
+BOOST_AUTO_TEST_CASE(TestSimilarityTransformSPRT) {
+  SetPRNGSeed(0);
+
+  const size_t num_samples = 1000;
+  const size_t num_outliers = 400;
+
+  // Create some arbitrary transformation.
+  const SimilarityTransform3 orig_tform(2, ComposeIdentityQuaternion(),
+                                        Eigen::Vector3d(100, 10, 10));
+
+  // Generate exact data.
+  std::vector<Eigen::Vector3d> src;
+  std::vector<Eigen::Vector3d> dst;
+  for (size_t i = 0; i < num_samples; ++i) {
+    src.emplace_back(i, std::sqrt(i) + 2, std::sqrt(2 * i + 2));
+    dst.push_back(src.back());
+    orig_tform.TransformPoint(&dst.back());
+  }
+
+  // Add some faulty data.
+  for (size_t i = 0; i < num_outliers; ++i) {
+    dst[i] = Eigen::Vector3d(RandomReal(-3000.0, -2000.0),
+                             RandomReal(-4000.0, -3000.0),
+                             RandomReal(-5000.0, -4000.0));
+  }
+
+  // Robustly estimate transformation using RANSAC with early rejection of
+  // bad models, which must yield the same result as without.
+  RANSACOptions options;
+  options.max_error = 10;
+  options.use_sprt = true;
+  RANSAC<SimilarityTransformEstimator<3>> ransac(options);
+  const auto report = ransac.Estimate(src, dst);
+
+  BOOST_CHECK_EQUAL(report.success, true);
+  BOOST_CHECK_GT(report.num_trials, 0);
+
+  // Make sure outliers were detected correctly.
+  BOOST_CHECK_EQUAL(report.support.num_inliers, num_samples - num_outliers);
+  for (size_t i = 0; i < num_samples; ++i) {
+    if (i < num_outliers) {
+      BOOST_CHECK(!report.inlier_mask[i]);
+    } else {
+      BOOST_CHECK(report.inlier_mask[i]);
+    }
+  }
+
+  // Make sure original transformation is estimated correctly.
+  const double matrix_diff =
+      (orig_tform.Matrix().topLeftCorner<3, 4>() - report.model).norm();
+  BOOST_CHECK(std::abs(matrix_diff) < 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(TestSPRTVerifierResiduals) {
+  SetPRNGSeed(0);
+
+  const size_t num_samples = 100;
+
+  const SimilarityTransform3 orig_tform(2, ComposeIdentityQuaternion(),
+                                        Eigen::Vector3d(100, 10, 10));
+
+  std::vector<Eigen::Vector3d> src;
+  std::vector<Eigen::Vector3d> dst;
+  for (size_t i = 0; i < num_samples; ++i) {
+    src.emplace_back(i, std::sqrt(i) + 2, std::sqrt(2 * i + 2));
+    dst.push_back(src.back());
+    orig_tform.TransformPoint(&dst.back());
+    dst.back() += Eigen::Vector3d::Constant(0.01 * i);
+  }
+
+  RANSACOptions options;
+  options.max_error = 10;
+  SPRTVerifier<SimilarityTransformEstimator<3>> sprt_verifier(options, src,
+                                                              dst);
+
+  // The residuals of a verified model are those of all samples in their
+  // original order.
+  SimilarityTransformEstimator<3> estimator;
+  const Eigen::Matrix3x4d model = orig_tform.Matrix().topLeftCorner<3, 4>();
+  std::vector<double> residuals;
+  BOOST_CHECK(sprt_verifier.Verify(&estimator, model, &residuals));
+  std::vector<double> expected_residuals;
+  estimator.Residuals(src, dst, model, &expected_residuals);
+  BOOST_CHECK_EQUAL(residuals.size(), num_samples);
+  for (size_t i = 0; i < num_samples; ++i) {
+    BOOST_CHECK_EQUAL(residuals[i], expected_residuals[i]);
+  }
+}
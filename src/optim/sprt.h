@@ -66,8 +66,19 @@ class SPRT {
 
   void Update(const Options& options);
 
+  const Options& GetOptions() const;
+
+  // Evaluate the residuals of a model and return false, if the model is
+  // rejected before all residuals are evaluated.
+  bool Evaluate(const std::vector<double>& residuals, const double max_residual,
+                size_t* num_inliers, size_t* num_eval_samples) const;
+
+  // Continue the evaluation of a model with the next batch of residuals, where
+  // the likelihood ratio carries the state of the test between batches and
+  // must be initialized to 1 before the first batch of a model.
   bool Evaluate(const std::vector<double>& residuals, const double max_residual,
-                size_t* num_inliers, size_t* num_eval_samples);
+                double* likelihood_ratio, size_t* num_inliers,
+                size_t* num_eval_samples) const;
 
  private:
   void UpdateDecisionThreshold();
@@ -36,6 +36,8 @@
 #include <bitset>
 #include <cstdint>
 #include <fstream>
+#include <limits>
+#include <numeric>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -55,6 +57,13 @@ namespace retrieval {
 // Implements an inverted file, including the ability to compute image scores
 // and matches. The template parameter is the length of the binary vectors
 // in the Hamming Embedding.
+//
+// The entries are stored in a structure-of-arrays layout: the binary
+// signatures are packed into contiguous 64-bit words, such that scoring only
+// streams over the signatures and computes their Hamming distances in a
+// vectorized manner, while the feature indices and geometries are kept apart.
+// Image identifiers are run-length encoded, i.e. each run of consecutive
+// entries of the same image stores its image identifier only once.
 // This class is based on an original implementation by Torsten Sattler.
 template <int kEmbeddingDim>
 class InvertedFile {
@@ -76,7 +85,11 @@ class InvertedFile {
   size_t NumEntries() const;
 
   // Return all entries in the file.
-  const std::vector<EntryType>& GetEntries() const;
+  void GetEntries(std::vector<EntryType>* entries) const;
+
+  // Return the entries of the given images in the file.
+  void GetEntries(const std::unordered_set<int>& image_ids,
+                  std::vector<EntryType>* entries) const;
 
   // Whether the Hamming embedding was computed for this file.
   bool HasHammingEmbedding() const;
@@ -95,10 +108,17 @@ class InvertedFile {
   void AddEntry(const int image_id, typename DescType::Index feature_idx,
                 const DescType& descriptor, const GeomType& geometry);
 
+  // Adds an entry, whose binary descriptor was already computed.
+  void AddEntry(const EntryType& entry);
+
   // Sorts the inverted file entries in ascending order of image ids. This is
   // required for efficient scoring and must be called before ScoreFeature.
   void SortEntries();
 
+  // Remove the entries of the given images, while keeping the order of the
+  // remaining entries.
+  void RemoveEntries(const std::unordered_set<int>& image_ids);
+
   // Clear all entries in this file.
   void ClearEntries();
 
@@ -141,14 +161,30 @@ class InvertedFile {
   void Write(std::ofstream* ofs) const;
 
  private:
+  // Number of entries, whose Hamming distances are computed at once.
+  static const size_t kScoreBlockSize = 256;
+
+  // Convert the entry at the given index in the file back to its struct.
+  void GetEntry(const int image_id, const size_t entry_idx,
+                EntryType* entry) const;
+
   // Whether the inverted file is initialized.
   uint8_t status_;
 
   // The inverse document frequency weight of this inverted file.
   float idf_weight_;
 
-  // The entries of the inverted file system.
-  std::vector<EntryType> entries_;
+  // The run-length encoded image identifiers of the entries. The entries of
+  // the image image_ids_[i] are in the range
+  // [image_offsets_[i], image_offsets_[i + 1]), i.e. image_offsets_ always has
+  // one more element than image_ids_.
+  std::vector<int> image_ids_;
+  std::vector<uint32_t> image_offsets_;
+
+  // The feature indices, geometries, and binary signatures of the entries.
+  std::vector<int> feature_idxs_;
+  std::vector<GeomType> geometries_;
+  std::vector<uint64_t> descriptors_;
 
   // The thresholds used for Hamming embedding.
   DescType thresholds_;
@@ -166,6 +202,9 @@ template <int kEmbeddingDim>
 const HammingDistWeightFunctor<kEmbeddingDim>
     InvertedFile<kEmbeddingDim>::hamming_dist_weight_functor_;
 
+template <int kEmbeddingDim>
+const size_t InvertedFile<kEmbeddingDim>::kScoreBlockSize;
+
 template <int kEmbeddingDim>
 InvertedFile<kEmbeddingDim>::InvertedFile()
     : status_(UNUSABLE), idf_weight_(0.0f) {
@@ -174,6 +213,10 @@ InvertedFile<kEmbeddingDim>::InvertedFile()
                 " be a multiple of 8.");
   static_assert(kEmbeddingDim > 0,
                 "Dimensionality of projected space needs to be > 0.");
+  static_assert(kEmbeddingDim <= 64,
+                "Dimensionality of projected space needs to be <= 64.");
+
+  image_offsets_.push_back(0);
 
   thresholds_.resize(kEmbeddingDim);
   thresholds_.setZero();
@@ -181,13 +224,33 @@ InvertedFile<kEmbeddingDim>::InvertedFile()
 
 template <int kEmbeddingDim>
 size_t InvertedFile<kEmbeddingDim>::NumEntries() const {
-  return entries_.size();
+  return descriptors_.size();
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::GetEntries(
+    std::vector<EntryType>* entries) const {
+  entries->resize(NumEntries());
+  for (size_t i = 0; i < image_ids_.size(); ++i) {
+    for (size_t j = image_offsets_[i]; j < image_offsets_[i + 1]; ++j) {
+      GetEntry(image_ids_[i], j, &(*entries)[j]);
+    }
+  }
 }
 
 template <int kEmbeddingDim>
-const std::vector<typename InvertedFile<kEmbeddingDim>::EntryType>&
-InvertedFile<kEmbeddingDim>::GetEntries() const {
-  return entries_;
+void InvertedFile<kEmbeddingDim>::GetEntries(
+    const std::unordered_set<int>& image_ids,
+    std::vector<EntryType>* entries) const {
+  entries->clear();
+  for (size_t i = 0; i < image_ids_.size(); ++i) {
+    if (image_ids.count(image_ids_[i])) {
+      for (size_t j = image_offsets_[i]; j < image_offsets_[i + 1]; ++j) {
+        entries->emplace_back();
+        GetEntry(image_ids_[i], j, &entries->back());
+      }
+    }
+  }
 }
 
 template <int kEmbeddingDim>
@@ -210,29 +273,138 @@ void InvertedFile<kEmbeddingDim>::AddEntry(const int image_id,
                                            typename DescType::Index feature_idx,
                                            const DescType& descriptor,
                                            const GeomType& geometry) {
-  CHECK_GE(image_id, 0);
   CHECK_EQ(descriptor.size(), kEmbeddingDim);
   EntryType entry;
   entry.image_id = image_id;
   entry.feature_idx = feature_idx;
   entry.geometry = geometry;
   ConvertToBinaryDescriptor(descriptor, &entry.descriptor);
-  entries_.push_back(entry);
+  AddEntry(entry);
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::AddEntry(const EntryType& entry) {
+  CHECK_GE(entry.image_id, 0);
+  CHECK_LT(NumEntries(), std::numeric_limits<uint32_t>::max());
+
+  feature_idxs_.push_back(entry.feature_idx);
+  geometries_.push_back(entry.geometry);
+  descriptors_.push_back(static_cast<uint64_t>(entry.descriptor.to_ullong()));
+
+  if (image_ids_.empty() || image_ids_.back() != entry.image_id) {
+    image_ids_.push_back(entry.image_id);
+    image_offsets_.push_back(static_cast<uint32_t>(NumEntries()));
+  } else {
+    image_offsets_.back() += 1;
+  }
+
   status_ &= ~ENTRIES_SORTED;
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::SortEntries() {
-  std::sort(entries_.begin(), entries_.end(),
-            [](const EntryType& entry1, const EntryType& entry2) {
-              return entry1.image_id < entry2.image_id;
-            });
+  // Entries are usually added image by image, so only the runs must be sorted.
+  std::vector<size_t> run_idxs(image_ids_.size());
+  std::iota(run_idxs.begin(), run_idxs.end(), 0);
+  std::stable_sort(run_idxs.begin(), run_idxs.end(),
+                   [this](const size_t idx1, const size_t idx2) {
+                     return image_ids_[idx1] < image_ids_[idx2];
+                   });
+
+  bool runs_sorted = true;
+  for (size_t i = 0; i < run_idxs.size(); ++i) {
+    if (run_idxs[i] != i ||
+        (i > 0 && image_ids_[run_idxs[i - 1]] == image_ids_[run_idxs[i]])) {
+      runs_sorted = false;
+      break;
+    }
+  }
+
+  if (!runs_sorted) {
+    std::vector<int> image_ids;
+    std::vector<uint32_t> image_offsets;
+    std::vector<int> feature_idxs;
+    std::vector<GeomType> geometries;
+    std::vector<uint64_t> descriptors;
+    image_ids.reserve(image_ids_.size());
+    image_offsets.reserve(image_offsets_.size());
+    image_offsets.push_back(0);
+    feature_idxs.reserve(NumEntries());
+    geometries.reserve(NumEntries());
+    descriptors.reserve(NumEntries());
+
+    for (const size_t run_idx : run_idxs) {
+      const uint32_t begin = image_offsets_[run_idx];
+      const uint32_t end = image_offsets_[run_idx + 1];
+      feature_idxs.insert(feature_idxs.end(), feature_idxs_.begin() + begin,
+                          feature_idxs_.begin() + end);
+      geometries.insert(geometries.end(), geometries_.begin() + begin,
+                        geometries_.begin() + end);
+      descriptors.insert(descriptors.end(), descriptors_.begin() + begin,
+                         descriptors_.begin() + end);
+      // Merge runs of the same image.
+      if (image_ids.empty() || image_ids.back() != image_ids_[run_idx]) {
+        image_ids.push_back(image_ids_[run_idx]);
+        image_offsets.push_back(0);
+      }
+      image_offsets.back() = static_cast<uint32_t>(descriptors.size());
+    }
+
+    image_ids_.swap(image_ids);
+    image_offsets_.swap(image_offsets);
+    feature_idxs_.swap(feature_idxs);
+    geometries_.swap(geometries);
+    descriptors_.swap(descriptors);
+  }
+
   status_ |= ENTRIES_SORTED;
 }
 
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::RemoveEntries(
+    const std::unordered_set<int>& image_ids) {
+  // Compact the runs of the remaining images in place.
+  size_t num_runs = 0;
+  uint32_t num_entries = 0;
+  for (size_t i = 0; i < image_ids_.size(); ++i) {
+    if (image_ids.count(image_ids_[i])) {
+      continue;
+    }
+    const uint32_t begin = image_offsets_[i];
+    const uint32_t end = image_offsets_[i + 1];
+    if (begin != num_entries) {
+      std::copy(feature_idxs_.begin() + begin, feature_idxs_.begin() + end,
+                feature_idxs_.begin() + num_entries);
+      std::copy(geometries_.begin() + begin, geometries_.begin() + end,
+                geometries_.begin() + num_entries);
+      std::copy(descriptors_.begin() + begin, descriptors_.begin() + end,
+                descriptors_.begin() + num_entries);
+    }
+    num_entries += end - begin;
+    // Merge runs of the same image that became adjacent.
+    if (num_runs > 0 && image_ids_[num_runs - 1] == image_ids_[i]) {
+      image_offsets_[num_runs] = num_entries;
+    } else {
+      image_ids_[num_runs] = image_ids_[i];
+      image_offsets_[num_runs + 1] = num_entries;
+      num_runs += 1;
+    }
+  }
+
+  image_ids_.resize(num_runs);
+  image_offsets_.resize(num_runs + 1);
+  feature_idxs_.resize(num_entries);
+  geometries_.resize(num_entries);
+  descriptors_.resize(num_entries);
+}
+
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ClearEntries() {
-  entries_.clear();
+  image_ids_.clear();
+  image_offsets_.assign(1, 0);
+  feature_idxs_.clear();
+  geometries_.clear();
+  descriptors_.clear();
   status_ &= ~ENTRIES_SORTED;
 }
 
@@ -240,7 +412,7 @@ template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::Reset() {
   status_ = UNUSABLE;
   idf_weight_ = 0.0f;
-  entries_.clear();
+  ClearEntries();
   thresholds_.setZero();
 }
 
@@ -256,7 +428,9 @@ void InvertedFile<kEmbeddingDim>::ConvertToBinaryDescriptor(
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ComputeIDFWeight(const int num_total_images) {
-  if (entries_.empty()) {
+  if (NumEntries() == 0) {
+    // Reset the weight of files, whose entries were all removed.
+    idf_weight_ = 0.0f;
     return;
   }
 
@@ -302,7 +476,7 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
     return;
   }
 
-  if (entries_.size() == 0) {
+  if (NumEntries() == 0) {
     return;
   }
 
@@ -310,38 +484,57 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
 
   std::bitset<kEmbeddingDim> bin_descriptor;
   ConvertToBinaryDescriptor(descriptor, &bin_descriptor);
+  const uint64_t bin_descriptor_data =
+      static_cast<uint64_t>(bin_descriptor.to_ullong());
 
+  // Note that this assumes that the entries are sorted using SortEntries
+  // according to their image identifiers, i.e., that each image has a single
+  // run of entries.
+  size_t image_idx = 0;
   ImageScore image_score;
-  image_score.image_id = entries_.front().image_id;
+  image_score.image_id = image_ids_[image_idx];
   image_score.score = 0.0f;
   int num_image_votes = 0;
 
-  // Note that this assumes that the entries are sorted using SortEntries
-  // according to their image identifiers.
-  for (const auto& entry : entries_) {
-    if (image_score.image_id < entry.image_id) {
-      if (num_image_votes > 0) {
-        // Finalizes the voting since we now know how many features from
-        // the database image match the current image feature. This is
-        // required to perform burstiness normalization (cf. Eqn. 2 in
-        // Arandjelovic, Zisserman: Scalable descriptor
-        // distinctiveness for location recognition. ACCV 2014).
-        // Notice that the weight from the descriptor matching is already
-        // accumulated in image_score.score, i.e., we only need
-        // to apply the burstiness weighting.
-        image_score.score /= std::sqrt(static_cast<float>(num_image_votes));
-        image_score.score *= squared_idf_weight;
-        image_scores->push_back(image_score);
+  uint64_t hamming_dists[kScoreBlockSize];
+  for (size_t block_begin = 0; block_begin < NumEntries();
+       block_begin += kScoreBlockSize) {
+    const size_t block_size =
+        std::min(kScoreBlockSize, NumEntries() - block_begin);
+    ComputeHammingDistances(bin_descriptor_data,
+                            descriptors_.data() + block_begin, block_size,
+                            hamming_dists);
+
+    for (size_t i = 0; i < block_size; ++i) {
+      const uint64_t hamming_dist = hamming_dists[i];
+      if (hamming_dist > hamming_dist_weight_functor_.kMaxHammingDistance) {
+        continue;
       }
 
-      image_score.image_id = entry.image_id;
-      image_score.score = 0.0f;
-      num_image_votes = 0;
-    }
-
-    const size_t hamming_dist = (bin_descriptor ^ entry.descriptor).count();
+      const size_t entry_idx = block_begin + i;
+      if (entry_idx >= image_offsets_[image_idx + 1]) {
+        if (num_image_votes > 0) {
+          // Finalizes the voting since we now know how many features from
+          // the database image match the current image feature. This is
+          // required to perform burstiness normalization (cf. Eqn. 2 in
+          // Arandjelovic, Zisserman: Scalable descriptor
+          // distinctiveness for location recognition. ACCV 2014).
+          // Notice that the weight from the descriptor matching is already
+          // accumulated in image_score.score, i.e., we only need
+          // to apply the burstiness weighting.
+          image_score.score /= std::sqrt(static_cast<float>(num_image_votes));
+          image_score.score *= squared_idf_weight;
+          image_scores->push_back(image_score);
+        }
+
+        do {
+          image_idx += 1;
+        } while (entry_idx >= image_offsets_[image_idx + 1]);
+        image_score.image_id = image_ids_[image_idx];
+        image_score.score = 0.0f;
+        num_image_votes = 0;
+      }
 
-    if (hamming_dist <= hamming_dist_weight_functor_.kMaxHammingDistance) {
       image_score.score += hamming_dist_weight_functor_(hamming_dist);
       num_image_votes += 1;
     }
@@ -358,17 +551,18 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::GetImageIds(
     std::unordered_set<int>* ids) const {
-  for (const EntryType& entry : entries_) {
-    ids->insert(entry.image_id);
-  }
+  ids->insert(image_ids_.begin(), image_ids_.end());
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ComputeImageSelfSimilarities(
     std::unordered_map<int, double>* self_similarities) const {
   const double squared_idf_weight = idf_weight_ * idf_weight_;
-  for (const auto& entry : entries_) {
-    (*self_similarities)[entry.image_id] += squared_idf_weight;
+  for (size_t i = 0; i < image_ids_.size(); ++i) {
+    double& self_similarity = (*self_similarities)[image_ids_[i]];
+    for (size_t j = image_offsets_[i]; j < image_offsets_[i + 1]; ++j) {
+      self_similarity += squared_idf_weight;
+    }
   }
 }
 
@@ -376,7 +570,8 @@ template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::Read(std::ifstream* ifs) {
   CHECK(ifs->is_open());
 
-  ifs->read(reinterpret_cast<char*>(&status_), sizeof(uint8_t));
+  uint8_t status = UNUSABLE;
+  ifs->read(reinterpret_cast<char*>(&status), sizeof(uint8_t));
   ifs->read(reinterpret_cast<char*>(&idf_weight_), sizeof(float));
 
   for (int i = 0; i < kEmbeddingDim; ++i) {
@@ -385,11 +580,18 @@ void InvertedFile<kEmbeddingDim>::Read(std::ifstream* ifs) {
 
   uint32_t num_entries = 0;
   ifs->read(reinterpret_cast<char*>(&num_entries), sizeof(uint32_t));
-  entries_.resize(num_entries);
+  ClearEntries();
+  feature_idxs_.reserve(num_entries);
+  geometries_.reserve(num_entries);
+  descriptors_.reserve(num_entries);
 
+  EntryType entry;
   for (uint32_t i = 0; i < num_entries; ++i) {
-    entries_[i].Read(ifs);
+    entry.Read(ifs);
+    AddEntry(entry);
   }
+
+  status_ = status;
 }
 
 template <int kEmbeddingDim>
@@ -403,14 +605,28 @@ void InvertedFile<kEmbeddingDim>::Write(std::ofstream* ofs) const {
     ofs->write(reinterpret_cast<const char*>(&thresholds_[i]), sizeof(float));
   }
 
-  const uint32_t num_entries = static_cast<uint32_t>(entries_.size());
+  const uint32_t num_entries = static_cast<uint32_t>(NumEntries());
   ofs->write(reinterpret_cast<const char*>(&num_entries), sizeof(uint32_t));
 
-  for (uint32_t i = 0; i < num_entries; ++i) {
-    entries_[i].Write(ofs);
+  EntryType entry;
+  for (size_t i = 0; i < image_ids_.size(); ++i) {
+    for (size_t j = image_offsets_[i]; j < image_offsets_[i + 1]; ++j) {
+      GetEntry(image_ids_[i], j, &entry);
+      entry.Write(ofs);
+    }
   }
 }
 
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::GetEntry(const int image_id,
+                                           const size_t entry_idx,
+                                           EntryType* entry) const {
+  entry->image_id = image_id;
+  entry->feature_idx = feature_idxs_[entry_idx];
+  entry->geometry = geometries_[entry_idx];
+  entry->descriptor = std::bitset<kEmbeddingDim>(descriptors_[entry_idx]);
+}
+
 }  // namespace retrieval
 }  // namespace colmap
 
@@ -0,0 +1,340 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "retrieval/inverted_file"
+#include "util/testing.h"
+
+#include <map>
+#include <sstream>
+
+#include "retrieval/inverted_file.h"
+#include "util/random.h"
+
+using namespace colmap;
+using namespace colmap::retrieval;
+
+namespace {
+
+typedef InvertedFile<64> InvertedFileType;
+
+InvertedFileType::EntryType CreateEntry(const int image_id,
+                                        const int feature_idx) {
+  InvertedFileType::EntryType entry;
+  entry.image_id = image_id;
+  entry.feature_idx = feature_idx;
+  entry.geometry.x = RandomReal(0.0f, 100.0f);
+  entry.geometry.y = RandomReal(0.0f, 100.0f);
+  entry.geometry.scale = RandomReal(1.0f, 10.0f);
+  entry.geometry.orientation = RandomReal(-1.0f, 1.0f);
+  entry.descriptor = std::bitset<64>(
+      (static_cast<uint64_t>(RandomInteger<uint32_t>(0, 0xffffffff)) << 32) |
+      RandomInteger<uint32_t>(0, 0xffffffff));
+  return entry;
+}
+
+void CheckEqualEntries(const InvertedFileType::EntryType& entry1,
+                       const InvertedFileType::EntryType& entry2) {
+  BOOST_CHECK_EQUAL(entry1.image_id, entry2.image_id);
+  BOOST_CHECK_EQUAL(entry1.feature_idx, entry2.feature_idx);
+  BOOST_CHECK_EQUAL(entry1.geometry.x, entry2.geometry.x);
+  BOOST_CHECK_EQUAL(entry1.geometry.y, entry2.geometry.y);
+  BOOST_CHECK_EQUAL(entry1.geometry.scale, entry2.geometry.scale);
+  BOOST_CHECK_EQUAL(entry1.geometry.orientation, entry2.geometry.orientation);
+  BOOST_CHECK_EQUAL(entry1.descriptor, entry2.descriptor);
+}
+
+// Adds the entries of each image in two separate runs and in descending
+// order of image identifiers.
+std::vector<InvertedFileType::EntryType> AddUnsortedEntries(
+    const int num_images, InvertedFileType* inverted_file) {
+  std::vector<InvertedFileType::EntryType> entries;
+  for (int k = 0; k < 2; ++k) {
+    for (int image_id = num_images - 1; image_id >= 0; --image_id) {
+      for (int feature_idx = k; feature_idx < image_id; feature_idx += 2) {
+        entries.push_back(CreateEntry(image_id, feature_idx));
+        inverted_file->AddEntry(entries.back());
+      }
+    }
+  }
+  return entries;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestComputeHammingDistances) {
+  typedef void (*HammingDistancesFunc)(const uint64_t, const uint64_t*,
+                                       const size_t, uint64_t*);
+  std::vector<HammingDistancesFunc> funcs = {
+      ComputeHammingDistances,
+      retrieval::internal::ComputeHammingDistancesBaseline};
+#if defined(COLMAP_HAS_TARGET_POPCNT)
+  if (CPUHasPOPCNT()) {
+    funcs.push_back(retrieval::internal::ComputeHammingDistancesPOPCNT);
+  }
+#endif
+#if defined(COLMAP_HAS_TARGET_AVX2)
+  if (CPUHasAVX2() && CPUHasPOPCNT()) {
+    funcs.push_back(retrieval::internal::ComputeHammingDistancesAVX2);
+  }
+#endif
+
+  for (const auto func : funcs) {
+    SetPRNGSeed(0);
+    for (size_t num_sigs = 0; num_sigs < 10; ++num_sigs) {
+      const uint64_t query = CreateEntry(0, 0).descriptor.to_ullong();
+      std::vector<uint64_t> sigs(num_sigs);
+      for (auto& sig : sigs) {
+        sig = CreateEntry(0, 0).descriptor.to_ullong();
+      }
+      sigs.push_back(query);
+      sigs.push_back(~query);
+      std::vector<uint64_t> dists(sigs.size());
+      func(query, sigs.data(), sigs.size(), dists.data());
+      for (size_t i = 0; i < sigs.size(); ++i) {
+        BOOST_CHECK_EQUAL(dists[i], std::bitset<64>(query ^ sigs[i]).count());
+      }
+      BOOST_CHECK_EQUAL(dists[num_sigs], 0);
+      BOOST_CHECK_EQUAL(dists[num_sigs + 1], 64);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestEmpty) {
+  InvertedFileType inverted_file;
+  BOOST_CHECK_EQUAL(inverted_file.NumEntries(), 0);
+  BOOST_CHECK(!inverted_file.HasHammingEmbedding());
+  BOOST_CHECK(!inverted_file.EntriesSorted());
+  std::vector<InvertedFileType::EntryType> entries;
+  inverted_file.GetEntries(&entries);
+  BOOST_CHECK(entries.empty());
+  std::unordered_set<int> image_ids;
+  inverted_file.GetImageIds(&image_ids);
+  BOOST_CHECK(image_ids.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestAddSortEntries) {
+  SetPRNGSeed(0);
+  InvertedFileType inverted_file;
+  std::vector<InvertedFileType::EntryType> entries =
+      AddUnsortedEntries(10, &inverted_file);
+  BOOST_CHECK_EQUAL(inverted_file.NumEntries(), entries.size());
+  BOOST_CHECK(!inverted_file.EntriesSorted());
+
+  std::vector<InvertedFileType::EntryType> file_entries;
+  inverted_file.GetEntries(&file_entries);
+  BOOST_CHECK_EQUAL(file_entries.size(), entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    CheckEqualEntries(file_entries[i], entries[i]);
+  }
+
+  inverted_file.SortEntries();
+  BOOST_CHECK(inverted_file.EntriesSorted());
+
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const InvertedFileType::EntryType& entry1,
+                      const InvertedFileType::EntryType& entry2) {
+                     return entry1.image_id < entry2.image_id;
+                   });
+  inverted_file.GetEntries(&file_entries);
+  BOOST_CHECK_EQUAL(file_entries.size(), entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    CheckEqualEntries(file_entries[i], entries[i]);
+  }
+
+  inverted_file.GetEntries({3, 5}, &file_entries);
+  BOOST_CHECK_EQUAL(file_entries.size(), 8);
+  for (const auto& entry : file_entries) {
+    BOOST_CHECK(entry.image_id == 3 || entry.image_id == 5);
+  }
+
+  std::unordered_set<int> image_ids;
+  inverted_file.GetImageIds(&image_ids);
+  BOOST_CHECK_EQUAL(image_ids.size(), 9);
+  BOOST_CHECK_EQUAL(image_ids.count(0), 0);
+
+  inverted_file.ClearEntries();
+  BOOST_CHECK_EQUAL(inverted_file.NumEntries(), 0);
+  inverted_file.GetEntries(&file_entries);
+  BOOST_CHECK(file_entries.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestRemoveEntries) {
+  SetPRNGSeed(0);
+  InvertedFileType inverted_file;
+  std::vector<InvertedFileType::EntryType> entries;
+  for (const int image_id : {1, 2, 1, 3, 4, 3, 2}) {
+    for (int feature_idx = 0; feature_idx < image_id; ++feature_idx) {
+      entries.push_back(CreateEntry(image_id, feature_idx));
+      inverted_file.AddEntry(entries.back());
+    }
+  }
+
+  const auto RemoveAndCheckEntries =
+      [&](const std::unordered_set<int>& image_ids) {
+        inverted_file.RemoveEntries(image_ids);
+        entries.erase(
+            std::remove_if(entries.begin(), entries.end(),
+                           [&](const InvertedFileType::EntryType& entry) {
+                             return image_ids.count(entry.image_id) != 0;
+                           }),
+            entries.end());
+        BOOST_CHECK_EQUAL(inverted_file.NumEntries(), entries.size());
+        std::vector<InvertedFileType::EntryType> file_entries;
+        inverted_file.GetEntries(&file_entries);
+        BOOST_CHECK_EQUAL(file_entries.size(), entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+          CheckEqualEntries(file_entries[i], entries[i]);
+        }
+      };
+
+  // Removing image 2 makes the two runs of image 1 adjacent.
+  RemoveAndCheckEntries({2, 5});
+  std::unordered_set<int> image_ids;
+  inverted_file.GetImageIds(&image_ids);
+  BOOST_CHECK_EQUAL(image_ids.size(), 3);
+  BOOST_CHECK_EQUAL(image_ids.count(2), 0);
+  RemoveAndCheckEntries({});
+
+  inverted_file.SortEntries();
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const InvertedFileType::EntryType& entry1,
+                      const InvertedFileType::EntryType& entry2) {
+                     return entry1.image_id < entry2.image_id;
+                   });
+  RemoveAndCheckEntries({3});
+  BOOST_CHECK(inverted_file.EntriesSorted());
+
+  RemoveAndCheckEntries({1, 4});
+  BOOST_CHECK_EQUAL(inverted_file.NumEntries(), 0);
+  image_ids.clear();
+  inverted_file.GetImageIds(&image_ids);
+  BOOST_CHECK(image_ids.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestScoreFeature) {
+  SetPRNGSeed(0);
+  InvertedFileType inverted_file;
+
+  Eigen::Matrix<float, Eigen::Dynamic, 64> descriptors(1000, 64);
+  descriptors.setRandom();
+  inverted_file.ComputeHammingEmbedding(descriptors);
+  BOOST_CHECK(inverted_file.HasHammingEmbedding());
+
+  const int kNumImages = 100;
+  std::vector<InvertedFileType::EntryType> entries;
+  for (int k = 0; k < 2; ++k) {
+    for (int image_id = kNumImages - 1; image_id >= 0; --image_id) {
+      for (int i = 0; i < 5; ++i) {
+        const Eigen::VectorXf descriptor =
+            descriptors.row(RandomInteger(0, 999)).transpose();
+        inverted_file.AddEntry(image_id, i, descriptor, FeatureGeometry());
+        entries.emplace_back();
+        entries.back().image_id = image_id;
+        inverted_file.ConvertToBinaryDescriptor(descriptor,
+                                                &entries.back().descriptor);
+      }
+    }
+  }
+
+  inverted_file.ComputeIDFWeight(2 * kNumImages);
+  inverted_file.SortEntries();
+  BOOST_CHECK(inverted_file.IsUsable());
+  BOOST_CHECK_CLOSE(inverted_file.IDFWeight(), std::log(2.0f), 1e-4);
+
+  const HammingDistWeightFunctor<64> hamming_dist_weight_functor;
+  const float squared_idf_weight =
+      inverted_file.IDFWeight() * inverted_file.IDFWeight();
+
+  for (int i = 0; i < 10; ++i) {
+    const Eigen::VectorXf query = descriptors.row(i).transpose();
+    std::bitset<64> bin_query;
+    inverted_file.ConvertToBinaryDescriptor(query, &bin_query);
+
+    std::map<int, std::pair<float, int>> ref_scores;
+    for (int image_id = 0; image_id < kNumImages; ++image_id) {
+      for (const auto& entry : entries) {
+        if (entry.image_id != image_id) {
+          continue;
+        }
+        const size_t hamming_dist = (bin_query ^ entry.descriptor).count();
+        if (hamming_dist <= hamming_dist_weight_functor.kMaxHammingDistance) {
+          auto& ref_score = ref_scores[image_id];
+          ref_score.first += hamming_dist_weight_functor(hamming_dist);
+          ref_score.second += 1;
+        }
+      }
+    }
+
+    std::vector<ImageScore> image_scores;
+    inverted_file.ScoreFeature(query, &image_scores);
+    BOOST_CHECK_EQUAL(image_scores.size(), ref_scores.size());
+    auto ref_score = ref_scores.begin();
+    for (const auto& image_score : image_scores) {
+      BOOST_CHECK_EQUAL(image_score.image_id, ref_score->first);
+      BOOST_CHECK_EQUAL(
+          image_score.score,
+          ref_score->second.first /
+              std::sqrt(static_cast<float>(ref_score->second.second)) *
+              squared_idf_weight);
+      ++ref_score;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWrite) {
+  SetPRNGSeed(0);
+  InvertedFileType inverted_file;
+  AddUnsortedEntries(10, &inverted_file);
+  inverted_file.SortEntries();
+
+  std::vector<InvertedFileType::EntryType> entries;
+  inverted_file.GetEntries(&entries);
+
+  const std::string file_path = "inverted_file_test.bin";
+  {
+    std::ofstream file(file_path, std::ios::binary);
+    inverted_file.Write(&file);
+  }
+
+  InvertedFileType read_inverted_file;
+  {
+    std::ifstream file(file_path, std::ios::binary);
+    read_inverted_file.Read(&file);
+  }
+
+  BOOST_CHECK(read_inverted_file.EntriesSorted());
+  std::vector<InvertedFileType::EntryType> read_entries;
+  read_inverted_file.GetEntries(&read_entries);
+  BOOST_CHECK_EQUAL(read_entries.size(), entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    CheckEqualEntries(read_entries[i], entries[i]);
+  }
+}
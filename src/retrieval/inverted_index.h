@@ -89,6 +89,23 @@ class InvertedIndex {
                 typename DescType::Index feature_idx,
                 const DescType& descriptor, const GeomType& geometry);
 
+  // Compute the entry of a single feature for the given visual word without
+  // adding it to the index. This is thread-safe and, together with the
+  // following method, equivalent to `AddEntry`.
+  void ComputeEntry(const int image_id, const int word_id,
+                    typename DescType::Index feature_idx,
+                    const DescType& descriptor, const GeomType& geometry,
+                    EntryType* entry) const;
+
+  // Add a single precomputed entry to the index.
+  void AddEntry(const int word_id, const EntryType& entry);
+
+  // Return all entries of the given visual word.
+  void GetEntries(const int word_id, std::vector<EntryType>* entries) const;
+
+  // Remove all index entries of the given images.
+  void RemoveEntries(const std::unordered_set<int>& image_ids);
+
   // Clear all index entries.
   void ClearEntries();
 
@@ -103,7 +120,7 @@ class InvertedIndex {
   float GetIDFWeight(const int word_id) const;
 
   void FindMatches(const int word_id, const std::unordered_set<int>& image_ids,
-                   std::vector<const EntryType*>* matches) const;
+                   std::vector<EntryType>* matches) const;
 
   // Compute the self-similarity for the image.
   float ComputeSelfSimilarity(const Eigen::MatrixXi& word_ids) const;
@@ -221,11 +238,44 @@ template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::AddEntry(
     const int image_id, const int word_id, typename DescType::Index feature_idx,
     const DescType& descriptor, const GeomType& geometry) {
+  EntryType entry;
+  ComputeEntry(image_id, word_id, feature_idx, descriptor, geometry, &entry);
+  AddEntry(word_id, entry);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::ComputeEntry(
+    const int image_id, const int word_id, typename DescType::Index feature_idx,
+    const DescType& descriptor, const GeomType& geometry,
+    EntryType* entry) const {
   CHECK_EQ(descriptor.size(), kDescDim);
   const ProjDescType proj_desc =
       proj_matrix_ * descriptor.transpose().template cast<float>();
-  inverted_files_.at(word_id)
-      .AddEntry(image_id, feature_idx, proj_desc, geometry);
+  entry->image_id = image_id;
+  entry->feature_idx = feature_idx;
+  entry->geometry = geometry;
+  inverted_files_.at(word_id).ConvertToBinaryDescriptor(proj_desc,
+                                                        &entry->descriptor);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::AddEntry(
+    const int word_id, const EntryType& entry) {
+  inverted_files_.at(word_id).AddEntry(entry);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::GetEntries(
+    const int word_id, std::vector<EntryType>* entries) const {
+  inverted_files_.at(word_id).GetEntries(entries);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::RemoveEntries(
+    const std::unordered_set<int>& image_ids) {
+  for (auto& inverted_file : inverted_files_) {
+    inverted_file.RemoveEntries(image_ids);
+  }
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -307,14 +357,8 @@ float InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::GetIDFWeight(
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::FindMatches(
     const int word_id, const std::unordered_set<int>& image_ids,
-    std::vector<const EntryType*>* matches) const {
-  matches->clear();
-  const auto& entries = inverted_files_.at(word_id).GetEntries();
-  for (const auto& entry : entries) {
-    if (image_ids.count(entry.image_id)) {
-      matches->emplace_back(&entry);
-    }
-  }
+    std::vector<EntryType>* matches) const {
+  inverted_files_.at(word_id).GetEntries(image_ids, matches);
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
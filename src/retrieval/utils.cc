@@ -0,0 +1,132 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "retrieval/utils.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace colmap {
+namespace retrieval {
+namespace internal {
+
+void ComputeHammingDistancesBaseline(const uint64_t query,
+                                     const uint64_t* sigs,
+                                     const size_t num_sigs, uint64_t* dists) {
+  for (size_t i = 0; i < num_sigs; ++i) {
+#if defined(__POPCNT__)
+    dists[i] = std::bitset<64>(query ^ sigs[i]).count();
+#else
+    // Without the popcnt instruction, std::bitset::count is a library call,
+    // which is much slower than counting the bits in parallel.
+    uint64_t diff = query ^ sigs[i];
+    diff -= (diff >> 1) & 0x5555555555555555ULL;
+    diff = (diff & 0x3333333333333333ULL) +
+           ((diff >> 2) & 0x3333333333333333ULL);
+    diff = (diff + (diff >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    dists[i] = (diff * 0x0101010101010101ULL) >> 56;
+#endif
+  }
+}
+
+#if defined(COLMAP_HAS_TARGET_POPCNT)
+
+COLMAP_TARGET_POPCNT void ComputeHammingDistancesPOPCNT(const uint64_t query,
+                                                        const uint64_t* sigs,
+                                                        const size_t num_sigs,
+                                                        uint64_t* dists) {
+  for (size_t i = 0; i < num_sigs; ++i) {
+#if defined(_MSC_VER)
+    dists[i] = __popcnt64(query ^ sigs[i]);
+#else
+    dists[i] = __builtin_popcountll(query ^ sigs[i]);
+#endif
+  }
+}
+
+#endif
+
+#if defined(COLMAP_HAS_TARGET_AVX2)
+
+COLMAP_TARGET_AVX2 void ComputeHammingDistancesAVX2(const uint64_t query,
+                                                    const uint64_t* sigs,
+                                                    const size_t num_sigs,
+                                                    uint64_t* dists) {
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i query4 = _mm256_set1_epi64x(static_cast<int64_t>(query));
+  size_t i = 0;
+  for (; i + 4 <= num_sigs; i += 4) {
+    const __m256i diff = _mm256_xor_si256(
+        query4, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sigs + i)));
+    const __m256i low = _mm256_and_si256(diff, low_mask);
+    const __m256i high = _mm256_and_si256(_mm256_srli_epi16(diff, 4), low_mask);
+    const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low),
+                                           _mm256_shuffle_epi8(lookup, high));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dists + i),
+                        _mm256_sad_epu8(counts, zero));
+  }
+
+  // The remaining signatures are counted with the popcnt instruction, which
+  // is checked to be supported together with AVX2.
+  ComputeHammingDistancesPOPCNT(query, sigs + i, num_sigs - i, dists + i);
+}
+
+#endif
+
+}  // namespace internal
+
+void ComputeHammingDistances(const uint64_t query, const uint64_t* sigs,
+                             const size_t num_sigs, uint64_t* dists) {
+#if defined(COLMAP_HAS_TARGET_AVX2)
+  if (CPUHasAVX2() && CPUHasPOPCNT()) {
+    internal::ComputeHammingDistancesAVX2(query, sigs, num_sigs, dists);
+    return;
+  }
+#endif
+#if defined(COLMAP_HAS_TARGET_POPCNT)
+  if (CPUHasPOPCNT()) {
+    internal::ComputeHammingDistancesPOPCNT(query, sigs, num_sigs, dists);
+    return;
+  }
+#endif
+  internal::ComputeHammingDistancesBaseline(query, sigs, num_sigs, dists);
+}
+
+}  // namespace retrieval
+}  // namespace colmap
@@ -33,7 +33,12 @@
 #define COLMAP_SRC_RETRIEVAL_UTILS_H_
 
 #include <array>
+#include <bitset>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "util/simd.h"
 
 namespace colmap {
 namespace retrieval {
@@ -81,6 +86,38 @@ class HammingDistWeightFunctor {
   std::array<float, N + 1> look_up_table_;
 };
 
+// Computes the Hamming distances between a binary signature and an array of
+// contiguously stored signatures, i.e. dists[i] = popcount(query ^ sigs[i]).
+// The population counts are computed with the fastest instruction set of the
+// CPU. With AVX2, the population counts of four signatures are computed at
+// once using the nibble look-up table method of Mula et al.: Faster Population
+// Counts Using AVX2 Instructions. The Computer Journal 2018.
+void ComputeHammingDistances(const uint64_t query, const uint64_t* sigs,
+                             const size_t num_sigs, uint64_t* dists);
+
+namespace internal {
+
+// The implementations of `ComputeHammingDistances` for the different
+// instruction sets. The POPCNT version requires `CPUHasPOPCNT()` and the AVX2
+// version requires both `CPUHasAVX2()` and `CPUHasPOPCNT()`.
+void ComputeHammingDistancesBaseline(const uint64_t query,
+                                     const uint64_t* sigs,
+                                     const size_t num_sigs, uint64_t* dists);
+#if defined(COLMAP_HAS_TARGET_POPCNT)
+COLMAP_TARGET_POPCNT void ComputeHammingDistancesPOPCNT(const uint64_t query,
+                                                        const uint64_t* sigs,
+                                                        const size_t num_sigs,
+                                                        uint64_t* dists);
+#endif
+#if defined(COLMAP_HAS_TARGET_AVX2)
+COLMAP_TARGET_AVX2 void ComputeHammingDistancesAVX2(const uint64_t query,
+                                                    const uint64_t* sigs,
+                                                    const size_t num_sigs,
+                                                    uint64_t* dists);
+#endif
+
+}  // namespace internal
+
 }  // namespace retrieval
 }  // namespace colmap
 
@@ -32,6 +32,9 @@
 #ifndef COLMAP_SRC_RETRIEVAL_VISUAL_INDEX_H_
 #define COLMAP_SRC_RETRIEVAL_VISUAL_INDEX_H_
 
+#include <deque>
+#include <memory>
+
 #include <boost/heap/fibonacci_heap.hpp>
 #include <Eigen/Core>
 
@@ -43,11 +46,19 @@
 #include "util/alignment.h"
 #include "util/endian.h"
 #include "util/logging.h"
+#include "util/mapped_file.h"
 #include "util/math.h"
+#include "util/misc.h"
+#include "util/threading.h"
 
 namespace colmap {
 namespace retrieval {
 
+// Magic bytes and version of the image index written by
+// `VisualIndex::WriteImages`.
+const char kImageIndexMagic[8] = {'C', 'O', 'L', 'M', 'A', 'P', 'V', 'I'};
+const uint32_t kImageIndexVersion = 2;
+
 // Visual index for image retrieval using a vocabulary tree with Hamming
 // embedding, based on the papers:
 //
@@ -126,9 +137,41 @@ class VisualIndex {
   void Add(const IndexOptions& options, const int image_id,
            const GeomType& geometries, const DescType& descriptors);
 
+  // Add multiple images to the visual index. The visual words of the images
+  // are found in parallel, while the index is the same as after adding the
+  // images one by one in the given order. When adding images in many batches,
+  // the same thread pool should be passed for all batches. Otherwise, a thread
+  // pool with `options.num_threads` threads is created for every call.
+  void Add(const IndexOptions& options, const std::vector<int>& image_ids,
+           const std::vector<GeomType>& geometries,
+           const std::vector<DescType>& descriptors,
+           ThreadPool* thread_pool = nullptr);
+
   // Check if an image has been indexed.
   bool ImageIndexed(const int image_id) const;
 
+  // Get the identifiers of all indexed images.
+  std::vector<int> ImageIds() const;
+
+  // Get the number of features, with which an image was added, or -1 for
+  // images read together with the vocabulary using `Read`.
+  int NumImageFeatures(const int image_id) const;
+
+  // Get the checksum of the descriptors, with which an image was added, or 0
+  // for images read together with the vocabulary using `Read`.
+  uint64_t ImageDescriptorsChecksum(const int image_id) const;
+
+  // Compute the checksum of the descriptors of an image, e.g., to detect that
+  // the features of an indexed image changed.
+  static uint64_t DescriptorsChecksum(const DescType& descriptors);
+
+  // Remove the given indexed images, e.g., to re-index them after their
+  // features changed. Images that are not indexed are ignored.
+  void RemoveImages(const std::unordered_set<int>& image_ids);
+
+  // Remove all indexed images, while keeping the vocabulary.
+  void ClearImages();
+
   // Query for most similar images in the visual index.
   void Query(const QueryOptions& options, const DescType& descriptors,
              std::vector<ImageScore>* image_scores) const;
@@ -150,6 +193,16 @@ class VisualIndex {
   void Read(const std::string& path);
   void Write(const std::string& path);
 
+  // Read and write only the indexed images, e.g., to incrementally index a
+  // growing image collection with the same vocabulary. The image index is
+  // versioned and only read if it was written for the same vocabulary and
+  // index options and is complete. Otherwise, false is returned and the index
+  // is unchanged. The file is read through a memory mapping and written to a
+  // temporary file first, which then replaces the previous file, such that
+  // an interrupted write never leaves a truncated image index behind.
+  bool ReadImages(const std::string& path, const IndexOptions& options);
+  void WriteImages(const std::string& path, const IndexOptions& options) const;
+
  private:
   // Quantize the descriptor space into visual words.
   void Quantize(const BuildOptions& options, const DescType& descriptors);
@@ -161,6 +214,17 @@ class VisualIndex {
                            std::vector<ImageScore>* image_scores,
                            Eigen::MatrixXi* word_ids) const;
 
+  // Compute the inverted index entries of an image with their visual words,
+  // without adding them to the index.
+  void ComputeEntries(const IndexOptions& options, const int image_id,
+                      const GeomType& geometries, const DescType& descriptors,
+                      const int num_threads,
+                      std::vector<std::pair<int, EntryType>>* entries) const;
+
+  // Checksum of the visual words to detect images indexed with a different
+  // vocabulary.
+  uint64_t VocabularyChecksum() const;
+
   // Find the nearest neighbor visual words for the given descriptors.
   Eigen::MatrixXi FindWordIds(const DescType& descriptors,
                               const int num_neighbors, const int num_checks,
@@ -175,8 +239,15 @@ class VisualIndex {
   // The inverted index of the database.
   InvertedIndexType inverted_index_;
 
-  // Identifiers of all indexed images.
-  std::unordered_set<int> image_ids_;
+  struct IndexedImage {
+    // The number of features, with which the image was added, or -1.
+    int num_features = -1;
+    // The checksum of the descriptors, with which the image was added, or 0.
+    uint64_t descriptors_checksum = 0;
+  };
+
+  // The number of features and the descriptor checksums of indexed images.
+  std::unordered_map<int, IndexedImage> indexed_images_;
 
   // Whether the index is prepared.
   bool prepared_;
@@ -213,7 +284,9 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Add(
     return;
   }
 
-  image_ids_.insert(image_id);
+  IndexedImage& image = indexed_images_[image_id];
+  image.num_features = descriptors.rows();
+  image.descriptors_checksum = DescriptorsChecksum(descriptors);
 
   prepared_ = false;
 
@@ -221,9 +294,81 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Add(
     return;
   }
 
-  const Eigen::MatrixXi word_ids =
-      FindWordIds(descriptors, options.num_neighbors, options.num_checks,
-                  options.num_threads);
+  std::vector<std::pair<int, EntryType>> entries;
+  ComputeEntries(options, image_id, geometries, descriptors,
+                 options.num_threads, &entries);
+  for (const auto& entry : entries) {
+    inverted_index_.AddEntry(entry.first, entry.second);
+  }
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Add(
+    const IndexOptions& options, const std::vector<int>& image_ids,
+    const std::vector<GeomType>& geometries,
+    const std::vector<DescType>& descriptors, ThreadPool* thread_pool) {
+  CHECK_EQ(image_ids.size(), geometries.size());
+  CHECK_EQ(image_ids.size(), descriptors.size());
+
+  // Only the first occurrence of images, that are not yet indexed, is added.
+  std::vector<size_t> idxs;
+  idxs.reserve(image_ids.size());
+  std::unordered_set<int> new_image_ids;
+  for (size_t i = 0; i < image_ids.size(); ++i) {
+    CHECK_EQ(geometries[i].size(), descriptors[i].rows());
+    if (!ImageIndexed(image_ids[i]) &&
+        new_image_ids.insert(image_ids[i]).second) {
+      idxs.push_back(i);
+    }
+  }
+
+  if (idxs.empty()) {
+    return;
+  }
+
+  prepared_ = false;
+
+  // Every worker finds the visual words of one image at a time, which scales
+  // better than parallelizing the search over the features of each image.
+  std::unique_ptr<ThreadPool> owned_thread_pool;
+  if (thread_pool == nullptr) {
+    owned_thread_pool.reset(new ThreadPool(options.num_threads));
+    thread_pool = owned_thread_pool.get();
+  }
+
+  std::vector<std::vector<std::pair<int, EntryType>>> entries(idxs.size());
+  thread_pool->ParallelFor(0, idxs.size(), [&](const int64_t k) {
+    const size_t i = idxs[k];
+    if (descriptors[i].rows() > 0) {
+      ComputeEntries(options, image_ids[i], geometries[i], descriptors[i],
+                     /*num_threads=*/1, &entries[k]);
+    }
+  });
+
+  // Merge the entries in the order of the images, which yields the same
+  // inverted files as adding the images sequentially.
+  for (size_t k = 0; k < idxs.size(); ++k) {
+    IndexedImage& image = indexed_images_[image_ids[idxs[k]]];
+    image.num_features = descriptors[idxs[k]].rows();
+    image.descriptors_checksum = DescriptorsChecksum(descriptors[idxs[k]]);
+    for (const auto& entry : entries[k]) {
+      inverted_index_.AddEntry(entry.first, entry.second);
+    }
+    entries[k].clear();
+    entries[k].shrink_to_fit();
+  }
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ComputeEntries(
+    const IndexOptions& options, const int image_id, const GeomType& geometries,
+    const DescType& descriptors, const int num_threads,
+    std::vector<std::pair<int, EntryType>>* entries) const {
+  const Eigen::MatrixXi word_ids = FindWordIds(
+      descriptors, options.num_neighbors, options.num_checks, num_threads);
+
+  entries->clear();
+  entries->reserve(descriptors.rows() * options.num_neighbors);
 
   for (typename DescType::Index i = 0; i < descriptors.rows(); ++i) {
     const auto& descriptor = descriptors.row(i);
@@ -237,7 +382,10 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Add(
     for (int n = 0; n < options.num_neighbors; ++n) {
       const int word_id = word_ids(i, n);
       if (word_id != InvertedIndexType::kInvalidWordId) {
-        inverted_index_.AddEntry(image_id, word_id, i, descriptor, geometry);
+        EntryType entry;
+        inverted_index_.ComputeEntry(image_id, word_id, i, descriptor,
+                                     geometry, &entry);
+        entries->emplace_back(word_id, entry);
       }
     }
   }
@@ -246,7 +394,75 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Add(
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 bool VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ImageIndexed(
     const int image_id) const {
-  return image_ids_.count(image_id) != 0;
+  return indexed_images_.count(image_id) != 0;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+std::vector<int> VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ImageIds()
+    const {
+  std::vector<int> image_ids;
+  image_ids.reserve(indexed_images_.size());
+  for (const auto& image : indexed_images_) {
+    image_ids.push_back(image.first);
+  }
+  return image_ids;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+int VisualIndex<kDescType, kDescDim, kEmbeddingDim>::NumImageFeatures(
+    const int image_id) const {
+  return indexed_images_.at(image_id).num_features;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+uint64_t
+VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ImageDescriptorsChecksum(
+    const int image_id) const {
+  return indexed_images_.at(image_id).descriptors_checksum;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+uint64_t VisualIndex<kDescType, kDescDim, kEmbeddingDim>::DescriptorsChecksum(
+    const DescType& descriptors) {
+  static_assert(DescType::IsRowMajor, "Descriptors must be row-major.");
+  // FNV-1a hash over 64-bit words, which is fast enough to check the
+  // descriptors of all images before deciding to reuse an image index.
+  uint64_t checksum = 14695981039346656037ULL;
+  const char* data = reinterpret_cast<const char*>(descriptors.data());
+  const size_t num_bytes = descriptors.size() * sizeof(kDescType);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= num_bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(uint64_t));
+    checksum ^= LittleEndianToNative(word);
+    checksum *= 1099511628211ULL;
+  }
+  for (; i < num_bytes; ++i) {
+    checksum ^= static_cast<uint8_t>(data[i]);
+    checksum *= 1099511628211ULL;
+  }
+  // Distinguish images without features from images read using `Read`.
+  return checksum ^ static_cast<uint64_t>(descriptors.rows());
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::RemoveImages(
+    const std::unordered_set<int>& image_ids) {
+  if (image_ids.empty()) {
+    return;
+  }
+  inverted_index_.RemoveEntries(image_ids);
+  for (const int image_id : image_ids) {
+    indexed_images_.erase(image_id);
+  }
+  prepared_ = false;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ClearImages() {
+  inverted_index_.ClearEntries();
+  indexed_images_.clear();
+  prepared_ = false;
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -288,11 +504,15 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
   std::unordered_map<int, std::unordered_map<int, OrderedMatchListType>>
       db_to_query_matches;
 
-  std::vector<const EntryType*> word_matches;
+  std::vector<EntryType> word_matches;
 
   std::vector<EntryType> query_entries;  // Convert query features, too.
   query_entries.reserve(descriptors.rows());
 
+  // The inverted files return copies of their entries, which are kept here
+  // with stable addresses for the matches referencing them.
+  std::deque<EntryType> db_entries;
+
   // NOTE: Currently, we are redundantly computing the feature weighting.
   const HammingDistWeightFunctor<kEmbeddingDim> hamming_dist_weight_functor;
 
@@ -309,8 +529,8 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
 
     // For each db feature, keep track of the lowest distance (if db features
     // are mapped to more than one visual word).
-    std::unordered_map<
-        int, std::unordered_map<int, std::pair<float, const EntryType*>>>
+    std::unordered_map<int,
+                       std::unordered_map<int, std::pair<float, EntryType>>>
         image_matches;
 
     for (int j = 0; j < word_ids.cols(); ++j) {
@@ -327,18 +547,18 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
 
         for (const auto& match : word_matches) {
           const size_t hamming_dist =
-              (query_entries[i].descriptor ^ match->descriptor).count();
+              (query_entries[i].descriptor ^ match.descriptor).count();
 
           if (hamming_dist <= hamming_dist_weight_functor.kMaxHammingDistance) {
             const float dist =
                 hamming_dist_weight_functor(hamming_dist) * squared_idf_weight;
 
-            auto& feature_matches = image_matches[match->image_id];
-            const auto feature_match = feature_matches.find(match->feature_idx);
+            auto& feature_matches = image_matches[match.image_id];
+            const auto feature_match = feature_matches.find(match.feature_idx);
 
             if (feature_match == feature_matches.end() ||
                 feature_match->first < dist) {
-              feature_matches[match->feature_idx] = std::make_pair(dist, match);
+              feature_matches[match.feature_idx] = std::make_pair(dist, match);
             }
           }
         }
@@ -352,7 +572,8 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
       for (const auto& feature_match : feature_matches.second) {
         const auto feature_idx = feature_match.first;
         const auto dist = feature_match.second.first;
-        const auto db_match = feature_match.second.second;
+        db_entries.push_back(feature_match.second.second);
+        const EntryType* db_match = &db_entries.back();
 
         const auto entry_pair = std::make_pair(&query_entries[i], db_match);
 
@@ -582,8 +803,12 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Read(
     inverted_index_.Read(&file);
   }
 
-  image_ids_.clear();
-  inverted_index_.GetImageIds(&image_ids_);
+  std::unordered_set<int> image_ids;
+  inverted_index_.GetImageIds(&image_ids);
+  indexed_images_.clear();
+  for (const int image_id : image_ids) {
+    indexed_images_.emplace(image_id, IndexedImage());
+  }
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -620,6 +845,167 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Write(
   }
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+bool VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ReadImages(
+    const std::string& path, const IndexOptions& options) {
+  const MappedFile file(path);
+  MappedFileReader reader(file, 0);
+
+  const uint64_t kHeaderNumBytes = sizeof(kImageIndexMagic) +
+                                   2 * sizeof(uint32_t) +
+                                   2 * sizeof(uint64_t) + 2 * sizeof(int32_t);
+  if (file.Size() < kHeaderNumBytes) {
+    std::cout << "WARNING: Not an image index: " << path << std::endl;
+    return false;
+  }
+
+  char magic[sizeof(kImageIndexMagic)];
+  for (size_t i = 0; i < sizeof(kImageIndexMagic); ++i) {
+    magic[i] = reader.Read<char>();
+  }
+  if (memcmp(magic, kImageIndexMagic, sizeof(kImageIndexMagic)) != 0) {
+    std::cout << "WARNING: Not an image index: " << path << std::endl;
+    return false;
+  }
+
+  if (reader.Read<uint32_t>() != kImageIndexVersion) {
+    std::cout << "WARNING: Unsupported image index version: " << path
+              << std::endl;
+    return false;
+  }
+  reader.Read<uint32_t>();
+
+  if (reader.Read<uint64_t>() != VocabularyChecksum() ||
+      reader.Read<uint64_t>() != NumVisualWords()) {
+    std::cout << "WARNING: Image index was built for a different vocabulary: "
+              << path << std::endl;
+    return false;
+  }
+
+  if (reader.Read<int32_t>() != options.num_neighbors ||
+      reader.Read<int32_t>() != options.num_checks) {
+    std::cout << "WARNING: Image index was built with different options: "
+              << path << std::endl;
+    return false;
+  }
+
+  // Check that the file is complete, before the index is modified.
+  const uint64_t kImageNumBytes = 2 * sizeof(int32_t) + sizeof(uint64_t);
+  const uint64_t kEntryNumBytes =
+      2 * sizeof(int32_t) + 4 * sizeof(float) + sizeof(uint64_t);
+  const uint64_t images_offset = reader.Offset();
+  const auto SkipSection = [&reader](const uint64_t num_elem_bytes) {
+    if (reader.NumRemainingBytes() < sizeof(uint64_t)) {
+      return false;
+    }
+    const uint64_t num_elems = reader.Read<uint64_t>();
+    if (num_elems > reader.NumRemainingBytes() / num_elem_bytes) {
+      return false;
+    }
+    reader.Skip(num_elems * num_elem_bytes);
+    return true;
+  };
+  bool complete = SkipSection(kImageNumBytes);
+  for (size_t word_id = 0; complete && word_id < NumVisualWords(); ++word_id) {
+    complete = SkipSection(kEntryNumBytes);
+  }
+  if (!complete || reader.NumRemainingBytes() != 0) {
+    std::cout << "WARNING: Truncated or corrupt image index: " << path
+              << std::endl;
+    return false;
+  }
+
+  ClearImages();
+
+  reader = MappedFileReader(file, images_offset);
+
+  const uint64_t num_images = reader.Read<uint64_t>();
+  indexed_images_.reserve(num_images);
+  for (uint64_t i = 0; i < num_images; ++i) {
+    const int image_id = reader.Read<int32_t>();
+    IndexedImage& image = indexed_images_[image_id];
+    image.num_features = reader.Read<int32_t>();
+    image.descriptors_checksum = reader.Read<uint64_t>();
+  }
+
+  for (size_t word_id = 0; word_id < NumVisualWords(); ++word_id) {
+    const uint64_t num_entries = reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < num_entries; ++i) {
+      EntryType entry;
+      entry.image_id = reader.Read<int32_t>();
+      entry.feature_idx = reader.Read<int32_t>();
+      entry.geometry.x = reader.Read<float>();
+      entry.geometry.y = reader.Read<float>();
+      entry.geometry.scale = reader.Read<float>();
+      entry.geometry.orientation = reader.Read<float>();
+      entry.descriptor = std::bitset<kEmbeddingDim>(reader.Read<uint64_t>());
+      inverted_index_.AddEntry(word_id, entry);
+    }
+  }
+
+  return true;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::WriteImages(
+    const std::string& path, const IndexOptions& options) const {
+  static_assert(kEmbeddingDim <= 64, "Dimensionality too large");
+
+  const std::string temp_path = path + ".tmp";
+  std::ofstream file(temp_path, std::ios::binary);
+  CHECK(file.is_open()) << temp_path;
+
+  file.write(kImageIndexMagic, sizeof(kImageIndexMagic));
+  WriteBinaryLittleEndian<uint32_t>(&file, kImageIndexVersion);
+  WriteBinaryLittleEndian<uint32_t>(&file, 0);
+  WriteBinaryLittleEndian<uint64_t>(&file, VocabularyChecksum());
+  WriteBinaryLittleEndian<uint64_t>(&file, NumVisualWords());
+  WriteBinaryLittleEndian<int32_t>(&file, options.num_neighbors);
+  WriteBinaryLittleEndian<int32_t>(&file, options.num_checks);
+
+  WriteBinaryLittleEndian<uint64_t>(&file, indexed_images_.size());
+  for (const auto& image : indexed_images_) {
+    WriteBinaryLittleEndian<int32_t>(&file, image.first);
+    WriteBinaryLittleEndian<int32_t>(&file, image.second.num_features);
+    WriteBinaryLittleEndian<uint64_t>(&file,
+                                      image.second.descriptors_checksum);
+  }
+
+  std::vector<EntryType> entries;
+  for (size_t word_id = 0; word_id < NumVisualWords(); ++word_id) {
+    inverted_index_.GetEntries(word_id, &entries);
+    WriteBinaryLittleEndian<uint64_t>(&file, entries.size());
+    for (const auto& entry : entries) {
+      WriteBinaryLittleEndian<int32_t>(&file, entry.image_id);
+      WriteBinaryLittleEndian<int32_t>(&file, entry.feature_idx);
+      WriteBinaryLittleEndian<float>(&file, entry.geometry.x);
+      WriteBinaryLittleEndian<float>(&file, entry.geometry.y);
+      WriteBinaryLittleEndian<float>(&file, entry.geometry.scale);
+      WriteBinaryLittleEndian<float>(&file, entry.geometry.orientation);
+      WriteBinaryLittleEndian<uint64_t>(&file, entry.descriptor.to_ullong());
+    }
+  }
+
+  file.close();
+  CHECK(file.good()) << "Failed to write " << temp_path;
+  boost::filesystem::rename(temp_path, path);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+uint64_t VisualIndex<kDescType, kDescDim, kEmbeddingDim>::VocabularyChecksum()
+    const {
+  // FNV-1a hash of the visual words.
+  uint64_t checksum = 14695981039346656037ULL;
+  const char* data = reinterpret_cast<const char*>(visual_words_.ptr());
+  const size_t num_bytes =
+      visual_words_.rows * visual_words_.cols * sizeof(kDescType);
+  for (size_t i = 0; i < num_bytes; ++i) {
+    checksum ^= static_cast<uint8_t>(data[i]);
+    checksum *= 1099511628211ULL;
+  }
+  return checksum;
+}
+
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Quantize(
     const BuildOptions& options, const DescType& descriptors) {
@@ -32,6 +32,8 @@
 #define TEST_NAME "retrieval/visual_index"
 #include "util/testing.h"
 
+#include <fstream>
+
 #include "retrieval/visual_index.h"
 
 using namespace colmap;
@@ -104,6 +106,253 @@ void TestVocabTreeType() {
   }
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void TestAddBatchType() {
+  typedef VisualIndex<kDescType, kDescDim, kEmbeddingDim> VisualIndexType;
+
+  SetPRNGSeed(0);
+
+  typename VisualIndexType::DescType descriptors =
+      VisualIndexType::DescType::Random(1000, kDescDim);
+  VisualIndexType visual_index1;
+  typename VisualIndexType::BuildOptions build_options;
+  build_options.num_visual_words = 100;
+  build_options.branching = 10;
+  visual_index1.Build(build_options, descriptors);
+
+  const std::string path = "visual_index_test.bin";
+  visual_index1.Write(path);
+  VisualIndexType visual_index2;
+  visual_index2.Read(path);
+
+  std::vector<int> image_ids;
+  std::vector<typename VisualIndexType::GeomType> keypoints;
+  std::vector<typename VisualIndexType::DescType> image_descriptors;
+  for (int i = 0; i < 10; ++i) {
+    image_ids.push_back(i + 1);
+    keypoints.emplace_back(10 * i);
+    image_descriptors.push_back(
+        VisualIndexType::DescType::Random(10 * i, kDescDim));
+  }
+
+  // Duplicate images are only added once.
+  image_ids.push_back(1);
+  keypoints.push_back(keypoints[0]);
+  image_descriptors.push_back(image_descriptors[0]);
+
+  typename VisualIndexType::IndexOptions index_options;
+  index_options.num_neighbors = 2;
+  for (size_t i = 0; i < image_ids.size(); ++i) {
+    visual_index1.Add(index_options, image_ids[i], keypoints[i],
+                      image_descriptors[i]);
+  }
+  visual_index1.Prepare();
+
+  index_options.num_threads = 3;
+  visual_index2.Add(index_options, image_ids, keypoints, image_descriptors);
+  visual_index2.Prepare();
+
+  for (int i = 0; i < 10; ++i) {
+    BOOST_CHECK(visual_index2.ImageIndexed(i + 1));
+  }
+
+  typename VisualIndexType::QueryOptions query_options;
+  for (size_t i = 1; i < 10; ++i) {
+    std::vector<ImageScore> image_scores1;
+    visual_index1.Query(query_options, image_descriptors[i], &image_scores1);
+    std::vector<ImageScore> image_scores2;
+    visual_index2.Query(query_options, image_descriptors[i], &image_scores2);
+    BOOST_CHECK_EQUAL(image_scores1.size(), image_scores2.size());
+    for (size_t j = 0; j < image_scores1.size(); ++j) {
+      BOOST_CHECK_EQUAL(image_scores1[j].image_id, image_scores2[j].image_id);
+      BOOST_CHECK_EQUAL(image_scores1[j].score, image_scores2[j].score);
+    }
+  }
+
+  // The inverted index is bit-identical to the sequentially built one.
+  const std::string path1 = "visual_index_test1.bin";
+  const std::string path2 = "visual_index_test2.bin";
+  visual_index1.Write(path1);
+  visual_index2.Write(path2);
+  std::ifstream file1(path1, std::ios::binary);
+  std::ifstream file2(path2, std::ios::binary);
+  const std::string data1((std::istreambuf_iterator<char>(file1)),
+                          std::istreambuf_iterator<char>());
+  const std::string data2((std::istreambuf_iterator<char>(file2)),
+                          std::istreambuf_iterator<char>());
+  BOOST_CHECK(data1 == data2);
+
+  // Adding the images in multiple batches with a shared thread pool yields the
+  // same inverted index.
+  VisualIndexType visual_index3;
+  visual_index3.Read(path);
+  ThreadPool thread_pool(3);
+  const size_t kBatchSize = 4;
+  for (size_t begin = 0; begin < image_ids.size(); begin += kBatchSize) {
+    const size_t end = std::min(begin + kBatchSize, image_ids.size());
+    visual_index3.Add(
+        index_options,
+        std::vector<int>(image_ids.begin() + begin, image_ids.begin() + end),
+        std::vector<typename VisualIndexType::GeomType>(
+            keypoints.begin() + begin, keypoints.begin() + end),
+        std::vector<typename VisualIndexType::DescType>(
+            image_descriptors.begin() + begin,
+            image_descriptors.begin() + end),
+        &thread_pool);
+  }
+  visual_index3.Prepare();
+  const std::string path3 = "visual_index_test3.bin";
+  visual_index3.Write(path3);
+  std::ifstream file3(path3, std::ios::binary);
+  const std::string data3((std::istreambuf_iterator<char>(file3)),
+                          std::istreambuf_iterator<char>());
+  BOOST_CHECK(data1 == data3);
+
+  std::remove(path.c_str());
+  std::remove(path1.c_str());
+  std::remove(path2.c_str());
+  std::remove(path3.c_str());
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void TestReadWriteImagesType() {
+  typedef VisualIndex<kDescType, kDescDim, kEmbeddingDim> VisualIndexType;
+
+  SetPRNGSeed(0);
+
+  typename VisualIndexType::DescType descriptors =
+      VisualIndexType::DescType::Random(1000, kDescDim);
+  VisualIndexType visual_index1;
+  typename VisualIndexType::BuildOptions build_options;
+  build_options.num_visual_words = 100;
+  build_options.branching = 10;
+  visual_index1.Build(build_options, descriptors);
+
+  const std::string vocab_tree_path = "visual_index_test.bin";
+  const std::string image_index_path = "visual_index_test_images.bin";
+  visual_index1.Write(vocab_tree_path);
+
+  typename VisualIndexType::IndexOptions index_options;
+  std::vector<typename VisualIndexType::DescType> image_descriptors;
+  for (int i = 0; i < 5; ++i) {
+    image_descriptors.push_back(
+        VisualIndexType::DescType::Random(10 * i, kDescDim));
+    visual_index1.Add(index_options, i + 1,
+                      typename VisualIndexType::GeomType(10 * i),
+                      image_descriptors.back());
+  }
+  visual_index1.Prepare();
+  visual_index1.WriteImages(image_index_path, index_options);
+
+  VisualIndexType visual_index2;
+  visual_index2.Read(vocab_tree_path);
+  BOOST_CHECK(visual_index2.ImageIds().empty());
+
+  // The image index is only read with the same options.
+  typename VisualIndexType::IndexOptions other_index_options;
+  other_index_options.num_neighbors = 2;
+  BOOST_CHECK(
+      !visual_index2.ReadImages(image_index_path, other_index_options));
+  BOOST_CHECK(visual_index2.ImageIds().empty());
+
+  BOOST_CHECK(visual_index2.ReadImages(image_index_path, index_options));
+  BOOST_CHECK_EQUAL(visual_index2.ImageIds().size(), 5);
+  for (int i = 0; i < 5; ++i) {
+    BOOST_CHECK(visual_index2.ImageIndexed(i + 1));
+    BOOST_CHECK_EQUAL(visual_index2.NumImageFeatures(i + 1), 10 * i);
+    BOOST_CHECK_EQUAL(
+        visual_index2.ImageDescriptorsChecksum(i + 1),
+        VisualIndexType::DescriptorsChecksum(image_descriptors[i]));
+  }
+  visual_index2.Prepare();
+
+  // Changed descriptors with the same number of features are detected.
+  typename VisualIndexType::DescType changed_descriptors =
+      image_descriptors[1];
+  changed_descriptors(0, 0) += 1;
+  BOOST_CHECK_NE(VisualIndexType::DescriptorsChecksum(changed_descriptors),
+                 visual_index2.ImageDescriptorsChecksum(2));
+  BOOST_CHECK_NE(visual_index2.ImageDescriptorsChecksum(1), 0);
+
+  // The image index is written through a temporary file.
+  BOOST_CHECK(!ExistsFile(image_index_path + ".tmp"));
+
+  // A truncated image index is not read and leaves the index unchanged.
+  const std::string truncated_image_index_path =
+      "visual_index_test_images_truncated.bin";
+  {
+    std::ifstream file(image_index_path, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    for (const size_t num_bytes : {size_t(0), size_t(20), size_t(100),
+                                   data.size() / 2, data.size() - 1}) {
+      std::ofstream truncated_file(truncated_image_index_path,
+                                   std::ios::binary);
+      truncated_file.write(data.data(), num_bytes);
+      truncated_file.close();
+      BOOST_CHECK(!visual_index2.ReadImages(truncated_image_index_path,
+                                            index_options));
+      BOOST_CHECK_EQUAL(visual_index2.ImageIds().size(), 5);
+    }
+  }
+
+  typename VisualIndexType::QueryOptions query_options;
+  for (int i = 1; i < 5; ++i) {
+    std::vector<ImageScore> image_scores1;
+    visual_index1.Query(query_options, image_descriptors[i], &image_scores1);
+    std::vector<ImageScore> image_scores2;
+    visual_index2.Query(query_options, image_descriptors[i], &image_scores2);
+    BOOST_CHECK_EQUAL(image_scores1.size(), image_scores2.size());
+    for (size_t j = 0; j < image_scores1.size(); ++j) {
+      BOOST_CHECK_EQUAL(image_scores1[j].image_id, image_scores2[j].image_id);
+      BOOST_CHECK_EQUAL(image_scores1[j].score, image_scores2[j].score);
+    }
+  }
+
+  // The image index is not read for a different vocabulary.
+  VisualIndexType visual_index3;
+  visual_index3.Build(build_options,
+                      VisualIndexType::DescType::Random(1000, kDescDim));
+  BOOST_CHECK(!visual_index3.ReadImages(image_index_path, index_options));
+
+  // Removing an image is the same as never indexing it.
+  VisualIndexType visual_index4;
+  visual_index4.Read(vocab_tree_path);
+  for (int i = 0; i < 5; ++i) {
+    if (i != 1) {
+      visual_index4.Add(index_options, i + 1,
+                        typename VisualIndexType::GeomType(10 * i),
+                        image_descriptors[i]);
+    }
+  }
+  visual_index4.Prepare();
+  visual_index2.RemoveImages({2, 6});
+  BOOST_CHECK_EQUAL(visual_index2.ImageIds().size(), 4);
+  BOOST_CHECK(!visual_index2.ImageIndexed(2));
+  BOOST_CHECK(visual_index2.ImageIndexed(3));
+  visual_index2.Prepare();
+  for (int i = 1; i < 5; ++i) {
+    std::vector<ImageScore> image_scores2;
+    visual_index2.Query(query_options, image_descriptors[i], &image_scores2);
+    std::vector<ImageScore> image_scores4;
+    visual_index4.Query(query_options, image_descriptors[i], &image_scores4);
+    BOOST_CHECK_EQUAL(image_scores2.size(), image_scores4.size());
+    for (size_t j = 0; j < image_scores2.size(); ++j) {
+      BOOST_CHECK_NE(image_scores2[j].image_id, 2);
+      BOOST_CHECK_EQUAL(image_scores2[j].image_id, image_scores4[j].image_id);
+      BOOST_CHECK_CLOSE(image_scores2[j].score, image_scores4[j].score, 1e-4);
+    }
+  }
+
+  visual_index2.ClearImages();
+  BOOST_CHECK(visual_index2.ImageIds().empty());
+  BOOST_CHECK(!visual_index2.ImageIndexed(1));
+
+  std::remove(vocab_tree_path.c_str());
+  std::remove(image_index_path.c_str());
+  std::remove(truncated_image_index_path.c_str());
+}
+
 BOOST_AUTO_TEST_CASE(TestVocabTree) {
   TestVocabTreeType<uint8_t, 128, 64>();
   TestVocabTreeType<uint8_t, 64, 64>();
@@ -112,3 +361,13 @@ BOOST_AUTO_TEST_CASE(TestVocabTree) {
   TestVocabTreeType<float, 32, 16>();
   TestVocabTreeType<double, 32, 16>();
 }
+
+BOOST_AUTO_TEST_CASE(TestAddBatch) {
+  TestAddBatchType<uint8_t, 128, 64>();
+  TestAddBatchType<float, 32, 16>();
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWriteImages) {
+  TestReadWriteImagesType<uint8_t, 128, 64>();
+  TestReadWriteImagesType<float, 32, 16>();
+}
@@ -39,6 +39,8 @@
 #include "estimators/pose.h"
 #include "util/bitmap.h"
 #include "util/misc.h"
+#include "util/threading.h"
+#include "util/trace.h"
 
 namespace colmap {
 namespace {
@@ -146,6 +148,7 @@ void IncrementalMapper::EndReconstruction(const bool discard) {
 bool IncrementalMapper::FindInitialImagePair(const Options& options,
                                              image_t* image_id1,
                                              image_t* image_id2) {
+  COLMAP_TRACE_SCOPE("FindInitialImagePair");
   CHECK(options.Check());
 
   std::vector<image_t> image_ids1;
@@ -200,6 +203,7 @@ bool IncrementalMapper::FindInitialImagePair(const Options& options,
 }
 
 std::vector<image_t> IncrementalMapper::FindNextImages(const Options& options) {
+  COLMAP_TRACE_SCOPE("FindNextImages");
   CHECK_NOTNULL(reconstruction_);
   CHECK(options.Check());
 
@@ -258,6 +262,7 @@ std::vector<image_t> IncrementalMapper::FindNextImages(const Options& options) {
 bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
                                                  const image_t image_id1,
                                                  const image_t image_id2) {
+  COLMAP_TRACE_SCOPE("RegisterInitialImagePair");
   CHECK_NOTNULL(reconstruction_);
   CHECK_EQ(reconstruction_->NumRegImages(), 0);
 
@@ -343,212 +348,128 @@ bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
 
 bool IncrementalMapper::RegisterNextImage(const Options& options,
                                           const image_t image_id) {
+  ScopedTraceSpan trace_span("RegisterNextImage");
+  trace_span.SetArg("image_id", image_id);
   CHECK_NOTNULL(reconstruction_);
   CHECK_GE(reconstruction_->NumRegImages(), 2);
 
   CHECK(options.Check());
 
-  Image& image = reconstruction_->Image(image_id);
-  Camera& camera = reconstruction_->Camera(image.CameraId());
-
-  CHECK(!image.IsRegistered()) << "Image cannot be registered multiple times";
+  CHECK(!reconstruction_->Image(image_id).IsRegistered())
+      << "Image cannot be registered multiple times";
 
   num_reg_trials_[image_id] += 1;
 
-  // Check if enough 2D-3D correspondences.
-  if (image.NumVisiblePoints3D() <
-      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
-    return false;
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-  // Search for 2D-3D correspondences
-  //////////////////////////////////////////////////////////////////////////////
-
-  const int kCorrTransitivity = 1;
-
-  std::vector<std::pair<point2D_t, point3D_t>> tri_corrs;
-  std::vector<Eigen::Vector2d> tri_points2D;
-  std::vector<Eigen::Vector3d> tri_points3D;
-
-  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
-       ++point2D_idx) {
-    const Point2D& point2D = image.Point2D(point2D_idx);
-    const CorrespondenceGraph& correspondence_graph =
-        database_cache_->CorrespondenceGraph();
-    const std::vector<CorrespondenceGraph::Correspondence> corrs =
-        correspondence_graph.FindTransitiveCorrespondences(
-            image_id, point2D_idx, kCorrTransitivity);
-
-    std::unordered_set<point3D_t> point3D_ids;
-
-    for (const auto corr : corrs) {
-      const Image& corr_image = reconstruction_->Image(corr.image_id);
-      if (!corr_image.IsRegistered()) {
-        continue;
-      }
-
-      const Point2D& corr_point2D = corr_image.Point2D(corr.point2D_idx);
-      if (!corr_point2D.HasPoint3D()) {
-        continue;
-      }
-
-      // Avoid duplicate correspondences.
-      if (point3D_ids.count(corr_point2D.Point3DId()) > 0) {
-        continue;
-      }
-
-      const Camera& corr_camera =
-          reconstruction_->Camera(corr_image.CameraId());
-
-      // Avoid correspondences to images with bogus camera parameters.
-      if (corr_camera.HasBogusParams(options.min_focal_length_ratio,
-                                     options.max_focal_length_ratio,
-                                     options.max_extra_param)) {
-        continue;
-      }
-
-      const Point3D& point3D =
-          reconstruction_->Point3D(corr_point2D.Point3DId());
-
-      tri_corrs.emplace_back(point2D_idx, corr_point2D.Point3DId());
-      point3D_ids.insert(corr_point2D.Point3DId());
-      tri_points2D.push_back(point2D.XY());
-      tri_points3D.push_back(point3D.XYZ());
+  NextImagePose pose;
+  if (!EstimateNextImagePose(options, image_id, options.num_threads, &pose)) {
+    if (pose.reset_camera) {
+      ResetCameraParams(pose.camera.CameraId());
     }
-  }
-
-  // The size of `next_image.num_tri_obs` and `tri_corrs_point2D_idxs.size()`
-  // can only differ, when there are images with bogus camera parameters, and
-  // hence we skip some of the 2D-3D correspondences.
-  if (tri_points2D.size() <
-      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
     return false;
   }
 
-  //////////////////////////////////////////////////////////////////////////////
-  // 2D-3D estimation
-  //////////////////////////////////////////////////////////////////////////////
+  RegisterNextImagePose(pose);
 
-  // Only refine / estimate focal length, if no focal length was specified
-  // (manually or through EXIF) and if it was not already estimated previously
-  // from another image (when multiple images share the same camera
-  // parameters)
-
-  AbsolutePoseEstimationOptions abs_pose_options;
-  abs_pose_options.num_threads = options.num_threads;
-  abs_pose_options.num_focal_length_samples = 30;
-  abs_pose_options.min_focal_length_ratio = options.min_focal_length_ratio;
-  abs_pose_options.max_focal_length_ratio = options.max_focal_length_ratio;
-  abs_pose_options.ransac_options.max_error = options.abs_pose_max_error;
-  abs_pose_options.ransac_options.min_inlier_ratio =
-      options.abs_pose_min_inlier_ratio;
-  // Use high confidence to avoid preemptive termination of P3P RANSAC
-  // - too early termination may lead to bad registration.
-  abs_pose_options.ransac_options.min_num_trials = 100;
-  abs_pose_options.ransac_options.max_num_trials = 10000;
-  abs_pose_options.ransac_options.confidence = 0.99999;
-
-  AbsolutePoseRefinementOptions abs_pose_refinement_options;
-  if (num_reg_images_per_camera_[image.CameraId()] > 0) {
-    // Camera already refined from another image with the same camera.
-    if (camera.HasBogusParams(options.min_focal_length_ratio,
-                              options.max_focal_length_ratio,
-                              options.max_extra_param)) {
-      // Previously refined camera has bogus parameters,
-      // so reset parameters and try to re-refine.
-      camera.SetParams(database_cache_->Camera(image.CameraId()).Params());
-      abs_pose_options.estimate_focal_length = !camera.HasPriorFocalLength();
-      abs_pose_refinement_options.refine_focal_length = true;
-      abs_pose_refinement_options.refine_extra_params = true;
-    } else {
-      abs_pose_options.estimate_focal_length = false;
-      abs_pose_refinement_options.refine_focal_length = false;
-      abs_pose_refinement_options.refine_extra_params = false;
-    }
-  } else {
-    // Camera not refined before.
-    abs_pose_options.estimate_focal_length = !camera.HasPriorFocalLength();
-    abs_pose_refinement_options.refine_focal_length = true;
-    abs_pose_refinement_options.refine_extra_params = true;
-  }
-
-  if (!options.abs_pose_refine_focal_length) {
-    abs_pose_options.estimate_focal_length = false;
-    abs_pose_refinement_options.refine_focal_length = false;
-  }
+  return true;
+}
 
-  if (!options.abs_pose_refine_extra_params) {
-    abs_pose_refinement_options.refine_extra_params = false;
-  }
+std::vector<image_t> IncrementalMapper::RegisterNextImages(
+    const Options& options, const std::vector<image_t>& image_ids) {
+  ScopedTraceSpan trace_span("RegisterNextImages");
+  trace_span.SetArg("num_images", image_ids.size());
+  CHECK_NOTNULL(reconstruction_);
+  CHECK_GE(reconstruction_->NumRegImages(), 2);
 
-  size_t num_inliers;
-  std::vector<char> inlier_mask;
+  CHECK(options.Check());
 
-  if (!EstimateAbsolutePose(abs_pose_options, tri_points2D, tri_points3D,
-                            &image.Qvec(), &image.Tvec(), &camera, &num_inliers,
-                            &inlier_mask)) {
-    return false;
+  for (const image_t image_id : image_ids) {
+    CHECK(!reconstruction_->Image(image_id).IsRegistered())
+        << "Image cannot be registered multiple times";
   }
 
-  if (num_inliers < static_cast<size_t>(options.abs_pose_min_num_inliers)) {
-    return false;
+  // Estimate the poses of all images in parallel against the current state
+  // of the reconstruction, which is not modified until all poses are known.
+  std::vector<NextImagePose, Eigen::aligned_allocator<NextImagePose>> poses(
+      image_ids.size());
+  std::vector<char> success(image_ids.size(), false);
+
+  const int num_eff_threads = std::min(
+      GetEffectiveNumThreads(options.num_threads),
+      static_cast<int>(image_ids.size()));
+  if (num_eff_threads > 1) {
+    ThreadPool thread_pool(num_eff_threads);
+    thread_pool.ParallelFor(0, image_ids.size(),
+                            [&](const int64_t i) {
+                              success[i] = EstimateNextImagePose(
+                                  options, image_ids[i], 1, &poses[i]);
+                            },
+                            1);
+  } else {
+    for (size_t i = 0; i < image_ids.size(); ++i) {
+      success[i] = EstimateNextImagePose(options, image_ids[i],
+                                         options.num_threads, &poses[i]);
+    }
   }
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Pose refinement
-  //////////////////////////////////////////////////////////////////////////////
+  // Register the images in the given order. The poses of images whose camera
+  // was modified by a previous image of the batch were estimated with
+  // outdated intrinsics, so they are left for a later trial.
+  std::vector<image_t> reg_image_ids;
+  std::unordered_set<camera_t> modified_camera_ids;
+  for (size_t i = 0; i < image_ids.size(); ++i) {
+    const image_t image_id = image_ids[i];
+    const camera_t camera_id = reconstruction_->Image(image_id).CameraId();
+    if (modified_camera_ids.count(camera_id) > 0) {
+      continue;
+    }
 
-  if (!RefineAbsolutePose(abs_pose_refinement_options, inlier_mask,
-                          tri_points2D, tri_points3D, &image.Qvec(),
-                          &image.Tvec(), &camera)) {
-    return false;
-  }
+    num_reg_trials_[image_id] += 1;
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Continue tracks
-  //////////////////////////////////////////////////////////////////////////////
+    if (!success[i]) {
+      if (poses[i].reset_camera) {
+        ResetCameraParams(camera_id);
+        modified_camera_ids.insert(camera_id);
+      }
+      continue;
+    }
 
-  reconstruction_->RegisterImage(image_id);
-  RegisterImageEvent(image_id);
+    RegisterNextImagePose(poses[i]);
+    reg_image_ids.push_back(image_id);
 
-  for (size_t i = 0; i < inlier_mask.size(); ++i) {
-    if (inlier_mask[i]) {
-      const point2D_t point2D_idx = tri_corrs[i].first;
-      const Point2D& point2D = image.Point2D(point2D_idx);
-      if (!point2D.HasPoint3D()) {
-        const point3D_t point3D_id = tri_corrs[i].second;
-        const TrackElement track_el(image_id, point2D_idx);
-        reconstruction_->AddObservation(point3D_id, track_el);
-        triangulator_->AddModifiedPoint3D(point3D_id);
-      }
+    if (poses[i].modified_camera) {
+      modified_camera_ids.insert(camera_id);
     }
   }
 
-  return true;
+  return reg_image_ids;
 }
 
 size_t IncrementalMapper::TriangulateImage(
     const IncrementalTriangulator::Options& tri_options,
     const image_t image_id) {
+  ScopedTraceSpan trace_span("TriangulateImage");
+  trace_span.SetArg("image_id", image_id);
   CHECK_NOTNULL(reconstruction_);
   return triangulator_->TriangulateImage(tri_options, image_id);
 }
 
 size_t IncrementalMapper::Retriangulate(
     const IncrementalTriangulator::Options& tri_options) {
+  COLMAP_TRACE_SCOPE("Retriangulate");
   CHECK_NOTNULL(reconstruction_);
   return triangulator_->Retriangulate(tri_options);
 }
 
 size_t IncrementalMapper::CompleteTracks(
     const IncrementalTriangulator::Options& tri_options) {
+  COLMAP_TRACE_SCOPE("CompleteTracks");
   CHECK_NOTNULL(reconstruction_);
   return triangulator_->CompleteAllTracks(tri_options);
 }
 
 size_t IncrementalMapper::MergeTracks(
     const IncrementalTriangulator::Options& tri_options) {
+  COLMAP_TRACE_SCOPE("MergeTracks");
   CHECK_NOTNULL(reconstruction_);
   return triangulator_->MergeAllTracks(tri_options);
 }
@@ -558,18 +479,37 @@ IncrementalMapper::AdjustLocalBundle(
     const Options& options, const BundleAdjustmentOptions& ba_options,
     const IncrementalTriangulator::Options& tri_options, const image_t image_id,
     const std::unordered_set<point3D_t>& point3D_ids) {
+  return AdjustLocalBundle(options, ba_options, tri_options,
+                           std::vector<image_t>{image_id}, point3D_ids);
+}
+
+IncrementalMapper::LocalBundleAdjustmentReport
+IncrementalMapper::AdjustLocalBundle(
+    const Options& options, const BundleAdjustmentOptions& ba_options,
+    const IncrementalTriangulator::Options& tri_options,
+    const std::vector<image_t>& image_ids,
+    const std::unordered_set<point3D_t>& point3D_ids) {
+  ScopedTraceSpan trace_span("AdjustLocalBundle");
+  if (image_ids.size() == 1) {
+    trace_span.SetArg("image_id", image_ids[0]);
+  } else {
+    trace_span.SetArg("num_images", image_ids.size());
+  }
   CHECK_NOTNULL(reconstruction_);
   CHECK(options.Check());
+  CHECK(!image_ids.empty());
 
   LocalBundleAdjustmentReport report;
 
-  // Find images that have most 3D points with given image in common.
-  const std::vector<image_t> local_bundle = FindLocalBundle(options, image_id);
+  // Find images that have most 3D points with given images in common.
+  const std::vector<image_t> local_bundle = FindLocalBundle(options, image_ids);
 
   // Do the bundle adjustment only if there is any connected images.
   if (local_bundle.size() > 0) {
     BundleAdjustmentConfig ba_config;
-    ba_config.AddImage(image_id);
+    for (const image_t image_id : image_ids) {
+      ba_config.AddImage(image_id);
+    }
     for (const image_t local_image_id : local_bundle) {
       ba_config.AddImage(local_image_id);
     }
@@ -602,7 +542,7 @@ IncrementalMapper::AdjustLocalBundle(
     // Fix 7 DOF to avoid scale/rotation/translation drift in bundle adjustment.
     if (local_bundle.size() == 1) {
       ba_config.SetConstantPose(local_bundle[0]);
-      ba_config.SetConstantTvec(image_id, {0});
+      ba_config.SetConstantTvec(image_ids[0], {0});
     } else if (local_bundle.size() > 1) {
       const image_t image_id1 = local_bundle[local_bundle.size() - 1];
       const image_t image_id2 = local_bundle[local_bundle.size() - 2];
@@ -644,8 +584,10 @@ IncrementalMapper::AdjustLocalBundle(
     // registrations.
     report.num_completed_observations =
         triangulator_->CompleteTracks(tri_options, variable_point3D_ids);
-    report.num_completed_observations +=
-        triangulator_->CompleteImage(tri_options, image_id);
+    for (const image_t image_id : image_ids) {
+      report.num_completed_observations +=
+          triangulator_->CompleteImage(tri_options, image_id);
+    }
   }
 
   // Filter both the modified images and all changed 3D points to make sure
@@ -653,7 +595,7 @@ IncrementalMapper::AdjustLocalBundle(
   // many of the provided 3D points may also be contained in the adjusted
   // images, but the filtering is not a bottleneck at this point.
   std::unordered_set<image_t> filter_image_ids;
-  filter_image_ids.insert(image_id);
+  filter_image_ids.insert(image_ids.begin(), image_ids.end());
   filter_image_ids.insert(local_bundle.begin(), local_bundle.end());
   report.num_filtered_observations = reconstruction_->FilterPoints3DInImages(
       options.filter_max_reproj_error, options.filter_min_tri_angle,
@@ -667,6 +609,7 @@ IncrementalMapper::AdjustLocalBundle(
 
 bool IncrementalMapper::AdjustGlobalBundle(
     const Options& options, const BundleAdjustmentOptions& ba_options) {
+  COLMAP_TRACE_STAGE("AdjustGlobalBundle");
   CHECK_NOTNULL(reconstruction_);
 
   const std::vector<image_t>& reg_image_ids = reconstruction_->RegImageIds();
@@ -716,6 +659,7 @@ bool IncrementalMapper::AdjustGlobalBundle(
 bool IncrementalMapper::AdjustParallelGlobalBundle(
     const BundleAdjustmentOptions& ba_options,
     const ParallelBundleAdjuster::Options& parallel_ba_options) {
+  COLMAP_TRACE_STAGE("AdjustParallelGlobalBundle");
   CHECK_NOTNULL(reconstruction_);
 
   const std::vector<image_t>& reg_image_ids = reconstruction_->RegImageIds();
@@ -747,6 +691,7 @@ bool IncrementalMapper::AdjustParallelGlobalBundle(
 }
 
 size_t IncrementalMapper::FilterImages(const Options& options) {
+  COLMAP_TRACE_SCOPE("FilterImages");
   CHECK_NOTNULL(reconstruction_);
   CHECK(options.Check());
 
@@ -771,6 +716,7 @@ size_t IncrementalMapper::FilterImages(const Options& options) {
 }
 
 size_t IncrementalMapper::FilterPoints(const Options& options) {
+  COLMAP_TRACE_SCOPE("FilterPoints");
   CHECK_NOTNULL(reconstruction_);
   CHECK(options.Check());
   return reconstruction_->FilterAllPoints3D(options.filter_max_reproj_error,
@@ -939,6 +885,218 @@ std::vector<image_t> IncrementalMapper::FindSecondInitialImage(
   return image_ids;
 }
 
+bool IncrementalMapper::EstimateNextImagePose(const Options& options,
+                                              const image_t image_id,
+                                              const int num_threads,
+                                              NextImagePose* pose) const {
+  const Image& image = reconstruction_->Image(image_id);
+
+  pose->image_id = image_id;
+  pose->qvec = image.Qvec();
+  pose->tvec = image.Tvec();
+  pose->camera = reconstruction_->Camera(image.CameraId());
+  pose->modified_camera = false;
+  pose->reset_camera = false;
+
+  Camera& camera = pose->camera;
+
+  // Check if enough 2D-3D correspondences.
+  if (image.NumVisiblePoints3D() <
+      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Search for 2D-3D correspondences
+  //////////////////////////////////////////////////////////////////////////////
+
+  const int kCorrTransitivity = 1;
+
+  std::vector<Eigen::Vector2d> tri_points2D;
+  std::vector<Eigen::Vector3d> tri_points3D;
+
+  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+       ++point2D_idx) {
+    const Point2D& point2D = image.Point2D(point2D_idx);
+    const CorrespondenceGraph& correspondence_graph =
+        database_cache_->CorrespondenceGraph();
+    const std::vector<CorrespondenceGraph::Correspondence> corrs =
+        correspondence_graph.FindTransitiveCorrespondences(
+            image_id, point2D_idx, kCorrTransitivity);
+
+    std::unordered_set<point3D_t> point3D_ids;
+
+    for (const auto corr : corrs) {
+      const Image& corr_image = reconstruction_->Image(corr.image_id);
+      if (!corr_image.IsRegistered()) {
+        continue;
+      }
+
+      const Point2D& corr_point2D = corr_image.Point2D(corr.point2D_idx);
+      if (!corr_point2D.HasPoint3D()) {
+        continue;
+      }
+
+      // Avoid duplicate correspondences.
+      if (point3D_ids.count(corr_point2D.Point3DId()) > 0) {
+        continue;
+      }
+
+      const Camera& corr_camera =
+          reconstruction_->Camera(corr_image.CameraId());
+
+      // Avoid correspondences to images with bogus camera parameters.
+      if (corr_camera.HasBogusParams(options.min_focal_length_ratio,
+                                     options.max_focal_length_ratio,
+                                     options.max_extra_param)) {
+        continue;
+      }
+
+      const Point3D& point3D =
+          reconstruction_->Point3D(corr_point2D.Point3DId());
+
+      pose->tri_corrs.emplace_back(point2D_idx, corr_point2D.Point3DId());
+      point3D_ids.insert(corr_point2D.Point3DId());
+      tri_points2D.push_back(point2D.XY());
+      tri_points3D.push_back(point3D.XYZ());
+    }
+  }
+
+  // The size of `next_image.num_tri_obs` and `tri_corrs_point2D_idxs.size()`
+  // can only differ, when there are images with bogus camera parameters, and
+  // hence we skip some of the 2D-3D correspondences.
+  if (tri_points2D.size() <
+      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // 2D-3D estimation
+  //////////////////////////////////////////////////////////////////////////////
+
+  // Only refine / estimate focal length, if no focal length was specified
+  // (manually or through EXIF) and if it was not already estimated previously
+  // from another image (when multiple images share the same camera
+  // parameters)
+
+  AbsolutePoseEstimationOptions abs_pose_options;
+  abs_pose_options.num_threads = num_threads;
+  abs_pose_options.num_focal_length_samples = 30;
+  abs_pose_options.min_focal_length_ratio = options.min_focal_length_ratio;
+  abs_pose_options.max_focal_length_ratio = options.max_focal_length_ratio;
+  abs_pose_options.ransac_options.max_error = options.abs_pose_max_error;
+  abs_pose_options.ransac_options.min_inlier_ratio =
+      options.abs_pose_min_inlier_ratio;
+  // Use high confidence to avoid preemptive termination of P3P RANSAC
+  // - too early termination may lead to bad registration.
+  abs_pose_options.ransac_options.min_num_trials = 100;
+  abs_pose_options.ransac_options.max_num_trials = 10000;
+  abs_pose_options.ransac_options.confidence = 0.99999;
+  abs_pose_options.ransac_options.use_sprt = options.abs_pose_use_sprt;
+
+  AbsolutePoseRefinementOptions abs_pose_refinement_options;
+  const auto num_reg_images_for_camera =
+      num_reg_images_per_camera_.find(image.CameraId());
+  if (num_reg_images_for_camera != num_reg_images_per_camera_.end() &&
+      num_reg_images_for_camera->second > 0) {
+    // Camera already refined from another image with the same camera.
+    if (camera.HasBogusParams(options.min_focal_length_ratio,
+                              options.max_focal_length_ratio,
+                              options.max_extra_param)) {
+      // Previously refined camera has bogus parameters,
+      // so reset parameters and try to re-refine.
+      camera.SetParams(database_cache_->Camera(image.CameraId()).Params());
+      abs_pose_options.estimate_focal_length = !camera.HasPriorFocalLength();
+      abs_pose_refinement_options.refine_focal_length = true;
+      abs_pose_refinement_options.refine_extra_params = true;
+      pose->modified_camera = true;
+      pose->reset_camera = true;
+    } else {
+      abs_pose_options.estimate_focal_length = false;
+      abs_pose_refinement_options.refine_focal_length = false;
+      abs_pose_refinement_options.refine_extra_params = false;
+    }
+  } else {
+    // Camera not refined before.
+    abs_pose_options.estimate_focal_length = !camera.HasPriorFocalLength();
+    abs_pose_refinement_options.refine_focal_length = true;
+    abs_pose_refinement_options.refine_extra_params = true;
+  }
+
+  if (!options.abs_pose_refine_focal_length) {
+    abs_pose_options.estimate_focal_length = false;
+    abs_pose_refinement_options.refine_focal_length = false;
+  }
+
+  if (!options.abs_pose_refine_extra_params) {
+    abs_pose_refinement_options.refine_extra_params = false;
+  }
+
+  if (abs_pose_options.estimate_focal_length ||
+      abs_pose_refinement_options.refine_focal_length ||
+      abs_pose_refinement_options.refine_extra_params) {
+    pose->modified_camera = true;
+  }
+
+  size_t num_inliers;
+
+  if (!EstimateAbsolutePose(abs_pose_options, tri_points2D, tri_points3D,
+                            &pose->qvec, &pose->tvec, &camera, &num_inliers,
+                            &pose->inlier_mask)) {
+    return false;
+  }
+
+  if (num_inliers < static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Pose refinement
+  //////////////////////////////////////////////////////////////////////////////
+
+  if (!RefineAbsolutePose(abs_pose_refinement_options, pose->inlier_mask,
+                          tri_points2D, tri_points3D, &pose->qvec,
+                          &pose->tvec, &camera)) {
+    return false;
+  }
+
+  return true;
+}
+
+void IncrementalMapper::ResetCameraParams(const camera_t camera_id) {
+  reconstruction_->Camera(camera_id).SetParams(
+      database_cache_->Camera(camera_id).Params());
+}
+
+void IncrementalMapper::RegisterNextImagePose(const NextImagePose& pose) {
+  Image& image = reconstruction_->Image(pose.image_id);
+  image.SetQvec(pose.qvec);
+  image.SetTvec(pose.tvec);
+  if (pose.modified_camera) {
+    reconstruction_->Camera(image.CameraId()) = pose.camera;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Continue tracks
+  //////////////////////////////////////////////////////////////////////////////
+
+  reconstruction_->RegisterImage(pose.image_id);
+  RegisterImageEvent(pose.image_id);
+
+  for (size_t i = 0; i < pose.inlier_mask.size(); ++i) {
+    if (pose.inlier_mask[i]) {
+      const point2D_t point2D_idx = pose.tri_corrs[i].first;
+      const Point2D& point2D = image.Point2D(point2D_idx);
+      if (!point2D.HasPoint3D()) {
+        const point3D_t point3D_id = pose.tri_corrs[i].second;
+        const TrackElement track_el(pose.image_id, point2D_idx);
+        reconstruction_->AddObservation(point3D_id, track_el);
+        triangulator_->AddModifiedPoint3D(point3D_id);
+      }
+    }
+  }
+}
+
 std::vector<image_t> IncrementalMapper::FindLocalBundle(
     const Options& options, const image_t image_id) const {
   CHECK(options.Check());
@@ -1108,6 +1266,26 @@ std::vector<image_t> IncrementalMapper::FindLocalBundle(
   return local_bundle_image_ids;
 }
 
+std::vector<image_t> IncrementalMapper::FindLocalBundle(
+    const Options& options, const std::vector<image_t>& image_ids) const {
+  if (image_ids.size() == 1) {
+    return FindLocalBundle(options, image_ids[0]);
+  }
+
+  std::unordered_set<image_t> local_bundle_image_ids(image_ids.begin(),
+                                                     image_ids.end());
+  std::vector<image_t> local_bundle;
+  for (const image_t image_id : image_ids) {
+    for (const image_t local_image_id : FindLocalBundle(options, image_id)) {
+      if (local_bundle_image_ids.insert(local_image_id).second) {
+        local_bundle.push_back(local_image_id);
+      }
+    }
+  }
+
+  return local_bundle;
+}
+
 void IncrementalMapper::RegisterImageEvent(const image_t image_id) {
   const Image& image = reconstruction_->Image(image_id);
   size_t& num_reg_images_for_camera =
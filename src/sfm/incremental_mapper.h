@@ -89,6 +89,10 @@ class IncrementalMapper {
     // Minimum inlier ratio in absolute pose estimation.
     double abs_pose_min_inlier_ratio = 0.25;
 
+    // Whether to use the sequential probability ratio test in absolute pose
+    // estimation to reject bad hypotheses early.
+    bool abs_pose_use_sprt = false;
+
     // Whether to estimate the focal length in absolute pose estimation.
     bool abs_pose_refine_focal_length = true;
 
@@ -174,6 +178,14 @@ class IncrementalMapper {
   // a previous call to `RegisterInitialImagePair` was successful.
   bool RegisterNextImage(const Options& options, const image_t image_id);
 
+  // Attempt to register a batch of images to the existing model. The poses of
+  // all images are estimated in parallel against the current model and the
+  // successfully estimated images are then registered in the given order.
+  // Images whose camera parameters were changed by the registration of a
+  // previous image in the batch are skipped. Returns the registered images.
+  std::vector<image_t> RegisterNextImages(
+      const Options& options, const std::vector<image_t>& image_ids);
+
   // Triangulate observations of image.
   size_t TriangulateImage(const IncrementalTriangulator::Options& tri_options,
                           const image_t image_id);
@@ -206,6 +218,26 @@ class IncrementalMapper {
       const IncrementalTriangulator::Options& tri_options,
       const image_t image_id, const std::unordered_set<point3D_t>& point3D_ids);
 
+  // Jointly adjust the locally connected images and points of multiple
+  // reference images, e.g. after registering a batch of images.
+  LocalBundleAdjustmentReport AdjustLocalBundle(
+      const Options& options, const BundleAdjustmentOptions& ba_options,
+      const IncrementalTriangulator::Options& tri_options,
+      const std::vector<image_t>& image_ids,
+      const std::unordered_set<point3D_t>& point3D_ids);
+
+  // Find local bundle for given image in the reconstruction. The local bundle
+  // is defined as the images that are most connected, i.e. maximum number of
+  // shared 3D points, to the given image.
+  std::vector<image_t> FindLocalBundle(const Options& options,
+                                       const image_t image_id) const;
+
+  // Find the joint local bundle of multiple images, which is the union of
+  // their local bundles in the order of the given images without the given
+  // images themselves.
+  std::vector<image_t> FindLocalBundle(
+      const Options& options, const std::vector<image_t>& image_ids) const;
+
   // Global bundle adjustment using Ceres Solver or PBA.
   bool AdjustGlobalBundle(const Options& options,
                           const BundleAdjustmentOptions& ba_options);
@@ -233,6 +265,38 @@ class IncrementalMapper {
   void ClearModifiedPoints3D();
 
  private:
+  // Estimated pose of an image that is not yet registered in the model.
+  struct NextImagePose {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    image_t image_id = kInvalidImageId;
+    Eigen::Vector4d qvec;
+    Eigen::Vector3d tvec;
+    // The camera with potentially refined parameters.
+    Camera camera;
+    bool modified_camera = false;
+    // Whether the camera had bogus parameters and was reset to its prior.
+    bool reset_camera = false;
+    // The 2D-3D correspondences and the inliers of the estimated pose.
+    std::vector<std::pair<point2D_t, point3D_t>> tri_corrs;
+    std::vector<char> inlier_mask;
+  };
+
+  // Estimate the pose of an image from its 2D-3D correspondences without
+  // modifying the reconstruction, such that multiple poses can be estimated
+  // concurrently.
+  bool EstimateNextImagePose(const Options& options, const image_t image_id,
+                             const int num_threads,
+                             NextImagePose* pose) const;
+
+  // Register an image with its estimated pose and continue the tracks of its
+  // inlier correspondences.
+  void RegisterNextImagePose(const NextImagePose& pose);
+
+  // Reset the parameters of a camera to its prior parameters in the database.
+  // Bogus camera parameters are reset even if the image fails to register,
+  // such that subsequent images do not use them.
+  void ResetCameraParams(const camera_t camera_id);
+
   // Find seed images for incremental reconstruction. Suitable seed images have
   // a large number of correspondences and have camera calibration priors. The
   // returned list is ordered such that most suitable images are in the front.
@@ -245,12 +309,6 @@ class IncrementalMapper {
   std::vector<image_t> FindSecondInitialImage(const Options& options,
                                               const image_t image_id1) const;
 
-  // Find local bundle for given image in the reconstruction. The local bundle
-  // is defined as the images that are most connected, i.e. maximum number of
-  // shared 3D points, to the given image.
-  std::vector<image_t> FindLocalBundle(const Options& options,
-                                       const image_t image_id) const;
-
   // Register / De-register image in current reconstruction and update
   // the number of shared images between all reconstructions.
   void RegisterImageEvent(const image_t image_id);
@@ -0,0 +1,306 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "sfm/incremental_mapper"
+#include "util/testing.h"
+
+#include "base/database.h"
+#include "sfm/incremental_mapper.h"
+#include "util/misc.h"
+#include "util/random.h"
+
+using namespace colmap;
+
+namespace {
+
+// Synthesize a database with images on a line, which look at a slab of 3D
+// points, such that every image observes the points in a window around its
+// projection center. The keypoints of the outlier images are random, such that
+// their poses cannot be estimated from their correspondences.
+void SynthesizeDatabase(const std::vector<camera_t>& camera_ids,
+                        const std::unordered_set<image_t>& outlier_image_ids,
+                        Database* database) {
+  SetPRNGSeed(0);
+
+  const double kImageSpacing = 0.5;
+  const double kVisibilityRadius = 2.5;
+  const size_t kNumPoints3D = 500;
+
+  std::vector<Eigen::Vector3d> points3D(kNumPoints3D);
+  for (auto& xyz : points3D) {
+    xyz = Eigen::Vector3d(
+        RandomReal(-kVisibilityRadius,
+                   kImageSpacing * camera_ids.size() + kVisibilityRadius),
+        RandomReal(-1.0, 1.0), RandomReal(4.0, 6.0));
+  }
+
+  DatabaseTransaction database_transaction(database);
+
+  for (const camera_t camera_id : std::unordered_set<camera_t>(
+           camera_ids.begin(), camera_ids.end())) {
+    Camera camera;
+    camera.SetCameraId(camera_id);
+    camera.InitializeWithName("SIMPLE_PINHOLE", 500, 1000, 1000);
+    camera.SetPriorFocalLength(true);
+    database->WriteCamera(camera, /*use_camera_id=*/true);
+  }
+
+  // Maps the 3D points of every image to the index of their observation.
+  std::vector<std::unordered_map<size_t, point2D_t>> point3D_to_point2D(
+      camera_ids.size());
+
+  for (size_t i = 0; i < camera_ids.size(); ++i) {
+    const image_t image_id = static_cast<image_t>(i + 1);
+    const Eigen::Vector3d proj_center(kImageSpacing * i, 0, 0);
+
+    Image image;
+    image.SetImageId(image_id);
+    image.SetCameraId(camera_ids[i]);
+    image.SetName("image" + std::to_string(image_id));
+    database->WriteImage(image, /*use_image_id=*/true);
+
+    const Camera camera = database->ReadCamera(camera_ids[i]);
+    FeatureKeypoints keypoints;
+    for (size_t j = 0; j < points3D.size(); ++j) {
+      const Eigen::Vector3d xyz = points3D[j] - proj_center;
+      if (std::abs(xyz.x()) > kVisibilityRadius) {
+        continue;
+      }
+      Eigen::Vector2d point2D = camera.WorldToImage(xyz.hnormalized());
+      if (outlier_image_ids.count(image_id) > 0) {
+        point2D = Eigen::Vector2d(RandomReal(0.0, 1000.0),
+                                  RandomReal(0.0, 1000.0));
+      }
+      point3D_to_point2D[i].emplace(j, keypoints.size());
+      keypoints.emplace_back(static_cast<float>(point2D.x()),
+                             static_cast<float>(point2D.y()));
+    }
+    database->WriteKeypoints(image_id, keypoints);
+  }
+
+  for (size_t i1 = 0; i1 < camera_ids.size(); ++i1) {
+    for (size_t i2 = i1 + 1; i2 < camera_ids.size(); ++i2) {
+      TwoViewGeometry two_view_geometry;
+      two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+      for (const auto& point3D_and_idx : point3D_to_point2D[i1]) {
+        const auto match = point3D_to_point2D[i2].find(point3D_and_idx.first);
+        if (match != point3D_to_point2D[i2].end()) {
+          two_view_geometry.inlier_matches.emplace_back(
+              point3D_and_idx.second, match->second);
+        }
+      }
+      if (two_view_geometry.inlier_matches.empty()) {
+        continue;
+      }
+      database->WriteMatches(i1 + 1, i2 + 1, two_view_geometry.inlier_matches);
+      database->WriteTwoViewGeometry(i1 + 1, i2 + 1, two_view_geometry);
+    }
+  }
+}
+
+// Database cache of a synthetic scene, which is stored in a temporary
+// directory during its lifetime.
+class SyntheticScene {
+ public:
+  SyntheticScene(const std::vector<camera_t>& camera_ids,
+                 const std::unordered_set<image_t>& outlier_image_ids = {})
+      : path_((boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path())
+                  .string()) {
+    CreateDirIfNotExists(path_);
+    Database database(JoinPaths(path_, "database.db"));
+    SynthesizeDatabase(camera_ids, outlier_image_ids, &database);
+    database_cache_.Load(database, 0, false, {});
+  }
+
+  ~SyntheticScene() { boost::filesystem::remove_all(path_); }
+
+  const DatabaseCache& Cache() const { return database_cache_; }
+
+ private:
+  const std::string path_;
+  DatabaseCache database_cache_;
+};
+
+IncrementalMapper::Options CreateMapperOptions() {
+  IncrementalMapper::Options options;
+  options.init_min_tri_angle = 2;
+  options.num_threads = 1;
+  return options;
+}
+
+// Register the first two images and triangulate their points.
+void InitializeReconstruction(const IncrementalMapper::Options& options,
+                              IncrementalMapper* mapper,
+                              Reconstruction* reconstruction) {
+  SetPRNGSeed(0);
+  mapper->BeginReconstruction(reconstruction);
+  BOOST_REQUIRE(mapper->RegisterInitialImagePair(options, 1, 2));
+  mapper->TriangulateImage(IncrementalTriangulator::Options(), 1);
+  mapper->TriangulateImage(IncrementalTriangulator::Options(), 2);
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestRegisterNextImagesBatchSizeOne) {
+  const SyntheticScene scene({1, 1, 2, 2, 3, 1});
+  const IncrementalMapper::Options options = CreateMapperOptions();
+
+  Reconstruction reconstruction1;
+  IncrementalMapper mapper1(&scene.Cache());
+  InitializeReconstruction(options, &mapper1, &reconstruction1);
+
+  Reconstruction reconstruction2;
+  IncrementalMapper mapper2(&scene.Cache());
+  InitializeReconstruction(options, &mapper2, &reconstruction2);
+
+  for (image_t image_id = 3; image_id <= 6; ++image_id) {
+    SetPRNGSeed(image_id);
+    BOOST_CHECK(mapper1.RegisterNextImage(options, image_id));
+    SetPRNGSeed(image_id);
+    BOOST_CHECK(mapper2.RegisterNextImages(options, {image_id}) ==
+                std::vector<image_t>{image_id});
+
+    const Image& image1 = reconstruction1.Image(image_id);
+    const Image& image2 = reconstruction2.Image(image_id);
+    BOOST_CHECK(image2.IsRegistered());
+    BOOST_CHECK_EQUAL(image1.Qvec(), image2.Qvec());
+    BOOST_CHECK_EQUAL(image1.Tvec(), image2.Tvec());
+    BOOST_CHECK_EQUAL(image1.NumPoints3D(), image2.NumPoints3D());
+    BOOST_CHECK(reconstruction1.Camera(image1.CameraId()).Params() ==
+                reconstruction2.Camera(image2.CameraId()).Params());
+
+    mapper1.TriangulateImage(IncrementalTriangulator::Options(), image_id);
+    mapper2.TriangulateImage(IncrementalTriangulator::Options(), image_id);
+    BOOST_CHECK_EQUAL(reconstruction1.NumPoints3D(),
+                      reconstruction2.NumPoints3D());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestRegisterNextImagesSharedCamera) {
+  const SyntheticScene scene({1, 1, 2, 2, 2, 1});
+  const IncrementalMapper::Options options = CreateMapperOptions();
+
+  Reconstruction reconstruction;
+  IncrementalMapper mapper(&scene.Cache());
+  InitializeReconstruction(options, &mapper, &reconstruction);
+
+  // The first image of the second camera refines its parameters, so that the
+  // poses of the other images with this camera are outdated and they are
+  // skipped, while the image with the already registered camera is not.
+  BOOST_CHECK(mapper.RegisterNextImages(options, {3, 4, 6, 5}) ==
+              std::vector<image_t>({3, 6}));
+  BOOST_CHECK(reconstruction.IsImageRegistered(3));
+  BOOST_CHECK(!reconstruction.IsImageRegistered(4));
+  BOOST_CHECK(!reconstruction.IsImageRegistered(5));
+  BOOST_CHECK(reconstruction.IsImageRegistered(6));
+
+  // Once refined, the camera is not modified by the other images.
+  const std::vector<double> params = reconstruction.Camera(2).Params();
+  BOOST_CHECK(mapper.RegisterNextImages(options, {4, 5}) ==
+              std::vector<image_t>({4, 5}));
+  BOOST_CHECK(reconstruction.Camera(2).Params() == params);
+}
+
+BOOST_AUTO_TEST_CASE(TestRegisterNextImagesResetCamera) {
+  const SyntheticScene scene({1, 1, 2, 2, 2}, {4});
+  const IncrementalMapper::Options options = CreateMapperOptions();
+
+  Reconstruction reconstruction;
+  IncrementalMapper mapper(&scene.Cache());
+  InitializeReconstruction(options, &mapper, &reconstruction);
+  BOOST_REQUIRE(mapper.RegisterNextImage(options, 3));
+
+  // The bogus parameters of the second camera are reset to the prior, even
+  // though the outlier image fails to register.
+  reconstruction.Camera(2).SetParams({1e5, 500, 500});
+  BOOST_CHECK(!mapper.RegisterNextImage(options, 4));
+  BOOST_CHECK(reconstruction.Camera(2).Params() ==
+              scene.Cache().Camera(2).Params());
+
+  // The same holds in batch registration, where the other images of the
+  // camera are then skipped.
+  reconstruction.Camera(2).SetParams({1e5, 500, 500});
+  BOOST_CHECK(mapper.RegisterNextImages(options, {4, 5}).empty());
+  BOOST_CHECK(reconstruction.Camera(2).Params() ==
+              scene.Cache().Camera(2).Params());
+  BOOST_CHECK(!reconstruction.IsImageRegistered(5));
+}
+
+BOOST_AUTO_TEST_CASE(TestAdjustLocalBundle) {
+  const SyntheticScene scene({1, 1, 1, 1, 1, 1, 1, 1});
+  IncrementalMapper::Options options = CreateMapperOptions();
+  options.local_ba_num_images = 2;
+
+  Reconstruction reconstruction;
+  IncrementalMapper mapper(&scene.Cache());
+  InitializeReconstruction(options, &mapper, &reconstruction);
+  for (image_t image_id = 3; image_id <= 8; ++image_id) {
+    BOOST_REQUIRE(mapper.RegisterNextImage(options, image_id));
+    mapper.TriangulateImage(IncrementalTriangulator::Options(), image_id);
+  }
+
+  const std::vector<image_t> image_ids = {1, 8, 2};
+  std::vector<image_t> local_bundle;
+  for (const image_t image_id : image_ids) {
+    for (const image_t local_image_id :
+         mapper.FindLocalBundle(options, image_id)) {
+      if (std::find(image_ids.begin(), image_ids.end(), local_image_id) ==
+              image_ids.end() &&
+          std::find(local_bundle.begin(), local_bundle.end(),
+                    local_image_id) == local_bundle.end()) {
+        local_bundle.push_back(local_image_id);
+      }
+    }
+  }
+  BOOST_CHECK(mapper.FindLocalBundle(options, image_ids) == local_bundle);
+  BOOST_CHECK(mapper.FindLocalBundle(options, {1}) ==
+              mapper.FindLocalBundle(options, 1));
+
+  // Without any variable points, the adjusted observations are exactly the
+  // observations of the given images and their joint local bundle.
+  size_t num_observations = 0;
+  for (const image_t image_id : image_ids) {
+    num_observations += reconstruction.Image(image_id).NumPoints3D();
+  }
+  for (const image_t image_id : local_bundle) {
+    num_observations += reconstruction.Image(image_id).NumPoints3D();
+  }
+  BOOST_CHECK_LT(local_bundle.size() + image_ids.size(),
+                 reconstruction.NumRegImages());
+
+  const IncrementalMapper::LocalBundleAdjustmentReport report =
+      mapper.AdjustLocalBundle(options, BundleAdjustmentOptions(),
+                               IncrementalTriangulator::Options(), image_ids,
+                               {});
+  BOOST_CHECK_EQUAL(report.num_adjusted_observations, num_observations);
+}
@@ -597,7 +597,7 @@ size_t IncrementalTriangulator::Merge(const Options& options,
   const auto& point3D = reconstruction_->Point3D(point3D_id);
 
   for (const auto& track_el : point3D.Track().Elements()) {
-    const std::vector<CorrespondenceGraph::Correspondence>& corrs =
+    const CorrespondenceGraph::CorrespondenceRange corrs =
         correspondence_graph_->FindCorrespondences(track_el.image_id,
                                                    track_el.point2D_idx);
 
@@ -689,7 +689,8 @@ size_t IncrementalTriangulator::Complete(const Options& options,
 
   const Point3D& point3D = reconstruction_->Point3D(point3D_id);
 
-  std::vector<TrackElement> queue = point3D.Track().Elements();
+  std::vector<TrackElement> queue(point3D.Track().Elements().begin(),
+                                  point3D.Track().Elements().end());
 
   const int max_transitivity = options.complete_max_transitivity;
   for (int transitivity = 0; transitivity < max_transitivity; ++transitivity) {
@@ -701,7 +702,7 @@ size_t IncrementalTriangulator::Complete(const Options& options,
     queue.clear();
 
     for (const TrackElement queue_elem : prev_queue) {
-      const std::vector<CorrespondenceGraph::Correspondence>& corrs =
+      const CorrespondenceGraph::CorrespondenceRange corrs =
           correspondence_graph_->FindCorrespondences(queue_elem.image_id,
                                                      queue_elem.point2D_idx);
 
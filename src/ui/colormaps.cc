@@ -66,11 +66,9 @@ float PointColormapBase::AdjustScale(const float gray) {
   }
 }
 
-void PointColormapPhotometric::Prepare(EIGEN_STL_UMAP(camera_t, Camera) &
-                                           cameras,
-                                       EIGEN_STL_UMAP(image_t, Image) & images,
-                                       EIGEN_STL_UMAP(point3D_t, Point3D) &
-                                           points3D,
+void PointColormapPhotometric::Prepare(SlotMap<camera_t, Camera>& cameras,
+                                       SlotMap<image_t, Image>& images,
+                                       SlotMap<point3D_t, Point3D>& points3D,
                                        std::vector<image_t>& reg_image_ids) {}
 
 Eigen::Vector4f PointColormapPhotometric::ComputeColor(
@@ -79,9 +77,9 @@ Eigen::Vector4f PointColormapPhotometric::ComputeColor(
                          point3D.Color(2) / 255.0f, 1.0f);
 }
 
-void PointColormapError::Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-                                 EIGEN_STL_UMAP(image_t, Image) & images,
-                                 EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+void PointColormapError::Prepare(SlotMap<camera_t, Camera>& cameras,
+                                 SlotMap<image_t, Image>& images,
+                                 SlotMap<point3D_t, Point3D>& points3D,
                                  std::vector<image_t>& reg_image_ids) {
   std::vector<float> errors;
   errors.reserve(points3D.size());
@@ -100,10 +98,9 @@ Eigen::Vector4f PointColormapError::ComputeColor(const point3D_t point3D_id,
                          JetColormap::Blue(gray), 1.0f);
 }
 
-void PointColormapTrackLen::Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-                                    EIGEN_STL_UMAP(image_t, Image) & images,
-                                    EIGEN_STL_UMAP(point3D_t, Point3D) &
-                                        points3D,
+void PointColormapTrackLen::Prepare(SlotMap<camera_t, Camera>& cameras,
+                                    SlotMap<image_t, Image>& images,
+                                    SlotMap<point3D_t, Point3D>& points3D,
                                     std::vector<image_t>& reg_image_ids) {
   std::vector<float> track_lengths;
   track_lengths.reserve(points3D.size());
@@ -123,9 +120,9 @@ Eigen::Vector4f PointColormapTrackLen::ComputeColor(const point3D_t point3D_id,
 }
 
 void PointColormapGroundResolution::Prepare(
-    EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-    EIGEN_STL_UMAP(image_t, Image) & images,
-    EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+    SlotMap<camera_t, Camera>& cameras,
+    SlotMap<image_t, Image>& images,
+    SlotMap<point3D_t, Point3D>& points3D,
     std::vector<image_t>& reg_image_ids) {
   std::vector<float> resolutions;
   resolutions.reserve(points3D.size());
@@ -210,10 +207,9 @@ const Eigen::Vector4f ImageColormapBase::kDefaultFrameColor = {0.8f, 0.1f, 0.0f,
 
 ImageColormapBase::ImageColormapBase() {}
 
-void ImageColormapUniform::Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-                                   EIGEN_STL_UMAP(image_t, Image) & images,
-                                   EIGEN_STL_UMAP(point3D_t, Point3D) &
-                                       points3D,
+void ImageColormapUniform::Prepare(SlotMap<camera_t, Camera>& cameras,
+                                   SlotMap<image_t, Image>& images,
+                                   SlotMap<point3D_t, Point3D>& points3D,
                                    std::vector<image_t>& reg_image_ids) {}
 
 void ImageColormapUniform::ComputeColor(const Image& image,
@@ -223,11 +219,9 @@ void ImageColormapUniform::ComputeColor(const Image& image,
   *frame_color = uniform_frame_color;
 }
 
-void ImageColormapNameFilter::Prepare(EIGEN_STL_UMAP(camera_t, Camera) &
-                                          cameras,
-                                      EIGEN_STL_UMAP(image_t, Image) & images,
-                                      EIGEN_STL_UMAP(point3D_t, Point3D) &
-                                          points3D,
+void ImageColormapNameFilter::Prepare(SlotMap<camera_t, Camera>& cameras,
+                                      SlotMap<image_t, Image>& images,
+                                      SlotMap<point3D_t, Point3D>& points3D,
                                       std::vector<image_t>& reg_image_ids) {}
 
 void ImageColormapNameFilter::AddColorForWord(
@@ -46,9 +46,9 @@ class PointColormapBase {
   PointColormapBase();
   virtual ~PointColormapBase() = default;
 
-  virtual void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-                       EIGEN_STL_UMAP(image_t, Image) & images,
-                       EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  virtual void Prepare(SlotMap<camera_t, Camera>& cameras,
+                       SlotMap<image_t, Image>& images,
+                       SlotMap<point3D_t, Point3D>& points3D,
                        std::vector<image_t>& reg_image_ids) = 0;
 
   virtual Eigen::Vector4f ComputeColor(const point3D_t point3D_id,
@@ -68,9 +68,9 @@ class PointColormapBase {
 // Map color according to RGB value from image.
 class PointColormapPhotometric : public PointColormapBase {
  public:
-  void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-               EIGEN_STL_UMAP(image_t, Image) & images,
-               EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  void Prepare(SlotMap<camera_t, Camera>& cameras,
+               SlotMap<image_t, Image>& images,
+               SlotMap<point3D_t, Point3D>& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(const point3D_t point3D_id,
@@ -80,9 +80,9 @@ class PointColormapPhotometric : public PointColormapBase {
 // Map color according to error.
 class PointColormapError : public PointColormapBase {
  public:
-  void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-               EIGEN_STL_UMAP(image_t, Image) & images,
-               EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  void Prepare(SlotMap<camera_t, Camera>& cameras,
+               SlotMap<image_t, Image>& images,
+               SlotMap<point3D_t, Point3D>& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(const point3D_t point3D_id,
@@ -92,9 +92,9 @@ class PointColormapError : public PointColormapBase {
 // Map color according to track length.
 class PointColormapTrackLen : public PointColormapBase {
  public:
-  void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-               EIGEN_STL_UMAP(image_t, Image) & images,
-               EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  void Prepare(SlotMap<camera_t, Camera>& cameras,
+               SlotMap<image_t, Image>& images,
+               SlotMap<point3D_t, Point3D>& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(const point3D_t point3D_id,
@@ -104,9 +104,9 @@ class PointColormapTrackLen : public PointColormapBase {
 // Map color according to ground-resolution.
 class PointColormapGroundResolution : public PointColormapBase {
  public:
-  void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-               EIGEN_STL_UMAP(image_t, Image) & images,
-               EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  void Prepare(SlotMap<camera_t, Camera>& cameras,
+               SlotMap<image_t, Image>& images,
+               SlotMap<point3D_t, Point3D>& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(const point3D_t point3D_id,
@@ -122,9 +122,9 @@ class ImageColormapBase {
   ImageColormapBase();
   virtual ~ImageColormapBase() = default;
 
-  virtual void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-                       EIGEN_STL_UMAP(image_t, Image) & images,
-                       EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  virtual void Prepare(SlotMap<camera_t, Camera>& cameras,
+                       SlotMap<image_t, Image>& images,
+                       SlotMap<point3D_t, Point3D>& points3D,
                        std::vector<image_t>& reg_image_ids) = 0;
 
   virtual void ComputeColor(const Image& image, Eigen::Vector4f* plane_color,
@@ -137,9 +137,9 @@ class ImageColormapBase {
 // Use uniform color for all images.
 class ImageColormapUniform : public ImageColormapBase {
  public:
-  void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-               EIGEN_STL_UMAP(image_t, Image) & images,
-               EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  void Prepare(SlotMap<camera_t, Camera>& cameras,
+               SlotMap<image_t, Image>& images,
+               SlotMap<point3D_t, Point3D>& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   void ComputeColor(const Image& image, Eigen::Vector4f* plane_color,
@@ -152,9 +152,9 @@ class ImageColormapUniform : public ImageColormapBase {
 // Use color for images with specific words in their name.
 class ImageColormapNameFilter : public ImageColormapBase {
  public:
-  void Prepare(EIGEN_STL_UMAP(camera_t, Camera) & cameras,
-               EIGEN_STL_UMAP(image_t, Image) & images,
-               EIGEN_STL_UMAP(point3D_t, Point3D) & points3D,
+  void Prepare(SlotMap<camera_t, Camera>& cameras,
+               SlotMap<image_t, Image>& images,
+               SlotMap<point3D_t, Point3D>& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   void AddColorForWord(const std::string& word,
@@ -80,6 +80,8 @@ SIFTExtractionWidget::SIFTExtractionWidget(QWidget* parent,
                     "camera_mask_path");
 
   AddOptionInt(&options->sift_extraction->max_image_size, "max_image_size");
+  AddOptionInt(&options->sift_extraction->max_image_buffer_mb,
+               "max_image_buffer_mb", 1);
   AddOptionInt(&options->sift_extraction->max_num_features, "max_num_features");
   AddOptionInt(&options->sift_extraction->first_octave, "first_octave", -5);
   AddOptionInt(&options->sift_extraction->num_octaves, "num_octaves");
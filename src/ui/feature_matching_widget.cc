@@ -126,12 +126,18 @@ void FeatureMatchingTab::CreateGeneralOptions() {
                                 "max_num_trials");
   options_widget_->AddOptionDouble(&options_->sift_matching->min_inlier_ratio,
                                    "min_inlier_ratio", 0, 1, 0.001, 3);
+  options_widget_->AddOptionBool(&options_->sift_matching->use_sprt,
+                                 "use_sprt");
   options_widget_->AddOptionInt(&options_->sift_matching->min_num_inliers,
                                 "min_num_inliers");
   options_widget_->AddOptionBool(&options_->sift_matching->multiple_models,
                                  "multiple_models");
   options_widget_->AddOptionBool(&options_->sift_matching->guided_matching,
                                  "guided_matching");
+  options_widget_->AddOptionInt(&options_->sift_matching->write_batch_size,
+                                "write_batch_size", 1);
+  options_widget_->AddOptionDouble(
+      &options_->sift_matching->write_batch_seconds, "write_batch_seconds");
 
   options_widget_->AddSpacer();
 
@@ -193,6 +199,8 @@ SequentialMatchingTab::SequentialMatchingTab(QWidget* parent,
       "loop_detection_max_num_features", -1);
   options_widget_->AddOptionFilePath(
       &options_->sequential_matching->vocab_tree_path, "vocab_tree_path");
+  options_widget_->AddOptionFilePath(
+      &options_->sequential_matching->image_index_path, "image_index_path");
 
   CreateGeneralOptions();
 }
@@ -229,6 +237,8 @@ VocabTreeMatchingTab::VocabTreeMatchingTab(QWidget* parent,
       &options_->vocab_tree_matching->max_num_features, "max_num_features", -1);
   options_widget_->AddOptionFilePath(
       &options_->vocab_tree_matching->vocab_tree_path, "vocab_tree_path");
+  options_widget_->AddOptionFilePath(
+      &options_->vocab_tree_matching->image_index_path, "image_index_path");
 
   CreateGeneralOptions();
 }
@@ -123,9 +123,9 @@ class ModelViewerWidget : public QOpenGLWidget,
 
   // Copy of current scene data that is displayed
   Reconstruction* reconstruction = nullptr;
-  EIGEN_STL_UMAP(camera_t, Camera) cameras;
-  EIGEN_STL_UMAP(image_t, Image) images;
-  EIGEN_STL_UMAP(point3D_t, Point3D) points3D;
+  SlotMap<camera_t, Camera> cameras;
+  SlotMap<image_t, Image> images;
+  SlotMap<point3D_t, Point3D> points3D;
   std::vector<image_t> reg_image_ids;
 
   QLabel* statusbar_status_label;
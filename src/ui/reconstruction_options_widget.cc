@@ -85,7 +85,10 @@ MapperRegistrationOptionsWidget::MapperRegistrationOptionsWidget(
                "abs_pose_min_num_inliers");
   AddOptionDouble(&options->mapper->mapper.abs_pose_min_inlier_ratio,
                   "abs_pose_min_inlier_ratio");
+  AddOptionBool(&options->mapper->mapper.abs_pose_use_sprt,
+                "abs_pose_use_sprt");
   AddOptionInt(&options->mapper->mapper.max_reg_trials, "max_reg_trials", 1);
+  AddOptionInt(&options->mapper->reg_batch_size, "reg_batch_size", 1);
 }
 
 MapperInitializationOptionsWidget::MapperInitializationOptionsWidget(
@@ -0,0 +1,103 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "util/file_lock.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+#include "util/logging.h"
+
+namespace colmap {
+
+FileLock::FileLock(const std::string& path) : path_(path) {
+#ifdef _WIN32
+  file_ = CreateFileA(path_.c_str(), GENERIC_READ | GENERIC_WRITE,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                      nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  CHECK(file_ != INVALID_HANDLE_VALUE) << "Failed to open " << path_;
+#else
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+  CHECK_GE(fd_, 0) << "Failed to open " << path_;
+#endif
+}
+
+FileLock::~FileLock() {
+#ifdef _WIN32
+  CloseHandle(static_cast<HANDLE>(file_));
+#else
+  close(fd_);
+#endif
+}
+
+void FileLock::Lock() {
+#ifdef _WIN32
+  OVERLAPPED overlapped = {};
+  CHECK(LockFileEx(static_cast<HANDLE>(file_), LOCKFILE_EXCLUSIVE_LOCK, 0,
+                   MAXDWORD, MAXDWORD, &overlapped))
+      << "Failed to lock " << path_;
+#else
+  // In contrast to fcntl, flock locks belong to the open file description,
+  // such that they also exclude other descriptors within the same process.
+  int status;
+  do {
+    status = flock(fd_, LOCK_EX);
+  } while (status != 0 && errno == EINTR);
+  CHECK_EQ(status, 0) << "Failed to lock " << path_;
+#endif
+}
+
+void FileLock::Unlock() {
+#ifdef _WIN32
+  OVERLAPPED overlapped = {};
+  CHECK(UnlockFileEx(static_cast<HANDLE>(file_), 0, MAXDWORD, MAXDWORD,
+                     &overlapped))
+      << "Failed to unlock " << path_;
+#else
+  CHECK_EQ(flock(fd_, LOCK_UN), 0) << "Failed to unlock " << path_;
+#endif
+}
+
+FileLockGuard::FileLockGuard(FileLock* lock) : lock_(lock) { lock_->Lock(); }
+
+FileLockGuard::~FileLockGuard() { lock_->Unlock(); }
+
+}  // namespace colmap
@@ -0,0 +1,82 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_UTIL_FILE_LOCK_H_
+#define COLMAP_SRC_UTIL_FILE_LOCK_H_
+
+#include <string>
+
+#include "util/types.h"
+
+namespace colmap {
+
+// Advisory, exclusive lock of a file, which serializes critical sections
+// across processes. Separate objects for the same file also exclude each
+// other within one process, so that independently opened instances of a
+// resource can be synchronized. The lock is not recursive.
+class FileLock {
+ public:
+  // Open or create the lock file at the given path.
+  explicit FileLock(const std::string& path);
+  ~FileLock();
+
+  // Block until the lock is acquired or release the acquired lock.
+  void Lock();
+  void Unlock();
+
+ private:
+  NON_COPYABLE(FileLock)
+  NON_MOVABLE(FileLock)
+
+  const std::string path_;
+#ifdef _WIN32
+  void* file_;
+#else
+  int fd_;
+#endif
+};
+
+// Holds the lock of a file for the lifetime of the object.
+class FileLockGuard {
+ public:
+  explicit FileLockGuard(FileLock* lock);
+  ~FileLockGuard();
+
+ private:
+  NON_COPYABLE(FileLockGuard)
+  NON_MOVABLE(FileLockGuard)
+
+  FileLock* lock_;
+};
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_UTIL_FILE_LOCK_H_
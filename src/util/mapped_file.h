@@ -0,0 +1,135 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_UTIL_MAPPED_FILE_H_
+#define COLMAP_SRC_UTIL_MAPPED_FILE_H_
+
+#include <cstring>
+#include <string>
+
+#include "util/endian.h"
+#include "util/logging.h"
+#include "util/types.h"
+
+namespace colmap {
+
+// Read-only memory mapping of the first bytes of a file. The mapping stays
+// valid until the object is destroyed, even if the file is modified or deleted
+// in the meantime, but any bytes written to the mapped range are visible.
+class MappedFile {
+ public:
+  // Map the entire file or only its first `size` bytes.
+  explicit MappedFile(const std::string& path);
+  MappedFile(const std::string& path, const size_t size);
+  ~MappedFile();
+
+  inline const char* Data() const;
+  inline size_t Size() const;
+
+ private:
+  NON_COPYABLE(MappedFile)
+  NON_MOVABLE(MappedFile)
+
+  const char* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* handle_;
+#endif
+};
+
+// Sequential reader of little-endian values from a mapped file, which checks
+// that all reads stay within the file.
+class MappedFileReader {
+ public:
+  MappedFileReader(const MappedFile& file, const uint64_t offset);
+
+  template <typename T>
+  T Read();
+
+  std::string ReadString();
+
+  void Skip(const uint64_t num_bytes);
+
+  inline uint64_t Offset() const;
+  inline uint64_t NumRemainingBytes() const;
+
+ private:
+  const char* data_;
+  size_t size_;
+  uint64_t offset_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+const char* MappedFile::Data() const { return data_; }
+
+size_t MappedFile::Size() const { return size_; }
+
+inline MappedFileReader::MappedFileReader(const MappedFile& file,
+                                          const uint64_t offset)
+    : data_(file.Data()), size_(file.Size()), offset_(offset) {}
+
+template <typename T>
+T MappedFileReader::Read() {
+  CHECK_LE(offset_ + sizeof(T), size_) << "Unexpected end of file";
+  T value;
+  memcpy(&value, data_ + offset_, sizeof(T));
+  offset_ += sizeof(T);
+  return LittleEndianToNative(value);
+}
+
+inline std::string MappedFileReader::ReadString() {
+  CHECK_LT(offset_, size_) << "Unexpected end of file";
+  const char* begin = data_ + offset_;
+  const char* end =
+      static_cast<const char*>(memchr(begin, '\0', size_ - offset_));
+  CHECK(end != nullptr) << "Unterminated string";
+  offset_ += end - begin + 1;
+  return std::string(begin, end);
+}
+
+inline void MappedFileReader::Skip(const uint64_t num_bytes) {
+  CHECK_LE(num_bytes, size_ - offset_) << "Unexpected end of file";
+  offset_ += num_bytes;
+}
+
+uint64_t MappedFileReader::Offset() const { return offset_; }
+
+uint64_t MappedFileReader::NumRemainingBytes() const {
+  return size_ - offset_;
+}
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_UTIL_MAPPED_FILE_H_
@@ -33,6 +33,16 @@
 
 #include <cstdarg>
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 #include <boost/algorithm/string.hpp>
 
 namespace colmap {
@@ -207,6 +217,27 @@ size_t GetFileSize(const std::string& path) {
   return file.tellg();
 }
 
+size_t GetPeakMemoryUsage() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return static_cast<size_t>(counters.PeakWorkingSetSize);
+  }
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  // Reported in bytes on macOS and in kilobytes on Linux.
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
 void PrintHeading1(const std::string& heading) {
   std::cout << std::endl << std::string(78, '=') << std::endl;
   std::cout << heading << std::endl;
@@ -102,6 +102,10 @@ std::vector<std::string> GetRecursiveDirList(const std::string& path);
 // Get the size in bytes of a file.
 size_t GetFileSize(const std::string& path);
 
+// Get the peak resident memory usage of the current process in bytes. Returns
+// zero if the information is not available on the platform.
+size_t GetPeakMemoryUsage();
+
 // Print first-order heading with over- and underscores to `std::cout`.
 void PrintHeading1(const std::string& heading);
 
@@ -46,6 +46,7 @@
 #include "ui/render_options.h"
 #include "util/misc.h"
 #include "util/random.h"
+#include "util/trace.h"
 #include "util/version.h"
 
 namespace config = boost::program_options;
@@ -56,6 +57,7 @@ OptionManager::OptionManager(bool add_project_options) {
   project_path.reset(new std::string());
   database_path.reset(new std::string());
   image_path.reset(new std::string());
+  trace_path.reset(new std::string());
 
   image_reader.reset(new ImageReaderOptions());
   sift_extraction.reset(new SiftExtractionOptions());
@@ -78,6 +80,7 @@ OptionManager::OptionManager(bool add_project_options) {
   desc_->add_options()("help,h", "");
 
   AddRandomOptions();
+  AddTraceOptions();
 
   if (add_project_options) {
     desc_->add_options()("project_path", config::value<std::string>());
@@ -168,6 +171,7 @@ void OptionManager::ModifyForExtremeQuality() {
 void OptionManager::AddAllOptions() {
   AddLogOptions();
   AddRandomOptions();
+  AddTraceOptions();
   AddDatabaseOptions();
   AddImageOptions();
   AddExtractionOptions();
@@ -205,6 +209,15 @@ void OptionManager::AddRandomOptions() {
   AddAndRegisterDefaultOption("random_seed", &kDefaultPRNGSeed);
 }
 
+void OptionManager::AddTraceOptions() {
+  if (added_trace_options_) {
+    return;
+  }
+  added_trace_options_ = true;
+
+  AddAndRegisterDefaultOption("trace_path", trace_path.get());
+}
+
 void OptionManager::AddDatabaseOptions() {
   if (added_database_options_) {
     return;
@@ -254,6 +267,8 @@ void OptionManager::AddExtractionOptions() {
                               &sift_extraction->gpu_index);
   AddAndRegisterDefaultOption("SiftExtraction.max_image_size",
                               &sift_extraction->max_image_size);
+  AddAndRegisterDefaultOption("SiftExtraction.max_image_buffer_mb",
+                              &sift_extraction->max_image_buffer_mb);
   AddAndRegisterDefaultOption("SiftExtraction.max_num_features",
                               &sift_extraction->max_num_features);
   AddAndRegisterDefaultOption("SiftExtraction.first_octave",
@@ -309,12 +324,18 @@ void OptionManager::AddMatchingOptions() {
                               &sift_matching->max_num_trials);
   AddAndRegisterDefaultOption("SiftMatching.min_inlier_ratio",
                               &sift_matching->min_inlier_ratio);
+  AddAndRegisterDefaultOption("SiftMatching.use_sprt",
+                              &sift_matching->use_sprt);
   AddAndRegisterDefaultOption("SiftMatching.min_num_inliers",
                               &sift_matching->min_num_inliers);
   AddAndRegisterDefaultOption("SiftMatching.multiple_models",
                               &sift_matching->multiple_models);
   AddAndRegisterDefaultOption("SiftMatching.guided_matching",
                               &sift_matching->guided_matching);
+  AddAndRegisterDefaultOption("SiftMatching.write_batch_size",
+                              &sift_matching->write_batch_size);
+  AddAndRegisterDefaultOption("SiftMatching.write_batch_seconds",
+                              &sift_matching->write_batch_seconds);
 }
 
 void OptionManager::AddExhaustiveMatchingOptions() {
@@ -360,6 +381,8 @@ void OptionManager::AddSequentialMatchingOptions() {
       &sequential_matching->loop_detection_max_num_features);
   AddAndRegisterDefaultOption("SequentialMatching.vocab_tree_path",
                               &sequential_matching->vocab_tree_path);
+  AddAndRegisterDefaultOption("SequentialMatching.image_index_path",
+                              &sequential_matching->image_index_path);
 }
 
 void OptionManager::AddVocabTreeMatchingOptions() {
@@ -383,6 +406,8 @@ void OptionManager::AddVocabTreeMatchingOptions() {
                               &vocab_tree_matching->max_num_features);
   AddAndRegisterDefaultOption("VocabTreeMatching.vocab_tree_path",
                               &vocab_tree_matching->vocab_tree_path);
+  AddAndRegisterDefaultOption("VocabTreeMatching.image_index_path",
+                              &vocab_tree_matching->image_index_path);
   AddAndRegisterDefaultOption("VocabTreeMatching.match_list_path",
                               &vocab_tree_matching->match_list_path);
 }
@@ -470,6 +495,7 @@ void OptionManager::AddMapperOptions() {
   AddAndRegisterDefaultOption("Mapper.init_image_id2", &mapper->init_image_id2);
   AddAndRegisterDefaultOption("Mapper.init_num_trials",
                               &mapper->init_num_trials);
+  AddAndRegisterDefaultOption("Mapper.reg_batch_size", &mapper->reg_batch_size);
   AddAndRegisterDefaultOption("Mapper.extract_colors", &mapper->extract_colors);
   AddAndRegisterDefaultOption("Mapper.num_threads", &mapper->num_threads);
   AddAndRegisterDefaultOption("Mapper.min_focal_length_ratio",
@@ -536,6 +562,8 @@ void OptionManager::AddMapperOptions() {
                               &mapper->mapper.abs_pose_min_num_inliers);
   AddAndRegisterDefaultOption("Mapper.abs_pose_min_inlier_ratio",
                               &mapper->mapper.abs_pose_min_inlier_ratio);
+  AddAndRegisterDefaultOption("Mapper.abs_pose_use_sprt",
+                              &mapper->mapper.abs_pose_use_sprt);
   AddAndRegisterDefaultOption("Mapper.filter_max_reproj_error",
                               &mapper->mapper.filter_max_reproj_error);
   AddAndRegisterDefaultOption("Mapper.filter_min_tri_angle",
@@ -576,8 +604,12 @@ void OptionManager::AddPatchMatchStereoOptions() {
 
   AddAndRegisterDefaultOption("PatchMatchStereo.max_image_size",
                               &patch_match_stereo->max_image_size);
+  AddAndRegisterDefaultOption("PatchMatchStereo.use_gpu",
+                              &patch_match_stereo->use_gpu);
   AddAndRegisterDefaultOption("PatchMatchStereo.gpu_index",
                               &patch_match_stereo->gpu_index);
+  AddAndRegisterDefaultOption("PatchMatchStereo.num_threads",
+                              &patch_match_stereo->num_threads);
   AddAndRegisterDefaultOption("PatchMatchStereo.depth_min",
                               &patch_match_stereo->depth_min);
   AddAndRegisterDefaultOption("PatchMatchStereo.depth_max",
@@ -649,6 +681,8 @@ void OptionManager::AddStereoFusionOptions() {
                               &stereo_fusion->check_num_images);
   AddAndRegisterDefaultOption("StereoFusion.cache_size",
                               &stereo_fusion->cache_size);
+  AddAndRegisterDefaultOption("StereoFusion.num_threads",
+                              &stereo_fusion->num_threads);
 }
 
 void OptionManager::AddPoissonMeshingOptions() {
@@ -721,6 +755,7 @@ void OptionManager::Reset() {
 
   added_log_options_ = false;
   added_random_options_ = false;
+  added_trace_options_ = false;
   added_database_options_ = false;
   added_image_options_ = false;
   added_extraction_options_ = false;
@@ -744,6 +779,7 @@ void OptionManager::ResetOptions(const bool reset_paths) {
     *project_path = "";
     *database_path = "";
     *image_path = "";
+    *trace_path = "";
   }
   *image_reader = ImageReaderOptions();
   *sift_extraction = SiftExtractionOptions();
@@ -840,6 +876,10 @@ void OptionManager::Parse(const int argc, char** argv) {
     std::cerr << "ERROR: Invalid options provided." << std::endl;
     exit(EXIT_FAILURE);
   }
+
+  if (!trace_path->empty()) {
+    Tracer::Instance().Start(*trace_path);
+  }
 }
 
 bool OptionManager::Read(const std::string& path) {
@@ -81,6 +81,7 @@ class OptionManager {
   void AddAllOptions();
   void AddLogOptions();
   void AddRandomOptions();
+  void AddTraceOptions();
   void AddDatabaseOptions();
   void AddImageOptions();
   void AddExtractionOptions();
@@ -119,6 +120,10 @@ class OptionManager {
   std::shared_ptr<std::string> database_path;
   std::shared_ptr<std::string> image_path;
 
+  // If not empty, the pipeline stages are traced after parsing the options
+  // and the trace is written to this path, see `Tracer`.
+  std::shared_ptr<std::string> trace_path;
+
   std::shared_ptr<ImageReaderOptions> image_reader;
   std::shared_ptr<SiftExtractionOptions> sift_extraction;
 
@@ -159,6 +164,7 @@ class OptionManager {
 
   bool added_log_options_;
   bool added_random_options_;
+  bool added_trace_options_;
   bool added_database_options_;
   bool added_image_options_;
   bool added_extraction_options_;
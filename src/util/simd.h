@@ -0,0 +1,65 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_UTIL_SIMD_H_
+#define COLMAP_SRC_UTIL_SIMD_H_
+
+// Functions using instructions beyond the baseline of the target architecture
+// are marked with COLMAP_TARGET_AVX2 or COLMAP_TARGET_POPCNT, so that they are
+// compiled for the extended instruction set without changing the compiler
+// flags of the build. They may only be called if the corresponding CPUHas*
+// function returns true. COLMAP_HAS_TARGET_AVX2 and COLMAP_HAS_TARGET_POPCNT
+// are defined, if the compiler supports such functions.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#if defined(__GNUC__) || defined(__clang__)
+#define COLMAP_HAS_TARGET_AVX2
+#define COLMAP_HAS_TARGET_POPCNT
+#define COLMAP_TARGET_AVX2 __attribute__((target("avx2")))
+#define COLMAP_TARGET_POPCNT __attribute__((target("popcnt")))
+#elif defined(_MSC_VER)
+// MSVC allows intrinsics of all instruction sets in any function.
+#define COLMAP_HAS_TARGET_AVX2
+#define COLMAP_HAS_TARGET_POPCNT
+#define COLMAP_TARGET_AVX2
+#define COLMAP_TARGET_POPCNT
+#endif
+#endif
+
+namespace colmap {
+
+// Check whether the CPU and operating system support the instruction sets.
+// The checks are performed once and are cheap to call afterwards.
+bool CPUHasAVX2();
+bool CPUHasPOPCNT();
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_UTIL_SIMD_H_
@@ -0,0 +1,59 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "util/simd"
+#include "util/testing.h"
+
+#include "util/simd.h"
+
+using namespace colmap;
+
+BOOST_AUTO_TEST_CASE(TestCPUHasAVX2) {
+#if defined(__AVX2__)
+  BOOST_CHECK(CPUHasAVX2());
+#endif
+#if !defined(COLMAP_HAS_TARGET_AVX2)
+  BOOST_CHECK(!CPUHasAVX2());
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(TestCPUHasPOPCNT) {
+#if defined(__POPCNT__)
+  BOOST_CHECK(CPUHasPOPCNT());
+#endif
+#if !defined(COLMAP_HAS_TARGET_POPCNT)
+  BOOST_CHECK(!CPUHasPOPCNT());
+#endif
+  // All CPUs with AVX2 also support POPCNT.
+  if (CPUHasAVX2()) {
+    BOOST_CHECK(CPUHasPOPCNT());
+  }
+}
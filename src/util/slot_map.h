@@ -0,0 +1,511 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_UTIL_SLOT_MAP_H_
+#define COLMAP_SRC_UTIL_SLOT_MAP_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "util/logging.h"
+
+namespace colmap {
+
+// Associative container for elements with integer identifiers, e.g. the
+// images and 3D points of a reconstruction. The interface mirrors the subset
+// of `std::unordered_map` used in the code base, but the elements are stored
+// in contiguous blocks of slots that are iterated in order, and lookups go
+// through a dense identifier-to-slot index instead of hashing. Identifiers that
+// are far larger than the number of elements fall back to a hash index, such
+// that arbitrary identifiers do not blow up the memory usage.
+//
+// Elements are never relocated, i.e. references and pointers to elements stay
+// valid until the element is erased, as for `std::unordered_map`. The slots of
+// erased elements are kept in a free list and reused by later insertions.
+// Iterators are invalidated only by erasing the element they point to.
+template <typename key_t, typename value_t>
+class SlotMap {
+ public:
+  typedef key_t key_type;
+  typedef value_t mapped_type;
+  typedef std::pair<const key_t, value_t> value_type;
+
+  template <bool kConst>
+  class Iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename SlotMap::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef typename std::conditional<kConst, const value_type*,
+                                      value_type*>::type pointer;
+    typedef typename std::conditional<kConst, const value_type&,
+                                      value_type&>::type reference;
+    typedef typename std::conditional<kConst, const SlotMap*, SlotMap*>::type
+        map_pointer;
+
+    Iterator() : map_(nullptr), slot_(0) {}
+    Iterator(map_pointer map, const size_t slot) : map_(map), slot_(slot) {}
+
+    // Allow conversion of mutable to constant iterators.
+    template <bool kOtherConst,
+              typename = typename std::enable_if<kConst || !kOtherConst>::type>
+    Iterator(const Iterator<kOtherConst>& other)
+        : map_(other.map_), slot_(other.slot_) {}
+
+    reference operator*() const { return map_->SlotValue(slot_); }
+    pointer operator->() const { return &map_->SlotValue(slot_); }
+
+    Iterator& operator++() {
+      slot_ = map_->NextOccupiedSlot(slot_ + 1);
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator it = *this;
+      ++(*this);
+      return it;
+    }
+
+    template <bool kOtherConst>
+    bool operator==(const Iterator<kOtherConst>& other) const {
+      return slot_ == other.slot_;
+    }
+
+    template <bool kOtherConst>
+    bool operator!=(const Iterator<kOtherConst>& other) const {
+      return slot_ != other.slot_;
+    }
+
+   private:
+    friend class SlotMap;
+    template <bool>
+    friend class Iterator;
+
+    map_pointer map_;
+    size_t slot_;
+  };
+
+  typedef Iterator<false> iterator;
+  typedef Iterator<true> const_iterator;
+
+  SlotMap();
+  SlotMap(const SlotMap& other);
+  SlotMap(SlotMap&& other);
+  ~SlotMap();
+
+  SlotMap& operator=(const SlotMap& other);
+  SlotMap& operator=(SlotMap&& other);
+
+  // The number of elements.
+  size_t size() const;
+  bool empty() const;
+
+  // Reserve memory for the given number of elements.
+  void reserve(const size_t num_elems);
+
+  // Remove all elements and release the memory.
+  void clear();
+
+  // Iterate over the elements in the order of their slots.
+  iterator begin();
+  iterator end();
+  const_iterator begin() const;
+  const_iterator end() const;
+
+  // Access elements by their identifier. The `at` methods throw
+  // `std::out_of_range` for non-existing elements, while `operator[]`
+  // inserts a default-constructed element.
+  size_t count(const key_t key) const;
+  iterator find(const key_t key);
+  const_iterator find(const key_t key) const;
+  value_t& at(const key_t key);
+  const value_t& at(const key_t key) const;
+  value_t& operator[](const key_t key);
+
+  // Construct a new element in place, if the identifier does not yet exist.
+  template <typename... args_t>
+  std::pair<iterator, bool> emplace(const key_t key, args_t&&... args);
+
+  // Erase elements by identifier or by iterator. The latter returns the
+  // iterator to the next element.
+  size_t erase(const key_t key);
+  iterator erase(const_iterator pos);
+
+ private:
+  // Number of slots per block, which are allocated as a whole.
+  static const size_t kBlockSize = 256;
+
+  // Identifiers below this size always use the dense index.
+  static const size_t kMinDenseIndexSize = 4096;
+
+  // Maximum ratio of the dense index size to the number of elements.
+  static const size_t kMaxDenseIndexRatio = 16;
+
+  static const uint32_t kInvalidSlot = std::numeric_limits<uint32_t>::max();
+
+  struct Block {
+    typename std::aligned_storage<sizeof(value_type),
+                                  alignof(value_type)>::type slots[kBlockSize];
+  };
+
+  value_type& SlotValue(const size_t slot);
+  const value_type& SlotValue(const size_t slot) const;
+
+  // Find the first occupied slot at or after the given slot.
+  size_t NextOccupiedSlot(size_t slot) const;
+
+  uint32_t FindSlot(const key_t key) const;
+  void SetSlot(const key_t key, const uint32_t slot);
+
+  // Occupied status of all allocated slots.
+  std::vector<char> occupied_;
+
+  // Blocks of element storage, allocated with Eigen's aligned allocator to
+  // support elements with fixed-size vectorizable members.
+  std::vector<Block*> blocks_;
+
+  // Unoccupied slots before the end of `occupied_`.
+  std::vector<uint32_t> free_slots_;
+
+  // Mapping from identifier to slot, where the hash index contains all
+  // identifiers that exceed the size of the dense index.
+  std::vector<uint32_t> dense_index_;
+  std::unordered_map<key_t, uint32_t> sparse_index_;
+
+  size_t size_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename key_t, typename value_t>
+const size_t SlotMap<key_t, value_t>::kBlockSize;
+
+template <typename key_t, typename value_t>
+const size_t SlotMap<key_t, value_t>::kMinDenseIndexSize;
+
+template <typename key_t, typename value_t>
+const size_t SlotMap<key_t, value_t>::kMaxDenseIndexRatio;
+
+template <typename key_t, typename value_t>
+const uint32_t SlotMap<key_t, value_t>::kInvalidSlot;
+
+template <typename key_t, typename value_t>
+SlotMap<key_t, value_t>::SlotMap() : size_(0) {}
+
+template <typename key_t, typename value_t>
+SlotMap<key_t, value_t>::SlotMap(const SlotMap& other) : SlotMap() {
+  *this = other;
+}
+
+template <typename key_t, typename value_t>
+SlotMap<key_t, value_t>::SlotMap(SlotMap&& other) : SlotMap() {
+  *this = std::move(other);
+}
+
+template <typename key_t, typename value_t>
+SlotMap<key_t, value_t>::~SlotMap() {
+  clear();
+}
+
+template <typename key_t, typename value_t>
+SlotMap<key_t, value_t>& SlotMap<key_t, value_t>::operator=(
+    const SlotMap& other) {
+  if (this != &other) {
+    clear();
+    reserve(other.size());
+    for (const auto& elem : other) {
+      emplace(elem.first, elem.second);
+    }
+  }
+  return *this;
+}
+
+template <typename key_t, typename value_t>
+SlotMap<key_t, value_t>& SlotMap<key_t, value_t>::operator=(SlotMap&& other) {
+  if (this != &other) {
+    clear();
+    occupied_.swap(other.occupied_);
+    blocks_.swap(other.blocks_);
+    free_slots_.swap(other.free_slots_);
+    dense_index_.swap(other.dense_index_);
+    sparse_index_.swap(other.sparse_index_);
+    std::swap(size_, other.size_);
+  }
+  return *this;
+}
+
+template <typename key_t, typename value_t>
+size_t SlotMap<key_t, value_t>::size() const {
+  return size_;
+}
+
+template <typename key_t, typename value_t>
+bool SlotMap<key_t, value_t>::empty() const {
+  return size_ == 0;
+}
+
+template <typename key_t, typename value_t>
+void SlotMap<key_t, value_t>::reserve(const size_t num_elems) {
+  occupied_.reserve(num_elems);
+  blocks_.reserve((num_elems + kBlockSize - 1) / kBlockSize);
+}
+
+template <typename key_t, typename value_t>
+void SlotMap<key_t, value_t>::clear() {
+  for (size_t slot = 0; slot < occupied_.size(); ++slot) {
+    if (occupied_[slot]) {
+      SlotValue(slot).~value_type();
+    }
+  }
+
+  Eigen::aligned_allocator<Block> allocator;
+  for (Block* block : blocks_) {
+    allocator.deallocate(block, 1);
+  }
+
+  std::vector<char>().swap(occupied_);
+  std::vector<Block*>().swap(blocks_);
+  std::vector<uint32_t>().swap(free_slots_);
+  std::vector<uint32_t>().swap(dense_index_);
+  sparse_index_.clear();
+  size_ = 0;
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::iterator SlotMap<key_t, value_t>::begin() {
+  return iterator(this, NextOccupiedSlot(0));
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::iterator SlotMap<key_t, value_t>::end() {
+  return iterator(this, occupied_.size());
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::const_iterator
+SlotMap<key_t, value_t>::begin() const {
+  return const_iterator(this, NextOccupiedSlot(0));
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::const_iterator SlotMap<key_t, value_t>::end()
+    const {
+  return const_iterator(this, occupied_.size());
+}
+
+template <typename key_t, typename value_t>
+size_t SlotMap<key_t, value_t>::count(const key_t key) const {
+  return FindSlot(key) == kInvalidSlot ? 0 : 1;
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::iterator SlotMap<key_t, value_t>::find(
+    const key_t key) {
+  const uint32_t slot = FindSlot(key);
+  return slot == kInvalidSlot ? end() : iterator(this, slot);
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::const_iterator SlotMap<key_t, value_t>::find(
+    const key_t key) const {
+  const uint32_t slot = FindSlot(key);
+  return slot == kInvalidSlot ? end() : const_iterator(this, slot);
+}
+
+template <typename key_t, typename value_t>
+value_t& SlotMap<key_t, value_t>::at(const key_t key) {
+  const uint32_t slot = FindSlot(key);
+  if (slot == kInvalidSlot) {
+    throw std::out_of_range("SlotMap::at");
+  }
+  return SlotValue(slot).second;
+}
+
+template <typename key_t, typename value_t>
+const value_t& SlotMap<key_t, value_t>::at(const key_t key) const {
+  const uint32_t slot = FindSlot(key);
+  if (slot == kInvalidSlot) {
+    throw std::out_of_range("SlotMap::at");
+  }
+  return SlotValue(slot).second;
+}
+
+template <typename key_t, typename value_t>
+value_t& SlotMap<key_t, value_t>::operator[](const key_t key) {
+  return emplace(key).first->second;
+}
+
+template <typename key_t, typename value_t>
+template <typename... args_t>
+std::pair<typename SlotMap<key_t, value_t>::iterator, bool>
+SlotMap<key_t, value_t>::emplace(const key_t key, args_t&&... args) {
+  const uint32_t existing_slot = FindSlot(key);
+  if (existing_slot != kInvalidSlot) {
+    return std::make_pair(iterator(this, existing_slot), false);
+  }
+
+  uint32_t slot;
+  if (free_slots_.empty()) {
+    CHECK_LT(occupied_.size(), kInvalidSlot);
+    slot = static_cast<uint32_t>(occupied_.size());
+    if (slot == blocks_.size() * kBlockSize) {
+      blocks_.push_back(Eigen::aligned_allocator<Block>().allocate(1));
+    }
+    occupied_.push_back(false);
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+
+  new (&SlotValue(slot))
+      value_type(std::piecewise_construct, std::forward_as_tuple(key),
+                 std::forward_as_tuple(std::forward<args_t>(args)...));
+  occupied_[slot] = true;
+  size_ += 1;
+
+  SetSlot(key, slot);
+
+  return std::make_pair(iterator(this, slot), true);
+}
+
+template <typename key_t, typename value_t>
+size_t SlotMap<key_t, value_t>::erase(const key_t key) {
+  const uint32_t slot = FindSlot(key);
+  if (slot == kInvalidSlot) {
+    return 0;
+  }
+  erase(const_iterator(this, slot));
+  return 1;
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::iterator SlotMap<key_t, value_t>::erase(
+    const_iterator pos) {
+  const size_t slot = pos.slot_;
+  CHECK_LT(slot, occupied_.size());
+  CHECK(occupied_[slot]);
+
+  const key_t key = SlotValue(slot).first;
+  if (static_cast<size_t>(key) < dense_index_.size()) {
+    dense_index_[static_cast<size_t>(key)] = kInvalidSlot;
+  } else {
+    sparse_index_.erase(key);
+  }
+
+  SlotValue(slot).~value_type();
+  occupied_[slot] = false;
+  free_slots_.push_back(static_cast<uint32_t>(slot));
+  size_ -= 1;
+
+  return iterator(this, NextOccupiedSlot(slot + 1));
+}
+
+template <typename key_t, typename value_t>
+typename SlotMap<key_t, value_t>::value_type&
+SlotMap<key_t, value_t>::SlotValue(const size_t slot) {
+  return *reinterpret_cast<value_type*>(
+      &blocks_[slot / kBlockSize]->slots[slot % kBlockSize]);
+}
+
+template <typename key_t, typename value_t>
+const typename SlotMap<key_t, value_t>::value_type&
+SlotMap<key_t, value_t>::SlotValue(const size_t slot) const {
+  return *reinterpret_cast<const value_type*>(
+      &blocks_[slot / kBlockSize]->slots[slot % kBlockSize]);
+}
+
+template <typename key_t, typename value_t>
+size_t SlotMap<key_t, value_t>::NextOccupiedSlot(size_t slot) const {
+  while (slot < occupied_.size() && !occupied_[slot]) {
+    slot += 1;
+  }
+  return slot;
+}
+
+template <typename key_t, typename value_t>
+uint32_t SlotMap<key_t, value_t>::FindSlot(const key_t key) const {
+  if (static_cast<size_t>(key) < dense_index_.size()) {
+    return dense_index_[static_cast<size_t>(key)];
+  }
+  if (sparse_index_.empty()) {
+    return kInvalidSlot;
+  }
+  const auto it = sparse_index_.find(key);
+  return it == sparse_index_.end() ? kInvalidSlot : it->second;
+}
+
+template <typename key_t, typename value_t>
+void SlotMap<key_t, value_t>::SetSlot(const key_t key, const uint32_t slot) {
+  const size_t index = static_cast<size_t>(key);
+  if (index < dense_index_.size()) {
+    dense_index_[index] = slot;
+    return;
+  }
+
+  const size_t max_dense_index_size =
+      std::max(kMinDenseIndexSize, kMaxDenseIndexRatio * size_);
+  if (index >= max_dense_index_size) {
+    sparse_index_.emplace(key, slot);
+    return;
+  }
+
+  // Grow the dense index geometrically and move all identifiers that now fit
+  // into it from the hash index.
+  const size_t dense_index_size = std::min(
+      max_dense_index_size, std::max(index + 1, 2 * dense_index_.size()));
+  dense_index_.resize(dense_index_size, kInvalidSlot);
+  dense_index_[index] = slot;
+
+  for (auto it = sparse_index_.begin(); it != sparse_index_.end();) {
+    if (static_cast<size_t>(it->first) < dense_index_size) {
+      dense_index_[static_cast<size_t>(it->first)] = it->second;
+      it = sparse_index_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_UTIL_SLOT_MAP_H_
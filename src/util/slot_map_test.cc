@@ -0,0 +1,200 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "util/slot_map"
+#include "util/testing.h"
+
+#include <string>
+
+#include "util/slot_map.h"
+
+using namespace colmap;
+
+BOOST_AUTO_TEST_CASE(TestEmpty) {
+  SlotMap<uint32_t, int> map;
+  BOOST_CHECK_EQUAL(map.size(), 0);
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK(map.begin() == map.end());
+  BOOST_CHECK_EQUAL(map.count(0), 0);
+  BOOST_CHECK(map.find(0) == map.end());
+  BOOST_CHECK_THROW(map.at(0), std::out_of_range);
+  BOOST_CHECK_EQUAL(map.erase(0), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestEmplaceFindErase) {
+  SlotMap<uint32_t, std::string> map;
+  BOOST_CHECK(map.emplace(1, "1").second);
+  BOOST_CHECK(map.emplace(3, "3").second);
+  BOOST_CHECK(!map.emplace(1, "2").second);
+  BOOST_CHECK_EQUAL(map.size(), 2);
+  BOOST_CHECK_EQUAL(map.at(1), "1");
+  BOOST_CHECK_EQUAL(map.at(3), "3");
+  BOOST_CHECK_EQUAL(map.count(2), 0);
+  BOOST_CHECK_EQUAL(map.find(3)->first, 3);
+  BOOST_CHECK_EQUAL(map.find(3)->second, "3");
+
+  map[2] = "2";
+  BOOST_CHECK_EQUAL(map.size(), 3);
+  BOOST_CHECK_EQUAL(map.at(2), "2");
+  BOOST_CHECK_EQUAL(map[4], "");
+  BOOST_CHECK_EQUAL(map.size(), 4);
+
+  BOOST_CHECK_EQUAL(map.erase(1), 1);
+  BOOST_CHECK_EQUAL(map.erase(1), 0);
+  BOOST_CHECK_EQUAL(map.size(), 3);
+  BOOST_CHECK_EQUAL(map.count(1), 0);
+  BOOST_CHECK_THROW(map.at(1), std::out_of_range);
+
+  map.clear();
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK(map.begin() == map.end());
+  BOOST_CHECK_EQUAL(map.count(2), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestIteration) {
+  SlotMap<uint32_t, int> map;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    map.emplace(i, static_cast<int>(i));
+  }
+
+  for (auto it = map.begin(); it != map.end();) {
+    if (it->first % 2 == 0) {
+      it = map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), 500);
+  size_t num_elems = 0;
+  for (const auto& elem : map) {
+    BOOST_CHECK_EQUAL(elem.first % 2, 1);
+    BOOST_CHECK_EQUAL(elem.second, static_cast<int>(elem.first));
+    num_elems += 1;
+  }
+  BOOST_CHECK_EQUAL(num_elems, 500);
+
+  for (auto& elem : map) {
+    elem.second = -elem.second;
+  }
+  const SlotMap<uint32_t, int>& const_map = map;
+  for (SlotMap<uint32_t, int>::const_iterator it = const_map.begin();
+       it != const_map.end(); ++it) {
+    BOOST_CHECK_EQUAL(it->second, -static_cast<int>(it->first));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestStableReferences) {
+  SlotMap<uint32_t, int> map;
+  map.emplace(0, 0);
+  const int* ptr = &map.at(0);
+  for (uint32_t i = 1; i < 10000; ++i) {
+    map.emplace(i, static_cast<int>(i));
+    if (i % 3 == 0) {
+      map.erase(i - 1);
+    }
+  }
+  BOOST_CHECK_EQUAL(ptr, &map.at(0));
+  BOOST_CHECK_EQUAL(*ptr, 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestSlotReuse) {
+  SlotMap<uint32_t, int> map;
+  for (uint32_t i = 0; i < 10; ++i) {
+    map.emplace(i, static_cast<int>(i));
+  }
+  const int* ptr = &map.at(5);
+  map.erase(5);
+  map.emplace(10, 10);
+  BOOST_CHECK_EQUAL(ptr, &map.at(10));
+  BOOST_CHECK_EQUAL(map.size(), 10);
+}
+
+BOOST_AUTO_TEST_CASE(TestSparseKeys) {
+  SlotMap<uint64_t, int> map;
+  const uint64_t kLargeKey = std::numeric_limits<uint64_t>::max() - 1;
+  map.emplace(kLargeKey, 1);
+  map.emplace(5, 2);
+  map.emplace(100000, 3);
+  BOOST_CHECK_EQUAL(map.size(), 3);
+  BOOST_CHECK_EQUAL(map.at(kLargeKey), 1);
+  BOOST_CHECK_EQUAL(map.at(5), 2);
+  BOOST_CHECK_EQUAL(map.at(100000), 3);
+  BOOST_CHECK_EQUAL(map.count(std::numeric_limits<uint64_t>::max()), 0);
+
+  // Inserting many elements moves the previously sparse keys into the dense
+  // index, which must not change the lookups.
+  for (uint64_t i = 10; i < 10000; ++i) {
+    map.emplace(i, static_cast<int>(i));
+  }
+  BOOST_CHECK_EQUAL(map.at(kLargeKey), 1);
+  BOOST_CHECK_EQUAL(map.at(5), 2);
+  BOOST_CHECK_EQUAL(map.at(100000), 3);
+  BOOST_CHECK_EQUAL(map.at(9999), 9999);
+
+  BOOST_CHECK_EQUAL(map.erase(kLargeKey), 1);
+  BOOST_CHECK_EQUAL(map.erase(100000), 1);
+  BOOST_CHECK_EQUAL(map.count(kLargeKey), 0);
+  BOOST_CHECK_EQUAL(map.count(100000), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestCopyMove) {
+  SlotMap<uint32_t, std::string> map;
+  map.emplace(1, "1");
+  map.emplace(2, "2");
+  map.erase(1);
+
+  SlotMap<uint32_t, std::string> map_copy(map);
+  BOOST_CHECK_EQUAL(map_copy.size(), 1);
+  BOOST_CHECK_EQUAL(map_copy.at(2), "2");
+  BOOST_CHECK_EQUAL(map.at(2), "2");
+
+  SlotMap<uint32_t, std::string> map_move(std::move(map));
+  BOOST_CHECK_EQUAL(map_move.size(), 1);
+  BOOST_CHECK_EQUAL(map_move.at(2), "2");
+  BOOST_CHECK(map.empty());
+
+  map = map_move;
+  map_copy = std::move(map_move);
+  BOOST_CHECK_EQUAL(map.at(2), "2");
+  BOOST_CHECK_EQUAL(map_copy.at(2), "2");
+}
+
+BOOST_AUTO_TEST_CASE(TestEigenValues) {
+  SlotMap<uint32_t, Eigen::Vector4d> map;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    map.emplace(i, Eigen::Vector4d::Constant(i));
+    BOOST_CHECK_EQUAL(
+        reinterpret_cast<uintptr_t>(map.at(i).data()) % EIGEN_MAX_ALIGN_BYTES,
+        0);
+  }
+  BOOST_CHECK_EQUAL(map.at(999)(3), 999);
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_UTIL_SPAN_H_
+#define COLMAP_SRC_UTIL_SPAN_H_
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace colmap {
+
+// Non-owning view of a contiguous sequence of elements, similar to C++20's
+// `std::span`. The view is only valid as long as the underlying storage is
+// neither destroyed nor reallocated. Vectors implicitly convert to spans, so
+// that functions taking spans also accept vectors.
+template <typename T>
+class Span {
+ public:
+  typedef T element_type;
+  typedef typename std::remove_cv<T>::type value_type;
+  typedef T* iterator;
+  typedef T& reference;
+
+  Span() : data_(nullptr), size_(0) {}
+  Span(T* data, const size_t size) : data_(data), size_(size) {}
+
+  // Conversion from mutable to constant spans.
+  template <typename U, typename = typename std::enable_if<
+                            std::is_same<const U, T>::value>::type>
+  Span(const Span<U>& other) : data_(other.data()), size_(other.size()) {}
+
+  // Conversion from vectors.
+  template <typename U, typename = typename std::enable_if<std::is_same<
+                            typename std::remove_cv<T>::type, U>::value>::type>
+  Span(std::vector<U>& vector) : data_(vector.data()), size_(vector.size()) {}
+  template <typename U, typename = typename std::enable_if<
+                            std::is_same<const U, T>::value>::type>
+  Span(const std::vector<U>& vector)
+      : data_(vector.data()), size_(vector.size()) {}
+
+  T* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T* begin() const { return data_; }
+  T* end() const { return data_ + size_; }
+
+  T& front() const { return data_[0]; }
+  T& back() const { return data_[size_ - 1]; }
+
+  T& operator[](const size_t idx) const { return data_[idx]; }
+
+  // Bounds-checked access that throws `std::out_of_range`.
+  T& at(const size_t idx) const {
+    if (idx >= size_) {
+      throw std::out_of_range("Span::at");
+    }
+    return data_[idx];
+  }
+
+ private:
+  T* data_;
+  size_t size_;
+};
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_UTIL_SPAN_H_
@@ -32,12 +32,17 @@
 #include "util/string.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdarg>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include <sstream>
 
 #include <boost/algorithm/string.hpp>
 
+#include "util/logging.h"
+
 namespace colmap {
 namespace {
 
@@ -126,6 +131,164 @@ bool IsNotWhiteSpace(const int character) {
          character != '\t';
 }
 
+// Unsigned integer of fixed capacity, which is sufficient for the exact
+// comparison of decimal and binary floating point numbers in `ParseDouble`.
+class BigInteger {
+ public:
+  explicit BigInteger(uint64_t value = 0) : num_limbs_(0) {
+    for (; value > 0; value >>= 32) {
+      limbs_[num_limbs_++] = static_cast<uint32_t>(value);
+    }
+  }
+
+  // Only copy the used limbs.
+  BigInteger(const BigInteger& other) : num_limbs_(other.num_limbs_) {
+    memcpy(limbs_, other.limbs_, num_limbs_ * sizeof(uint32_t));
+  }
+
+  // Compute `factor * this + summand`.
+  void MultiplyAdd(const uint32_t factor, const uint32_t summand) {
+    uint64_t carry = summand;
+    for (int i = 0; i < num_limbs_; ++i) {
+      const uint64_t product =
+          static_cast<uint64_t>(limbs_[i]) * factor + carry;
+      limbs_[i] = static_cast<uint32_t>(product);
+      carry = product >> 32;
+    }
+    if (carry > 0) {
+      CHECK_LT(num_limbs_, kMaxNumLimbs);
+      limbs_[num_limbs_++] = static_cast<uint32_t>(carry);
+    }
+  }
+
+  void MultiplyPow5(int exponent) {
+    const uint32_t kPow5_13 = 1220703125;
+    for (; exponent >= 13; exponent -= 13) {
+      MultiplyAdd(kPow5_13, 0);
+    }
+    uint32_t factor = 1;
+    for (; exponent > 0; --exponent) {
+      factor *= 5;
+    }
+    MultiplyAdd(factor, 0);
+  }
+
+  void MultiplyPow2(const int exponent) {
+    if (num_limbs_ == 0) {
+      return;
+    }
+    const int limb_shift = exponent / 32;
+    const int bit_shift = exponent % 32;
+    CHECK_LT(num_limbs_ + limb_shift, kMaxNumLimbs);
+    if (bit_shift > 0) {
+      limbs_[num_limbs_] = 0;
+      for (int i = num_limbs_; i > 0; --i) {
+        limbs_[i] = (limbs_[i] << bit_shift) |
+                    (limbs_[i - 1] >> (32 - bit_shift));
+      }
+      limbs_[0] <<= bit_shift;
+      num_limbs_ += limbs_[num_limbs_] > 0;
+    }
+    if (limb_shift > 0) {
+      memmove(limbs_ + limb_shift, limbs_, num_limbs_ * sizeof(uint32_t));
+      memset(limbs_, 0, limb_shift * sizeof(uint32_t));
+      num_limbs_ += limb_shift;
+    }
+  }
+
+  int Compare(const BigInteger& other) const {
+    if (num_limbs_ != other.num_limbs_) {
+      return num_limbs_ < other.num_limbs_ ? -1 : 1;
+    }
+    for (int i = num_limbs_ - 1; i >= 0; --i) {
+      if (limbs_[i] != other.limbs_[i]) {
+        return limbs_[i] < other.limbs_[i] ? -1 : 1;
+      }
+    }
+    return 0;
+  }
+
+ private:
+  static const int kMaxNumLimbs = 256;
+  int num_limbs_;
+  uint32_t limbs_[kMaxNumLimbs];
+};
+
+// Compare `digits * 10^decimal_exponent` with `mantissa * 2^binary_exponent`.
+int CompareDecimalWithBinary(const BigInteger& digits,
+                             const int decimal_exponent,
+                             const uint64_t mantissa,
+                             const int binary_exponent) {
+  BigInteger lhs = digits;
+  BigInteger rhs(mantissa);
+  if (decimal_exponent >= 0) {
+    lhs.MultiplyPow5(decimal_exponent);
+  } else {
+    rhs.MultiplyPow5(-decimal_exponent);
+  }
+  if (decimal_exponent >= binary_exponent) {
+    lhs.MultiplyPow2(decimal_exponent - binary_exponent);
+  } else {
+    rhs.MultiplyPow2(binary_exponent - decimal_exponent);
+  }
+  return lhs.Compare(rhs);
+}
+
+// Decompose a non-negative, finite number into `mantissa * 2^exponent`, where
+// the exponent is the exponent of the unit in the last place of the number.
+void DecomposeDouble(const double value, uint64_t* mantissa, int* exponent) {
+  int value_exponent = 0;
+  std::frexp(value, &value_exponent);
+  *exponent = value == 0 ? -1074 : std::max(value_exponent - 53, -1074);
+  *mantissa = static_cast<uint64_t>(std::ldexp(value, -*exponent));
+}
+
+// Correctly round the non-negative number `digits * 10^exponent` given its
+// approximation, which is assumed to be off by only a few units in the last
+// place. The approximation is moved to the neighboring number as long as the
+// exact value lies beyond the midpoint between them, where ties are resolved
+// to the number with an even mantissa.
+double RoundDecimal(const BigInteger& digits, const int exponent,
+                    double value) {
+  const double kInf = std::numeric_limits<double>::infinity();
+  while (true) {
+    uint64_t mantissa;
+    int binary_exponent;
+    DecomposeDouble(value, &mantissa, &binary_exponent);
+    const bool odd = (mantissa & 1) != 0;
+
+    const int upper_cmp = CompareDecimalWithBinary(
+        digits, exponent, 2 * mantissa + 1, binary_exponent - 1);
+    if (upper_cmp > 0 || (upper_cmp == 0 && odd)) {
+      value = std::nextafter(value, kInf);
+      if (std::isinf(value)) {
+        return value;
+      }
+      continue;
+    }
+
+    if (value == 0) {
+      return value;
+    }
+
+    const double lower_value = std::nextafter(value, 0.0);
+    uint64_t lower_mantissa;
+    int lower_binary_exponent;
+    DecomposeDouble(lower_value, &lower_mantissa, &lower_binary_exponent);
+    const int lower_cmp = CompareDecimalWithBinary(
+        digits, exponent,
+        lower_mantissa +
+            (mantissa << (binary_exponent - lower_binary_exponent)),
+        lower_binary_exponent - 1);
+    if (lower_cmp < 0 || (lower_cmp == 0 && odd)) {
+      value = lower_value;
+      continue;
+    }
+
+    return value;
+  }
+}
+
 }  // namespace
 
 std::string StringPrintf(const char* format, ...) {
@@ -201,4 +364,203 @@ bool StringContains(const std::string& str, const std::string& sub_str) {
   return str.find(sub_str) != std::string::npos;
 }
 
+std::string EscapeJSONString(const std::string& str) {
+  std::string escaped;
+  escaped.reserve(str.size() + 2);
+  escaped += '"';
+  for (const char c : str) {
+    switch (c) {
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      case '\t':
+        escaped += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          escaped += StringPrintf("\\u%04x", c);
+        } else {
+          escaped += c;
+        }
+    }
+  }
+  escaped += '"';
+  return escaped;
+}
+
+// Numbers whose significant digits and decimal exponent can be represented
+// exactly are converted with a single, correctly rounded multiplication or
+// division, if possible in extended precision, e.g., with 17 significant
+// digits as written by COLMAP. All other numbers are approximated and then
+// correctly rounded using exact integer arithmetic.
+bool ParseDouble(const char* begin, const char* end, double* value) {
+  static const double kPowersOf10[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const int kMaxExactPowerOf10 = 22;
+  static const long double kPowersOf10Ext[] = {
+      1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,  1e8L,  1e9L,
+      1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+      1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L};
+  const int kMaxExactPowerOf10Ext = 27;
+  const uint64_t kMaxExactMantissa = uint64_t(1) << 53;
+  const int kMaxNumDigits = 19;
+  // Any number with more significant digits lies strictly between two
+  // midpoints of neighboring doubles, iff its truncation does.
+  const int kMaxNumExactDigits = 768;
+
+  const char* ptr = begin;
+  const bool negative = ptr != end && *ptr == '-';
+  if (ptr != end && (*ptr == '-' || *ptr == '+')) {
+    ++ptr;
+  }
+  const char* digits_begin = ptr;
+
+  uint64_t mantissa = 0;
+  int num_digits = 0;
+  int exponent = 0;
+  bool has_digits = false;
+  for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr) {
+    mantissa = 10 * mantissa + (*ptr - '0');
+    num_digits += mantissa > 0;
+    has_digits = true;
+  }
+  if (ptr != end && *ptr == '.') {
+    for (++ptr; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr) {
+      mantissa = 10 * mantissa + (*ptr - '0');
+      num_digits += mantissa > 0;
+      exponent -= 1;
+      has_digits = true;
+    }
+  }
+  const char* digits_end = ptr;
+  if (has_digits && ptr != end && (*ptr == 'e' || *ptr == 'E')) {
+    ++ptr;
+    const bool negative_exponent = ptr != end && *ptr == '-';
+    if (ptr != end && (*ptr == '-' || *ptr == '+')) {
+      ++ptr;
+    }
+    int exponent_value = 0;
+    has_digits = false;
+    for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr) {
+      exponent_value = std::min(10 * exponent_value + (*ptr - '0'), 10000);
+      has_digits = true;
+    }
+    exponent += negative_exponent ? -exponent_value : exponent_value;
+  }
+
+  if (!has_digits || ptr != end) {
+    std::string token(digits_begin, end);
+    StringToLower(&token);
+    if (token == "inf" || token == "infinity") {
+      *value = negative ? -std::numeric_limits<double>::infinity()
+                        : std::numeric_limits<double>::infinity();
+      return true;
+    } else if (token == "nan") {
+      *value = std::numeric_limits<double>::quiet_NaN();
+      return true;
+    }
+    return false;
+  }
+
+  if (num_digits <= kMaxNumDigits && mantissa <= kMaxExactMantissa &&
+      exponent >= -kMaxExactPowerOf10 && exponent <= kMaxExactPowerOf10) {
+    const double exact_value =
+        exponent < 0 ? mantissa / kPowersOf10[-exponent]
+                     : mantissa * kPowersOf10[exponent];
+    *value = negative ? -exact_value : exact_value;
+    return true;
+  }
+
+  // With extended precision, the same conversion is correctly rounded for all
+  // numbers with up to 19 significant digits, unless the rounded extended
+  // precision value lies next to the midpoint of two neighboring doubles.
+  if (std::numeric_limits<long double>::digits >= 64 &&
+      num_digits <= kMaxNumDigits && exponent >= -kMaxExactPowerOf10Ext &&
+      exponent <= kMaxExactPowerOf10Ext) {
+    const long double ext_value =
+        exponent < 0 ? mantissa / kPowersOf10Ext[-exponent]
+                     : mantissa * kPowersOf10Ext[exponent];
+    int ext_value_exponent;
+    const uint64_t ext_value_bits = static_cast<uint64_t>(
+        std::ldexp(std::frexp(ext_value, &ext_value_exponent),
+                   std::numeric_limits<uint64_t>::digits));
+    const uint64_t kExtraBitsMask = (1 << 11) - 1;
+    const uint64_t kMidpointBits = 1 << 10;
+    const uint64_t extra_bits = ext_value_bits & kExtraBitsMask;
+    if (extra_bits + 1 < kMidpointBits || extra_bits > kMidpointBits + 1) {
+      *value = negative ? -static_cast<double>(ext_value)
+                        : static_cast<double>(ext_value);
+      return true;
+    }
+  }
+
+  // Collect the significant digits exactly and their leading digits for the
+  // approximation of the number.
+  BigInteger digits;
+  uint64_t leading_digits = 0;
+  int num_leading_digits = 0;
+  int num_exact_digits = 0;
+  int num_truncated_digits = 0;
+  bool truncated_non_zero = false;
+  for (ptr = digits_begin; ptr != digits_end; ++ptr) {
+    if (*ptr == '.' || (num_exact_digits == 0 && *ptr == '0')) {
+      continue;
+    }
+    if (num_exact_digits == kMaxNumExactDigits) {
+      num_truncated_digits += 1;
+      truncated_non_zero |= *ptr != '0';
+      continue;
+    }
+    const uint32_t digit = *ptr - '0';
+    digits.MultiplyAdd(10, digit);
+    num_exact_digits += 1;
+    if (num_leading_digits < kMaxNumDigits) {
+      leading_digits = 10 * leading_digits + digit;
+      num_leading_digits += 1;
+    }
+  }
+
+  exponent += num_truncated_digits;
+
+  double approx_value = 0;
+  if (num_exact_digits > 0) {
+    // Decimal exponent of the leading digit.
+    const int leading_exponent = exponent + num_exact_digits - 1;
+    if (leading_exponent > 309) {
+      approx_value = std::numeric_limits<double>::infinity();
+    } else if (leading_exponent >= -325) {
+      const int approx_exponent =
+          exponent + num_exact_digits - num_leading_digits;
+      if (approx_exponent < -300) {
+        // Avoid the underflow of the power of 10 for subnormal numbers.
+        approx_value =
+            leading_digits * std::pow(10.0, approx_exponent + 300) / 1e300;
+      } else {
+        approx_value = leading_digits * std::pow(10.0, approx_exponent);
+      }
+      if (std::isinf(approx_value)) {
+        approx_value = std::numeric_limits<double>::max();
+      } else if (approx_value == 0) {
+        approx_value = std::numeric_limits<double>::denorm_min();
+      }
+      // The truncated digits only matter through being non-zero.
+      if (truncated_non_zero) {
+        digits.MultiplyAdd(10, 1);
+        exponent -= 1;
+      }
+      approx_value = RoundDecimal(digits, exponent, approx_value);
+    }
+  }
+
+  *value = negative ? -approx_value : approx_value;
+  return true;
+}
+
 }  // namespace colmap
@@ -68,6 +68,16 @@ void StringToUpper(std::string* str);
 // Check whether the sub-string is contained in the given string.
 bool StringContains(const std::string& str, const std::string& sub_str);
 
+// Quote the string and escape its special characters as a JSON string.
+std::string EscapeJSONString(const std::string& str);
+
+// Parse the decimal floating point number in [begin, end) independent of the
+// current locale, which also accepts "inf", "infinity", and "nan" in any case.
+// The result is correctly rounded and thus identical to `strtod` in the "C"
+// locale, but unlike `strtod`, leading whitespace and hexadecimal numbers are
+// not accepted. Returns false if the characters are not a valid number.
+bool ParseDouble(const char* begin, const char* end, double* value);
+
 }  // namespace colmap
 
 #endif  // COLMAP_SRC_UTIL_STRING_H_
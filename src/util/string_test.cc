@@ -32,10 +32,60 @@
 #define TEST_NAME "util/string"
 #include "util/testing.h"
 
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "util/random.h"
 #include "util/string.h"
 
 using namespace colmap;
 
+namespace {
+
+// Check that the number is parsed to the same value as by `strtod`, which is
+// correctly rounded in the "C" locale of the test.
+void CheckParseDouble(const std::string& str) {
+  double value = 0;
+  BOOST_REQUIRE_MESSAGE(
+      ParseDouble(str.data(), str.data() + str.size(), &value), str);
+  char* ref_end = nullptr;
+  const double ref_value = std::strtod(str.c_str(), &ref_end);
+  BOOST_REQUIRE_EQUAL(ref_end, str.c_str() + str.size());
+  if (std::isnan(ref_value)) {
+    BOOST_CHECK_MESSAGE(std::isnan(value), str);
+  } else {
+    BOOST_CHECK_MESSAGE(memcmp(&value, &ref_value, sizeof(double)) == 0,
+                        str << ": " << StringPrintf("%.17g", value)
+                            << " != " << StringPrintf("%.17g", ref_value));
+  }
+}
+
+void CheckInvalidDouble(const std::string& str) {
+  double value = 0;
+  BOOST_CHECK_MESSAGE(!ParseDouble(str.data(), str.data() + str.size(), &value),
+                      str);
+}
+
+// Exact decimal representation of the midpoint between the given number and
+// its upper neighbor, or of the closest numbers below and above the midpoint.
+// Requires extended precision, in which the midpoint is representable.
+std::string MidpointString(const double value, const int offset) {
+  const long double lower_value = value;
+  const long double upper_value =
+      std::nextafter(value, std::numeric_limits<double>::infinity());
+  long double midpoint = lower_value + (upper_value - lower_value) / 2;
+  if (offset < 0) {
+    midpoint = std::nextafter(midpoint, lower_value);
+  } else if (offset > 0) {
+    midpoint = std::nextafter(midpoint, upper_value);
+  }
+  return StringPrintf("%.1100Le", midpoint);
+}
+
+}  // namespace
+
 #define TEST_STRING_INPLACE(Func, str, ref_str) \
   {                                             \
     std::string str_inplace = str;              \
@@ -221,3 +271,151 @@ BOOST_AUTO_TEST_CASE(TestStringContains) {
   BOOST_CHECK(!StringContains("", "a"));
   BOOST_CHECK(!StringContains("ab", "c"));
 }
+
+BOOST_AUTO_TEST_CASE(TestEscapeJSONString) {
+  BOOST_CHECK_EQUAL(EscapeJSONString(""), "\"\"");
+  BOOST_CHECK_EQUAL(EscapeJSONString("abc"), "\"abc\"");
+  BOOST_CHECK_EQUAL(EscapeJSONString("a\"b\\c"), "\"a\\\"b\\\\c\"");
+  BOOST_CHECK_EQUAL(EscapeJSONString("a\nb\tc"), "\"a\\nb\\tc\"");
+  BOOST_CHECK_EQUAL(EscapeJSONString(std::string("a\x01", 2)),
+                    "\"a\\u0001\"");
+}
+
+BOOST_AUTO_TEST_CASE(TestParseDouble) {
+  for (const std::string str :
+       {"0", "-0", "+0", "0.0", "00.000", "0e10", "1", "-1", "+1", ".5", "5.",
+        "-.5e-1", "1e5", "1E+5", "1e-5", "123.456e-7", "0.1", "0.3",
+        "3.14159265358979", "0.30000000000000004", "1e22", "1e23",
+        "123456789e-5", "9007199254740992", "inf", "-inf", "INF", "Infinity",
+        "-INFINITY", "nan", "NaN", "-nan"}) {
+    CheckParseDouble(str);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestParseDoubleTiesToEven) {
+  for (const std::string str :
+       {"9007199254740993", "9007199254740995", "-9007199254740993",
+        "9007199254740993.0000000000000000000000000001",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000033306690738754696212708950042724609375",
+        "1.000000000000000111022302462515654042363166809082031250001",
+        "1.000000000000000111022302462515654042363166809082031249999",
+        "5e-324", "7.4109846876186982e-324", "2.4703282292062328e-324"}) {
+    CheckParseDouble(str);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestParseDoubleLimits) {
+  for (const std::string str :
+       {"4.9406564584124654e-324", "2.4703282292062327e-324",
+        "2.4703282292062328e-324", "1e-324", "-1e-324", "1e-320", "-1e-310",
+        "2.2250738585072009e-308", "2.2250738585072011e-308",
+        "2.2250738585072014e-308", "1.7976931348623157e308",
+        "1.7976931348623158e308", "1.7976931348623159e308", "1e308", "1e309",
+        "-1e400", "1e99999999999", "1e-99999999999", "0e99999999999",
+        "0.0000000000000000000000000000001e-300"}) {
+    CheckParseDouble(str);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestParseDoubleManyDigits) {
+  for (const std::string str :
+       {"12345678901234567890", "12345678901234567890123",
+        "0.12345678901234567890123456789e5",
+        "3.14159265358979323846264338327950288419716939937510",
+        "179769313486231580793728971405303415079934132710037826936173778980444"
+        "968292764750946649017977587207096330286416692887910946555547851940402"
+        "630657488671505820681908902000708383676273854845817711531764475730270"
+        "069855571366959622842914819860834936475292719074168444365510704342711"
+        "559699508093042880177904174497791.9999999999999999999999999999999999",
+        "2.4703282292062327208828439643411068618252990130716238221279284125033"
+        "775363510437593264991818081799618989828234772285886546332835517796989"
+        "819938739800539093906315035659515570226392290858392449105184435931802"
+        "849936536152500319370457678249219365623669863658480757001585769269903"
+        "706311928279558551332927834338409351978015531246597263579574622766465"
+        "272827220056374006485499977096599470454020828166226237857393450736339"
+        "007967761930577506740176324673600968951340535537458516661134223766678"
+        "604162159680461914467291840300530057530849048765391711386591646239524"
+        "912623653881879636239373280423891018672348497668235089863388587925628"
+        "302755995657524455507255189313690836254779186948667994968324049705821"
+        "028513185451396213837722826145437693412532098591327667236328125e-324",
+        "2.4703282292062327208828439643411068618252990130716238221279284125033"
+        "775363510437593264991818081799618989828234772285886546332835517796989"
+        "819938739800539093906315035659515570226392290858392449105184435931802"
+        "849936536152500319370457678249219365623669863658480757001585769269903"
+        "706311928279558551332927834338409351978015531246597263579574622766465"
+        "272827220056374006485499977096599470454020828166226237857393450736339"
+        "007967761930577506740176324673600968951340535537458516661134223766678"
+        "604162159680461914467291840300530057530849048765391711386591646239524"
+        "912623653881879636239373280423891018672348497668235089863388587925628"
+        "302755995657524455507255189313690836254779186948667994968324049705821"
+        "0285131854513962138377228261454376934125320985913276672363281250001e-"
+        "324"}) {
+    CheckParseDouble(str);
+  }
+
+  // Significant digits beyond the first 768 only matter through being zero or
+  // non-zero, which decides between a tie and rounding up.
+  CheckParseDouble(std::string(800, '1'));
+  CheckParseDouble("0." + std::string(800, '0') + "1");
+  CheckParseDouble("1" + std::string(900, '0') + "e-900");
+  CheckParseDouble("1.00000000000000011102230246251565404236316680908203125" +
+                   std::string(800, '0'));
+  CheckParseDouble("1.00000000000000011102230246251565404236316680908203125" +
+                   std::string(800, '0') + "1");
+
+  if (std::numeric_limits<long double>::digits >= 64) {
+    for (const double value :
+         {1.0, 0.1, 1e300, 1e-300, std::numeric_limits<double>::min(),
+          std::numeric_limits<double>::denorm_min(),
+          3 * std::numeric_limits<double>::denorm_min(),
+          std::nextafter(std::numeric_limits<double>::min(), 0.0)}) {
+      for (const int offset : {-1, 0, 1}) {
+        std::string str = MidpointString(value, offset);
+        CheckParseDouble(str);
+        str.insert(str.find('e'), "1");
+        CheckParseDouble(str);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestParseDoubleRandom) {
+  SetPRNGSeed(0);
+  for (int i = 0; i < 20000; ++i) {
+    uint64_t bits = 0;
+    for (int j = 0; j < 4; ++j) {
+      bits = (bits << 16) | RandomInteger<uint64_t>(0, 0xFFFF);
+    }
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!std::isfinite(value)) {
+      continue;
+    }
+    CheckParseDouble(StringPrintf("%.17g", value));
+    CheckParseDouble(StringPrintf("%.*e", RandomInteger(0, 25), value));
+  }
+
+  for (int i = 0; i < 20000; ++i) {
+    std::string str = RandomInteger(0, 1) ? "-" : "";
+    const int num_digits = RandomInteger(1, 30);
+    const int dot_pos = RandomInteger(0, num_digits);
+    for (int j = 0; j < num_digits; ++j) {
+      if (j == dot_pos) {
+        str += '.';
+      }
+      str += static_cast<char>('0' + RandomInteger(0, 9));
+    }
+    str += "e" + std::to_string(RandomInteger(-350, 330));
+    CheckParseDouble(str);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestParseDoubleInvalid) {
+  for (const std::string str :
+       {"", "+", "-", ".", "-.", "e5", "-e5", ".e5", "e", "1e", "1e+", "1e-",
+        "1.2.3", "1e5.5", "1e5e5", "--1", "+-1", "1-", "1,5", "0x10", " 1",
+        "1 ", "nanx", "infinit", "in", "abc", "1f", "1.5d"}) {
+    CheckInvalidDouble(str);
+  }
+}
@@ -31,6 +31,9 @@
 
 #include "util/threading.h"
 
+#include <deque>
+#include <stdexcept>
+
 #include "util/logging.h"
 
 namespace colmap {
@@ -183,9 +186,67 @@ void Thread::RunFunc() {
   Callback(FINISHED_CALLBACK);
 }
 
+namespace {
+
+// The pool and worker index of the current thread. Note that `thread_local`
+// only supports plain old data types on all platforms.
+thread_local const ThreadPool* current_thread_pool = nullptr;
+thread_local int current_thread_index = -1;
+
+}  // namespace
+
+struct ThreadPool::TaskQueue {
+  std::mutex mutex;
+  std::deque<std::function<void()>> tasks[ThreadPool::kNumPriorities];
+
+  void Push(const Priority priority, std::function<void()> task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    tasks[static_cast<int>(priority)].push_back(std::move(task));
+  }
+
+  bool PopFront(const int priority, std::function<void()>* task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto& queue = tasks[priority];
+    if (queue.empty()) {
+      return false;
+    }
+    *task = std::move(queue.front());
+    queue.pop_front();
+    return true;
+  }
+
+  bool PopBack(const int priority, std::function<void()>* task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto& queue = tasks[priority];
+    if (queue.empty()) {
+      return false;
+    }
+    *task = std::move(queue.back());
+    queue.pop_back();
+    return true;
+  }
+
+  size_t Clear() {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t num_tasks = 0;
+    for (auto& queue : tasks) {
+      num_tasks += queue.size();
+      queue.clear();
+    }
+    return num_tasks;
+  }
+};
+
 ThreadPool::ThreadPool(const int num_threads)
-    : stopped_(false), num_active_workers_(0) {
+    : shared_queue_(new TaskQueue()),
+      stopped_(false),
+      num_queued_tasks_(0),
+      num_unfinished_tasks_(0),
+      num_sleeping_workers_(0) {
   const int num_effective_threads = GetEffectiveNumThreads(num_threads);
+  for (int index = 0; index < num_effective_threads; ++index) {
+    worker_queues_.emplace_back(new TaskQueue());
+  }
   for (int index = 0; index < num_effective_threads; ++index) {
     std::function<void(void)> worker =
         std::bind(&ThreadPool::WorkerFunc, this, index);
@@ -204,10 +265,14 @@ void ThreadPool::Stop() {
     }
 
     stopped_ = true;
+  }
 
-    std::queue<std::function<void()>> empty_tasks;
-    std::swap(tasks_, empty_tasks);
+  size_t num_discarded_tasks = shared_queue_->Clear();
+  for (auto& worker_queue : worker_queues_) {
+    num_discarded_tasks += worker_queue->Clear();
   }
+  num_queued_tasks_ -= num_discarded_tasks;
+  num_unfinished_tasks_ -= num_discarded_tasks;
 
   task_condition_.notify_all();
 
@@ -215,57 +280,133 @@ void ThreadPool::Stop() {
     worker.join();
   }
 
-  finished_condition_.notify_all();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_condition_.notify_all();
+  }
 }
 
 void ThreadPool::Wait() {
+  CHECK(!IsWorkerThread())
+      << "Cannot wait for all tasks inside a task of the same thread pool";
   std::unique_lock<std::mutex> lock(mutex_);
-  if (!tasks_.empty() || num_active_workers_ > 0) {
-    finished_condition_.wait(
-        lock, [this]() { return tasks_.empty() && num_active_workers_ == 0; });
+  finished_condition_.wait(lock, [this]() {
+    return stopped_ || num_unfinished_tasks_ == 0;
+  });
+}
+
+void ThreadPool::PushTask(const Priority priority,
+                          std::function<void()> task) {
+  if (stopped_) {
+    throw std::runtime_error("Cannot add task to stopped thread pool.");
+  }
+
+  // Count the task before it is visible to the workers, so that the counters
+  // never underflow.
+  num_unfinished_tasks_ += 1;
+  num_queued_tasks_ += 1;
+
+  if (current_thread_pool == this) {
+    worker_queues_[current_thread_index]->Push(priority, std::move(task));
+  } else {
+    shared_queue_->Push(priority, std::move(task));
+  }
+
+  // Only take the lock, if a worker might be sleeping. Sleeping workers are
+  // counted before they check for queued tasks, so either they see the new
+  // task or we see them sleeping.
+  if (num_sleeping_workers_ > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_condition_.notify_one();
   }
 }
 
-void ThreadPool::WorkerFunc(const int index) {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    thread_id_to_index_.emplace(GetThreadId(), index);
+bool ThreadPool::PopTask(const int index, std::function<void()>* task) {
+  if (num_queued_tasks_ <= 0) {
+    return false;
   }
 
-  while (true) {
-    std::function<void()> task;
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      task_condition_.wait(lock,
-                           [this] { return stopped_ || !tasks_.empty(); });
-      if (stopped_ && tasks_.empty()) {
-        return;
+  const int num_workers = static_cast<int>(worker_queues_.size());
+  const int first_victim_index = index >= 0 ? index + 1 : 0;
+
+  for (int priority = kNumPriorities - 1; priority >= 0; --priority) {
+    // Prefer the most recent task of the own queue, whose data is most likely
+    // still in the cache, then the oldest task added from outside the pool,
+    // and finally steal the oldest task of another worker.
+    bool found_task =
+        (index >= 0 && worker_queues_[index]->PopBack(priority, task)) ||
+        shared_queue_->PopFront(priority, task);
+    for (int i = 0; !found_task && i < num_workers; ++i) {
+      const int victim_index = (first_victim_index + i) % num_workers;
+      if (victim_index != index) {
+        found_task = worker_queues_[victim_index]->PopFront(priority, task);
       }
-      task = std::move(tasks_.front());
-      tasks_.pop();
-      num_active_workers_ += 1;
     }
 
-    task();
-
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      num_active_workers_ -= 1;
+    if (found_task) {
+      num_queued_tasks_ -= 1;
+      return true;
     }
+  }
+
+  return false;
+}
 
+void ThreadPool::RunTask(std::function<void()>* task) {
+  (*task)();
+  *task = nullptr;
+
+  if (--num_unfinished_tasks_ == 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
     finished_condition_.notify_all();
   }
 }
 
+bool ThreadPool::RunPendingTask() {
+  CHECK(IsWorkerThread());
+  std::function<void()> task;
+  if (PopTask(current_thread_index, &task)) {
+    RunTask(&task);
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::WorkerFunc(const int index) {
+  current_thread_pool = this;
+  current_thread_index = index;
+
+  std::function<void()> task;
+  while (!stopped_) {
+    if (PopTask(index, &task)) {
+      RunTask(&task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_sleeping_workers_ += 1;
+    task_condition_.wait(
+        lock, [this] { return stopped_ || num_queued_tasks_ > 0; });
+    num_sleeping_workers_ -= 1;
+  }
+
+  current_thread_pool = nullptr;
+  current_thread_index = -1;
+}
+
 std::thread::id ThreadPool::GetThreadId() const {
   return std::this_thread::get_id();
 }
 
 int ThreadPool::GetThreadIndex() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return thread_id_to_index_.at(GetThreadId());
+  if (!IsWorkerThread()) {
+    throw std::out_of_range("Current thread is not a worker of the pool.");
+  }
+  return current_thread_index;
 }
 
+bool ThreadPool::IsWorkerThread() const { return current_thread_pool == this; }
+
 int GetEffectiveNumThreads(const int num_threads) {
   int num_effective_threads = num_threads;
   if (num_threads <= 0) {
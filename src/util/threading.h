@@ -32,13 +32,18 @@
 #ifndef COLMAP_SRC_UTIL_THREADING_
 #define COLMAP_SRC_UTIL_THREADING_
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <climits>
 #include <functional>
 #include <future>
 #include <list>
+#include <memory>
 #include <queue>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "util/timer.h"
 
@@ -194,7 +199,8 @@ class Thread {
   std::unordered_map<int, std::list<std::function<void()>>> callbacks_;
 };
 
-// A thread pool class to submit generic tasks (functors) to a pool of workers:
+// A work-stealing thread pool class to submit generic tasks (functors) to a
+// pool of workers:
 //
 //    ThreadPool thread_pool;
 //    thread_pool.AddTask([]() { /* Do some work */ });
@@ -205,10 +211,34 @@ class Thread {
 //    }
 //    thread_pool.Wait();
 //
+// Every worker owns a queue of tasks per priority. Tasks added by a worker are
+// pushed to its own queue and processed in LIFO order for cache locality,
+// while idle workers steal the oldest tasks of other workers. Tasks added from
+// outside the pool are processed in FIFO order. Higher priority tasks are
+// always preferred over lower priority tasks.
+//
+// Tasks may add subtasks and wait for them using `WaitFor` or `ParallelFor`,
+// e.g. a parallel loop inside of a parallel loop:
+//
+//    thread_pool.ParallelFor(0, 10, [&](const int64_t i) {
+//      thread_pool.ParallelFor(0, 100, [&](const int64_t j) { /* ... */ });
+//    });
+//
+// A waiting worker executes other pending tasks in the meantime, so nested
+// waits never deadlock the pool. Note that such a task may hence be
+// interleaved with other tasks on the same thread, i.e. tasks that wait for
+// subtasks must not hold locks or per-thread state (by `GetThreadIndex`)
+// that other tasks require.
 class ThreadPool {
  public:
   static const int kMaxNumThreads = -1;
 
+  enum class Priority {
+    LOW = 0,
+    NORMAL = 1,
+    HIGH = 2,
+  };
+
   explicit ThreadPool(const int num_threads = kMaxNumThreads);
   ~ThreadPool();
 
@@ -219,10 +249,32 @@ class ThreadPool {
   auto AddTask(func_t&& f, args_t&&... args)
       -> std::future<typename std::result_of<func_t(args_t...)>::type>;
 
+  // Add new task with the given priority to the thread pool.
+  template <class func_t, class... args_t>
+  auto AddTaskWithPriority(const Priority priority, func_t&& f,
+                           args_t&&... args)
+      -> std::future<typename std::result_of<func_t(args_t...)>::type>;
+
+  // Execute `func(i)` for all i in [begin, end) and wait for completion. The
+  // range is split into chunks of `chunk_size` iterations or, if zero, into
+  // a few chunks per worker to balance uneven iterations. Exceptions thrown
+  // by `func` are rethrown after all chunks finished. Can be called from
+  // inside tasks of this pool.
+  template <typename func_t>
+  void ParallelFor(const int64_t begin, const int64_t end, func_t&& func,
+                   const int64_t chunk_size = 0,
+                   const Priority priority = Priority::NORMAL);
+
+  // Wait until the task of the given future is finished. If called from a
+  // worker of this pool, the worker executes other tasks while waiting.
+  template <typename T>
+  void WaitFor(const std::future<T>& future);
+
   // Stop the execution of all workers.
   void Stop();
 
-  // Wait until tasks are finished.
+  // Wait until tasks are finished. Must not be called from inside a task of
+  // this pool, use `WaitFor` or `ParallelFor` instead.
   void Wait();
 
   // Get the unique identifier of the current thread.
@@ -233,20 +285,43 @@ class ThreadPool {
   // In other words, there are the thread indices 0, ..., N-1.
   int GetThreadIndex();
 
+  // Check whether the current thread is a worker of this pool.
+  bool IsWorkerThread() const;
+
  private:
+  struct TaskQueue;
+
+  static const int kNumPriorities = 3;
+
+  void PushTask(const Priority priority, std::function<void()> task);
+
+  // Pop the next task for the given worker index or, if negative, for an
+  // external thread. Returns false if there are no queued tasks.
+  bool PopTask(const int index, std::function<void()>* task);
+
+  // Execute the task and signal waiting threads, if all tasks finished.
+  void RunTask(std::function<void()>* task);
+
+  // Execute one pending task on the current worker, if there is any.
+  bool RunPendingTask();
+
   void WorkerFunc(const int index);
 
   std::vector<std::thread> workers_;
-  std::queue<std::function<void()>> tasks_;
+  std::vector<std::unique_ptr<TaskQueue>> worker_queues_;
+  std::unique_ptr<TaskQueue> shared_queue_;
 
   std::mutex mutex_;
   std::condition_variable task_condition_;
   std::condition_variable finished_condition_;
 
-  bool stopped_;
-  int num_active_workers_;
-
-  std::unordered_map<std::thread::id, int> thread_id_to_index_;
+  std::atomic<bool> stopped_;
+  // Number of tasks in the queues.
+  std::atomic<int64_t> num_queued_tasks_;
+  // Number of queued and currently executed tasks.
+  std::atomic<int64_t> num_unfinished_tasks_;
+  // Number of workers waiting for new tasks.
+  std::atomic<int> num_sleeping_workers_;
 };
 
 // A job queue class for the producer-consumer paradigm.
@@ -303,6 +378,10 @@ class JobQueue {
   // Pop a job from the queue. Waits if there is no job in the queue.
   Job Pop();
 
+  // Pop a job from the queue. Waits at most the given number of seconds if
+  // there is no job in the queue and returns an invalid job on timeout.
+  Job Pop(const double timeout_seconds);
+
   // Wait for all jobs to be popped and then stop the queue.
   void Wait();
 
@@ -312,7 +391,13 @@ class JobQueue {
   // Clear all pushed and not popped jobs from the queue.
   void Clear();
 
+  // Whether the queue was stopped.
+  bool IsStopped() const;
+
  private:
+  // Pop the front job, if the queue is not stopped. Requires the lock.
+  Job PopFront();
+
   size_t max_num_jobs_;
   std::atomic<bool> stop_;
   std::queue<T> jobs_;
@@ -335,6 +420,14 @@ size_t ThreadPool::NumThreads() const { return workers_.size(); }
 template <class func_t, class... args_t>
 auto ThreadPool::AddTask(func_t&& f, args_t&&... args)
     -> std::future<typename std::result_of<func_t(args_t...)>::type> {
+  return AddTaskWithPriority(Priority::NORMAL, std::forward<func_t>(f),
+                             std::forward<args_t>(args)...);
+}
+
+template <class func_t, class... args_t>
+auto ThreadPool::AddTaskWithPriority(const Priority priority, func_t&& f,
+                                     args_t&&... args)
+    -> std::future<typename std::result_of<func_t(args_t...)>::type> {
   typedef typename std::result_of<func_t(args_t...)>::type return_t;
 
   auto task = std::make_shared<std::packaged_task<return_t()>>(
@@ -342,17 +435,70 @@ auto ThreadPool::AddTask(func_t&& f, args_t&&... args)
 
   std::future<return_t> result = task->get_future();
 
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (stopped_) {
-      throw std::runtime_error("Cannot add task to stopped thread pool.");
-    }
-    tasks_.emplace([task]() { (*task)(); });
+  PushTask(priority, [task]() { (*task)(); });
+
+  return result;
+}
+
+template <typename func_t>
+void ThreadPool::ParallelFor(const int64_t begin, const int64_t end,
+                             func_t&& func, const int64_t chunk_size,
+                             const Priority priority) {
+  if (begin >= end) {
+    return;
   }
 
-  task_condition_.notify_one();
+  const int64_t num_iterations = end - begin;
+  int64_t effective_chunk_size = chunk_size;
+  if (effective_chunk_size <= 0) {
+    const int64_t kNumChunksPerThread = 4;
+    const int64_t num_chunks =
+        kNumChunksPerThread * static_cast<int64_t>(NumThreads());
+    effective_chunk_size =
+        std::max<int64_t>(1, (num_iterations + num_chunks - 1) / num_chunks);
+  }
 
-  return result;
+  std::vector<std::future<void>> futures;
+  futures.reserve(static_cast<size_t>(
+      (num_iterations + effective_chunk_size - 1) / effective_chunk_size));
+  for (int64_t chunk_begin = begin; chunk_begin < end;
+       chunk_begin += effective_chunk_size) {
+    const int64_t chunk_end =
+        std::min(end, chunk_begin + effective_chunk_size);
+    futures.push_back(
+        AddTaskWithPriority(priority, [&func, chunk_begin, chunk_end]() {
+          for (int64_t i = chunk_begin; i < chunk_end; ++i) {
+            func(i);
+          }
+        }));
+  }
+
+  // Wait for all chunks before rethrowing any exception, since the chunks
+  // reference the function object of the caller.
+  for (const auto& future : futures) {
+    WaitFor(future);
+  }
+
+  for (auto& future : futures) {
+    future.get();
+  }
+}
+
+template <typename T>
+void ThreadPool::WaitFor(const std::future<T>& future) {
+  if (!IsWorkerThread()) {
+    future.wait();
+    return;
+  }
+
+  while (future.wait_for(std::chrono::seconds(0)) !=
+         std::future_status::ready) {
+    if (!RunPendingTask()) {
+      // The awaited task is executed by another worker, so check for newly
+      // added tasks in regular intervals.
+      future.wait_for(std::chrono::microseconds(100));
+    }
+  }
 }
 
 template <typename T>
@@ -394,17 +540,21 @@ typename JobQueue<T>::Job JobQueue<T>::Pop() {
   while (jobs_.empty() && !stop_) {
     push_condition_.wait(lock);
   }
-  if (stop_) {
-    return Job();
-  } else {
-    const T data = jobs_.front();
-    jobs_.pop();
-    pop_condition_.notify_one();
-    if (jobs_.empty()) {
-      empty_condition_.notify_all();
+  return PopFront();
+}
+
+template <typename T>
+typename JobQueue<T>::Job JobQueue<T>::Pop(const double timeout_seconds) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration<double>(timeout_seconds);
+  while (jobs_.empty() && !stop_) {
+    if (push_condition_.wait_until(lock, deadline) ==
+        std::cv_status::timeout) {
+      break;
     }
-    return Job(data);
   }
+  return PopFront();
 }
 
 template <typename T>
@@ -429,6 +579,25 @@ void JobQueue<T>::Clear() {
   std::swap(jobs_, empty_jobs);
 }
 
+template <typename T>
+bool JobQueue<T>::IsStopped() const {
+  return stop_;
+}
+
+template <typename T>
+typename JobQueue<T>::Job JobQueue<T>::PopFront() {
+  if (stop_ || jobs_.empty()) {
+    return Job();
+  }
+  const T data = jobs_.front();
+  jobs_.pop();
+  pop_condition_.notify_one();
+  if (jobs_.empty()) {
+    empty_condition_.notify_all();
+  }
+  return Job(data);
+}
+
 }  // namespace colmap
 
 #endif  // COLMAP_SRC_UTIL_THREADING_
@@ -638,6 +638,132 @@ BOOST_AUTO_TEST_CASE(TestThreadPoolGetThreadIndex) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestThreadPoolGetThreadIndexOutsidePool) {
+  ThreadPool pool(2);
+  BOOST_CHECK(!pool.IsWorkerThread());
+  BOOST_CHECK_THROW(pool.GetThreadIndex(), std::out_of_range);
+  BOOST_CHECK(pool.AddTask([&]() { return pool.IsWorkerThread(); }).get());
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolPriority) {
+  ThreadPool pool(1);
+
+  // Block the only worker until all tasks are queued.
+  std::promise<void> unblock;
+  std::shared_future<void> unblocked = unblock.get_future().share();
+  pool.AddTask([unblocked]() { unblocked.wait(); });
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto Func = [&](const int value) {
+    std::unique_lock<std::mutex> lock(mutex);
+    order.push_back(value);
+  };
+
+  pool.AddTaskWithPriority(ThreadPool::Priority::LOW, Func, 0);
+  pool.AddTaskWithPriority(ThreadPool::Priority::NORMAL, Func, 1);
+  pool.AddTaskWithPriority(ThreadPool::Priority::HIGH, Func, 2);
+  pool.AddTaskWithPriority(ThreadPool::Priority::NORMAL, Func, 3);
+  pool.AddTaskWithPriority(ThreadPool::Priority::HIGH, Func, 4);
+
+  unblock.set_value();
+  pool.Wait();
+
+  BOOST_REQUIRE_EQUAL(order.size(), 5);
+  BOOST_CHECK_EQUAL(order[0], 2);
+  BOOST_CHECK_EQUAL(order[1], 4);
+  BOOST_CHECK_EQUAL(order[2], 1);
+  BOOST_CHECK_EQUAL(order[3], 3);
+  BOOST_CHECK_EQUAL(order[4], 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolParallelFor) {
+  ThreadPool pool(4);
+
+  std::vector<int> results(1000, 0);
+  pool.ParallelFor(0, results.size(),
+                   [&](const int64_t i) { results[i] += i; });
+  for (size_t i = 0; i < results.size(); ++i) {
+    BOOST_CHECK_EQUAL(results[i], i);
+  }
+
+  pool.ParallelFor(10, 20, [&](const int64_t i) { results[i] = -1; }, 3);
+  for (size_t i = 0; i < results.size(); ++i) {
+    BOOST_CHECK_EQUAL(results[i], (i >= 10 && i < 20) ? -1 : i);
+  }
+
+  std::atomic<int> num_empty_iterations(0);
+  pool.ParallelFor(5, 5, [&](const int64_t) { num_empty_iterations += 1; });
+  BOOST_CHECK_EQUAL(num_empty_iterations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolParallelForException) {
+  ThreadPool pool(4);
+  std::atomic<int> num_iterations(0);
+  BOOST_CHECK_THROW(pool.ParallelFor(0, 100,
+                                     [&](const int64_t i) {
+                                       num_iterations += 1;
+                                       if (i == 50) {
+                                         throw std::runtime_error("");
+                                       }
+                                     },
+                                     1),
+                    std::runtime_error);
+  BOOST_CHECK_EQUAL(num_iterations, 100);
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolNestedParallelFor) {
+  // More outer iterations than workers, such that all workers wait for their
+  // nested loops at the same time.
+  for (const int num_threads : {1, 2, 4}) {
+    ThreadPool pool(num_threads);
+    std::vector<std::vector<int>> results(16, std::vector<int>(100, 0));
+    std::atomic<int> num_non_worker_iterations(0);
+    pool.ParallelFor(
+        0, results.size(),
+        [&](const int64_t i) {
+          pool.ParallelFor(
+              0, results[i].size(),
+              [&](const int64_t j) {
+                if (!pool.IsWorkerThread()) {
+                  num_non_worker_iterations += 1;
+                }
+                results[i][j] = i * j;
+              },
+              1);
+        },
+        1);
+    BOOST_CHECK_EQUAL(num_non_worker_iterations, 0);
+    for (size_t i = 0; i < results.size(); ++i) {
+      for (size_t j = 0; j < results[i].size(); ++j) {
+        BOOST_CHECK_EQUAL(results[i][j], i * j);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolNestedWaitFor) {
+  ThreadPool pool(2);
+
+  std::function<int(int)> Fibonacci;
+  Fibonacci = [&](const int n) {
+    if (n < 2) {
+      return n;
+    }
+    auto future1 = pool.AddTask(Fibonacci, n - 1);
+    auto future2 = pool.AddTask(Fibonacci, n - 2);
+    pool.WaitFor(future1);
+    pool.WaitFor(future2);
+    return future1.get() + future2.get();
+  };
+
+  auto future = pool.AddTask(Fibonacci, 15);
+  pool.WaitFor(future);
+  BOOST_CHECK_EQUAL(future.get(), 610);
+
+  pool.Wait();
+}
+
 BOOST_AUTO_TEST_CASE(TestJobQueueSingleProducerSingleConsumer) {
   JobQueue<int> job_queue;
 
@@ -870,6 +996,37 @@ BOOST_AUTO_TEST_CASE(TestJobQueueClear) {
   BOOST_CHECK_EQUAL(job_queue.Size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(TestJobQueuePopTimeout) {
+  JobQueue<int> job_queue;
+
+  Timer timer;
+  timer.Start();
+  BOOST_CHECK(!job_queue.Pop(0.1).IsValid());
+  BOOST_CHECK_GE(timer.ElapsedSeconds(), 0.1);
+  BOOST_CHECK(!job_queue.IsStopped());
+
+  BOOST_CHECK(job_queue.Push(1));
+  const auto job = job_queue.Pop(0.1);
+  BOOST_CHECK(job.IsValid());
+  BOOST_CHECK_EQUAL(job.Data(), 1);
+
+  std::thread producer_thread([&job_queue]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(job_queue.Push(2));
+  });
+
+  const auto delayed_job = job_queue.Pop(10);
+  BOOST_CHECK(delayed_job.IsValid());
+  BOOST_CHECK_EQUAL(delayed_job.Data(), 2);
+  producer_thread.join();
+
+  job_queue.Stop();
+  BOOST_CHECK(job_queue.IsStopped());
+  timer.Restart();
+  BOOST_CHECK(!job_queue.Pop(10).IsValid());
+  BOOST_CHECK_LT(timer.ElapsedSeconds(), 10);
+}
+
 BOOST_AUTO_TEST_CASE(TestGetEffectiveNumThreads) {
   BOOST_CHECK_GT(GetEffectiveNumThreads(-2), 0);
   BOOST_CHECK_GT(GetEffectiveNumThreads(-1), 0);
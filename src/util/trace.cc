@@ -0,0 +1,508 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#include "util/trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include "util/logging.h"
+#include "util/misc.h"
+#include "util/string.h"
+#include "util/threading.h"
+
+namespace colmap {
+
+struct Tracer::ThreadBuffer {
+  static const size_t kChunkSize = 1024;
+
+  // The sequence number is the index of the event plus one and it is reset to
+  // zero while the event is written, such that readers can discard events
+  // that were overwritten while copying them. The event is copied word by
+  // word through relaxed atomics, since readers may copy it concurrently.
+  struct Slot {
+    static const size_t kNumWords = sizeof(TraceEvent) / sizeof(uint64_t);
+    static_assert(sizeof(TraceEvent) % sizeof(uint64_t) == 0,
+                  "Trace events must consist of whole words");
+
+    void Store(const TraceEvent& event) {
+      uint64_t event_words[kNumWords];
+      std::memcpy(event_words, &event, sizeof(TraceEvent));
+      for (size_t i = 0; i < kNumWords; ++i) {
+        words[i].store(event_words[i], std::memory_order_relaxed);
+      }
+    }
+
+    TraceEvent Load() const {
+      uint64_t event_words[kNumWords];
+      for (size_t i = 0; i < kNumWords; ++i) {
+        event_words[i] = words[i].load(std::memory_order_relaxed);
+      }
+      TraceEvent event;
+      std::memcpy(&event, event_words, sizeof(TraceEvent));
+      return event;
+    }
+
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> words[kNumWords];
+  };
+
+  struct Chunk {
+    Chunk() {
+      for (auto& slot : slots) {
+        slot.seq.store(0, std::memory_order_relaxed);
+      }
+    }
+    Slot slots[kChunkSize];
+  };
+
+  ThreadBuffer(const uint64_t session, const size_t num_slots)
+      : session(session),
+        num_slots(num_slots),
+        num_chunks((num_slots + kChunkSize - 1) / kChunkSize),
+        chunks(new std::atomic<Chunk*>[num_chunks]),
+        num_events(0) {
+    for (size_t i = 0; i < num_chunks; ++i) {
+      chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~ThreadBuffer() {
+    for (size_t i = 0; i < num_chunks; ++i) {
+      delete chunks[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  // Only called by the owning thread and without locking. The chunks are
+  // allocated on demand, since most threads record only few events.
+  void Add(const TraceEvent& event) {
+    const uint64_t event_idx = num_events.load(std::memory_order_relaxed);
+    if (num_slots > 0) {
+      const size_t slot_idx = event_idx % num_slots;
+      std::atomic<Chunk*>& chunk = chunks[slot_idx / kChunkSize];
+      if (chunk.load(std::memory_order_relaxed) == nullptr) {
+        chunk.store(new Chunk(), std::memory_order_release);
+      }
+      Slot& slot =
+          chunk.load(std::memory_order_relaxed)->slots[slot_idx % kChunkSize];
+      slot.seq.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.Store(event);
+      slot.seq.store(event_idx + 1, std::memory_order_release);
+    }
+    num_events.store(event_idx + 1, std::memory_order_release);
+  }
+
+  // Append the most recent events ordered by their recording time.
+  void AppendEvents(std::vector<TraceEvent>* events) const {
+    const uint64_t end_idx = num_events.load(std::memory_order_acquire);
+    for (uint64_t event_idx = end_idx - std::min<uint64_t>(end_idx, num_slots);
+         event_idx < end_idx; ++event_idx) {
+      const size_t slot_idx = event_idx % num_slots;
+      const Slot& slot = chunks[slot_idx / kChunkSize]
+                             .load(std::memory_order_acquire)
+                             ->slots[slot_idx % kChunkSize];
+      if (slot.seq.load(std::memory_order_acquire) != event_idx + 1) {
+        continue;
+      }
+      const TraceEvent event = slot.Load();
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == event_idx + 1) {
+        events->push_back(event);
+      }
+    }
+  }
+
+  size_t NumDroppedEvents() const {
+    const uint64_t end_idx = num_events.load(std::memory_order_acquire);
+    return end_idx - std::min<uint64_t>(end_idx, num_slots);
+  }
+
+  const uint64_t session;
+  uint32_t thread_idx = 0;
+  // Guarded by the mutex of the tracer.
+  std::string thread_name;
+
+  const size_t num_slots;
+  const size_t num_chunks;
+  std::unique_ptr<std::atomic<Chunk*>[]> chunks;
+  std::atomic<uint64_t> num_events;
+};
+
+// Releases the buffer of its thread, when the thread exits.
+struct Tracer::ThreadBufferOwner {
+  ThreadBuffer* thread_buffer = nullptr;
+
+  ~ThreadBufferOwner() {
+    if (thread_buffer != nullptr) {
+      Tracer::Instance().ReleaseThreadBuffer(thread_buffer);
+    }
+  }
+};
+
+Tracer& Tracer::Instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::Tracer()
+    : enabled_(false),
+      session_(0),
+      start_time_(std::chrono::steady_clock::now()),
+      max_num_events_per_thread_(kDefaultMaxNumEventsPerThread),
+      num_threads_(0),
+      exited_num_dropped_events_(0) {}
+
+void Tracer::Start(const std::string& output_path,
+                   const size_t max_num_events_per_thread) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  session_ += 1;
+  exited_events_.clear();
+  exited_events_.shrink_to_fit();
+  exited_num_dropped_events_ = 0;
+  exited_thread_names_.clear();
+  output_path_ = output_path;
+  max_num_events_per_thread_ = max_num_events_per_thread;
+  start_time_ = std::chrono::steady_clock::now();
+  enabled_ = true;
+}
+
+void Tracer::Stop() {
+  if (!enabled_.exchange(false)) {
+    return;
+  }
+
+  PrintSummary();
+
+  if (!output_path_.empty()) {
+    WriteChromeTrace(output_path_);
+    std::cout << StringPrintf("Wrote trace to %s", output_path_.c_str())
+              << std::endl;
+  }
+}
+
+int64_t Tracer::NowMicroSeconds() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start_time_)
+      .count();
+}
+
+uint16_t& Tracer::ThreadDepth() {
+  static thread_local uint16_t depth = 0;
+  return depth;
+}
+
+Tracer::ThreadBuffer* Tracer::GetThreadBuffer() {
+  static thread_local ThreadBufferOwner owner;
+  ThreadBuffer* thread_buffer = owner.thread_buffer;
+  if (thread_buffer != nullptr &&
+      thread_buffer->session == session_.load(std::memory_order_acquire)) {
+    return thread_buffer;
+  }
+
+  // First event of the thread in the current session.
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_ptr<ThreadBuffer> new_thread_buffer(
+      new ThreadBuffer(session_, max_num_events_per_thread_));
+  if (thread_buffer == nullptr) {
+    num_threads_ += 1;
+    new_thread_buffer->thread_idx = num_threads_;
+    thread_buffers_.push_back(std::move(new_thread_buffer));
+    owner.thread_buffer = thread_buffers_.back().get();
+  } else {
+    new_thread_buffer->thread_idx = thread_buffer->thread_idx;
+    new_thread_buffer->thread_name = thread_buffer->thread_name;
+    for (auto& other_thread_buffer : thread_buffers_) {
+      if (other_thread_buffer.get() == thread_buffer) {
+        other_thread_buffer = std::move(new_thread_buffer);
+        owner.thread_buffer = other_thread_buffer.get();
+        break;
+      }
+    }
+  }
+
+  return owner.thread_buffer;
+}
+
+void Tracer::ReleaseThreadBuffer(ThreadBuffer* thread_buffer) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (thread_buffer->session == session_) {
+    thread_buffer->AppendEvents(&exited_events_);
+    exited_num_dropped_events_ += thread_buffer->NumDroppedEvents();
+    if (!thread_buffer->thread_name.empty()) {
+      exited_thread_names_.emplace_back(thread_buffer->thread_idx,
+                                        thread_buffer->thread_name);
+    }
+  }
+  thread_buffers_.erase(
+      std::find_if(thread_buffers_.begin(), thread_buffers_.end(),
+                   [thread_buffer](const std::unique_ptr<ThreadBuffer>& other) {
+                     return other.get() == thread_buffer;
+                   }));
+}
+
+void Tracer::SetThreadName(const std::string& name) {
+  if (!IsEnabled()) {
+    return;
+  }
+  ThreadBuffer* thread_buffer = GetThreadBuffer();
+  std::unique_lock<std::mutex> lock(mutex_);
+  thread_buffer->thread_name = name;
+}
+
+void Tracer::RecordSpan(const char* name, const uint16_t depth,
+                        const int64_t begin_us, const int64_t duration_us,
+                        const char* arg_name, const double arg_value,
+                        const size_t peak_memory) {
+  ThreadBuffer* thread_buffer = GetThreadBuffer();
+  TraceEvent event;
+  event.type = TraceEvent::Type::SPAN;
+  event.depth = depth;
+  event.thread_idx = thread_buffer->thread_idx;
+  event.name = name;
+  event.begin_us = begin_us;
+  event.duration_us = duration_us;
+  event.arg_name = arg_name;
+  event.arg_value = arg_value;
+  event.peak_memory = peak_memory;
+  thread_buffer->Add(event);
+}
+
+void Tracer::RecordCounter(const char* name, const double value) {
+  if (!IsEnabled()) {
+    return;
+  }
+  ThreadBuffer* thread_buffer = GetThreadBuffer();
+  TraceEvent event;
+  event.type = TraceEvent::Type::COUNTER;
+  event.thread_idx = thread_buffer->thread_idx;
+  event.name = name;
+  event.begin_us = NowMicroSeconds();
+  event.arg_name = name;
+  event.arg_value = value;
+  thread_buffer->Add(event);
+}
+
+std::vector<TraceEvent> Tracer::Events() const {
+  std::vector<TraceEvent> events;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    events = exited_events_;
+    for (const auto& thread_buffer : thread_buffers_) {
+      if (thread_buffer->session == session_) {
+        thread_buffer->AppendEvents(&events);
+      }
+    }
+  }
+
+  // Spans are recorded when they end, so parents follow their children.
+  std::stable_sort(events.begin(), events.end(),
+                   [](const TraceEvent& event1, const TraceEvent& event2) {
+                     if (event1.thread_idx != event2.thread_idx) {
+                       return event1.thread_idx < event2.thread_idx;
+                     } else if (event1.begin_us != event2.begin_us) {
+                       return event1.begin_us < event2.begin_us;
+                     } else {
+                       return event1.depth < event2.depth;
+                     }
+                   });
+
+  return events;
+}
+
+size_t Tracer::NumDroppedEvents() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t num_dropped_events = exited_num_dropped_events_;
+  for (const auto& thread_buffer : thread_buffers_) {
+    if (thread_buffer->session == session_) {
+      num_dropped_events += thread_buffer->NumDroppedEvents();
+    }
+  }
+  return num_dropped_events;
+}
+
+void Tracer::WriteChromeTrace(const std::string& path) const {
+  const std::vector<TraceEvent> events = Events();
+
+  std::ofstream file(path, std::ios::trunc);
+  CHECK(file.is_open()) << path;
+
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+          "\"args\":{\"name\":\"COLMAP\"}}";
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::vector<std::pair<uint32_t, std::string>> thread_names =
+        exited_thread_names_;
+    for (const auto& thread_buffer : thread_buffers_) {
+      if (thread_buffer->session == session_ &&
+          !thread_buffer->thread_name.empty()) {
+        thread_names.emplace_back(thread_buffer->thread_idx,
+                                  thread_buffer->thread_name);
+      }
+    }
+    for (const auto& thread_name : thread_names) {
+      file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+           << thread_name.first << ",\"args\":{\"name\":"
+           << EscapeJSONString(thread_name.second) << "}}";
+    }
+  }
+
+  for (const auto& event : events) {
+    if (event.type == TraceEvent::Type::SPAN) {
+      file << ",\n{\"name\":" << EscapeJSONString(event.name)
+           << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_idx
+           << ",\"ts\":" << event.begin_us << ",\"dur\":" << event.duration_us
+           << ",\"args\":{";
+      if (event.arg_name != nullptr) {
+        file << EscapeJSONString(event.arg_name) << ":" << event.arg_value;
+      }
+      if (event.peak_memory > 0) {
+        file << (event.arg_name != nullptr ? "," : "")
+             << "\"peak_memory_mb\":" << event.peak_memory / (1024 * 1024);
+      }
+      file << "}}";
+      if (event.peak_memory > 0) {
+        file << ",\n{\"name\":\"peak_memory_mb\",\"ph\":\"C\",\"pid\":1,"
+                "\"tid\":"
+             << event.thread_idx
+             << ",\"ts\":" << event.begin_us + event.duration_us
+             << ",\"args\":{\"value\":" << event.peak_memory / (1024 * 1024)
+             << "}}";
+      }
+    } else {
+      file << ",\n{\"name\":" << EscapeJSONString(event.name)
+           << ",\"ph\":\"C\",\"pid\":1,\"tid\":" << event.thread_idx
+           << ",\"ts\":" << event.begin_us << ",\"args\":{\"value\":"
+           << event.arg_value << "}}";
+    }
+  }
+
+  file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{"
+       << "\"num_dropped_events\":" << NumDroppedEvents() << "}}\n";
+}
+
+void Tracer::PrintSummary() const {
+  struct StageStats {
+    size_t num_calls = 0;
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+    size_t peak_memory = 0;
+  };
+
+  // Aggregate the spans by their nested names over all threads. Comparing
+  // the paths by component sorts the children directly after their parent.
+  std::map<std::vector<std::string>, StageStats> stage_stats;
+  std::vector<std::string> path;
+  uint32_t thread_idx = 0;
+  for (const auto& event : Events()) {
+    if (event.type != TraceEvent::Type::SPAN) {
+      continue;
+    }
+    if (event.thread_idx != thread_idx) {
+      thread_idx = event.thread_idx;
+      path.clear();
+    }
+    // Spans whose parents were dropped from the ring buffer are attributed
+    // to the closest recorded ancestor.
+    path.resize(std::min<size_t>(path.size(), event.depth));
+    path.push_back(event.name);
+    auto& stats = stage_stats[path];
+    stats.num_calls += 1;
+    stats.total_us += event.duration_us;
+    stats.max_us = std::max(stats.max_us, event.duration_us);
+    stats.peak_memory = std::max(stats.peak_memory, event.peak_memory);
+  }
+
+  PrintHeading1("Trace summary");
+
+  std::cout << StringPrintf("%-48s %10s %12s %12s %12s", "Stage", "Calls",
+                            "Total [s]", "Max [s]", "Memory [MB]")
+            << std::endl;
+  for (const auto& stats : stage_stats) {
+    const std::string name =
+        std::string(2 * (stats.first.size() - 1), ' ') + stats.first.back();
+    const std::string peak_memory =
+        stats.second.peak_memory > 0
+            ? std::to_string(stats.second.peak_memory / (1024 * 1024))
+            : "-";
+    std::cout << StringPrintf("%-48s %10d %12.3f %12.3f %12s", name.c_str(),
+                              static_cast<int>(stats.second.num_calls),
+                              stats.second.total_us / 1e6,
+                              stats.second.max_us / 1e6, peak_memory.c_str())
+              << std::endl;
+  }
+
+  const size_t num_dropped_events = NumDroppedEvents();
+  if (num_dropped_events > 0) {
+    std::cout << StringPrintf(
+                     "WARNING: Dropped %d events due to full buffers; the "
+                     "summary only covers the most recent events.",
+                     static_cast<int>(num_dropped_events))
+              << std::endl;
+  }
+}
+
+ScopedTraceSpan::ScopedTraceSpan(const char* name,
+                                 const bool record_peak_memory)
+    : name_(name),
+      enabled_(Tracer::Instance().IsEnabled()),
+      record_peak_memory_(record_peak_memory),
+      begin_us_(0),
+      arg_name_(nullptr),
+      arg_value_(0) {
+  if (enabled_) {
+    begin_us_ = Tracer::Instance().NowMicroSeconds();
+    Tracer::ThreadDepth() += 1;
+  }
+}
+
+ScopedTraceSpan::~ScopedTraceSpan() {
+  if (!enabled_) {
+    return;
+  }
+  auto& tracer = Tracer::Instance();
+  auto& depth = Tracer::ThreadDepth();
+  depth -= 1;
+  tracer.RecordSpan(name_, depth, begin_us_,
+                    tracer.NowMicroSeconds() - begin_us_, arg_name_,
+                    arg_value_, record_peak_memory_ ? GetPeakMemoryUsage() : 0);
+}
+
+ScopedTraceStage::ScopedTraceStage(const char* name)
+    : ScopedTraceSpan(name, /*record_peak_memory=*/true) {}
+
+}  // namespace colmap
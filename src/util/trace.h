@@ -0,0 +1,219 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_UTIL_TRACE_H_
+#define COLMAP_SRC_UTIL_TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace colmap {
+
+// Low-overhead tracing of scoped spans and counters, e.g.:
+//
+//    Tracer::Instance().Start("trace.json");
+//    ...
+//    {
+//      COLMAP_TRACE_SCOPE("RegisterNextImage");
+//      ...
+//    }
+//    ...
+//    Tracer::Instance().Stop();
+//
+// The events are recorded lock-free in a ring buffer per thread, such that
+// threads never wait for each other, and the most recent events are kept if
+// the buffer overflows. The buffers of exited threads are collected and
+// released when the threads exit. The trace is written in the Chrome trace
+// event format and can be inspected in `chrome://tracing` or
+// https://ui.perfetto.dev.
+// If tracing is disabled, a span costs a single atomic load.
+//
+// All names must be string literals or otherwise outlive the tracer.
+
+struct TraceEvent {
+  enum class Type : uint8_t {
+    SPAN,
+    COUNTER,
+  };
+
+  Type type = Type::SPAN;
+  // Nesting level of the span in its thread.
+  uint16_t depth = 0;
+  // Sequential index of the recording thread.
+  uint32_t thread_idx = 0;
+  const char* name = nullptr;
+  // Start time and duration in microseconds since the start of the tracer.
+  int64_t begin_us = 0;
+  int64_t duration_us = 0;
+  // Optional argument of spans or the value of counters.
+  const char* arg_name = nullptr;
+  double arg_value = 0;
+  // Peak memory usage in bytes at the end of stage spans or zero.
+  size_t peak_memory = 0;
+};
+
+class Tracer {
+ public:
+  // Maximum number of events kept per thread.
+  static const size_t kDefaultMaxNumEventsPerThread = 1 << 16;
+
+  static Tracer& Instance();
+
+  // Start recording events and discard the events of previous sessions. If an
+  // output path is given, the trace is written to it when tracing is stopped.
+  void Start(const std::string& output_path = "",
+             const size_t max_num_events_per_thread =
+                 kDefaultMaxNumEventsPerThread);
+
+  // Stop recording events, print the per-stage summary, and write the trace
+  // to the output path given to `Start`. Does nothing if not started.
+  void Stop();
+
+  inline bool IsEnabled() const;
+
+  // Microseconds since the start of the tracer.
+  int64_t NowMicroSeconds() const;
+
+  // Name the current thread in the exported trace. Only has an effect, if
+  // tracing is enabled.
+  void SetThreadName(const std::string& name);
+
+  // Record a completed span or the value of a counter for the current thread.
+  void RecordSpan(const char* name, const uint16_t depth,
+                  const int64_t begin_us, const int64_t duration_us,
+                  const char* arg_name, const double arg_value,
+                  const size_t peak_memory);
+  void RecordCounter(const char* name, const double value);
+
+  // Get all recorded events ordered by thread and start time.
+  std::vector<TraceEvent> Events() const;
+
+  // Number of events that were overwritten due to full ring buffers.
+  size_t NumDroppedEvents() const;
+
+  // Write the recorded events in the Chrome trace event JSON format.
+  void WriteChromeTrace(const std::string& path) const;
+
+  // Print the number of calls, the total and maximum wall time per nested
+  // stage, and the peak memory usage recorded by stage spans.
+  void PrintSummary() const;
+
+  // Current nesting depth of the spans of this thread.
+  static uint16_t& ThreadDepth();
+
+ private:
+  struct ThreadBuffer;
+  struct ThreadBufferOwner;
+
+  Tracer();
+
+  ThreadBuffer* GetThreadBuffer();
+
+  // Collect the events of an exiting thread and destroy its buffer.
+  void ReleaseThreadBuffer(ThreadBuffer* thread_buffer);
+
+  std::atomic<bool> enabled_;
+  // Incremented for every started session. Buffers of previous sessions are
+  // ignored and replaced by their threads on their next event.
+  std::atomic<uint64_t> session_;
+  std::chrono::steady_clock::time_point start_time_;
+  std::string output_path_;
+  size_t max_num_events_per_thread_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers_;
+  uint32_t num_threads_;
+
+  // Collected events, number of dropped events, and names of exited threads.
+  std::vector<TraceEvent> exited_events_;
+  size_t exited_num_dropped_events_;
+  std::vector<std::pair<uint32_t, std::string>> exited_thread_names_;
+};
+
+// Records the wall time of its lifetime as a span of the current thread.
+class ScopedTraceSpan {
+ public:
+  explicit ScopedTraceSpan(const char* name,
+                           const bool record_peak_memory = false);
+  ~ScopedTraceSpan();
+
+  // Attach a numeric argument to the span, e.g. the identifier of an image.
+  inline void SetArg(const char* name, const double value);
+
+ private:
+  const char* name_;
+  const bool enabled_;
+  const bool record_peak_memory_;
+  int64_t begin_us_;
+  const char* arg_name_;
+  double arg_value_;
+};
+
+// A span for coarse pipeline stages, which additionally records the peak
+// memory usage of the process at the end of the stage. Querying the memory
+// usage requires a system call, so this should not be used in tight loops.
+class ScopedTraceStage : public ScopedTraceSpan {
+ public:
+  explicit ScopedTraceStage(const char* name);
+};
+
+#define COLMAP_TRACE_CONCAT_IMPL(a, b) a##b
+#define COLMAP_TRACE_CONCAT(a, b) COLMAP_TRACE_CONCAT_IMPL(a, b)
+
+#define COLMAP_TRACE_SCOPE(name) \
+  ::colmap::ScopedTraceSpan COLMAP_TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#define COLMAP_TRACE_STAGE(name)                                       \
+  ::colmap::ScopedTraceStage COLMAP_TRACE_CONCAT(trace_stage_, __LINE__)( \
+      name)
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tracer::IsEnabled() const {
+  return enabled_.load(std::memory_order_relaxed);
+}
+
+void ScopedTraceSpan::SetArg(const char* name, const double value) {
+  arg_name_ = name;
+  arg_value_ = value;
+}
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_UTIL_TRACE_H_
@@ -0,0 +1,240 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "util/trace"
+#include "util/testing.h"
+
+#include <atomic>
+#include <fstream>
+#include <set>
+#include <thread>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "util/misc.h"
+#include "util/trace.h"
+
+using namespace colmap;
+
+BOOST_AUTO_TEST_CASE(TestDisabled) {
+  Tracer::Instance().Stop();
+  BOOST_CHECK(!Tracer::Instance().IsEnabled());
+  { COLMAP_TRACE_SCOPE("Span"); }
+  Tracer::Instance().RecordCounter("Counter", 1);
+  Tracer::Instance().Start();
+  BOOST_CHECK(Tracer::Instance().IsEnabled());
+  BOOST_CHECK(Tracer::Instance().Events().empty());
+  Tracer::Instance().Stop();
+  BOOST_CHECK(!Tracer::Instance().IsEnabled());
+}
+
+BOOST_AUTO_TEST_CASE(TestNesting) {
+  Tracer::Instance().Start();
+  {
+    COLMAP_TRACE_STAGE("Outer");
+    {
+      ScopedTraceSpan span("Inner");
+      span.SetArg("image_id", 42);
+    }
+    Tracer::Instance().RecordCounter("Counter", 3);
+  }
+  BOOST_CHECK_EQUAL(Tracer::ThreadDepth(), 0);
+  Tracer::Instance().Stop();
+
+  const std::vector<TraceEvent> events = Tracer::Instance().Events();
+  BOOST_REQUIRE_EQUAL(events.size(), 3);
+
+  const TraceEvent* outer = nullptr;
+  const TraceEvent* inner = nullptr;
+  const TraceEvent* counter = nullptr;
+  for (const auto& event : events) {
+    if (std::string(event.name) == "Outer") {
+      outer = &event;
+    } else if (std::string(event.name) == "Inner") {
+      inner = &event;
+    } else if (std::string(event.name) == "Counter") {
+      counter = &event;
+    }
+  }
+
+  BOOST_REQUIRE(outer != nullptr);
+  BOOST_REQUIRE(inner != nullptr);
+  BOOST_REQUIRE(counter != nullptr);
+  BOOST_CHECK(outer->type == TraceEvent::Type::SPAN);
+  BOOST_CHECK_EQUAL(outer->depth, 0);
+  BOOST_CHECK_GT(outer->peak_memory, 0);
+  BOOST_CHECK(inner->type == TraceEvent::Type::SPAN);
+  BOOST_CHECK_EQUAL(inner->depth, 1);
+  BOOST_CHECK_EQUAL(inner->peak_memory, 0);
+  BOOST_CHECK_EQUAL(std::string(inner->arg_name), "image_id");
+  BOOST_CHECK_EQUAL(inner->arg_value, 42);
+  BOOST_CHECK_GE(inner->begin_us, outer->begin_us);
+  BOOST_CHECK_LE(inner->begin_us + inner->duration_us,
+                 outer->begin_us + outer->duration_us);
+  BOOST_CHECK(counter->type == TraceEvent::Type::COUNTER);
+  BOOST_CHECK_EQUAL(counter->arg_value, 3);
+}
+
+BOOST_AUTO_TEST_CASE(TestRingBuffer) {
+  Tracer::Instance().Start("", 4);
+  for (int i = 0; i < 10; ++i) {
+    ScopedTraceSpan span("Span");
+    span.SetArg("index", i);
+  }
+  Tracer::Instance().Stop();
+
+  const std::vector<TraceEvent> events = Tracer::Instance().Events();
+  BOOST_REQUIRE_EQUAL(events.size(), 4);
+  BOOST_CHECK_EQUAL(Tracer::Instance().NumDroppedEvents(), 6);
+  for (size_t i = 0; i < events.size(); ++i) {
+    BOOST_CHECK_EQUAL(events[i].arg_value, 6 + i);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestMultipleThreads) {
+  Tracer::Instance().Start();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([]() {
+      for (int j = 0; j < 100; ++j) {
+        COLMAP_TRACE_SCOPE("Span");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  Tracer::Instance().Stop();
+  BOOST_CHECK_EQUAL(Tracer::Instance().Events().size(), 400);
+  BOOST_CHECK_EQUAL(Tracer::Instance().NumDroppedEvents(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestExitedThreads) {
+  Tracer::Instance().Start();
+  for (int i = 0; i < 8; ++i) {
+    std::thread thread([i]() {
+      Tracer::Instance().SetThreadName("Thread" + std::to_string(i));
+      for (int j = 0; j < 10; ++j) {
+        ScopedTraceSpan span("Span");
+        span.SetArg("thread", i);
+      }
+    });
+    thread.join();
+  }
+  Tracer::Instance().Stop();
+
+  const std::vector<TraceEvent> events = Tracer::Instance().Events();
+  BOOST_REQUIRE_EQUAL(events.size(), 80);
+  std::set<uint32_t> thread_idxs;
+  for (size_t i = 0; i < events.size(); ++i) {
+    BOOST_CHECK_EQUAL(events[i].arg_value, i / 10);
+    thread_idxs.insert(events[i].thread_idx);
+  }
+  BOOST_CHECK_EQUAL(thread_idxs.size(), 8);
+  BOOST_CHECK_EQUAL(Tracer::Instance().NumDroppedEvents(), 0);
+
+  // The next session does not contain the events of the exited threads.
+  Tracer::Instance().Start();
+  Tracer::Instance().Stop();
+  BOOST_CHECK(Tracer::Instance().Events().empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestConcurrentExport) {
+  const size_t kMaxNumEventsPerThread = 100;
+  Tracer::Instance().Start("", kMaxNumEventsPerThread);
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([i, &stop]() {
+      while (!stop) {
+        ScopedTraceSpan span("Span");
+        span.SetArg("thread", i);
+      }
+    });
+  }
+  int num_exports = 0;
+  while (num_exports < 100) {
+    const std::vector<TraceEvent> events = Tracer::Instance().Events();
+    if (!events.empty()) {
+      num_exports += 1;
+    }
+    BOOST_CHECK_LE(events.size(), 4 * kMaxNumEventsPerThread);
+    for (const auto& event : events) {
+      BOOST_CHECK_EQUAL(std::string(event.name), "Span");
+      BOOST_CHECK_LT(event.arg_value, 4);
+    }
+  }
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  Tracer::Instance().Stop();
+  BOOST_CHECK_GT(Tracer::Instance().Events().size(), 0);
+  BOOST_CHECK_LE(Tracer::Instance().Events().size(),
+                 4 * kMaxNumEventsPerThread);
+}
+
+BOOST_AUTO_TEST_CASE(TestWriteChromeTrace) {
+  const std::string path = "test_trace.json";
+  Tracer::Instance().Start(path);
+  Tracer::Instance().SetThreadName("Main");
+  {
+    COLMAP_TRACE_STAGE("Stage");
+    COLMAP_TRACE_SCOPE("Span");
+    Tracer::Instance().RecordCounter("Counter", 1);
+  }
+  Tracer::Instance().Stop();
+
+  boost::property_tree::ptree tree;
+  boost::property_tree::read_json(path, tree);
+  size_t num_metadata = 0;
+  size_t num_spans = 0;
+  size_t num_counters = 0;
+  for (const auto& event : tree.get_child("traceEvents")) {
+    const std::string phase = event.second.get<std::string>("ph");
+    if (phase == "M") {
+      num_metadata += 1;
+    } else if (phase == "X") {
+      num_spans += 1;
+    } else if (phase == "C") {
+      num_counters += 1;
+    }
+  }
+  // Process and thread name.
+  BOOST_CHECK_EQUAL(num_metadata, 2);
+  BOOST_CHECK_EQUAL(num_spans, 2);
+  // Explicit counter and peak memory of the stage.
+  BOOST_CHECK_EQUAL(num_counters, 2);
+  BOOST_CHECK_EQUAL(tree.get<size_t>("otherData.num_dropped_events"), 0);
+
+  boost::filesystem::remove(path);
+}